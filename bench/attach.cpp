@@ -0,0 +1,138 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/attach.h"
+
+/*
+ * Replays a synthetic trace of attached thread scans through the attacher
+ * aggregation. Each round is one DetectThreadsAttachedToProtectedProcess
+ * call, the attachers mimic what is seen attached to a real game:
+ *
+ *  - the system process and csrss, attached with a few threads most rounds
+ *  - defender scanning the game's memory in bursts of 8 threads
+ *  - an overlay attaching one thread every round, signed but not allowed
+ *  - a cheat renamed to csrss.exe, unsigned, attaching in short bursts
+ *  - short lived attaches from random processes
+ *
+ * Before aggregating every one of these threads was its own report.
+ */
+
+namespace {
+
+struct attach_trace {
+  std::vector<std::vector<ATTACH_SAMPLE>> rounds;
+  uint64_t samples = 0;
+};
+
+const ATTACH_ALLOWLIST_ENTRY ALLOWLIST[] = {
+    {"System", ATTACH_SIGNING_LEVEL_WINDOWS_TCB},
+    {"csrss.exe", ATTACH_SIGNING_LEVEL_WINDOWS_TCB},
+    {"lsass.exe", ATTACH_SIGNING_LEVEL_WINDOWS},
+    {"MsMpEng.exe", ATTACH_SIGNING_LEVEL_ANTIMALWARE}};
+
+/* scans are 100ms apart, in 100ns units like KeQueryInterruptTime */
+constexpr uint64_t ROUND_INTERVAL = 1000000;
+
+void add_samples(std::vector<ATTACH_SAMPLE> &round, uint32_t process_id,
+                 const char *image_name, UINT8 signature_level,
+                 uint32_t threads) {
+  for (uint32_t thread = 0; thread < threads; thread++) {
+    ATTACH_SAMPLE sample = {};
+    sample.process = 0xffffc00000000000ull + (uint64_t)process_id * 0x1000;
+    sample.process_id = process_id;
+    sample.signature_level = signature_level;
+    sample.thread = sample.process + 0x10000000ull + thread * 0x800;
+    sample.thread_id = process_id * 0x100 + thread * 4;
+    strncpy(sample.image_name, image_name, ATTACH_IMAGE_NAME_LENGTH - 1);
+    round.push_back(sample);
+  }
+}
+
+attach_trace make_attach_trace(uint32_t round_count) {
+  bench::xorshift random;
+  attach_trace trace;
+
+  trace.rounds.resize(round_count);
+
+  for (uint32_t index = 0; index < round_count; index++) {
+    std::vector<ATTACH_SAMPLE> &round = trace.rounds[index];
+
+    if (random.next() % 10 < 9)
+      add_samples(round, 4, "System", 0x1e, 2 + random.next() % 3);
+
+    if (random.next() % 4 == 0)
+      add_samples(round, 600, "csrss.exe", 0x3e, 1);
+
+    if (index % 50 < 5)
+      add_samples(round, 3200, "MsMpEng.exe", 0x37, 8);
+
+    add_samples(round, 9000, "overlay.exe", 0x04, 1);
+
+    if (index % 200 < 2)
+      add_samples(round, 14000, "csrss.exe", 0x01, 4);
+
+    if (random.next() % 20 == 0)
+      add_samples(round, 20000 + random.next() % 2000, "helper.exe", 0x04,
+                  1 + random.next() % 2);
+
+    trace.samples += round.size();
+  }
+
+  return trace;
+}
+
+const attach_trace &get_trace(uint32_t round_count) {
+  static std::vector<std::pair<uint32_t, attach_trace>> traces;
+
+  for (auto &entry : traces)
+    if (entry.first == round_count)
+      return entry.second;
+
+  traces.emplace_back(round_count, make_attach_trace(round_count));
+  return traces.back().second;
+}
+
+void count_report(PATTACHER Attacher, PVOID Context) {
+  benchmark::DoNotOptimize(Attacher->rounds);
+}
+
+} // namespace
+
+static void replay_attach_trace(benchmark::State &state) {
+  const attach_trace &trace =
+      get_trace(static_cast<uint32_t>(state.range(0)));
+  ATTACH_TRACKER tracker;
+
+  for (auto _ : state) {
+    AttachTrackerInitialise(&tracker, ALLOWLIST,
+                            sizeof(ALLOWLIST) / sizeof(ALLOWLIST[0]),
+                            count_report, nullptr);
+
+    uint64_t timestamp = 0;
+    for (const std::vector<ATTACH_SAMPLE> &round : trace.rounds) {
+      AttachTrackerBeginRound(&tracker, timestamp += ROUND_INTERVAL);
+
+      for (const ATTACH_SAMPLE &sample : round)
+        AttachTrackerRecord(&tracker, const_cast<PATTACH_SAMPLE>(&sample));
+
+      AttachTrackerEndRound(&tracker);
+    }
+
+    AttachTrackerFlush(&tracker);
+  }
+
+  state.SetItemsProcessed(state.iterations() * trace.samples);
+  state.counters["rounds"] = static_cast<double>(trace.rounds.size());
+  state.counters["samples"] = static_cast<double>(tracker.samples);
+  state.counters["allowed"] = static_cast<double>(tracker.allowed);
+  state.counters["reports"] = static_cast<double>(tracker.reports);
+  state.counters["overflowed"] = static_cast<double>(tracker.overflowed);
+  state.counters["reduction"] =
+      tracker.reports ? static_cast<double>(tracker.samples) / tracker.reports
+                      : 0.0;
+}
+BENCHMARK(replay_attach_trace)->Arg(1000)->Arg(100000);
@@ -0,0 +1,175 @@
+#include <benchmark/benchmark.h>
+
+#include <utility>
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/dataptr.h"
+
+/*
+ * Builds and rescans a data pointer map over 128 synthetic module images, each
+ * a .text and a .data section of 64 pages. The first half of every .data
+ * section is filled like an ops table, every other slot points into the .text
+ * of a module, the rest of .data holds integers and heap pointers. That is
+ * around 10^6 tracked slots on half of the data pages.
+ *
+ * Building the map is what every run cost before, when nothing was tracked
+ * between runs. A rescan only reads the tracked pages.
+ */
+
+namespace {
+
+constexpr uint32_t MODULE_COUNT = 128;
+constexpr uint32_t SECTION_PAGES = 64;
+constexpr uint32_t SECTION_SIZE = SECTION_PAGES * bench::PAGE_SIZE;
+constexpr uint32_t SLOTS_PER_PAGE = bench::PAGE_SIZE / sizeof(UINT64);
+
+/* the first .data section follows the headers and the first .text section */
+constexpr uint32_t TEXT_OFFSET = bench::PAGE_SIZE;
+constexpr uint32_t DATA_OFFSET = TEXT_OFFSET + SECTION_SIZE;
+
+/* kernel heap addresses, outside of every module */
+constexpr uint64_t HEAP_BASE = 0xffffa08000000000ull;
+
+struct synthetic_modules {
+  std::vector<std::vector<char>> images;
+  std::vector<DATA_POINTER_REGION> regions;
+  std::vector<DATA_POINTER_PAGE> pages;
+  std::vector<DATA_POINTER_SLOT> slots;
+  DATA_POINTER_MAP map = {};
+
+  synthetic_modules() {
+    bench::xorshift random;
+
+    for (uint32_t index = 0; index < MODULE_COUNT; index++)
+      this->images.push_back(bench::make_pe_image(2, SECTION_SIZE));
+
+    for (std::vector<char> &image : this->images)
+      this->fill_data(image, random);
+
+    this->regions.resize(MODULE_COUNT);
+    this->pages.resize(MODULE_COUNT * SECTION_PAGES);
+    this->slots.resize(MODULE_COUNT * SECTION_PAGES * SLOTS_PER_PAGE);
+
+    this->map.translate = translate;
+    this->map.region_capacity = static_cast<UINT32>(this->regions.size());
+    this->map.regions = this->regions.data();
+    this->map.page_capacity = static_cast<UINT32>(this->pages.size());
+    this->map.pages = this->pages.data();
+    this->map.slot_capacity = static_cast<UINT32>(this->slots.size());
+    this->map.slots = this->slots.data();
+  }
+
+  PUINT64 data(uint32_t module) {
+    return reinterpret_cast<PUINT64>(this->images[module].data() +
+                                     DATA_OFFSET);
+  }
+
+  void fill_data(std::vector<char> &image, bench::xorshift &random) {
+    PUINT64 data = reinterpret_cast<PUINT64>(image.data() + DATA_OFFSET);
+    uint32_t count = SECTION_PAGES * SLOTS_PER_PAGE;
+
+    for (uint32_t index = 0; index < count; index++) {
+      uint64_t value = random.next();
+
+      if (index < count / 2 && index % 2 == 0) {
+        uint32_t module = static_cast<uint32_t>(value % this->images.size());
+        data[index] = reinterpret_cast<UINT64>(this->images[module].data()) +
+                      TEXT_OFFSET + (value >> 32) % SECTION_SIZE;
+      } else if (index % 3) {
+        data[index] = value % 0x10000;
+      } else {
+        data[index] = HEAP_BASE + value % 0x1000000;
+      }
+    }
+  }
+
+  /* the images are ordinary user memory, every page is resident */
+  static PVOID translate(UINT64 Address, PVOID Context) {
+    return reinterpret_cast<PVOID>(Address);
+  }
+
+  void build() {
+    PE_VIEW view;
+
+    DataPointerMapReset(&this->map);
+
+    for (std::vector<char> &image : this->images) {
+      PeViewInitialise(&view, image.data(), image.size());
+      DataPointerMapAddCodeSections(&this->map, &view);
+    }
+
+    DataPointerMapSortRegions(&this->map);
+
+    for (std::vector<char> &image : this->images) {
+      PeViewInitialise(&view, image.data(), image.size());
+      DataPointerMapAddImage(&this->map, &view);
+    }
+  }
+};
+
+synthetic_modules &get_modules() {
+  static synthetic_modules modules;
+  return modules;
+}
+
+void count_report(UINT64 Address, UINT64 Baseline, UINT64 Current,
+                  PVOID Context) {
+  (*static_cast<uint64_t *>(Context))++;
+}
+
+} // namespace
+
+static void build_data_pointer_map(benchmark::State &state) {
+  synthetic_modules &modules = get_modules();
+
+  for (auto _ : state)
+    modules.build();
+
+  state.SetItemsProcessed(state.iterations() * MODULE_COUNT * SECTION_PAGES *
+                          SLOTS_PER_PAGE);
+  state.counters["slots"] = static_cast<double>(modules.map.slot_count);
+  state.counters["pages"] = static_cast<double>(modules.map.page_count);
+  state.counters["dropped"] = static_cast<double>(modules.map.dropped);
+}
+BENCHMARK(build_data_pointer_map)->Unit(benchmark::kMillisecond);
+
+/* range(0) tracked slots are hooked before every rescan */
+static void rescan_data_pointer_map(benchmark::State &state) {
+  synthetic_modules &modules = get_modules();
+  uint32_t hooks = static_cast<uint32_t>(state.range(0));
+  uint64_t reports = 0;
+  uint64_t hook = HEAP_BASE;
+  std::vector<std::pair<PUINT64, UINT64>> hooked;
+  bench::xorshift random;
+
+  modules.build();
+
+  for (auto _ : state) {
+    for (uint32_t index = 0; index < hooks; index++) {
+      uint32_t module = static_cast<uint32_t>(random.next() % MODULE_COUNT);
+      uint32_t slot = static_cast<uint32_t>(
+          random.next() % (SECTION_PAGES * SLOTS_PER_PAGE / 4));
+      PUINT64 address = &modules.data(module)[slot * 2];
+
+      hooked.emplace_back(address, *address);
+      *address = hook++;
+    }
+
+    DataPointerMapRescan(&modules.map, 0, count_report, &reports);
+  }
+
+  /* unhook in reverse, a slot may have been hooked more then once */
+  for (auto entry = hooked.rbegin(); entry != hooked.rend(); entry++)
+    *entry->first = entry->second;
+
+  state.SetItemsProcessed(state.iterations() * modules.map.slot_count);
+  state.counters["slots"] = static_cast<double>(modules.map.slot_count);
+  state.counters["reports"] = benchmark::Counter(
+      static_cast<double>(reports), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(rescan_data_pointer_map)
+    ->Arg(0)
+    ->Arg(16)
+    ->Unit(benchmark::kMillisecond);
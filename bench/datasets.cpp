@@ -0,0 +1,117 @@
+#include "datasets.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "../core/pe.h"
+
+uint64_t bench::xorshift::next() {
+  this->state ^= this->state << 13;
+  this->state ^= this->state >> 7;
+  this->state ^= this->state << 17;
+  return this->state;
+}
+
+void bench::fill_random(void *buffer, size_t size, uint64_t seed) {
+  xorshift rng(seed);
+  uint8_t *bytes = static_cast<uint8_t *>(buffer);
+
+  for (size_t index = 0; index < size; index += sizeof(uint64_t)) {
+    uint64_t value = rng.next();
+    size_t remaining = size - index;
+    memcpy(bytes + index, &value,
+           remaining < sizeof(uint64_t) ? remaining : sizeof(uint64_t));
+  }
+}
+
+std::vector<char> bench::make_signature_haystack(size_t size,
+                                                 const char *signature,
+                                                 size_t signature_length) {
+  /* ScanForSignature may read up to SignatureLength bytes past the end */
+  std::vector<char> buffer(size + signature_length);
+  fill_random(buffer.data(), buffer.size());
+  memcpy(buffer.data() + size - 64, signature, signature_length);
+  return buffer;
+}
+
+std::vector<char> bench::make_pool_pages(uint32_t page_count, const char *tag,
+                                         uint32_t tag_stride) {
+  std::vector<char> pages(static_cast<size_t>(page_count) * PAGE_SIZE);
+  fill_random(pages.data(), pages.size());
+
+  /*
+   * Pool allocations are 16 byte aligned and the tag lives at offset 4 of the
+   * POOL_HEADER, place the tag somewhere in the second half of the page.
+   */
+  xorshift rng(DATASET_SEED ^ page_count);
+  for (uint32_t page = 0; page < page_count; page += tag_stride) {
+    uint32_t offset = PAGE_SIZE / 2 + (rng.next() % (PAGE_SIZE / 2 - 16));
+    offset = (offset & ~0xfu) + 4;
+    memcpy(pages.data() + static_cast<size_t>(page) * PAGE_SIZE + offset, tag,
+           4);
+  }
+
+  return pages;
+}
+
+std::vector<char> bench::make_pe_image(uint32_t section_count,
+                                       uint32_t section_size) {
+  const uint32_t nt_offset = 0x80;
+  const uint32_t headers_size = PAGE_SIZE;
+  std::vector<char> image(headers_size +
+                          static_cast<size_t>(section_count) * section_size);
+
+  fill_random(image.data() + headers_size, image.size() - headers_size);
+
+  IMAGE_DOS_HEADER *dos = reinterpret_cast<IMAGE_DOS_HEADER *>(image.data());
+  dos->e_magic = 0x5a4d;
+  dos->e_lfanew = nt_offset;
+
+  LOCAL_NT_HEADER *nt =
+      reinterpret_cast<LOCAL_NT_HEADER *>(image.data() + nt_offset);
+  nt->Signature = 0x00004550;
+  nt->FileHeader.Machine = 0x8664;
+  nt->FileHeader.NumberOfSections = static_cast<UINT16>(section_count);
+  nt->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER64);
+
+  IMAGE_OPTIONAL_HEADER64 *optional =
+      reinterpret_cast<IMAGE_OPTIONAL_HEADER64 *>(&nt->OptionalHeader);
+  optional->Magic = 0x20b;
+  optional->SizeOfHeaders = headers_size;
+  optional->SizeOfImage = static_cast<UINT32>(image.size());
+  optional->NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+
+  IMAGE_SECTION_HEADER *section = PeGetFirstSection(nt);
+  for (uint32_t index = 0; index < section_count; index++, section++) {
+    snprintf(reinterpret_cast<char *>(section->Name), IMAGE_SIZEOF_SHORT_NAME,
+             index % 2 ? ".data%u" : ".text%u", index / 2);
+    section->VirtualAddress = headers_size + index * section_size;
+    section->Misc.VirtualSize = section_size;
+    section->PointerToRawData = headers_size + index * section_size;
+    section->SizeOfRawData = section_size;
+    section->Characteristics = index % 2
+                                   ? IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE
+                                   : IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_EXECUTE;
+  }
+
+  return image;
+}
+
+std::vector<RTL_MODULE_EXTENDED_INFO>
+bench::make_module_list(uint32_t module_count) {
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules(module_count);
+  xorshift rng;
+  uint64_t base = 0xfffff80000000000;
+
+  for (uint32_t index = 0; index < module_count; index++) {
+    uint32_t size = static_cast<uint32_t>((rng.next() % 0x200 + 0x10) *
+                                          PAGE_SIZE);
+    modules[index].ImageBase = reinterpret_cast<PVOID>(base);
+    modules[index].ImageSize = size;
+    snprintf(modules[index].FullPathName, sizeof(modules[index].FullPathName),
+             "\\SystemRoot\\System32\\drivers\\module%u.sys", index);
+    base += size + (rng.next() % 0x10) * PAGE_SIZE;
+  }
+
+  return modules;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../core/system_modules.h"
+
+namespace bench {
+
+/*
+ * Every dataset is generated from a fixed seed so the numbers produced by
+ * different commits are directly comparable.
+ */
+static constexpr uint64_t DATASET_SEED = 0x6163626e63686d6b;
+static constexpr uint32_t PAGE_SIZE = 0x1000;
+
+class xorshift {
+  uint64_t state;
+
+public:
+  xorshift(uint64_t seed = DATASET_SEED) : state(seed) {}
+  uint64_t next();
+};
+
+void fill_random(void *buffer, size_t size, uint64_t seed = DATASET_SEED);
+
+/* random bytes with the signature planted in the final 64 bytes */
+std::vector<char> make_signature_haystack(size_t size, const char *signature,
+                                          size_t signature_length);
+
+/* page_count pages, with the tag planted once every tag_stride pages */
+std::vector<char> make_pool_pages(uint32_t page_count, const char *tag,
+                                  uint32_t tag_stride);
+
+/*
+ * A minimal 64 bit PE image with section_count sections of section_size
+ * bytes each, alternating between executable and data sections.
+ */
+std::vector<char> make_pe_image(uint32_t section_count, uint32_t section_size);
+
+/* sorted, non overlapping module list similar to a real system module list */
+std::vector<RTL_MODULE_EXTENDED_INFO> make_module_list(uint32_t module_count);
+
+} // namespace bench
@@ -0,0 +1,116 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/dispatch.h"
+#include "../core/system_modules.h"
+
+/*
+ * Compares a HAL dispatch table run before and after snapshotting. Before,
+ * every routine of both tables was resolved against the module list on every
+ * run. Now a run diffs the live tables against the snapshot and only changed
+ * slots are resolved, which is none of them unless something is hooked.
+ *
+ * The tables are sized like HAL_DISPATCH and the 22H2 HAL_PRIVATE_DISPATCH.
+ */
+
+namespace {
+
+constexpr uint32_t HAL_DISPATCH_SLOTS = 21;
+constexpr uint32_t HAL_PRIVATE_DISPATCH_SLOTS = 157;
+constexpr uint32_t MODULE_COUNT = 256;
+
+struct dispatch_tables {
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules;
+  std::vector<UINT64> hal;
+  std::vector<UINT64> hal_private;
+
+  dispatch_tables()
+      : modules(bench::make_module_list(MODULE_COUNT)),
+        hal(HAL_DISPATCH_SLOTS), hal_private(HAL_PRIVATE_DISPATCH_SLOTS) {
+    bench::xorshift random;
+    fill(hal, random);
+    fill(hal_private, random);
+  }
+
+  /* every routine lives inside one of the first few modules, like the hal */
+  void fill(std::vector<UINT64> &table, bench::xorshift &random) {
+    for (UINT64 &slot : table) {
+      const RTL_MODULE_EXTENDED_INFO &module = modules[random.next() % 4];
+      slot = reinterpret_cast<UINT64>(module.ImageBase) +
+             random.next() % module.ImageSize;
+    }
+  }
+};
+
+struct resolve_context {
+  SYSTEM_MODULES modules;
+  uint64_t resolved;
+};
+
+void resolve_slot(UINT32 TableId, UINT32 Index, UINT64 Previous,
+                  UINT64 Current, PVOID Context) {
+  resolve_context *context = static_cast<resolve_context *>(Context);
+  BOOLEAN result = FALSE;
+
+  IsInstructionPointerInInvalidRegion(Current, &context->modules, &result);
+  benchmark::DoNotOptimize(result);
+  context->resolved++;
+}
+
+void snapshot(PDISPATCH_SNAPSHOT Snapshot, dispatch_tables &tables) {
+  DispatchSnapshotInitialise(Snapshot);
+  DispatchSnapshotAddTable(Snapshot, 0, tables.hal.data(),
+                           static_cast<UINT32>(tables.hal.size()));
+  DispatchSnapshotAddTable(Snapshot, 1, tables.hal_private.data(),
+                           static_cast<UINT32>(tables.hal_private.size()));
+}
+
+} // namespace
+
+static void resolve_dispatch_tables(benchmark::State &state) {
+  dispatch_tables tables;
+  DISPATCH_SNAPSHOT dispatch_snapshot;
+  resolve_context context = {{tables.modules.data(),
+                              static_cast<INT>(tables.modules.size())},
+                             0};
+
+  snapshot(&dispatch_snapshot, tables);
+
+  for (auto _ : state)
+    DispatchSnapshotEnumerate(&dispatch_snapshot, resolve_slot, &context);
+
+  state.SetItemsProcessed(state.iterations() * dispatch_snapshot.slot_count);
+  state.counters["resolved"] = benchmark::Counter(
+      static_cast<double>(context.resolved), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(resolve_dispatch_tables);
+
+/* range(0) slots are hooked between every run */
+static void diff_dispatch_tables(benchmark::State &state) {
+  dispatch_tables tables;
+  DISPATCH_SNAPSHOT dispatch_snapshot;
+  resolve_context context = {{tables.modules.data(),
+                              static_cast<INT>(tables.modules.size())},
+                             0};
+  uint32_t hooks = static_cast<uint32_t>(state.range(0));
+  UINT32 changed = 0;
+  UINT64 hook = 0xfffff80000000000ull;
+
+  snapshot(&dispatch_snapshot, tables);
+
+  for (auto _ : state) {
+    for (uint32_t index = 0; index < hooks; index++)
+      tables.hal_private[index * 7 % tables.hal_private.size()] = hook++;
+
+    DispatchSnapshotDiff(&dispatch_snapshot, resolve_slot, &context, &changed);
+    benchmark::DoNotOptimize(changed);
+  }
+
+  state.SetItemsProcessed(state.iterations() * dispatch_snapshot.slot_count);
+  state.counters["resolved"] = benchmark::Counter(
+      static_cast<double>(context.resolved), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(diff_dispatch_tables)->Arg(0)->Arg(1)->Arg(8);
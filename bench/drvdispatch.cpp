@@ -0,0 +1,186 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/drvdispatch.h"
+
+/*
+ * Validates the dispatch routines of DRIVER_COUNT synthetic driver objects,
+ * one per module. Each driver handles a few major functions itself and leaves
+ * the rest pointing at the default routine in the first module, like
+ * IopInvalidDeviceRequest in ntoskrnl. One driver in FAST_IO_STRIDE also has a
+ * full FastIo table.
+ *
+ * resolve_every_dispatch_slot is a run without the snapshot, every slot of
+ * every driver resolved against the module list. diff_driver_dispatch/N diffs
+ * the drivers against their snapshot twice per iteration, once with N slots
+ * hooked to unbacked memory and once after they are restored, so compare
+ * items_per_second rather than the time.
+ */
+
+namespace {
+
+constexpr uint32_t DRIVER_COUNT = 200;
+constexpr uint32_t MODULE_COUNT = 256;
+constexpr uint32_t OWN_MAJOR_FUNCTIONS = 6;
+constexpr uint32_t FAST_IO_STRIDE = 4;
+
+constexpr uint64_t UNBACKED_ROUTINE = 0xffffb00000001000ull;
+
+struct synthetic_drivers {
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules;
+  std::vector<MODULE_RANGE> module_ranges;
+  std::vector<MODULE_RANGE> allowed_ranges;
+  std::vector<DRIVER_DISPATCH_ENTRY> drivers;
+  std::vector<DRIVER_DISPATCH_ENTRY> entries;
+  SYSTEM_MODULES system_modules = {};
+  MODULE_RANGE_INDEX module_index = {};
+  MODULE_RANGE_INDEX allowed_index = {};
+  DRIVER_DISPATCH_SNAPSHOT snapshot = {};
+
+  synthetic_drivers()
+      : modules(bench::make_module_list(MODULE_COUNT)),
+        module_ranges(MODULE_COUNT), allowed_ranges(1), drivers(DRIVER_COUNT),
+        entries(DRIVER_DISPATCH_DEFAULT_CAPACITY) {
+    bench::xorshift random;
+
+    this->system_modules.address = this->modules.data();
+    this->system_modules.module_count = MODULE_COUNT;
+
+    ModuleRangeIndexInitialise(&this->module_index, this->module_ranges.data(),
+                               MODULE_COUNT);
+    ModuleRangeIndexBuild(&this->module_index, &this->system_modules);
+
+    ModuleRangeIndexInitialise(&this->allowed_index,
+                               this->allowed_ranges.data(), 1);
+    ModuleRangeIndexAdd(&this->allowed_index, address(0, 0),
+                        this->modules[0].ImageSize);
+    ModuleRangeIndexSort(&this->allowed_index);
+
+    for (uint32_t index = 0; index < DRIVER_COUNT; index++)
+      this->fill(index + 1, random);
+  }
+
+  UINT64 address(uint32_t module, uint64_t offset) const {
+    return reinterpret_cast<UINT64>(this->modules[module].ImageBase) + offset;
+  }
+
+  void fill(uint32_t module, bench::xorshift &random) {
+    DRIVER_DISPATCH_ENTRY &driver = this->drivers[module - 1];
+    uint32_t size = this->modules[module].ImageSize;
+    UINT64 default_routine = address(0, 0x1000);
+
+    driver.driver = 0xffffa00000000000ull + module * 0x200ull;
+    driver.image_base = address(module, 0);
+    driver.image_end = driver.image_base + size;
+
+    for (uint32_t slot = 0; slot < DRIVER_DISPATCH_MAJOR_FUNCTIONS; slot++)
+      driver.slots[slot] = default_routine;
+
+    for (uint32_t count = 0; count < OWN_MAJOR_FUNCTIONS; count++)
+      driver.slots[random.next() % DRIVER_DISPATCH_MAJOR_FUNCTIONS] =
+          address(module, random.next() % size);
+
+    driver.slots[DRIVER_DISPATCH_SLOT_UNLOAD] =
+        address(module, random.next() % size);
+
+    if (module % FAST_IO_STRIDE)
+      return;
+
+    driver.slots[DRIVER_DISPATCH_SLOT_FAST_IO_TABLE] =
+        address(module, random.next() % size);
+
+    for (uint32_t slot = DRIVER_DISPATCH_SLOT_FAST_IO;
+         slot < DRIVER_DISPATCH_SLOT_COUNT; slot++)
+      driver.slots[slot] = address(module, random.next() % size);
+  }
+
+  void run(DRIVER_DISPATCH_CALLBACK callback, uint64_t *reports) {
+    DriverDispatchBeginRound(&this->snapshot, &this->module_index,
+                             &this->allowed_index, NULL, 0);
+
+    for (DRIVER_DISPATCH_ENTRY &driver : this->drivers)
+      DriverDispatchUpdate(&this->snapshot, &driver, callback, reports);
+
+    DriverDispatchEndRound(&this->snapshot);
+  }
+};
+
+synthetic_drivers &get_drivers() {
+  static synthetic_drivers drivers;
+  return drivers;
+}
+
+void count_report(PDRIVER_DISPATCH_ENTRY Entry, UINT32 Slot, UINT64 Previous,
+                  DRIVER_DISPATCH_VERDICT Verdict, PVOID Context) {
+  (*static_cast<uint64_t *>(Context))++;
+}
+
+} // namespace
+
+static void resolve_every_dispatch_slot(benchmark::State &state) {
+  synthetic_drivers &drivers = get_drivers();
+  uint64_t resolved = 0;
+
+  for (auto _ : state) {
+    for (const DRIVER_DISPATCH_ENTRY &driver : drivers.drivers) {
+      for (UINT64 slot : driver.slots) {
+        BOOLEAN flag = FALSE;
+
+        if (!slot)
+          continue;
+
+        IsInstructionPointerInInvalidRegion(slot, &drivers.system_modules,
+                                            &flag);
+        benchmark::DoNotOptimize(flag);
+        resolved++;
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * DRIVER_COUNT);
+  state.counters["slots"] = benchmark::Counter(
+      static_cast<double>(resolved), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(resolve_every_dispatch_slot)->Unit(benchmark::kMicrosecond);
+
+static void diff_driver_dispatch(benchmark::State &state) {
+  synthetic_drivers &drivers = get_drivers();
+  uint32_t hooks = static_cast<uint32_t>(state.range(0));
+  std::vector<UINT64> saved(hooks);
+  uint64_t reports = 0;
+
+  DriverDispatchInitialise(&drivers.snapshot, drivers.entries.data(),
+                           DRIVER_DISPATCH_DEFAULT_CAPACITY);
+  drivers.run(count_report, &reports);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (uint32_t index = 0; index < hooks; index++) {
+      UINT64 &slot = drivers.drivers[index * 7 % DRIVER_COUNT].slots[index];
+      saved[index] = slot;
+      slot = UNBACKED_ROUTINE;
+    }
+    state.ResumeTiming();
+
+    drivers.run(count_report, &reports);
+
+    state.PauseTiming();
+    for (uint32_t index = 0; index < hooks; index++)
+      drivers.drivers[index * 7 % DRIVER_COUNT].slots[index] = saved[index];
+    state.ResumeTiming();
+
+    drivers.run(count_report, &reports);
+  }
+
+  state.SetItemsProcessed(state.iterations() * DRIVER_COUNT * 2);
+  state.counters["reports"] = benchmark::Counter(
+      static_cast<double>(reports), benchmark::Counter::kAvgIterations);
+  state.counters["drivers"] = static_cast<double>(drivers.snapshot.count);
+}
+BENCHMARK(diff_driver_dispatch)
+    ->Arg(0)
+    ->Arg(8)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,70 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+#include "../core/heartbeat.h"
+
+/*
+ * What a heartbeat costs each side. sign_heartbeat is the driver's share,
+ * paid once per interval under the session lock. track_heartbeats is the
+ * server's, verifying and tracking a heartbeat from each of N clients, which
+ * is what one interval of heartbeats costs an ingest server with N clients
+ * connected.
+ */
+
+namespace {
+
+const UCHAR key[16] = {0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+                       0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
+
+} // namespace
+
+static void sign_heartbeat(benchmark::State &state) {
+  HEARTBEAT_PACKET packet = {};
+  packet.session_cookie = 0x5eed;
+
+  for (auto _ : state) {
+    packet.sequence++;
+    packet.time += HEARTBEAT_INTERVAL_MS;
+    HeartbeatSign(&packet, (PVOID)key, sizeof(key));
+    benchmark::DoNotOptimize(packet);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(sign_heartbeat);
+
+static void track_heartbeats(benchmark::State &state) {
+  uint32_t clients = static_cast<uint32_t>(state.range(0));
+  std::vector<HEARTBEAT_TRACKER> trackers(clients);
+  std::vector<HEARTBEAT_PACKET> packets(clients);
+  UINT64 received = 0;
+  UINT64 rejected = 0;
+
+  for (uint32_t index = 0; index < clients; index++) {
+    HeartbeatTrackerInitialise(&trackers[index], HEARTBEAT_INTERVAL_MS);
+    packets[index].session_cookie = index;
+  }
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    received += HEARTBEAT_INTERVAL_MS;
+    for (HEARTBEAT_PACKET &packet : packets) {
+      packet.sequence++;
+      packet.time = received;
+      HeartbeatSign(&packet, (PVOID)key, sizeof(key));
+    }
+    state.ResumeTiming();
+
+    for (uint32_t index = 0; index < clients; index++)
+      rejected += HeartbeatTrack(&trackers[index], &packets[index],
+                                 (PVOID)key, sizeof(key), index, received) != 0;
+  }
+
+  if (rejected)
+    state.SkipWithError("an on time heartbeat was flagged");
+
+  state.SetItemsProcessed(state.iterations() * clients);
+}
+BENCHMARK(track_heartbeats)->Arg(1000)->Arg(10000);
@@ -0,0 +1,368 @@
+#include "memimage.h"
+
+#include <cstring>
+#include <iterator>
+
+#include "../core/poolscan.h"
+
+/* not part of the core signature, only used to make the bodies look real */
+static constexpr uint32_t IMAGE_FILE_NAME_OFFSET = 0x5a8;
+static constexpr uint32_t OBJECT_HEADER_TYPE_INDEX_OFFSET = 0x18;
+static constexpr uint8_t PROCESS_OBJECT_TYPE_INDEX = 0x07;
+static constexpr uint32_t NON_PAGED_POOL_TYPE = 0x02;
+static constexpr uint32_t QUOTA_INFO_SIZE = 0x20;
+
+static constexpr uint32_t PAGE_1GB_SHIFT = 30;
+static constexpr uint32_t PAGE_2MB_SHIFT = 21;
+static constexpr uint32_t PAGE_4KB_SHIFT = 12;
+
+static constexpr uint64_t PAGE_ENTRY_WRITE = 1ull << 1;
+static constexpr uint64_t KERNEL_PML4_INDEX = 256;
+static constexpr uint64_t MMIO_PML4_INDEX = 511;
+static constexpr uint64_t MMIO_BASE = 1ull << 45;
+
+/* 2..32 blocks, i.e 32 to 512 byte allocations */
+static constexpr uint32_t MIN_BLOCKS = 2;
+static constexpr uint32_t MAX_BLOCKS = 32;
+
+/* the furthest into a page a process allocation is placed */
+static constexpr uint32_t MAX_PROCESS_OFFSET = 0x500;
+/* every filler frame with this index stride holds a terminated process */
+static constexpr uint32_t TERMINATED_PROCESS_STRIDE = 8;
+
+static const char *FILLER_TAGS[] = {"Thre", "File", "MmSt", "Ntfx",
+                                    "Irp ", "Vad ", "Even", "Toke",
+                                    "Sema", "ObNm", "NtFs", "Mdl "};
+
+static const char *IMAGE_NAMES[] = {"System",       "smss.exe",
+                                    "csrss.exe",    "wininit.exe",
+                                    "services.exe", "lsass.exe",
+                                    "svchost.exe",  "explorer.exe",
+                                    "dwm.exe",      "RuntimeBroker."};
+
+static double chance(bench::xorshift &rng) {
+  return static_cast<double>(rng.next() >> 11) * 0x1.0p-53;
+}
+
+static void write_pool_header(uint8_t *at, uint32_t block_size,
+                              uint32_t previous_size, const char *tag) {
+  POOL_HEADER header = {};
+  header.PreviousSize = previous_size;
+  header.BlockSize = block_size;
+  header.PoolType = NON_PAGED_POOL_TYPE;
+  memcpy(&header.PoolTag, tag, POOL_TAG_LENGTH);
+  memcpy(at, &header, sizeof(header));
+}
+
+/*
+ * Chains small allocations with random contents over [from, to), returns the
+ * block size of the last one so the next header can point back at it.
+ */
+static uint32_t fill_allocations(uint8_t *page, uint32_t from, uint32_t to,
+                                 uint32_t previous, bench::xorshift &rng) {
+  uint32_t offset = from;
+
+  while (offset < to) {
+    uint32_t remaining = (to - offset) / POOL_BLOCK_CHUNK_SIZE;
+    uint32_t blocks =
+        MIN_BLOCKS + static_cast<uint32_t>(rng.next() % (MAX_BLOCKS - 1));
+
+    if (blocks + MIN_BLOCKS > remaining)
+      blocks = remaining;
+
+    const char *tag = FILLER_TAGS[rng.next() % std::size(FILLER_TAGS)];
+    write_pool_header(page + offset, blocks, previous, tag);
+    bench::fill_random(page + offset + sizeof(POOL_HEADER),
+                       blocks * POOL_BLOCK_CHUNK_SIZE - sizeof(POOL_HEADER),
+                       rng.next());
+
+    previous = blocks;
+    offset += blocks * POOL_BLOCK_CHUNK_SIZE;
+  }
+
+  return previous;
+}
+
+/*
+ * Writes a complete process allocation at offset: pool header, optional
+ * headers, OBJECT_HEADER and an EPROCESS body that is zero apart from the
+ * fields the signature looks at. Returns the address of the body.
+ */
+static uint8_t *write_process(uint8_t *page, uint32_t offset, uint32_t previous,
+                              bool terminated, bool system, uint64_t ram_size,
+                              bench::xorshift &rng) {
+  /*
+   * Process objects always carry OBJECT_HEADER_QUOTA_INFO, optionally followed
+   * by the creator, handle and audit info headers.
+   */
+  uint32_t header_size = OBJECT_HEADER_SIZE + QUOTA_INFO_SIZE +
+                         0x10 * static_cast<uint32_t>(rng.next() % 4);
+  uint32_t size = sizeof(POOL_HEADER) + header_size + EPROCESS_SIZE;
+  uint32_t blocks = (size + POOL_BLOCK_CHUNK_SIZE - 1) / POOL_BLOCK_CHUNK_SIZE;
+
+  write_pool_header(page + offset, blocks, previous,
+                    GetExecutiveObjectPoolTag(INDEX_PROCESS_POOL_TAG));
+  memset(page + offset + sizeof(POOL_HEADER), 0,
+         blocks * POOL_BLOCK_CHUNK_SIZE - sizeof(POOL_HEADER));
+
+  uint8_t *object_header =
+      page + offset + sizeof(POOL_HEADER) + header_size - OBJECT_HEADER_SIZE;
+  uint64_t pointer_count = 1 + rng.next() % 64;
+  memcpy(object_header, &pointer_count, sizeof(pointer_count));
+  object_header[OBJECT_HEADER_TYPE_INDEX_OFFSET] = PROCESS_OBJECT_TYPE_INDEX;
+
+  uint8_t *process = object_header + OBJECT_HEADER_SIZE;
+  uint64_t directory_table_base = (rng.next() % ram_size) & ~0xfffull;
+  uint64_t peak_virtual_size =
+      terminated ? 0 : (0x400000 + rng.next() % (2ull << 30)) & ~0xfffull;
+  uint64_t peb =
+      system ? 0 : (0x10000000 + rng.next() % 0x7ff000000000ull) & ~0xfffull;
+  uint64_t object_table =
+      0xffff800000000000ull | (rng.next() & 0x00007ffffffffff8ull);
+  const char *name = system ? IMAGE_NAMES[0]
+                            : IMAGE_NAMES[1 + rng.next() %
+                                                  (std::size(IMAGE_NAMES) - 1)];
+
+  /* a directory table base of 0 only belongs to the idle process */
+  if (!directory_table_base)
+    directory_table_base = bench::PAGE_SIZE;
+
+  memcpy(process + KPROCESS_DIRECTORY_TABLE_BASE_OFFSET, &directory_table_base,
+         sizeof(UINT64));
+  memcpy(process + EPROCESS_PEAK_VIRTUAL_SIZE_OFFSET, &peak_virtual_size,
+         sizeof(UINT64));
+  memcpy(process + EPROCESS_PEB_OFFSET, &peb, sizeof(UINT64));
+  memcpy(process + EPROCESS_OBJECT_TABLE_OFFSET, &object_table,
+         sizeof(UINT64));
+  memcpy(process + IMAGE_FILE_NAME_OFFSET, name, strnlen(name, 15));
+
+  fill_allocations(page, offset + blocks * POOL_BLOCK_CHUNK_SIZE,
+                   bench::PAGE_SIZE, blocks, rng);
+  return process;
+}
+
+bench::memory_image::memory_image(const memory_image_config &config)
+    : config(config) {
+  xorshift rng(config.seed);
+
+  this->ram_size = static_cast<uint64_t>(config.physical_size_gb)
+                   << PAGE_1GB_SHIFT;
+  /* leave a gap between ram and the tables, like the pci hole */
+  this->table_base = this->ram_size + PAGE_WALK_1GB_SIZE;
+  this->object_bitmap.resize((this->ram_size / PAGE_SIZE + 63) / 64);
+
+  this->filler.resize(static_cast<size_t>(config.filler_frames) * PAGE_SIZE);
+
+  for (uint32_t frame = 0; frame < config.filler_frames; frame++) {
+    uint8_t *page = this->filler.data() + static_cast<size_t>(frame) * PAGE_SIZE;
+    uint32_t decoy_blocks =
+        MIN_BLOCKS + static_cast<uint32_t>(rng.next() % (MAX_BLOCKS - 1));
+
+    /* a small allocation that happens to carry the process tag */
+    write_pool_header(page, decoy_blocks, 0,
+                      GetExecutiveObjectPoolTag(INDEX_PROCESS_POOL_TAG));
+    fill_random(page + sizeof(POOL_HEADER),
+                decoy_blocks * POOL_BLOCK_CHUNK_SIZE - sizeof(POOL_HEADER),
+                rng.next());
+
+    uint32_t offset = decoy_blocks * POOL_BLOCK_CHUNK_SIZE;
+
+    if (frame % TERMINATED_PROCESS_STRIDE) {
+      fill_allocations(page, offset, PAGE_SIZE, decoy_blocks, rng);
+      continue;
+    }
+
+    write_process(page, offset, decoy_blocks, true, false, this->ram_size,
+                  rng);
+  }
+
+  this->plant_processes(rng);
+  this->map_ram(rng);
+  this->map_mmio(rng);
+}
+
+uint64_t bench::memory_image::allocate_table() {
+  uint64_t physical =
+      this->table_base + this->tables.size() / PAGE_TABLE_ENTRY_COUNT * PAGE_SIZE;
+  this->tables.resize(this->tables.size() + PAGE_TABLE_ENTRY_COUNT);
+  return physical;
+}
+
+/* draws nothing at the default ratio, so existing images stay the same */
+uint64_t bench::memory_image::leaf_flags(xorshift &rng) {
+  uint64_t flags = PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+
+  if (this->config.executable_ratio < 1.0 &&
+      chance(rng) >= this->config.executable_ratio)
+    flags |= PAGE_ENTRY_NX;
+
+  return flags;
+}
+
+uint64_t *bench::memory_image::table(uint64_t physical) {
+  return static_cast<uint64_t *>(this->translate(physical));
+}
+
+void bench::memory_image::plant_processes(xorshift &rng) {
+  uint64_t ram_pages = this->ram_size / PAGE_SIZE;
+  uint32_t count = this->config.processes_per_gb * this->config.physical_size_gb;
+  uint32_t unlinked =
+      static_cast<uint32_t>(count * this->config.unlinked_ratio + 0.5);
+
+  if (count == 0)
+    count = 1;
+
+  if (unlinked == 0 && this->config.unlinked_ratio > 0)
+    unlinked = 1;
+
+  this->objects.resize(static_cast<size_t>(count) * PAGE_SIZE);
+
+  for (uint32_t index = 0; index < count; index++) {
+    uint64_t pfn = 0;
+
+    /* never the first page, and never one already holding a process */
+    do {
+      pfn = 1 + rng.next() % (ram_pages - 1);
+    } while (this->object_bitmap[pfn / 64] & (1ull << (pfn % 64)));
+
+    this->object_bitmap[pfn / 64] |= 1ull << (pfn % 64);
+    this->object_frames[pfn] = index;
+
+    uint8_t *page = this->objects.data() + static_cast<size_t>(index) * PAGE_SIZE;
+    uint32_t offset = POOL_BLOCK_CHUNK_SIZE *
+                      static_cast<uint32_t>(
+                          rng.next() %
+                          (MAX_PROCESS_OFFSET / POOL_BLOCK_CHUNK_SIZE + 1));
+    uint32_t previous = fill_allocations(page, 0, offset, 0, rng);
+    bool linked = index >= unlinked;
+    uint8_t *process = write_process(page, offset, previous, false,
+                                     index == unlinked, this->ram_size, rng);
+
+    this->planted.push_back(
+        {pfn * PAGE_SIZE, reinterpret_cast<uint64_t>(process), linked});
+  }
+}
+
+/*
+ * Direct maps all of ram starting at the first kernel PML4 entry. Every 1GB
+ * region is either a single 1GB page or a PD whose 2MB regions are each either
+ * a 2MB page or a PT of 4KB pages. Pages holding planted processes are always
+ * present.
+ */
+void bench::memory_image::map_ram(xorshift &rng) {
+  uint64_t pml4 = this->allocate_table();
+
+  for (uint64_t base = 0; base < this->ram_size; base += PAGE_WALK_1GB_SIZE) {
+    uint64_t pml4_index = KERNEL_PML4_INDEX + (base >> 39);
+
+    if (!(this->table(pml4)[pml4_index] & PAGE_ENTRY_PRESENT)) {
+      uint64_t pdpt = this->allocate_table();
+      this->table(pml4)[pml4_index] =
+          pdpt | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+    }
+
+    uint64_t pdpt = this->table(pml4)[pml4_index] & PAGE_ENTRY_4KB_FRAME;
+    uint64_t pdpt_index = (base >> PAGE_1GB_SHIFT) % PAGE_TABLE_ENTRY_COUNT;
+
+    if (chance(rng) < this->config.gb_page_ratio) {
+      this->table(pdpt)[pdpt_index] =
+          base | PAGE_ENTRY_LARGE | this->leaf_flags(rng);
+      this->present_pages += PAGE_WALK_1GB_SIZE / PAGE_SIZE;
+      continue;
+    }
+
+    uint64_t pd = this->allocate_table();
+    this->table(pdpt)[pdpt_index] = pd | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+
+    for (uint64_t pd_index = 0; pd_index < PAGE_TABLE_ENTRY_COUNT; pd_index++) {
+      uint64_t region = base + (pd_index << PAGE_2MB_SHIFT);
+
+      if (chance(rng) < this->config.mb_page_ratio) {
+        this->table(pd)[pd_index] =
+            region | PAGE_ENTRY_LARGE | this->leaf_flags(rng);
+        this->present_pages += PAGE_WALK_2MB_SIZE / PAGE_SIZE;
+        continue;
+      }
+
+      uint64_t pt = this->allocate_table();
+      this->table(pd)[pd_index] = pt | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+      uint64_t *entries = this->table(pt);
+
+      for (uint64_t pt_index = 0; pt_index < PAGE_TABLE_ENTRY_COUNT;
+           pt_index++) {
+        uint64_t page = region + (pt_index << PAGE_4KB_SHIFT);
+        uint64_t pfn = page / PAGE_SIZE;
+        bool object = this->object_bitmap[pfn / 64] & (1ull << (pfn % 64));
+
+        if (!object && chance(rng) < this->config.not_present_ratio)
+          continue;
+
+        entries[pt_index] = page | this->leaf_flags(rng);
+        this->present_pages++;
+      }
+    }
+  }
+}
+
+/* device memory is mapped by the kernel but isnt ram, the walk must skip it */
+void bench::memory_image::map_mmio(xorshift &rng) {
+  uint64_t pml4 = this->directory_table_base();
+  uint64_t pdpt = this->allocate_table();
+  uint64_t pd = this->allocate_table();
+  uint64_t pt = this->allocate_table();
+
+  this->table(pml4)[MMIO_PML4_INDEX] =
+      pdpt | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+  this->table(pdpt)[0] = pd | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+  this->table(pd)[0] = pt | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+
+  uint64_t *entries = this->table(pt);
+  for (uint32_t index = 0;
+       index < this->config.mmio_mappings && index < PAGE_TABLE_ENTRY_COUNT;
+       index++) {
+    uint64_t device = MMIO_BASE + (rng.next() % 0x100000) * PAGE_SIZE;
+    entries[index] = device | PAGE_ENTRY_WRITE | PAGE_ENTRY_PRESENT;
+  }
+}
+
+void *bench::memory_image::translate(uint64_t physical) {
+  if (physical >= this->table_base) {
+    uint64_t index = (physical - this->table_base) / PAGE_SIZE;
+
+    if (index >= this->tables.size() / PAGE_TABLE_ENTRY_COUNT)
+      return nullptr;
+
+    return this->tables.data() + index * PAGE_TABLE_ENTRY_COUNT +
+           (physical % PAGE_SIZE) / sizeof(uint64_t);
+  }
+
+  if (physical >= this->ram_size)
+    return nullptr;
+
+  uint64_t pfn = physical / PAGE_SIZE;
+
+  if (this->object_bitmap[pfn / 64] & (1ull << (pfn % 64)))
+    return this->objects.data() +
+           static_cast<size_t>(this->object_frames[pfn]) * PAGE_SIZE +
+           physical % PAGE_SIZE;
+
+  uint64_t frame =
+      ((pfn * 0x9e3779b97f4a7c15ull) >> 32) % this->config.filler_frames;
+  return this->filler.data() + frame * PAGE_SIZE + physical % PAGE_SIZE;
+}
+
+size_t bench::memory_image::resident_size() const {
+  return this->tables.size() * sizeof(uint64_t) + this->filler.size() +
+         this->objects.size() + this->object_bitmap.size() * sizeof(uint64_t);
+}
+
+void bench::memory_image::prepare_walk(PAGE_WALK &walk) {
+  walk.directory_table_base = this->directory_table_base();
+  walk.memory_context = this;
+  walk.translate = [](UINT64 physical, PVOID context) -> PVOID {
+    return static_cast<memory_image *>(context)->translate(physical);
+  };
+  walk.validate = [](PVOID address, PVOID context) -> BOOLEAN {
+    return address != nullptr;
+  };
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/pagewalk.h"
+
+namespace bench {
+
+/*
+ * Synthetic kernel memory image for the unlinked process scan.
+ *
+ * The image describes physical_size_gb of ram, direct mapped in the upper half
+ * of a 4 level page table hierarchy using a mix of 1GB, 2MB and 4KB pages. The
+ * tables themselves are real, but ram isnt: every page holding a planted
+ * process gets its own frame while the rest of ram aliases a small set of
+ * filler pool pages. This keeps 128GB images to a few hundred MB while the
+ * walk and scan still touch every page exactly as they would on a real
+ * system.
+ *
+ * All pool pages are built from POOL_HEADER chained allocations. Process
+ * pages contain a single EPROCESS allocation (pool header, optional headers,
+ * OBJECT_HEADER and body) passing the core signature, filler pages contain
+ * decoys carrying the process tag that must not.
+ */
+struct memory_image_config {
+  uint32_t physical_size_gb = 8;
+
+  /* fraction of 1GB regions mapped with a single 1GB page */
+  double gb_page_ratio = 0.25;
+  /* fraction of the remaining 2MB regions mapped with a single 2MB page */
+  double mb_page_ratio = 0.60;
+  /* fraction of 4KB PTEs left not present */
+  double not_present_ratio = 0.02;
+  /* fraction of leaf mappings of any size left executable, the rest are NX */
+  double executable_ratio = 1.0;
+
+  uint32_t processes_per_gb = 4;
+  /* fraction of planted processes absent from the process list */
+  double unlinked_ratio = 0.05;
+
+  /* distinct pool pages aliased over the rest of ram */
+  uint32_t filler_frames = 2048;
+  /* PTEs pointing at device memory outside of ram */
+  uint32_t mmio_mappings = 64;
+
+  uint64_t seed = DATASET_SEED;
+};
+
+struct planted_process {
+  uint64_t physical;
+  /* EPROCESS body, as the scan reports it */
+  uint64_t address;
+  bool linked;
+};
+
+class memory_image {
+  memory_image_config config;
+
+  uint64_t ram_size;
+  uint64_t table_base;
+  std::vector<uint64_t> tables;
+
+  std::vector<uint8_t> filler;
+  std::vector<uint8_t> objects;
+  std::vector<uint64_t> object_bitmap;
+  std::unordered_map<uint64_t, uint32_t> object_frames;
+
+  std::vector<planted_process> planted;
+  uint64_t present_pages = 0;
+
+  uint64_t allocate_table();
+  uint64_t leaf_flags(xorshift &rng);
+  uint64_t *table(uint64_t physical);
+  void map_ram(xorshift &rng);
+  void map_mmio(xorshift &rng);
+  void plant_processes(xorshift &rng);
+
+public:
+  explicit memory_image(const memory_image_config &config);
+
+  void *translate(uint64_t physical);
+
+  uint64_t directory_table_base() const { return this->table_base; }
+  const std::vector<planted_process> &processes() const {
+    return this->planted;
+  }
+
+  /* leaf 4KB pages backed by ram, i.e what a full walk should visit */
+  uint64_t mapped_pages() const { return this->present_pages; }
+  size_t resident_size() const;
+
+  /* fills in the memory callbacks of a PAGE_WALK for this image */
+  void prepare_walk(PAGE_WALK &walk);
+};
+
+} // namespace bench
@@ -0,0 +1,139 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+#include "memimage.h"
+
+#include "../core/pagewalk.h"
+#include "../core/poolscan.h"
+
+/* same margin FindUnlinkedProcesses uses to match against the process list */
+static constexpr uint64_t PROCESS_OBJECT_ALLOCATION_MARGIN = 0x90;
+
+/*
+ * Images are expensive to build at the larger scales, so each one is built
+ * once and shared by every benchmark using the same size.
+ */
+static bench::memory_image &get_image(uint32_t physical_size_gb) {
+  static std::map<uint32_t, std::unique_ptr<bench::memory_image>> images;
+  std::unique_ptr<bench::memory_image> &image = images[physical_size_gb];
+
+  if (!image) {
+    bench::memory_image_config config;
+    config.physical_size_gb = physical_size_gb;
+    image = std::make_unique<bench::memory_image>(config);
+  }
+
+  return *image;
+}
+
+static void count_page(UINT64 PageBase, ULONG PageSize, PVOID Context) {
+  benchmark::DoNotOptimize(*reinterpret_cast<volatile char *>(PageBase));
+}
+
+static void scan_page(UINT64 PageBase, ULONG PageSize, PVOID Context) {
+  ScanPageForKernelObjectAllocation(
+      PageBase, PageSize, INDEX_PROCESS_POOL_TAG,
+      static_cast<PPROCESS_SCAN_CONTEXT>(Context));
+}
+
+/* the cost of the walk alone, every leaf page is touched but not scanned */
+static void walk_memory_image(benchmark::State &state) {
+  bench::memory_image &image =
+      get_image(static_cast<uint32_t>(state.range(0)));
+  PAGE_WALK walk = {};
+
+  image.prepare_walk(walk);
+  walk.callback = count_page;
+
+  for (auto _ : state)
+    WalkPageTables(&walk);
+
+  state.SetItemsProcessed(state.iterations() * walk.pages_visited);
+  state.counters["pages"] = static_cast<double>(walk.pages_visited);
+  state.counters["tables"] = static_cast<double>(walk.tables_visited);
+  state.counters["coverage"] = static_cast<double>(walk.pages_visited) /
+                               static_cast<double>(image.mapped_pages());
+  state.counters["resident_mb"] =
+      static_cast<double>(image.resident_size()) / (1 << 20);
+}
+BENCHMARK(walk_memory_image)
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128)
+    ->Unit(benchmark::kMillisecond);
+
+/*
+ * The full unlinked process scan. Recall is the fraction of planted processes
+ * the scan reports, unlinked recall the fraction of unlinked ones left over
+ * once everything near a linked process is removed, exactly like
+ * FindUnlinkedProcesses does. Anything reported that wasnt planted is a false
+ * positive.
+ */
+static void scan_memory_image(benchmark::State &state) {
+  bench::memory_image &image =
+      get_image(static_cast<uint32_t>(state.range(0)));
+  const std::vector<bench::planted_process> &planted = image.processes();
+  std::vector<UINT64> buffer(planted.size() * 2);
+  PROCESS_SCAN_CONTEXT context = {};
+  PAGE_WALK walk = {};
+
+  image.prepare_walk(walk);
+  walk.callback = scan_page;
+  walk.callback_context = &context;
+
+  for (auto _ : state) {
+    std::fill(buffer.begin(), buffer.end(), 0);
+    context.process_count = static_cast<ULONG>(buffer.size());
+    context.process_buffer = buffer.data();
+    context.found = 0;
+    context.dropped = 0;
+    WalkPageTables(&walk);
+  }
+
+  std::vector<UINT64> found(buffer.begin(), buffer.begin() + context.found);
+  std::sort(found.begin(), found.end());
+  found.erase(std::unique(found.begin(), found.end()), found.end());
+
+  uint64_t detected = 0;
+  uint64_t unlinked = 0;
+  uint64_t unlinked_detected = 0;
+
+  for (const bench::planted_process &process : planted) {
+    bool hit = std::binary_search(found.begin(), found.end(), process.address);
+    detected += hit;
+    unlinked += !process.linked;
+    unlinked_detected += hit && !process.linked;
+  }
+
+  uint64_t flagged = 0;
+  for (UINT64 address : found) {
+    bool linked = std::any_of(
+        planted.begin(), planted.end(),
+        [address](const bench::planted_process &process) {
+          return process.linked &&
+                 process.address >= address - PROCESS_OBJECT_ALLOCATION_MARGIN &&
+                 process.address <= address + PROCESS_OBJECT_ALLOCATION_MARGIN;
+        });
+    flagged += !linked;
+  }
+
+  state.SetBytesProcessed(state.iterations() * walk.pages_visited *
+                          bench::PAGE_SIZE);
+  state.counters["processes"] = static_cast<double>(planted.size());
+  state.counters["recall"] =
+      static_cast<double>(detected) / static_cast<double>(planted.size());
+  state.counters["unlinked_recall"] =
+      unlinked ? static_cast<double>(unlinked_detected) / unlinked : 1.0;
+  state.counters["flagged"] = static_cast<double>(flagged);
+  state.counters["false_positives"] =
+      static_cast<double>(found.size() - detected);
+  state.counters["dropped"] = static_cast<double>(context.dropped);
+}
+BENCHMARK(scan_memory_image)
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,92 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/pagehash.h"
+
+/*
+ * Hashes and verifies a synthetic module image with a 1MB .text section, the
+ * size of the user mode module in a release build with its dependencies
+ * linked statically.
+ *
+ * verify_page_hashes/N is one integrity timer tick verifying N pages, which
+ * is what MODULE_IMAGE_VERIFY_BUDGET is sized from. N = 0 verifies the whole
+ * image in one go, which is what a tick would cost without the rotation.
+ */
+
+namespace {
+
+constexpr uint32_t TEXT_PAGES = 256;
+
+struct synthetic_module {
+  std::vector<char> image;
+  std::vector<PAGE_HASH> pages;
+  std::vector<char> scratch;
+  PAGE_HASH_SET set = {};
+  PE_VIEW view = {};
+
+  synthetic_module()
+      : image(bench::make_pe_image(2, TEXT_PAGES * bench::PAGE_SIZE)),
+        scratch(PAGE_HASH_PAGE_SIZE) {
+    PeViewInitialise(&this->view, this->image.data(), this->image.size());
+
+    this->pages.resize(PageHashCountPages(&this->view));
+    this->set.capacity = static_cast<UINT32>(this->pages.size());
+    this->set.pages = this->pages.data();
+  }
+
+  void build() {
+    PageHashSetReset(&this->set);
+    PageHashSetAddImage(&this->set, &this->view);
+  }
+};
+
+synthetic_module &get_module() {
+  static synthetic_module module;
+  return module;
+}
+
+void count_mismatch(PPAGE_HASH Page, PVOID Context) {
+  (*static_cast<uint64_t *>(Context))++;
+}
+
+} // namespace
+
+static void build_page_hashes(benchmark::State &state) {
+  synthetic_module &module = get_module();
+
+  for (auto _ : state)
+    module.build();
+
+  state.SetBytesProcessed(state.iterations() * TEXT_PAGES *
+                          bench::PAGE_SIZE);
+  state.counters["pages"] = static_cast<double>(module.set.count);
+}
+BENCHMARK(build_page_hashes)->Unit(benchmark::kMillisecond);
+
+static void verify_page_hashes(benchmark::State &state) {
+  synthetic_module &module = get_module();
+  uint32_t budget = static_cast<uint32_t>(state.range(0));
+  uint32_t pages = 0;
+  uint64_t mismatches = 0;
+
+  module.build();
+
+  for (auto _ : state)
+    pages += PageHashSetVerify(&module.set,
+                               reinterpret_cast<UINT64>(module.image.data()),
+                               budget, module.scratch.data(), count_mismatch,
+                               &mismatches);
+
+  state.SetBytesProcessed(static_cast<int64_t>(pages) * bench::PAGE_SIZE);
+  state.counters["pages"] = benchmark::Counter(
+      static_cast<double>(pages), benchmark::Counter::kAvgIterations);
+  state.counters["mismatches"] = static_cast<double>(mismatches);
+}
+BENCHMARK(verify_page_hashes)
+    ->Arg(1)
+    ->Arg(4)
+    ->Arg(0)
+    ->Unit(benchmark::kMicrosecond);
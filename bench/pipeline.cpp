@@ -0,0 +1,153 @@
+#include <benchmark/benchmark.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "../module/dispatcher/threadpool.h"
+#include "../module/kernel_interface/report_port.h"
+#include "../module/kernel_interface/simulated_device.h"
+
+#include "../core/report.h"
+
+/* mirrors of the module limits, see kernel_interface.h and message_queue.h */
+static constexpr int EVENT_COUNT = 5;
+static constexpr unsigned long MAXIMUM_REPORT_BUFFER_SIZE = 1000;
+static constexpr size_t SEND_BUFFER_SIZE = 8192;
+static constexpr int MESSAGE_TYPE_CLIENT_REPORT = 1;
+static constexpr uint32_t REPORTS_PER_ITERATION = 1000;
+
+struct message_packet_header {
+  int message_type;
+  int request_id;
+  uint64_t steam64_id;
+};
+
+/*
+ * The consumer side of the completion port: validate each report and batch it
+ * behind a packet header, flushing full batches to the uplink which here
+ * just counts the bytes.
+ */
+class report_sink {
+  std::mutex lock;
+  std::condition_variable drained;
+  std::vector<unsigned char> batch;
+  uint64_t handled = 0;
+  int request_id = 0;
+
+  void flush() {
+    this->uplink_bytes += this->batch.size();
+    this->batches++;
+    this->batch.clear();
+  }
+
+public:
+  uint64_t malformed = 0;
+  uint64_t batches = 0;
+  uint64_t uplink_bytes = 0;
+
+  report_sink() { this->batch.reserve(SEND_BUFFER_SIZE); }
+
+  void handle(void *buffer, unsigned long bytes) {
+    bool valid = ReportIsValid(buffer, bytes);
+    message_packet_header header = {};
+    header.message_type = MESSAGE_TYPE_CLIENT_REPORT;
+
+    std::lock_guard<std::mutex> lock(this->lock);
+    this->handled++;
+    if (!valid) {
+      this->malformed++;
+    } else {
+      if (this->batch.size() + sizeof(header) + bytes > SEND_BUFFER_SIZE)
+        this->flush();
+      header.request_id = this->request_id++;
+      const unsigned char *raw =
+          reinterpret_cast<const unsigned char *>(&header);
+      this->batch.insert(this->batch.end(), raw, raw + sizeof(header));
+      this->batch.insert(this->batch.end(),
+                         static_cast<unsigned char *>(buffer),
+                         static_cast<unsigned char *>(buffer) + bytes);
+    }
+    this->drained.notify_all();
+  }
+
+  /* waits for count reports in total, then uplinks the partial batch */
+  void wait(uint64_t count) {
+    std::unique_lock<std::mutex> lock(this->lock);
+    this->drained.wait(lock, [this, count] { return this->handled >= count; });
+    if (!this->batch.empty())
+      this->flush();
+  }
+};
+
+/*
+ * Simulated driver to uplink with the given number of completion port
+ * consumers. Each iteration injects a burst far larger than the five queued
+ * buffers, so most reports go through the deferred list. Its limit is raised
+ * so none are dropped.
+ */
+static void report_pipeline(benchmark::State &state) {
+  kernel_interface::simulated_device_config config;
+  config.report_rate = 0;
+  config.malformed_ratio = 0.01;
+  config.deferred_max = REPORTS_PER_ITERATION;
+
+  kernel_interface::simulated_device device(config);
+  kernel_interface::report_port port(device, EVENT_COUNT,
+                                     MAXIMUM_REPORT_BUFFER_SIZE);
+  dispatcher::thread_pool pool(static_cast<int>(state.range(0)));
+  report_sink sink;
+  uint64_t expected = 0;
+
+  port.queue_all();
+  for (int64_t index = 0; index < state.range(0); index++)
+    pool.queue_job([&]() {
+      port.run([&](void *buffer, unsigned long bytes) {
+        sink.handle(buffer, bytes);
+      });
+    });
+
+  for (auto _ : state) {
+    device.inject(REPORTS_PER_ITERATION);
+    expected += REPORTS_PER_ITERATION;
+    sink.wait(expected);
+  }
+
+  kernel_interface::simulated_device_stats stats = device.get_stats();
+  device.shutdown();
+  pool.terminate();
+
+  state.SetItemsProcessed(state.iterations() * REPORTS_PER_ITERATION);
+  state.SetBytesProcessed(sink.uplink_bytes);
+  state.counters["batches"] = static_cast<double>(sink.batches);
+  state.counters["malformed"] = static_cast<double>(sink.malformed);
+  state.counters["deferred_ratio"] =
+      static_cast<double>(stats.deferred) / static_cast<double>(expected);
+}
+BENCHMARK(report_pipeline)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * The synchronous ioctl path the dispatcher uses for every scan, with a
+ * simulated driver round trip of the given number of microseconds.
+ */
+static void driver_call(benchmark::State &state) {
+  kernel_interface::simulated_device_config config;
+  config.report_rate = 0;
+  config.call_latency_us = static_cast<uint32_t>(state.range(0));
+
+  kernel_interface::simulated_device device(config);
+  unsigned long bytes_returned = 0;
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        device.call(0, nullptr, 0, nullptr, 0, &bytes_returned));
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(driver_call)->Arg(0)->Arg(50)->UseRealTime();
@@ -0,0 +1,162 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/regionmap.h"
+#include "../core/sha256.h"
+
+/*
+ * Scans a synthetic executable region map shaped like a game process: 256
+ * loaded images with a .text and a second executable section each, 48 JIT
+ * and overlay regions of private memory and 16 mapped views, around 600
+ * executable regions in total.
+ *
+ * Inspecting a region hashes its first page, standing in for whatever is done
+ * with a new region. A full round inspects every region, which is what every
+ * scan would cost without the map. An incremental round only inspects the
+ * range(0) regions changed before it.
+ */
+
+namespace {
+
+constexpr uint32_t IMAGE_COUNT = 256;
+constexpr uint32_t PRIVATE_COUNT = 48;
+constexpr uint32_t MAPPED_COUNT = 16;
+
+constexpr UINT32 PAGE_EXECUTE_READ = 0x20;
+constexpr UINT32 PAGE_EXECUTE_READWRITE = 0x40;
+
+struct synthetic_process {
+  std::vector<MEMORY_REGION> regions;
+  std::vector<MEMORY_REGION> buffer;
+  std::vector<char> page;
+  REGION_MAP map = {};
+
+  synthetic_process() : page(bench::PAGE_SIZE) {
+    bench::xorshift random;
+    uint64_t address = 0x10000;
+
+    bench::fill_random(this->page.data(), this->page.size());
+
+    for (uint32_t index = 0;
+         index < IMAGE_COUNT + PRIVATE_COUNT + MAPPED_COUNT; index++) {
+      MEMORY_REGION region = {};
+      uint64_t pages = 1 + random.next() % 64;
+
+      region.base = address;
+      region.size = pages * bench::PAGE_SIZE;
+      region.protection = PAGE_EXECUTE_READ;
+
+      if (index % 6 == 5 && index / 6 < PRIVATE_COUNT) {
+        region.type = RegionTypePrivate;
+        region.protection = PAGE_EXECUTE_READWRITE;
+      } else if (index % 20 == 19 && index / 20 < MAPPED_COUNT) {
+        region.type = RegionTypeMapped;
+      } else {
+        region.type = RegionTypeImage;
+      }
+
+      this->regions.push_back(region);
+
+      /* images have their second executable section after .rdata */
+      if (region.type == RegionTypeImage) {
+        region.base += region.size + 2 * bench::PAGE_SIZE;
+        region.size = bench::PAGE_SIZE;
+        this->regions.push_back(region);
+      }
+
+      address = region.base + region.size + 0x100000;
+    }
+
+    this->buffer.resize(2 * REGION_MAP_DEFAULT_CAPACITY);
+    RegionMapInitialise(&this->map, this->buffer.data(),
+                        REGION_MAP_DEFAULT_CAPACITY);
+  }
+
+  void round(REGION_CALLBACK callback, PVOID context) {
+    RegionMapBeginRound(&this->map);
+
+    for (MEMORY_REGION &region : this->regions)
+      RegionMapRecord(&this->map, &region, callback, context);
+
+    RegionMapEndRound(&this->map);
+  }
+};
+
+synthetic_process &get_process() {
+  static synthetic_process process;
+  return process;
+}
+
+struct inspection {
+  const char *page;
+  uint64_t inspected;
+  uint64_t unbacked;
+};
+
+void inspect_region(PMEMORY_REGION Region, REGION_STATE State,
+                    PVOID Context) {
+  inspection *context = static_cast<inspection *>(Context);
+  UCHAR digest[32];
+
+  Sha256Compute(const_cast<char *>(context->page), bench::PAGE_SIZE, digest);
+  benchmark::DoNotOptimize(digest);
+
+  context->inspected++;
+  context->unbacked += RegionIsUnbackedExecutable(Region);
+}
+
+} // namespace
+
+static void inspect_every_region(benchmark::State &state) {
+  synthetic_process &process = get_process();
+  inspection context = {process.page.data()};
+
+  for (auto _ : state)
+    for (MEMORY_REGION &region : process.regions)
+      inspect_region(&region, RegionStateNew, &context);
+
+  state.SetItemsProcessed(state.iterations() * process.regions.size());
+  state.counters["regions"] = static_cast<double>(process.regions.size());
+  state.counters["inspected"] = benchmark::Counter(
+      static_cast<double>(context.inspected),
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(inspect_every_region)->Unit(benchmark::kMicrosecond);
+
+/* range(0) regions change protection before every round */
+static void scan_region_map(benchmark::State &state) {
+  synthetic_process &process = get_process();
+  uint32_t changes = static_cast<uint32_t>(state.range(0));
+  inspection context = {process.page.data()};
+  bench::xorshift random;
+
+  RegionMapReset(&process.map);
+  process.round(nullptr, nullptr);
+
+  for (auto _ : state) {
+    for (uint32_t index = 0; index < changes; index++) {
+      MEMORY_REGION &region =
+          process.regions[random.next() % process.regions.size()];
+      region.protection ^= PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE;
+    }
+
+    process.round(inspect_region, &context);
+  }
+
+  state.SetItemsProcessed(state.iterations() * process.regions.size());
+  state.counters["regions"] = static_cast<double>(process.map.count);
+  state.counters["inspected"] = benchmark::Counter(
+      static_cast<double>(context.inspected),
+      benchmark::Counter::kAvgIterations);
+  state.counters["unbacked"] = benchmark::Counter(
+      static_cast<double>(context.unbacked),
+      benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(scan_region_map)
+    ->Arg(0)
+    ->Arg(16)
+    ->Arg(128)
+    ->Unit(benchmark::kMicrosecond);
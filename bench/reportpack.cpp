@@ -0,0 +1,256 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/report.h"
+#include "../core/reportpack.h"
+
+/*
+ * Packs a corpus of the reports that dominate the uplink: handle reports,
+ * driver and process module validation failures and stackwalk reports, with
+ * names drawn from short lists and kernel addresses in the usual ranges. The
+ * dictionary is trained on one corpus and measured on another from a
+ * different seed, the way it would be trained on recordings and shipped.
+ *
+ * The /0 variants pack against zeroes, the /1 variants against the trained
+ * dictionary. bytes_per_second is over the unpacked reports, ratio is the
+ * unpacked size over the packed size.
+ */
+
+namespace {
+
+constexpr uint32_t CORPUS_SIZE = 1024;
+constexpr uint64_t TEST_SEED = 0x7061636b;
+
+const char *process_names[] = {"cheatengine-x86_64.exe", "ReClass.NET.exe",
+                               "x64dbg.exe", "ProcessHacker.exe",
+                               "svchost.exe", "explorer.exe", "csrss.exe"};
+
+const char *driver_names[] = {
+    "\\SystemRoot\\System32\\drivers\\dbk64.sys",
+    "\\SystemRoot\\System32\\drivers\\kprocesshacker.sys",
+    "\\SystemRoot\\System32\\drivers\\iqvw64e.sys",
+    "\\SystemRoot\\System32\\drivers\\gdrv.sys"};
+
+const char *module_paths[] = {"C:\\Windows\\System32\\ntdll.dll",
+                              "C:\\Windows\\System32\\kernel32.dll",
+                              "C:\\Users\\user\\AppData\\Local\\Temp\\a.dll",
+                              "C:\\Windows\\System32\\d3d11.dll"};
+
+template <size_t N>
+const char *pick(const char *(&names)[N], bench::xorshift &random) {
+  return names[random.next() % N];
+}
+
+UINT64 kernel_address(bench::xorshift &random) {
+  return 0xfffff80000000000ull | (random.next() & 0xffffffffffull);
+}
+
+std::vector<uint8_t> make_report(bench::xorshift &random) {
+  std::vector<uint8_t> buffer;
+
+  switch (random.next() % 4) {
+  case 0: {
+    OPEN_HANDLE_FAILURE_REPORT report = {};
+    report.report_code = REPORT_ILLEGAL_HANDLE_OPERATION;
+    report.process_id = static_cast<LONG>(random.next() % 0x4000) * 4;
+    report.thread_id = static_cast<LONG>(random.next() % 0x4000) * 4;
+    report.access = 0x1fffff;
+    strcpy(report.process_name, pick(process_names, random));
+    buffer.assign(reinterpret_cast<uint8_t *>(&report),
+                  reinterpret_cast<uint8_t *>(&report + 1));
+    break;
+  }
+  case 1: {
+    MODULE_VALIDATION_FAILURE report = {};
+    report.report_code = REPORT_MODULE_VALIDATION_FAILURE;
+    report.report_type = static_cast<INT>(random.next() % 3);
+    report.driver_base_address = kernel_address(random) & ~0xfffull;
+    report.driver_size = (random.next() % 0x100 + 1) * 0x1000;
+    strcpy(report.driver_name, pick(driver_names, random));
+    buffer.assign(reinterpret_cast<uint8_t *>(&report),
+                  reinterpret_cast<uint8_t *>(&report + 1));
+    break;
+  }
+  case 2: {
+    PROCESS_MODULE_VALIDATION_REPORT report = {};
+    const char *path = pick(module_paths, random);
+    report.report_code = REPORT_INVALID_PROCESS_MODULE;
+    report.image_base = 0x7ff000000000ull | (random.next() & 0xfff0000ull);
+    report.image_size = static_cast<UINT32>(random.next() % 0x100 + 1) << 12;
+    for (size_t index = 0; path[index]; index++)
+      report.module_path[index] = static_cast<WCHAR>(path[index]);
+    buffer.assign(reinterpret_cast<uint8_t *>(&report),
+                  reinterpret_cast<uint8_t *>(&report + 1));
+    break;
+  }
+  default: {
+    APC_STACKWALK_REPORT report = {};
+    report.report_code = REPORT_APC_STACKWALK;
+    report.kthread_address = 0xffff800000000000ull |
+                             (random.next() & 0xfffffffff0ull);
+    report.invalid_rip = kernel_address(random) | 0x100000000000ull;
+    memcpy(report.driver, &report.invalid_rip, sizeof(report.invalid_rip));
+    buffer.assign(reinterpret_cast<uint8_t *>(&report),
+                  reinterpret_cast<uint8_t *>(&report + 1));
+    break;
+  }
+  }
+
+  return buffer;
+}
+
+std::vector<std::vector<uint8_t>> make_corpus(uint64_t seed) {
+  std::vector<std::vector<uint8_t>> corpus;
+  bench::xorshift random(seed);
+
+  for (uint32_t index = 0; index < CORPUS_SIZE; index++)
+    corpus.push_back(make_report(random));
+
+  return corpus;
+}
+
+/* the same file format tools/replay writes with --train */
+struct trained_dictionary {
+  std::vector<uint8_t> data;
+  REPORT_DICTIONARY dictionary = {};
+
+  trained_dictionary() {
+    std::vector<std::vector<uint8_t>> corpus = make_corpus(bench::DATASET_SEED);
+    std::vector<std::vector<uint8_t>> references;
+    std::vector<std::vector<uint16_t>> counts;
+    std::vector<uint32_t> codes;
+
+    for (std::vector<uint8_t> &report : corpus) {
+      uint32_t code = ReportGetCode(report.data());
+      size_t index = 0;
+
+      while (index < codes.size() && codes[index] < code)
+        index++;
+
+      if (index == codes.size() || codes[index] != code) {
+        codes.insert(codes.begin() + index, code);
+        references.emplace(references.begin() + index, report.size());
+        counts.emplace(counts.begin() + index, report.size());
+      }
+
+      ReportDictionaryTrain(references[index].data(), counts[index].data(),
+                            report.data(),
+                            static_cast<UINT32>(report.size()));
+    }
+
+    this->data.resize(sizeof(REPORT_DICTIONARY_HEADER));
+    for (size_t index = 0; index < codes.size(); index++) {
+      REPORT_DICTIONARY_RECORD record = {};
+      record.report_code = codes[index];
+      record.size = static_cast<UINT32>(references[index].size());
+
+      const uint8_t *raw = reinterpret_cast<const uint8_t *>(&record);
+      this->data.insert(this->data.end(), raw, raw + sizeof(record));
+      this->data.insert(this->data.end(), references[index].begin(),
+                        references[index].end());
+    }
+
+    REPORT_DICTIONARY_HEADER header = {};
+    header.magic = REPORT_DICTIONARY_MAGIC;
+    header.version = REPORT_DICTIONARY_VERSION;
+    header.count = static_cast<UINT16>(codes.size());
+    header.id = ReportDictionaryHash(this->data.data() + sizeof(header),
+                                     this->data.size() - sizeof(header));
+    memcpy(this->data.data(), &header, sizeof(header));
+
+    ReportDictionaryLoad(&this->dictionary, this->data.data(),
+                         this->data.size());
+  }
+};
+
+PREPORT_DICTIONARY get_dictionary(bool trained) {
+  static trained_dictionary dictionary;
+  return trained ? &dictionary.dictionary : nullptr;
+}
+
+const std::vector<std::vector<uint8_t>> &get_corpus() {
+  static std::vector<std::vector<uint8_t>> corpus = make_corpus(TEST_SEED);
+  return corpus;
+}
+
+size_t corpus_bytes() {
+  size_t bytes = 0;
+  for (const std::vector<uint8_t> &report : get_corpus())
+    bytes += report.size();
+  return bytes;
+}
+
+} // namespace
+
+static void pack_reports(benchmark::State &state) {
+  PREPORT_DICTIONARY dictionary = get_dictionary(state.range(0));
+  const std::vector<std::vector<uint8_t>> &corpus = get_corpus();
+  uint8_t buffer[REPORT_PACK_BOUND(REPORT_DICTIONARY_MAX_SIZE)];
+  size_t packed = 0;
+
+  for (auto _ : state) {
+    packed = 0;
+    for (const std::vector<uint8_t> &report : corpus) {
+      packed += ReportPack(dictionary, (PVOID)report.data(),
+                           static_cast<UINT32>(report.size()), buffer,
+                           sizeof(buffer));
+      benchmark::DoNotOptimize(buffer);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * corpus.size());
+  state.SetBytesProcessed(state.iterations() * corpus_bytes());
+  state.counters["ratio"] = static_cast<double>(corpus_bytes()) / packed;
+}
+BENCHMARK(pack_reports)->Arg(0)->Arg(1);
+
+static void unpack_reports(benchmark::State &state) {
+  PREPORT_DICTIONARY dictionary = get_dictionary(state.range(0));
+  const std::vector<std::vector<uint8_t>> &corpus = get_corpus();
+  std::vector<uint8_t> stream;
+  uint8_t report[REPORT_DICTIONARY_MAX_SIZE];
+
+  for (const std::vector<uint8_t> &entry : corpus) {
+    uint8_t buffer[REPORT_PACK_BOUND(REPORT_DICTIONARY_MAX_SIZE)];
+    SIZE_T length = ReportPack(dictionary, (PVOID)entry.data(),
+                               static_cast<UINT32>(entry.size()), buffer,
+                               sizeof(buffer));
+    stream.insert(stream.end(), buffer, buffer + length);
+
+    UINT32 size = 0;
+    SIZE_T consumed = 0;
+    if (!NT_SUCCESS(ReportUnpack(dictionary, buffer, length, report,
+                                 sizeof(report), &size, &consumed)) ||
+        size != entry.size() || memcmp(report, entry.data(), size)) {
+      state.SkipWithError("report did not survive packing");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    size_t offset = 0;
+    while (offset < stream.size()) {
+      UINT32 size = 0;
+      SIZE_T consumed = 0;
+      NTSTATUS status = ReportUnpack(
+          dictionary, stream.data() + offset, stream.size() - offset, report,
+          sizeof(report), &size, &consumed);
+      if (!NT_SUCCESS(status)) {
+        state.SkipWithError("corrupt packed report");
+        return;
+      }
+      benchmark::DoNotOptimize(report);
+      offset += consumed;
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * corpus.size());
+  state.SetBytesProcessed(state.iterations() * corpus_bytes());
+  state.counters["ratio"] =
+      static_cast<double>(corpus_bytes()) / stream.size();
+}
+BENCHMARK(unpack_reports)->Arg(0)->Arg(1);
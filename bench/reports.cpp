@@ -0,0 +1,110 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstring>
+
+#include "datasets.h"
+
+#include "../core/container.h"
+#include "../core/report.h"
+#include "../module/dispatcher/threadpool.h"
+
+#define REPORT_QUEUE_POOL_TAG 'qqqq'
+
+/*
+ * Encode is what the driver does when completing an IRP, fill out the report
+ * and copy it into the output buffer. Decode is what the module does with the
+ * completed buffer.
+ */
+static void report_encode(benchmark::State &state) {
+  char buffer[sizeof(APC_STACKWALK_REPORT)];
+  UINT64 rip = 0xfffff80000001000;
+
+  for (auto _ : state) {
+    APC_STACKWALK_REPORT report = {0};
+    report.report_code = REPORT_APC_STACKWALK;
+    report.kthread_address = 0xffffc00000000000;
+    report.invalid_rip = rip++;
+    memcpy(report.driver, reinterpret_cast<void *>(&rip), sizeof(rip));
+    memcpy(buffer, &report, sizeof(report));
+    benchmark::DoNotOptimize(buffer);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(report_encode);
+
+static void report_decode(benchmark::State &state) {
+  static constexpr UINT32 codes[] = {
+      REPORT_NMI_CALLBACK_FAILURE,     REPORT_MODULE_VALIDATION_FAILURE,
+      REPORT_ILLEGAL_HANDLE_OPERATION, REPORT_INVALID_PROCESS_ALLOCATION,
+      REPORT_HIDDEN_SYSTEM_THREAD,     REPORT_ILLEGAL_ATTACH_PROCESS,
+      REPORT_APC_STACKWALK,            REPORT_DPC_STACKWALK,
+      REPORT_DATA_TABLE_ROUTINE,       REPORT_INVALID_PROCESS_MODULE};
+  static constexpr size_t count = sizeof(codes) / sizeof(codes[0]);
+
+  std::vector<std::vector<char>> buffers(count);
+  for (size_t index = 0; index < count; index++) {
+    buffers[index].resize(ReportGetExpectedSize(codes[index]));
+    bench::fill_random(buffers[index].data(), buffers[index].size(), index);
+    memcpy(buffers[index].data(), &codes[index], sizeof(UINT32));
+  }
+
+  for (auto _ : state) {
+    for (std::vector<char> &buffer : buffers) {
+      BOOLEAN valid =
+          ReportIsValid(buffer.data(), static_cast<UINT32>(buffer.size()));
+      UINT32 code = ReportGetCode(buffer.data());
+      benchmark::DoNotOptimize(valid);
+      benchmark::DoNotOptimize(code);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(report_decode);
+
+/*
+ * Same pattern as QueuePush / QueuePop in the driver, a pool allocation per
+ * node and a push followed by a pop of the whole batch.
+ */
+static void report_queue(benchmark::State &state) {
+  size_t batch = static_cast<size_t>(state.range(0));
+  QUEUE_LIST queue = {0};
+  QueueListInit(&queue);
+
+  for (auto _ : state) {
+    for (size_t index = 0; index < batch; index++) {
+      PQUEUE_NODE node = static_cast<PQUEUE_NODE>(
+          PlatformAllocatePool(sizeof(QUEUE_NODE), REPORT_QUEUE_POOL_TAG));
+      QueueListInsertTail(&queue, node, reinterpret_cast<PVOID>(index));
+    }
+
+    while (PQUEUE_NODE node = QueueListRemoveHead(&queue)) {
+      benchmark::DoNotOptimize(node->data);
+      PlatformFreePool(node, REPORT_QUEUE_POOL_TAG);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(report_queue)->Arg(20)->Arg(1000);
+
+static void thread_pool_dispatch(benchmark::State &state) {
+  size_t jobs = static_cast<size_t>(state.range(0));
+  dispatcher::thread_pool pool(4);
+  std::atomic<size_t> completed = 0;
+
+  for (auto _ : state) {
+    completed = 0;
+    for (size_t index = 0; index < jobs; index++)
+      pool.queue_job([&completed] { completed++; });
+
+    while (completed.load() != jobs)
+      ;
+  }
+
+  pool.terminate();
+  state.SetItemsProcessed(state.iterations() * jobs);
+}
+BENCHMARK(thread_pool_dispatch)->Arg(64)->Arg(1024)->UseRealTime();
@@ -0,0 +1,148 @@
+#include <benchmark/benchmark.h>
+
+#include "datasets.h"
+
+#include "../core/pe.h"
+#include "../core/sha256.h"
+#include "../core/signature.h"
+#include "../core/system_modules.h"
+
+static constexpr char SIGNATURE[] = "\x48\x8b\x05\x00\x00\x00\x00\x48\x85\xc0";
+static constexpr char PROCESS_POOL_TAG[] = "\x50\x72\x6f\x63";
+
+static void scan_for_signature(benchmark::State &state) {
+  size_t size = static_cast<size_t>(state.range(0));
+  std::vector<char> haystack =
+      bench::make_signature_haystack(size, SIGNATURE, sizeof(SIGNATURE) - 1);
+
+  for (auto _ : state) {
+    PVOID result = ScanForSignature(haystack.data(), size, SIGNATURE,
+                                    sizeof(SIGNATURE) - 1);
+    benchmark::DoNotOptimize(result);
+  }
+
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(scan_for_signature)->Arg(64 << 10)->Arg(1 << 20);
+
+/*
+ * Mirrors the unlinked process scan, every page is searched for every tag
+ * occurence rather then stopping at the first one.
+ */
+static void scan_pool_pages(benchmark::State &state) {
+  uint32_t page_count = static_cast<uint32_t>(state.range(0));
+  std::vector<char> pages =
+      bench::make_pool_pages(page_count, PROCESS_POOL_TAG, 8);
+
+  for (auto _ : state) {
+    uint32_t hits = 0;
+    for (uint32_t page = 0; page < page_count; page++) {
+      char *base = pages.data() + static_cast<size_t>(page) * bench::PAGE_SIZE;
+      char *end = base + bench::PAGE_SIZE;
+      while (base < end) {
+        char *match = static_cast<char *>(
+            ScanForPoolTag(base, end - base, PROCESS_POOL_TAG));
+        if (!match)
+          break;
+        hits++;
+        base = match + 1;
+      }
+    }
+    benchmark::DoNotOptimize(hits);
+  }
+
+  state.SetBytesProcessed(state.iterations() * pages.size());
+}
+BENCHMARK(scan_pool_pages)->Arg(256)->Arg(4096);
+
+/*
+ * The module integrity check copies every executable section out of the image
+ * and hashes the result, so measure both together.
+ */
+static void hash_executable_sections(benchmark::State &state) {
+  uint32_t section_size = static_cast<uint32_t>(state.range(0));
+  std::vector<char> image = bench::make_pe_image(9, section_size);
+  std::vector<char> buffer(image.size());
+  UCHAR digest[SHA256_DIGEST_LENGTH] = {0};
+
+  for (auto _ : state) {
+    UINT32 count = 0;
+    SIZE_T written = 0;
+    PeCopyExecutableSections(image.data(), image.size(), buffer.data(),
+                             buffer.size(), &count, &written);
+    Sha256Compute(buffer.data(), written, digest);
+    benchmark::DoNotOptimize(digest);
+  }
+
+  state.SetBytesProcessed(state.iterations() * image.size());
+}
+BENCHMARK(hash_executable_sections)->Arg(16 << 10)->Arg(256 << 10);
+
+/*
+ * Section extraction alone, with many small sections so the per section
+ * header checks dominate rather than the copy.
+ */
+static void copy_executable_sections(benchmark::State &state) {
+  uint32_t section_count = static_cast<uint32_t>(state.range(0));
+  std::vector<char> image = bench::make_pe_image(section_count, 0x200);
+  std::vector<char> buffer(image.size());
+
+  for (auto _ : state) {
+    UINT32 count = 0;
+    SIZE_T written = 0;
+    PeCopyExecutableSections(image.data(), image.size(), buffer.data(),
+                             buffer.size(), &count, &written);
+    benchmark::DoNotOptimize(written);
+  }
+
+  state.SetItemsProcessed(state.iterations() * section_count);
+  state.SetBytesProcessed(state.iterations() * image.size());
+}
+BENCHMARK(copy_executable_sections)->Arg(8)->Arg(96);
+
+static void sha256(benchmark::State &state) {
+  std::vector<char> buffer(static_cast<size_t>(state.range(0)));
+  UCHAR digest[SHA256_DIGEST_LENGTH] = {0};
+  bench::fill_random(buffer.data(), buffer.size());
+
+  for (auto _ : state) {
+    Sha256Compute(buffer.data(), buffer.size(), digest);
+    benchmark::DoNotOptimize(digest);
+  }
+
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(sha256)->Arg(4 << 10)->Arg(1 << 20);
+
+/*
+ * Stack frames are validated against the system module list one address at a
+ * time. Half of the lookups land inside a module and half land in the gaps
+ * between them.
+ */
+static void module_range_lookup(benchmark::State &state) {
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules =
+      bench::make_module_list(static_cast<uint32_t>(state.range(0)));
+  SYSTEM_MODULES system_modules = {modules.data(),
+                                   static_cast<INT>(modules.size())};
+
+  std::vector<UINT64> addresses(1024);
+  bench::xorshift rng;
+  for (size_t index = 0; index < addresses.size(); index++) {
+    const RTL_MODULE_EXTENDED_INFO &module =
+        modules[rng.next() % modules.size()];
+    UINT64 base = reinterpret_cast<UINT64>(module.ImageBase);
+    addresses[index] = index % 2 ? base + rng.next() % module.ImageSize
+                                 : base + module.ImageSize + 1;
+  }
+
+  for (auto _ : state) {
+    for (UINT64 address : addresses) {
+      BOOLEAN result = FALSE;
+      IsInstructionPointerInInvalidRegion(address, &system_modules, &result);
+      benchmark::DoNotOptimize(result);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * addresses.size());
+}
+BENCHMARK(module_range_lookup)->Arg(64)->Arg(256);
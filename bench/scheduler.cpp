@@ -0,0 +1,36 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../module/dispatcher/scheduler.h"
+
+/*
+ * post_job is the time from posting a job to the dispatcher's scheduler to it
+ * running on the dispatcher thread, with a periodic job far off in the heap as
+ * the module always has. Before the scheduler an urgent job waited for the
+ * next iteration of a loop that slept DISPATCH_LOOP_SLEEP_TIME seconds.
+ */
+
+static void post_job(benchmark::State &state) {
+  dispatcher::scheduler jobs;
+  std::atomic<uint64_t> ran(0);
+  uint64_t posted = 0;
+
+  jobs.schedule([]() {}, std::chrono::hours(1), std::chrono::hours(1));
+  std::thread runner([&]() { jobs.run(); });
+
+  for (auto _ : state) {
+    jobs.post([&]() { ran.fetch_add(1, std::memory_order_release); });
+    posted++;
+    while (ran.load(std::memory_order_acquire) != posted)
+      ;
+  }
+
+  jobs.shutdown();
+  runner.join();
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(post_job)->UseRealTime();
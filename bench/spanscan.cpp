@@ -0,0 +1,196 @@
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "memimage.h"
+
+#include "../core/pagewalk.h"
+
+/*
+ * Scans synthetic kernel page tables for executable memory outside of loaded
+ * modules, the way FindUnownedExecutableMemory does. Ram is mapped with the
+ * usual mix of 1GB, 2MB and 4KB pages, EXECUTABLE_RATIO of the leaf mappings
+ * are executable and all but one in UNOWNED_STRIDE of those belong to a
+ * module.
+ *
+ * scan_executable_pages is the scan without spans: every page of every
+ * mapping is translated and its ownership looked up on its own, like a large
+ * page is just a run of 4KB pages. scan_executable_spans checks ownership
+ * and executability once per mapping and only translates unowned ones.
+ * per_gb is the cost of scanning a GB of mapped memory.
+ */
+
+static constexpr double EXECUTABLE_RATIO = 0.05;
+static constexpr uint32_t UNOWNED_STRIDE = 64;
+
+namespace {
+
+struct span_scan {
+  PAGE_WALK *walk;
+  PAGE_SPAN_OWNERS owners;
+  /* offset into walk->span of the next page, for the per page scan */
+  uint64_t offset;
+  uint64_t unowned_pages;
+};
+
+struct span_image {
+  std::unique_ptr<bench::memory_image> image;
+  std::vector<PAGE_SPAN_OWNER> owners;
+  uint64_t executable_spans;
+  uint64_t mapped_gb;
+};
+
+BOOLEAN collect_owner(PPAGE_SPAN Span, PVOID Context) {
+  span_image *image = static_cast<span_image *>(Context);
+
+  if (!Span->executable || Span->user)
+    return FALSE;
+
+  if (image->executable_spans++ % UNOWNED_STRIDE != UNOWNED_STRIDE - 1)
+    image->owners.push_back(
+        {Span->virtual_base, Span->virtual_base + Span->size});
+
+  return FALSE;
+}
+
+void ignore_page(UINT64 PageBase, ULONG PageSize, PVOID Context) {}
+
+/*
+ * Executable spans are handed out to modules as they are found, skipping one
+ * in UNOWNED_STRIDE, so the unowned spans are spread over every page size.
+ */
+span_image &get_image(uint32_t physical_size_gb) {
+  static std::map<uint32_t, std::unique_ptr<span_image>> images;
+  std::unique_ptr<span_image> &image = images[physical_size_gb];
+
+  if (!image) {
+    bench::memory_image_config config;
+    config.physical_size_gb = physical_size_gb;
+    config.executable_ratio = EXECUTABLE_RATIO;
+
+    image = std::make_unique<span_image>();
+    image->image = std::make_unique<bench::memory_image>(config);
+    image->mapped_gb = physical_size_gb;
+
+    PAGE_WALK walk = {};
+    image->image->prepare_walk(walk);
+    walk.callback = ignore_page;
+    walk.callback_context = image.get();
+    walk.span_filter = collect_owner;
+    WalkPageTables(&walk);
+  }
+
+  return *image;
+}
+
+void prepare_scan(span_image &image, PAGE_WALK &walk, span_scan &scan) {
+  image.image->prepare_walk(walk);
+  walk.callback_context = &scan;
+
+  scan.walk = &walk;
+  scan.owners.capacity = static_cast<UINT32>(image.owners.size());
+  scan.owners.count = scan.owners.capacity;
+  scan.owners.owners = image.owners.data();
+  PageSpanOwnersSort(&scan.owners);
+}
+
+/* the same check the driver makes, the first non zero word ends it */
+bool is_page_empty(UINT64 PageBase, ULONG PageSize) {
+  const volatile uint64_t *page =
+      reinterpret_cast<const volatile uint64_t *>(PageBase);
+
+  for (uint32_t index = 0; index < PageSize / sizeof(uint64_t); index++)
+    if (page[index])
+      return false;
+
+  return true;
+}
+
+BOOLEAN keep_every_span(PPAGE_SPAN Span, PVOID Context) {
+  static_cast<span_scan *>(Context)->offset = 0;
+  return TRUE;
+}
+
+void scan_page(UINT64 PageBase, ULONG PageSize, PVOID Context) {
+  span_scan *scan = static_cast<span_scan *>(Context);
+  PAGE_SPAN page = scan->walk->span;
+
+  page.virtual_base += scan->offset;
+  page.size = PageSize;
+  scan->offset += PageSize;
+
+  if (!page.executable || page.user || PageSpanIsOwned(&scan->owners, &page))
+    return;
+
+  scan->unowned_pages++;
+  benchmark::DoNotOptimize(is_page_empty(PageBase, PageSize));
+}
+
+BOOLEAN keep_unowned_span(PPAGE_SPAN Span, PVOID Context) {
+  span_scan *scan = static_cast<span_scan *>(Context);
+  return Span->executable && !Span->user &&
+         !PageSpanIsOwned(&scan->owners, Span);
+}
+
+void scan_unowned_page(UINT64 PageBase, ULONG PageSize, PVOID Context) {
+  static_cast<span_scan *>(Context)->unowned_pages++;
+  benchmark::DoNotOptimize(is_page_empty(PageBase, PageSize));
+}
+
+void set_counters(benchmark::State &state, span_image &image,
+                  PAGE_WALK &walk, span_scan &scan) {
+  state.counters["spans"] = static_cast<double>(walk.spans_visited);
+  state.counters["owners"] = static_cast<double>(scan.owners.count);
+  state.counters["pages"] = static_cast<double>(walk.pages_visited);
+  state.counters["unowned_pages"] = benchmark::Counter(
+      static_cast<double>(scan.unowned_pages),
+      benchmark::Counter::kAvgIterations);
+  state.counters["per_gb"] = benchmark::Counter(
+      static_cast<double>(image.mapped_gb),
+      benchmark::Counter::kIsIterationInvariantRate |
+          benchmark::Counter::kInvert);
+}
+
+} // namespace
+
+static void scan_executable_pages(benchmark::State &state) {
+  span_image &image = get_image(static_cast<uint32_t>(state.range(0)));
+  PAGE_WALK walk = {};
+  span_scan scan = {};
+
+  prepare_scan(image, walk, scan);
+  walk.span_filter = keep_every_span;
+  walk.callback = scan_page;
+
+  for (auto _ : state)
+    WalkPageTables(&walk);
+
+  set_counters(state, image, walk, scan);
+}
+BENCHMARK(scan_executable_pages)
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128)
+    ->Unit(benchmark::kMillisecond);
+
+static void scan_executable_spans(benchmark::State &state) {
+  span_image &image = get_image(static_cast<uint32_t>(state.range(0)));
+  PAGE_WALK walk = {};
+  span_scan scan = {};
+
+  prepare_scan(image, walk, scan);
+  walk.span_filter = keep_unowned_span;
+  walk.callback = scan_unowned_page;
+
+  for (auto _ : state)
+    WalkPageTables(&walk);
+
+  set_counters(state, image, walk, scan);
+}
+BENCHMARK(scan_executable_spans)
+    ->Arg(8)
+    ->Arg(32)
+    ->Arg(128)
+    ->Unit(benchmark::kMillisecond);
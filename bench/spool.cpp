@@ -0,0 +1,217 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "datasets.h"
+
+#include "../core/spool.h"
+
+/*
+ * The report spool the module appends to before writing to the pipe, sized
+ * as the module maps it. Records are drawn from the sizes of the reports that
+ * dominate the uplink, framed as the module frames them.
+ *
+ * append_spool/0 appends to a spool in host memory, /1 to a MAP_SHARED file
+ * mapping the way the module maps its spool file. The reader keeps the spool
+ * at around half full, releasing a record for every one appended, so each
+ * append pays for the release checkpoint as it would with the server up.
+ * append_spool_outage is the server being down, appends with no releases
+ * until the spool fills, at which point it is drained untimed.
+ *
+ * recover_spool/N is SpoolOpen after a crash N appends past the newest
+ * checkpoint, the scan recovery has to do.
+ */
+
+namespace {
+
+constexpr SIZE_T SPOOL_SIZE = 0x400000;
+constexpr uint32_t RECORD_COUNT = 4096;
+constexpr uint32_t FRAME_HEADER_SIZE = 16;
+
+const uint32_t report_sizes[] = {0x48, 0x230, 0x218, 0x50, 0x28};
+
+std::vector<std::vector<uint8_t>> make_records() {
+  std::vector<std::vector<uint8_t>> records;
+  bench::xorshift random;
+
+  for (uint32_t index = 0; index < RECORD_COUNT; index++) {
+    uint32_t size = report_sizes[random.next() % (sizeof(report_sizes) /
+                                                  sizeof(report_sizes[0]))];
+    std::vector<uint8_t> record(FRAME_HEADER_SIZE + size);
+    bench::fill_random(record.data(), record.size(), random.next());
+    records.push_back(std::move(record));
+  }
+
+  return records;
+}
+
+const std::vector<std::vector<uint8_t>> &get_records() {
+  static std::vector<std::vector<uint8_t>> records = make_records();
+  return records;
+}
+
+/* host memory, or on unix an unlinked file mapped shared */
+class spool_mapping {
+  std::vector<uint8_t> memory;
+  void *view = nullptr;
+  int fd = -1;
+
+public:
+  spool_mapping(bool file) {
+    if (!file) {
+      this->memory.resize(SPOOL_SIZE);
+      this->view = this->memory.data();
+      return;
+    }
+#if defined(__unix__)
+    char path[] = "/tmp/ac_spool_bench_XXXXXX";
+    this->fd = mkstemp(path);
+    if (this->fd < 0)
+      return;
+    unlink(path);
+    if (ftruncate(this->fd, SPOOL_SIZE))
+      return;
+    void *view = mmap(nullptr, SPOOL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      this->fd, 0);
+    if (view != MAP_FAILED)
+      this->view = view;
+#endif
+  }
+
+  ~spool_mapping() {
+#if defined(__unix__)
+    if (this->fd >= 0) {
+      if (this->view)
+        munmap(this->view, SPOOL_SIZE);
+      close(this->fd);
+    }
+#endif
+  }
+
+  void *get() { return this->view; }
+};
+
+} // namespace
+
+static void append_spool(benchmark::State &state) {
+  const std::vector<std::vector<uint8_t>> &records = get_records();
+  spool_mapping mapping(state.range(0));
+  SPOOL spool = {};
+  size_t bytes = 0;
+  uint32_t index = 0;
+
+  if (!mapping.get() ||
+      !NT_SUCCESS(SpoolFormat(&spool, mapping.get(), SPOOL_SIZE))) {
+    state.SkipWithError("failed to map the spool");
+    return;
+  }
+
+  /* start half full so appends and releases are spread over the ring */
+  while (spool.tail - spool.head < spool.capacity / 2) {
+    const std::vector<uint8_t> &record = records[index++ % RECORD_COUNT];
+    SpoolAppend(&spool, (PVOID)record.data(),
+                static_cast<UINT32>(record.size()));
+  }
+
+  for (auto _ : state) {
+    const std::vector<uint8_t> &record = records[index++ % RECORD_COUNT];
+    if (!NT_SUCCESS(SpoolAppend(&spool, (PVOID)record.data(),
+                                static_cast<UINT32>(record.size())))) {
+      state.SkipWithError("spool filled up");
+      return;
+    }
+    SpoolRelease(&spool);
+    bytes += record.size();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(append_spool)->Arg(0)
+#if defined(__unix__)
+    ->Arg(1)
+#endif
+    ;
+
+static void append_spool_outage(benchmark::State &state) {
+  const std::vector<std::vector<uint8_t>> &records = get_records();
+  spool_mapping mapping(state.range(0));
+  SPOOL spool = {};
+  size_t bytes = 0;
+  uint32_t index = 0;
+
+  if (!mapping.get() ||
+      !NT_SUCCESS(SpoolFormat(&spool, mapping.get(), SPOOL_SIZE))) {
+    state.SkipWithError("failed to map the spool");
+    return;
+  }
+
+  for (auto _ : state) {
+    const std::vector<uint8_t> &record = records[index++ % RECORD_COUNT];
+    if (!NT_SUCCESS(SpoolAppend(&spool, (PVOID)record.data(),
+                                static_cast<UINT32>(record.size())))) {
+      state.PauseTiming();
+      while (spool.head != spool.tail)
+        SpoolRelease(&spool);
+      state.ResumeTiming();
+      continue;
+    }
+    bytes += record.size();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(bytes);
+}
+BENCHMARK(append_spool_outage)->Arg(0)
+#if defined(__unix__)
+    ->Arg(1)
+#endif
+    ;
+
+static void recover_spool(benchmark::State &state) {
+  const std::vector<std::vector<uint8_t>> &records = get_records();
+  std::vector<uint8_t> memory(SPOOL_SIZE);
+  std::vector<uint8_t> header(SPOOL_DATA_OFFSET);
+  SPOOL spool = {};
+  uint32_t index = 0;
+
+  SpoolFormat(&spool, memory.data(), memory.size());
+
+  /* a few thousand records in, then a checkpoint and N more */
+  while (spool.tail - spool.head < spool.capacity / 2) {
+    const std::vector<uint8_t> &record = records[index++ % RECORD_COUNT];
+    SpoolAppend(&spool, (PVOID)record.data(),
+                static_cast<UINT32>(record.size()));
+  }
+
+  SpoolCheckpoint(&spool);
+
+  for (int64_t count = 0; count < state.range(0); count++) {
+    const std::vector<uint8_t> &record = records[index++ % RECORD_COUNT];
+    SpoolAppend(&spool, (PVOID)record.data(),
+                static_cast<UINT32>(record.size()));
+  }
+
+  /* SpoolOpen writes a checkpoint, the crashed header is put back each time */
+  memcpy(header.data(), memory.data(), header.size());
+
+  for (auto _ : state) {
+    memcpy(memory.data(), header.data(), header.size());
+    if (!NT_SUCCESS(SpoolOpen(&spool, memory.data(), memory.size())) ||
+        spool.recovered != state.range(0)) {
+      state.SkipWithError("spool did not recover");
+      return;
+    }
+    benchmark::DoNotOptimize(spool);
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(recover_spool)->Arg(0)->Arg(16)->Arg(SPOOL_CHECKPOINT_INTERVAL - 1);
@@ -0,0 +1,146 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/stackcache.h"
+
+/*
+ * One stackwalk round over a synthetic system: MODULE_COUNT loaded modules and
+ * THREAD_COUNT system threads, each with a STACK_DEPTH frame stack of return
+ * addresses inside them.
+ *
+ * resolve_every_stack is what every round cost before the cache, every frame
+ * of every thread is resolved against the module list. cached_stack_round/N
+ * has N percent of the threads move to a new stack before every round, the
+ * rest are parked in the same wait as last time.
+ */
+
+namespace {
+
+constexpr uint32_t MODULE_COUNT = 200;
+constexpr uint32_t THREAD_COUNT = 1500;
+constexpr uint32_t STACK_DEPTH = 16;
+
+constexpr uint64_t MODULE_BASE = 0xfffff80000000000ull;
+constexpr uint32_t MODULE_SIZE = 0x100000;
+
+struct synthetic_system {
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules;
+  std::vector<UINT64> stacks;
+  std::vector<STACK_CACHE_ENTRY> entries;
+  SYSTEM_MODULES system_modules = {};
+  STACK_CACHE cache = {};
+  bench::xorshift random;
+
+  synthetic_system()
+      : modules(MODULE_COUNT), stacks(THREAD_COUNT * STACK_DEPTH),
+        entries(STACK_CACHE_DEFAULT_CAPACITY) {
+    for (uint32_t index = 0; index < MODULE_COUNT; index++) {
+      this->modules[index].ImageBase = reinterpret_cast<PVOID>(
+          MODULE_BASE + static_cast<uint64_t>(index) * 2 * MODULE_SIZE);
+      this->modules[index].ImageSize = MODULE_SIZE;
+    }
+
+    this->system_modules.address = this->modules.data();
+    this->system_modules.module_count = MODULE_COUNT;
+
+    for (uint32_t thread = 0; thread < THREAD_COUNT; thread++)
+      this->move_thread(thread);
+  }
+
+  void move_thread(uint32_t thread) {
+    UINT64 *stack = this->stack(thread);
+
+    for (uint32_t frame = 0; frame < STACK_DEPTH; frame++)
+      stack[frame] = MODULE_BASE +
+                     this->random.next() % MODULE_COUNT * 2 * MODULE_SIZE +
+                     this->random.next() % MODULE_SIZE;
+  }
+
+  UINT64 *stack(uint32_t thread) {
+    return this->stacks.data() + static_cast<size_t>(thread) * STACK_DEPTH;
+  }
+
+  static UINT64 thread_address(uint32_t thread) {
+    return 0xffffa00000000000ull + static_cast<uint64_t>(thread) * 0x800;
+  }
+
+  bool resolve(UINT64 *stack) {
+    bool valid = true;
+
+    for (uint32_t frame = 0; frame < STACK_DEPTH; frame++) {
+      BOOLEAN flag = FALSE;
+      IsInstructionPointerInInvalidRegion(stack[frame], &this->system_modules,
+                                          &flag);
+      valid &= flag != FALSE;
+    }
+
+    return valid;
+  }
+};
+
+synthetic_system &get_system() {
+  static synthetic_system system;
+  return system;
+}
+
+} // namespace
+
+static void resolve_every_stack(benchmark::State &state) {
+  synthetic_system &system = get_system();
+  uint64_t valid = 0;
+
+  for (auto _ : state)
+    for (uint32_t thread = 0; thread < THREAD_COUNT; thread++)
+      valid += system.resolve(system.stack(thread));
+
+  state.SetItemsProcessed(state.iterations() * THREAD_COUNT);
+  state.counters["frames"] = static_cast<double>(THREAD_COUNT * STACK_DEPTH);
+  state.counters["valid"] = benchmark::Counter(
+      static_cast<double>(valid), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(resolve_every_stack)->Unit(benchmark::kMicrosecond);
+
+static void cached_stack_round(benchmark::State &state) {
+  synthetic_system &system = get_system();
+  uint32_t moved = static_cast<uint32_t>(THREAD_COUNT * state.range(0) / 100);
+  UINT64 fingerprint = StackCacheModuleFingerprint(&system.system_modules);
+
+  StackCacheInitialise(&system.cache, system.entries.data(),
+                       STACK_CACHE_DEFAULT_CAPACITY);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (uint32_t index = 0; index < moved; index++)
+      system.move_thread(system.random.next() % THREAD_COUNT);
+    state.ResumeTiming();
+
+    StackCacheBeginRound(&system.cache, fingerprint);
+
+    for (uint32_t thread = 0; thread < THREAD_COUNT; thread++) {
+      UINT64 *stack = system.stack(thread);
+      UINT64 address = synthetic_system::thread_address(thread);
+      UINT64 hash = StackCacheHashFrames(stack, STACK_DEPTH);
+
+      if (StackCacheLookup(&system.cache, address, hash, STACK_DEPTH))
+        continue;
+
+      if (system.resolve(stack))
+        StackCacheInsert(&system.cache, address, hash, STACK_DEPTH);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * THREAD_COUNT);
+  state.counters["hit_rate"] =
+      static_cast<double>(system.cache.hits) / system.cache.lookups;
+  state.counters["frames_skipped"] =
+      static_cast<double>(system.cache.current.frames_skipped);
+  state.counters["entries"] = static_cast<double>(system.cache.count);
+}
+BENCHMARK(cached_stack_round)
+    ->Arg(0)
+    ->Arg(10)
+    ->Arg(50)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,164 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "datasets.h"
+
+#include "../core/threadstart.h"
+
+/*
+ * Audits the start addresses of THREAD_COUNT synthetic system threads against
+ * MODULE_COUNT loaded modules. One thread in UNBACKED_STRIDE starts in memory
+ * outside every module, a handful of start addresses shared between them the
+ * way a mapped driver starts its workers.
+ *
+ * audit_every_thread is a round without the audit: both start addresses of
+ * every thread resolved against the module list. audit_thread_starts/N has N
+ * threads exit and be replaced before each round, N = THREAD_COUNT is the
+ * cost of the round after the module list changes.
+ */
+
+namespace {
+
+constexpr uint32_t MODULE_COUNT = 200;
+constexpr uint32_t THREAD_COUNT = 3000;
+constexpr uint32_t UNBACKED_STRIDE = 500;
+constexpr uint32_t UNBACKED_STARTS = 4;
+
+constexpr uint64_t MODULE_BASE = 0xfffff80000000000ull;
+constexpr uint32_t MODULE_SIZE = 0x100000;
+constexpr uint64_t POOL_BASE = 0xffffb00000000000ull;
+
+struct synthetic_thread {
+  UINT64 thread;
+  UINT64 start_address;
+  UINT64 win32_start_address;
+  UINT32 generation;
+};
+
+struct synthetic_system {
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules;
+  std::vector<MODULE_RANGE> ranges;
+  std::vector<synthetic_thread> threads;
+  SYSTEM_MODULES system_modules = {};
+  THREAD_START_AUDIT audit = {};
+  bench::xorshift random;
+
+  synthetic_system()
+      : modules(MODULE_COUNT), ranges(MODULE_COUNT), threads(THREAD_COUNT) {
+    /* shuffled, the module list isn't sorted by base */
+    for (uint32_t index = 0; index < MODULE_COUNT; index++) {
+      uint32_t slot = (index * 37) % MODULE_COUNT;
+      this->modules[index].ImageBase = reinterpret_cast<PVOID>(
+          MODULE_BASE + static_cast<uint64_t>(slot) * 2 * MODULE_SIZE);
+      this->modules[index].ImageSize = MODULE_SIZE;
+    }
+
+    this->system_modules.address = this->modules.data();
+    this->system_modules.module_count = MODULE_COUNT;
+
+    for (uint32_t index = 0; index < THREAD_COUNT; index++)
+      this->replace_thread(index);
+  }
+
+  UINT64 module_address() {
+    return MODULE_BASE + this->random.next() % MODULE_COUNT * 2 * MODULE_SIZE +
+           this->random.next() % MODULE_SIZE;
+  }
+
+  void replace_thread(uint32_t index) {
+    synthetic_thread &thread = this->threads[index];
+
+    thread.thread =
+        0xffffa00000000000ull + this->random.next() % 0x1000000 * 0x800;
+    thread.start_address = this->module_address();
+    thread.win32_start_address = this->module_address();
+    thread.generation = 0;
+
+    if (this->random.next() % UNBACKED_STRIDE == 0)
+      thread.win32_start_address =
+          POOL_BASE + this->random.next() % UNBACKED_STARTS * 0x1000;
+  }
+
+  bool is_backed(UINT64 address) {
+    BOOLEAN flag = FALSE;
+    IsInstructionPointerInInvalidRegion(address, &this->system_modules, &flag);
+    return flag != FALSE;
+  }
+};
+
+synthetic_system &get_system() {
+  static synthetic_system system;
+  return system;
+}
+
+void count_report(PUNBACKED_THREAD_START Start, PVOID Context) {
+  (*static_cast<uint64_t *>(Context))++;
+}
+
+} // namespace
+
+static void audit_every_thread(benchmark::State &state) {
+  synthetic_system &system = get_system();
+  uint64_t unbacked = 0;
+
+  for (auto _ : state)
+    for (synthetic_thread &thread : system.threads)
+      unbacked += !system.is_backed(thread.start_address) ||
+                  !system.is_backed(thread.win32_start_address);
+
+  state.SetItemsProcessed(state.iterations() * THREAD_COUNT);
+  state.counters["unbacked"] = benchmark::Counter(
+      static_cast<double>(unbacked), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(audit_every_thread)->Unit(benchmark::kMicrosecond);
+
+static void audit_thread_starts(benchmark::State &state) {
+  synthetic_system &system = get_system();
+  uint32_t replaced = static_cast<uint32_t>(state.range(0));
+  uint64_t reports = 0;
+  uint64_t audited = 0;
+
+  ThreadStartAuditInitialise(&system.audit);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    if (replaced == THREAD_COUNT)
+      system.audit.module_fingerprint = 0;
+    else
+      for (uint32_t index = 0; index < replaced; index++)
+        system.replace_thread(system.random.next() % THREAD_COUNT);
+    state.ResumeTiming();
+
+    UINT32 generation = ThreadStartAuditBeginRound(
+        &system.audit, system.ranges.data(), MODULE_COUNT,
+        &system.system_modules);
+
+    for (synthetic_thread &thread : system.threads) {
+      if (thread.generation == generation)
+        continue;
+
+      if (ThreadStartAuditRecord(&system.audit, thread.thread,
+                                 static_cast<UINT32>(thread.thread >> 11),
+                                 thread.start_address,
+                                 thread.win32_start_address) !=
+          THREAD_START_DEFERRED)
+        thread.generation = generation;
+    }
+
+    audited += system.audit.audited;
+    ThreadStartAuditEndRound(&system.audit, count_report, &reports);
+  }
+
+  state.SetItemsProcessed(state.iterations() * THREAD_COUNT);
+  state.counters["audited"] = benchmark::Counter(
+      static_cast<double>(audited), benchmark::Counter::kAvgIterations);
+  state.counters["reports"] = static_cast<double>(reports);
+  state.counters["suppressed"] =
+      static_cast<double>(system.audit.suppressed);
+}
+BENCHMARK(audit_thread_starts)
+    ->Arg(0)
+    ->Arg(16)
+    ->Arg(THREAD_COUNT)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,77 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../module/dispatcher/threadpool.h"
+#include "../module/dispatcher/topology.h"
+
+/*
+ * A game thread rendering frames of a fixed amount of work while the module's
+ * background pool runs scans flat out, one more scan than there are logical
+ * processors so something always has to give.
+ *
+ * game_frame/0 leaves the pool threads unplaced as they were before, /1 places
+ * them as the dispatcher does from this machine's sysfs topology. The time is
+ * the mean frame time, p99_us the 99th percentile. On a single core machine
+ * placement can only lower the pool's priority, with more cores it also keeps
+ * the scans off most of them.
+ */
+
+namespace {
+
+constexpr uint32_t FRAME_WORK = 200000;
+
+uint64_t do_work(uint64_t seed, uint32_t rounds) {
+  for (uint32_t round = 0; round < rounds; round++)
+    seed = (seed ^ (seed >> 29)) * 0xbf58476d1ce4e5b9ull + round;
+  return seed;
+}
+
+} // namespace
+
+static void game_frame(benchmark::State &state) {
+  CPU_TOPOLOGY topology = {};
+  CPU_PLACEMENT placement = {};
+  std::atomic<bool> stop(false);
+  std::vector<double> frames;
+  bool placed = state.range(0);
+  int workers = static_cast<int>(std::thread::hardware_concurrency()) + 1;
+
+  dispatcher::load_cpu_topology(topology);
+  CpuTopologyGetPlacement(&topology, CpuPlacementBackground, &placement);
+
+  dispatcher::thread_pool pool(workers, [&]() {
+    if (placed)
+      dispatcher::apply_cpu_placement(placement);
+  });
+
+  for (int index = 0; index < workers; index++) {
+    pool.queue_job([&, index]() {
+      uint64_t seed = index;
+      while (!stop.load(std::memory_order_relaxed))
+        seed = do_work(seed, 1000);
+      benchmark::DoNotOptimize(seed);
+    });
+  }
+
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    benchmark::DoNotOptimize(do_work(state.iterations(), FRAME_WORK));
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    state.SetIterationTime(elapsed.count());
+    frames.push_back(elapsed.count());
+  }
+
+  stop = true;
+  pool.terminate();
+
+  std::sort(frames.begin(), frames.end());
+  state.counters["p99_us"] = frames[frames.size() * 99 / 100] * 1e6;
+  state.counters["cores"] = topology.core_count;
+}
+BENCHMARK(game_frame)->Arg(0)->Arg(1)->UseManualTime()->MinTime(1.0);
@@ -0,0 +1,83 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <vector>
+
+#include "../core/trace.h"
+
+static constexpr uint32_t TRACE_CPU_COUNT = 64;
+static constexpr uint64_t FRAME_RIP = 0xfffff80412345678ull;
+static constexpr uint64_t FRAME_RSP = 0xfffff80087654321ull;
+
+static PTRACE_BUFFER get_trace_buffer() {
+  static std::vector<uint8_t> storage(
+      TraceGetBufferSize(TRACE_CPU_COUNT, TRACE_DEFAULT_CAPACITY));
+  static bool initialised = NT_SUCCESS(
+      TraceInitialise(storage.data(), storage.size(), TRACE_CPU_COUNT,
+                      TRACE_DEFAULT_CAPACITY, 1000000000ull,
+                      TRACE_SOURCE_DRIVER));
+  benchmark::DoNotOptimize(initialised);
+  return reinterpret_cast<PTRACE_BUFFER>(storage.data());
+}
+
+/*
+ * What the NMI callback now does, one event into this cpu's ring. Threads
+ * write to their own ring like cpus do in the driver.
+ */
+static void trace_write(benchmark::State &state) {
+  PTRACE_BUFFER buffer = get_trace_buffer();
+  UINT32 core = static_cast<UINT32>(state.thread_index());
+  uint64_t timestamp = 0;
+
+  for (auto _ : state)
+    TraceWrite(buffer, core, timestamp++, TRACE_NMI_CALLBACK, FRAME_RIP,
+               FRAME_RSP, 0, 0);
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(trace_write)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ * What DEBUG_VERBOSE did before, minus the trip to the debugger. DbgPrintEx
+ * formats the same way before deciding whether to emit the line, so this is a
+ * lower bound on the old cost.
+ */
+static void format_verbose(benchmark::State &state) {
+  char message[512];
+  uint32_t core = static_cast<uint32_t>(state.thread_index());
+
+  for (auto _ : state) {
+    snprintf(message, sizeof(message),
+             "donna-ac : [VERBOSE] : [NMI CALLBACK]: Core Number: %x, "
+             "Interrupted RIP: %llx, Interrupted RSP: %llx\n",
+             core, (unsigned long long)FRAME_RIP,
+             (unsigned long long)FRAME_RSP);
+    benchmark::DoNotOptimize(message);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(format_verbose)->ThreadRange(1, 8)->UseRealTime();
+
+/* the cost per event of the module draining full rings */
+static void trace_drain(benchmark::State &state) {
+  PTRACE_BUFFER buffer = get_trace_buffer();
+  std::vector<uint8_t> output(sizeof(TRACE_DRAIN_HEADER) +
+                              TRACE_CPU_COUNT * TRACE_DEFAULT_CAPACITY *
+                                  sizeof(TRACE_EVENT));
+  uint64_t events = 0;
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (UINT32 core = 0; core < TRACE_CPU_COUNT; core++)
+      for (UINT32 index = 0; index < TRACE_DEFAULT_CAPACITY; index++)
+        TraceWrite(buffer, core, index, TRACE_DPC_STACKWALK, index, 0, 0, 0);
+    state.ResumeTiming();
+
+    TraceDrain(buffer, output.data(), output.size());
+    events += reinterpret_cast<PTRACE_DRAIN_HEADER>(output.data())->event_count;
+  }
+
+  state.SetItemsProcessed(events);
+}
+BENCHMARK(trace_drain)->Unit(benchmark::kMicrosecond);
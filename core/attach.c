@@ -0,0 +1,212 @@
+#include "attach.h"
+
+VOID
+AttachTrackerInitialise(_Out_ PATTACH_TRACKER              Tracker,
+                        _In_ const ATTACH_ALLOWLIST_ENTRY* Allowlist,
+                        _In_ UINT32                        AllowlistCount,
+                        _In_ ATTACH_REPORT_CALLBACK        Callback,
+                        _Inout_opt_ PVOID                  Context)
+{
+    RtlZeroMemory(Tracker, sizeof(ATTACH_TRACKER));
+
+    Tracker->allowlist        = Allowlist;
+    Tracker->allowlist_count  = AllowlistCount;
+    Tracker->callback         = Callback;
+    Tracker->callback_context = Context;
+}
+
+STATIC
+CHAR
+LowerCase(_In_ CHAR Character)
+{
+    if (Character >= 'A' && Character <= 'Z')
+        return Character + ('a' - 'A');
+
+    return Character;
+}
+
+/* image names are at most 15 characters, EPROCESS->ImageFileName truncates */
+STATIC
+BOOLEAN
+IsImageNameEqual(_In_ LPCSTR First, _In_ LPCSTR Second)
+{
+    for (UINT32 index = 0; index < ATTACH_IMAGE_NAME_LENGTH - 1; index++) {
+        if (LowerCase(First[index]) != LowerCase(Second[index]))
+            return FALSE;
+
+        if (!First[index])
+            return TRUE;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+AttachIsAllowed(_In_ PATTACH_TRACKER Tracker, _In_ PATTACH_SAMPLE Sample)
+{
+    UINT8 level = Sample->signature_level & ATTACH_SIGNING_LEVEL_MASK;
+
+    for (UINT32 index = 0; index < Tracker->allowlist_count; index++) {
+        if (!IsImageNameEqual(Tracker->allowlist[index].image_name,
+                              Sample->image_name))
+            continue;
+
+        if (level >= Tracker->allowlist[index].minimum_signature_level)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+VOID
+AttachTrackerBeginRound(_Inout_ PATTACH_TRACKER Tracker,
+                        _In_ UINT64             Timestamp)
+{
+    Tracker->round++;
+    Tracker->timestamp = Timestamp;
+
+    for (UINT32 index = 0; index < Tracker->count; index++)
+        Tracker->attachers[index].round_threads = 0;
+}
+
+STATIC
+VOID
+ReportAttacher(_Inout_ PATTACH_TRACKER Tracker, _Inout_ PATTACHER Attacher)
+{
+    Attacher->reported = TRUE;
+    Tracker->reports++;
+
+    if (Tracker->callback)
+        Tracker->callback(Attacher, Tracker->callback_context);
+}
+
+STATIC
+VOID
+InitialiseAttacher(_In_ PATTACH_TRACKER Tracker,
+                   _Out_ PATTACHER      Attacher,
+                   _In_ PATTACH_SAMPLE  Sample)
+{
+    RtlZeroMemory(Attacher, sizeof(ATTACHER));
+
+    Attacher->process         = Sample->process;
+    Attacher->process_id      = Sample->process_id;
+    Attacher->signature_level = Sample->signature_level;
+    Attacher->thread          = Sample->thread;
+    Attacher->thread_id       = Sample->thread_id;
+    Attacher->first_seen      = Tracker->timestamp;
+    Attacher->last_seen       = Tracker->timestamp;
+
+    RtlCopyMemory(
+        Attacher->image_name, Sample->image_name, ATTACH_IMAGE_NAME_LENGTH);
+    Attacher->image_name[ATTACH_IMAGE_NAME_LENGTH - 1] = '\0';
+}
+
+STATIC
+PATTACHER
+FindAttacher(_In_ PATTACH_TRACKER Tracker, _In_ PATTACH_SAMPLE Sample)
+{
+    PATTACHER attacher = NULL;
+
+    for (UINT32 index = 0; index < Tracker->count; index++) {
+        attacher = &Tracker->attachers[index];
+
+        if (attacher->process == Sample->process &&
+            attacher->process_id == Sample->process_id &&
+            IsImageNameEqual(attacher->image_name, Sample->image_name))
+            return attacher;
+    }
+
+    return NULL;
+}
+
+/*
+ * Records a thread found attached during the current round. Once every slot is
+ * taken new attachers can't be tracked, rather then dropping them they are
+ * reported straight away as a single round attach. This is no worse then
+ * reporting every thread, which is what we did before aggregating.
+ */
+UINT32
+AttachTrackerRecord(_Inout_ PATTACH_TRACKER Tracker,
+                    _In_ PATTACH_SAMPLE     Sample)
+{
+    ATTACHER  overflow = {0};
+    PATTACHER attacher = NULL;
+
+    Tracker->samples++;
+
+    if (AttachIsAllowed(Tracker, Sample)) {
+        Tracker->allowed++;
+        return ATTACH_RECORD_ALLOWED;
+    }
+
+    attacher = FindAttacher(Tracker, Sample);
+
+    if (!attacher && Tracker->count < ATTACH_MAX_ATTACHERS) {
+        attacher = &Tracker->attachers[Tracker->count++];
+        InitialiseAttacher(Tracker, attacher, Sample);
+    }
+
+    if (!attacher) {
+        Tracker->overflowed++;
+        InitialiseAttacher(Tracker, &overflow, Sample);
+        overflow.rounds      = 1;
+        overflow.max_threads = 1;
+        overflow.samples     = 1;
+        ReportAttacher(Tracker, &overflow);
+        return ATTACH_RECORD_OVERFLOW;
+    }
+
+    attacher->round_threads++;
+    attacher->samples++;
+    return ATTACH_RECORD_TRACKED;
+}
+
+/*
+ * Attachers seen this round extend their dwell, those that weren't have
+ * detached and their episode is over. Ended attachers are removed by moving
+ * the last one into their slot.
+ */
+VOID
+AttachTrackerEndRound(_Inout_ PATTACH_TRACKER Tracker)
+{
+    UINT32    index    = 0;
+    PATTACHER attacher = NULL;
+
+    while (index < Tracker->count) {
+        attacher = &Tracker->attachers[index];
+
+        if (attacher->round_threads) {
+            attacher->rounds++;
+            attacher->last_seen = Tracker->timestamp;
+
+            if (attacher->round_threads > attacher->max_threads)
+                attacher->max_threads = attacher->round_threads;
+
+            if (!attacher->reported &&
+                attacher->rounds >= ATTACH_REPORT_DWELL_ROUNDS)
+                ReportAttacher(Tracker, attacher);
+
+            index++;
+            continue;
+        }
+
+        attacher->ended = TRUE;
+
+        if (!attacher->reported)
+            ReportAttacher(Tracker, attacher);
+
+        *attacher = Tracker->attachers[--Tracker->count];
+    }
+}
+
+/* reports every attacher not yet reported and forgets all of them */
+VOID
+AttachTrackerFlush(_Inout_ PATTACH_TRACKER Tracker)
+{
+    for (UINT32 index = 0; index < Tracker->count; index++) {
+        if (!Tracker->attachers[index].reported)
+            ReportAttacher(Tracker, &Tracker->attachers[index]);
+    }
+
+    Tracker->count = 0;
+}
@@ -0,0 +1,139 @@
+#ifndef ATTACH_H
+#define ATTACH_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Aggregates threads found attached (KeAttachProcess / KeStackAttachProcess)
+ * to the protected process by the process that owns them.
+ *
+ * The attached thread scan is a sampling round, each thread found attached is
+ * recorded against its owning process and at the end of the round every
+ * attacher's dwell is updated. An attacher is reported once per attach
+ * episode, either once it has been seen attached for
+ * ATTACH_REPORT_DWELL_ROUNDS rounds in a row or when the episode ends, which
+ * ever comes first. Attachers are identified by process and image, so a
+ * process id being reused by a different image starts a new episode.
+ *
+ * Legitimate attachers (the system process, csrss, anti malware etc.) are
+ * filtered by an allowlist. Image names are trivially spoofed, so each entry
+ * also requires a minimum signature level, which the kernel assigns when the
+ * process is created from the signing of its image.
+ */
+#define ATTACH_MAX_ATTACHERS       64
+#define ATTACH_IMAGE_NAME_LENGTH   16
+#define ATTACH_REPORT_DWELL_ROUNDS 3
+
+/* SE_SIGNING_LEVEL_*, the upper bits of EPROCESS->SignatureLevel are flags */
+#define ATTACH_SIGNING_LEVEL_MASK         0x0f
+#define ATTACH_SIGNING_LEVEL_UNSIGNED     0x01
+#define ATTACH_SIGNING_LEVEL_AUTHENTICODE 0x04
+#define ATTACH_SIGNING_LEVEL_ANTIMALWARE  0x07
+#define ATTACH_SIGNING_LEVEL_MICROSOFT    0x08
+#define ATTACH_SIGNING_LEVEL_WINDOWS      0x0c
+#define ATTACH_SIGNING_LEVEL_WINDOWS_TCB  0x0e
+
+#define ATTACH_RECORD_TRACKED  0
+#define ATTACH_RECORD_ALLOWED  1
+#define ATTACH_RECORD_OVERFLOW 2
+
+typedef struct _ATTACH_SAMPLE {
+    /* owning process of the attached thread */
+    UINT64 process;
+    UINT32 process_id;
+    UINT8  signature_level;
+    CHAR   image_name[ATTACH_IMAGE_NAME_LENGTH];
+
+    UINT64 thread;
+    UINT32 thread_id;
+
+} ATTACH_SAMPLE, *PATTACH_SAMPLE;
+
+typedef struct _ATTACHER {
+    UINT64 process;
+    UINT32 process_id;
+    UINT8  signature_level;
+    CHAR   image_name[ATTACH_IMAGE_NAME_LENGTH];
+
+    /* first thread seen attached */
+    UINT64 thread;
+    UINT32 thread_id;
+
+    /* timestamps passed to AttachTrackerBeginRound */
+    UINT64 first_seen;
+    UINT64 last_seen;
+
+    /* consecutive rounds seen attached, and the most threads in one round */
+    UINT32 rounds;
+    UINT32 max_threads;
+    UINT32 round_threads;
+    UINT32 samples;
+
+    BOOLEAN reported;
+    BOOLEAN ended;
+
+} ATTACHER, *PATTACHER;
+
+typedef struct _ATTACH_ALLOWLIST_ENTRY {
+    LPCSTR image_name;
+    UINT8  minimum_signature_level;
+
+} ATTACH_ALLOWLIST_ENTRY, *PATTACH_ALLOWLIST_ENTRY;
+
+/* invoked once per attach episode with the attacher's summary */
+typedef VOID (*ATTACH_REPORT_CALLBACK)(_In_ PATTACHER Attacher,
+                                       _Inout_opt_ PVOID Context);
+
+typedef struct _ATTACH_TRACKER {
+    const ATTACH_ALLOWLIST_ENTRY* allowlist;
+    UINT32                        allowlist_count;
+    ATTACH_REPORT_CALLBACK        callback;
+    PVOID                         callback_context;
+
+    UINT32 round;
+    UINT64 timestamp;
+
+    UINT32   count;
+    ATTACHER attachers[ATTACH_MAX_ATTACHERS];
+
+    /* lifetime statistics */
+    UINT64 samples;
+    UINT64 allowed;
+    UINT64 overflowed;
+    UINT64 reports;
+
+} ATTACH_TRACKER, *PATTACH_TRACKER;
+
+VOID
+AttachTrackerInitialise(_Out_ PATTACH_TRACKER              Tracker,
+                        _In_ const ATTACH_ALLOWLIST_ENTRY* Allowlist,
+                        _In_ UINT32                        AllowlistCount,
+                        _In_ ATTACH_REPORT_CALLBACK        Callback,
+                        _Inout_opt_ PVOID                  Context);
+
+BOOLEAN
+AttachIsAllowed(_In_ PATTACH_TRACKER Tracker, _In_ PATTACH_SAMPLE Sample);
+
+VOID
+AttachTrackerBeginRound(_Inout_ PATTACH_TRACKER Tracker,
+                        _In_ UINT64             Timestamp);
+
+UINT32
+AttachTrackerRecord(_Inout_ PATTACH_TRACKER Tracker,
+                    _In_ PATTACH_SAMPLE     Sample);
+
+VOID
+AttachTrackerEndRound(_Inout_ PATTACH_TRACKER Tracker);
+
+VOID
+AttachTrackerFlush(_Inout_ PATTACH_TRACKER Tracker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
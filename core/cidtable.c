@@ -0,0 +1,247 @@
+#include "cidtable.h"
+
+UINT32
+CidTableGetMaximumEntryCount(_In_ UINT32 NextHandleNeedingPool)
+{
+    return NextHandleNeedingPool / CID_TABLE_HANDLE_INCREMENT;
+}
+
+/*
+ * Free entries have no object bits, their free list link lives in the high
+ * value. The object pointer is stored shifted with the low 4 bits and the
+ * sign extension dropped, objects being 16 byte aligned kernel addresses.
+ */
+UINT64
+CidTableDecodeObject(_In_ PCID_TABLE_ENTRY Entry)
+{
+    UINT64 bits = (Entry->low_value >> CID_TABLE_OBJECT_SHIFT) &
+                  CID_TABLE_OBJECT_MASK;
+
+    if (!bits)
+        return 0;
+
+    return (bits << 4) | CID_TABLE_OBJECT_HIGH;
+}
+
+STATIC
+VOID
+SiftDown(_Inout_ PUINT64 Objects, _In_ UINT32 Root, _In_ UINT32 Count)
+{
+    UINT32 child = 0;
+    UINT64 value = 0;
+
+    while ((child = Root * 2 + 1) < Count) {
+        if (child + 1 < Count && Objects[child + 1] > Objects[child])
+            child++;
+
+        if (Objects[Root] >= Objects[child])
+            return;
+
+        value          = Objects[Root];
+        Objects[Root]  = Objects[child];
+        Objects[child] = value;
+        Root           = child;
+    }
+}
+
+/*
+ * Heap sort, it sorts in place without recursion which keeps it off the
+ * kernel stack and doesnt need any scratch allocation.
+ */
+VOID
+CidTableSortObjects(_Inout_ PUINT64 Objects, _In_ UINT32 Count)
+{
+    UINT64 value = 0;
+
+    if (Count < 2)
+        return;
+
+    for (UINT32 index = Count / 2; index > 0; index--)
+        SiftDown(Objects, index - 1, Count);
+
+    for (UINT32 end = Count - 1; end > 0; end--) {
+        value        = Objects[0];
+        Objects[0]   = Objects[end];
+        Objects[end] = value;
+        SiftDown(Objects, 0, end);
+    }
+}
+
+STATIC
+VOID
+CollectLeafPage(_Inout_ PCID_TABLE_WALK Walk,
+                _In_ UINT64             Address,
+                _In_ UINT32             FirstIndex,
+                _In_ UINT32             Limit)
+{
+    UINT64           object = 0;
+    PCID_TABLE_ENTRY page   = Walk->translate(Address, Walk->memory_context);
+
+    if (!page) {
+        Walk->pages_skipped++;
+        return;
+    }
+
+    Walk->pages_visited++;
+
+    /*
+     * The first entry of every leaf page is reserved by the handle table
+     * code and never refers to an object, handle 0 being invalid is the
+     * visible part of this.
+     */
+    for (UINT32 index = 1; index < CID_TABLE_LEAF_ENTRY_COUNT; index++) {
+        if (FirstIndex + index >= Limit)
+            return;
+
+        object = CidTableDecodeObject(&page[index]);
+
+        if (!object)
+            continue;
+
+        if (Walk->object_count >= Walk->object_capacity) {
+            Walk->dropped++;
+            continue;
+        }
+
+        Walk->objects[Walk->object_count++] = object;
+    }
+}
+
+STATIC
+VOID
+WalkCidTableLevel(_Inout_ PCID_TABLE_WALK Walk,
+                  _In_ UINT64             Address,
+                  _In_ UINT32             Level,
+                  _In_ UINT32             FirstIndex,
+                  _In_ UINT32             Limit)
+{
+    UINT32  span  = CID_TABLE_LEAF_ENTRY_COUNT;
+    PUINT64 table = NULL;
+
+    if (Level == 0) {
+        CollectLeafPage(Walk, Address, FirstIndex, Limit);
+        return;
+    }
+
+    table = Walk->translate(Address, Walk->memory_context);
+
+    if (!table) {
+        Walk->pages_skipped++;
+        return;
+    }
+
+    Walk->pages_visited++;
+
+    /* number of entries covered by each pointer in this table */
+    if (Level == 2)
+        span *= CID_TABLE_INDEX_ENTRY_COUNT;
+
+    for (UINT32 index = 0; index < CID_TABLE_INDEX_ENTRY_COUNT; index++) {
+        if (FirstIndex + index * span >= Limit)
+            return;
+
+        if (!table[index]) {
+            Walk->pages_skipped++;
+            continue;
+        }
+
+        WalkCidTableLevel(
+            Walk, table[index], Level - 1, FirstIndex + index * span, Limit);
+    }
+}
+
+/*
+ * Collects every object referenced by the table in a single pass and sorts
+ * them, so that membership checks are a binary search and diffing a list of
+ * objects against the table is a single merge. Compared to a
+ * PsLookupThreadByThreadId per thread this takes no references and no
+ * handle table locks, the price being the table can change underneath us
+ * which is fine for a detection that is run repeatedly.
+ */
+NTSTATUS
+WalkCidTable(_Inout_ PCID_TABLE_WALK Walk)
+{
+    UINT32 level = 0;
+    UINT32 limit = 0;
+
+    if (!Walk || !Walk->translate || !Walk->objects)
+        return STATUS_INVALID_PARAMETER;
+
+    Walk->object_count  = 0;
+    Walk->dropped       = 0;
+    Walk->pages_visited = 0;
+    Walk->pages_skipped = 0;
+
+    level = (UINT32)(Walk->table_code & CID_TABLE_LEVEL_MASK);
+    limit = CidTableGetMaximumEntryCount(Walk->next_handle_needing_pool);
+
+    if (level > 2)
+        return STATUS_INVALID_PARAMETER;
+
+    WalkCidTableLevel(
+        Walk, Walk->table_code & ~CID_TABLE_LEVEL_MASK, level, 0, limit);
+
+    /* the top level page itself couldn't be read */
+    if (Walk->pages_visited == 0)
+        return STATUS_INVALID_ADDRESS;
+
+    CidTableSortObjects(Walk->objects, Walk->object_count);
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+CidTableContainsObject(_In_ PCID_TABLE_WALK Walk, _In_ UINT64 Object)
+{
+    UINT32 low  = 0;
+    UINT32 high = Walk->object_count;
+    UINT32 mid  = 0;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (Walk->objects[mid] == Object)
+            return TRUE;
+
+        if (Walk->objects[mid] < Object)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Sorts Objects and walks it alongside the table's sorted object set, calling
+ * Callback for every object the table doesnt reference. Returns the number of
+ * missing objects.
+ */
+UINT32
+CidTableFindMissingObjects(_In_ PCID_TABLE_WALK            Walk,
+                           _Inout_ PUINT64                 Objects,
+                           _In_ UINT32                     Count,
+                           _In_ CID_TABLE_MISSING_CALLBACK Callback,
+                           _Inout_opt_ PVOID               Context)
+{
+    UINT32 table   = 0;
+    UINT32 missing = 0;
+
+    CidTableSortObjects(Objects, Count);
+
+    for (UINT32 index = 0; index < Count; index++) {
+        while (table < Walk->object_count &&
+               Walk->objects[table] < Objects[index])
+            table++;
+
+        if (table < Walk->object_count &&
+            Walk->objects[table] == Objects[index])
+            continue;
+
+        missing++;
+
+        if (Callback)
+            Callback(Objects[index], Context);
+    }
+
+    return missing;
+}
@@ -0,0 +1,97 @@
+#ifndef CIDTABLE_H
+#define CIDTABLE_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The PspCidTable is an ordinary executive handle table whose entries point at
+ * process and thread objects rather then object headers. The low 2 bits of
+ * TableCode give the number of index levels above the leaf pages, each level
+ * is a single page:
+ *
+ *   0: TableCode points at a leaf page of 256 entries
+ *   1: TableCode points at 512 pointers to leaf pages
+ *   2: TableCode points at 512 pointers to pages of 512 leaf page pointers
+ *
+ * Handle values are multiples of 4, so a handle indexes entry handle / 4 and
+ * NextHandleNeedingPool is one past the last handle that is backed by a page.
+ */
+#define CID_TABLE_LEVEL_MASK        3ull
+#define CID_TABLE_LEAF_ENTRY_COUNT  256
+#define CID_TABLE_INDEX_ENTRY_COUNT 512
+#define CID_TABLE_HANDLE_INCREMENT  4
+
+#define CID_TABLE_OBJECT_SHIFT 20
+#define CID_TABLE_OBJECT_MASK  0x00000fffffffffffull
+#define CID_TABLE_OBJECT_HIGH  0xffff000000000000ull
+
+typedef struct _CID_TABLE_ENTRY {
+    /* unlocked bit, ref count, attributes and object pointer bits */
+    UINT64 low_value;
+
+    /* granted access for in use entries, next free entry otherwise */
+    UINT64 high_value;
+
+} CID_TABLE_ENTRY, *PCID_TABLE_ENTRY;
+
+/*
+ * Returns an address the table page at the given kernel address can be read
+ * from, or NULL if it isnt resident. In the kernel this is the address itself
+ * once MmIsAddressValid has accepted it.
+ */
+typedef PVOID (*CID_TABLE_TRANSLATE)(_In_ UINT64 Address,
+                                     _Inout_opt_ PVOID Context);
+
+/* invoked once for every object that is not present in the table */
+typedef VOID (*CID_TABLE_MISSING_CALLBACK)(_In_ UINT64 Object,
+                                           _Inout_opt_ PVOID Context);
+
+typedef struct _CID_TABLE_WALK {
+    UINT64              table_code;
+    UINT32              next_handle_needing_pool;
+    CID_TABLE_TRANSLATE translate;
+    PVOID               memory_context;
+
+    /* capacity of objects, in entries */
+    UINT32  object_capacity;
+    PUINT64 objects;
+
+    /* filled in by the walk, objects is sorted once it returns */
+    UINT32 object_count;
+    UINT32 dropped;
+    UINT64 pages_visited;
+    UINT64 pages_skipped;
+
+} CID_TABLE_WALK, *PCID_TABLE_WALK;
+
+UINT32
+CidTableGetMaximumEntryCount(_In_ UINT32 NextHandleNeedingPool);
+
+UINT64
+CidTableDecodeObject(_In_ PCID_TABLE_ENTRY Entry);
+
+VOID
+CidTableSortObjects(_Inout_ PUINT64 Objects, _In_ UINT32 Count);
+
+NTSTATUS
+WalkCidTable(_Inout_ PCID_TABLE_WALK Walk);
+
+BOOLEAN
+CidTableContainsObject(_In_ PCID_TABLE_WALK Walk, _In_ UINT64 Object);
+
+UINT32
+CidTableFindMissingObjects(_In_ PCID_TABLE_WALK            Walk,
+                           _Inout_ PUINT64                 Objects,
+                           _In_ UINT32                     Count,
+                           _In_ CID_TABLE_MISSING_CALLBACK Callback,
+                           _Inout_opt_ PVOID               Context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,15 +1,22 @@
-#include "crypt.h"
+#include "cipher.h"
 
-#include <immintrin.h>
-#include "imports.h"
-
-#include <bcrypt.h>
+/*
+ * The kernel build always has AVX2 available, on the host we only take the
+ * vector path if the compiler was told it can. Both paths produce identical
+ * output, the scalar path simply applies the 4 key lanes one entry at a time.
+ */
+#if defined(PLATFORM_KERNEL) || defined(__AVX2__)
+#    define CIPHER_USE_AVX2 1
+#    include <immintrin.h>
+#endif
 
 #define XOR_KEY_1 0x1122334455667788
 #define XOR_KEY_2 0x0011223344556677
 #define XOR_KEY_3 0x5566778899AABBCC
 #define XOR_KEY_4 0x66778899AABBCCDD
 
+#ifdef CIPHER_USE_AVX2
+
 STATIC
 __m256i
 CryptGenerateSseXorKey()
@@ -58,6 +65,27 @@ CryptDecryptImportBlock(_In_ PUINT64 Array, _In_ UINT32 BlockIndex)
     return _mm256_xor_si256(load_block, CryptGenerateSseXorKey());
 }
 
+#else
+
+/*
+ * _mm256_set_epi64x takes its arguments from the highest lane down, so the
+ * first entry of each block is xored with XOR_KEY_4.
+ */
+STATIC const UINT64 IMPORT_CIPHER_KEY[IMPORT_CIPHER_BLOCK_SIZE] = {
+    XOR_KEY_4, XOR_KEY_3, XOR_KEY_2, XOR_KEY_1};
+
+VOID
+CryptEncryptImportsArray(_In_ PUINT64 Array, _In_ UINT32 Entries)
+{
+    UINT32 block_count = Entries / IMPORT_CIPHER_BLOCK_SIZE;
+
+    for (UINT32 index = 0; index < block_count * IMPORT_CIPHER_BLOCK_SIZE;
+         index++)
+        Array[index] ^= IMPORT_CIPHER_KEY[index % IMPORT_CIPHER_BLOCK_SIZE];
+}
+
+#endif
+
 STATIC
 INLINE
 VOID
@@ -66,28 +94,8 @@ CryptFindContainingBlockForArrayIndex(_In_ UINT32   EntryIndex,
                                       _Out_ PUINT32 ContainingBlockIndex,
                                       _Out_ PUINT32 BlockSubIndex)
 {
-    UINT32 containing_block = EntryIndex;
-    UINT32 block_index      = 0;
-
-    if (EntryIndex < BlockSize) {
-        *ContainingBlockIndex = 0;
-        *BlockSubIndex        = EntryIndex;
-        return;
-    }
-
-    if (EntryIndex == BlockSize) {
-        *ContainingBlockIndex = 1;
-        *BlockSubIndex        = 0;
-        return;
-    }
-
-    while (containing_block % BlockSize != 0) {
-        containing_block--;
-        block_index++;
-    }
-
-    *ContainingBlockIndex = containing_block / BlockSize;
-    *BlockSubIndex        = block_index;
+    *ContainingBlockIndex = EntryIndex / BlockSize;
+    *BlockSubIndex        = EntryIndex % BlockSize;
 }
 
 UINT64
@@ -95,15 +103,20 @@ CryptDecryptImportsArrayEntry(_In_ PUINT64 Array,
                               _In_ UINT32  Entries,
                               _In_ UINT32  EntryIndex)
 {
-    __m256i original_block         = {0};
-    __m128i original_half          = {0};
-    UINT32  block_size             = sizeof(__m256i) / sizeof(UINT64);
-    UINT32  containing_block_index = 0;
-    UINT32  block_sub_index        = 0;
-    UINT64  pointer                = 0;
+    UINT32 containing_block_index = 0;
+    UINT32 block_sub_index        = 0;
+    UINT64 pointer                = 0;
+
+    UNREFERENCED_PARAMETER(Entries);
+
+    CryptFindContainingBlockForArrayIndex(EntryIndex,
+                                          IMPORT_CIPHER_BLOCK_SIZE,
+                                          &containing_block_index,
+                                          &block_sub_index);
 
-    CryptFindContainingBlockForArrayIndex(
-        EntryIndex, block_size, &containing_block_index, &block_sub_index);
+#ifdef CIPHER_USE_AVX2
+    __m256i original_block = {0};
+    __m128i original_half  = {0};
 
     original_block = CryptDecryptImportBlock(Array, containing_block_index);
 
@@ -123,6 +136,11 @@ CryptDecryptImportsArrayEntry(_In_ PUINT64 Array,
         else
             pointer = _mm_extract_epi64(original_half, 1);
     }
+#else
+    pointer = Array[containing_block_index * IMPORT_CIPHER_BLOCK_SIZE +
+                    block_sub_index] ^
+              IMPORT_CIPHER_KEY[block_sub_index];
+#endif
 
     return pointer;
 }
@@ -0,0 +1,33 @@
+#ifndef CIPHER_H
+#define CIPHER_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Number of UINT64 entries xored together as a single block. Entries past the
+ * last full block are left untouched by CryptEncryptImportsArray.
+ */
+#define IMPORT_CIPHER_BLOCK_SIZE 4
+
+VOID
+CryptEncryptImportsArray(_In_ PUINT64 Array, _In_ UINT32 Entries);
+
+UINT64
+CryptDecryptImportsArrayEntry(_In_ PUINT64 Array,
+                              _In_ UINT32  Entries,
+                              _In_ UINT32  EntryIndex);
+
+VOID
+CryptDecryptBufferWithCookie(_In_ PVOID  Buffer,
+                             _In_ UINT32 BufferSize,
+                             _In_ UINT32 Cookie);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
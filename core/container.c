@@ -0,0 +1,147 @@
+#include "container.h"
+
+VOID
+QueueListInit(_Out_ PQUEUE_LIST Queue)
+{
+    Queue->start   = NULL;
+    Queue->end     = NULL;
+    Queue->entries = 0;
+}
+
+VOID
+QueueListInsertTail(_Inout_ PQUEUE_LIST Queue,
+                    _Inout_ PQUEUE_NODE Node,
+                    _In_ PVOID          Data)
+{
+    Node->data = Data;
+    Node->next = NULL;
+
+    if (Queue->end != NULL)
+        Queue->end->next = Node;
+
+    Queue->end = Node;
+
+    if (Queue->start == NULL)
+        Queue->start = Node;
+
+    Queue->entries += 1;
+}
+
+PQUEUE_NODE
+QueueListRemoveHead(_Inout_ PQUEUE_LIST Queue)
+{
+    PQUEUE_NODE node = Queue->start;
+
+    if (node == NULL)
+        return NULL;
+
+    Queue->start = node->next;
+
+    if (Queue->end == node)
+        Queue->end = NULL;
+
+    Queue->entries -= 1;
+    return node;
+}
+
+VOID
+SingleListInsertHead(_Inout_ PSINGLE_LIST_ENTRY Head,
+                     _Inout_ PSINGLE_LIST_ENTRY Entry)
+{
+    Entry->Next = Head->Next;
+    Head->Next  = Entry;
+}
+
+PSINGLE_LIST_ENTRY
+SingleListRemoveHead(_Inout_ PSINGLE_LIST_ENTRY Head)
+{
+    PSINGLE_LIST_ENTRY entry = Head->Next;
+
+    if (entry)
+        Head->Next = entry->Next;
+
+    return entry;
+}
+
+/*
+ * Returns TRUE if the entry was found and unlinked, the caller is then
+ * responsible for freeing it.
+ */
+BOOLEAN
+SingleListUnlinkEntry(_Inout_ PSINGLE_LIST_ENTRY Head,
+                      _In_ PSINGLE_LIST_ENTRY    Entry)
+{
+    PSINGLE_LIST_ENTRY entry = Head;
+
+    while (entry->Next) {
+        if (entry->Next == Entry) {
+            entry->Next = Entry->Next;
+            return TRUE;
+        }
+
+        entry = entry->Next;
+    }
+
+    return FALSE;
+}
+
+#if !defined(PLATFORM_KERNEL)
+
+VOID
+InitializeListHead(_Out_ PLIST_ENTRY ListHead)
+{
+    ListHead->Flink = ListHead;
+    ListHead->Blink = ListHead;
+}
+
+BOOLEAN
+IsListEmpty(_In_ PLIST_ENTRY ListHead)
+{
+    return ListHead->Flink == ListHead ? TRUE : FALSE;
+}
+
+VOID
+InsertTailList(_Inout_ PLIST_ENTRY ListHead, _Inout_ PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY blink = ListHead->Blink;
+
+    Entry->Flink    = ListHead;
+    Entry->Blink    = blink;
+    blink->Flink    = Entry;
+    ListHead->Blink = Entry;
+}
+
+VOID
+InsertHeadList(_Inout_ PLIST_ENTRY ListHead, _Inout_ PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY flink = ListHead->Flink;
+
+    Entry->Flink    = flink;
+    Entry->Blink    = ListHead;
+    flink->Blink    = Entry;
+    ListHead->Flink = Entry;
+}
+
+PLIST_ENTRY
+RemoveHeadList(_Inout_ PLIST_ENTRY ListHead)
+{
+    PLIST_ENTRY entry = ListHead->Flink;
+    PLIST_ENTRY flink = entry->Flink;
+
+    ListHead->Flink = flink;
+    flink->Blink    = ListHead;
+    return entry;
+}
+
+BOOLEAN
+RemoveEntryList(_In_ PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY flink = Entry->Flink;
+    PLIST_ENTRY blink = Entry->Blink;
+
+    blink->Flink = flink;
+    flink->Blink = blink;
+    return flink == blink ? TRUE : FALSE;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pointer manipulation behind the driver's queue and list implementations.
+ * These are not lock free, every routine expects the caller to already hold
+ * the lock protecting the container and none of them allocate. The caller
+ * owns the memory backing each node, which keeps the helpers testable on the
+ * host while the driver keeps its guarded mutexes and lookaside lists.
+ */
+
+typedef struct _QUEUE_NODE {
+    struct _QUEUE_NODE* next;
+    PVOID               data;
+
+} QUEUE_NODE, *PQUEUE_NODE;
+
+typedef struct _QUEUE_LIST {
+    PQUEUE_NODE start;
+    PQUEUE_NODE end;
+    INT         entries;
+
+} QUEUE_LIST, *PQUEUE_LIST;
+
+VOID
+QueueListInit(_Out_ PQUEUE_LIST Queue);
+
+VOID
+QueueListInsertTail(_Inout_ PQUEUE_LIST Queue,
+                    _Inout_ PQUEUE_NODE Node,
+                    _In_ PVOID          Data);
+
+PQUEUE_NODE
+QueueListRemoveHead(_Inout_ PQUEUE_LIST Queue);
+
+VOID
+SingleListInsertHead(_Inout_ PSINGLE_LIST_ENTRY Head,
+                     _Inout_ PSINGLE_LIST_ENTRY Entry);
+
+PSINGLE_LIST_ENTRY
+SingleListRemoveHead(_Inout_ PSINGLE_LIST_ENTRY Head);
+
+BOOLEAN
+SingleListUnlinkEntry(_Inout_ PSINGLE_LIST_ENTRY Head,
+                      _In_ PSINGLE_LIST_ENTRY    Entry);
+
+/*
+ * The WDK provides these as inline routines in wdm.h, user mode and the host
+ * do not.
+ */
+#if !defined(PLATFORM_KERNEL)
+
+VOID
+InitializeListHead(_Out_ PLIST_ENTRY ListHead);
+
+BOOLEAN
+IsListEmpty(_In_ PLIST_ENTRY ListHead);
+
+VOID
+InsertTailList(_Inout_ PLIST_ENTRY ListHead, _Inout_ PLIST_ENTRY Entry);
+
+VOID
+InsertHeadList(_Inout_ PLIST_ENTRY ListHead, _Inout_ PLIST_ENTRY Entry);
+
+PLIST_ENTRY
+RemoveHeadList(_Inout_ PLIST_ENTRY ListHead);
+
+BOOLEAN
+RemoveEntryList(_In_ PLIST_ENTRY Entry);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+#include "cputopo.h"
+
+VOID
+CpuTopologyInitialise(_Out_ PCPU_TOPOLOGY Topology)
+{
+    RtlZeroMemory(Topology, sizeof(CPU_TOPOLOGY));
+}
+
+STATIC
+UINT32
+CountProcessors(_In_ UINT64 Mask)
+{
+    UINT32 count = 0;
+
+    for (; Mask; Mask &= Mask - 1)
+        count++;
+
+    return count;
+}
+
+NTSTATUS
+CpuTopologyAddCore(_Inout_ PCPU_TOPOLOGY Topology,
+                   _In_ UINT64           Mask,
+                   _In_ UINT8            EfficiencyClass)
+{
+    PCPU_TOPOLOGY_CORE core = NULL;
+
+    if (!Mask)
+        return STATUS_INVALID_PARAMETER;
+
+    for (UINT32 index = 0; index < Topology->core_count; index++) {
+        if (Topology->cores[index].mask == Mask)
+            return STATUS_SUCCESS;
+    }
+
+    if (Topology->processors & Mask)
+        return STATUS_INVALID_PARAMETER;
+
+    /* disjoint non empty masks, so this can never run past the array */
+    core                   = &Topology->cores[Topology->core_count++];
+    core->mask             = Mask;
+    core->efficiency_class = EfficiencyClass;
+
+    if (Topology->core_count == 1) {
+        Topology->lowest_class  = EfficiencyClass;
+        Topology->highest_class = EfficiencyClass;
+    }
+    else if (EfficiencyClass < Topology->lowest_class) {
+        Topology->lowest_class = EfficiencyClass;
+    }
+    else if (EfficiencyClass > Topology->highest_class) {
+        Topology->highest_class = EfficiencyClass;
+    }
+
+    if (Mask & (Mask - 1))
+        Topology->smt = TRUE;
+
+    Topology->processors |= Mask;
+    Topology->processor_count = CountProcessors(Topology->processors);
+    return STATUS_SUCCESS;
+}
+
+/* reads a decimal number, returning the characters consumed or 0 if none */
+STATIC
+SIZE_T
+ReadNumber(_In_ PCSTR List, _In_ SIZE_T Length, _Out_ PUINT32 Value)
+{
+    SIZE_T index = 0;
+
+    *Value = 0;
+
+    while (index < Length && List[index] >= '0' && List[index] <= '9') {
+        if (*Value > 0xffff)
+            return 0;
+
+        *Value = *Value * 10 + (UINT32)(List[index++] - '0');
+    }
+
+    return index;
+}
+
+NTSTATUS
+CpuTopologyParseList(_In_ PCSTR List, _In_ SIZE_T Length, _Out_ PUINT64 Mask)
+{
+    SIZE_T offset = 0;
+    SIZE_T read   = 0;
+    UINT32 first  = 0;
+    UINT32 last   = 0;
+
+    *Mask = 0;
+
+    /* sysfs files end in a newline */
+    while (Length && (List[Length - 1] == '\n' || List[Length - 1] == ' '))
+        Length--;
+
+    while (offset < Length) {
+        read = ReadNumber(List + offset, Length - offset, &first);
+
+        if (!read)
+            return STATUS_INVALID_PARAMETER;
+
+        offset += read;
+        last = first;
+
+        if (offset < Length && List[offset] == '-') {
+            offset++;
+            read = ReadNumber(List + offset, Length - offset, &last);
+
+            if (!read || last < first)
+                return STATUS_INVALID_PARAMETER;
+
+            offset += read;
+        }
+
+        if (offset < Length && List[offset++] != ',')
+            return STATUS_INVALID_PARAMETER;
+
+        for (UINT32 processor = first;
+             processor <= last && processor < CPU_TOPOLOGY_MAX_PROCESSORS;
+             processor++)
+            *Mask |= 1ull << processor;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* the last Count cores of the lowest class, which is every core here */
+STATIC
+UINT64
+GetLastCores(_In_ PCPU_TOPOLOGY Topology, _In_ UINT32 Count)
+{
+    UINT64 mask = 0;
+
+    for (UINT32 index = Topology->core_count - Count;
+         index < Topology->core_count;
+         index++)
+        mask |= Topology->cores[index].mask;
+
+    return mask;
+}
+
+STATIC
+UINT64
+GetBackgroundMask(_In_ PCPU_TOPOLOGY Topology)
+{
+    UINT64 mask  = 0;
+    UINT32 count = Topology->core_count / CPU_TOPOLOGY_BACKGROUND_CORE_DIVISOR;
+
+    if (Topology->lowest_class == Topology->highest_class)
+        return GetLastCores(Topology, count ? count : 1);
+
+    for (UINT32 index = 0; index < Topology->core_count; index++) {
+        if (Topology->cores[index].efficiency_class == Topology->lowest_class)
+            mask |= Topology->cores[index].mask;
+    }
+
+    return mask;
+}
+
+VOID
+CpuTopologyGetPlacement(_In_ PCPU_TOPOLOGY      Topology,
+                        _In_ CPU_PLACEMENT_CLASS Class,
+                        _Out_ PCPU_PLACEMENT     Placement)
+{
+    UINT64 background = 0;
+
+    RtlZeroMemory(Placement, sizeof(CPU_PLACEMENT));
+
+    /* background work is always deprioritised, even when it cant be moved */
+    Placement->low_priority = Class == CpuPlacementBackground;
+
+    if (Topology->core_count < 2)
+        return;
+
+    background = GetBackgroundMask(Topology);
+
+    if (Class == CpuPlacementBackground)
+        Placement->mask = background;
+    else
+        Placement->mask = Topology->processors & ~background;
+}
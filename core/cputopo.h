@@ -0,0 +1,96 @@
+#ifndef CPUTOPO_H
+#define CPUTOPO_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The layout of the logical processors the module's threads are placed on,
+ * built core by core from whatever the platform reports: on windows the
+ * RelationProcessorCore entries of GetLogicalProcessorInformationEx, on linux
+ * the thread_siblings_list of every cpu in sysfs.
+ *
+ * Each core is a set of SMT siblings with an efficiency class, higher classes
+ * being faster, which is how windows ranks them. A hybrid processor has more
+ * than one class. Processors are numbered as in the first processor group,
+ * so machines with more than 64 are only ever placed within the first 64.
+ */
+#define CPU_TOPOLOGY_MAX_PROCESSORS 64
+
+/* on a processor of one class, background work gets this share of cores */
+#define CPU_TOPOLOGY_BACKGROUND_CORE_DIVISOR 4
+
+typedef struct _CPU_TOPOLOGY_CORE {
+    UINT64 mask;
+    UINT8  efficiency_class;
+
+} CPU_TOPOLOGY_CORE, *PCPU_TOPOLOGY_CORE;
+
+typedef struct _CPU_TOPOLOGY {
+    UINT32            core_count;
+    UINT32            processor_count;
+    UINT64            processors;
+    UINT8             lowest_class;
+    UINT8             highest_class;
+    BOOLEAN           smt;
+    CPU_TOPOLOGY_CORE cores[CPU_TOPOLOGY_MAX_PROCESSORS];
+
+} CPU_TOPOLOGY, *PCPU_TOPOLOGY;
+
+typedef enum _CPU_PLACEMENT_CLASS {
+    /* scans and validation, throughput doesnt matter as long as they finish */
+    CpuPlacementBackground = 0,
+
+    /* completion port handling, wants to wake quickly on a fast core */
+    CpuPlacementLatency
+
+} CPU_PLACEMENT_CLASS;
+
+typedef struct _CPU_PLACEMENT {
+    /* the processors the thread may run on, 0 leaves it to the scheduler */
+    UINT64  mask;
+    BOOLEAN low_priority;
+
+} CPU_PLACEMENT, *PCPU_PLACEMENT;
+
+VOID
+CpuTopologyInitialise(_Out_ PCPU_TOPOLOGY Topology);
+
+/*
+ * Adds a core made of the processors in Mask. A core reported twice, as
+ * sysfs does once per sibling, is only added once, STATUS_INVALID_PARAMETER
+ * for a mask that partly overlaps a core already added.
+ */
+NTSTATUS
+CpuTopologyAddCore(_Inout_ PCPU_TOPOLOGY Topology,
+                   _In_ UINT64           Mask,
+                   _In_ UINT8            EfficiencyClass);
+
+/*
+ * Parses a sysfs cpu list such as "0-3,8,10-11" into a mask. Processors past
+ * CPU_TOPOLOGY_MAX_PROCESSORS are dropped, anything malformed is
+ * STATUS_INVALID_PARAMETER.
+ */
+NTSTATUS
+CpuTopologyParseList(_In_ PCSTR List, _In_ SIZE_T Length, _Out_ PUINT64 Mask);
+
+/*
+ * Background work goes on the slowest class of a hybrid processor, and on a
+ * single class processor on the last 1/CPU_TOPOLOGY_BACKGROUND_CORE_DIVISOR
+ * of the cores, keeping it off most of the cores the game is scheduled on.
+ * Latency sensitive work gets whatever background work doesnt. Either is
+ * left unrestricted when there is only one core to go around.
+ */
+VOID
+CpuTopologyGetPlacement(_In_ PCPU_TOPOLOGY      Topology,
+                        _In_ CPU_PLACEMENT_CLASS Class,
+                        _Out_ PCPU_PLACEMENT     Placement);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,316 @@
+#include "dataptr.h"
+
+#define DATA_POINTER_PAGE_MASK (DATA_POINTER_PAGE_SIZE - 1)
+
+VOID
+DataPointerMapReset(_Inout_ PDATA_POINTER_MAP Map)
+{
+    Map->region_count  = 0;
+    Map->page_count    = 0;
+    Map->slot_count    = 0;
+    Map->dropped       = 0;
+    Map->cursor        = 0;
+    Map->pages_scanned = 0;
+    Map->pages_skipped = 0;
+    Map->changed       = 0;
+    Map->retargeted    = 0;
+    Map->reports       = 0;
+}
+
+NTSTATUS
+DataPointerMapAddRegion(_Inout_ PDATA_POINTER_MAP Map,
+                        _In_ UINT64               Base,
+                        _In_ UINT64               Size)
+{
+    PDATA_POINTER_REGION region = NULL;
+
+    if (!Size || Base + Size < Base)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Map->region_count >= Map->region_capacity)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    region       = &Map->regions[Map->region_count++];
+    region->base = Base;
+    region->end  = Base + Size;
+
+    return STATUS_SUCCESS;
+}
+
+/* the image is mapped, so sections are located by their virtual address */
+NTSTATUS
+DataPointerMapAddCodeSections(_Inout_ PDATA_POINTER_MAP Map,
+                              _In_ PPE_VIEW             View)
+{
+    NTSTATUS              status  = STATUS_SUCCESS;
+    PIMAGE_SECTION_HEADER section = View->sections;
+
+    for (UINT32 index = 0; index < View->section_count; index++, section++) {
+        if (!(section->Characteristics & IMAGE_SCN_MEM_EXECUTE))
+            continue;
+
+        if (!PeViewGetPointer(
+                View, section->VirtualAddress, section->Misc.VirtualSize))
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        status = DataPointerMapAddRegion(Map,
+                                         View->base + section->VirtualAddress,
+                                         section->Misc.VirtualSize);
+
+        if (!NT_SUCCESS(status))
+            return status;
+    }
+
+    return status;
+}
+
+/*
+ * A few hundred modules with one or two code sections each, insertion sort is
+ * fine. Overlapping and adjacent regions are merged so the binary search in
+ * DataPointerIsValidCode only has to look at one.
+ */
+VOID
+DataPointerMapSortRegions(_Inout_ PDATA_POINTER_MAP Map)
+{
+    DATA_POINTER_REGION region = {0};
+    UINT32              merged = 0;
+    UINT32              index  = 0;
+
+    for (UINT32 next = 1; next < Map->region_count; next++) {
+        region = Map->regions[next];
+        index  = next;
+
+        while (index && Map->regions[index - 1].base > region.base) {
+            Map->regions[index] = Map->regions[index - 1];
+            index--;
+        }
+
+        Map->regions[index] = region;
+    }
+
+    for (index = 1; index < Map->region_count; index++) {
+        if (Map->regions[index].base <= Map->regions[merged].end) {
+            if (Map->regions[index].end > Map->regions[merged].end)
+                Map->regions[merged].end = Map->regions[index].end;
+
+            continue;
+        }
+
+        Map->regions[++merged] = Map->regions[index];
+    }
+
+    if (Map->region_count)
+        Map->region_count = merged + 1;
+}
+
+BOOLEAN
+DataPointerIsValidCode(_In_ PDATA_POINTER_MAP Map, _In_ UINT64 Address)
+{
+    UINT32 low    = 0;
+    UINT32 high   = Map->region_count;
+    UINT32 middle = 0;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (Address < Map->regions[middle].base)
+            high = middle;
+        else if (Address >= Map->regions[middle].end)
+            low = middle + 1;
+        else
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+STATIC
+PDATA_POINTER_PAGE
+AddPage(_Inout_ PDATA_POINTER_MAP Map, _In_ UINT64 Address)
+{
+    PDATA_POINTER_PAGE page = NULL;
+
+    if (Map->page_count >= Map->page_capacity)
+        return NULL;
+
+    page             = &Map->pages[Map->page_count++];
+    page->address    = Address;
+    page->first_slot = Map->slot_count;
+    page->slot_count = 0;
+
+    return page;
+}
+
+/*
+ * Adds the slots of a single page that point into validated code. The page is
+ * only added once its first slot is found, most pages of .data hold none.
+ */
+STATIC
+VOID
+AddPageSlots(_Inout_ PDATA_POINTER_MAP Map,
+             _In_ UINT64               Page,
+             _In_ PUINT64              Data,
+             _In_ UINT32               First,
+             _In_ UINT32               Last)
+{
+    PDATA_POINTER_PAGE page = NULL;
+    PDATA_POINTER_SLOT slot = NULL;
+
+    for (UINT32 index = First; index < Last; index++) {
+        if (!DataPointerIsValidCode(Map, Data[index]))
+            continue;
+
+        if (!page)
+            page = AddPage(Map, Page);
+
+        if (!page || Map->slot_count >= Map->slot_capacity) {
+            Map->dropped++;
+            continue;
+        }
+
+        slot           = &Map->slots[Map->slot_count++];
+        slot->baseline = Data[index];
+        slot->offset   = index * DATA_POINTER_SLOT_SIZE;
+        slot->reserved = 0;
+        page->slot_count++;
+    }
+}
+
+/*
+ * Pages that aren't resident when the map is built are skipped, a hook on one
+ * of those goes unseen until the map is rebuilt.
+ */
+NTSTATUS
+DataPointerMapAddRange(_Inout_ PDATA_POINTER_MAP Map,
+                       _In_ UINT64               Base,
+                       _In_ UINT64               Size)
+{
+    UINT64  end   = Base + Size;
+    UINT64  page  = Base & ~DATA_POINTER_PAGE_MASK;
+    UINT64  first = 0;
+    UINT64  last  = 0;
+    PUINT64 data  = NULL;
+
+    if (!Map->translate || end < Base)
+        return STATUS_INVALID_PARAMETER;
+
+    for (; page < end; page += DATA_POINTER_PAGE_SIZE) {
+        data = Map->translate(page, Map->memory_context);
+
+        if (!data) {
+            Map->pages_skipped++;
+            continue;
+        }
+
+        first = page < Base ? Base - page : 0;
+        last  = end - page < DATA_POINTER_PAGE_SIZE ? end - page
+                                                    : DATA_POINTER_PAGE_SIZE;
+
+        AddPageSlots(Map,
+                     page,
+                     data,
+                     (UINT32)((first + DATA_POINTER_SLOT_SIZE - 1) /
+                              DATA_POINTER_SLOT_SIZE),
+                     (UINT32)(last / DATA_POINTER_SLOT_SIZE));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* every writable section that isn't also executable */
+NTSTATUS
+DataPointerMapAddImage(_Inout_ PDATA_POINTER_MAP Map, _In_ PPE_VIEW View)
+{
+    NTSTATUS              status  = STATUS_SUCCESS;
+    PIMAGE_SECTION_HEADER section = View->sections;
+
+    for (UINT32 index = 0; index < View->section_count; index++, section++) {
+        if (!(section->Characteristics & IMAGE_SCN_MEM_WRITE) ||
+            section->Characteristics & IMAGE_SCN_MEM_EXECUTE)
+            continue;
+
+        if (!PeViewGetPointer(
+                View, section->VirtualAddress, section->Misc.VirtualSize))
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        status = DataPointerMapAddRange(Map,
+                                        View->base + section->VirtualAddress,
+                                        section->Misc.VirtualSize);
+
+        if (!NT_SUCCESS(status))
+            return status;
+    }
+
+    return status;
+}
+
+STATIC
+VOID
+RescanPage(_Inout_ PDATA_POINTER_MAP  Map,
+           _In_ PDATA_POINTER_PAGE    Page,
+           _In_ DATA_POINTER_CALLBACK Callback,
+           _Inout_opt_ PVOID          Context)
+{
+    PUINT64            data     = NULL;
+    PDATA_POINTER_SLOT slot     = &Map->slots[Page->first_slot];
+    UINT64             current  = 0;
+    UINT64             previous = 0;
+
+    data = Map->translate(Page->address, Map->memory_context);
+
+    if (!data) {
+        Map->pages_skipped++;
+        return;
+    }
+
+    Map->pages_scanned++;
+
+    for (UINT32 index = 0; index < Page->slot_count; index++, slot++) {
+        current = data[slot->offset / DATA_POINTER_SLOT_SIZE];
+
+        if (current == slot->baseline)
+            continue;
+
+        previous       = slot->baseline;
+        slot->baseline = current;
+        Map->changed++;
+
+        if (current < DATA_POINTER_KERNEL_BASE ||
+            DataPointerIsValidCode(Map, current)) {
+            Map->retargeted++;
+            continue;
+        }
+
+        Map->reports++;
+        Callback(Page->address + slot->offset, previous, current, Context);
+    }
+}
+
+/*
+ * Rescans up to PageBudget pages starting where the last rescan stopped, so
+ * the cost of a single run stays bounded however many pages are tracked. A
+ * budget of 0 rescans every page. Returns the number of pages visited.
+ */
+UINT32
+DataPointerMapRescan(_Inout_ PDATA_POINTER_MAP  Map,
+                     _In_ UINT32                PageBudget,
+                     _In_ DATA_POINTER_CALLBACK Callback,
+                     _Inout_opt_ PVOID          Context)
+{
+    UINT32 count = 0;
+
+    if (!Map->page_count || !Callback)
+        return 0;
+
+    if (!PageBudget || PageBudget > Map->page_count)
+        PageBudget = Map->page_count;
+
+    for (; count < PageBudget; count++) {
+        if (Map->cursor >= Map->page_count)
+            Map->cursor = 0;
+
+        RescanPage(Map, &Map->pages[Map->cursor++], Callback, Context);
+    }
+
+    return count;
+}
@@ -0,0 +1,132 @@
+#ifndef DATAPTR_H
+#define DATAPTR_H
+
+#include "platform.h"
+
+#include "pe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Data pointer hooks overwrite a function pointer held in a drivers writable
+ * data (a callback array, an ops table, a global in .data) rather then
+ * patching code, so hashing executable sections never sees them.
+ *
+ * The map records every pointer sized slot in the writable sections of the
+ * loaded modules that points into the code of a validated module, along with
+ * its value at the time. Slots are grouped by the page they live on, so a
+ * rescan only reads the pages that held a code pointer, and only the tracked
+ * slots within them.
+ *
+ * When a slot changes it is reported if it now holds a kernel address outside
+ * every validated code region. Retargets to validated code, and values that
+ * aren't kernel addresses at all, are taken as the new baseline. Either way a
+ * change is only seen once.
+ */
+#define DATA_POINTER_PAGE_SIZE   0x1000ull
+#define DATA_POINTER_SLOT_SIZE   sizeof(UINT64)
+#define DATA_POINTER_KERNEL_BASE 0xffff800000000000ull
+
+typedef struct _DATA_POINTER_REGION {
+    UINT64 base;
+    UINT64 end;
+
+} DATA_POINTER_REGION, *PDATA_POINTER_REGION;
+
+typedef struct _DATA_POINTER_PAGE {
+    UINT64 address;
+    UINT32 first_slot;
+    UINT32 slot_count;
+
+} DATA_POINTER_PAGE, *PDATA_POINTER_PAGE;
+
+typedef struct _DATA_POINTER_SLOT {
+    UINT64 baseline;
+    UINT32 offset;
+    UINT32 reserved;
+
+} DATA_POINTER_SLOT, *PDATA_POINTER_SLOT;
+
+/*
+ * Returns an address the page at the given kernel address can be read from,
+ * or NULL if it isnt resident. Same contract as CID_TABLE_TRANSLATE.
+ */
+typedef PVOID (*DATA_POINTER_TRANSLATE)(_In_ UINT64 Address,
+                                        _Inout_opt_ PVOID Context);
+
+/* invoked for every slot found pointing outside validated code */
+typedef VOID (*DATA_POINTER_CALLBACK)(_In_ UINT64 Address,
+                                      _In_ UINT64 Baseline,
+                                      _In_ UINT64 Current,
+                                      _Inout_opt_ PVOID Context);
+
+typedef struct _DATA_POINTER_MAP {
+    DATA_POINTER_TRANSLATE translate;
+    PVOID                  memory_context;
+
+    /* code of validated modules, sorted by DataPointerMapSortRegions */
+    UINT32               region_capacity;
+    UINT32               region_count;
+    PDATA_POINTER_REGION regions;
+
+    UINT32             page_capacity;
+    UINT32             page_count;
+    PDATA_POINTER_PAGE pages;
+
+    UINT32             slot_capacity;
+    UINT32             slot_count;
+    PDATA_POINTER_SLOT slots;
+
+    /* slots that didn't fit, and the next page an incremental rescan reads */
+    UINT32 dropped;
+    UINT32 cursor;
+
+    /* lifetime statistics */
+    UINT64 pages_scanned;
+    UINT64 pages_skipped;
+    UINT64 changed;
+    UINT64 retargeted;
+    UINT64 reports;
+
+} DATA_POINTER_MAP, *PDATA_POINTER_MAP;
+
+/* forgets every region, page and slot, the buffers are kept */
+VOID
+DataPointerMapReset(_Inout_ PDATA_POINTER_MAP Map);
+
+NTSTATUS
+DataPointerMapAddRegion(_Inout_ PDATA_POINTER_MAP Map,
+                        _In_ UINT64               Base,
+                        _In_ UINT64               Size);
+
+NTSTATUS
+DataPointerMapAddCodeSections(_Inout_ PDATA_POINTER_MAP Map,
+                              _In_ PPE_VIEW             View);
+
+VOID
+DataPointerMapSortRegions(_Inout_ PDATA_POINTER_MAP Map);
+
+BOOLEAN
+DataPointerIsValidCode(_In_ PDATA_POINTER_MAP Map, _In_ UINT64 Address);
+
+NTSTATUS
+DataPointerMapAddRange(_Inout_ PDATA_POINTER_MAP Map,
+                       _In_ UINT64               Base,
+                       _In_ UINT64               Size);
+
+NTSTATUS
+DataPointerMapAddImage(_Inout_ PDATA_POINTER_MAP Map, _In_ PPE_VIEW View);
+
+UINT32
+DataPointerMapRescan(_Inout_ PDATA_POINTER_MAP  Map,
+                     _In_ UINT32                PageBudget,
+                     _In_ DATA_POINTER_CALLBACK Callback,
+                     _Inout_opt_ PVOID          Context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,207 @@
+#include "dispatch.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#    include <emmintrin.h>
+#    define DISPATCH_USE_SSE2 1
+#endif
+
+#define DISPATCH_HASH_SEED       0x6469737061746368ull
+#define DISPATCH_HASH_MULTIPLIER 0x9e3779b97f4a7c15ull
+
+VOID
+DispatchSnapshotInitialise(_Out_ PDISPATCH_SNAPSHOT Snapshot)
+{
+    RtlZeroMemory(Snapshot, sizeof(DISPATCH_SNAPSHOT));
+    Snapshot->hash = DispatchSnapshotHash(Snapshot);
+}
+
+STATIC
+UINT64
+HashWord(_In_ UINT64 Hash, _In_ UINT64 Word)
+{
+    Hash = (Hash ^ Word) * DISPATCH_HASH_MULTIPLIER;
+    return Hash ^ (Hash >> 29);
+}
+
+/*
+ * Not cryptographic, it only has to make our copy of the tables useless to
+ * patch without also recomputing the hash, at which point the attacker may as
+ * well patch our code.
+ */
+UINT64
+DispatchSnapshotHash(_In_ PDISPATCH_SNAPSHOT Snapshot)
+{
+    UINT64          hash  = DISPATCH_HASH_SEED;
+    PDISPATCH_TABLE table = NULL;
+
+    hash = HashWord(hash, Snapshot->table_count);
+    hash = HashWord(hash, Snapshot->slot_count);
+
+    for (UINT32 index = 0; index < Snapshot->table_count; index++) {
+        table = &Snapshot->tables[index];
+        hash  = HashWord(hash, ((UINT64)table->id << 32) | table->first_slot);
+        hash  = HashWord(hash, table->slot_count);
+        hash  = HashWord(hash, (UINT64)table->live);
+    }
+
+    for (UINT32 index = 0; index < Snapshot->slot_count; index++)
+        hash = HashWord(hash, Snapshot->slots[index]);
+
+    return hash;
+}
+
+NTSTATUS
+DispatchSnapshotAddTable(_Inout_ PDISPATCH_SNAPSHOT Snapshot,
+                         _In_ UINT32                TableId,
+                         _In_ PUINT64               Table,
+                         _In_ UINT32                SlotCount)
+{
+    PDISPATCH_TABLE table = NULL;
+
+    if (!Table || !SlotCount)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Snapshot->table_count >= DISPATCH_SNAPSHOT_MAX_TABLES ||
+        SlotCount > DISPATCH_SNAPSHOT_MAX_SLOTS - Snapshot->slot_count)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    table             = &Snapshot->tables[Snapshot->table_count++];
+    table->id         = TableId;
+    table->first_slot = Snapshot->slot_count;
+    table->slot_count = SlotCount;
+    table->live       = Table;
+
+    RtlCopyMemory(
+        &Snapshot->slots[table->first_slot], Table, SlotCount * sizeof(UINT64));
+
+    Snapshot->slot_count += SlotCount;
+    Snapshot->hash = DispatchSnapshotHash(Snapshot);
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+DispatchSnapshotEnumerate(_In_ PDISPATCH_SNAPSHOT     Snapshot,
+                          _In_ DISPATCH_SLOT_CALLBACK Callback,
+                          _Inout_opt_ PVOID           Context)
+{
+    PDISPATCH_TABLE table = NULL;
+    UINT64          slot  = 0;
+
+    for (UINT32 index = 0; index < Snapshot->table_count; index++) {
+        table = &Snapshot->tables[index];
+
+        for (UINT32 entry = 0; entry < table->slot_count; entry++) {
+            slot = Snapshot->slots[table->first_slot + entry];
+            Callback(table->id, entry, slot, slot, Context);
+        }
+    }
+}
+
+/*
+ * Returns TRUE if the DISPATCH_BLOCK_SLOTS slots at Live and Saved differ.
+ * The tables are rarely written so almost every block compares equal, this
+ * is the entire cost of a run in the common case.
+ */
+STATIC
+BOOLEAN
+HasBlockChanged(_In_ PUINT64 Live, _In_ PUINT64 Saved)
+{
+#if defined(DISPATCH_USE_SSE2)
+    __m128i low  = _mm_xor_si128(_mm_loadu_si128((__m128i*)Live),
+                                _mm_loadu_si128((__m128i*)Saved));
+    __m128i high = _mm_xor_si128(_mm_loadu_si128((__m128i*)(Live + 2)),
+                                 _mm_loadu_si128((__m128i*)(Saved + 2)));
+    __m128i diff = _mm_or_si128(low, high);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) !=
+           0xffff;
+#else
+    return ((Live[0] ^ Saved[0]) | (Live[1] ^ Saved[1]) | (Live[2] ^ Saved[2]) |
+            (Live[3] ^ Saved[3])) != 0;
+#endif
+}
+
+STATIC
+UINT32
+DiffSlots(_In_ PDISPATCH_TABLE        Table,
+          _Inout_ PUINT64             Saved,
+          _In_ UINT32                 First,
+          _In_ UINT32                 Count,
+          _In_ DISPATCH_SLOT_CALLBACK Callback,
+          _Inout_opt_ PVOID           Context)
+{
+    UINT32 changed = 0;
+    UINT64 current = 0;
+
+    for (UINT32 index = First; index < First + Count; index++) {
+        current = Table->live[index];
+
+        if (current == Saved[index])
+            continue;
+
+        Callback(Table->id, index, Saved[index], current, Context);
+        Saved[index] = current;
+        changed++;
+    }
+
+    return changed;
+}
+
+/*
+ * Compares every live table against the snapshot, calling Callback for each
+ * slot that changed. Changed slots are then taken into the snapshot, so a
+ * slot is only ever reported once per change.
+ *
+ * STATUS_DATA_ERROR means the snapshot itself was modified, in which case
+ * nothing is compared and the caller should take a new one and validate it
+ * in full.
+ */
+NTSTATUS
+DispatchSnapshotDiff(_Inout_ PDISPATCH_SNAPSHOT  Snapshot,
+                     _In_ DISPATCH_SLOT_CALLBACK Callback,
+                     _Inout_opt_ PVOID           Context,
+                     _Out_ PUINT32               Changed)
+{
+    PDISPATCH_TABLE table  = NULL;
+    PUINT64         saved  = NULL;
+    UINT32          blocks = 0;
+    UINT32          tail   = 0;
+
+    *Changed = 0;
+
+    if (DispatchSnapshotHash(Snapshot) != Snapshot->hash)
+        return STATUS_DATA_ERROR;
+
+    for (UINT32 index = 0; index < Snapshot->table_count; index++) {
+        table  = &Snapshot->tables[index];
+        saved  = &Snapshot->slots[table->first_slot];
+        blocks = table->slot_count / DISPATCH_BLOCK_SLOTS;
+        tail   = blocks * DISPATCH_BLOCK_SLOTS;
+
+        for (UINT32 block = 0; block < blocks; block++) {
+            if (!HasBlockChanged(&table->live[block * DISPATCH_BLOCK_SLOTS],
+                                 &saved[block * DISPATCH_BLOCK_SLOTS]))
+                continue;
+
+            *Changed += DiffSlots(table,
+                                  saved,
+                                  block * DISPATCH_BLOCK_SLOTS,
+                                  DISPATCH_BLOCK_SLOTS,
+                                  Callback,
+                                  Context);
+        }
+
+        *Changed += DiffSlots(table,
+                              saved,
+                              tail,
+                              table->slot_count - tail,
+                              Callback,
+                              Context);
+    }
+
+    if (*Changed)
+        Snapshot->hash = DispatchSnapshotHash(Snapshot);
+
+    return STATUS_SUCCESS;
+}
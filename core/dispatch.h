@@ -0,0 +1,77 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Snapshots of kernel dispatch tables (HalDispatchTable,
+ * HalPrivateDispatchTable etc.). Every pointer of every table is copied into
+ * one contiguous slot array when the snapshot is taken and fully validated
+ * once. Later runs compare the live tables against the slots a block at a
+ * time, and only slots that changed need resolving against the module list.
+ *
+ * The snapshot is hashed, including the table descriptors, so that patching
+ * our copy to match a hook is caught rather then trusted.
+ */
+#define DISPATCH_SNAPSHOT_MAX_TABLES 8
+#define DISPATCH_SNAPSHOT_MAX_SLOTS  512
+
+/* slots compared at once, 32 bytes */
+#define DISPATCH_BLOCK_SLOTS 4
+
+typedef struct _DISPATCH_TABLE {
+    UINT32  id;
+    UINT32  first_slot;
+    UINT32  slot_count;
+    PUINT64 live;
+
+} DISPATCH_TABLE, *PDISPATCH_TABLE;
+
+typedef struct _DISPATCH_SNAPSHOT {
+    UINT32         table_count;
+    UINT32         slot_count;
+    UINT64         hash;
+    DISPATCH_TABLE tables[DISPATCH_SNAPSHOT_MAX_TABLES];
+    UINT64         slots[DISPATCH_SNAPSHOT_MAX_SLOTS];
+
+} DISPATCH_SNAPSHOT, *PDISPATCH_SNAPSHOT;
+
+/* invoked for every slot, or only changed ones when diffing */
+typedef VOID (*DISPATCH_SLOT_CALLBACK)(_In_ UINT32 TableId,
+                                       _In_ UINT32 Index,
+                                       _In_ UINT64 Previous,
+                                       _In_ UINT64 Current,
+                                       _Inout_opt_ PVOID Context);
+
+VOID
+DispatchSnapshotInitialise(_Out_ PDISPATCH_SNAPSHOT Snapshot);
+
+NTSTATUS
+DispatchSnapshotAddTable(_Inout_ PDISPATCH_SNAPSHOT Snapshot,
+                         _In_ UINT32                TableId,
+                         _In_ PUINT64               Table,
+                         _In_ UINT32                SlotCount);
+
+UINT64
+DispatchSnapshotHash(_In_ PDISPATCH_SNAPSHOT Snapshot);
+
+VOID
+DispatchSnapshotEnumerate(_In_ PDISPATCH_SNAPSHOT     Snapshot,
+                          _In_ DISPATCH_SLOT_CALLBACK Callback,
+                          _Inout_opt_ PVOID           Context);
+
+NTSTATUS
+DispatchSnapshotDiff(_Inout_ PDISPATCH_SNAPSHOT  Snapshot,
+                     _In_ DISPATCH_SLOT_CALLBACK Callback,
+                     _Inout_opt_ PVOID           Context,
+                     _Out_ PUINT32               Changed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+#include "drvdispatch.h"
+
+VOID
+DriverDispatchInitialise(_Out_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                         _In_ PDRIVER_DISPATCH_ENTRY     Entries,
+                         _In_ UINT32                     Capacity)
+{
+    RtlZeroMemory(Snapshot, sizeof(DRIVER_DISPATCH_SNAPSHOT));
+
+    Snapshot->capacity = Capacity;
+    Snapshot->entries  = Entries;
+}
+
+VOID
+DriverDispatchBeginRound(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                         _In_ PMODULE_RANGE_INDEX          Modules,
+                         _In_ PMODULE_RANGE_INDEX          Allowed,
+                         _In_ PMODULE_RANGE                Ports,
+                         _In_ UINT32                       PortCount)
+{
+    Snapshot->modules    = Modules;
+    Snapshot->allowed    = Allowed;
+    Snapshot->ports      = Ports;
+    Snapshot->port_count = PortCount < DRIVER_DISPATCH_MAXIMUM_PORTS
+                               ? PortCount
+                               : DRIVER_DISPATCH_MAXIMUM_PORTS;
+
+    Snapshot->round++;
+    Snapshot->drivers         = 0;
+    Snapshot->drivers_added   = 0;
+    Snapshot->slots_changed   = 0;
+    Snapshot->drivers_removed = 0;
+}
+
+STATIC
+INT32
+FindDriverDispatchPort(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                       _In_ UINT64                    Address)
+{
+    for (UINT32 index = 0; index < Snapshot->port_count; index++) {
+        if (Address >= Snapshot->ports[index].base &&
+            Address < Snapshot->ports[index].end)
+            return (INT32)index;
+    }
+
+    return -1;
+}
+
+VOID
+DriverDispatchResolvePorts(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                           _Inout_ PDRIVER_DISPATCH_ENTRY Entry,
+                           _In_ PUINT64                   ImportAddressTable,
+                           _In_ UINT32                    Count)
+{
+    INT32 port = 0;
+
+    Entry->ports = 0;
+
+    for (UINT32 index = 0; index < Count; index++) {
+        port = FindDriverDispatchPort(Snapshot, ImportAddressTable[index]);
+
+        if (port >= 0)
+            Entry->ports |= 1u << port;
+    }
+}
+
+DRIVER_DISPATCH_VERDICT
+DriverDispatchClassify(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                       _In_ PDRIVER_DISPATCH_ENTRY    Entry,
+                       _In_ UINT64                    Address)
+{
+    INT32 port = 0;
+
+    if (Address >= Entry->image_base && Address < Entry->image_end)
+        return DRIVER_DISPATCH_OWN_IMAGE;
+
+    if (ModuleRangeIndexContains(Snapshot->allowed, Address))
+        return DRIVER_DISPATCH_ALLOWED_MODULE;
+
+    port = FindDriverDispatchPort(Snapshot, Address);
+
+    if (port >= 0 && Entry->ports & (1u << port))
+        return DRIVER_DISPATCH_ALLOWED_MODULE;
+
+    if (ModuleRangeIndexContains(Snapshot->modules, Address))
+        return DRIVER_DISPATCH_FOREIGN_MODULE;
+
+    return DRIVER_DISPATCH_UNBACKED;
+}
+
+/* the index of the driver, or of where it would be inserted */
+STATIC
+UINT32
+FindDriverDispatchEntry(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                        _In_ UINT64                    Driver)
+{
+    UINT32 low    = 0;
+    UINT32 high   = Snapshot->count;
+    UINT32 middle = 0;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (Snapshot->entries[middle].driver < Driver)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/* a driver seen for the first time */
+STATIC
+UINT32
+ValidateDriverDispatchEntry(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                            _In_ PDRIVER_DISPATCH_ENTRY    Entry,
+                            _In_ DRIVER_DISPATCH_CALLBACK  Callback,
+                            _Inout_opt_ PVOID              Context)
+{
+    DRIVER_DISPATCH_VERDICT verdict  = DRIVER_DISPATCH_OWN_IMAGE;
+    UINT32                  reported = 0;
+
+    for (UINT32 slot = 0; slot < DRIVER_DISPATCH_SLOT_COUNT; slot++) {
+        if (!Entry->slots[slot])
+            continue;
+
+        verdict = DriverDispatchClassify(Snapshot, Entry, Entry->slots[slot]);
+
+        if (verdict == DRIVER_DISPATCH_OWN_IMAGE ||
+            verdict == DRIVER_DISPATCH_ALLOWED_MODULE)
+            continue;
+
+        Callback(Entry, slot, 0, verdict, Context);
+        reported++;
+    }
+
+    return reported;
+}
+
+STATIC
+UINT32
+DiffDriverDispatchEntry(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                        _Inout_ PDRIVER_DISPATCH_ENTRY    Entry,
+                        _In_ PDRIVER_DISPATCH_ENTRY       Live,
+                        _In_ DRIVER_DISPATCH_CALLBACK     Callback,
+                        _Inout_opt_ PVOID                 Context)
+{
+    DRIVER_DISPATCH_VERDICT verdict  = DRIVER_DISPATCH_OWN_IMAGE;
+    UINT64                  previous = 0;
+    UINT32                  reported = 0;
+
+    for (UINT32 slot = 0; slot < DRIVER_DISPATCH_SLOT_COUNT; slot++) {
+        if (Entry->slots[slot] == Live->slots[slot])
+            continue;
+
+        previous           = Entry->slots[slot];
+        Entry->slots[slot] = Live->slots[slot];
+        Snapshot->slots_changed++;
+
+        if (!Live->slots[slot])
+            continue;
+
+        verdict = DriverDispatchClassify(Snapshot, Entry, Live->slots[slot]);
+
+        if (verdict == DRIVER_DISPATCH_OWN_IMAGE ||
+            verdict == DRIVER_DISPATCH_ALLOWED_MODULE)
+            continue;
+
+        Callback(Entry, slot, previous, verdict, Context);
+        reported++;
+    }
+
+    return reported;
+}
+
+/*
+ * Drivers beyond the capacity of the snapshot can't be diffed, so they are
+ * validated as if seen for the first time on every round.
+ */
+UINT32
+DriverDispatchUpdate(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                     _In_ PDRIVER_DISPATCH_ENTRY       Live,
+                     _In_ DRIVER_DISPATCH_CALLBACK     Callback,
+                     _Inout_opt_ PVOID                 Context)
+{
+    PDRIVER_DISPATCH_ENTRY entry = NULL;
+    UINT32                 index = 0;
+
+    Snapshot->drivers++;
+
+    index = FindDriverDispatchEntry(Snapshot, Live->driver);
+
+    if (index < Snapshot->count &&
+        Snapshot->entries[index].driver == Live->driver) {
+        entry = &Snapshot->entries[index];
+
+        /* the object was freed and reused by another driver */
+        if (entry->image_base == Live->image_base &&
+            entry->image_end == Live->image_end) {
+            entry->round = Snapshot->round;
+            return DiffDriverDispatchEntry(
+                Snapshot, entry, Live, Callback, Context);
+        }
+    }
+    else if (Snapshot->count < Snapshot->capacity) {
+        for (UINT32 next = Snapshot->count; next > index; next--)
+            Snapshot->entries[next] = Snapshot->entries[next - 1];
+
+        entry = &Snapshot->entries[index];
+        Snapshot->count++;
+    }
+
+    Snapshot->drivers_added++;
+
+    if (!entry)
+        return ValidateDriverDispatchEntry(Snapshot, Live, Callback, Context);
+
+    RtlCopyMemory(entry, Live, sizeof(DRIVER_DISPATCH_ENTRY));
+    entry->round = Snapshot->round;
+
+    return ValidateDriverDispatchEntry(Snapshot, entry, Callback, Context);
+}
+
+VOID
+DriverDispatchEndRound(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot)
+{
+    UINT32 kept = 0;
+
+    for (UINT32 index = 0; index < Snapshot->count; index++) {
+        if (Snapshot->entries[index].round != Snapshot->round) {
+            Snapshot->drivers_removed++;
+            continue;
+        }
+
+        if (kept != index)
+            Snapshot->entries[kept] = Snapshot->entries[index];
+
+        kept++;
+    }
+
+    Snapshot->count      = kept;
+    Snapshot->modules    = NULL;
+    Snapshot->allowed    = NULL;
+    Snapshot->ports      = NULL;
+    Snapshot->port_count = 0;
+}
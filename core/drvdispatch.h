@@ -0,0 +1,146 @@
+#ifndef DRVDISPATCH_H
+#define DRVDISPATCH_H
+
+#include "platform.h"
+
+#include "system_modules.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Snapshots of the routines every driver object hands to the I/O manager: the
+ * 28 MajorFunction entries, DriverUnload, the FastIoDispatch table pointer and
+ * the routines in that table. Hooking these on disk, keyboard, mouse and
+ * network drivers is how a lot of cheats intercept I/O without patching any
+ * code.
+ *
+ * A slot may point into the drivers own image, a framework any driver may
+ * hand its dispatch routines to (ntoskrnl, wdf) or one of its ports. Class
+ * and port drivers fill in the dispatch routines of the drivers built on
+ * them, disk on classpnp or a miniport on ndis, so each driver is paired
+ * with the ports its import address table points into out of an explicit
+ * list of port modules. Anywhere else is reported.
+ *
+ * The first time a driver is seen every slot is checked. Later runs diff
+ * each driver against its snapshot and only check the slots that changed.
+ * The new value becomes the baseline either way, so a hook is only reported
+ * once.
+ */
+#define DRIVER_DISPATCH_MAJOR_FUNCTIONS  28
+#define DRIVER_DISPATCH_FAST_IO_ROUTINES 27
+
+#define DRIVER_DISPATCH_SLOT_UNLOAD        DRIVER_DISPATCH_MAJOR_FUNCTIONS
+#define DRIVER_DISPATCH_SLOT_FAST_IO_TABLE (DRIVER_DISPATCH_SLOT_UNLOAD + 1)
+#define DRIVER_DISPATCH_SLOT_FAST_IO \
+    (DRIVER_DISPATCH_SLOT_FAST_IO_TABLE + 1)
+#define DRIVER_DISPATCH_SLOT_COUNT \
+    (DRIVER_DISPATCH_SLOT_FAST_IO + DRIVER_DISPATCH_FAST_IO_ROUTINES)
+
+#define DRIVER_DISPATCH_DEFAULT_CAPACITY 0x200
+
+/* ports are tracked in a bitmask on each driver */
+#define DRIVER_DISPATCH_MAXIMUM_PORTS 32
+
+typedef enum _DRIVER_DISPATCH_VERDICT {
+    DRIVER_DISPATCH_OWN_IMAGE = 0,
+    DRIVER_DISPATCH_ALLOWED_MODULE,
+    DRIVER_DISPATCH_FOREIGN_MODULE,
+    DRIVER_DISPATCH_UNBACKED
+
+} DRIVER_DISPATCH_VERDICT;
+
+typedef struct _DRIVER_DISPATCH_ENTRY {
+    UINT64 driver;
+    UINT64 image_base;
+    UINT64 image_end;
+    UINT32 round;
+    /* bit n set when the driver imports from port n */
+    UINT32 ports;
+    UINT64 slots[DRIVER_DISPATCH_SLOT_COUNT];
+
+} DRIVER_DISPATCH_ENTRY, *PDRIVER_DISPATCH_ENTRY;
+
+/* invoked for every slot found pointing somewhere it shouldnt */
+typedef VOID (*DRIVER_DISPATCH_CALLBACK)(_In_ PDRIVER_DISPATCH_ENTRY  Entry,
+                                         _In_ UINT32                  Slot,
+                                         _In_ UINT64                  Previous,
+                                         _In_ DRIVER_DISPATCH_VERDICT Verdict,
+                                         _Inout_opt_ PVOID            Context);
+
+typedef struct _DRIVER_DISPATCH_SNAPSHOT {
+    /* sorted by driver object */
+    UINT32                 capacity;
+    UINT32                 count;
+    PDRIVER_DISPATCH_ENTRY entries;
+
+    /* only valid between DriverDispatchBeginRound and EndRound */
+    PMODULE_RANGE_INDEX modules;
+    PMODULE_RANGE_INDEX allowed;
+    PMODULE_RANGE       ports;
+    UINT32              port_count;
+
+    UINT32 round;
+
+    /* the last round */
+    UINT32 drivers;
+    UINT32 drivers_added;
+    UINT32 slots_changed;
+    UINT32 drivers_removed;
+
+} DRIVER_DISPATCH_SNAPSHOT, *PDRIVER_DISPATCH_SNAPSHOT;
+
+VOID
+DriverDispatchInitialise(_Out_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                         _In_ PDRIVER_DISPATCH_ENTRY     Entries,
+                         _In_ UINT32                     Capacity);
+
+/*
+ * Modules is every loaded module, Allowed the modules whose code may appear
+ * in any drivers dispatch table. Ports holds the range of each port module,
+ * empty for ports that aren't loaded, and has to be in the same order every
+ * round since drivers keep their ports as indexes into it. All three must
+ * outlive the round.
+ */
+VOID
+DriverDispatchBeginRound(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                         _In_ PMODULE_RANGE_INDEX          Modules,
+                         _In_ PMODULE_RANGE_INDEX          Allowed,
+                         _In_ PMODULE_RANGE                Ports,
+                         _In_ UINT32                       PortCount);
+
+/*
+ * Sets the ports of Entry from the resolved entries of its import address
+ * table, to be called on the live entry before DriverDispatchUpdate.
+ */
+VOID
+DriverDispatchResolvePorts(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                           _Inout_ PDRIVER_DISPATCH_ENTRY Entry,
+                           _In_ PUINT64                   ImportAddressTable,
+                           _In_ UINT32                    Count);
+
+DRIVER_DISPATCH_VERDICT
+DriverDispatchClassify(_In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                       _In_ PDRIVER_DISPATCH_ENTRY    Entry,
+                       _In_ UINT64                    Address);
+
+/*
+ * Live holds the drivers current slots, read by the caller. Returns the
+ * number of slots reported.
+ */
+UINT32
+DriverDispatchUpdate(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                     _In_ PDRIVER_DISPATCH_ENTRY       Live,
+                     _In_ DRIVER_DISPATCH_CALLBACK     Callback,
+                     _Inout_opt_ PVOID                 Context);
+
+/* drops the snapshots of drivers not seen this round */
+VOID
+DriverDispatchEndRound(_Inout_ PDRIVER_DISPATCH_SNAPSHOT Snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+#include "heartbeat.h"
+
+#include "sha256.h"
+
+#define HMAC_INNER_PAD 0x36
+#define HMAC_OUTER_PAD 0x5c
+
+/* the domain separator hashed ahead of the session cookie */
+#define HEARTBEAT_KEY_MAGIC 0x6b626841 /* Ahbk */
+
+STATIC
+VOID
+ComputeHmac(_In_ PVOID   Key,
+            _In_ UINT32  KeyLength,
+            _In_ PVOID   Data,
+            _In_ UINT32  DataLength,
+            _Out_ PUCHAR Digest)
+{
+    SHA256_CONTEXT context                = {0};
+    UCHAR          key[SHA256_BLOCK_SIZE] = {0};
+    UCHAR          pad[SHA256_BLOCK_SIZE] = {0};
+
+    /* keys longer than a block are hashed first, as HMAC specifies */
+    if (KeyLength > SHA256_BLOCK_SIZE)
+        Sha256Compute(Key, KeyLength, key);
+    else
+        RtlCopyMemory(key, Key, KeyLength);
+
+    for (UINT32 index = 0; index < SHA256_BLOCK_SIZE; index++)
+        pad[index] = key[index] ^ HMAC_INNER_PAD;
+
+    Sha256Init(&context);
+    Sha256Update(&context, pad, sizeof(pad));
+    Sha256Update(&context, Data, DataLength);
+    Sha256Final(&context, Digest);
+
+    for (UINT32 index = 0; index < SHA256_BLOCK_SIZE; index++)
+        pad[index] = key[index] ^ HMAC_OUTER_PAD;
+
+    Sha256Init(&context);
+    Sha256Update(&context, pad, sizeof(pad));
+    Sha256Update(&context, Digest, SHA256_DIGEST_LENGTH);
+    Sha256Final(&context, Digest);
+}
+
+STATIC
+VOID
+ComputeMac(_In_ PHEARTBEAT_PACKET Packet,
+           _In_ PVOID             Key,
+           _In_ UINT32            KeyLength,
+           _Out_ PUCHAR           Mac)
+{
+    UCHAR digest[SHA256_DIGEST_LENGTH] = {0};
+
+    ComputeHmac(
+        Key, KeyLength, Packet, FIELD_OFFSET(HEARTBEAT_PACKET, mac), digest);
+    RtlCopyMemory(Mac, digest, HEARTBEAT_MAC_LENGTH);
+}
+
+VOID
+HeartbeatDeriveKey(_In_ PVOID   RootKey,
+                   _In_ UINT32  RootKeyLength,
+                   _In_ UINT32  SessionCookie,
+                   _Out_ PUCHAR Key)
+{
+    UINT32 input[2]                     = {HEARTBEAT_KEY_MAGIC, SessionCookie};
+    UCHAR  digest[SHA256_DIGEST_LENGTH] = {0};
+
+    ComputeHmac(RootKey, RootKeyLength, input, sizeof(input), digest);
+    RtlCopyMemory(Key, digest, HEARTBEAT_KEY_LENGTH);
+}
+
+VOID
+HeartbeatSign(_Inout_ PHEARTBEAT_PACKET Packet,
+              _In_ PVOID                Key,
+              _In_ UINT32               KeyLength)
+{
+    Packet->magic = HEARTBEAT_MAGIC;
+    ComputeMac(Packet, Key, KeyLength, Packet->mac);
+}
+
+/* compares every byte, so the time taken says nothing about the mac */
+BOOLEAN
+HeartbeatVerify(_In_ PHEARTBEAT_PACKET Packet,
+                _In_ PVOID             Key,
+                _In_ UINT32            KeyLength)
+{
+    UCHAR mac[HEARTBEAT_MAC_LENGTH] = {0};
+    UCHAR difference                = 0;
+
+    if (Packet->magic != HEARTBEAT_MAGIC)
+        return FALSE;
+
+    ComputeMac(Packet, Key, KeyLength, mac);
+
+    for (UINT32 index = 0; index < HEARTBEAT_MAC_LENGTH; index++)
+        difference |= mac[index] ^ Packet->mac[index];
+
+    return difference == 0;
+}
+
+VOID
+HeartbeatTrackerInitialise(_Out_ PHEARTBEAT_TRACKER Tracker,
+                           _In_ UINT32              Interval)
+{
+    RtlZeroMemory(Tracker, sizeof(HEARTBEAT_TRACKER));
+    Tracker->interval = Interval;
+}
+
+STATIC
+UINT64
+GetDistance(_In_ UINT64 Left, _In_ UINT64 Right)
+{
+    return Left > Right ? Left - Right : Right - Left;
+}
+
+/*
+ * The first heartbeat a tracker sees only sets the baseline, a module
+ * restarted within a session reconnects part way through the sequence.
+ */
+UINT32
+HeartbeatTrack(_Inout_ PHEARTBEAT_TRACKER Tracker,
+               _In_ PHEARTBEAT_PACKET     Packet,
+               _In_ PVOID                 Key,
+               _In_ UINT32                KeyLength,
+               _In_ UINT32                SessionCookie,
+               _In_ UINT64                Received)
+{
+    UINT32 verdict  = 0;
+    UINT64 elapsed  = 0;
+    UINT64 interval = Tracker->interval;
+
+    if (Packet->session_cookie != SessionCookie ||
+        !HeartbeatVerify(Packet, Key, KeyLength)) {
+        Tracker->forged++;
+        return HEARTBEAT_VERDICT_FORGED;
+    }
+
+    if (Tracker->started) {
+        if (Packet->sequence < Tracker->next_sequence ||
+            Packet->time < Tracker->last_time) {
+            Tracker->replayed++;
+            return HEARTBEAT_VERDICT_REPLAYED;
+        }
+
+        if (Packet->sequence > Tracker->next_sequence) {
+            Tracker->missed += Packet->sequence - Tracker->next_sequence;
+            verdict |= HEARTBEAT_VERDICT_GAP;
+        }
+
+        elapsed = Received - Tracker->last_received;
+
+        if (elapsed > interval * HEARTBEAT_LATE_FACTOR) {
+            Tracker->late++;
+            verdict |= HEARTBEAT_VERDICT_LATE;
+        }
+
+        if (GetDistance(Packet->time - Tracker->last_time, elapsed) >
+            interval / HEARTBEAT_SKEW_DIVISOR) {
+            Tracker->skewed++;
+            verdict |= HEARTBEAT_VERDICT_SKEWED;
+        }
+    }
+
+    Tracker->started       = TRUE;
+    Tracker->next_sequence = Packet->sequence + 1;
+    Tracker->last_time     = Packet->time;
+    Tracker->last_received = Received;
+    Tracker->accepted++;
+    return verdict;
+}
@@ -0,0 +1,142 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Heartbeats prove to the server that the driver and module are alive and
+ * passing everything on. The driver signs each one with a key derived from
+ * the session cookie and a root key only it and the server hold, never the
+ * session key the module hands the driver, so the module cant make them up.
+ * The module forwards one every
+ * HEARTBEAT_INTERVAL_MS and the server tracks each client's stream:
+ *
+ *   - a missing sequence number is a heartbeat the module held back or lost
+ *   - a heartbeat arriving long after the previous one is a module that was
+ *     suspended, or killed and restarted
+ *   - the driver's clock moving at a different rate to the server's between
+ *     two heartbeats is a module queueing them up to send later
+ *
+ * The report count lets the server tell a clean client from one whose
+ * reports are going missing, and budget its checks.
+ */
+#define HEARTBEAT_MAGIC       0x74626841 /* Ahbt */
+#define HEARTBEAT_INTERVAL_MS 10000
+#define HEARTBEAT_MAC_LENGTH  16
+
+#define HEARTBEAT_ROOT_KEY_LENGTH 32
+#define HEARTBEAT_KEY_LENGTH      16
+
+/*
+ * The root key of test builds, as the bytes of an initialiser. Used by the
+ * simulated device, the ingest tools and drivers built with
+ * HEARTBEAT_USE_TEST_ROOT_KEY. It is public, anything shipped is built with
+ * its own key, see driver/session.c.
+ */
+#define HEARTBEAT_TEST_ROOT_KEY_BYTES                \
+    0x64, 0x6f, 0x6e, 0x6e, 0x61, 0x20, 0x68, 0x65, \
+    0x61, 0x72, 0x74, 0x62, 0x65, 0x61, 0x74, 0x20, \
+    0x74, 0x65, 0x73, 0x74, 0x20, 0x72, 0x6f, 0x6f, \
+    0x74, 0x20, 0x6b, 0x65, 0x79, 0x21, 0x21, 0x21
+
+/* how far past the interval a heartbeat can be before it counts as late */
+#define HEARTBEAT_LATE_FACTOR 2
+
+/*
+ * How far the two clocks may move apart between heartbeats, as a fraction of
+ * the interval. Less than a whole interval so a burst of held back heartbeats
+ * is caught, which arrive together but were signed an interval apart.
+ */
+#define HEARTBEAT_SKEW_DIVISOR 2
+
+typedef struct _HEARTBEAT_PACKET {
+    UINT32 magic;
+    UINT32 session_cookie;
+
+    /* starts at 1 for a session and never repeats */
+    UINT64 sequence;
+
+    /* milliseconds since boot on the driver's clock, including sleep */
+    UINT64 time;
+
+    /* reports the driver has issued this session, delivered or not */
+    UINT32 report_count;
+    UINT32 reserved;
+
+    /* truncated HMAC-SHA256 over everything above, see HeartbeatDeriveKey */
+    UCHAR mac[HEARTBEAT_MAC_LENGTH];
+
+} HEARTBEAT_PACKET, *PHEARTBEAT_PACKET;
+
+#define HEARTBEAT_VERDICT_FORGED   0x1
+#define HEARTBEAT_VERDICT_REPLAYED 0x2
+#define HEARTBEAT_VERDICT_GAP      0x4
+#define HEARTBEAT_VERDICT_LATE     0x8
+#define HEARTBEAT_VERDICT_SKEWED   0x10
+
+/* the server's view of one client's heartbeats */
+typedef struct _HEARTBEAT_TRACKER {
+    UINT32  interval;
+    BOOLEAN started;
+    UINT64  next_sequence;
+    UINT64  last_time;
+    UINT64  last_received;
+
+    UINT64 accepted;
+    UINT64 missed;
+    UINT64 replayed;
+    UINT64 forged;
+    UINT64 late;
+    UINT64 skewed;
+
+} HEARTBEAT_TRACKER, *PHEARTBEAT_TRACKER;
+
+/*
+ * The key the heartbeats of the session with SessionCookie are signed with,
+ * HMAC-SHA256 of HEARTBEAT_KEY_MAGIC and the cookie keyed by RootKey and
+ * truncated to HEARTBEAT_KEY_LENGTH. Without the root key a key for one
+ * session says nothing about the key for another.
+ */
+VOID
+HeartbeatDeriveKey(_In_ PVOID   RootKey,
+                   _In_ UINT32  RootKeyLength,
+                   _In_ UINT32  SessionCookie,
+                   _Out_ PUCHAR Key);
+
+VOID
+HeartbeatSign(_Inout_ PHEARTBEAT_PACKET Packet,
+              _In_ PVOID                Key,
+              _In_ UINT32               KeyLength);
+
+BOOLEAN
+HeartbeatVerify(_In_ PHEARTBEAT_PACKET Packet,
+                _In_ PVOID             Key,
+                _In_ UINT32            KeyLength);
+
+VOID
+HeartbeatTrackerInitialise(_Out_ PHEARTBEAT_TRACKER Tracker,
+                           _In_ UINT32              Interval);
+
+/*
+ * Checks Packet, received at Received milliseconds on the server's clock,
+ * against the client's stream and returns the HEARTBEAT_VERDICT flags that
+ * apply, 0 for a heartbeat that is on time and in sequence. Forged and
+ * replayed heartbeats leave the stream where it was.
+ */
+UINT32
+HeartbeatTrack(_Inout_ PHEARTBEAT_TRACKER Tracker,
+               _In_ PHEARTBEAT_PACKET     Packet,
+               _In_ PVOID                 Key,
+               _In_ UINT32                KeyLength,
+               _In_ UINT32                SessionCookie,
+               _In_ UINT64                Received);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+/*
+ * The message_type of the packet header in front of everything the module
+ * sends the server through the pipe. The server's MESSAGE_TYPE enum in
+ * server/Message/MessageHandler.cs mirrors these.
+ */
+#define MESSAGE_TYPE_CLIENT_REPORT        1
+#define MESSAGE_TYPE_CLIENT_SEND          2
+#define MESSAGE_TYPE_CLIENT_REQUEST       3
+
+/* the dictionary id and the packed report, see ReportPackMessage */
+#define MESSAGE_TYPE_CLIENT_PACKED_REPORT 4
+
+/* a HEARTBEAT_PACKET, see core/heartbeat.h. Never acked */
+#define MESSAGE_TYPE_CLIENT_HEARTBEAT     5
+
+#endif
@@ -0,0 +1,152 @@
+#include "pagehash.h"
+
+#include "sha256.h"
+
+STATIC
+BOOLEAN
+IsHashedSection(_In_ PIMAGE_SECTION_HEADER Section)
+{
+    return (Section->Characteristics & IMAGE_SCN_MEM_EXECUTE) &&
+           Section->Misc.VirtualSize;
+}
+
+UINT32
+PageHashCountPages(_In_ PPE_VIEW View)
+{
+    UINT32                count   = 0;
+    PIMAGE_SECTION_HEADER section = View->sections;
+
+    for (UINT32 index = 0; index < View->section_count; index++, section++) {
+        if (!IsHashedSection(section))
+            continue;
+
+        count += (section->Misc.VirtualSize + PAGE_HASH_PAGE_SIZE - 1) /
+                 PAGE_HASH_PAGE_SIZE;
+    }
+
+    return count;
+}
+
+VOID
+PageHashSetReset(_Inout_ PPAGE_HASH_SET Set)
+{
+    Set->count      = 0;
+    Set->cursor     = 0;
+    Set->verified   = 0;
+    Set->unreadable = 0;
+    Set->mismatches = 0;
+}
+
+/*
+ * The image is mapped, so sections are located by their virtual address and
+ * only VirtualSize bytes of each are hashed. Anything past that up to the end
+ * of the last page is zero filled and not part of the image.
+ */
+NTSTATUS
+PageHashSetAddImage(_Inout_ PPAGE_HASH_SET Set, _In_ PPE_VIEW View)
+{
+    PIMAGE_SECTION_HEADER section = View->sections;
+    PPAGE_HASH            page    = NULL;
+    PVOID                 data    = NULL;
+    UINT32                offset  = 0;
+
+    for (UINT32 index = 0; index < View->section_count; index++, section++) {
+        if (!IsHashedSection(section))
+            continue;
+
+        data = PeViewGetPointer(
+            View, section->VirtualAddress, section->Misc.VirtualSize);
+
+        if (!data)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        for (offset = 0; offset < section->Misc.VirtualSize;
+             offset += PAGE_HASH_PAGE_SIZE) {
+            if (Set->count >= Set->capacity)
+                return STATUS_BUFFER_TOO_SMALL;
+
+            page           = &Set->pages[Set->count++];
+            page->rva      = section->VirtualAddress + offset;
+            page->length   = section->Misc.VirtualSize - offset;
+            page->reported = FALSE;
+            page->reserved = 0;
+
+            if (page->length > PAGE_HASH_PAGE_SIZE)
+                page->length = PAGE_HASH_PAGE_SIZE;
+
+            Sha256Compute((PUCHAR)data + offset, page->length, page->digest);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATIC
+VOID
+VerifyPage(_Inout_ PPAGE_HASH_SET  Set,
+           _Inout_ PPAGE_HASH      Page,
+           _In_ UINT64             ImageBase,
+           _Out_ PVOID             Scratch,
+           _In_ PAGE_HASH_CALLBACK Callback,
+           _Inout_opt_ PVOID       Context)
+{
+    UCHAR digest[PAGE_HASH_DIGEST_LENGTH] = {0};
+
+    if (!NT_SUCCESS(PlatformCopyMemory(
+            Scratch, (PVOID)(ImageBase + Page->rva), Page->length))) {
+        Set->unreadable++;
+        return;
+    }
+
+    Set->verified++;
+    Sha256Compute(Scratch, Page->length, digest);
+
+    if (!memcmp(digest, Page->digest, PAGE_HASH_DIGEST_LENGTH)) {
+        Page->reported = FALSE;
+        return;
+    }
+
+    if (Page->reported)
+        return;
+
+    Page->reported = TRUE;
+    Set->mismatches++;
+    Callback(Page, Context);
+}
+
+/*
+ * Verifies up to PageBudget pages of the image at ImageBase, starting where
+ * the last verification stopped. A budget of 0 verifies every page. Scratch
+ * must hold PAGE_HASH_PAGE_SIZE bytes, the live page is copied into it before
+ * hashing. Returns the number of pages visited.
+ */
+UINT32
+PageHashSetVerify(_Inout_ PPAGE_HASH_SET  Set,
+                  _In_ UINT64             ImageBase,
+                  _In_ UINT32             PageBudget,
+                  _Out_ PVOID             Scratch,
+                  _In_ PAGE_HASH_CALLBACK Callback,
+                  _Inout_opt_ PVOID       Context)
+{
+    UINT32 count = 0;
+
+    if (!Set->count || !Callback)
+        return 0;
+
+    if (!PageBudget || PageBudget > Set->count)
+        PageBudget = Set->count;
+
+    for (; count < PageBudget; count++) {
+        if (Set->cursor >= Set->count)
+            Set->cursor = 0;
+
+        VerifyPage(Set,
+                   &Set->pages[Set->cursor++],
+                   ImageBase,
+                   Scratch,
+                   Callback,
+                   Context);
+    }
+
+    return count;
+}
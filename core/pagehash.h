@@ -0,0 +1,75 @@
+#ifndef PAGEHASH_H
+#define PAGEHASH_H
+
+#include "platform.h"
+
+#include "pe.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per page SHA-256 hashes of an image's executable sections, taken from the
+ * image as mapped from disk. The in memory image is then verified against
+ * them a few pages at a time, so the cost of a single verification stays
+ * bounded however large the image is, and a patched page is found within one
+ * pass over the image.
+ *
+ * A page that no longer matches is reported once, and again only after it
+ * has matched in between.
+ */
+#define PAGE_HASH_PAGE_SIZE     0x1000
+#define PAGE_HASH_DIGEST_LENGTH 32
+
+typedef struct _PAGE_HASH {
+    UINT32 rva;
+    UINT32 length;
+    UINT32 reported;
+    UINT32 reserved;
+    UCHAR  digest[PAGE_HASH_DIGEST_LENGTH];
+
+} PAGE_HASH, *PPAGE_HASH;
+
+/* invoked for every page found not matching its hash */
+typedef VOID (*PAGE_HASH_CALLBACK)(_In_ PPAGE_HASH Page,
+                                   _Inout_opt_ PVOID Context);
+
+typedef struct _PAGE_HASH_SET {
+    UINT32     capacity;
+    UINT32     count;
+    PPAGE_HASH pages;
+
+    /* the next page a verification reads */
+    UINT32 cursor;
+
+    /* lifetime statistics */
+    UINT64 verified;
+    UINT64 unreadable;
+    UINT64 mismatches;
+
+} PAGE_HASH_SET, *PPAGE_HASH_SET;
+
+/* pages in the executable sections of the image, to size the set */
+UINT32
+PageHashCountPages(_In_ PPE_VIEW View);
+
+VOID
+PageHashSetReset(_Inout_ PPAGE_HASH_SET Set);
+
+NTSTATUS
+PageHashSetAddImage(_Inout_ PPAGE_HASH_SET Set, _In_ PPE_VIEW View);
+
+UINT32
+PageHashSetVerify(_Inout_ PPAGE_HASH_SET  Set,
+                  _In_ UINT64             ImageBase,
+                  _In_ UINT32             PageBudget,
+                  _Out_ PVOID             Scratch,
+                  _In_ PAGE_HASH_CALLBACK Callback,
+                  _Inout_opt_ PVOID       Context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,276 @@
+#include "pagewalk.h"
+
+#define PAGE_WALK_LEVEL_PML4 4
+#define PAGE_WALK_LEVEL_PDPT 3
+#define PAGE_WALK_LEVEL_PD   2
+#define PAGE_WALK_LEVEL_PT   1
+
+/* addresses with bit 47 set are sign extended into the upper half */
+#define PAGE_WALK_CANONICAL_INDEX 256
+#define PAGE_WALK_CANONICAL_HIGH  0xffff000000000000ull
+
+STATIC
+PUINT64
+MapPageTable(_Inout_ PPAGE_WALK Walk, _In_ UINT64 PhysicalAddress)
+{
+    PVOID table = Walk->translate(PhysicalAddress, Walk->memory_context);
+
+    if (!table || !Walk->validate(table, Walk->memory_context))
+        return NULL;
+
+    Walk->tables_visited++;
+    return (PUINT64)table;
+}
+
+/*
+ * Pages are translated one 4kb frame at a time, including those belonging to
+ * a large page. There is no guarantee the virtual address returned for a
+ * physical frame is contiguous with that of its neighbour, so the base of a
+ * large page can't simply be translated once and then walked linearly.
+ */
+STATIC
+VOID
+EnumeratePhysicalRange(_Inout_ PPAGE_WALK Walk,
+                       _In_ UINT64        PhysicalBase,
+                       _In_ UINT64        Size)
+{
+    PVOID page = NULL;
+
+    for (UINT64 offset = 0; offset < Size; offset += PAGE_WALK_4KB_SIZE) {
+        page = Walk->translate(PhysicalBase + offset, Walk->memory_context);
+
+        if (!page || !Walk->validate(page, Walk->memory_context)) {
+            Walk->pages_skipped++;
+            continue;
+        }
+
+        Walk->pages_visited++;
+        Walk->callback((UINT64)page, PAGE_WALK_4KB_SIZE, Walk->callback_context);
+    }
+}
+
+STATIC
+UINT32
+GetLevelShift(_In_ UINT32 Level)
+{
+    return 12 + 9 * (Level - 1);
+}
+
+/*
+ * Every present leaf is handed to the span filter once, with the permissions
+ * of the whole path to it. Only if the filter keeps it are its frames
+ * translated and passed to the callback one 4kb page at a time.
+ */
+STATIC
+VOID
+EnumerateSpan(_Inout_ PPAGE_WALK Walk,
+              _In_ UINT64        VirtualBase,
+              _In_ UINT64        PhysicalBase,
+              _In_ UINT64        Size,
+              _In_ UINT64        Entry,
+              _In_ UINT64        Flags)
+{
+    Walk->span.virtual_base  = VirtualBase;
+    Walk->span.physical_base = PhysicalBase;
+    Walk->span.size          = Size;
+    Walk->span.executable    = !((Flags | Entry) & PAGE_ENTRY_NX);
+    Walk->span.user          = !!(Flags & Entry & PAGE_ENTRY_USER);
+    Walk->spans_visited++;
+
+    if (Walk->span_filter &&
+        !Walk->span_filter(&Walk->span, Walk->callback_context)) {
+        Walk->spans_filtered++;
+        return;
+    }
+
+    EnumeratePhysicalRange(Walk, PhysicalBase, Size);
+}
+
+/*
+ * Flags carries the permission bits of the entries above this table: NX is
+ * set if any of them set it, U/S only if all of them did.
+ */
+STATIC
+VOID
+WalkPageTableLevel(_Inout_ PPAGE_WALK Walk,
+                   _In_ UINT64        TablePhysical,
+                   _In_ UINT32        Level,
+                   _In_ UINT64        VirtualBase,
+                   _In_ UINT64        Flags)
+{
+    UINT64  entry   = 0;
+    UINT64  address = 0;
+    UINT64  next    = 0;
+    PUINT64 table   = MapPageTable(Walk, TablePhysical);
+
+    if (!table)
+        return;
+
+    for (UINT32 index = 0; index < PAGE_TABLE_ENTRY_COUNT; index++) {
+        entry = table[index];
+
+        if (!(entry & PAGE_ENTRY_PRESENT))
+            continue;
+
+        address = VirtualBase | ((UINT64)index << GetLevelShift(Level));
+
+        if (Level == PAGE_WALK_LEVEL_PML4 &&
+            index >= PAGE_WALK_CANONICAL_INDEX)
+            address |= PAGE_WALK_CANONICAL_HIGH;
+
+        if (Level == PAGE_WALK_LEVEL_PT) {
+            EnumerateSpan(Walk,
+                          address,
+                          entry & PAGE_ENTRY_4KB_FRAME,
+                          PAGE_WALK_4KB_SIZE,
+                          entry,
+                          Flags);
+            continue;
+        }
+
+        if (Level == PAGE_WALK_LEVEL_PDPT && entry & PAGE_ENTRY_LARGE) {
+            EnumerateSpan(Walk,
+                          address,
+                          entry & PAGE_ENTRY_1GB_FRAME,
+                          PAGE_WALK_1GB_SIZE,
+                          entry,
+                          Flags);
+            continue;
+        }
+
+        if (Level == PAGE_WALK_LEVEL_PD && entry & PAGE_ENTRY_LARGE) {
+            EnumerateSpan(Walk,
+                          address,
+                          entry & PAGE_ENTRY_2MB_FRAME,
+                          PAGE_WALK_2MB_SIZE,
+                          entry,
+                          Flags);
+            continue;
+        }
+
+        next = (Flags | (entry & PAGE_ENTRY_NX)) &
+               (entry | ~PAGE_ENTRY_USER);
+
+        WalkPageTableLevel(
+            Walk, entry & PAGE_ENTRY_4KB_FRAME, Level - 1, address, next);
+    }
+}
+
+/*
+ * This is your basic page table walk. Each entry in each table contains the
+ * physical address of the next table in the structure, so a PML4 entry points
+ * to the base of a PDPT, a PDPT entry to a PD and so on.
+ *
+ * The tables themselves are read through Walk->translate. In the kernel we
+ * can't use MmCopyMemory or MmMapIoSpace on paging structures, however the
+ * tables are still mapped by the kernel so MmGetVirtualForPhysical gives us a
+ * virtual address we can read them through. On the host the translation is
+ * provided by whatever built the page tables.
+ */
+NTSTATUS
+WalkPageTables(_Inout_ PPAGE_WALK Walk)
+{
+    if (!Walk || !Walk->translate || !Walk->validate || !Walk->callback)
+        return STATUS_INVALID_PARAMETER;
+
+    Walk->tables_visited = 0;
+    Walk->pages_visited  = 0;
+    Walk->pages_skipped  = 0;
+    Walk->spans_visited  = 0;
+    Walk->spans_filtered = 0;
+
+    WalkPageTableLevel(Walk,
+                       Walk->directory_table_base & PAGE_ENTRY_4KB_FRAME,
+                       PAGE_WALK_LEVEL_PML4,
+                       0,
+                       PAGE_ENTRY_USER);
+
+    /* the PML4 itself couldn't be mapped */
+    if (Walk->tables_visited == 0)
+        return STATUS_INVALID_ADDRESS;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+PageSpanOwnersAdd(_Inout_ PPAGE_SPAN_OWNERS Owners,
+                  _In_ UINT64               Base,
+                  _In_ UINT64               Size)
+{
+    if (!Size)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Owners->count >= Owners->capacity)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    Owners->owners[Owners->count].base = Base;
+    Owners->owners[Owners->count].end  = Base + Size;
+    Owners->count++;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Insertion sort, there are a few hundred modules at most and they mostly
+ * arrive in address order. Overlapping and adjacent ranges are merged.
+ */
+VOID
+PageSpanOwnersSort(_Inout_ PPAGE_SPAN_OWNERS Owners)
+{
+    PAGE_SPAN_OWNER owner  = {0};
+    UINT32          merged = 0;
+    UINT32          index  = 0;
+
+    for (UINT32 next = 1; next < Owners->count; next++) {
+        owner = Owners->owners[next];
+        index = next;
+
+        while (index && Owners->owners[index - 1].base > owner.base) {
+            Owners->owners[index] = Owners->owners[index - 1];
+            index--;
+        }
+
+        Owners->owners[index] = owner;
+    }
+
+    for (index = 1; index < Owners->count; index++) {
+        if (Owners->owners[index].base <= Owners->owners[merged].end) {
+            if (Owners->owners[index].end > Owners->owners[merged].end)
+                Owners->owners[merged].end = Owners->owners[index].end;
+
+            continue;
+        }
+
+        Owners->owners[++merged] = Owners->owners[index];
+    }
+
+    if (Owners->count)
+        Owners->count = merged + 1;
+}
+
+/*
+ * A span is owned if any module overlaps it. Large pages are mapped by the
+ * loader and routinely extend past the end of the image they hold, so
+ * requiring the whole span to lie within a module would flag the kernel and
+ * hal on every system.
+ */
+BOOLEAN
+PageSpanIsOwned(_In_ PPAGE_SPAN_OWNERS Owners, _In_ PPAGE_SPAN Span)
+{
+    UINT32 low    = 0;
+    UINT32 high   = Owners->count;
+    UINT32 middle = 0;
+
+    /* the first owner ending after the span starts */
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (Owners->owners[middle].end <= Span->virtual_base)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low < Owners->count &&
+           Owners->owners[low].base < Span->virtual_base + Span->size;
+}
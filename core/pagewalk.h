@@ -0,0 +1,124 @@
+#ifndef PAGEWALK_H
+#define PAGEWALK_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 4 level x64 paging. Every table is a single page holding 512 entries, PDPT
+ * and PD entries with the page size bit set map a 1GB or 2MB page directly
+ * rather then pointing to the next table.
+ */
+#define PAGE_TABLE_ENTRY_COUNT 512
+
+#define PAGE_ENTRY_PRESENT   (1ull << 0)
+#define PAGE_ENTRY_USER      (1ull << 2)
+#define PAGE_ENTRY_LARGE     (1ull << 7)
+#define PAGE_ENTRY_NX        (1ull << 63)
+#define PAGE_ENTRY_4KB_FRAME 0x000ffffffffff000ull
+#define PAGE_ENTRY_2MB_FRAME 0x000fffffffe00000ull
+#define PAGE_ENTRY_1GB_FRAME 0x000fffffc0000000ull
+
+#define PAGE_WALK_4KB_SIZE 0x1000ull
+#define PAGE_WALK_2MB_SIZE 0x200000ull
+#define PAGE_WALK_1GB_SIZE 0x40000000ull
+
+/*
+ * Returns the virtual address the given physical address is mapped at, or NULL
+ * if it isnt backed by ram. In the kernel this is MmGetVirtualForPhysical
+ * filtered by the physical memory ranges.
+ */
+typedef PVOID (*PAGE_WALK_TRANSLATE)(_In_ UINT64 PhysicalAddress,
+                                     _Inout_opt_ PVOID Context);
+
+typedef BOOLEAN (*PAGE_WALK_VALIDATE)(_In_ PVOID     VirtualAddress,
+                                      _Inout_opt_ PVOID Context);
+
+/* invoked once for every present 4kb page, large pages are split up */
+typedef VOID (*PAGE_WALK_CALLBACK)(_In_ UINT64     PageBase,
+                                   _In_ ULONG      PageSize,
+                                   _Inout_opt_ PVOID Context);
+
+/*
+ * A single present leaf mapping, i.e one 4kb, 2mb or 1gb page. A page is only
+ * executable if no entry on the way to it sets NX, and only user accessible if
+ * every entry sets U/S.
+ */
+typedef struct _PAGE_SPAN {
+    UINT64  virtual_base;
+    UINT64  physical_base;
+    UINT64  size;
+    BOOLEAN executable;
+    BOOLEAN user;
+
+} PAGE_SPAN, *PPAGE_SPAN;
+
+/*
+ * Optional, invoked once per span before any of its pages are translated.
+ * Returning FALSE skips the span entirely, so a 1gb page that isnt of interest
+ * costs a single call rather then 262144 translations.
+ */
+typedef BOOLEAN (*PAGE_WALK_SPAN_FILTER)(_In_ PPAGE_SPAN    Span,
+                                         _Inout_opt_ PVOID Context);
+
+typedef struct _PAGE_WALK {
+    /* physical address of the PML4 */
+    UINT64                directory_table_base;
+    PAGE_WALK_TRANSLATE   translate;
+    PAGE_WALK_VALIDATE    validate;
+    PVOID                 memory_context;
+    PAGE_WALK_CALLBACK    callback;
+    PVOID                 callback_context;
+    PAGE_WALK_SPAN_FILTER span_filter;
+
+    /* the span the callback is currently being invoked for */
+    PAGE_SPAN span;
+
+    /* filled in by the walk */
+    UINT64 tables_visited;
+    UINT64 pages_visited;
+    UINT64 pages_skipped;
+    UINT64 spans_visited;
+    UINT64 spans_filtered;
+
+} PAGE_WALK, *PPAGE_WALK;
+
+NTSTATUS
+WalkPageTables(_Inout_ PPAGE_WALK Walk);
+
+/*
+ * Address ranges owned by loaded modules, sorted and merged so a span can be
+ * looked up with a single binary search.
+ */
+typedef struct _PAGE_SPAN_OWNER {
+    UINT64 base;
+    UINT64 end;
+
+} PAGE_SPAN_OWNER, *PPAGE_SPAN_OWNER;
+
+typedef struct _PAGE_SPAN_OWNERS {
+    UINT32           capacity;
+    UINT32           count;
+    PPAGE_SPAN_OWNER owners;
+
+} PAGE_SPAN_OWNERS, *PPAGE_SPAN_OWNERS;
+
+NTSTATUS
+PageSpanOwnersAdd(_Inout_ PPAGE_SPAN_OWNERS Owners,
+                  _In_ UINT64               Base,
+                  _In_ UINT64               Size);
+
+VOID
+PageSpanOwnersSort(_Inout_ PPAGE_SPAN_OWNERS Owners);
+
+BOOLEAN
+PageSpanIsOwned(_In_ PPAGE_SPAN_OWNERS Owners, _In_ PPAGE_SPAN Span);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,317 @@
+#include "pe.h"
+
+PLOCAL_NT_HEADER
+PeGetNtHeader(_In_ PVOID ImageBase)
+{
+    PIMAGE_DOS_HEADER dos_header = (PIMAGE_DOS_HEADER)ImageBase;
+
+    /*
+     * The IMAGE_DOS_HEADER.e_lfanew stores the offset of the
+     * IMAGE_NT_HEADER from the base of the image.
+     */
+    return (PLOCAL_NT_HEADER)((UINT64)ImageBase + dos_header->e_lfanew);
+}
+
+/*
+ * The first section header follows the optional header, whose size is stored
+ * in the file header. This is the same for both 32 and 64 bit images.
+ */
+PIMAGE_SECTION_HEADER
+PeGetFirstSection(_In_ PLOCAL_NT_HEADER NtHeader)
+{
+    return (PIMAGE_SECTION_HEADER)((UINT64)NtHeader +
+                                   FIELD_OFFSET(LOCAL_NT_HEADER,
+                                                OptionalHeader) +
+                                   NtHeader->FileHeader.SizeOfOptionalHeader);
+}
+
+/*
+ * Validates the headers of the image and fills out View. The section table and
+ * data directories are only referenced once they are known to lie within the
+ * image, after which the accessors below can be used without further checks
+ * on the headers themselves.
+ */
+NTSTATUS
+PeViewInitialise(_Out_ PPE_VIEW View,
+                 _In_ PVOID     ImageBase,
+                 _In_ SIZE_T    ImageSize)
+{
+    PIMAGE_DOS_HEADER        dos_header       = NULL;
+    PLOCAL_NT_HEADER         nt_header        = NULL;
+    PIMAGE_OPTIONAL_HEADER32 optional_32      = NULL;
+    PIMAGE_OPTIONAL_HEADER64 optional_64      = NULL;
+    UINT64                   section_offset   = 0;
+    UINT64                   optional_offset  = 0;
+    UINT16                   optional_size    = 0;
+    UINT32                   directory_offset = 0;
+    UINT32                   directory_count  = 0;
+
+    RtlZeroMemory(View, sizeof(PE_VIEW));
+
+    if (!ImageBase)
+        return STATUS_INVALID_PARAMETER;
+
+    View->base = (UINT64)ImageBase;
+    View->size = ImageSize;
+
+    dos_header = (PIMAGE_DOS_HEADER)PeViewGetPointer(
+        View, 0, sizeof(IMAGE_DOS_HEADER));
+
+    if (!dos_header || dos_header->e_magic != PE_DOS_SIGNATURE ||
+        dos_header->e_lfanew < 0)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    /* the optional header is variable size, so only require the fixed part */
+    nt_header = (PLOCAL_NT_HEADER)PeViewGetPointer(
+        View,
+        dos_header->e_lfanew,
+        FIELD_OFFSET(LOCAL_NT_HEADER, OptionalHeader));
+
+    if (!nt_header || nt_header->Signature != PE_NT_SIGNATURE)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    optional_offset = (UINT64)dos_header->e_lfanew +
+                      FIELD_OFFSET(LOCAL_NT_HEADER, OptionalHeader);
+    optional_size   = nt_header->FileHeader.SizeOfOptionalHeader;
+    section_offset  = optional_offset + optional_size;
+
+    View->nt_header     = nt_header;
+    View->section_count = nt_header->FileHeader.NumberOfSections;
+    View->sections      = (PIMAGE_SECTION_HEADER)PeViewGetPointer(
+        View,
+        section_offset,
+        View->section_count * sizeof(IMAGE_SECTION_HEADER));
+
+    if (!View->sections)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    /*
+     * Only trust as many data directories as both NumberOfRvaAndSizes and
+     * SizeOfOptionalHeader allow for.
+     */
+    if (optional_size < sizeof(UINT16))
+        return STATUS_SUCCESS;
+
+    optional_32 = (PIMAGE_OPTIONAL_HEADER32)&nt_header->OptionalHeader;
+    optional_64 = (PIMAGE_OPTIONAL_HEADER64)&nt_header->OptionalHeader;
+
+    if (optional_32->Magic == PE_OPTIONAL_HEADER64_MAGIC)
+        directory_offset =
+            FIELD_OFFSET(IMAGE_OPTIONAL_HEADER64, DataDirectory);
+    else if (optional_32->Magic == PE_OPTIONAL_HEADER32_MAGIC)
+        directory_offset =
+            FIELD_OFFSET(IMAGE_OPTIONAL_HEADER32, DataDirectory);
+    else
+        return STATUS_SUCCESS;
+
+    /*
+     * NumberOfRvaAndSizes sits just ahead of the directories, so it is only
+     * read once the optional header is known to extend that far.
+     */
+    if (optional_size < directory_offset ||
+        !PeViewGetPointer(View, optional_offset, directory_offset))
+        return STATUS_SUCCESS;
+
+    if (optional_32->Magic == PE_OPTIONAL_HEADER64_MAGIC) {
+        View->data_directory = optional_64->DataDirectory;
+        directory_count      = optional_64->NumberOfRvaAndSizes;
+    }
+    else {
+        View->data_directory = optional_32->DataDirectory;
+        directory_count      = optional_32->NumberOfRvaAndSizes;
+    }
+
+    if (directory_count > (optional_size - directory_offset) /
+                              sizeof(IMAGE_DATA_DIRECTORY))
+        directory_count =
+            (optional_size - directory_offset) / sizeof(IMAGE_DATA_DIRECTORY);
+
+    if (directory_count > IMAGE_NUMBEROF_DIRECTORY_ENTRIES)
+        directory_count = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+
+    View->data_directory_count = directory_count;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Returns a pointer to Length bytes at Offset from the base of the image, or
+ * NULL if any part of the range lies outside of it. Offsets are 64 bit so the
+ * sum of two 32 bit header fields can never wrap.
+ */
+PVOID
+PeViewGetPointer(_In_ PPE_VIEW View, _In_ UINT64 Offset, _In_ UINT64 Length)
+{
+    if (Offset > View->size || Length > View->size - Offset)
+        return NULL;
+
+    return (PVOID)(View->base + Offset);
+}
+
+PIMAGE_DATA_DIRECTORY
+PeViewGetDataDirectory(_In_ PPE_VIEW View, _In_ UINT32 Index)
+{
+    if (Index >= View->data_directory_count)
+        return NULL;
+
+    return &View->data_directory[Index];
+}
+
+/* returns NULL unless the string is terminated within the image */
+LPCSTR
+PeViewGetString(_In_ PPE_VIEW View, _In_ UINT64 Offset)
+{
+    PCHAR string = (PCHAR)PeViewGetPointer(View, Offset, 1);
+
+    if (!string)
+        return NULL;
+
+    if (!memchr(string, 0, View->size - Offset))
+        return NULL;
+
+    return string;
+}
+
+/*
+ * Walks the export name table of the image mapped at ImageBase and returns
+ * the address of the export matching ExportName.
+ */
+PVOID
+PeFindExportByName(_In_ PVOID  ImageBase,
+                   _In_ SIZE_T ImageSize,
+                   _In_ LPCSTR ExportName)
+{
+    NTSTATUS                status            = STATUS_UNSUCCESSFUL;
+    PE_VIEW                 view              = {0};
+    PIMAGE_DATA_DIRECTORY   data_dir          = NULL;
+    PIMAGE_EXPORT_DIRECTORY export_dir        = NULL;
+    PUINT32                 export_name_table = NULL;
+    PUINT16                 ordinals_table    = NULL;
+    PUINT32                 export_addr_table = NULL;
+    LPCSTR                  name              = NULL;
+    UINT32                  ordinal           = 0;
+
+    if (!ImageBase || !ExportName)
+        return NULL;
+
+    status = PeViewInitialise(&view, ImageBase, ImageSize);
+
+    if (!NT_SUCCESS(status))
+        return NULL;
+
+    data_dir = PeViewGetDataDirectory(&view, IMAGE_DIRECTORY_ENTRY_EXPORT);
+
+    if (!data_dir || !data_dir->VirtualAddress)
+        return NULL;
+
+    export_dir = (PIMAGE_EXPORT_DIRECTORY)PeViewGetPointer(
+        &view, data_dir->VirtualAddress, sizeof(IMAGE_EXPORT_DIRECTORY));
+
+    if (!export_dir)
+        return NULL;
+
+    export_name_table = (PUINT32)PeViewGetPointer(
+        &view,
+        export_dir->AddressOfNames,
+        (UINT64)export_dir->NumberOfNames * sizeof(UINT32));
+    ordinals_table = (PUINT16)PeViewGetPointer(
+        &view,
+        export_dir->AddressOfNameOrdinals,
+        (UINT64)export_dir->NumberOfNames * sizeof(UINT16));
+    export_addr_table = (PUINT32)PeViewGetPointer(
+        &view,
+        export_dir->AddressOfFunctions,
+        (UINT64)export_dir->NumberOfFunctions * sizeof(UINT32));
+
+    if (!export_name_table || !ordinals_table || !export_addr_table)
+        return NULL;
+
+    for (UINT32 index = 0; index < export_dir->NumberOfNames; index++) {
+        name = PeViewGetString(&view, export_name_table[index]);
+
+        if (!name || strcmp(name, ExportName))
+            continue;
+
+        ordinal = ordinals_table[index];
+
+        if (ordinal >= export_dir->NumberOfFunctions)
+            return NULL;
+
+        return PeViewGetPointer(&view, export_addr_table[ordinal], 1);
+    }
+
+    return NULL;
+}
+
+/*
+ * Copies every executable section of the image into Buffer, each one stored
+ * as its IMAGE_SECTION_HEADER immediately followed by the sections raw data.
+ * This is the layout the integrity checks hash and compare, so both the disk
+ * and memory images must be passed through this routine.
+ */
+NTSTATUS
+PeCopyExecutableSections(_In_ PVOID    ImageBase,
+                         _In_ SIZE_T   ImageSize,
+                         _Out_ PVOID   Buffer,
+                         _In_ SIZE_T   BufferSize,
+                         _Out_ PUINT32 SectionCount,
+                         _Out_ PSIZE_T BytesWritten)
+{
+    NTSTATUS              status       = STATUS_SUCCESS;
+    PE_VIEW               view         = {0};
+    PIMAGE_SECTION_HEADER section      = NULL;
+    PVOID                 section_data = NULL;
+    SIZE_T                total_size   = 0;
+    SIZE_T                section_size = 0;
+    UINT64                buffer_base  = (UINT64)Buffer;
+
+    *SectionCount = 0;
+    *BytesWritten = 0;
+
+    if (!ImageBase || !Buffer)
+        return STATUS_INVALID_PARAMETER;
+
+    status = PeViewInitialise(&view, ImageBase, ImageSize);
+
+    if (!NT_SUCCESS(status))
+        return status;
+
+    section = view.sections;
+
+    for (UINT32 index = 0; index < view.section_count; index++, section++) {
+        if (!(section->Characteristics & IMAGE_SCN_MEM_EXECUTE))
+            continue;
+
+        section_data = PeViewGetPointer(
+            &view, section->PointerToRawData, section->SizeOfRawData);
+
+        if (!section_data)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        section_size = sizeof(IMAGE_SECTION_HEADER) + section->SizeOfRawData;
+
+        if (section_size > BufferSize - total_size)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        status = PlatformCopyMemory((PVOID)(buffer_base + total_size),
+                                    section,
+                                    sizeof(IMAGE_SECTION_HEADER));
+
+        if (!NT_SUCCESS(status))
+            return status;
+
+        status = PlatformCopyMemory(
+            (PVOID)(buffer_base + total_size + sizeof(IMAGE_SECTION_HEADER)),
+            section_data,
+            section->SizeOfRawData);
+
+        if (!NT_SUCCESS(status))
+            return status;
+
+        total_size += section_size;
+        *SectionCount += 1;
+    }
+
+    *BytesWritten = total_size;
+    return status;
+}
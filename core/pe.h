@@ -0,0 +1,254 @@
+#ifndef PE_H
+#define PE_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * PE structures shared between the driver and the host build. The kernel
+ * headers dont provide these, and on the host unsigned long is 64 bits, so
+ * they are declared with explicit widths. User mode windows gets the real
+ * ones from winnt.h.
+ */
+#if !defined(PLATFORM_WINDOWS)
+
+#    define IMAGE_DIRECTORY_ENTRY_EXPORT         0
+#    define IMAGE_DIRECTORY_ENTRY_IMPORT         1
+#    define IMAGE_DIRECTORY_ENTRY_RESOURCE       2
+#    define IMAGE_DIRECTORY_ENTRY_EXCEPTION      3
+#    define IMAGE_DIRECTORY_ENTRY_SECURITY       4
+#    define IMAGE_DIRECTORY_ENTRY_BASERELOC      5
+#    define IMAGE_DIRECTORY_ENTRY_DEBUG          6
+#    define IMAGE_DIRECTORY_ENTRY_COPYRIGHT      7
+#    define IMAGE_DIRECTORY_ENTRY_GLOBALPTR      8 /* (MIPS GP) */
+#    define IMAGE_DIRECTORY_ENTRY_TLS            9
+#    define IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG    10
+#    define IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT   11
+#    define IMAGE_DIRECTORY_ENTRY_IAT            12 /* Import Address Table */
+#    define IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT   13
+#    define IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR 14
+
+#    define IMAGE_SCN_MEM_EXECUTE 0x20000000
+#    define IMAGE_SCN_MEM_READ    0x40000000
+#    define IMAGE_SCN_MEM_WRITE   0x80000000
+
+#    define IMAGE_SIZEOF_SHORT_NAME 8
+
+typedef struct _IMAGE_SECTION_HEADER {
+    UCHAR Name[IMAGE_SIZEOF_SHORT_NAME];
+    union {
+        UINT32 PhysicalAddress;
+        UINT32 VirtualSize;
+    } Misc;
+    UINT32 VirtualAddress;
+    UINT32 SizeOfRawData;
+    UINT32 PointerToRawData;
+    UINT32 PointerToRelocations;
+    UINT32 PointerToLinenumbers;
+    UINT16 NumberOfRelocations;
+    UINT16 NumberOfLinenumbers;
+    UINT32 Characteristics;
+} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+typedef struct _IMAGE_FILE_HEADER {
+    UINT16 Machine;
+    UINT16 NumberOfSections;
+    UINT32 TimeDateStamp;
+    UINT32 PointerToSymbolTable;
+    UINT32 NumberOfSymbols;
+    UINT16 SizeOfOptionalHeader;
+    UINT16 Characteristics;
+} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY {
+    UINT32 VirtualAddress;
+    UINT32 Size;
+} IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
+
+#    define IMAGE_NUMBEROF_DIRECTORY_ENTRIES 16
+
+typedef struct _IMAGE_OPTIONAL_HEADER64 {
+    UINT16               Magic;
+    UCHAR                MajorLinkerVersion;
+    UCHAR                MinorLinkerVersion;
+    UINT32               SizeOfCode;
+    UINT32               SizeOfInitializedData;
+    UINT32               SizeOfUninitializedData;
+    UINT32               AddressOfEntryPoint;
+    UINT32               BaseOfCode;
+    UINT64               ImageBase;
+    UINT32               SectionAlignment;
+    UINT32               FileAlignment;
+    UINT16               MajorOperatingSystemVersion;
+    UINT16               MinorOperatingSystemVersion;
+    UINT16               MajorImageVersion;
+    UINT16               MinorImageVersion;
+    UINT16               MajorSubsystemVersion;
+    UINT16               MinorSubsystemVersion;
+    UINT32               Win32VersionValue;
+    UINT32               SizeOfImage;
+    UINT32               SizeOfHeaders;
+    UINT32               CheckSum;
+    UINT16               Subsystem;
+    UINT16               DllCharacteristics;
+    UINT64               SizeOfStackReserve;
+    UINT64               SizeOfStackCommit;
+    UINT64               SizeOfHeapReserve;
+    UINT64               SizeOfHeapCommit;
+    UINT32               LoaderFlags;
+    UINT32               NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_OPTIONAL_HEADER32 {
+    UINT16               Magic;
+    UCHAR                MajorLinkerVersion;
+    UCHAR                MinorLinkerVersion;
+    UINT32               SizeOfCode;
+    UINT32               SizeOfInitializedData;
+    UINT32               SizeOfUninitializedData;
+    UINT32               AddressOfEntryPoint;
+    UINT32               BaseOfCode;
+    UINT32               BaseOfData;
+    UINT32               ImageBase;
+    UINT32               SectionAlignment;
+    UINT32               FileAlignment;
+    UINT16               MajorOperatingSystemVersion;
+    UINT16               MinorOperatingSystemVersion;
+    UINT16               MajorImageVersion;
+    UINT16               MinorImageVersion;
+    UINT16               MajorSubsystemVersion;
+    UINT16               MinorSubsystemVersion;
+    UINT32               Win32VersionValue;
+    UINT32               SizeOfImage;
+    UINT32               SizeOfHeaders;
+    UINT32               CheckSum;
+    UINT16               Subsystem;
+    UINT16               DllCharacteristics;
+    UINT32               SizeOfStackReserve;
+    UINT32               SizeOfStackCommit;
+    UINT32               SizeOfHeapReserve;
+    UINT32               SizeOfHeapCommit;
+    UINT32               LoaderFlags;
+    UINT32               NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
+
+typedef struct _IMAGE_DOS_HEADER { // DOS .EXE header
+    UINT16 e_magic;                // Magic number
+    UINT16 e_cblp;                 // Bytes on last page of file
+    UINT16 e_cp;                   // Pages in file
+    UINT16 e_crlc;                 // Relocations
+    UINT16 e_cparhdr;              // Size of header in paragraphs
+    UINT16 e_minalloc;             // Minimum extra paragraphs needed
+    UINT16 e_maxalloc;             // Maximum extra paragraphs needed
+    UINT16 e_ss;                   // Initial (relative) SS value
+    UINT16 e_sp;                   // Initial SP value
+    UINT16 e_csum;                 // Checksum
+    UINT16 e_ip;                   // Initial IP value
+    UINT16 e_cs;                   // Initial (relative) CS value
+    UINT16 e_lfarlc;               // File address of relocation table
+    UINT16 e_ovno;                 // Overlay number
+    UINT16 e_res[4];               // Reserved words
+    UINT16 e_oemid;                // OEM identifier (for e_oeminfo)
+    UINT16 e_oeminfo;              // OEM information; e_oemid specific
+    UINT16 e_res2[10];             // Reserved words
+    LONG   e_lfanew;               // File address of new exe header
+} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+
+typedef struct _IMAGE_EXPORT_DIRECTORY {
+    UINT32 Characteristics;
+    UINT32 TimeDateStamp;
+    UINT16 MajorVersion;
+    UINT16 MinorVersion;
+    UINT32 Name;
+    UINT32 Base;
+    UINT32 NumberOfFunctions;
+    UINT32 NumberOfNames;
+    UINT32 AddressOfFunctions;
+    UINT32 AddressOfNames;
+    UINT32 AddressOfNameOrdinals;
+} IMAGE_EXPORT_DIRECTORY, *PIMAGE_EXPORT_DIRECTORY;
+
+#endif
+
+typedef struct _LOCAL_NT_HEADER {
+    UINT32                  Signature;
+    IMAGE_FILE_HEADER       FileHeader;
+    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
+} LOCAL_NT_HEADER, *PLOCAL_NT_HEADER;
+
+#if !defined(PLATFORM_WINDOWS)
+#    define IMAGE_FIRST_SECTION(ntheader)                                        \
+        ((PIMAGE_SECTION_HEADER)((ULONG_PTR)(ntheader) +                         \
+                                 FIELD_OFFSET(LOCAL_NT_HEADER, OptionalHeader) + \
+                                 ((ntheader))->FileHeader.SizeOfOptionalHeader))
+#endif
+
+#define PE_DOS_SIGNATURE           0x5a4d     /* MZ */
+#define PE_NT_SIGNATURE            0x00004550 /* PE00 */
+#define PE_OPTIONAL_HEADER32_MAGIC 0x10b
+#define PE_OPTIONAL_HEADER64_MAGIC 0x20b
+
+/*
+ * A bounds checked view of a PE image. Images handed to the parsing routines
+ * come from modules and files an attacker controls, so every offset read from
+ * the headers is checked against the size of the image before use. The view
+ * never copies, it only points into the image.
+ */
+typedef struct _PE_VIEW {
+    UINT64                base;
+    SIZE_T                size;
+    PLOCAL_NT_HEADER      nt_header;
+    PIMAGE_SECTION_HEADER sections;
+    UINT32                section_count;
+    PIMAGE_DATA_DIRECTORY data_directory;
+    UINT32                data_directory_count;
+
+} PE_VIEW, *PPE_VIEW;
+
+/*
+ * These two trust the image and are only meant for images built locally,
+ * anything else should go through a PE_VIEW.
+ */
+PLOCAL_NT_HEADER
+PeGetNtHeader(_In_ PVOID ImageBase);
+
+PIMAGE_SECTION_HEADER
+PeGetFirstSection(_In_ PLOCAL_NT_HEADER NtHeader);
+
+NTSTATUS
+PeViewInitialise(_Out_ PPE_VIEW View,
+                 _In_ PVOID     ImageBase,
+                 _In_ SIZE_T    ImageSize);
+
+PVOID
+PeViewGetPointer(_In_ PPE_VIEW View, _In_ UINT64 Offset, _In_ UINT64 Length);
+
+PIMAGE_DATA_DIRECTORY
+PeViewGetDataDirectory(_In_ PPE_VIEW View, _In_ UINT32 Index);
+
+LPCSTR
+PeViewGetString(_In_ PPE_VIEW View, _In_ UINT64 Offset);
+
+PVOID
+PeFindExportByName(_In_ PVOID  ImageBase,
+                   _In_ SIZE_T ImageSize,
+                   _In_ LPCSTR ExportName);
+
+NTSTATUS
+PeCopyExecutableSections(_In_ PVOID    ImageBase,
+                         _In_ SIZE_T   ImageSize,
+                         _Out_ PVOID   Buffer,
+                         _In_ SIZE_T   BufferSize,
+                         _Out_ PUINT32 SectionCount,
+                         _Out_ PSIZE_T BytesWritten);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#include "platform.h"
+
+/*
+ * User mode and host implementation of the platform routines. The driver
+ * provides its own in driver/platform.c, so this file is excluded from the
+ * kernel build.
+ */
+
+#include <stdlib.h>
+
+PVOID
+PlatformAllocatePool(_In_ SIZE_T Size, _In_ ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    /* ExAllocatePool2 zeroes the allocation, so mirror that here. */
+    return calloc(1, Size);
+}
+
+VOID
+PlatformFreePool(_In_ PVOID Buffer, _In_ ULONG Tag)
+{
+    UNREFERENCED_PARAMETER(Tag);
+    free(Buffer);
+}
+
+NTSTATUS
+PlatformCopyMemory(_Out_ PVOID Destination,
+                   _In_ PVOID  Source,
+                   _In_ SIZE_T Length)
+{
+    if (!Destination || !Source)
+        return STATUS_INVALID_ADDRESS;
+
+    RtlCopyMemory(Destination, Source, Length);
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+/*
+ * Thin platform layer for the ac_core library. The core sources are written
+ * against the same NT style types and status codes as the driver so that they
+ * can be dropped straight into the kernel build, while the host build (linux,
+ * gcc/clang) gets an equivalent set of fixed width definitions here.
+ *
+ * Anything the core needs from its environment (pool memory, safe copies) is
+ * routed through the Platform* routines declared at the bottom of this file.
+ * The driver implements these on top of its Imp* wrappers, everything else
+ * uses core/platform.c.
+ */
+
+#if defined(_KERNEL_MODE)
+#    define PLATFORM_KERNEL 1
+#    include <ntifs.h>
+#elif defined(_WIN32)
+#    define PLATFORM_WINDOWS 1
+#    include <Windows.h>
+#    include <string.h>
+#else
+#    define PLATFORM_HOST 1
+#    include <stddef.h>
+#    include <stdint.h>
+#    include <string.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(PLATFORM_HOST)
+
+/*
+ * LONG, ULONG and DWORD are 32 bits on windows regardless of the data model,
+ * so we cant simply use long here. Every structure shared with the driver
+ * relies on these widths being correct.
+ */
+#    define VOID void
+
+typedef void*              PVOID;
+typedef char               CHAR;
+typedef unsigned char      UCHAR;
+typedef unsigned char      BYTE;
+typedef short              SHORT;
+typedef unsigned short     USHORT;
+typedef unsigned short     WORD;
+typedef int                INT;
+typedef unsigned int       UINT;
+typedef int32_t            LONG;
+typedef uint32_t           ULONG;
+typedef uint32_t           DWORD;
+typedef int64_t            LONGLONG;
+typedef uint64_t           ULONGLONG;
+typedef int64_t            LONG64;
+typedef uint64_t           ULONG64;
+typedef int8_t             INT8;
+typedef int16_t            INT16;
+typedef int32_t            INT32;
+typedef int64_t            INT64;
+typedef uint8_t            UINT8;
+typedef uint16_t           UINT16;
+typedef uint32_t           UINT32;
+typedef uint64_t           UINT64;
+typedef uintptr_t          ULONG_PTR;
+typedef intptr_t           LONG_PTR;
+typedef size_t             SIZE_T;
+typedef UCHAR              BOOLEAN;
+typedef uint16_t           WCHAR;
+typedef LONG               NTSTATUS;
+typedef CHAR*              PCHAR;
+typedef UCHAR*             PUCHAR;
+typedef BYTE*              PBYTE;
+typedef USHORT*            PUSHORT;
+typedef INT*               PINT;
+typedef LONG*              PLONG;
+typedef ULONG*             PULONG;
+typedef UINT8*             PUINT8;
+typedef UINT16*            PUINT16;
+typedef UINT32*            PUINT32;
+typedef UINT64*            PUINT64;
+typedef INT64*             PINT64;
+typedef SIZE_T*            PSIZE_T;
+typedef BOOLEAN*           PBOOLEAN;
+typedef WCHAR*             PWCHAR;
+typedef WCHAR*             PWCH;
+typedef const CHAR*        LPCSTR;
+typedef const CHAR*        PCSTR;
+typedef const CHAR*        PCZPSTR;
+typedef CHAR*              LPSTR;
+typedef const WCHAR*       PCWSTR;
+
+typedef struct _LIST_ENTRY {
+    struct _LIST_ENTRY* Flink;
+    struct _LIST_ENTRY* Blink;
+
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _SINGLE_LIST_ENTRY {
+    struct _SINGLE_LIST_ENTRY* Next;
+
+} SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+#    define TRUE  1
+#    define FALSE 0
+
+#    define MAXUINT32 ((UINT32)~((UINT32)0))
+#    define MAXUINT64 ((UINT64)~((UINT64)0))
+
+#    define FIELD_OFFSET(type, field) offsetof(type, field)
+#    define CONTAINING_RECORD(address, type, field) \
+        ((type*)((PCHAR)(address) - FIELD_OFFSET(type, field)))
+
+#    define UNREFERENCED_PARAMETER(P) ((void)(P))
+
+#    define RtlCopyMemory(Destination, Source, Length) \
+        memcpy((Destination), (Source), (Length))
+#    define RtlZeroMemory(Destination, Length) \
+        memset((Destination), 0, (Length))
+
+/* SAL is meaningless outside of msvc */
+#    define _In_
+#    define _In_opt_
+#    define _In_z_
+#    define _Out_
+#    define _Out_opt_
+#    define _Inout_
+#    define _Inout_opt_
+#    define _Outptr_
+#    define _Outptr_result_maybenull_
+
+#endif
+
+#if defined(PLATFORM_WINDOWS)
+#    ifndef _NTDEF_
+typedef LONG NTSTATUS;
+#    endif
+typedef const CHAR* PCZPSTR;
+#endif
+
+#ifndef NT_SUCCESS
+#    define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#endif
+
+/*
+ * Only the status codes actually returned by the core. Some of these are
+ * already defined by winnt.h in user mode so each one is guarded.
+ */
+#ifndef STATUS_SUCCESS
+#    define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+#endif
+#ifndef STATUS_UNSUCCESSFUL
+#    define STATUS_UNSUCCESSFUL ((NTSTATUS)0xC0000001L)
+#endif
+#ifndef STATUS_INVALID_PARAMETER
+#    define STATUS_INVALID_PARAMETER ((NTSTATUS)0xC000000DL)
+#endif
+#ifndef STATUS_NOT_FOUND
+#    define STATUS_NOT_FOUND ((NTSTATUS)0xC0000225L)
+#endif
+#ifndef STATUS_BUFFER_TOO_SMALL
+#    define STATUS_BUFFER_TOO_SMALL ((NTSTATUS)0xC0000023L)
+#endif
+#ifndef STATUS_INVALID_IMAGE_FORMAT
+#    define STATUS_INVALID_IMAGE_FORMAT ((NTSTATUS)0xC000007BL)
+#endif
+#ifndef STATUS_INVALID_ADDRESS
+#    define STATUS_INVALID_ADDRESS ((NTSTATUS)0xC0000141L)
+#endif
+#ifndef STATUS_MEMORY_NOT_ALLOCATED
+#    define STATUS_MEMORY_NOT_ALLOCATED ((NTSTATUS)0xC00000A0L)
+#endif
+#ifndef STATUS_DATA_ERROR
+#    define STATUS_DATA_ERROR ((NTSTATUS)0xC000003EL)
+#endif
+
+#ifndef STATIC
+#    define STATIC static
+#endif
+
+#ifndef INLINE
+#    define INLINE inline
+#endif
+
+PVOID
+PlatformAllocatePool(_In_ SIZE_T Size, _In_ ULONG Tag);
+
+VOID
+PlatformFreePool(_In_ PVOID Buffer, _In_ ULONG Tag);
+
+/*
+ * Copies Length bytes from Source, failing rather then faulting if the source
+ * range is not valid. In the kernel this is MmCopyMemory, on the host a plain
+ * memcpy since we only ever read our own buffers.
+ */
+NTSTATUS
+PlatformCopyMemory(_Out_ PVOID Destination,
+                   _In_ PVOID  Source,
+                   _In_ SIZE_T Length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
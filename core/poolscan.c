@@ -0,0 +1,188 @@
+#include "poolscan.h"
+
+#include "signature.h"
+
+#define PROCESS_HEADER_SIZE_LIMIT 0xb0
+#define PROCESS_HEADER_SIZE_STEP  0x10
+
+#define HIGHEST_USER_ADDRESS  0x00007ffffffeffffull
+#define LOWEST_KERNEL_ADDRESS 0xffff800000000000ull
+
+STATIC
+CHAR EXECUTIVE_OBJECT_POOL_TAGS[EXECUTIVE_OBJECT_COUNT][POOL_TAG_LENGTH] = {
+    "\x50\x72\x6f\x63", /* Process */
+    "\x54\x68\x72\x64", /* Thread */
+    "\x44\x65\x73\x6B", /* Desktop */
+    "\x57\x69\x6E\x64", /* Windows Station */
+    "\x4D\x75\x74\x65", /* Mutants i.e mutex etc. */
+    "\x46\x69\x6C\x65", /* File objects */
+    "\x44\x72\x69\x76", /* Drivers */
+    "\x4C\x69\x6E\x6B"  /* Symbolic links */
+};
+
+LPCSTR
+GetExecutiveObjectPoolTag(_In_ ULONG ObjectIndex)
+{
+    if (ObjectIndex >= EXECUTIVE_OBJECT_COUNT)
+        return NULL;
+
+    return EXECUTIVE_OBJECT_POOL_TAGS[ObjectIndex];
+}
+
+/*
+ * Here we define a signature that can be used to find EPROCESS structures
+ * consistently across major windows versions. The fields we test have proven
+ * to be consistent in the following study:
+ *
+ * https://www.cise.ufl.edu/~traynor/papers/ccs09b.pdf
+ *
+ * The paper targets 32 bit windows, so the address checks have been adjusted
+ * for the 64 bit address space. The following signature is used:
+ *
+ * PeakVirtualSize must be greater then 0 for any valid process:
+ *	-> EPROCESS->PeakVirtualSize > 0
+ *
+ * The DirectoryTableBase must be 0x20 aligned:
+ *	-> EPROCESS->DirectoryTableBase % 0x20 == 0
+ *
+ * The pool allocation size must be greater then the size of an EPROCESS
+ * allocation and less then the size of a page:
+ *	-> AllocationSize = POOL_HEADER->BlockSize * CHUNK_SIZE - sizeof(POOL_HEADER)
+ *	-> AllocationSize > sizeof(EPROCESS)
+ *	-> AllocationSize & 0xfff0 != 0xfff0
+ *
+ * Pool type must be non-null:
+ *	-> POOL_HEADER->PoolType != NULL
+ *
+ * The process PEB must either be null (system processes) or a page aligned
+ * user mode address:
+ *	-> EPROCESS->Peb <= MM_HIGHEST_USER_ADDRESS && EPROCESS->Peb % 0x1000 == 0
+ *
+ * The object table must be an 0x8 aligned kernel address:
+ *	-> EPROCESS->ObjectTable >= 0xffff800000000000 && ObjectTable % 0x8 == 0
+ *
+ * The caller must guarantee the whole candidate lies within a resident page.
+ */
+BOOLEAN
+ValidateIfAddressIsProcessStructure(_In_ PVOID        Address,
+                                    _In_ PPOOL_HEADER PoolHeader)
+{
+    UINT64 peak_virtual_size = 0;
+    UINT64 dir_table_base    = 0;
+    UINT64 allocation_size   = 0;
+    UINT64 peb               = 0;
+    UINT64 object_table      = 0;
+
+    dir_table_base =
+        *(PUINT64)((UINT64)Address + KPROCESS_DIRECTORY_TABLE_BASE_OFFSET);
+    peak_virtual_size =
+        *(PUINT64)((UINT64)Address + EPROCESS_PEAK_VIRTUAL_SIZE_OFFSET);
+    peb          = *(PUINT64)((UINT64)Address + EPROCESS_PEB_OFFSET);
+    object_table = *(PUINT64)((UINT64)Address + EPROCESS_OBJECT_TABLE_OFFSET);
+    allocation_size =
+        PoolHeader->BlockSize * POOL_BLOCK_CHUNK_SIZE - sizeof(POOL_HEADER);
+
+    if (peak_virtual_size == 0)
+        return FALSE;
+
+    if (dir_table_base == 0 || dir_table_base % 0x20 != 0)
+        return FALSE;
+
+    if (allocation_size <=
+            EPROCESS_SIZE + OBJECT_HEADER_SIZE + sizeof(POOL_HEADER) ||
+        (allocation_size & 0xfff0) == 0xfff0)
+        return FALSE;
+
+    if (PoolHeader->PoolType == 0)
+        return FALSE;
+
+    if (peb > HIGHEST_USER_ADDRESS || peb % 0x1000 != 0)
+        return FALSE;
+
+    if (object_table < LOWEST_KERNEL_ADDRESS || object_table % 0x8 != 0)
+        return FALSE;
+
+    return TRUE;
+}
+
+/*
+ * Every executive allocation is required to have an _OBJECT_HEADER, so once a
+ * tag is matched we start iterating from the size of the object header, then
+ * jump up in blocks of 0x10 since every optional header is divisible by 0x10.
+ * We iterate up to 0xb0 which is equal to the following:
+ *
+ * 0xb0 = sizeof(ALL_HEADER_OBJECTS) + 0x10
+ *
+ * where the 0x10 is 16 bytes of padding.
+ */
+STATIC
+PVOID
+FindProcessAfterPoolHeader(_In_ PPOOL_HEADER PoolHeader)
+{
+    PVOID process = NULL;
+
+    for (ULONG header_size = OBJECT_HEADER_SIZE;
+         header_size < PROCESS_HEADER_SIZE_LIMIT;
+         header_size += PROCESS_HEADER_SIZE_STEP) {
+        process = (PVOID)((UINT64)PoolHeader + sizeof(POOL_HEADER) +
+                          header_size);
+
+        if (ValidateIfAddressIsProcessStructure(process, PoolHeader))
+            return process;
+    }
+
+    return NULL;
+}
+
+/*
+ * Searches a single resident page for pool allocations carrying the tag of
+ * the given executive object and records every one that passes the process
+ * signature. Small pool allocations never cross a page boundary, so only tags
+ * early enough in the page to be followed by an entire EPROCESS are checked,
+ * which also keeps every read made by the signature inside the page.
+ */
+VOID
+ScanPageForKernelObjectAllocation(_In_ UINT64                   PageBase,
+                                  _In_ ULONG                    PageSize,
+                                  _In_ ULONG                    ObjectIndex,
+                                  _Inout_ PPROCESS_SCAN_CONTEXT Context)
+{
+    UINT64       cursor       = 0;
+    UINT64       end          = 0;
+    PCHAR        match        = NULL;
+    PPOOL_HEADER pool_header  = NULL;
+    PVOID        process      = NULL;
+    PUINT64      address_list = (PUINT64)Context->process_buffer;
+    LPCSTR       tag          = GetExecutiveObjectPoolTag(ObjectIndex);
+    ULONG        minimum_process_allocation_size =
+        EPROCESS_SIZE - sizeof(POOL_HEADER) - OBJECT_HEADER_SIZE;
+
+    if (!PageBase || !tag ||
+        PageSize < minimum_process_allocation_size + POOL_TAG_LENGTH)
+        return;
+
+    cursor = PageBase + POOL_HEADER_TAG_OFFSET;
+    end    = PageBase + PageSize - minimum_process_allocation_size;
+
+    while (cursor < end) {
+        match = ScanForPoolTag((PVOID)cursor, end - cursor, tag);
+
+        if (!match)
+            return;
+
+        cursor      = (UINT64)match + 1;
+        pool_header = (PPOOL_HEADER)((UINT64)match - POOL_HEADER_TAG_OFFSET);
+        process     = FindProcessAfterPoolHeader(pool_header);
+
+        if (!process)
+            continue;
+
+        if (Context->found >= Context->process_count) {
+            Context->dropped++;
+            continue;
+        }
+
+        address_list[Context->found] = (UINT64)process;
+        Context->found++;
+    }
+}
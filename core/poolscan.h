@@ -0,0 +1,94 @@
+#ifndef POOLSCAN_H
+#define POOLSCAN_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EPROCESS_PEAK_VIRTUAL_SIZE_OFFSET 0x490
+#define EPROCESS_OBJECT_TABLE_OFFSET      0x570
+#define EPROCESS_PEB_OFFSET               0x550
+#define EPROCESS_SIZE                     0xa40
+
+#define KPROCESS_DIRECTORY_TABLE_BASE_OFFSET 0x028
+
+#define OBJECT_HEADER_SIZE 0x30
+
+#define POOL_HEADER_BLOCK_SIZE_OFFSET 0x02
+#define POOL_HEADER_TAG_OFFSET        0x04
+
+#define POOL_TAG_LENGTH        4
+#define POOL_BLOCK_CHUNK_SIZE  16
+#define EXECUTIVE_OBJECT_COUNT 8
+
+#define INDEX_PROCESS_POOL_TAG         0
+#define INDEX_THREAD_POOL_TAG          1
+#define INDEX_DESKTOP_POOL_TAG         2
+#define INDEX_WINDOW_STATIONS_POOL_TAG 3
+#define INDEX_MUTANTS_POOL_TAG         4
+#define INDEX_FILE_OBJECTS_POOL_TAG    5
+#define INDEX_DRIVERS_POOL_TAG         6
+#define INDEX_SYMBOLIC_LINKS_POOL_TAG  7
+
+#if defined(_MSC_VER)
+#    pragma warning(push)
+#    pragma warning(disable : 4201 4214)
+#endif
+
+#pragma pack(push, 1)
+typedef struct _POOL_HEADER {
+    union {
+        struct {
+            ULONG PreviousSize : 8;
+            ULONG PoolIndex : 8;
+            ULONG BlockSize : 8;
+            ULONG PoolType : 8;
+        };
+        ULONG Ulong1;
+    };
+    ULONG PoolTag;
+    union {
+        PVOID ProcessBilled;
+        struct {
+            USHORT AllocatorBackTraceIndex;
+            USHORT PoolTagHash;
+        };
+    };
+} POOL_HEADER, *PPOOL_HEADER;
+#pragma pack(pop)
+
+#if defined(_MSC_VER)
+#    pragma warning(pop)
+#endif
+
+typedef struct _PROCESS_SCAN_CONTEXT {
+    /* capacity of process_buffer, in entries */
+    ULONG process_count;
+    PVOID process_buffer;
+
+    /* number of entries written and matches that didnt fit */
+    ULONG found;
+    ULONG dropped;
+
+} PROCESS_SCAN_CONTEXT, *PPROCESS_SCAN_CONTEXT;
+
+LPCSTR
+GetExecutiveObjectPoolTag(_In_ ULONG ObjectIndex);
+
+BOOLEAN
+ValidateIfAddressIsProcessStructure(_In_ PVOID        Address,
+                                    _In_ PPOOL_HEADER PoolHeader);
+
+VOID
+ScanPageForKernelObjectAllocation(_In_ UINT64                   PageBase,
+                                  _In_ ULONG                    PageSize,
+                                  _In_ ULONG                    ObjectIndex,
+                                  _Inout_ PPROCESS_SCAN_CONTEXT Context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#include "recording.h"
+
+/*
+ * Both encoders return the number of bytes written to Buffer, or 0 if it is
+ * too small to hold the block.
+ */
+SIZE_T
+RecordingEncodeSession(_Out_ PVOID Buffer,
+                       _In_ SIZE_T BufferSize,
+                       _In_ UINT64 WallClock)
+{
+    RECORDING_BLOCK   block   = {0};
+    RECORDING_SESSION session = {0};
+
+    if (!Buffer || BufferSize < sizeof(block) + sizeof(session))
+        return 0;
+
+    block.type        = RECORDING_BLOCK_SESSION;
+    block.stored_size = sizeof(session);
+    block.size        = sizeof(session);
+    block.timestamp   = WallClock;
+
+    session.magic   = RECORDING_MAGIC;
+    session.version = RECORDING_VERSION;
+
+    RtlCopyMemory(Buffer, &block, sizeof(block));
+    RtlCopyMemory((PVOID)((UINT64)Buffer + sizeof(block)),
+                  &session,
+                  sizeof(session));
+
+    return sizeof(block) + sizeof(session);
+}
+
+SIZE_T
+RecordingEncodeReport(_Out_ PVOID Buffer,
+                      _In_ SIZE_T BufferSize,
+                      _In_ UINT64 Timestamp,
+                      _In_ PVOID  Report,
+                      _In_ UINT32 ReportSize)
+{
+    RECORDING_BLOCK block       = {0};
+    UINT32          stored_size = ReportSize;
+    PUCHAR          report      = (PUCHAR)Report;
+
+    if (!Buffer || !Report || ReportSize > RECORDING_MAX_REPORT_SIZE)
+        return 0;
+
+    while (stored_size > 0 && report[stored_size - 1] == 0)
+        stored_size--;
+
+    if (BufferSize < sizeof(block) + stored_size)
+        return 0;
+
+    block.type        = RECORDING_BLOCK_REPORT;
+    block.stored_size = (UINT16)stored_size;
+    block.size        = ReportSize;
+    block.timestamp   = Timestamp;
+
+    RtlCopyMemory(Buffer, &block, sizeof(block));
+    RtlCopyMemory(
+        (PVOID)((UINT64)Buffer + sizeof(block)), Report, stored_size);
+
+    return sizeof(block) + stored_size;
+}
+
+/*
+ * Reads the block at the start of Buffer. STATUS_BUFFER_TOO_SMALL means the
+ * block is incomplete, which for the last block of a recording means the
+ * writer was interrupted.
+ */
+NTSTATUS
+RecordingReadBlock(_In_ PVOID             Buffer,
+                   _In_ SIZE_T            Length,
+                   _Out_ PRECORDING_BLOCK Block,
+                   _Out_ PVOID*           Payload,
+                   _Out_ PSIZE_T          Consumed)
+{
+    PRECORDING_SESSION session = NULL;
+
+    *Payload  = NULL;
+    *Consumed = 0;
+
+    if (!Buffer)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Length < sizeof(RECORDING_BLOCK))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlCopyMemory(Block, Buffer, sizeof(RECORDING_BLOCK));
+
+    if (Length - sizeof(RECORDING_BLOCK) < Block->stored_size)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    *Payload = (PVOID)((UINT64)Buffer + sizeof(RECORDING_BLOCK));
+
+    switch (Block->type) {
+    case RECORDING_BLOCK_SESSION:
+        if (Block->stored_size != sizeof(RECORDING_SESSION))
+            return STATUS_INVALID_PARAMETER;
+
+        session = (PRECORDING_SESSION)*Payload;
+
+        if (session->magic != RECORDING_MAGIC ||
+            session->version != RECORDING_VERSION)
+            return STATUS_INVALID_PARAMETER;
+
+        break;
+    case RECORDING_BLOCK_REPORT:
+        if (Block->stored_size > Block->size)
+            return STATUS_INVALID_PARAMETER;
+
+        break;
+    default: return STATUS_INVALID_PARAMETER;
+    }
+
+    *Consumed = sizeof(RECORDING_BLOCK) + Block->stored_size;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Copies a report block back into its original form, zero filling whatever
+ * the encoder trimmed.
+ */
+NTSTATUS
+RecordingExpandReport(_In_ PRECORDING_BLOCK Block,
+                      _In_ PVOID            Payload,
+                      _Out_ PVOID           Report,
+                      _In_ SIZE_T           ReportSize)
+{
+    if (Block->type != RECORDING_BLOCK_REPORT || !Report)
+        return STATUS_INVALID_PARAMETER;
+
+    if (ReportSize < Block->size)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlCopyMemory(Report, Payload, Block->stored_size);
+    RtlZeroMemory((PVOID)((UINT64)Report + Block->stored_size),
+                  Block->size - Block->stored_size);
+
+    return STATUS_SUCCESS;
+}
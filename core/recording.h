@@ -0,0 +1,82 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Report stream recordings. A recording is an append only sequence of blocks,
+ * each one a RECORDING_BLOCK followed by stored_size bytes of payload.
+ *
+ * Every time the module starts recording it appends a session block carrying
+ * the wall clock time, and the timestamp of each following report block is
+ * relative to the start of that session. Trailing zero bytes of a report are
+ * not stored since most reports are dominated by fixed size string buffers,
+ * the reader restores them from the original size.
+ *
+ * A block cut short by the process dying mid write is simply treated as the
+ * end of the recording.
+ */
+
+#define RECORDING_MAGIC   0x63657241 /* Arec */
+#define RECORDING_VERSION 1
+
+#define RECORDING_BLOCK_SESSION 1
+#define RECORDING_BLOCK_REPORT  2
+
+#define RECORDING_MAX_REPORT_SIZE 0xffff
+
+typedef struct _RECORDING_BLOCK {
+    UINT16 type;
+    UINT16 stored_size;
+
+    /* size of the report before trailing zeroes were removed */
+    UINT32 size;
+
+    /*
+     * Session blocks: wall clock time in 100ns units since 1601 (FILETIME).
+     * Report blocks: nanoseconds since the session started.
+     */
+    UINT64 timestamp;
+
+} RECORDING_BLOCK, *PRECORDING_BLOCK;
+
+typedef struct _RECORDING_SESSION {
+    UINT32 magic;
+    UINT32 version;
+
+} RECORDING_SESSION, *PRECORDING_SESSION;
+
+SIZE_T
+RecordingEncodeSession(_Out_ PVOID Buffer,
+                       _In_ SIZE_T BufferSize,
+                       _In_ UINT64 WallClock);
+
+SIZE_T
+RecordingEncodeReport(_Out_ PVOID Buffer,
+                      _In_ SIZE_T BufferSize,
+                      _In_ UINT64 Timestamp,
+                      _In_ PVOID  Report,
+                      _In_ UINT32 ReportSize);
+
+NTSTATUS
+RecordingReadBlock(_In_ PVOID             Buffer,
+                   _In_ SIZE_T            Length,
+                   _Out_ PRECORDING_BLOCK Block,
+                   _Out_ PVOID*           Payload,
+                   _Out_ PSIZE_T          Consumed);
+
+NTSTATUS
+RecordingExpandReport(_In_ PRECORDING_BLOCK Block,
+                      _In_ PVOID            Payload,
+                      _Out_ PVOID           Report,
+                      _In_ SIZE_T           ReportSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+#include "regionmap.h"
+
+VOID
+RegionMapInitialise(_Out_ PREGION_MAP   Map,
+                    _In_ PMEMORY_REGION Buffer,
+                    _In_ UINT32         Capacity)
+{
+    RtlZeroMemory(Map, sizeof(REGION_MAP));
+
+    Map->capacity = Capacity;
+    Map->buffer   = Buffer;
+    Map->regions  = Buffer;
+    Map->next     = Buffer + Capacity;
+}
+
+PMEMORY_REGION
+RegionMapGrow(_Inout_ PREGION_MAP   Map,
+              _In_ PMEMORY_REGION Buffer,
+              _In_ UINT32         Capacity)
+{
+    PMEMORY_REGION previous = Map->buffer;
+
+    RtlCopyMemory(Buffer, Map->regions, Map->count * sizeof(MEMORY_REGION));
+    RtlCopyMemory(Buffer + Capacity,
+                  Map->next,
+                  Map->next_count * sizeof(MEMORY_REGION));
+
+    Map->capacity = Capacity;
+    Map->buffer   = Buffer;
+    Map->regions  = Buffer;
+    Map->next     = Buffer + Capacity;
+
+    return previous;
+}
+
+VOID
+RegionMapReset(_Inout_ PREGION_MAP Map)
+{
+    Map->count      = 0;
+    Map->next_count = 0;
+    Map->cursor     = 0;
+    Map->end        = 0;
+    Map->dropped    = 0;
+    Map->rounds     = 0;
+    Map->recorded   = 0;
+    Map->inspected  = 0;
+}
+
+/* a round that was never ended is discarded, the last completed one is kept */
+VOID
+RegionMapBeginRound(_Inout_ PREGION_MAP Map)
+{
+    Map->next_count = 0;
+    Map->cursor     = 0;
+    Map->end        = 0;
+    Map->dropped    = 0;
+}
+
+STATIC
+BOOLEAN
+IsSameRegion(_In_ PMEMORY_REGION Left, _In_ PMEMORY_REGION Right)
+{
+    return Left->base == Right->base && Left->size == Right->size &&
+           Left->protection == Right->protection && Left->type == Right->type;
+}
+
+/*
+ * Regions have to be recorded in ascending order without overlapping, which
+ * is the order VirtualQuery returns them in. Previous regions ending before
+ * this one can't match anything recorded later, so the cursor only moves
+ * forward.
+ */
+NTSTATUS
+RegionMapRecord(_Inout_ PREGION_MAP  Map,
+                _In_ PMEMORY_REGION  Region,
+                _In_ REGION_CALLBACK Callback,
+                _Inout_opt_ PVOID    Context)
+{
+    PMEMORY_REGION previous = NULL;
+    REGION_STATE   state    = RegionStateNew;
+
+    if (!Region->size || Region->base + Region->size < Region->base ||
+        Region->base < Map->end)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Map->next_count == Map->capacity)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    Map->end = Region->base + Region->size;
+    Map->recorded++;
+
+    while (Map->cursor < Map->count) {
+        previous = &Map->regions[Map->cursor];
+
+        if (previous->base + previous->size > Region->base)
+            break;
+
+        Map->cursor++;
+    }
+
+    if (Map->cursor < Map->count) {
+        if (IsSameRegion(previous, Region))
+            state = RegionStateUnchanged;
+        else if (previous->base < Map->end)
+            state = RegionStateChanged;
+    }
+
+    Map->next[Map->next_count++] = *Region;
+
+    if (state == RegionStateUnchanged)
+        return STATUS_SUCCESS;
+
+    Map->inspected++;
+
+    if (Callback)
+        Callback(Region, state, Context);
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+RegionMapEndRound(_Inout_ PREGION_MAP Map)
+{
+    PMEMORY_REGION regions = Map->regions;
+
+    Map->regions    = Map->next;
+    Map->count      = Map->next_count;
+    Map->next       = regions;
+    Map->next_count = 0;
+    Map->cursor     = 0;
+    Map->end        = 0;
+    Map->rounds++;
+}
+
+VOID
+RegionMapAbandonRound(_Inout_ PREGION_MAP Map)
+{
+    for (UINT32 index = Map->cursor; index < Map->count; index++) {
+        if (Map->regions[index].base < Map->end)
+            continue;
+
+        if (Map->next_count == Map->capacity) {
+            Map->dropped += Map->count - index;
+            break;
+        }
+
+        Map->next[Map->next_count++] = Map->regions[index];
+    }
+
+    RegionMapEndRound(Map);
+}
+
+/* executable memory that no image on disk accounts for */
+BOOLEAN
+RegionIsUnbackedExecutable(_In_ PMEMORY_REGION Region)
+{
+    return Region->type != RegionTypeImage &&
+           (Region->protection & REGION_PROTECTION_EXECUTE) != 0;
+}
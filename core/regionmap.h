@@ -0,0 +1,134 @@
+#ifndef REGIONMAP_H
+#define REGIONMAP_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Executable memory of a process as seen by one round of VirtualQuery, kept
+ * between rounds so only regions that are new, or that changed since the last
+ * round, have to be inspected.
+ *
+ * Every round records its regions in ascending order into one buffer while
+ * walking the previous round in the other, so comparing the two is a single
+ * merge. A region is identified by its bounds, protection and type. Memory
+ * freed and allocated again with all four unchanged is not seen as changed.
+ *
+ * A full map fails RegionMapRecord with STATUS_BUFFER_TOO_SMALL before
+ * anything is recorded, the caller grows it with RegionMapGrow and records
+ * the region again. A round that can't be completed is abandoned rather than
+ * discarded, so regions already inspected aren't inspected again next round.
+ */
+#define REGION_MAP_DEFAULT_CAPACITY 0x400
+#define REGION_MAP_MAXIMUM_CAPACITY 0x10000
+
+/* PAGE_EXECUTE, PAGE_EXECUTE_READ, PAGE_EXECUTE_READWRITE and WRITECOPY */
+#define REGION_PROTECTION_EXECUTE 0xf0
+
+typedef enum _REGION_TYPE {
+    RegionTypeImage = 0,
+    RegionTypeMapped,
+    RegionTypePrivate
+
+} REGION_TYPE;
+
+typedef enum _REGION_STATE {
+    RegionStateUnchanged = 0,
+    RegionStateNew,
+    RegionStateChanged
+
+} REGION_STATE;
+
+typedef struct _MEMORY_REGION {
+    UINT64 base;
+    UINT64 size;
+    UINT32 protection;
+    UINT32 type;
+
+} MEMORY_REGION, *PMEMORY_REGION;
+
+/* invoked for every region that is new or changed since the last round */
+typedef VOID (*REGION_CALLBACK)(_In_ PMEMORY_REGION Region,
+                                _In_ REGION_STATE State,
+                                _Inout_opt_ PVOID Context);
+
+typedef struct _REGION_MAP {
+    UINT32         capacity;
+    PMEMORY_REGION buffer;
+
+    /* the last completed round, sorted by base */
+    UINT32         count;
+    PMEMORY_REGION regions;
+
+    /* the round being recorded */
+    UINT32         next_count;
+    PMEMORY_REGION next;
+
+    /* position in regions and the end of the last region recorded */
+    UINT32 cursor;
+    UINT64 end;
+
+    /*
+     * regions of the last round an abandoned one couldn't keep, they are
+     * inspected again next round
+     */
+    UINT32 dropped;
+
+    /* lifetime statistics */
+    UINT64 rounds;
+    UINT64 recorded;
+    UINT64 inspected;
+
+} REGION_MAP, *PREGION_MAP;
+
+/* Buffer holds 2 * Capacity regions, one for each round */
+VOID
+RegionMapInitialise(_Out_ PREGION_MAP   Map,
+                    _In_ PMEMORY_REGION Buffer,
+                    _In_ UINT32         Capacity);
+
+/*
+ * Moves the map to Buffer, which holds 2 * Capacity regions, keeping the
+ * round being recorded. Capacity has to be larger than the current capacity.
+ * The previous buffer is no longer used and is returned.
+ */
+PMEMORY_REGION
+RegionMapGrow(_Inout_ PREGION_MAP   Map,
+              _In_ PMEMORY_REGION Buffer,
+              _In_ UINT32         Capacity);
+
+/* forgets every region, the next round inspects everything */
+VOID
+RegionMapReset(_Inout_ PREGION_MAP Map);
+
+VOID
+RegionMapBeginRound(_Inout_ PREGION_MAP Map);
+
+NTSTATUS
+RegionMapRecord(_Inout_ PREGION_MAP  Map,
+                _In_ PMEMORY_REGION  Region,
+                _In_ REGION_CALLBACK Callback,
+                _Inout_opt_ PVOID    Context);
+
+VOID
+RegionMapEndRound(_Inout_ PREGION_MAP Map);
+
+/*
+ * Ends a round that stopped part way through. The regions recorded so far
+ * are kept along with the regions of the last round past the point it
+ * stopped, which weren't compared against anything.
+ */
+VOID
+RegionMapAbandonRound(_Inout_ PREGION_MAP Map);
+
+BOOLEAN
+RegionIsUnbackedExecutable(_In_ PMEMORY_REGION Region);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#include "report.h"
+
+UINT32
+ReportGetCode(_In_ PVOID Buffer)
+{
+    return *(PUINT32)Buffer;
+}
+
+/*
+ * Returns the size of the structure associated with the given report code, or
+ * 0 if the code is unknown.
+ */
+UINT32
+ReportGetExpectedSize(_In_ UINT32 ReportCode)
+{
+    switch (ReportCode) {
+    case REPORT_NMI_CALLBACK_FAILURE: return sizeof(NMI_CALLBACK_FAILURE);
+    case REPORT_MODULE_VALIDATION_FAILURE:
+        return sizeof(MODULE_VALIDATION_FAILURE);
+    case REPORT_ILLEGAL_HANDLE_OPERATION:
+        return sizeof(OPEN_HANDLE_FAILURE_REPORT);
+    case REPORT_INVALID_PROCESS_ALLOCATION:
+        return sizeof(INVALID_PROCESS_ALLOCATION_REPORT);
+    case REPORT_HIDDEN_SYSTEM_THREAD:
+        return sizeof(HIDDEN_SYSTEM_THREAD_REPORT);
+    case REPORT_ILLEGAL_ATTACH_PROCESS: return sizeof(ATTACH_PROCESS_REPORT);
+    case REPORT_APC_STACKWALK: return sizeof(APC_STACKWALK_REPORT);
+    case REPORT_DPC_STACKWALK: return sizeof(DPC_STACKWALK_REPORT);
+    case REPORT_DATA_TABLE_ROUTINE: return sizeof(DATA_TABLE_ROUTINE_REPORT);
+    case REPORT_INVALID_PROCESS_MODULE:
+        return sizeof(PROCESS_MODULE_VALIDATION_REPORT);
+    case REPORT_DATA_POINTER_HOOK: return sizeof(DATA_POINTER_HOOK_REPORT);
+    case REPORT_PRIVATE_EXECUTABLE_MEMORY:
+        return sizeof(PRIVATE_EXECUTABLE_MEMORY_REPORT);
+    case REPORT_MODULE_IMAGE_MODIFIED:
+        return sizeof(MODULE_IMAGE_MODIFIED_REPORT);
+    case REPORT_UNOWNED_EXECUTABLE_MEMORY:
+        return sizeof(UNOWNED_EXECUTABLE_MEMORY_REPORT);
+    case REPORT_UNBACKED_SYSTEM_THREAD:
+        return sizeof(UNBACKED_SYSTEM_THREAD_REPORT);
+    case REPORT_DRIVER_DISPATCH_HOOK:
+        return sizeof(DRIVER_DISPATCH_HOOK_REPORT);
+    default: return 0;
+    }
+}
+
+/*
+ * A buffer is only considered a valid report if it carries a known report
+ * code and is large enough to hold the corresponding structure.
+ */
+BOOLEAN
+ReportIsValid(_In_ PVOID Buffer, _In_ UINT32 BufferSize)
+{
+    UINT32 expected_size = 0;
+
+    if (!Buffer || BufferSize < sizeof(UINT32))
+        return FALSE;
+
+    expected_size = ReportGetExpectedSize(ReportGetCode(Buffer));
+
+    if (!expected_size || BufferSize < expected_size)
+        return FALSE;
+
+    return TRUE;
+}
@@ -0,0 +1,252 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Report structures sent from the driver to the user mode module via the irp
+ * queue. Every report begins with its report code, which is how the module
+ * identifies the structure when a completed irp buffer arrives.
+ */
+
+#define REPORT_NMI_CALLBACK_FAILURE       50
+#define REPORT_MODULE_VALIDATION_FAILURE  60
+#define REPORT_ILLEGAL_HANDLE_OPERATION   70
+#define REPORT_INVALID_PROCESS_ALLOCATION 80
+#define REPORT_HIDDEN_SYSTEM_THREAD       90
+#define REPORT_ILLEGAL_ATTACH_PROCESS     100
+#define REPORT_APC_STACKWALK              110
+#define REPORT_DPC_STACKWALK              120
+#define REPORT_DATA_TABLE_ROUTINE         130
+#define REPORT_INVALID_PROCESS_MODULE     140
+#define REPORT_DATA_POINTER_HOOK          150
+#define REPORT_PRIVATE_EXECUTABLE_MEMORY  160
+#define REPORT_MODULE_IMAGE_MODIFIED      170
+#define REPORT_UNOWNED_EXECUTABLE_MEMORY  180
+#define REPORT_UNBACKED_SYSTEM_THREAD     190
+#define REPORT_DRIVER_DISPATCH_HOOK       200
+
+typedef enum _TABLE_ID { HalDispatch = 0, HalPrivateDispatch } TABLE_ID;
+
+#define APC_STACKWALK_BUFFER_SIZE 500
+
+typedef struct _APC_STACKWALK_REPORT {
+    INT    report_code;
+    UINT64 kthread_address;
+    UINT64 invalid_rip;
+    CHAR   driver[APC_STACKWALK_BUFFER_SIZE];
+
+} APC_STACKWALK_REPORT, *PAPC_STACKWALK_REPORT;
+
+typedef struct _DPC_STACKWALK_REPORT {
+    UINT32 report_code;
+    UINT64 kthread_address;
+    UINT64 invalid_rip;
+    CHAR   driver[APC_STACKWALK_BUFFER_SIZE];
+
+} DPC_STACKWALK_REPORT, *PDPC_STACKWALK_REPORT;
+
+typedef struct _MODULE_VALIDATION_FAILURE {
+    INT    report_code;
+    INT    report_type;
+    UINT64 driver_base_address;
+    UINT64 driver_size;
+    CHAR   driver_name[128];
+
+} MODULE_VALIDATION_FAILURE, *PMODULE_VALIDATION_FAILURE;
+
+#define DATA_TABLE_ROUTINE_BUF_SIZE 256
+
+typedef struct _DATA_TABLE_ROUTINE_REPORT {
+    UINT32   report_code;
+    TABLE_ID id;
+    UINT64   address;
+    CHAR     routine[DATA_TABLE_ROUTINE_BUF_SIZE];
+
+} DATA_TABLE_ROUTINE_REPORT, *PDATA_TABLE_ROUTINE_REPORT;
+
+typedef struct _NMI_CALLBACK_FAILURE {
+    INT    report_code;
+    INT    were_nmis_disabled;
+    UINT64 kthread_address;
+    UINT64 invalid_rip;
+
+} NMI_CALLBACK_FAILURE, *PNMI_CALLBACK_FAILURE;
+
+#define REPORT_INVALID_PROCESS_BUFFER_SIZE 500
+
+typedef struct _INVALID_PROCESS_ALLOCATION_REPORT {
+    INT  report_code;
+    CHAR process[REPORT_INVALID_PROCESS_BUFFER_SIZE];
+
+} INVALID_PROCESS_ALLOCATION_REPORT, *PINVALID_PROCESS_ALLOCATION_REPORT;
+
+typedef struct _HIDDEN_SYSTEM_THREAD_REPORT {
+    INT    report_code;
+    INT    found_in_kthreadlist;
+    INT    found_in_pspcidtable;
+    UINT64 thread_address;
+    LONG   thread_id;
+    CHAR   thread[500];
+
+} HIDDEN_SYSTEM_THREAD_REPORT, *PHIDDEN_SYSTEM_THREAD_REPORT;
+
+#define ATTACH_REPORT_IMAGE_NAME_LENGTH 16
+
+/*
+ * One report per process attaching to the protected process, see
+ * core/attach.h. thread_id and thread_address are the first thread seen
+ * attached.
+ */
+typedef struct _ATTACH_PROCESS_REPORT {
+    INT    report_code;
+    UINT32 thread_id;
+    UINT64 thread_address;
+    UINT32 process_id;
+    UINT32 signature_level;
+    CHAR   image_name[ATTACH_REPORT_IMAGE_NAME_LENGTH];
+
+    /* 100ns units between the first and last round the process was seen */
+    UINT64 dwell_time;
+    UINT32 rounds;
+    UINT32 max_threads;
+    UINT32 samples;
+    UINT32 ended;
+
+} ATTACH_PROCESS_REPORT, *PATTACH_PROCESS_REPORT;
+
+#define HANDLE_REPORT_PROCESS_NAME_MAX_LENGTH 64
+
+typedef struct _OPEN_HANDLE_FAILURE_REPORT {
+    INT  report_code;
+    INT  is_kernel_handle;
+    LONG process_id;
+    LONG thread_id;
+    LONG access;
+    CHAR process_name[HANDLE_REPORT_PROCESS_NAME_MAX_LENGTH];
+
+} OPEN_HANDLE_FAILURE_REPORT, *POPEN_HANDLE_FAILURE_REPORT;
+
+#define MODULE_PATH_LEN 256
+
+typedef struct _PROCESS_MODULE_VALIDATION_REPORT {
+    INT    report_code;
+    UINT64 image_base;
+    UINT32 image_size;
+    WCHAR  module_path[MODULE_PATH_LEN];
+
+} PROCESS_MODULE_VALIDATION_REPORT, *PPROCESS_MODULE_VALIDATION_REPORT;
+
+#define DATA_POINTER_REPORT_MODULE_LENGTH 64
+
+/*
+ * A pointer in a modules writable data that pointed into validated code and
+ * now points outside of it, see core/dataptr.h. module_base and module are
+ * the module the pointer lives in.
+ */
+typedef struct _DATA_POINTER_HOOK_REPORT {
+    UINT32 report_code;
+    UINT32 reserved;
+    UINT64 slot_address;
+    UINT64 module_base;
+    UINT64 baseline;
+    UINT64 current;
+    CHAR   module[DATA_POINTER_REPORT_MODULE_LENGTH];
+
+} DATA_POINTER_HOOK_REPORT, *PDATA_POINTER_HOOK_REPORT;
+
+/*
+ * Executable memory in the protected process that isn't backed by an image,
+ * see core/regionmap.h. region_type is a REGION_TYPE and state whether the
+ * region is new or changed since the previous scan.
+ */
+typedef struct _PRIVATE_EXECUTABLE_MEMORY_REPORT {
+    UINT32 report_code;
+    UINT32 region_type;
+    UINT64 base;
+    UINT64 size;
+    UINT64 allocation_base;
+    UINT32 protection;
+    UINT32 state;
+
+} PRIVATE_EXECUTABLE_MEMORY_REPORT, *PPRIVATE_EXECUTABLE_MEMORY_REPORT;
+
+/*
+ * A page of the user mode modules own code that no longer matches the image
+ * on disk, see core/pagehash.h.
+ */
+typedef struct _MODULE_IMAGE_MODIFIED_REPORT {
+    UINT32 report_code;
+    UINT32 page_rva;
+    UINT32 page_length;
+    UINT32 image_size;
+    UINT64 image_base;
+
+} MODULE_IMAGE_MODIFIED_REPORT, *PMODULE_IMAGE_MODIFIED_REPORT;
+
+/*
+ * An executable kernel mapping no loaded module overlaps, see
+ * core/pagewalk.h. span_size is the size of the page mapping it, 4kb, 2mb or
+ * 1gb.
+ */
+typedef struct _UNOWNED_EXECUTABLE_MEMORY_REPORT {
+    UINT32 report_code;
+    UINT32 span_size;
+    UINT64 virtual_base;
+    UINT64 physical_base;
+
+} UNOWNED_EXECUTABLE_MEMORY_REPORT, *PUNOWNED_EXECUTABLE_MEMORY_REPORT;
+
+/*
+ * A system thread whose start address no loaded module covers, see
+ * core/threadstart.h. Sent once per start address, threads is how many
+ * threads were found starting there in the round it was first seen.
+ */
+typedef struct _UNBACKED_SYSTEM_THREAD_REPORT {
+    UINT32 report_code;
+    UINT32 thread_id;
+    UINT64 thread_address;
+    UINT64 start_address;
+    UINT64 win32_start_address;
+    UINT32 threads;
+
+} UNBACKED_SYSTEM_THREAD_REPORT, *PUNBACKED_SYSTEM_THREAD_REPORT;
+
+#define DRIVER_DISPATCH_REPORT_NAME_LENGTH 64
+
+/*
+ * A MajorFunction, DriverUnload or FastIo slot of a driver object pointing
+ * somewhere it shouldnt, see core/drvdispatch.h. slot is the index into
+ * DRIVER_DISPATCH_ENTRY.slots and verdict a DRIVER_DISPATCH_VERDICT. previous
+ * is 0 when the slot was bad the first time the driver was seen.
+ */
+typedef struct _DRIVER_DISPATCH_HOOK_REPORT {
+    UINT32 report_code;
+    UINT32 slot;
+    UINT32 verdict;
+    UINT32 driver_size;
+    UINT64 driver_base;
+    UINT64 previous;
+    UINT64 current;
+    CHAR   driver_name[DRIVER_DISPATCH_REPORT_NAME_LENGTH];
+
+} DRIVER_DISPATCH_HOOK_REPORT, *PDRIVER_DISPATCH_HOOK_REPORT;
+
+UINT32
+ReportGetCode(_In_ PVOID Buffer);
+
+UINT32
+ReportGetExpectedSize(_In_ UINT32 ReportCode);
+
+BOOLEAN
+ReportIsValid(_In_ PVOID Buffer, _In_ UINT32 BufferSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
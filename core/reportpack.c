@@ -0,0 +1,420 @@
+#include "reportpack.h"
+
+#define REPORT_DICTIONARY_HASH_SEED       0x811c9dc5
+#define REPORT_DICTIONARY_HASH_MULTIPLIER 0x01000193
+
+/* values never exceed REPORT_DICTIONARY_MAX_SIZE, which takes 2 bytes */
+#define REPORT_PACK_MAX_VARINT_LENGTH 3
+
+/* what reports without a dictionary entry are packed against */
+static const UCHAR REPORT_PACK_ZERO_REFERENCE[REPORT_DICTIONARY_MAX_SIZE];
+
+UINT32
+ReportDictionaryHash(_In_ PVOID Buffer, _In_ SIZE_T Length)
+{
+    PUCHAR bytes = (PUCHAR)Buffer;
+    UINT32 hash  = REPORT_DICTIONARY_HASH_SEED;
+
+    for (SIZE_T index = 0; index < Length; index++)
+        hash = (hash ^ bytes[index]) * REPORT_DICTIONARY_HASH_MULTIPLIER;
+
+    return hash;
+}
+
+NTSTATUS
+ReportDictionaryLoad(_Out_ PREPORT_DICTIONARY Dictionary,
+                     _In_ PVOID               Buffer,
+                     _In_ SIZE_T              Length)
+{
+    REPORT_DICTIONARY_HEADER header = {0};
+    REPORT_DICTIONARY_RECORD record = {0};
+    PUCHAR                   bytes  = (PUCHAR)Buffer;
+    SIZE_T                   offset = sizeof(REPORT_DICTIONARY_HEADER);
+
+    RtlZeroMemory(Dictionary, sizeof(REPORT_DICTIONARY));
+
+    if (!Buffer || Length < sizeof(REPORT_DICTIONARY_HEADER))
+        return STATUS_INVALID_PARAMETER;
+
+    RtlCopyMemory(&header, Buffer, sizeof(header));
+
+    if (header.magic != REPORT_DICTIONARY_MAGIC ||
+        header.version != REPORT_DICTIONARY_VERSION ||
+        header.count > REPORT_DICTIONARY_MAX_ENTRIES)
+        return STATUS_INVALID_PARAMETER;
+
+    if (header.id != ReportDictionaryHash(bytes + offset, Length - offset))
+        return STATUS_DATA_ERROR;
+
+    for (UINT32 index = 0; index < header.count; index++) {
+        if (Length - offset < sizeof(record))
+            return STATUS_INVALID_PARAMETER;
+
+        RtlCopyMemory(&record, bytes + offset, sizeof(record));
+        offset += sizeof(record);
+
+        if (!record.size || record.size > REPORT_DICTIONARY_MAX_SIZE ||
+            Length - offset < record.size)
+            return STATUS_INVALID_PARAMETER;
+
+        /* sorted and unique, so lookups can binary search */
+        if (index && record.report_code <=
+                         Dictionary->entries[index - 1].report_code)
+            return STATUS_INVALID_PARAMETER;
+
+        Dictionary->entries[index].report_code = record.report_code;
+        Dictionary->entries[index].size        = record.size;
+        Dictionary->entries[index].reference   = bytes + offset;
+
+        offset += record.size;
+    }
+
+    if (offset != Length)
+        return STATUS_INVALID_PARAMETER;
+
+    Dictionary->id    = header.id;
+    Dictionary->count = header.count;
+    return STATUS_SUCCESS;
+}
+
+PUCHAR
+ReportDictionaryLookup(_In_opt_ PREPORT_DICTIONARY Dictionary,
+                       _In_ UINT32                 ReportCode,
+                       _In_ UINT32                 Size)
+{
+    UINT32 low    = 0;
+    UINT32 high   = 0;
+    UINT32 middle = 0;
+
+    if (!Dictionary)
+        return NULL;
+
+    high = Dictionary->count;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (Dictionary->entries[middle].report_code < ReportCode)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    /* a reference trained on another version of the structure is useless */
+    if (low < Dictionary->count &&
+        Dictionary->entries[low].report_code == ReportCode &&
+        Dictionary->entries[low].size == Size)
+        return Dictionary->entries[low].reference;
+
+    return NULL;
+}
+
+VOID
+ReportDictionaryTrain(_Inout_ PUCHAR  Reference,
+                      _Inout_ PUINT16 Counts,
+                      _In_ PUCHAR     Sample,
+                      _In_ UINT32     Size)
+{
+    for (UINT32 index = 0; index < Size; index++) {
+        if (!Counts[index]) {
+            Reference[index] = Sample[index];
+            Counts[index]    = 1;
+        }
+        else if (Reference[index] == Sample[index]) {
+            if (Counts[index] != 0xffff)
+                Counts[index]++;
+        }
+        else {
+            Counts[index]--;
+        }
+    }
+}
+
+/* the end of the run of bytes matching the reference starting at Offset */
+STATIC
+UINT32
+FindMatchEnd(_In_ PUCHAR Report,
+             _In_ PUCHAR Reference,
+             _In_ UINT32 Offset,
+             _In_ UINT32 Size)
+{
+    UINT64 left  = 0;
+    UINT64 right = 0;
+
+    while (Size - Offset >= sizeof(UINT64)) {
+        RtlCopyMemory(&left, Report + Offset, sizeof(UINT64));
+        RtlCopyMemory(&right, Reference + Offset, sizeof(UINT64));
+
+        if (left != right)
+            break;
+
+        Offset += sizeof(UINT64);
+    }
+
+    while (Offset < Size && Report[Offset] == Reference[Offset])
+        Offset++;
+
+    return Offset;
+}
+
+/* the end of the literal starting at Offset, short matches are absorbed */
+STATIC
+UINT32
+FindLiteralEnd(_In_ PUCHAR Report,
+               _In_ PUCHAR Reference,
+               _In_ UINT32 Offset,
+               _In_ UINT32 Size)
+{
+    UINT32 match_end = 0;
+
+    while (Offset < Size) {
+        if (Report[Offset] != Reference[Offset]) {
+            Offset++;
+            continue;
+        }
+
+        match_end = FindMatchEnd(Report, Reference, Offset, Size);
+
+        if (match_end - Offset >= REPORT_PACK_MIN_MATCH)
+            break;
+
+        Offset = match_end;
+    }
+
+    return Offset;
+}
+
+STATIC
+SIZE_T
+WriteVarint(_Out_ PUCHAR Buffer, _In_ UINT32 Value)
+{
+    SIZE_T length = 0;
+
+    while (Value >= 0x80) {
+        Buffer[length++] = (UCHAR)(Value | 0x80);
+        Value >>= 7;
+    }
+
+    Buffer[length++] = (UCHAR)Value;
+    return length;
+}
+
+/*
+ * Returns the number of bytes read, 0 if the varint runs past the end of the
+ * buffer or is longer than any valid length.
+ */
+STATIC
+SIZE_T
+ReadVarint(_In_ PUCHAR Buffer, _In_ SIZE_T Length, _Out_ PUINT32 Value)
+{
+    SIZE_T length = 0;
+
+    *Value = 0;
+
+    while (length < Length && length < REPORT_PACK_MAX_VARINT_LENGTH) {
+        *Value |= (UINT32)(Buffer[length] & 0x7f) << (7 * length);
+
+        if (!(Buffer[length++] & 0x80))
+            return length;
+    }
+
+    return 0;
+}
+
+SIZE_T
+ReportPack(_In_opt_ PREPORT_DICTIONARY Dictionary,
+           _In_ PVOID                  Report,
+           _In_ UINT32                 Size,
+           _Out_ PVOID                 Buffer,
+           _In_ SIZE_T                 BufferSize)
+{
+    REPORT_PACK_HEADER header      = {0};
+    PUCHAR             report      = (PUCHAR)Report;
+    PUCHAR             output      = (PUCHAR)Buffer;
+    PUCHAR             reference   = NULL;
+    SIZE_T             length      = sizeof(REPORT_PACK_HEADER);
+    UINT32             offset      = 0;
+    UINT32             match_end   = 0;
+    UINT32             literal_end = 0;
+
+    if (!Report || !Buffer || Size < sizeof(UINT32) ||
+        Size > REPORT_DICTIONARY_MAX_SIZE ||
+        BufferSize < REPORT_PACK_BOUND(Size))
+        return 0;
+
+    RtlCopyMemory(&header.report_code, Report, sizeof(UINT32));
+
+    reference = ReportDictionaryLookup(Dictionary, header.report_code, Size);
+
+    if (!reference)
+        reference = (PUCHAR)REPORT_PACK_ZERO_REFERENCE;
+
+    while (offset < Size) {
+        match_end   = FindMatchEnd(report, reference, offset, Size);
+        literal_end = FindLiteralEnd(report, reference, match_end, Size);
+
+        length += WriteVarint(output + length, match_end - offset);
+        length += WriteVarint(output + length, literal_end - match_end);
+
+        RtlCopyMemory(
+            output + length, report + match_end, literal_end - match_end);
+
+        length += literal_end - match_end;
+        offset = literal_end;
+    }
+
+    header.size        = (UINT16)Size;
+    header.packed_size = (UINT16)(length - sizeof(REPORT_PACK_HEADER));
+
+    RtlCopyMemory(Buffer, &header, sizeof(header));
+    return length;
+}
+
+NTSTATUS
+ReportUnpack(_In_opt_ PREPORT_DICTIONARY Dictionary,
+             _In_ PVOID                  Buffer,
+             _In_ SIZE_T                 Length,
+             _Out_ PVOID                 Report,
+             _In_ SIZE_T                 ReportSize,
+             _Out_ PUINT32               Size,
+             _Out_ PSIZE_T               Consumed)
+{
+    REPORT_PACK_HEADER header    = {0};
+    PUCHAR             input     = (PUCHAR)Buffer + sizeof(header);
+    PUCHAR             report    = (PUCHAR)Report;
+    PUCHAR             reference = NULL;
+    SIZE_T             position  = 0;
+    SIZE_T             read      = 0;
+    UINT32             offset    = 0;
+    UINT32             match     = 0;
+    UINT32             literal   = 0;
+    UINT32             code      = 0;
+
+    *Size     = 0;
+    *Consumed = 0;
+
+    if (!Buffer || !Report)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Length < sizeof(header))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlCopyMemory(&header, Buffer, sizeof(header));
+
+    if (header.size < sizeof(UINT32) ||
+        header.size > REPORT_DICTIONARY_MAX_SIZE || header.size > ReportSize)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Length - sizeof(header) < header.packed_size)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    reference =
+        ReportDictionaryLookup(Dictionary, header.report_code, header.size);
+
+    if (!reference)
+        reference = (PUCHAR)REPORT_PACK_ZERO_REFERENCE;
+
+    while (offset < header.size) {
+        read = ReadVarint(
+            input + position, header.packed_size - position, &match);
+
+        if (!read || match > header.size - offset)
+            return STATUS_DATA_ERROR;
+
+        position += read;
+
+        RtlCopyMemory(report + offset, reference + offset, match);
+        offset += match;
+
+        read = ReadVarint(
+            input + position, header.packed_size - position, &literal);
+
+        /* an empty token would never make progress */
+        if (!read || (!match && !literal) ||
+            literal > header.size - offset ||
+            literal > header.packed_size - position - read)
+            return STATUS_DATA_ERROR;
+
+        position += read;
+
+        RtlCopyMemory(report + offset, input + position, literal);
+        offset += literal;
+        position += literal;
+    }
+
+    RtlCopyMemory(&code, report, sizeof(UINT32));
+
+    /* the report code is in the header, the two copies have to agree */
+    if (position != header.packed_size || code != header.report_code)
+        return STATUS_DATA_ERROR;
+
+    *Size     = header.size;
+    *Consumed = sizeof(header) + header.packed_size;
+    return STATUS_SUCCESS;
+}
+
+SIZE_T
+ReportPackMessage(_In_opt_ PREPORT_DICTIONARY Dictionary,
+                  _In_ PVOID                  Report,
+                  _In_ UINT32                 Size,
+                  _Out_ PVOID                 Buffer,
+                  _In_ SIZE_T                 BufferSize)
+{
+    UINT32 id     = Dictionary ? Dictionary->id : 0;
+    SIZE_T length = 0;
+
+    if (!Buffer || BufferSize < sizeof(id))
+        return 0;
+
+    length = ReportPack(Dictionary,
+                        Report,
+                        Size,
+                        (PUCHAR)Buffer + sizeof(id),
+                        BufferSize - sizeof(id));
+
+    if (!length)
+        return 0;
+
+    RtlCopyMemory(Buffer, &id, sizeof(id));
+    return sizeof(id) + length;
+}
+
+NTSTATUS
+ReportUnpackMessage(_In_opt_ PREPORT_DICTIONARY Dictionary,
+                    _In_ PVOID                  Buffer,
+                    _In_ SIZE_T                 Length,
+                    _Out_ PVOID                 Report,
+                    _In_ SIZE_T                 ReportSize,
+                    _Out_ PUINT32               Size,
+                    _Out_ PSIZE_T               Consumed)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    UINT32   id     = 0;
+
+    *Size     = 0;
+    *Consumed = 0;
+
+    if (!Buffer)
+        return STATUS_INVALID_PARAMETER;
+
+    if (Length < sizeof(id))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlCopyMemory(&id, Buffer, sizeof(id));
+
+    if (id != (Dictionary ? Dictionary->id : 0))
+        return STATUS_NOT_FOUND;
+
+    status = ReportUnpack(Dictionary,
+                          (PUCHAR)Buffer + sizeof(id),
+                          Length - sizeof(id),
+                          Report,
+                          ReportSize,
+                          Size,
+                          Consumed);
+
+    if (NT_SUCCESS(status))
+        *Consumed += sizeof(id);
+
+    return status;
+}
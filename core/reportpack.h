@@ -0,0 +1,169 @@
+#ifndef REPORTPACK_H
+#define REPORTPACK_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packing of reports for the uplink. Reports are fixed size structures that
+ * are mostly zeroed string buffers, and what isnt zero tends to be the same
+ * from one report to the next: the report code, the upper half of kernel
+ * addresses, \SystemRoot\System32\ and so on.
+ *
+ * Each report is encoded as the difference to a reference of the same
+ * layout. The references are trained offline from recorded report streams
+ * (see tools/replay) and shipped to both ends as a dictionary, and a report
+ * with no reference is encoded against zeroes. Because the reference has the
+ * same layout there is nothing to search for, a packed report is just a run
+ * of bytes matching the reference followed by a run of literal bytes, over
+ * and over, so packing costs little more than a compare of the two.
+ *
+ * Both ends must use the same dictionary, which one is agreed on out of band
+ * using the dictionary id.
+ */
+#define REPORT_DICTIONARY_MAGIC   0x63696441 /* Adic */
+#define REPORT_DICTIONARY_VERSION 1
+
+#define REPORT_DICTIONARY_MAX_ENTRIES 64
+#define REPORT_DICTIONARY_MAX_SIZE    0x1000
+
+/* matches shorter than this are cheaper to send as part of the literal */
+#define REPORT_PACK_MIN_MATCH 4
+
+typedef struct _REPORT_DICTIONARY_HEADER {
+    UINT32 magic;
+    UINT16 version;
+    UINT16 count;
+
+    /* hash of everything following the header, see ReportDictionaryHash */
+    UINT32 id;
+    UINT32 reserved;
+
+} REPORT_DICTIONARY_HEADER, *PREPORT_DICTIONARY_HEADER;
+
+/* followed by size bytes of reference, entries are sorted by report code */
+typedef struct _REPORT_DICTIONARY_RECORD {
+    UINT32 report_code;
+    UINT32 size;
+
+} REPORT_DICTIONARY_RECORD, *PREPORT_DICTIONARY_RECORD;
+
+typedef struct _REPORT_DICTIONARY_ENTRY {
+    UINT32 report_code;
+    UINT32 size;
+    PUCHAR reference;
+
+} REPORT_DICTIONARY_ENTRY, *PREPORT_DICTIONARY_ENTRY;
+
+typedef struct _REPORT_DICTIONARY {
+    UINT32                  id;
+    UINT32                  count;
+    REPORT_DICTIONARY_ENTRY entries[REPORT_DICTIONARY_MAX_ENTRIES];
+
+} REPORT_DICTIONARY, *PREPORT_DICTIONARY;
+
+/*
+ * The token stream is packed_size bytes of: the length of the match as a
+ * base 128 varint, the length of the literal the same way and then the
+ * literal bytes, until size bytes have been described.
+ */
+typedef struct _REPORT_PACK_HEADER {
+    UINT32 report_code;
+    UINT16 size;
+    UINT16 packed_size;
+
+} REPORT_PACK_HEADER, *PREPORT_PACK_HEADER;
+
+/* the largest a packed report of Size bytes can be, header included */
+#define REPORT_PACK_BOUND(Size) (sizeof(REPORT_PACK_HEADER) + (Size) + 8)
+
+/*
+ * On the uplink a packed report is preceded by the id of the dictionary it
+ * was packed against, 0 for none, so a server holding another dictionary
+ * rejects it rather than unpacking garbage.
+ */
+#define REPORT_PACK_MESSAGE_BOUND(Size) (sizeof(UINT32) + REPORT_PACK_BOUND(Size))
+
+UINT32
+ReportDictionaryHash(_In_ PVOID Buffer, _In_ SIZE_T Length);
+
+/*
+ * Parses a dictionary file. The entries point into Buffer, which has to
+ * outlive the dictionary.
+ */
+NTSTATUS
+ReportDictionaryLoad(_Out_ PREPORT_DICTIONARY Dictionary,
+                     _In_ PVOID               Buffer,
+                     _In_ SIZE_T              Length);
+
+/* the reference for the report, or NULL if it is packed against zeroes */
+PUCHAR
+ReportDictionaryLookup(_In_opt_ PREPORT_DICTIONARY Dictionary,
+                       _In_ UINT32                 ReportCode,
+                       _In_ UINT32                 Size);
+
+/*
+ * Adds a sample to a reference being trained. Every byte of the reference is
+ * a running majority vote over the samples, with Counts holding one counter
+ * per byte. Both start zeroed.
+ */
+VOID
+ReportDictionaryTrain(_Inout_ PUCHAR  Reference,
+                      _Inout_ PUINT16 Counts,
+                      _In_ PUCHAR     Sample,
+                      _In_ UINT32     Size);
+
+/*
+ * Returns the number of bytes written to Buffer, or 0 if the report is
+ * malformed or Buffer is smaller than REPORT_PACK_BOUND(Size).
+ */
+SIZE_T
+ReportPack(_In_opt_ PREPORT_DICTIONARY Dictionary,
+           _In_ PVOID                  Report,
+           _In_ UINT32                 Size,
+           _Out_ PVOID                 Buffer,
+           _In_ SIZE_T                 BufferSize);
+
+/*
+ * Reads the packed report at the start of Buffer into Report. Consumed is
+ * set to the length of the packed report, and STATUS_BUFFER_TOO_SMALL is
+ * returned while Buffer doesnt hold all of it yet.
+ */
+NTSTATUS
+ReportUnpack(_In_opt_ PREPORT_DICTIONARY Dictionary,
+             _In_ PVOID                  Buffer,
+             _In_ SIZE_T                 Length,
+             _Out_ PVOID                 Report,
+             _In_ SIZE_T                 ReportSize,
+             _Out_ PUINT32               Size,
+             _Out_ PSIZE_T               Consumed);
+
+/* ReportPack for the uplink, the dictionary id followed by the report */
+SIZE_T
+ReportPackMessage(_In_opt_ PREPORT_DICTIONARY Dictionary,
+                  _In_ PVOID                  Report,
+                  _In_ UINT32                 Size,
+                  _Out_ PVOID                 Buffer,
+                  _In_ SIZE_T                 BufferSize);
+
+/*
+ * ReportUnpack for the uplink. Fails with STATUS_NOT_FOUND when the report
+ * was packed against a dictionary other than Dictionary.
+ */
+NTSTATUS
+ReportUnpackMessage(_In_opt_ PREPORT_DICTIONARY Dictionary,
+                    _In_ PVOID                  Buffer,
+                    _In_ SIZE_T                 Length,
+                    _Out_ PVOID                 Report,
+                    _In_ SIZE_T                 ReportSize,
+                    _Out_ PUINT32               Size,
+                    _Out_ PSIZE_T               Consumed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,180 @@
+#include "sha256.h"
+
+/*
+ * Portable SHA-256 (FIPS 180-4). The driver hashes sections with the BCrypt
+ * provider, this exists so the same digests can be produced by the host build
+ * and the user mode module without pulling in a crypto library.
+ */
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define CH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define EP0(x)       (ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define EP1(x)       (ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define SIG0(x)      (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define SIG1(x)      (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+
+static const UINT32 SHA256_ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+STATIC
+VOID
+Sha256TransformBlock(_Inout_ PSHA256_CONTEXT Context, _In_ const UCHAR* Block)
+{
+    UINT32 w[64] = {0};
+    UINT32 a     = Context->state[0];
+    UINT32 b     = Context->state[1];
+    UINT32 c     = Context->state[2];
+    UINT32 d     = Context->state[3];
+    UINT32 e     = Context->state[4];
+    UINT32 f     = Context->state[5];
+    UINT32 g     = Context->state[6];
+    UINT32 h     = Context->state[7];
+    UINT32 t1    = 0;
+    UINT32 t2    = 0;
+
+    for (UINT32 index = 0; index < 16; index++) {
+        w[index] = ((UINT32)Block[index * 4] << 24) |
+                   ((UINT32)Block[index * 4 + 1] << 16) |
+                   ((UINT32)Block[index * 4 + 2] << 8) |
+                   ((UINT32)Block[index * 4 + 3]);
+    }
+
+    for (UINT32 index = 16; index < 64; index++) {
+        w[index] = SIG1(w[index - 2]) + w[index - 7] + SIG0(w[index - 15]) +
+                   w[index - 16];
+    }
+
+    for (UINT32 index = 0; index < 64; index++) {
+        t1 = h + EP1(e) + CH(e, f, g) + SHA256_ROUND_CONSTANTS[index] +
+             w[index];
+        t2 = EP0(a) + MAJ(a, b, c);
+        h  = g;
+        g  = f;
+        f  = e;
+        e  = d + t1;
+        d  = c;
+        c  = b;
+        b  = a;
+        a  = t1 + t2;
+    }
+
+    Context->state[0] += a;
+    Context->state[1] += b;
+    Context->state[2] += c;
+    Context->state[3] += d;
+    Context->state[4] += e;
+    Context->state[5] += f;
+    Context->state[6] += g;
+    Context->state[7] += h;
+}
+
+VOID
+Sha256Init(_Out_ PSHA256_CONTEXT Context)
+{
+    Context->state[0]      = 0x6a09e667;
+    Context->state[1]      = 0xbb67ae85;
+    Context->state[2]      = 0x3c6ef372;
+    Context->state[3]      = 0xa54ff53a;
+    Context->state[4]      = 0x510e527f;
+    Context->state[5]      = 0x9b05688c;
+    Context->state[6]      = 0x1f83d9ab;
+    Context->state[7]      = 0x5be0cd19;
+    Context->length        = 0;
+    Context->buffer_length = 0;
+}
+
+VOID
+Sha256Update(_Inout_ PSHA256_CONTEXT Context,
+             _In_ PVOID              Buffer,
+             _In_ SIZE_T             Length)
+{
+    const UCHAR* data  = (const UCHAR*)Buffer;
+    SIZE_T       count = 0;
+
+    Context->length += Length;
+
+    /* top up a partially filled block first */
+    if (Context->buffer_length) {
+        count = SHA256_BLOCK_SIZE - Context->buffer_length;
+
+        if (count > Length)
+            count = Length;
+
+        RtlCopyMemory(Context->buffer + Context->buffer_length, data, count);
+        Context->buffer_length += (UINT32)count;
+        data += count;
+        Length -= count;
+
+        if (Context->buffer_length < SHA256_BLOCK_SIZE)
+            return;
+
+        Sha256TransformBlock(Context, Context->buffer);
+        Context->buffer_length = 0;
+    }
+
+    /* then hash straight out of the callers buffer */
+    while (Length >= SHA256_BLOCK_SIZE) {
+        Sha256TransformBlock(Context, data);
+        data += SHA256_BLOCK_SIZE;
+        Length -= SHA256_BLOCK_SIZE;
+    }
+
+    if (Length) {
+        RtlCopyMemory(Context->buffer, data, Length);
+        Context->buffer_length = (UINT32)Length;
+    }
+}
+
+VOID
+Sha256Final(_Inout_ PSHA256_CONTEXT Context, _Out_ PUCHAR Digest)
+{
+    UINT64 bit_length = Context->length * 8;
+    UINT32 index      = Context->buffer_length;
+
+    Context->buffer[index++] = 0x80;
+
+    if (index > SHA256_BLOCK_SIZE - sizeof(UINT64)) {
+        RtlZeroMemory(Context->buffer + index, SHA256_BLOCK_SIZE - index);
+        Sha256TransformBlock(Context, Context->buffer);
+        index = 0;
+    }
+
+    RtlZeroMemory(Context->buffer + index,
+                  SHA256_BLOCK_SIZE - sizeof(UINT64) - index);
+
+    for (UINT32 byte = 0; byte < sizeof(UINT64); byte++) {
+        Context->buffer[SHA256_BLOCK_SIZE - 1 - byte] =
+            (UCHAR)(bit_length >> (byte * 8));
+    }
+
+    Sha256TransformBlock(Context, Context->buffer);
+
+    for (UINT32 word = 0; word < 8; word++) {
+        Digest[word * 4]     = (UCHAR)(Context->state[word] >> 24);
+        Digest[word * 4 + 1] = (UCHAR)(Context->state[word] >> 16);
+        Digest[word * 4 + 2] = (UCHAR)(Context->state[word] >> 8);
+        Digest[word * 4 + 3] = (UCHAR)(Context->state[word]);
+    }
+}
+
+VOID
+Sha256Compute(_In_ PVOID Buffer, _In_ SIZE_T Length, _Out_ PUCHAR Digest)
+{
+    SHA256_CONTEXT context = {0};
+
+    Sha256Init(&context);
+    Sha256Update(&context, Buffer, Length);
+    Sha256Final(&context, Digest);
+}
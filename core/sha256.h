@@ -0,0 +1,39 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_DIGEST_LENGTH 32
+#define SHA256_BLOCK_SIZE    64
+
+typedef struct _SHA256_CONTEXT {
+    UINT32 state[8];
+    UINT64 length;
+    UINT32 buffer_length;
+    UCHAR  buffer[SHA256_BLOCK_SIZE];
+
+} SHA256_CONTEXT, *PSHA256_CONTEXT;
+
+VOID
+Sha256Init(_Out_ PSHA256_CONTEXT Context);
+
+VOID
+Sha256Update(_Inout_ PSHA256_CONTEXT Context,
+             _In_ PVOID              Buffer,
+             _In_ SIZE_T             Length);
+
+VOID
+Sha256Final(_Inout_ PSHA256_CONTEXT Context, _Out_ PUCHAR Digest);
+
+VOID
+Sha256Compute(_In_ PVOID Buffer, _In_ SIZE_T Length, _Out_ PUCHAR Digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#include "signature.h"
+
+/*
+ * Returns the address of the first occurence of Signature within the
+ * MaxLength bytes starting at BaseAddress. Note that the comparison may read
+ * up to SignatureLength bytes past BaseAddress + MaxLength.
+ */
+PVOID
+ScanForSignature(_In_ PVOID  BaseAddress,
+                 _In_ SIZE_T MaxLength,
+                 _In_ LPCSTR Signature,
+                 _In_ SIZE_T SignatureLength)
+{
+    CHAR current_char     = 0;
+    CHAR current_sig_char = 0;
+
+    for (SIZE_T index = 0; index < MaxLength; index++) {
+        for (SIZE_T sig = 0; sig < SignatureLength + 1; sig++) {
+            if (sig == SignatureLength)
+                return (PVOID)((UINT64)BaseAddress + index);
+
+            current_char     = *(PCHAR)((UINT64)BaseAddress + index + sig);
+            current_sig_char = Signature[sig];
+
+            if (current_char != current_sig_char)
+                break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Pool tags are always 4 bytes, so rather then comparing byte by byte like
+ * ScanForSignature we compare a full tag at each offset. Unlike
+ * ScanForSignature this never reads past BaseAddress + Length.
+ */
+PVOID
+ScanForPoolTag(_In_ PVOID BaseAddress, _In_ SIZE_T Length, _In_ LPCSTR Tag)
+{
+    UINT32 tag     = 0;
+    UINT32 current = 0;
+
+    if (!BaseAddress || !Tag || Length < sizeof(UINT32))
+        return NULL;
+
+    RtlCopyMemory(&tag, Tag, sizeof(UINT32));
+
+    for (SIZE_T index = 0; index <= Length - sizeof(UINT32); index++) {
+        RtlCopyMemory(
+            &current, (PVOID)((UINT64)BaseAddress + index), sizeof(UINT32));
+
+        if (current == tag)
+            return (PVOID)((UINT64)BaseAddress + index);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,23 @@
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+PVOID
+ScanForSignature(_In_ PVOID  BaseAddress,
+                 _In_ SIZE_T MaxLength,
+                 _In_ LPCSTR Signature,
+                 _In_ SIZE_T SignatureLength);
+
+PVOID
+ScanForPoolTag(_In_ PVOID BaseAddress, _In_ SIZE_T Length, _In_ LPCSTR Tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
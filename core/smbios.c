@@ -0,0 +1,133 @@
+#include "smbios.h"
+
+#define NULL_TERMINATOR '\0'
+
+/*
+ * From line 727 in the SMBIOS Specification:
+ *
+ * 727 • Each structure shall be terminated by a double-null (0000h), either
+ * directly following the formatted area (if no strings are present) or
+ * directly following the last string. This includes 729   system- and
+ * OEM-specific structures and allows upper-level software to easily traverse
+ * the 730   structure table. (See structure-termination examples later in this
+ * clause.)
+ *
+ * TLDR is that if the first two characters proceeding the structure are null
+ * terminators, then there are no strings, otherwise to find the end of the
+ * string section simply iterate until there is a double null terminator.
+ *
+ * source:
+ * https://www.dmtf.org/sites/default/files/standards/documents/DSP0134_2.7.1.pdf
+ */
+VOID
+GetNextSMBIOSStructureInTable(_Inout_ PSMBIOS_TABLE_HEADER* CurrentStructure)
+{
+    PCHAR string_section_start =
+        (PCHAR)((UINT64)*CurrentStructure + (*CurrentStructure)->Length);
+
+    PCHAR current_char_in_strings = string_section_start;
+    PCHAR next_char_in_strings    = string_section_start + 1;
+
+    for (;;) {
+        if (*current_char_in_strings == NULL_TERMINATOR &&
+            *next_char_in_strings == NULL_TERMINATOR) {
+            *CurrentStructure =
+                (PSMBIOS_TABLE_HEADER)(next_char_in_strings + 1);
+            return;
+        }
+
+        current_char_in_strings++;
+        next_char_in_strings++;
+    }
+}
+
+/*
+ * Remember that the string index does not start from the beginning of the
+ * struct. For example, lets take RAW_SMBIOS_TABLE_02: the first string is NOT
+ * "Type" at index 0, the first string is Manufacturer. So if we want to find
+ * the SerialNumber, the string index would be 4, as the previous 3 values
+ * (after the header) are all strings. So remember, the index is into the number
+ * of strings that exist for the given table, NOT the size of the structure or a
+ * values index into the struct.
+ *
+ * Here we count the number of strings by incrementing the string_count each
+ * time we pass a null terminator so we know when we're at the beginning of the
+ * target string.
+ */
+NTSTATUS
+GetStringAtIndexFromSMBIOSTable(_In_ PSMBIOS_TABLE_HEADER Table,
+                                _In_ INT                  Index,
+                                _In_ PVOID                Buffer,
+                                _In_ SIZE_T               BufferSize)
+{
+    SIZE_T current_string_char_index = 0;
+    INT    string_count              = 0;
+    PCHAR  current_string_char       = (PCHAR)((UINT64)Table + Table->Length);
+    PCHAR  next_string_char          = current_string_char + 1;
+
+    for (;;) {
+        if (*current_string_char == NULL_TERMINATOR &&
+            *next_string_char == NULL_TERMINATOR)
+            return STATUS_NOT_FOUND;
+
+        if (current_string_char_index >= BufferSize)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        if (string_count + 1 == Index) {
+            if (*current_string_char == NULL_TERMINATOR)
+                return STATUS_SUCCESS;
+
+            UINT64 dest = (UINT64)Buffer + current_string_char_index;
+
+            RtlCopyMemory((PVOID)dest, current_string_char, sizeof(CHAR));
+            current_string_char_index++;
+            goto increment;
+        }
+
+        if (*current_string_char == NULL_TERMINATOR) {
+            current_string_char_index = 0;
+            string_count++;
+        }
+
+    increment:
+        current_string_char++;
+        next_string_char++;
+    }
+
+    return STATUS_NOT_FOUND;
+}
+
+/*
+ * Locates the first structure of type TableType within the raw firmware table
+ * and copies the string at StringIndex into Buffer. The walk is bounded by the
+ * length stored in the RAW_SMBIOS_DATA header and the end of table structure.
+ */
+NTSTATUS
+FindSMBIOSStringInTable(_In_ PRAW_SMBIOS_DATA Data,
+                        _In_ ULONG            TableType,
+                        _In_ ULONG            StringIndex,
+                        _Out_ PVOID           Buffer,
+                        _In_ SIZE_T           BufferSize)
+{
+    PSMBIOS_TABLE_HEADER header    = NULL;
+    UINT64               table_end = 0;
+
+    if (!Data || !Buffer || !BufferSize)
+        return STATUS_INVALID_PARAMETER;
+
+    header    = (PSMBIOS_TABLE_HEADER)(&Data->SMBIOSTableData[0]);
+    table_end = (UINT64)&Data->SMBIOSTableData[0] + Data->Length;
+
+    while (header->Type != TableType) {
+        if (header->Type == SMBIOS_END_OF_TABLE_TYPE)
+            return STATUS_NOT_FOUND;
+
+        GetNextSMBIOSStructureInTable(&header);
+
+        if ((UINT64)header + sizeof(UINT32) > table_end)
+            return STATUS_NOT_FOUND;
+    }
+
+    return GetStringAtIndexFromSMBIOSTable(
+        header, StringIndex, Buffer, BufferSize);
+}
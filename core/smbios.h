@@ -0,0 +1,82 @@
+#ifndef SMBIOS_H
+#define SMBIOS_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SMBIOS_END_OF_TABLE_TYPE 127
+
+typedef struct _RAW_SMBIOS_DATA {
+    UCHAR  Used20CallingMethod;
+    UCHAR  SMBIOSMajorVersion;
+    UCHAR  SMBIOSMinorVersion;
+    UCHAR  DmiRevision;
+    UINT32 Length;
+    UCHAR  SMBIOSTableData[1];
+} RAW_SMBIOS_DATA, *PRAW_SMBIOS_DATA;
+
+typedef struct _SMBIOS_TABLE_HEADER {
+    UCHAR  Type;
+    UCHAR  Length;
+    USHORT Handle;
+    PCHAR  TableData;
+
+} SMBIOS_TABLE_HEADER, *PSMBIOS_TABLE_HEADER;
+
+typedef struct _RAW_SMBIOS_TABLE_01 {
+    UCHAR  Type;
+    UCHAR  Length;
+    USHORT Handle;
+    UCHAR  Manufacturer;
+    UCHAR  ProductName;
+    UCHAR  Version;
+    UCHAR  SerialNumber;
+    UCHAR  UUID[16];
+    UCHAR  WakeUpType;
+    UCHAR  SKUNumber;
+    UCHAR  Family;
+
+} RAW_SMBIOS_TABLE_01, *PRAW_SMBIOS_TABLE_01;
+
+typedef struct _RAW_SMBIOS_TABLE_02 {
+    UCHAR  Type;
+    UCHAR  Length;
+    USHORT Handle;
+    UCHAR  Manufacturer;
+    UCHAR  Product;
+    UCHAR  Version;
+    UCHAR  SerialNumber;
+    UCHAR  AssetTag;
+    UCHAR  FeatureFlags;
+    UCHAR  LocationInChassis;
+    UINT16 ChassisHandle;
+    UCHAR  BoardType;
+    UCHAR  NumberOfContainedObjectHandles;
+    UCHAR  ContainedObjectHandles[256];
+
+} RAW_SMBIOS_TABLE_02, *PRAW_SMBIOS_TABLE_02;
+
+VOID
+GetNextSMBIOSStructureInTable(_Inout_ PSMBIOS_TABLE_HEADER* CurrentStructure);
+
+NTSTATUS
+GetStringAtIndexFromSMBIOSTable(_In_ PSMBIOS_TABLE_HEADER Table,
+                                _In_ INT                  Index,
+                                _In_ PVOID                Buffer,
+                                _In_ SIZE_T               BufferSize);
+
+NTSTATUS
+FindSMBIOSStringInTable(_In_ PRAW_SMBIOS_DATA Data,
+                        _In_ ULONG            TableType,
+                        _In_ ULONG            StringIndex,
+                        _Out_ PVOID           Buffer,
+                        _In_ SIZE_T           BufferSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,439 @@
+#include "spool.h"
+
+#define SPOOL_CHECKSUM_SEED       0x9e3779b97f4a7c15ull
+#define SPOOL_CHECKSUM_MULTIPLIER 0xff51afd7ed558ccdull
+
+#define SPOOL_ALIGN(Length) \
+    (((UINT64)(Length) + SPOOL_ALIGNMENT - 1) & ~(UINT64)(SPOOL_ALIGNMENT - 1))
+
+STATIC
+UINT32
+SpoolChecksum(_In_ PVOID Buffer, _In_ SIZE_T Length, _In_ UINT64 Seed)
+{
+    PUCHAR bytes = (PUCHAR)Buffer;
+    UINT64 hash  = SPOOL_CHECKSUM_SEED ^ Seed;
+    UINT64 word  = 0;
+    SIZE_T index = 0;
+
+    for (; Length - index >= sizeof(UINT64); index += sizeof(UINT64)) {
+        RtlCopyMemory(&word, bytes + index, sizeof(UINT64));
+        hash = (hash ^ word) * SPOOL_CHECKSUM_MULTIPLIER;
+        hash ^= hash >> 32;
+    }
+
+    for (; index < Length; index++) {
+        hash = (hash ^ bytes[index]) * SPOOL_CHECKSUM_MULTIPLIER;
+        hash ^= hash >> 32;
+    }
+
+    return (UINT32)(hash ^ (hash >> 32));
+}
+
+/* the checksum covers the sequence and length as well as the payload */
+STATIC
+UINT32
+GetRecordChecksum(_In_ PSPOOL_RECORD Record, _In_ UINT32 Length)
+{
+    return SpoolChecksum(Record + 1,
+                         Length,
+                         (Record->sequence * SPOOL_CHECKSUM_MULTIPLIER) ^
+                             Record->length);
+}
+
+STATIC
+UINT32
+GetCheckpointChecksum(_In_ PSPOOL_CHECKPOINT Checkpoint)
+{
+    return SpoolChecksum(
+        Checkpoint, FIELD_OFFSET(SPOOL_CHECKPOINT, checksum), SPOOL_MAGIC);
+}
+
+STATIC
+UINT64
+GetRecordSize(_In_ UINT32 Length)
+{
+    return SPOOL_ALIGN(sizeof(SPOOL_RECORD) + Length);
+}
+
+/* bytes left in the current lap from Position */
+STATIC
+UINT64
+GetContiguousSize(_In_ PSPOOL Spool, _In_ UINT64 Position)
+{
+    return Spool->capacity - Position % Spool->capacity;
+}
+
+STATIC
+PSPOOL_RECORD
+GetRecord(_In_ PSPOOL Spool, _In_ UINT64 Position)
+{
+    return (PSPOOL_RECORD)(Spool->data + Position % Spool->capacity);
+}
+
+UINT32
+SpoolGetMaximumRecordLength(_In_ UINT64 Capacity)
+{
+    /* a record that has to wrap can waste up to its own size */
+    return (UINT32)((Capacity / 2) & ~(UINT64)(SPOOL_ALIGNMENT - 1)) -
+           sizeof(SPOOL_RECORD);
+}
+
+/*
+ * Validates the record expected at Position, following a wrap marker to the
+ * start of the next lap. Returns FALSE at the end of the spool, which is the
+ * first record that is torn, from an earlier lap or otherwise out of
+ * sequence.
+ */
+STATIC
+BOOLEAN
+ReadRecord(_In_ PSPOOL          Spool,
+           _In_ UINT64          Position,
+           _In_ UINT64          Sequence,
+           _Out_ PSPOOL_RECORD* Record,
+           _Out_ PUINT64        Start)
+{
+    PSPOOL_RECORD record     = NULL;
+    UINT64        contiguous = GetContiguousSize(Spool, Position);
+
+    if (contiguous >= sizeof(SPOOL_RECORD)) {
+        record = GetRecord(Spool, Position);
+
+        if (record->length == SPOOL_RECORD_WRAP) {
+            if (record->sequence != Sequence ||
+                record->checksum != GetRecordChecksum(record, 0))
+                return FALSE;
+
+            Position += contiguous;
+        }
+    }
+    else {
+        Position += contiguous;
+    }
+
+    record = GetRecord(Spool, Position);
+
+    if (record->sequence != Sequence ||
+        record->length > SpoolGetMaximumRecordLength(Spool->capacity) ||
+        GetRecordSize(record->length) >
+            GetContiguousSize(Spool, Position) ||
+        record->checksum != GetRecordChecksum(record, record->length))
+        return FALSE;
+
+    *Record = record;
+    *Start  = Position;
+    return TRUE;
+}
+
+STATIC
+UINT64
+GetSpoolCapacity(_In_ SIZE_T Size)
+{
+    if (Size < SPOOL_DATA_OFFSET)
+        return 0;
+
+    return (Size - SPOOL_DATA_OFFSET) & ~(UINT64)(SPOOL_ALIGNMENT - 1);
+}
+
+/* the flush routine is kept, it may be set before the spool is opened */
+STATIC
+VOID
+InitialiseSpool(_Inout_ PSPOOL Spool, _In_ PVOID Base, _In_ UINT64 Capacity)
+{
+    SPOOL_FLUSH_ROUTINE routine = Spool->flush_routine;
+    PVOID               context = Spool->flush_context;
+
+    RtlZeroMemory(Spool, sizeof(SPOOL));
+
+    Spool->header        = (PSPOOL_HEADER)Base;
+    Spool->data          = (PUCHAR)Base + SPOOL_DATA_OFFSET;
+    Spool->capacity      = Capacity;
+    Spool->flush_routine = routine;
+    Spool->flush_context = context;
+}
+
+VOID
+SpoolSetFlushRoutine(_Inout_ PSPOOL              Spool,
+                     _In_opt_ SPOOL_FLUSH_ROUTINE Routine,
+                     _In_opt_ PVOID               Context)
+{
+    Spool->flush_routine = Routine;
+    Spool->flush_context = Context;
+}
+
+/*
+ * The data area is zeroed as well, a spool formatted over an old one would
+ * otherwise find the old records where it expects its own.
+ */
+NTSTATUS
+SpoolFormat(_Inout_ PSPOOL Spool, _In_ PVOID Base, _In_ SIZE_T Size)
+{
+    UINT64 capacity = GetSpoolCapacity(Size);
+
+    if (!Base || capacity < SPOOL_MINIMUM_CAPACITY)
+        return STATUS_INVALID_PARAMETER;
+
+    InitialiseSpool(Spool, Base, capacity);
+
+    RtlZeroMemory(Base, SPOOL_DATA_OFFSET + capacity);
+
+    Spool->header->magic    = SPOOL_MAGIC;
+    Spool->header->version  = SPOOL_VERSION;
+    Spool->header->capacity = capacity;
+
+    SpoolCheckpoint(Spool);
+    return STATUS_SUCCESS;
+}
+
+STATIC
+BOOLEAN
+IsCheckpointValid(_In_ PSPOOL Spool, _In_ PSPOOL_CHECKPOINT Checkpoint)
+{
+    return Checkpoint->generation &&
+           Checkpoint->checksum == GetCheckpointChecksum(Checkpoint) &&
+           Checkpoint->head <= Checkpoint->tail &&
+           Checkpoint->tail - Checkpoint->head <= Spool->capacity &&
+           Checkpoint->head_sequence <= Checkpoint->tail_sequence;
+}
+
+NTSTATUS
+SpoolOpen(_Inout_ PSPOOL Spool, _In_ PVOID Base, _In_ SIZE_T Size)
+{
+    PSPOOL_CHECKPOINT checkpoint = NULL;
+    PSPOOL_CHECKPOINT candidate  = NULL;
+    PSPOOL_RECORD     record     = NULL;
+    UINT64            capacity   = GetSpoolCapacity(Size);
+    UINT64            start      = 0;
+
+    if (!Base || capacity < SPOOL_MINIMUM_CAPACITY)
+        return STATUS_INVALID_PARAMETER;
+
+    InitialiseSpool(Spool, Base, capacity);
+
+    if (Spool->header->magic != SPOOL_MAGIC ||
+        Spool->header->version != SPOOL_VERSION ||
+        Spool->header->capacity != capacity)
+        return STATUS_INVALID_PARAMETER;
+
+    for (UINT32 index = 0; index < SPOOL_CHECKPOINT_COUNT; index++) {
+        candidate = &Spool->header->checkpoints[index];
+
+        if (!IsCheckpointValid(Spool, candidate))
+            continue;
+
+        if (!checkpoint || candidate->generation > checkpoint->generation)
+            checkpoint = candidate;
+    }
+
+    if (!checkpoint)
+        return STATUS_DATA_ERROR;
+
+    Spool->generation    = checkpoint->generation;
+    Spool->head          = checkpoint->head;
+    Spool->head_sequence = checkpoint->head_sequence;
+    Spool->tail          = checkpoint->tail;
+    Spool->tail_sequence = checkpoint->tail_sequence;
+
+    /* a checkpoint only ever covers records that were flushed first */
+    Spool->flushed          = Spool->tail;
+    Spool->flushed_sequence = Spool->tail_sequence;
+
+    /* the records appended after the checkpoint was written */
+    while (ReadRecord(
+        Spool, Spool->tail, Spool->tail_sequence, &record, &start)) {
+        if (start + GetRecordSize(record->length) - Spool->head >
+            Spool->capacity)
+            break;
+
+        Spool->tail = start + GetRecordSize(record->length);
+        Spool->tail_sequence++;
+        Spool->recovered++;
+    }
+
+    SpoolCheckpoint(Spool);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+SpoolAppend(_Inout_ PSPOOL Spool, _In_ PVOID Record, _In_ UINT32 Length)
+{
+    PSPOOL_RECORD record     = NULL;
+    UINT64        size       = GetRecordSize(Length);
+    UINT64        position   = Spool->tail;
+    UINT64        contiguous = GetContiguousSize(Spool, position);
+    UINT64        skipped    = size > contiguous ? contiguous : 0;
+
+    if (!Record || Length > SpoolGetMaximumRecordLength(Spool->capacity))
+        return STATUS_INVALID_PARAMETER;
+
+    if (position + skipped + size - Spool->head > Spool->capacity) {
+        Spool->full++;
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    if (skipped && contiguous >= sizeof(SPOOL_RECORD)) {
+        record           = GetRecord(Spool, position);
+        record->length   = SPOOL_RECORD_WRAP;
+        record->sequence = Spool->tail_sequence;
+        record->checksum = GetRecordChecksum(record, 0);
+    }
+
+    position += skipped;
+    record = GetRecord(Spool, position);
+
+    RtlCopyMemory(record + 1, Record, Length);
+
+    record->length   = Length;
+    record->sequence = Spool->tail_sequence;
+    record->checksum = GetRecordChecksum(record, Length);
+
+    Spool->tail = position + size;
+    Spool->tail_sequence++;
+    Spool->appended++;
+
+    if (++Spool->appends_since_checkpoint >= SPOOL_CHECKPOINT_INTERVAL)
+        SpoolCheckpoint(Spool);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Hands the records between the last flush and the tail to the flush routine,
+ * in two pieces if they wrap around the end of the data area. Records already
+ * released dont need to reach the disk.
+ */
+STATIC
+VOID
+FlushRecords(_Inout_ PSPOOL Spool)
+{
+    UINT64 start  = Spool->flushed > Spool->head ? Spool->flushed : Spool->head;
+    UINT64 length = Spool->tail - start;
+    UINT64 offset = start % Spool->capacity;
+
+    if (Spool->flush_routine && length) {
+        if (length > Spool->capacity - offset) {
+            Spool->flush_routine(Spool->data + offset,
+                                 (SIZE_T)(Spool->capacity - offset),
+                                 Spool->flush_context);
+
+            length -= Spool->capacity - offset;
+            offset = 0;
+        }
+
+        Spool->flush_routine(
+            Spool->data + offset, (SIZE_T)length, Spool->flush_context);
+    }
+
+    Spool->flushed          = Spool->tail;
+    Spool->flushed_sequence = Spool->tail_sequence;
+}
+
+/*
+ * Overwrites the older of the two checkpoints, a crash half way through
+ * leaves its checksum wrong and the other one is used instead. The tail it
+ * records is the flushed one, so a checkpoint never points past records that
+ * may not have reached the disk.
+ */
+STATIC
+VOID
+WriteCheckpoint(_Inout_ PSPOOL Spool)
+{
+    PSPOOL_CHECKPOINT checkpoint = NULL;
+    UINT64            index      = 0;
+
+    /* without a flush routine the mapping is all there is */
+    if (!Spool->flush_routine) {
+        Spool->flushed          = Spool->tail;
+        Spool->flushed_sequence = Spool->tail_sequence;
+    }
+    else if (Spool->flushed < Spool->head) {
+        Spool->flushed          = Spool->head;
+        Spool->flushed_sequence = Spool->head_sequence;
+    }
+
+    Spool->generation++;
+
+    index      = Spool->generation % SPOOL_CHECKPOINT_COUNT;
+    checkpoint = &Spool->header->checkpoints[index];
+
+    checkpoint->generation    = Spool->generation;
+    checkpoint->head          = Spool->head;
+    checkpoint->head_sequence = Spool->head_sequence;
+    checkpoint->tail          = Spool->flushed;
+    checkpoint->tail_sequence = Spool->flushed_sequence;
+    checkpoint->reserved      = 0;
+    checkpoint->checksum      = GetCheckpointChecksum(checkpoint);
+
+    Spool->appends_since_checkpoint = 0;
+}
+
+/*
+ * Validates the record at the head before it is handed out. A record that
+ * doesnt check out can only have been lost to a system crash before it
+ * reached the disk, and nothing after it can be trusted either, so the spool
+ * is cut back to the head and the records dropped are counted as discarded.
+ */
+STATIC
+BOOLEAN
+ReadHead(_Inout_ PSPOOL Spool, _Out_ PSPOOL_RECORD* Record, _Out_ PUINT64 Start)
+{
+    if (Spool->head == Spool->tail)
+        return FALSE;
+
+    if (ReadRecord(Spool, Spool->head, Spool->head_sequence, Record, Start) &&
+        *Start + GetRecordSize((*Record)->length) <= Spool->tail)
+        return TRUE;
+
+    Spool->discarded += Spool->tail_sequence - Spool->head_sequence;
+
+    Spool->tail             = Spool->head;
+    Spool->tail_sequence    = Spool->head_sequence;
+    Spool->flushed          = Spool->head;
+    Spool->flushed_sequence = Spool->head_sequence;
+
+    WriteCheckpoint(Spool);
+    return FALSE;
+}
+
+NTSTATUS
+SpoolPeek(_Inout_ PSPOOL Spool, _Out_ PVOID* Record, _Out_ PUINT32 Length)
+{
+    PSPOOL_RECORD record = NULL;
+    UINT64        start  = 0;
+
+    *Record = NULL;
+    *Length = 0;
+
+    if (!ReadHead(Spool, &record, &start))
+        return STATUS_NOT_FOUND;
+
+    *Record = record + 1;
+    *Length = record->length;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * The checkpoint written here only moves the head, the tail it records is
+ * the last one flushed so releasing never has to wait on the disk.
+ */
+VOID
+SpoolRelease(_Inout_ PSPOOL Spool)
+{
+    PSPOOL_RECORD record = NULL;
+    UINT64        start  = 0;
+
+    if (!ReadHead(Spool, &record, &start))
+        return;
+
+    Spool->head = start + GetRecordSize(record->length);
+    Spool->head_sequence++;
+    Spool->released++;
+
+    WriteCheckpoint(Spool);
+}
+
+VOID
+SpoolCheckpoint(_Inout_ PSPOOL Spool)
+{
+    FlushRecords(Spool);
+    WriteCheckpoint(Spool);
+}
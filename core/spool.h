@@ -0,0 +1,173 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A circular spool of reports waiting to be uplinked, laid out in a file
+ * mapped into memory so whatever was appended survives the server being
+ * down, the module crashing or both. The spool only ever touches the mapping,
+ * mapping it is up to the caller, as is locking. Surviving a system crash as
+ * well takes a flush routine, see SpoolSetFlushRoutine.
+ *
+ * Positions are 64 bit offsets that only ever grow, the physical offset is
+ * the position modulo the capacity. Every record carries a sequence number
+ * and a checksum over the record, so a record torn by a crash or left over
+ * from an earlier lap around the ring is recognised as the end of the spool.
+ *
+ * The head and tail are made durable through two checkpoints in the header,
+ * written alternately so one of them is always intact. A checkpoint is
+ * written whenever a record is released and every SPOOL_CHECKPOINT_INTERVAL
+ * appends, recovery starts from the newest valid one and only has to scan
+ * the records appended after it. The record at the head is validated again
+ * before it is handed out, so a record the disk never saw ends the spool
+ * rather than being sent.
+ *
+ * Delivery is at least once, a record sent but not yet released when the
+ * module dies is sent again.
+ */
+#define SPOOL_MAGIC   0x6c707341 /* Aspl */
+#define SPOOL_VERSION 1
+
+#define SPOOL_ALIGNMENT           8
+#define SPOOL_CHECKPOINT_INTERVAL 64
+#define SPOOL_MINIMUM_CAPACITY    0x1000
+#define SPOOL_CHECKPOINT_COUNT    2
+
+/* the length of the record marking the rest of the lap as unused */
+#define SPOOL_RECORD_WRAP 0xffffffff
+
+typedef struct _SPOOL_CHECKPOINT {
+    UINT64 generation;
+    UINT64 head;
+    UINT64 head_sequence;
+    UINT64 tail;
+    UINT64 tail_sequence;
+    UINT32 checksum;
+    UINT32 reserved;
+
+} SPOOL_CHECKPOINT, *PSPOOL_CHECKPOINT;
+
+typedef struct _SPOOL_HEADER {
+    UINT32           magic;
+    UINT32           version;
+    UINT64           capacity;
+    SPOOL_CHECKPOINT checkpoints[SPOOL_CHECKPOINT_COUNT];
+
+} SPOOL_HEADER, *PSPOOL_HEADER;
+
+/*
+ * Makes Length bytes of the mapping at Base durable. Called by SpoolCheckpoint
+ * for the records a checkpoint is about to cover, before it is written.
+ */
+typedef VOID (*SPOOL_FLUSH_ROUTINE)(_In_ PVOID     Base,
+                                    _In_ SIZE_T    Length,
+                                    _In_opt_ PVOID Context);
+
+/* followed by length bytes of payload, padded to SPOOL_ALIGNMENT */
+typedef struct _SPOOL_RECORD {
+    UINT32 checksum;
+    UINT32 length;
+    UINT64 sequence;
+
+} SPOOL_RECORD, *PSPOOL_RECORD;
+
+/* the data area starts at this offset into the mapping */
+#define SPOOL_DATA_OFFSET                                               \
+    ((sizeof(SPOOL_HEADER) + SPOOL_ALIGNMENT - 1) & ~(SPOOL_ALIGNMENT - 1))
+
+typedef struct _SPOOL {
+    PSPOOL_HEADER header;
+    PUCHAR        data;
+    UINT64        capacity;
+
+    UINT64 head;
+    UINT64 head_sequence;
+    UINT64 tail;
+    UINT64 tail_sequence;
+    UINT64 generation;
+    UINT32 appends_since_checkpoint;
+
+    /* the tail as of the last flush, which is as far as checkpoints reach */
+    UINT64 flushed;
+    UINT64 flushed_sequence;
+
+    SPOOL_FLUSH_ROUTINE flush_routine;
+    PVOID               flush_context;
+
+    /* set by SpoolOpen, records found after the newest checkpoint */
+    UINT32 recovered;
+
+    UINT64 appended;
+    UINT64 released;
+    UINT64 full;
+
+    /* records dropped because the one at the head failed its checksum */
+    UINT64 discarded;
+
+} SPOOL, *PSPOOL;
+
+/*
+ * Formats Size bytes at Base as an empty spool. Size is rounded down to the
+ * alignment and must leave at least SPOOL_MINIMUM_CAPACITY for records.
+ */
+NTSTATUS
+SpoolFormat(_Inout_ PSPOOL Spool, _In_ PVOID Base, _In_ SIZE_T Size);
+
+/*
+ * Recovers the spool at Base, from the newest intact checkpoint up to the
+ * first record that is torn or out of sequence. Fails if Base doesnt hold a
+ * spool of the same size, in which case it should be formatted.
+ *
+ * Both keep the flush routine already set on Spool, anything else in it is
+ * overwritten.
+ */
+NTSTATUS
+SpoolOpen(_Inout_ PSPOOL Spool, _In_ PVOID Base, _In_ SIZE_T Size);
+
+/* STATUS_BUFFER_TOO_SMALL if the spool is too full to take the record */
+NTSTATUS
+SpoolAppend(_Inout_ PSPOOL Spool, _In_ PVOID Record, _In_ UINT32 Length);
+
+/*
+ * The oldest record, which stays in the spool until released. Returns
+ * STATUS_NOT_FOUND once the spool is empty.
+ */
+NTSTATUS
+SpoolPeek(_Inout_ PSPOOL Spool, _Out_ PVOID* Record, _Out_ PUINT32 Length);
+
+/* drops the oldest record once it has been delivered */
+VOID
+SpoolRelease(_Inout_ PSPOOL Spool);
+
+/*
+ * Flushes the records appended since the last flush and writes a checkpoint
+ * covering them. Also done every SPOOL_CHECKPOINT_INTERVAL appends.
+ */
+VOID
+SpoolCheckpoint(_Inout_ PSPOOL Spool);
+
+/*
+ * Routine is called with Context for every range of records that has to reach
+ * the disk before a checkpoint can cover it. Without one the spool is only as
+ * durable as the mapping, which is enough to survive the process crashing.
+ * Set it on a zeroed SPOOL before SpoolFormat or SpoolOpen.
+ */
+VOID
+SpoolSetFlushRoutine(_Inout_ PSPOOL              Spool,
+                     _In_opt_ SPOOL_FLUSH_ROUTINE Routine,
+                     _In_opt_ PVOID               Context);
+
+/* the largest record a spool of Capacity bytes can take */
+UINT32
+SpoolGetMaximumRecordLength(_In_ UINT64 Capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
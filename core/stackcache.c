@@ -0,0 +1,181 @@
+#include "stackcache.h"
+
+#define STACK_CACHE_HASH_SEED       0xcbf29ce484222325ull
+#define STACK_CACHE_HASH_MULTIPLIER 0x9e3779b97f4a7c15ull
+
+VOID
+StackCacheInitialise(_Out_ PSTACK_CACHE      Cache,
+                     _In_ PSTACK_CACHE_ENTRY Entries,
+                     _In_ UINT32             Capacity)
+{
+    RtlZeroMemory(Cache, sizeof(STACK_CACHE));
+    RtlZeroMemory(Entries, Capacity * sizeof(STACK_CACHE_ENTRY));
+
+    Cache->capacity = Capacity;
+    Cache->entries  = Entries;
+}
+
+STATIC
+UINT64
+MixHash(_In_ UINT64 Hash, _In_ UINT64 Value)
+{
+    Hash ^= Value;
+    Hash *= STACK_CACHE_HASH_MULTIPLIER;
+    return Hash ^ (Hash >> 29);
+}
+
+UINT64
+StackCacheHashFrames(_In_ PUINT64 Frames, _In_ UINT32 Count)
+{
+    UINT64 hash = MixHash(STACK_CACHE_HASH_SEED, Count);
+
+    for (UINT32 index = 0; index < Count; index++)
+        hash = MixHash(hash, Frames[index]);
+
+    return hash;
+}
+
+/*
+ * A module loading or unloading changes which return addresses are valid, so
+ * every verdict taken against the old list has to go.
+ */
+UINT64
+StackCacheModuleFingerprint(_In_ PSYSTEM_MODULES Modules)
+{
+    PRTL_MODULE_EXTENDED_INFO modules =
+        (PRTL_MODULE_EXTENDED_INFO)Modules->address;
+    UINT64 hash = MixHash(STACK_CACHE_HASH_SEED, Modules->module_count);
+
+    for (INT index = 0; index < Modules->module_count; index++) {
+        hash = MixHash(hash, (UINT64)modules[index].ImageBase);
+        hash = MixHash(hash, modules[index].ImageSize);
+    }
+
+    return hash;
+}
+
+VOID
+StackCacheBeginRound(_Inout_ PSTACK_CACHE Cache, _In_ UINT64 ModuleFingerprint)
+{
+    Cache->previous = Cache->current;
+    RtlZeroMemory(&Cache->current, sizeof(STACK_CACHE_STATS));
+
+    Cache->round++;
+    Cache->rounds++;
+
+    if (Cache->module_fingerprint == ModuleFingerprint)
+        return;
+
+    if (Cache->count)
+        Cache->invalidations++;
+
+    Cache->module_fingerprint = ModuleFingerprint;
+    Cache->count              = 0;
+
+    RtlZeroMemory(Cache->entries, Cache->capacity * sizeof(STACK_CACHE_ENTRY));
+}
+
+/*
+ * Slots are picked by thread alone, so the stacks a thread had in earlier
+ * rounds share its probe window and are the first to be evicted by its new
+ * ones.
+ */
+STATIC
+UINT32
+GetSlot(_In_ PSTACK_CACHE Cache, _In_ UINT64 Thread)
+{
+    return (UINT32)(MixHash(STACK_CACHE_HASH_SEED, Thread) &
+                    (Cache->capacity - 1));
+}
+
+STATIC
+BOOLEAN
+IsEntryStale(_In_ PSTACK_CACHE Cache, _In_ PSTACK_CACHE_ENTRY Entry)
+{
+    return Cache->round - Entry->round > STACK_CACHE_MAX_AGE;
+}
+
+BOOLEAN
+StackCacheLookup(_Inout_ PSTACK_CACHE Cache,
+                 _In_ UINT64          Thread,
+                 _In_ UINT64          Hash,
+                 _In_ UINT32          Frames)
+{
+    PSTACK_CACHE_ENTRY entry = NULL;
+    UINT32             slot  = 0;
+
+    if (!Cache->capacity)
+        return FALSE;
+
+    Cache->current.lookups++;
+    Cache->lookups++;
+
+    slot = GetSlot(Cache, Thread);
+
+    for (UINT32 probe = 0; probe < STACK_CACHE_PROBE_LIMIT; probe++) {
+        entry = &Cache->entries[(slot + probe) & (Cache->capacity - 1)];
+
+        if (!entry->thread)
+            return FALSE;
+
+        if (entry->thread != Thread || entry->hash != Hash ||
+            entry->frames != Frames || IsEntryStale(Cache, entry))
+            continue;
+
+        entry->round = Cache->round;
+        Cache->current.hits++;
+        Cache->current.frames_skipped += Frames;
+        Cache->hits++;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Takes the first empty or stale slot in the probe window, otherwise the
+ * least recently seen entry in it is evicted.
+ */
+VOID
+StackCacheInsert(_Inout_ PSTACK_CACHE Cache,
+                 _In_ UINT64          Thread,
+                 _In_ UINT64          Hash,
+                 _In_ UINT32          Frames)
+{
+    PSTACK_CACHE_ENTRY entry  = NULL;
+    PSTACK_CACHE_ENTRY oldest = NULL;
+    UINT32             slot   = 0;
+
+    if (!Cache->capacity || !Thread)
+        return;
+
+    slot = GetSlot(Cache, Thread);
+
+    for (UINT32 probe = 0; probe < STACK_CACHE_PROBE_LIMIT; probe++) {
+        entry = &Cache->entries[(slot + probe) & (Cache->capacity - 1)];
+
+        if (!entry->thread) {
+            Cache->count++;
+            goto insert;
+        }
+
+        if (entry->thread == Thread && entry->hash == Hash)
+            goto insert;
+
+        if (IsEntryStale(Cache, entry))
+            goto insert;
+
+        if (!oldest || entry->round < oldest->round)
+            oldest = entry;
+    }
+
+    entry = oldest;
+    Cache->current.evictions++;
+
+insert:
+
+    entry->thread = Thread;
+    entry->hash   = Hash;
+    entry->round  = Cache->round;
+    entry->frames = Frames;
+}
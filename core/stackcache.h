@@ -0,0 +1,94 @@
+#ifndef STACKCACHE_H
+#define STACKCACHE_H
+
+#include "platform.h"
+
+#include "system_modules.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stacks captured by the APC, DPC and NMI stackwalks that had every return
+ * address inside a loaded module, keyed by the thread and a hash of its
+ * frames. Most threads sit in the same wait between rounds, so a later round
+ * capturing the same stack for the same thread can skip resolving it.
+ *
+ * Only clean stacks are stored. A stack with a frame outside every module is
+ * resolved again each round so the frame can be reported. Entries not seen
+ * for STACK_CACHE_MAX_AGE rounds are ignored and later reused, and the whole
+ * cache is dropped when the module list a round is validated against changes.
+ */
+#define STACK_CACHE_DEFAULT_CAPACITY 0x1000
+#define STACK_CACHE_MAX_AGE          16
+#define STACK_CACHE_PROBE_LIMIT      8
+
+typedef struct _STACK_CACHE_ENTRY {
+    UINT64 thread;
+    UINT64 hash;
+    UINT32 round;
+    UINT32 frames;
+
+} STACK_CACHE_ENTRY, *PSTACK_CACHE_ENTRY;
+
+typedef struct _STACK_CACHE_STATS {
+    UINT64 lookups;
+    UINT64 hits;
+    UINT64 frames_skipped;
+    UINT64 evictions;
+
+} STACK_CACHE_STATS, *PSTACK_CACHE_STATS;
+
+typedef struct _STACK_CACHE {
+    /* a power of two */
+    UINT32             capacity;
+    UINT32             count;
+    PSTACK_CACHE_ENTRY entries;
+
+    UINT32 round;
+    UINT64 module_fingerprint;
+
+    /* the round in progress and the one before it */
+    STACK_CACHE_STATS current;
+    STACK_CACHE_STATS previous;
+
+    /* lifetime statistics */
+    UINT64 rounds;
+    UINT64 invalidations;
+    UINT64 hits;
+    UINT64 lookups;
+
+} STACK_CACHE, *PSTACK_CACHE;
+
+VOID
+StackCacheInitialise(_Out_ PSTACK_CACHE      Cache,
+                     _In_ PSTACK_CACHE_ENTRY Entries,
+                     _In_ UINT32             Capacity);
+
+UINT64
+StackCacheHashFrames(_In_ PUINT64 Frames, _In_ UINT32 Count);
+
+UINT64
+StackCacheModuleFingerprint(_In_ PSYSTEM_MODULES Modules);
+
+VOID
+StackCacheBeginRound(_Inout_ PSTACK_CACHE Cache, _In_ UINT64 ModuleFingerprint);
+
+BOOLEAN
+StackCacheLookup(_Inout_ PSTACK_CACHE Cache,
+                 _In_ UINT64          Thread,
+                 _In_ UINT64          Hash,
+                 _In_ UINT32          Frames);
+
+VOID
+StackCacheInsert(_Inout_ PSTACK_CACHE Cache,
+                 _In_ UINT64          Thread,
+                 _In_ UINT64          Hash,
+                 _In_ UINT32          Frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+#include "system_modules.h"
+
+/*
+ * This returns a reference to an entry in the system modules array retrieved
+ * via GetSystemModuleInformation. It's important to remember we don't free the
+ * modules once we retrieve this reference, and instead only free them when we
+ * are done using it.
+ */
+PRTL_MODULE_EXTENDED_INFO
+FindSystemModuleByName(_In_ LPCSTR          ModuleName,
+                       _In_ PSYSTEM_MODULES SystemModules)
+{
+    if (!ModuleName || !SystemModules)
+        return NULL;
+
+    PRTL_MODULE_EXTENDED_INFO modules =
+        (PRTL_MODULE_EXTENDED_INFO)SystemModules->address;
+
+    for (INT index = 0; index < SystemModules->module_count; index++) {
+        if (strstr(modules[index].FullPathName, ModuleName)) {
+            return &modules[index];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * TODO: this probably doesnt need to return an NTSTATUS, we can just return a
+ * boolean and remove the out variable.
+ */
+NTSTATUS
+IsInstructionPointerInInvalidRegion(_In_ UINT64          RIP,
+                                    _In_ PSYSTEM_MODULES SystemModules,
+                                    _Out_ PBOOLEAN       Result)
+{
+    if (!RIP || !SystemModules || !Result)
+        return STATUS_INVALID_PARAMETER;
+
+    PRTL_MODULE_EXTENDED_INFO modules =
+        (PRTL_MODULE_EXTENDED_INFO)SystemModules->address;
+
+    /* Note that this does not check for HAL or PatchGuard Execution */
+    for (INT index = 0; index < SystemModules->module_count; index++) {
+        UINT64 base = (UINT64)modules[index].ImageBase;
+        UINT64 end  = base + modules[index].ImageSize;
+
+        if (RIP >= base && RIP <= end) {
+            *Result = TRUE;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    *Result = FALSE;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+IsInstructionPointerInsideModule(_In_ UINT64                    Rip,
+                                 _In_ PRTL_MODULE_EXTENDED_INFO Module,
+                                 _Out_ PBOOLEAN                 Result)
+{
+    UINT64 base = (UINT64)Module->ImageBase;
+    UINT64 end  = base + Module->ImageSize;
+
+    if (Rip >= base && Rip <= end) {
+        *Result = TRUE;
+        return STATUS_SUCCESS;
+    }
+
+    *Result = FALSE;
+    return STATUS_SUCCESS;
+}
+
+VOID
+ModuleRangeIndexInitialise(_Out_ PMODULE_RANGE_INDEX Index,
+                           _In_ PMODULE_RANGE        Ranges,
+                           _In_ UINT32               Capacity)
+{
+    Index->capacity = Capacity;
+    Index->count    = 0;
+    Index->ranges   = Ranges;
+}
+
+VOID
+ModuleRangeIndexAdd(_Inout_ PMODULE_RANGE_INDEX Index,
+                    _In_ UINT64                 Base,
+                    _In_ UINT64                 Size)
+{
+    if (!Size || Index->count >= Index->capacity)
+        return;
+
+    Index->ranges[Index->count].base = Base;
+    Index->ranges[Index->count].end  = Base + Size;
+    Index->count++;
+}
+
+VOID
+ModuleRangeIndexSort(_Inout_ PMODULE_RANGE_INDEX Index)
+{
+    MODULE_RANGE range  = {0};
+    UINT32       merged = 0;
+    UINT32       index  = 0;
+
+    for (UINT32 next = 1; next < Index->count; next++) {
+        range = Index->ranges[next];
+        index = next;
+
+        while (index && Index->ranges[index - 1].base > range.base) {
+            Index->ranges[index] = Index->ranges[index - 1];
+            index--;
+        }
+
+        Index->ranges[index] = range;
+    }
+
+    for (index = 1; index < Index->count; index++) {
+        if (Index->ranges[index].base <= Index->ranges[merged].end) {
+            if (Index->ranges[index].end > Index->ranges[merged].end)
+                Index->ranges[merged].end = Index->ranges[index].end;
+
+            continue;
+        }
+
+        Index->ranges[++merged] = Index->ranges[index];
+    }
+
+    if (Index->count)
+        Index->count = merged + 1;
+}
+
+VOID
+ModuleRangeIndexBuild(_Inout_ PMODULE_RANGE_INDEX Index,
+                      _In_ PSYSTEM_MODULES        Modules)
+{
+    PRTL_MODULE_EXTENDED_INFO modules =
+        (PRTL_MODULE_EXTENDED_INFO)Modules->address;
+
+    Index->count = 0;
+
+    for (INT index = 0; index < Modules->module_count; index++)
+        ModuleRangeIndexAdd(Index,
+                            (UINT64)modules[index].ImageBase,
+                            modules[index].ImageSize);
+
+    ModuleRangeIndexSort(Index);
+}
+
+BOOLEAN
+ModuleRangeIndexContains(_In_ PMODULE_RANGE_INDEX Index, _In_ UINT64 Address)
+{
+    UINT32 low    = 0;
+    UINT32 high   = Index->count;
+    UINT32 middle = 0;
+
+    /* the first range ending after the address */
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (Index->ranges[middle].end <= Address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low < Index->count && Index->ranges[low].base <= Address;
+}
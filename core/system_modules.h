@@ -0,0 +1,84 @@
+#ifndef SYSTEM_MODULES_H
+#define SYSTEM_MODULES_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _RTL_MODULE_EXTENDED_INFO {
+    PVOID  ImageBase;
+    ULONG  ImageSize;
+    USHORT FileNameOffset;
+    CHAR   FullPathName[0x100];
+
+} RTL_MODULE_EXTENDED_INFO, *PRTL_MODULE_EXTENDED_INFO;
+
+/* system modules information */
+
+typedef struct _SYSTEM_MODULES {
+    PVOID address;
+    INT   module_count;
+
+} SYSTEM_MODULES, *PSYSTEM_MODULES;
+
+/*
+ * Module ranges sorted by base with overlapping ones merged, so whether an
+ * address lies inside any of them is a single binary search rather then a
+ * walk of the whole module list. The caller provides the range storage.
+ */
+typedef struct _MODULE_RANGE {
+    UINT64 base;
+    UINT64 end;
+
+} MODULE_RANGE, *PMODULE_RANGE;
+
+typedef struct _MODULE_RANGE_INDEX {
+    UINT32        capacity;
+    UINT32        count;
+    PMODULE_RANGE ranges;
+
+} MODULE_RANGE_INDEX, *PMODULE_RANGE_INDEX;
+
+PRTL_MODULE_EXTENDED_INFO
+FindSystemModuleByName(_In_ LPCSTR          ModuleName,
+                       _In_ PSYSTEM_MODULES SystemModules);
+
+NTSTATUS
+IsInstructionPointerInInvalidRegion(_In_ UINT64          RIP,
+                                    _In_ PSYSTEM_MODULES SystemModules,
+                                    _Out_ PBOOLEAN       Result);
+
+NTSTATUS
+IsInstructionPointerInsideModule(_In_ UINT64                    Rip,
+                                 _In_ PRTL_MODULE_EXTENDED_INFO Module,
+                                 _Out_ PBOOLEAN                 Result);
+
+VOID
+ModuleRangeIndexInitialise(_Out_ PMODULE_RANGE_INDEX Index,
+                           _In_ PMODULE_RANGE        Ranges,
+                           _In_ UINT32               Capacity);
+
+/* ranges added are only searchable after the next ModuleRangeIndexSort */
+VOID
+ModuleRangeIndexAdd(_Inout_ PMODULE_RANGE_INDEX Index,
+                    _In_ UINT64                 Base,
+                    _In_ UINT64                 Size);
+
+VOID
+ModuleRangeIndexSort(_Inout_ PMODULE_RANGE_INDEX Index);
+
+/* replaces the contents of the index with every module in the list */
+VOID
+ModuleRangeIndexBuild(_Inout_ PMODULE_RANGE_INDEX Index,
+                      _In_ PSYSTEM_MODULES        Modules);
+
+BOOLEAN
+ModuleRangeIndexContains(_In_ PMODULE_RANGE_INDEX Index, _In_ UINT64 Address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
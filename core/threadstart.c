@@ -0,0 +1,172 @@
+#include "threadstart.h"
+
+#define THREAD_START_HASH_SEED       0xcbf29ce484222325ull
+#define THREAD_START_HASH_MULTIPLIER 0x100000001b3ull
+
+STATIC
+UINT64
+HashModuleRangeIndex(_In_ PMODULE_RANGE_INDEX Index)
+{
+    UINT64 hash = THREAD_START_HASH_SEED ^ Index->count;
+
+    for (UINT32 index = 0; index < Index->count; index++) {
+        hash = (hash ^ Index->ranges[index].base) *
+               THREAD_START_HASH_MULTIPLIER;
+        hash = (hash ^ Index->ranges[index].end) *
+               THREAD_START_HASH_MULTIPLIER;
+    }
+
+    return hash;
+}
+
+VOID
+ThreadStartAuditInitialise(_Out_ PTHREAD_START_AUDIT Audit)
+{
+    RtlZeroMemory(Audit, sizeof(THREAD_START_AUDIT));
+}
+
+UINT32
+ThreadStartAuditBeginRound(_Inout_ PTHREAD_START_AUDIT Audit,
+                           _In_ PMODULE_RANGE          Ranges,
+                           _In_ UINT32                 Capacity,
+                           _In_ PSYSTEM_MODULES        Modules)
+{
+    UINT64 fingerprint = 0;
+
+    ModuleRangeIndexInitialise(&Audit->index, Ranges, Capacity);
+    ModuleRangeIndexBuild(&Audit->index, Modules);
+
+    Audit->pending_count = 0;
+    Audit->audited       = 0;
+    Audit->unbacked      = 0;
+    Audit->rounds++;
+
+    fingerprint = HashModuleRangeIndex(&Audit->index);
+
+    /* threads are created with generation 0, so the first round is never 0 */
+    if (fingerprint != Audit->module_fingerprint || !Audit->generation) {
+        Audit->module_fingerprint = fingerprint;
+
+        if (!++Audit->generation)
+            Audit->generation++;
+    }
+
+    return Audit->generation;
+}
+
+STATIC
+BOOLEAN
+IsStartAddressUnbacked(_In_ PTHREAD_START_AUDIT Audit, _In_ UINT64 Address)
+{
+    /* Win32StartAddress is left unset by some kernel thread creation paths */
+    return Address && !ModuleRangeIndexContains(&Audit->index, Address);
+}
+
+THREAD_START_VERDICT
+ThreadStartAuditRecord(_Inout_ PTHREAD_START_AUDIT Audit,
+                       _In_ UINT64                 Thread,
+                       _In_ UINT32                 ThreadId,
+                       _In_ UINT64                 StartAddress,
+                       _In_ UINT64                 Win32StartAddress)
+{
+    PUNBACKED_THREAD_START start   = NULL;
+    UINT64                 address = 0;
+
+    if (IsStartAddressUnbacked(Audit, Win32StartAddress))
+        address = Win32StartAddress;
+    else if (IsStartAddressUnbacked(Audit, StartAddress))
+        address = StartAddress;
+
+    if (!address) {
+        Audit->audited++;
+        Audit->threads_audited++;
+        return THREAD_START_BACKED;
+    }
+
+    for (UINT32 index = 0; index < Audit->pending_count; index++) {
+        if (Audit->pending[index].address == address) {
+            start = &Audit->pending[index];
+            break;
+        }
+    }
+
+    if (!start) {
+        if (Audit->pending_count >= THREAD_START_PENDING_CAPACITY)
+            return THREAD_START_DEFERRED;
+
+        start = &Audit->pending[Audit->pending_count++];
+
+        start->address             = address;
+        start->start_address       = StartAddress;
+        start->win32_start_address = Win32StartAddress;
+        start->thread              = Thread;
+        start->thread_id           = ThreadId;
+        start->threads             = 0;
+    }
+
+    start->threads++;
+
+    Audit->audited++;
+    Audit->unbacked++;
+    Audit->threads_audited++;
+    return THREAD_START_UNBACKED;
+}
+
+/*
+ * Inserts the address into the sorted reported set, returns FALSE if it was
+ * already there.
+ */
+STATIC
+BOOLEAN
+MarkStartAddressReported(_Inout_ PTHREAD_START_AUDIT Audit,
+                         _In_ UINT64                 Address)
+{
+    UINT32 low    = 0;
+    UINT32 high   = Audit->reported_count;
+    UINT32 middle = 0;
+
+    while (low < high) {
+        middle = low + (high - low) / 2;
+
+        if (Audit->reported[middle] < Address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low < Audit->reported_count && Audit->reported[low] == Address)
+        return FALSE;
+
+    if (Audit->reported_count >= THREAD_START_REPORTED_CAPACITY)
+        return TRUE;
+
+    for (UINT32 index = Audit->reported_count; index > low; index--)
+        Audit->reported[index] = Audit->reported[index - 1];
+
+    Audit->reported[low] = Address;
+    Audit->reported_count++;
+    return TRUE;
+}
+
+UINT32
+ThreadStartAuditEndRound(_Inout_ PTHREAD_START_AUDIT Audit,
+                         _In_ THREAD_START_CALLBACK  Callback,
+                         _Inout_opt_ PVOID           Context)
+{
+    UINT32 reported = 0;
+
+    for (UINT32 index = 0; index < Audit->pending_count; index++) {
+        if (!MarkStartAddressReported(Audit, Audit->pending[index].address)) {
+            Audit->suppressed++;
+            continue;
+        }
+
+        Callback(&Audit->pending[index], Context);
+        reported++;
+    }
+
+    Audit->pending_count = 0;
+    ModuleRangeIndexInitialise(&Audit->index, NULL, 0);
+
+    return reported;
+}
@@ -0,0 +1,111 @@
+#ifndef THREADSTART_H
+#define THREADSTART_H
+
+#include "platform.h"
+
+#include "system_modules.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A system thread created by a manually mapped driver starts in memory no
+ * loaded module covers, and its start addresses stay in the thread long after
+ * the stack has moved on. The audit checks the StartAddress and
+ * Win32StartAddress of every system thread against a sorted index of the
+ * loaded modules.
+ *
+ * It is incremental. Each thread records the generation it was audited in,
+ * new threads start at 0 and exited threads leave the list, so a round only
+ * resolves threads created since the last one. The generation moves on when
+ * the module list changes, which has every thread audited again, since a
+ * module unloading from under its own thread is just as suspicious.
+ *
+ * Unbacked threads are aggregated by start address within a round, and each
+ * start address is only reported once.
+ */
+#define THREAD_START_PENDING_CAPACITY  0x40
+#define THREAD_START_REPORTED_CAPACITY 0x100
+
+typedef struct _UNBACKED_THREAD_START {
+    /* the unbacked one of the two start addresses, the aggregation key */
+    UINT64 address;
+    UINT64 start_address;
+    UINT64 win32_start_address;
+
+    /* the first thread seen starting there, and how many did this round */
+    UINT64 thread;
+    UINT32 thread_id;
+    UINT32 threads;
+
+} UNBACKED_THREAD_START, *PUNBACKED_THREAD_START;
+
+typedef VOID (*THREAD_START_CALLBACK)(_In_ PUNBACKED_THREAD_START Start,
+                                      _Inout_opt_ PVOID           Context);
+
+typedef enum _THREAD_START_VERDICT {
+    THREAD_START_BACKED = 0,
+    THREAD_START_UNBACKED,
+    /* no room left to aggregate it this round, audit the thread again later */
+    THREAD_START_DEFERRED
+
+} THREAD_START_VERDICT;
+
+typedef struct _THREAD_START_AUDIT {
+    /* only valid between ThreadStartAuditBeginRound and EndRound */
+    MODULE_RANGE_INDEX index;
+
+    UINT64 module_fingerprint;
+    UINT32 generation;
+
+    UINT32                pending_count;
+    UNBACKED_THREAD_START pending[THREAD_START_PENDING_CAPACITY];
+
+    /* sorted, once full new start addresses are reported every round */
+    UINT32 reported_count;
+    UINT64 reported[THREAD_START_REPORTED_CAPACITY];
+
+    /* the last round */
+    UINT32 audited;
+    UINT32 unbacked;
+
+    /* lifetime statistics */
+    UINT64 rounds;
+    UINT64 threads_audited;
+    UINT64 suppressed;
+
+} THREAD_START_AUDIT, *PTHREAD_START_AUDIT;
+
+VOID
+ThreadStartAuditInitialise(_Out_ PTHREAD_START_AUDIT Audit);
+
+/*
+ * Ranges must hold at least one entry per module and outlive the round.
+ * Returns the generation of the round, threads last audited in an older one
+ * need auditing.
+ */
+UINT32
+ThreadStartAuditBeginRound(_Inout_ PTHREAD_START_AUDIT Audit,
+                           _In_ PMODULE_RANGE          Ranges,
+                           _In_ UINT32                 Capacity,
+                           _In_ PSYSTEM_MODULES        Modules);
+
+THREAD_START_VERDICT
+ThreadStartAuditRecord(_Inout_ PTHREAD_START_AUDIT Audit,
+                       _In_ UINT64                 Thread,
+                       _In_ UINT32                 ThreadId,
+                       _In_ UINT64                 StartAddress,
+                       _In_ UINT64                 Win32StartAddress);
+
+/* returns the number of start addresses reported */
+UINT32
+ThreadStartAuditEndRound(_Inout_ PTHREAD_START_AUDIT Audit,
+                         _In_ THREAD_START_CALLBACK  Callback,
+                         _Inout_opt_ PVOID           Context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
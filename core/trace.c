@@ -0,0 +1,286 @@
+#include "trace.h"
+
+/*
+ * The writer publishes an event by storing its sequence number last with
+ * release semantics, the reader loads it with acquire semantics before and
+ * after copying so a torn or overwritten event is never returned.
+ */
+#if defined(PLATFORM_HOST)
+#    define TraceIncrementHead(Head) \
+        __atomic_add_fetch((Head), 1, __ATOMIC_RELAXED)
+#    define TraceLoadAcquire(Address) \
+        __atomic_load_n((Address), __ATOMIC_ACQUIRE)
+#    define TraceStoreRelease(Address, Value) \
+        __atomic_store_n((Address), (Value), __ATOMIC_RELEASE)
+#    define TraceFence() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#else
+#    define TraceIncrementHead(Head) InterlockedIncrement64((Head))
+#    define TraceLoadAcquire(Address) \
+        (UINT64) ReadAcquire64((volatile LONG64*)(Address))
+#    define TraceStoreRelease(Address, Value) \
+        WriteRelease64((volatile LONG64*)(Address), (LONG64)(Value))
+#    define TraceFence() MemoryBarrier()
+#endif
+
+typedef struct _TRACE_EVENT_DESCRIPTOR {
+    LPCSTR name;
+    LPCSTR format;
+
+} TRACE_EVENT_DESCRIPTOR;
+
+STATIC const TRACE_EVENT_DESCRIPTOR trace_events[TRACE_EVENT_ID_MAX] = {
+    [TRACE_NMI_CALLBACK] = {"nmi_callback",
+                            "Interrupted RIP: %llx, Interrupted RSP: %llx"},
+    [TRACE_DPC_STACKWALK] = {"dpc_stackwalk", "Frames captured: %llx"},
+    [TRACE_APC_STACKWALK_QUEUED] = {"apc_stackwalk_queued", "Thread: %llx"},
+    [TRACE_HANDLE_ACCESS_STRIPPED] =
+        {"handle_access_stripped",
+         "Access: %llx, Stripped: %llx, Required system process: %llx"},
+    [TRACE_PCI_DEVICE] = {"pci_device",
+                          "Device: %llx, DeviceID: %llx, VendorID: %llx, "
+                          "Flagged: %llx"},
+    [TRACE_MODULE_HASHED] = {"module_hashed",
+                             "Base: %llx, Size: %llx, Status: %llx"},
+    [TRACE_MODULE_VALIDATED] = {"module_validated",
+                                "Base: %llx, Size: %llx, Valid: %llx"},
+    [TRACE_CHECK_SPAN] = {"check_span",
+                          "Check: %llx, Start: %llx, Result: %llx"},
+};
+
+STATIC const LPCSTR trace_checks[TRACE_CHECK_ID_MAX] = {
+    [TRACE_CHECK_UNKNOWN]            = "unknown",
+    [TRACE_CHECK_NMI_CALLBACKS]      = "nmi_callbacks",
+    [TRACE_CHECK_DRIVER_OBJECTS]     = "driver_objects",
+    [TRACE_CHECK_VIRTUALISATION]     = "virtualisation",
+    [TRACE_CHECK_HANDLE_TABLES]      = "handle_tables",
+    [TRACE_CHECK_PROCESS_MODULES]    = "process_modules",
+    [TRACE_CHECK_UNLINKED_PROCESSES] = "unlinked_processes",
+    [TRACE_CHECK_MODULE_INTEGRITY]   = "module_integrity",
+    [TRACE_CHECK_ATTACHED_THREADS]   = "attached_threads",
+    [TRACE_CHECK_APC_STACKWALK]      = "apc_stackwalk",
+    [TRACE_CHECK_EPT_HOOKS]          = "ept_hooks",
+    [TRACE_CHECK_DPC_STACKWALK]      = "dpc_stackwalk",
+    [TRACE_CHECK_SYSTEM_MODULES]     = "system_modules",
+    [TRACE_CHECK_PCI_DEVICES]        = "pci_devices",
+    [TRACE_CHECK_PROCESS_MEMORY]     = "process_memory",
+    [TRACE_CHECK_KERNEL_MEMORY]      = "kernel_memory",
+};
+
+STATIC
+PTRACE_RING
+TraceGetRing(_In_ PTRACE_BUFFER Buffer, _In_ UINT32 Core)
+{
+    SIZE_T stride = FIELD_OFFSET(TRACE_RING, events) +
+                    (SIZE_T)Buffer->capacity * sizeof(TRACE_EVENT);
+
+    return (PTRACE_RING)((UINT64)Buffer + sizeof(TRACE_BUFFER) +
+                         Core * stride);
+}
+
+SIZE_T
+TraceGetBufferSize(_In_ UINT32 CpuCount, _In_ UINT32 Capacity)
+{
+    return sizeof(TRACE_BUFFER) +
+           (SIZE_T)CpuCount * (FIELD_OFFSET(TRACE_RING, events) +
+                               (SIZE_T)Capacity * sizeof(TRACE_EVENT));
+}
+
+NTSTATUS
+TraceInitialise(_Out_ PVOID Buffer,
+                _In_ SIZE_T BufferSize,
+                _In_ UINT32 CpuCount,
+                _In_ UINT32 Capacity,
+                _In_ UINT64 Frequency,
+                _In_ UINT32 Source)
+{
+    PTRACE_BUFFER trace = (PTRACE_BUFFER)Buffer;
+
+    if (!Buffer || !CpuCount || !Capacity || (Capacity & (Capacity - 1)))
+        return STATUS_INVALID_PARAMETER;
+
+    if (BufferSize < TraceGetBufferSize(CpuCount, Capacity))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    RtlZeroMemory(Buffer, TraceGetBufferSize(CpuCount, Capacity));
+
+    trace->magic     = TRACE_MAGIC;
+    trace->version   = TRACE_VERSION;
+    trace->cpu_count = CpuCount;
+    trace->capacity  = Capacity;
+    trace->frequency = Frequency;
+    trace->source    = Source;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+TraceWrite(_In_ PTRACE_BUFFER Buffer,
+           _In_ UINT32        Core,
+           _In_ UINT64        Timestamp,
+           _In_ UINT16        Id,
+           _In_ UINT64        Argument0,
+           _In_ UINT64        Argument1,
+           _In_ UINT64        Argument2,
+           _In_ UINT64        Argument3)
+{
+    PTRACE_RING  ring     = NULL;
+    PTRACE_EVENT event    = NULL;
+    UINT64       position = 0;
+
+    if (!Buffer || Core >= Buffer->cpu_count)
+        return;
+
+    ring     = TraceGetRing(Buffer, Core);
+    position = (UINT64)TraceIncrementHead(&ring->head) - 1;
+    event    = &ring->events[position & (Buffer->capacity - 1)];
+
+    /* invalidate the slot first so a reader cant mistake it for the old one */
+    TraceStoreRelease(&event->sequence, 0);
+
+    event->timestamp    = Timestamp;
+    event->id           = Id;
+    event->core         = (UINT16)Core;
+    event->arguments[0] = Argument0;
+    event->arguments[1] = Argument1;
+    event->arguments[2] = Argument2;
+    event->arguments[3] = Argument3;
+
+    TraceStoreRelease(&event->sequence, position + 1);
+}
+
+VOID
+TraceWriteSpan(_In_ PTRACE_BUFFER Buffer,
+               _In_ UINT32        Core,
+               _In_ UINT64        Start,
+               _In_ UINT64        End,
+               _In_ UINT16        Check,
+               _In_ UINT64        Result)
+{
+    TraceWrite(Buffer, Core, End, TRACE_CHECK_SPAN, Check, Start, Result, 0);
+}
+
+/*
+ * Returns FALSE if the event at Position isnt readable, Overwritten tells the
+ * caller whether it is gone for good or simply not finished yet.
+ */
+STATIC
+BOOLEAN
+TraceReadEvent(_In_ PTRACE_BUFFER Buffer,
+               _In_ PTRACE_RING   Ring,
+               _In_ UINT64        Position,
+               _Out_ PTRACE_EVENT Event,
+               _Out_ PBOOLEAN     Overwritten)
+{
+    PTRACE_EVENT slot = &Ring->events[Position & (Buffer->capacity - 1)];
+    UINT64       sequence = TraceLoadAcquire(&slot->sequence);
+
+    *Overwritten = sequence > Position + 1;
+
+    if (sequence != Position + 1)
+        return FALSE;
+
+    RtlCopyMemory(Event, slot, sizeof(TRACE_EVENT));
+    TraceFence();
+
+    if (TraceLoadAcquire(&slot->sequence) != Position + 1) {
+        *Overwritten = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+SIZE_T
+TraceDrain(_In_ PTRACE_BUFFER Buffer,
+           _Out_ PVOID        Output,
+           _In_ SIZE_T        OutputSize)
+{
+    PTRACE_DRAIN_HEADER header      = (PTRACE_DRAIN_HEADER)Output;
+    PTRACE_EVENT        events      = NULL;
+    PTRACE_RING         ring        = NULL;
+    UINT64              head        = 0;
+    UINT64              cursor      = 0;
+    UINT32              maximum     = 0;
+    UINT32              core        = 0;
+    BOOLEAN             overwritten = FALSE;
+
+    if (!Buffer || !Output || OutputSize < sizeof(TRACE_DRAIN_HEADER))
+        return 0;
+
+    RtlZeroMemory(header, sizeof(TRACE_DRAIN_HEADER));
+    header->magic     = TRACE_MAGIC;
+    header->frequency = Buffer->frequency;
+    header->source    = Buffer->source;
+
+    events  = (PTRACE_EVENT)((UINT64)Output + sizeof(TRACE_DRAIN_HEADER));
+    maximum = (UINT32)((OutputSize - sizeof(TRACE_DRAIN_HEADER)) /
+                       sizeof(TRACE_EVENT));
+
+    for (UINT32 index = 0; index < Buffer->cpu_count; index++) {
+        core   = (Buffer->drain_core + index) % Buffer->cpu_count;
+        ring   = TraceGetRing(Buffer, core);
+        head   = (UINT64)TraceLoadAcquire(&ring->head);
+        cursor = ring->read_cursor;
+
+        if (head - cursor > Buffer->capacity) {
+            header->lost += head - cursor - Buffer->capacity;
+            cursor = head - Buffer->capacity;
+        }
+
+        while (cursor < head && header->event_count < maximum) {
+            if (TraceReadEvent(Buffer,
+                               ring,
+                               cursor,
+                               &events[header->event_count],
+                               &overwritten)) {
+                header->event_count++;
+            }
+            else if (!overwritten) {
+                /* reserved but still being written, pick it up next time */
+                break;
+            }
+            else {
+                header->lost++;
+            }
+
+            cursor++;
+        }
+
+        ring->read_cursor = cursor;
+
+        if (cursor < head && header->event_count == maximum) {
+            Buffer->drain_core = core;
+            break;
+        }
+    }
+
+    return sizeof(TRACE_DRAIN_HEADER) +
+           header->event_count * sizeof(TRACE_EVENT);
+}
+
+LPCSTR
+TraceGetEventName(_In_ UINT16 Id)
+{
+    if (Id >= TRACE_EVENT_ID_MAX || !trace_events[Id].name)
+        return "unknown";
+
+    return trace_events[Id].name;
+}
+
+LPCSTR
+TraceGetEventFormat(_In_ UINT16 Id)
+{
+    if (Id >= TRACE_EVENT_ID_MAX || !trace_events[Id].format)
+        return "%llx %llx %llx %llx";
+
+    return trace_events[Id].format;
+}
+
+LPCSTR
+TraceGetCheckName(_In_ UINT16 Check)
+{
+    if (Check >= TRACE_CHECK_ID_MAX)
+        return "unknown";
+
+    return trace_checks[Check];
+}
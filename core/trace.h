@@ -0,0 +1,177 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary event tracing for hot paths where DbgPrintEx is too slow or simply
+ * not allowed, e.g the NMI callback at HIGH_LEVEL.
+ *
+ * Each cpu owns a ring of fixed size events. Writers reserve a slot with a
+ * single interlocked increment of the ring head and never wait, so tracing is
+ * safe at any IRQL and from an NMI interrupting another writer on the same
+ * cpu. Only an event id and up to four raw arguments are stored, formatting
+ * is left to whoever drains the rings, the module or tools/trace.
+ *
+ * Once a ring is full the oldest events are overwritten and counted as lost
+ * by the next drain.
+ *
+ * The module keeps rings of its own for the same events, stamped with the
+ * same tsc, so drains from both can be merged into one timeline. Checks are
+ * recorded as spans, a TRACE_CHECK_SPAN event written when the check ends
+ * which carries the check, its start timestamp and its result.
+ */
+
+#define TRACE_MAGIC   0x63617254 /* Trac */
+#define TRACE_VERSION 1
+
+#define TRACE_ARGUMENT_COUNT 4
+
+/* events per cpu, must be a power of two */
+#define TRACE_DEFAULT_CAPACITY 1024
+
+#define TRACE_SOURCE_DRIVER 0
+#define TRACE_SOURCE_MODULE 1
+
+typedef enum _TRACE_EVENT_ID {
+    TRACE_NMI_CALLBACK = 1,
+    TRACE_DPC_STACKWALK,
+    TRACE_APC_STACKWALK_QUEUED,
+    TRACE_HANDLE_ACCESS_STRIPPED,
+    TRACE_PCI_DEVICE,
+    TRACE_MODULE_HASHED,
+    TRACE_MODULE_VALIDATED,
+    TRACE_CHECK_SPAN,
+    TRACE_EVENT_ID_MAX
+
+} TRACE_EVENT_ID;
+
+typedef enum _TRACE_CHECK_ID {
+    TRACE_CHECK_UNKNOWN = 0,
+    TRACE_CHECK_NMI_CALLBACKS,
+    TRACE_CHECK_DRIVER_OBJECTS,
+    TRACE_CHECK_VIRTUALISATION,
+    TRACE_CHECK_HANDLE_TABLES,
+    TRACE_CHECK_PROCESS_MODULES,
+    TRACE_CHECK_UNLINKED_PROCESSES,
+    TRACE_CHECK_MODULE_INTEGRITY,
+    TRACE_CHECK_ATTACHED_THREADS,
+    TRACE_CHECK_APC_STACKWALK,
+    TRACE_CHECK_EPT_HOOKS,
+    TRACE_CHECK_DPC_STACKWALK,
+    TRACE_CHECK_SYSTEM_MODULES,
+    TRACE_CHECK_PCI_DEVICES,
+    TRACE_CHECK_PROCESS_MEMORY,
+    TRACE_CHECK_KERNEL_MEMORY,
+    TRACE_CHECK_ID_MAX
+
+} TRACE_CHECK_ID;
+
+typedef struct _TRACE_EVENT {
+    /* position of the event in its ring plus one, written last */
+    UINT64 sequence;
+    UINT64 timestamp;
+    UINT16 id;
+    UINT16 core;
+    UINT32 reserved;
+    UINT64 arguments[TRACE_ARGUMENT_COUNT];
+    UINT64 reserved2;
+
+} TRACE_EVENT, *PTRACE_EVENT;
+
+typedef struct _TRACE_RING {
+    volatile LONG64 head;
+    UINT64          read_cursor;
+    UINT64          reserved[6];
+    TRACE_EVENT     events[1];
+
+} TRACE_RING, *PTRACE_RING;
+
+typedef struct _TRACE_BUFFER {
+    UINT32 magic;
+    UINT32 version;
+    UINT32 cpu_count;
+    UINT32 capacity;
+    /* timestamp ticks per second */
+    UINT64 frequency;
+    /* where the next drain starts, so a busy cpu cant starve the others */
+    UINT32 drain_core;
+    UINT32 source;
+    UINT64 reserved[4];
+
+} TRACE_BUFFER, *PTRACE_BUFFER;
+
+/*
+ * What a drain returns: this header followed by event_count events, in ring
+ * order per cpu but not sorted across cpus.
+ */
+typedef struct _TRACE_DRAIN_HEADER {
+    UINT32 magic;
+    UINT32 event_count;
+    UINT64 frequency;
+    UINT64 lost;
+    UINT32 source;
+    UINT32 reserved;
+
+} TRACE_DRAIN_HEADER, *PTRACE_DRAIN_HEADER;
+
+SIZE_T
+TraceGetBufferSize(_In_ UINT32 CpuCount, _In_ UINT32 Capacity);
+
+NTSTATUS
+TraceInitialise(_Out_ PVOID   Buffer,
+                _In_ SIZE_T   BufferSize,
+                _In_ UINT32   CpuCount,
+                _In_ UINT32   Capacity,
+                _In_ UINT64   Frequency,
+                _In_ UINT32   Source);
+
+VOID
+TraceWrite(_In_ PTRACE_BUFFER Buffer,
+           _In_ UINT32        Core,
+           _In_ UINT64        Timestamp,
+           _In_ UINT16        Id,
+           _In_ UINT64        Argument0,
+           _In_ UINT64        Argument1,
+           _In_ UINT64        Argument2,
+           _In_ UINT64        Argument3);
+
+/* records a check that started at Start and has just finished */
+VOID
+TraceWriteSpan(_In_ PTRACE_BUFFER Buffer,
+               _In_ UINT32        Core,
+               _In_ UINT64        Start,
+               _In_ UINT64        End,
+               _In_ UINT16        Check,
+               _In_ UINT64        Result);
+
+/*
+ * Copies every event written since the last drain into Output, a
+ * TRACE_DRAIN_HEADER followed by the events. If Output fills up the next drain
+ * resumes with the cpu this one stopped at. Only one drain may run at a time.
+ * Returns the number of bytes written.
+ */
+SIZE_T
+TraceDrain(_In_ PTRACE_BUFFER Buffer,
+           _Out_ PVOID        Output,
+           _In_ SIZE_T        OutputSize);
+
+/* name and printf format of an event, the format takes four UINT64s */
+LPCSTR
+TraceGetEventName(_In_ UINT16 Id);
+
+LPCSTR
+TraceGetEventFormat(_In_ UINT16 Id);
+
+LPCSTR
+TraceGetCheckName(_In_ UINT16 Check);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
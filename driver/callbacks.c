@@ -303,10 +303,17 @@ ImageLoadNotifyRoutineCallback(_In_opt_ PUNICODE_STRING FullImageName,
 
     FindDriverEntryByBaseAddress(ImageInfo->ImageBase, &entry);
 
-    if (entry)
+    /* the driver that was here has been unloaded and another loaded over it */
+    if (entry) {
+        ImpKeAcquireGuardedMutex(&list->lock);
+        entry->ImageSize = ImageInfo->ImageSize;
+        entry->unloaded  = FALSE;
+        ImpKeReleaseGuardedMutex(&list->lock);
+        InterlockedIncrement(&list->generation);
         return;
+    }
 
-    entry = ExAllocatePool2(
+    entry = ImpExAllocatePool2(
         POOL_FLAG_NON_PAGED, sizeof(DRIVER_LIST_ENTRY), POOL_TAG_DRIVER_LIST);
 
     if (!entry)
@@ -356,6 +363,37 @@ hash:
     }
 
     ListInsert(&list->start, entry, &list->lock);
+    InterlockedIncrement(&list->generation);
+}
+
+/*
+ * There is no notify routine for images being unloaded, so entries whose
+ * image is no longer mapped are marked as unloaded instead. Entries are never
+ * freed here, FindDriverEntryByBaseAddress hands them out past the lock.
+ */
+VOID
+DetectUnloadedDrivers()
+{
+    PDRIVER_LIST_HEAD  list     = GetDriverList();
+    PDRIVER_LIST_ENTRY entry    = NULL;
+    BOOLEAN            unloaded = FALSE;
+
+    ImpKeAcquireGuardedMutex(&list->lock);
+
+    for (entry = (PDRIVER_LIST_ENTRY)list->start.Next; entry;
+         entry = (PDRIVER_LIST_ENTRY)entry->list.Next) {
+        if (entry->unloaded || ImpMmIsAddressValid(entry->ImageBase))
+            continue;
+
+        DEBUG_VERBOSE("Driver unloaded: %s", entry->path);
+        entry->unloaded = TRUE;
+        unloaded        = TRUE;
+    }
+
+    ImpKeReleaseGuardedMutex(&list->lock);
+
+    if (unloaded)
+        InterlockedIncrement(&list->generation);
 }
 
 NTSTATUS
@@ -516,6 +554,66 @@ ProcessCreateNotifyRoutine(_In_ HANDLE  ParentId,
     }
 }
 
+/*
+ * Threads that existed before the driver loaded are inserted by
+ * SeedThreadListFromPspCidTable, which can race the notify routine for a
+ * thread being created. Only while it runs is a thread already in the list
+ * skipped, the rest of the time a create notify is always for a new thread
+ * and inserts without walking the list. A thread whose create notify was
+ * delayed past the end of seeding may still end up in the list twice, the
+ * exit notify removes every entry for it. An exiting thread is skipped too,
+ * it may already be past the exit notify and would never be removed.
+ */
+VOID
+ThreadListSetSeeding(_In_ BOOLEAN Seeding)
+{
+    PTHREAD_LIST_HEAD list = GetThreadList();
+
+    ImpKeAcquireGuardedMutex(&list->lock);
+    list->seeding = Seeding;
+    ImpKeReleaseGuardedMutex(&list->lock);
+}
+
+VOID
+ThreadListInsertThread(_In_ PKTHREAD Thread, _In_ PKPROCESS Process)
+{
+    PTHREAD_LIST_ENTRY entry = NULL;
+    PTHREAD_LIST_HEAD  list  = GetThreadList();
+
+    ImpKeAcquireGuardedMutex(&list->lock);
+
+    if (ImpPsIsThreadTerminating(Thread))
+        goto unlock;
+
+    entry = list->seeding ? (PTHREAD_LIST_ENTRY)list->start.Next : NULL;
+
+    while (entry) {
+        if (entry->thread == Thread)
+            goto unlock;
+
+        entry = (PTHREAD_LIST_ENTRY)entry->list.Next;
+    }
+
+    entry = ExAllocateFromLookasideListEx(&list->lookaside_list);
+
+    if (!entry)
+        goto unlock;
+
+    ImpObfReferenceObject(Thread);
+    ImpObfReferenceObject(Process);
+
+    entry->thread                 = Thread;
+    entry->owning_process         = Process;
+    entry->apc                    = NULL;
+    entry->apc_queued             = FALSE;
+    entry->start_audit_generation = 0;
+
+    PushEntryList(&list->start, &entry->list);
+
+unlock:
+    ImpKeReleaseGuardedMutex(&list->lock);
+}
+
 VOID
 ThreadCreateNotifyRoutine(_In_ HANDLE  ProcessId,
                           _In_ HANDLE  ThreadId,
@@ -537,31 +635,21 @@ ThreadCreateNotifyRoutine(_In_ HANDLE  ProcessId,
         return;
 
     if (Create) {
-        entry = ExAllocateFromLookasideListEx(&list->lookaside_list);
-
-        if (!entry)
-            return;
-
-        ImpObfReferenceObject(thread);
-        ImpObfReferenceObject(process);
-
-        entry->thread         = thread;
-        entry->owning_process = process;
-        entry->apc            = NULL;
-        entry->apc_queued     = FALSE;
-
-        ListInsert(&list->start, &entry->list, &list->lock);
+        ThreadListInsertThread(thread, process);
     }
     else {
-        FindThreadListEntryByThreadAddress(thread, &entry);
+        /* see ThreadListInsertThread for why there can be more than one */
+        for (;;) {
+            FindThreadListEntryByThreadAddress(thread, &entry);
 
-        if (!entry)
-            return;
+            if (!entry)
+                return;
 
-        ImpObDereferenceObject(entry->thread);
-        ImpObDereferenceObject(entry->owning_process);
+            ImpObDereferenceObject(entry->thread);
+            ImpObDereferenceObject(entry->owning_process);
 
-        LookasideListRemoveEntry(&list->start, entry, &list->lock);
+            LookasideListRemoveEntry(&list->start, entry, &list->lock);
+        }
     }
 }
 
@@ -720,6 +808,16 @@ ExUnlockHandleTableEntry(IN PHANDLE_TABLE       HandleTable,
     ImpExfUnblockPushLock(&HandleTable->HandleContentionEvent, NULL);
 }
 
+#define HANDLE_STRIP_ACCESS_ALWAYS                                        \
+    (PROCESS_CREATE_PROCESS | PROCESS_CREATE_THREAD | PROCESS_DUP_HANDLE | \
+     PROCESS_QUERY_INFORMATION | PROCESS_QUERY_LIMITED_INFORMATION |       \
+     PROCESS_VM_READ)
+
+#define HANDLE_STRIP_ACCESS_NON_CRITICAL                          \
+    (PROCESS_SET_INFORMATION | PROCESS_SET_QUOTA |                \
+     PROCESS_SUSPEND_RESUME | PROCESS_TERMINATE |                 \
+     PROCESS_VM_OPERATION | PROCESS_VM_WRITE)
+
 static UNICODE_STRING OBJECT_TYPE_PROCESS = RTL_CONSTANT_STRING(L"Process");
 static UNICODE_STRING OBJECT_TYPE_THREAD  = RTL_CONSTANT_STRING(L"Thread");
 
@@ -740,6 +838,8 @@ EnumHandleCallback(_In_ PHANDLE_TABLE       HandleTable,
     LPCSTR       process_name           = NULL;
     LPCSTR       protected_process_name = NULL;
     ACCESS_MASK  handle_access_mask     = 0;
+    ACCESS_MASK  stripped_access        = 0;
+    BOOLEAN      required_process       = FALSE;
 
     object_header = GET_OBJECT_HEADER_FROM_HANDLE(Entry->ObjectPointerBits);
 
@@ -764,82 +864,30 @@ EnumHandleCallback(_In_ PHANDLE_TABLE       HandleTable,
     if (strcmp(process_name, protected_process_name))
         goto end;
 
-    DEBUG_VERBOSE(
-        "Handle references our protected process with access mask: %lx",
-        (ACCESS_MASK)Entry->GrantedAccessBits);
-
     handle_access_mask = (ACCESS_MASK)Entry->GrantedAccessBits;
+    required_process   = !strcmp(process_name, "csrss.exe") ||
+                       !strcmp(process_name, "lsass.exe");
 
-    /* These permissions can be stripped from every process
-     * including CSRSS and LSASS */
-    if (handle_access_mask & PROCESS_CREATE_PROCESS) {
-        Entry->GrantedAccessBits &= ~PROCESS_CREATE_PROCESS;
-        DEBUG_VERBOSE("Stripped PROCESS_CREATE_PROCESS");
-    }
+    /*
+     * Some permissions can be stripped from every process including CSRSS
+     * and LSASS, the rest only from non critical processes.
+     */
+    stripped_access = handle_access_mask & HANDLE_STRIP_ACCESS_ALWAYS;
 
-    if (handle_access_mask & PROCESS_CREATE_THREAD) {
-        Entry->GrantedAccessBits &= ~PROCESS_CREATE_THREAD;
-        DEBUG_VERBOSE("Stripped PROCESS_CREATE_THREAD");
-    }
+    if (!required_process)
+        stripped_access |=
+            handle_access_mask & HANDLE_STRIP_ACCESS_NON_CRITICAL;
 
-    if (handle_access_mask & PROCESS_DUP_HANDLE) {
-        Entry->GrantedAccessBits &= ~PROCESS_DUP_HANDLE;
-        DEBUG_VERBOSE("Stripped PROCESS_DUP_HANDLE");
-    }
+    Entry->GrantedAccessBits &= ~stripped_access;
 
-    if (handle_access_mask & PROCESS_QUERY_INFORMATION) {
-        Entry->GrantedAccessBits &= ~PROCESS_QUERY_INFORMATION;
-        DEBUG_VERBOSE("Stripped PROCESS_QUERY_INFORMATION");
-    }
+    DEBUG_TRACE(TRACE_HANDLE_ACCESS_STRIPPED,
+                handle_access_mask,
+                stripped_access,
+                required_process,
+                0);
 
-    if (handle_access_mask & PROCESS_QUERY_LIMITED_INFORMATION) {
-        Entry->GrantedAccessBits &= ~PROCESS_QUERY_LIMITED_INFORMATION;
-        DEBUG_VERBOSE("Stripped PROCESS_QUERY_LIMITED_INFORMATION");
-    }
-
-    if (handle_access_mask & PROCESS_VM_READ) {
-        Entry->GrantedAccessBits &= ~PROCESS_VM_READ;
-        DEBUG_VERBOSE("Stripped PROCESS_VM_READ");
-    }
-
-    if (!strcmp(process_name, "csrss.exe") ||
-        !strcmp(process_name, "lsass.exe")) {
-        DEBUG_VERBOSE(
-            "Required system process allowed, only stripping some permissions");
+    if (required_process)
         goto end;
-    }
-
-    /* Permissions beyond here can only be stripped from non
-     * critical processes */
-    if (handle_access_mask & PROCESS_SET_INFORMATION) {
-        Entry->GrantedAccessBits &= ~PROCESS_SET_INFORMATION;
-        DEBUG_VERBOSE("Stripped PROCESS_SET_INFORMATION");
-    }
-
-    if (handle_access_mask & PROCESS_SET_QUOTA) {
-        Entry->GrantedAccessBits &= ~PROCESS_SET_QUOTA;
-        DEBUG_VERBOSE("Stripped PROCESS_SET_QUOTA");
-    }
-
-    if (handle_access_mask & PROCESS_SUSPEND_RESUME) {
-        Entry->GrantedAccessBits &= ~PROCESS_SUSPEND_RESUME;
-        DEBUG_VERBOSE("Stripped PROCESS_SUSPEND_RESUME ");
-    }
-
-    if (handle_access_mask & PROCESS_TERMINATE) {
-        Entry->GrantedAccessBits &= ~PROCESS_TERMINATE;
-        DEBUG_VERBOSE("Stripped PROCESS_TERMINATE");
-    }
-
-    if (handle_access_mask & PROCESS_VM_OPERATION) {
-        Entry->GrantedAccessBits &= ~PROCESS_VM_OPERATION;
-        DEBUG_VERBOSE("Stripped PROCESS_VM_OPERATION");
-    }
-
-    if (handle_access_mask & PROCESS_VM_WRITE) {
-        Entry->GrantedAccessBits &= ~PROCESS_VM_WRITE;
-        DEBUG_VERBOSE("Stripped PROCESS_VM_WRITE");
-    }
 
     POPEN_HANDLE_FAILURE_REPORT report =
         ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
@@ -914,8 +962,6 @@ EnumerateProcessHandles(_In_ PPROCESS_LIST_ENTRY ProcessListEntry,
     return STATUS_SUCCESS;
 }
 
-#define REPEAT_TIME_10_SEC 10000
-
 ULONG value = 10;
 
 VOID
@@ -940,6 +986,16 @@ TimerObjectWorkItemRoutine(_In_ PDEVICE_OBJECT DeviceObject,
     if (!NT_SUCCESS(status))
         DEBUG_ERROR("ValidateOurDriverImage failed with status %x", status);
 
+    status = ValidateDataPointers();
+
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("ValidateDataPointers failed with status %x", status);
+
+    status = ValidateModuleImage();
+
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("ValidateModuleImage failed with status %x", status);
+
 end:
     InterlockedExchange(&timer->state, FALSE);
 }
@@ -15,12 +15,16 @@ typedef void (*PROCESSLIST_CALLBACK_ROUTINE)(
 #define DRIVER_PATH_LENGTH  0x100
 #define SHA_256_HASH_LENGTH 32
 
+/* period of the integrity check timer, in milliseconds */
+#define REPEAT_TIME_10_SEC 10000
+
 typedef struct _DRIVER_LIST_ENTRY {
     SINGLE_LIST_ENTRY list;
     PVOID             ImageBase;
     ULONG             ImageSize;
     BOOLEAN           hashed;
     BOOLEAN           x86;
+    BOOLEAN           unloaded;
     CHAR              path[DRIVER_PATH_LENGTH];
     CHAR              text_hash[SHA_256_HASH_LENGTH];
 
@@ -95,6 +99,9 @@ VOID
 FindDriverEntryByBaseAddress(_In_ PVOID                ImageBase,
                              _Out_ PDRIVER_LIST_ENTRY* Entry);
 
+VOID
+DetectUnloadedDrivers();
+
 VOID
 CleanupProcessListOnDriverUnload();
 
@@ -106,6 +113,12 @@ ImageLoadNotifyRoutineCallback(_In_opt_ PUNICODE_STRING FullImageName,
                                _In_ HANDLE              ProcessId,
                                _In_ PIMAGE_INFO         ImageInfo);
 
+VOID
+ThreadListSetSeeding(_In_ BOOLEAN Seeding);
+
+VOID
+ThreadListInsertThread(_In_ PKTHREAD Thread, _In_ PKPROCESS Process);
+
 NTSTATUS
 InitialiseTimerObject(_Out_ PTIMER_OBJECT Timer);
 
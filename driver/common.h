@@ -6,6 +6,18 @@
 #include "io.h"
 
 #include "types/types.h"
+#include "../core/attach.h"
+#include "../core/dispatch.h"
+#include "../core/drvdispatch.h"
+#include "../core/heartbeat.h"
+#include "../core/pagehash.h"
+#include "../core/pe.h"
+#include "../core/poolscan.h"
+#include "../core/regionmap.h"
+#include "../core/smbios.h"
+#include "../core/system_modules.h"
+#include "../core/threadstart.h"
+#include "../core/trace.h"
 
 /*
  * For numbers < 32, these are equivalent to 0ul < x.
@@ -60,6 +72,9 @@ typedef struct _THREAD_LIST_HEAD {
     KGUARDED_MUTEX    lock;
     LOOKASIDE_LIST_EX lookaside_list;
 
+    /* set under lock while SeedThreadListFromPspCidTable runs */
+    BOOLEAN seeding;
+
 } THREAD_LIST_HEAD, *PTHREAD_LIST_HEAD;
 
 typedef struct _PROCESS_LIST_HEAD {
@@ -76,6 +91,9 @@ typedef struct _DRIVER_LIST_HEAD {
     volatile BOOLEAN  active;
     KGUARDED_MUTEX    lock;
 
+    /* bumped whenever a driver is loaded or found to have been unloaded */
+    volatile LONG generation;
+
     /* modules that need to be hashed later. */
     PIO_WORKITEM  deferred_work_item;
     LIST_ENTRY    deferred_list;
@@ -90,8 +108,23 @@ typedef struct _THREAD_LIST_ENTRY {
     BOOLEAN           apc_queued;
     PKAPC             apc;
 
+    /* the start address audit generation it was last checked in */
+    UINT32 start_audit_generation;
+
 } THREAD_LIST_ENTRY, *PTHREAD_LIST_ENTRY;
 
+typedef struct _THREAD_START_CONTEXT {
+    THREAD_START_AUDIT audit;
+    KGUARDED_MUTEX     lock;
+
+} THREAD_START_CONTEXT, *PTHREAD_START_CONTEXT;
+
+typedef struct _DRIVER_DISPATCH_CONTEXT {
+    DRIVER_DISPATCH_SNAPSHOT snapshot;
+    KGUARDED_MUTEX           lock;
+
+} DRIVER_DISPATCH_CONTEXT, *PDRIVER_DISPATCH_CONTEXT;
+
 typedef struct _PROCESS_LIST_ENTRY {
     SINGLE_LIST_ENTRY list;
     PKPROCESS         process;
@@ -208,6 +241,19 @@ typedef struct _IRP_QUEUE_ENTRY {
 
 #define AES_128_KEY_SIZE 16
 
+/*
+ * The user mode modules own image inside the protected process, registered
+ * once per session. Page hashes are taken the first time it is verified.
+ */
+typedef struct _MODULE_IMAGE {
+    UINT64         base;
+    SIZE_T         size;
+    UNICODE_STRING path;
+    PAGE_HASH_SET  hashes;
+    PVOID          scratch;
+
+} MODULE_IMAGE, *PMODULE_IMAGE;
+
 typedef struct _ACTIVE_SESSION {
     BOOLEAN             is_session_active;
     PVOID               um_handle;
@@ -218,6 +264,9 @@ typedef struct _ACTIVE_SESSION {
     UINT32 session_cookie;
     CHAR   session_aes_key[AES_128_KEY_SIZE];
 
+    /* derived from the root key, the module never sees it */
+    UCHAR heartbeat_key[HEARTBEAT_KEY_LENGTH];
+
     struct SESSION_STATISTICS {
         UINT32 irps_processed;
         UINT32 report_count;
@@ -226,6 +275,26 @@ typedef struct _ACTIVE_SESSION {
 
     KGUARDED_MUTEX lock;
 
+    /*
+     * Processes attached to the protected process across attached thread
+     * scans. Has its own lock as reports are completed while it is held.
+     */
+    ATTACH_TRACKER attach_tracker;
+    KGUARDED_MUTEX attach_lock;
+
+    /* taken at session start, see ValidateHalDispatchTables */
+    DISPATCH_SNAPSHOT dispatch_snapshot;
+    KGUARDED_MUTEX    dispatch_lock;
+
+    /* executable memory of the process, see ScanProcessExecutableMemory */
+    REGION_MAP     region_map;
+    MEMORY_REGION  region_buffer[2 * REGION_MAP_DEFAULT_CAPACITY];
+    KGUARDED_MUTEX region_lock;
+
+    /* see ValidateModuleImage */
+    MODULE_IMAGE   module_image;
+    KGUARDED_MUTEX module_lock;
+
 } ACTIVE_SESSION, *PACTIVE_SESSION;
 
 #define NMI_CONTEXT_POOL               '7331'
@@ -261,6 +330,14 @@ typedef struct _ACTIVE_SESSION {
 #define POOL_TAG_DRIVER_LIST           'drvl'
 #define POOL_TAG_IRP_QUEUE             'irpp'
 #define POOL_TAG_TIMER                 'time'
+#define POOL_TAG_CID_TABLE             'cidt'
+#define POOL_TAG_DATA_POINTER          'dptr'
+#define POOL_TAG_MODULE_IMAGE          'mimg'
+#define POOL_TAG_SPAN_OWNERS           'spno'
+#define POOL_TAG_STACK_CACHE           'stkc'
+#define POOL_TAG_THREAD_START          'tsta'
+#define POOL_TAG_DRIVER_DISPATCH       'drvd'
+#define POOL_TAG_REGION_MAP            'rgnm'
 
 #define IA32_APERF_MSR 0x000000E8
 
@@ -278,32 +355,26 @@ typedef struct _ACTIVE_SESSION {
 #define KTHREAD_PREVIOUS_MODE_OFFSET 0x232
 #define KTHREAD_STATE_OFFSET         0x184
 
+#define ETHREAD_WIN32_START_ADDRESS_OFFSET 0x4d0
+
 #define KTHREAD_MISC_FLAGS_APC_QUEUEABLE 14
 #define KTHREAD_MISC_FLAGS_ALERTABLE     4
 
-#define EPROCESS_PEAK_VIRTUAL_SIZE_OFFSET 0x490
-#define EPROCESS_VAD_ROOT_OFFSET          0x7d8
-#define EPROCESS_OBJECT_TABLE_OFFSET      0x570
-#define EPROCESS_IMAGE_NAME_OFFSET        0x5a8
-#define EPROCESS_PEB_OFFSET               0x550
-#define EPROCESS_SECTION_BASE_OFFSET      0x520
-#define EPROCESS_IMAGE_FILE_NAME_OFFSET   0x5a8
-#define EPROCESS_HANDLE_TABLE_OFFSET      0x570
-#define EPROCESS_PLIST_ENTRY_OFFSET       0x448
+#define EPROCESS_VAD_ROOT_OFFSET        0x7d8
+#define EPROCESS_IMAGE_NAME_OFFSET      0x5a8
+#define EPROCESS_SECTION_BASE_OFFSET    0x520
+#define EPROCESS_IMAGE_FILE_NAME_OFFSET 0x5a8
+#define EPROCESS_HANDLE_TABLE_OFFSET    0x570
+#define EPROCESS_PLIST_ENTRY_OFFSET     0x448
+#define EPROCESS_SIGNATURE_LEVEL_OFFSET 0x878
 
-#define KPROCESS_THREADLIST_OFFSET           0x030
-#define KPROCESS_DIRECTORY_TABLE_BASE_OFFSET 0x028
+#define KPROCESS_THREADLIST_OFFSET 0x030
 
-#define OBJECT_HEADER_SIZE              0x30
 #define OBJECT_HEADER_TYPE_INDEX_OFFSET 0x018
 
-#define POOL_HEADER_BLOCK_SIZE_OFFSET 0x02
-#define POOL_HEADER_TAG_OFFSET        0x04
-
 #define KPROCESS_OFFSET_FROM_POOL_HEADER_SIZE_1 0x70
 #define KPROCESS_OFFSET_FROM_POOL_HEADER_SIZE_2 0x80
 #define KPROCESS_OFFSET_FROM_POOL_HEADER_SIZE_3 0x30
-#define EPROCESS_SIZE                           0xa40
 
 #define KPCRB_CURRENT_THREAD 0x8
 
@@ -312,22 +383,6 @@ typedef struct _ACTIVE_SESSION {
 
 #define MODULE_VALIDATION_FAILURE_MAX_REPORT_COUNT 20
 
-#define IMAGE_DIRECTORY_ENTRY_EXPORT         0
-#define IMAGE_DIRECTORY_ENTRY_IMPORT         1
-#define IMAGE_DIRECTORY_ENTRY_RESOURCE       2
-#define IMAGE_DIRECTORY_ENTRY_EXCEPTION      3
-#define IMAGE_DIRECTORY_ENTRY_SECURITY       4
-#define IMAGE_DIRECTORY_ENTRY_BASERELOC      5
-#define IMAGE_DIRECTORY_ENTRY_DEBUG          6
-#define IMAGE_DIRECTORY_ENTRY_COPYRIGHT      7
-#define IMAGE_DIRECTORY_ENTRY_GLOBALPTR      8 /* (MIPS GP) */
-#define IMAGE_DIRECTORY_ENTRY_TLS            9
-#define IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG    10
-#define IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT   11
-#define IMAGE_DIRECTORY_ENTRY_IAT            12 /* Import Address Table */
-#define IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT   13
-#define IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR 14
-
 /*
  * Generic macros that allow you to quickly determine whether
  *  or not a page table entry is present or may forward to a
@@ -383,14 +438,6 @@ typedef struct _DEVICE_MAP {
 
 } DEVICE_MAP, *PDEVICE_MAP;
 
-typedef struct _RTL_MODULE_EXTENDED_INFO {
-    PVOID  ImageBase;
-    ULONG  ImageSize;
-    USHORT FileNameOffset;
-    CHAR   FullPathName[0x100];
-
-} RTL_MODULE_EXTENDED_INFO, *PRTL_MODULE_EXTENDED_INFO;
-
 /*
 Thread Information Block: (GS register)
 
@@ -540,33 +587,6 @@ typedef union _EXHANDLE {
 
 #pragma warning(disable : 4214 4201)
 
-#pragma pack(push, 1)
-typedef struct _POOL_HEADER // Size=16
-{
-    union {
-        struct {
-            unsigned long PreviousSize : 8; // Size=4 Offset=0 BitOffset=0
-                                            // BitCount=8
-            unsigned long PoolIndex : 8;    // Size=4 Offset=0
-                                            // BitOffset=8 BitCount=8
-            unsigned long BlockSize : 8;    // Size=4 Offset=0
-                                            // BitOffset=16 BitCount=8
-            unsigned long PoolType : 8;     // Size=4 Offset=0
-                                            // BitOffset=24 BitCount=8
-        };
-        unsigned long Ulong1; // Size=4 Offset=0
-    };
-    unsigned long PoolTag; // Size=4 Offset=4
-    union {
-        struct _EPROCESS* ProcessBilled; // Size=8 Offset=8
-        struct {
-            unsigned short AllocatorBackTraceIndex; // Size=2 Offset=8
-            unsigned short PoolTagHash;             // Size=2 Offset=10
-        };
-    };
-} POOL_HEADER, *PPOOL_HEADER;
-#pragma pack(pop)
-
 typedef struct _HANDLE_TABLE_ENTRY // Size=16
 {
     union {
@@ -711,137 +731,9 @@ typedef struct _OBJECT_HEADER {
     QUAD  Body;
 } OBJECT_HEADER, *POBJECT_HEADER;
 
-#define IMAGE_SCN_MEM_EXECUTE 0x20000000
-#define IMAGE_SCN_MEM_READ    0x40000000
-#define IMAGE_SCN_MEM_WRITE   0x80000000
-
-#define IMAGE_SIZEOF_SHORT_NAME 8
-
-typedef struct _IMAGE_SECTION_HEADER {
-    unsigned char Name[IMAGE_SIZEOF_SHORT_NAME];
-    union {
-        unsigned long PhysicalAddress;
-        unsigned long VirtualSize;
-    } Misc;
-    unsigned long  VirtualAddress;
-    unsigned long  SizeOfRawData;
-    unsigned long  PointerToRawData;
-    unsigned long  PointerToRelocations;
-    unsigned long  PointerToLinenumbers;
-    unsigned short NumberOfRelocations;
-    unsigned short NumberOfLinenumbers;
-    unsigned long  Characteristics;
-} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
-
-typedef struct _IMAGE_FILE_HEADER {
-    unsigned short Machine;
-    unsigned short NumberOfSections;
-    unsigned long  TimeDateStamp;
-    unsigned long  PointerToSymbolTable;
-    unsigned long  NumberOfSymbols;
-    unsigned short SizeOfOptionalHeader;
-    unsigned short Characteristics;
-} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
-
-typedef struct _IMAGE_DATA_DIRECTORY {
-    unsigned long VirtualAddress;
-    unsigned long Size;
-} IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
-
-#define IMAGE_NUMBEROF_DIRECTORY_ENTRIES 16
-
-typedef struct _IMAGE_OPTIONAL_HEADER64 {
-    unsigned short       Magic;
-    unsigned char        MajorLinkerVersion;
-    unsigned char        MinorLinkerVersion;
-    unsigned long        SizeOfCode;
-    unsigned long        SizeOfInitializedData;
-    unsigned long        SizeOfUninitializedData;
-    unsigned long        AddressOfEntryPoint;
-    unsigned long        BaseOfCode;
-    ULONGLONG            ImageBase;
-    unsigned long        SectionAlignment;
-    unsigned long        FileAlignment;
-    unsigned short       MajorOperatingSystemVersion;
-    unsigned short       MinorOperatingSystemVersion;
-    unsigned short       MajorImageVersion;
-    unsigned short       MinorImageVersion;
-    unsigned short       MajorSubsystemVersion;
-    unsigned short       MinorSubsystemVersion;
-    unsigned long        Win32VersionValue;
-    unsigned long        SizeOfImage;
-    unsigned long        SizeOfHeaders;
-    unsigned long        CheckSum;
-    unsigned short       Subsystem;
-    unsigned short       DllCharacteristics;
-    ULONGLONG            SizeOfStackReserve;
-    ULONGLONG            SizeOfStackCommit;
-    ULONGLONG            SizeOfHeapReserve;
-    ULONGLONG            SizeOfHeapCommit;
-    unsigned long        LoaderFlags;
-    unsigned long        NumberOfRvaAndSizes;
-    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
-} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
-
 typedef unsigned long  DWORD;
 typedef unsigned short WORD;
 
-typedef struct _IMAGE_OPTIONAL_HEADER32 {
-    WORD                 Magic;
-    BYTE                 MajorLinkerVersion;
-    BYTE                 MinorLinkerVersion;
-    DWORD                SizeOfCode;
-    DWORD                SizeOfInitializedData;
-    DWORD                SizeOfUninitializedData;
-    DWORD                AddressOfEntryPoint;
-    DWORD                BaseOfCode;
-    DWORD                BaseOfData;
-    DWORD                ImageBase;
-    DWORD                SectionAlignment;
-    DWORD                FileAlignment;
-    WORD                 MajorOperatingSystemVersion;
-    WORD                 MinorOperatingSystemVersion;
-    WORD                 MajorImageVersion;
-    WORD                 MinorImageVersion;
-    WORD                 MajorSubsystemVersion;
-    WORD                 MinorSubsystemVersion;
-    DWORD                Win32VersionValue;
-    DWORD                SizeOfImage;
-    DWORD                SizeOfHeaders;
-    DWORD                CheckSum;
-    WORD                 Subsystem;
-    WORD                 DllCharacteristics;
-    DWORD                SizeOfStackReserve;
-    DWORD                SizeOfStackCommit;
-    DWORD                SizeOfHeapReserve;
-    DWORD                SizeOfHeapCommit;
-    DWORD                LoaderFlags;
-    DWORD                NumberOfRvaAndSizes;
-    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
-} IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
-
-typedef struct _IMAGE_DOS_HEADER { // DOS .EXE header
-    unsigned short e_magic;        // Magic number
-    unsigned short e_cblp;         // Bytes on last page of file
-    unsigned short e_cp;           // Pages in file
-    unsigned short e_crlc;         // Relocations
-    unsigned short e_cparhdr;      // Size of header in paragraphs
-    unsigned short e_minalloc;     // Minimum extra paragraphs needed
-    unsigned short e_maxalloc;     // Maximum extra paragraphs needed
-    unsigned short e_ss;           // Initial (relative) SS value
-    unsigned short e_sp;           // Initial SP value
-    unsigned short e_csum;         // Checksum
-    unsigned short e_ip;           // Initial IP value
-    unsigned short e_cs;           // Initial (relative) CS value
-    unsigned short e_lfarlc;       // File address of relocation table
-    unsigned short e_ovno;         // Overlay number
-    unsigned short e_res[4];       // Reserved words
-    unsigned short e_oemid;        // OEM identifier (for e_oeminfo)
-    unsigned short e_oeminfo;      // OEM information; e_oemid specific
-    unsigned short e_res2[10];     // Reserved words
-    LONG           e_lfanew;       // File address of new exe header
-} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
-
 typedef struct _KLDR_DATA_TABLE_ENTRY {
     LIST_ENTRY InLoadOrderLinks;
     PVOID      ExceptionTable;
@@ -864,31 +756,6 @@ typedef struct _KLDR_DATA_TABLE_ENTRY {
     PVOID PatchInformation;
 } KLDR_DATA_TABLE_ENTRY, *PKLDR_DATA_TABLE_ENTRY;
 
-typedef struct _IMAGE_EXPORT_DIRECTORY {
-    DWORD Characteristics;
-    DWORD TimeDateStamp;
-    WORD  MajorVersion;
-    WORD  MinorVersion;
-    DWORD Name;
-    DWORD Base;
-    DWORD NumberOfFunctions;
-    DWORD NumberOfNames;
-    DWORD AddressOfFunctions;
-    DWORD AddressOfNames;
-    DWORD AddressOfNameOrdinals;
-} IMAGE_EXPORT_DIRECTORY, *PIMAGE_EXPORT_DIRECTORY;
-
-typedef struct _LOCAL_NT_HEADER {
-    unsigned long           Signature;
-    IMAGE_FILE_HEADER       FileHeader;
-    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
-} LOCAL_NT_HEADER, *PLOCAL_NT_HEADER;
-
-#define IMAGE_FIRST_SECTION(ntheader)                                        \
-    ((PIMAGE_SECTION_HEADER)((ULONG_PTR)(ntheader) +                         \
-                             FIELD_OFFSET(LOCAL_NT_HEADER, OptionalHeader) + \
-                             ((ntheader))->FileHeader.SizeOfOptionalHeader))
-
 /* creds: https://www.unknowncheats.me/forum/2602838-post2.html */
 
 typedef struct _DBGKD_DEBUG_DATA_HEADER64 {
@@ -1262,56 +1129,6 @@ typedef union _PD_ENTRY_LARGE {
 //     };
 // } KAPC_STATE, * PKAPC_STATE, * PRKAPC_STATE;
 
-typedef struct _RAW_SMBIOS_DATA {
-    BYTE   Used20CallingMethod;
-    BYTE   SMBIOSMajorVersion;
-    BYTE   SMBIOSMinorVersion;
-    BYTE   DmiRevision;
-    UINT32 Length;
-    BYTE   SMBIOSTableData[1];
-} RAW_SMBIOS_DATA, *PRAW_SMBIOS_DATA;
-
-typedef struct _SMBIOS_TABLE_HEADER {
-    UCHAR  Type;
-    UCHAR  Length;
-    USHORT Handle;
-    PCHAR  TableData;
-
-} SMBIOS_TABLE_HEADER, *PSMBIOS_TABLE_HEADER;
-
-typedef struct _RAW_SMBIOS_TABLE_01 {
-    UCHAR  Type;
-    UCHAR  Length;
-    USHORT Handle;
-    UCHAR  Manufacturer;
-    UCHAR  ProductName;
-    UCHAR  Version;
-    UCHAR  SerialNumber;
-    UCHAR  UUID[16];
-    UCHAR  WakeUpType;
-    UCHAR  SKUNumber;
-    UCHAR  Family;
-
-} RAW_SMBIOS_TABLE_01, *PRAW_SMBIOS_TABLE_01;
-
-typedef struct _RAW_SMBIOS_TABLE_02 {
-    UCHAR  Type;
-    UCHAR  Length;
-    USHORT Handle;
-    BYTE   Manufacturer;
-    BYTE   Product;
-    BYTE   Version;
-    BYTE   SerialNumber;
-    BYTE   AssetTag;
-    BYTE   FeatureFlags;
-    BYTE   LocationInChassis;
-    UINT16 ChassisHandle;
-    BYTE   BoardType;
-    BYTE   NumberOfContainedObjectHandles;
-    BYTE   ContainedObjectHandles[256];
-
-} RAW_SMBIOS_TABLE_02, *PRAW_SMBIOS_TABLE_02;
-
 typedef struct _RTL_RELATIVE_NAME {
     UNICODE_STRING RelativeName;
     HANDLE         ContainingDirectory;
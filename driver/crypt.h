@@ -3,17 +3,7 @@
 
 #include "common.h"
 
-VOID
-CryptEncryptImportsArray(_In_ PUINT64 Array, _In_ UINT32 Entries);
+/* The import cipher lives in the core library so it can be tested off box. */
+#include "../core/cipher.h"
 
-UINT64
-CryptDecryptImportsArrayEntry(_In_ PUINT64 Array,
-                              _In_ UINT32  Entries,
-                              _In_ UINT32  EntryIndex);
-
-VOID
-CryptDecryptBufferWithCookie(_In_ PVOID  Buffer,
-                             _In_ UINT32 BufferSize,
-                             _In_ UINT32 Cookie);
-
-#endif
\ No newline at end of file
+#endif
@@ -76,28 +76,33 @@ DrvLoadInitialiseDriverConfig(_In_ PDRIVER_OBJECT  DriverObject,
 #endif
 
 typedef struct _DRIVER_CONFIG {
-    volatile LONG          nmi_status;
-    UNICODE_STRING         unicode_driver_name;
-    ANSI_STRING            ansi_driver_name;
-    PUNICODE_STRING        device_name;
-    PUNICODE_STRING        device_symbolic_link;
-    UNICODE_STRING         driver_path;
-    UNICODE_STRING         registry_path;
-    SYSTEM_INFORMATION     system_information;
-    PVOID                  apc_contexts[MAXIMUM_APC_CONTEXTS];
-    PDRIVER_OBJECT         driver_object;
-    PDEVICE_OBJECT         device_object;
-    volatile BOOLEAN       unload_in_progress;
-    KGUARDED_MUTEX         lock;
-    SYS_MODULE_VAL_CONTEXT sys_val_context;
-    IRP_QUEUE_HEAD         irp_queue;
-    TIMER_OBJECT           timer;
-    ACTIVE_SESSION         active_session;
-    THREAD_LIST_HEAD       thread_list;
-    DRIVER_LIST_HEAD       driver_list;
-    PROCESS_LIST_HEAD      process_list;
-    SHARED_MAPPING         mapping;
-    BOOLEAN                has_driver_loaded;
+    volatile LONG           nmi_status;
+    UNICODE_STRING          unicode_driver_name;
+    ANSI_STRING             ansi_driver_name;
+    PUNICODE_STRING         device_name;
+    PUNICODE_STRING         device_symbolic_link;
+    UNICODE_STRING          driver_path;
+    UNICODE_STRING          registry_path;
+    SYSTEM_INFORMATION      system_information;
+    PVOID                   apc_contexts[MAXIMUM_APC_CONTEXTS];
+    PDRIVER_OBJECT          driver_object;
+    PDEVICE_OBJECT          device_object;
+    volatile BOOLEAN        unload_in_progress;
+    KGUARDED_MUTEX          lock;
+    SYS_MODULE_VAL_CONTEXT  sys_val_context;
+    DATA_POINTER_CONTEXT    data_pointer_context;
+    STACK_CACHE_CONTEXT     stack_cache;
+    THREAD_START_CONTEXT    thread_start;
+    DRIVER_DISPATCH_CONTEXT driver_dispatch;
+    IRP_QUEUE_HEAD          irp_queue;
+    TIMER_OBJECT            timer;
+    ACTIVE_SESSION          active_session;
+    THREAD_LIST_HEAD        thread_list;
+    DRIVER_LIST_HEAD        driver_list;
+    PROCESS_LIST_HEAD       process_list;
+    SHARED_MAPPING          mapping;
+    PTRACE_BUFFER           trace;
+    BOOLEAN                 has_driver_loaded;
 
 } DRIVER_CONFIG, *PDRIVER_CONFIG;
 
@@ -116,6 +121,10 @@ UNICODE_STRING g_DeviceSymbolicLink = RTL_CONSTANT_STRING(L"\\??\\DonnaAC");
 PDRIVER_CONFIG g_DriverConfig = NULL;
 
 #define POOL_TAG_CONFIG 'conf'
+#define POOL_TAG_TRACE  'cart'
+
+/* how long to stall for when calibrating the trace timestamps, in us */
+#define TRACE_CALIBRATION_PERIOD 1000
 
 BOOLEAN
 HasDriverLoaded()
@@ -211,6 +220,32 @@ GetSystemModuleValidationContext()
     return &g_DriverConfig->sys_val_context;
 }
 
+PDATA_POINTER_CONTEXT
+GetDataPointerContext()
+{
+    PAGED_CODE();
+    return &g_DriverConfig->data_pointer_context;
+}
+
+PSTACK_CACHE_CONTEXT
+GetStackCacheContext()
+{
+    return &g_DriverConfig->stack_cache;
+}
+
+PTHREAD_START_CONTEXT
+GetThreadStartContext()
+{
+    PAGED_CODE();
+    return &g_DriverConfig->thread_start;
+}
+
+PDRIVER_DISPATCH_CONTEXT
+GetDriverDispatchContext()
+{
+    return &g_DriverConfig->driver_dispatch;
+}
+
 PUNICODE_STRING
 GetDriverPath()
 {
@@ -260,6 +295,12 @@ GetDriverList()
     return &g_DriverConfig->driver_list;
 }
 
+PTRACE_BUFFER
+GetTraceBuffer()
+{
+    return g_DriverConfig->trace;
+}
+
 PPROCESS_LIST_HEAD
 GetProcessList()
 {
@@ -350,6 +391,51 @@ DrvUnloadFreeModuleValidationContext()
     CleanupValidationContextOnUnload(&g_DriverConfig->sys_val_context);
 }
 
+STATIC
+VOID
+DrvUnloadFreeDataPointerContext()
+{
+    PAGED_CODE();
+    CleanupDataPointerContextOnUnload(&g_DriverConfig->data_pointer_context);
+}
+
+STATIC
+VOID
+DrvUnloadFreeStackCache()
+{
+    PAGED_CODE();
+    CleanupStackCacheOnUnload(&g_DriverConfig->stack_cache);
+}
+
+STATIC
+VOID
+DrvUnloadFreeDriverDispatchSnapshot()
+{
+    PAGED_CODE();
+    CleanupDriverDispatchOnUnload(&g_DriverConfig->driver_dispatch);
+}
+
+STATIC
+VOID
+DrvUnloadFreeRegionMap()
+{
+    PAGED_CODE();
+    ResetProcessMemoryScan();
+}
+
+STATIC
+VOID
+DrvUnloadFreeTraceBuffer()
+{
+    PTRACE_BUFFER trace = g_DriverConfig->trace;
+
+    if (!trace)
+        return;
+
+    g_DriverConfig->trace = NULL;
+    ImpExFreePoolWithTag(trace, POOL_TAG_TRACE);
+}
+
 STATIC
 VOID
 DriverUnload(_In_ PDRIVER_OBJECT DriverObject)
@@ -369,6 +455,10 @@ DriverUnload(_In_ PDRIVER_OBJECT DriverObject)
 
     DrvUnloadFreeTimerObject();
     DrvUnloadFreeModuleValidationContext();
+    DrvUnloadFreeDataPointerContext();
+    DrvUnloadFreeStackCache();
+    DrvUnloadFreeDriverDispatchSnapshot();
+    DrvUnloadFreeRegionMap();
     DrvUnloadUnregisterObCallbacks();
 
     UnregisterThreadCreateNotifyRoutine();
@@ -380,6 +470,7 @@ DriverUnload(_In_ PDRIVER_OBJECT DriverObject)
     DrvUnloadFreeDriverList();
 
     DrvUnloadFreeConfigStrings();
+    DrvUnloadFreeTraceBuffer();
     DrvUnloadDeleteSymbolicLink();
     ImpIoDeleteDevice(DriverObject->DeviceObject);
 
@@ -469,6 +560,7 @@ DrvLoadSetupDriverLists()
         return status;
     }
 
+    SeedThreadListFromPspCidTable();
     return status;
 }
 
@@ -757,6 +849,68 @@ DrvLoadRetrieveDriverNameFromRegistry(_In_ PUNICODE_STRING RegistryPath)
     return status;
 }
 
+/*
+ * Events are stamped with the raw tsc since it is the cheapest clock we can
+ * read at any IRQL, so measure its frequency against the performance counter
+ * once here for whoever converts the timestamps later on.
+ */
+STATIC
+UINT64
+DrvLoadCalibrateTraceFrequency()
+{
+    LARGE_INTEGER frequency = {0};
+    LARGE_INTEGER start     = {0};
+    LARGE_INTEGER end       = {0};
+    UINT64        tsc_start = 0;
+    UINT64        tsc_end   = 0;
+
+    start     = KeQueryPerformanceCounter(&frequency);
+    tsc_start = __rdtsc();
+
+    KeStallExecutionProcessor(TRACE_CALIBRATION_PERIOD);
+
+    end     = KeQueryPerformanceCounter(NULL);
+    tsc_end = __rdtsc();
+
+    if (end.QuadPart <= start.QuadPart)
+        return 0;
+
+    return (tsc_end - tsc_start) * frequency.QuadPart /
+           (end.QuadPart - start.QuadPart);
+}
+
+STATIC
+NTSTATUS
+DrvLoadInitialiseTraceBuffer()
+{
+    NTSTATUS status    = STATUS_UNSUCCESSFUL;
+    UINT32   cpu_count = ImpKeQueryActiveProcessorCount(0);
+    SIZE_T   size      = 0;
+    PVOID    buffer    = NULL;
+
+    size   = TraceGetBufferSize(cpu_count, TRACE_DEFAULT_CAPACITY);
+    buffer = ImpExAllocatePool2(POOL_FLAG_NON_PAGED, size, POOL_TAG_TRACE);
+
+    if (!buffer)
+        return STATUS_MEMORY_NOT_ALLOCATED;
+
+    status = TraceInitialise(buffer,
+                             size,
+                             cpu_count,
+                             TRACE_DEFAULT_CAPACITY,
+                             DrvLoadCalibrateTraceFrequency(),
+                             TRACE_SOURCE_DRIVER);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("TraceInitialise failed with status %x", status);
+        ImpExFreePoolWithTag(buffer, POOL_TAG_TRACE);
+        return status;
+    }
+
+    g_DriverConfig->trace = buffer;
+    return status;
+}
+
 STATIC
 NTSTATUS
 DrvLoadInitialiseDriverConfig(_In_ PDRIVER_OBJECT  DriverObject,
@@ -768,6 +922,10 @@ DrvLoadInitialiseDriverConfig(_In_ PDRIVER_OBJECT  DriverObject,
     NTSTATUS status = STATUS_UNSUCCESSFUL;
 
     ImpKeInitializeGuardedMutex(&g_DriverConfig->lock);
+    KeInitializeSpinLock(&g_DriverConfig->stack_cache.lock);
+    ImpKeInitializeGuardedMutex(&g_DriverConfig->thread_start.lock);
+    ThreadStartAuditInitialise(&g_DriverConfig->thread_start.audit);
+    ImpKeInitializeGuardedMutex(&g_DriverConfig->driver_dispatch.lock);
 
     IrpQueueInitialise();
     SessionInitialiseCallbackConfiguration();
@@ -809,6 +967,14 @@ DrvLoadInitialiseDriverConfig(_In_ PDRIVER_OBJECT  DriverObject,
         return status;
     }
 
+    status = DrvLoadInitialiseTraceBuffer();
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("DrvLoadInitialiseTraceBuffer failed with status %x",
+                    status);
+        return status;
+    }
+
     DEBUG_VERBOSE("driver name: %s", g_DriverConfig->ansi_driver_name.Buffer);
     return status;
 }
@@ -868,6 +1034,7 @@ DriverEntry(_In_ PDRIVER_OBJECT DriverObject, _In_ PUNICODE_STRING RegistryPath)
     if (!NT_SUCCESS(status)) {
         DEBUG_ERROR("IoCreateSymbolicLink failed with status %x", status);
         DrvUnloadFreeConfigStrings();
+        DrvUnloadFreeTraceBuffer();
         DrvUnloadFreeTimerObject();
         ImpIoDeleteDevice(DriverObject->DeviceObject);
         return status;
@@ -878,6 +1045,7 @@ DriverEntry(_In_ PDRIVER_OBJECT DriverObject, _In_ PUNICODE_STRING RegistryPath)
     if (!NT_SUCCESS(status)) {
         DEBUG_ERROR("EnablenotifyRoutines failed with status %x", status);
         DrvUnloadFreeConfigStrings();
+        DrvUnloadFreeTraceBuffer();
         DrvUnloadFreeTimerObject();
         DrvUnloadDeleteSymbolicLink();
         ImpIoDeleteDevice(DriverObject->DeviceObject);
@@ -889,6 +1057,7 @@ DriverEntry(_In_ PDRIVER_OBJECT DriverObject, _In_ PUNICODE_STRING RegistryPath)
     if (!NT_SUCCESS(status)) {
         DEBUG_ERROR("DrvLoadSetupDriverLists failed with status %x", status);
         DrvUnloadFreeConfigStrings();
+        DrvUnloadFreeTraceBuffer();
         DrvUnloadFreeTimerObject();
         DrvUnloadDeleteSymbolicLink();
         ImpIoDeleteDevice(DriverObject->DeviceObject);
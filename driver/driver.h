@@ -28,6 +28,18 @@ GetIrpQueueHead();
 PSYS_MODULE_VAL_CONTEXT
 GetSystemModuleValidationContext();
 
+PDATA_POINTER_CONTEXT
+GetDataPointerContext();
+
+PSTACK_CACHE_CONTEXT
+GetStackCacheContext();
+
+PTHREAD_START_CONTEXT
+GetThreadStartContext();
+
+PDRIVER_DISPATCH_CONTEXT
+GetDriverDispatchContext();
+
 PUNICODE_STRING
 GetDriverPath();
 
@@ -52,6 +64,32 @@ GetDriverList();
 PPROCESS_LIST_HEAD
 GetProcessList();
 
+PTRACE_BUFFER
+GetTraceBuffer();
+
+/*
+ * Records an event in the calling cpu's trace ring. Unlike DEBUG_VERBOSE this
+ * never formats anything and is safe at any IRQL, use it on hot paths.
+ */
+#define DEBUG_TRACE(id, a0, a1, a2, a3)             \
+    TraceWrite(GetTraceBuffer(),                    \
+               KeGetCurrentProcessorNumber(),       \
+               __rdtsc(),                           \
+               (id),                                \
+               (UINT64)(a0),                        \
+               (UINT64)(a1),                        \
+               (UINT64)(a2),                        \
+               (UINT64)(a3))
+
+/* records a check which started at the tsc value start and has just ended */
+#define DEBUG_TRACE_SPAN(check, start, result)     \
+    TraceWriteSpan(GetTraceBuffer(),               \
+                   KeGetCurrentProcessorNumber(),  \
+                   (start),                        \
+                   __rdtsc(),                      \
+                   (check),                        \
+                   (UINT64)(result))
+
 PUINT64
 GetApcContextArray();
 
@@ -1,6 +1,8 @@
 #include "hw.h"
 
+#include "driver.h"
 #include "modules.h"
+#include "imports.h"
 
 #define PCI_VENDOR_ID_OFFSET 0x00
 #define PCI_DEVICE_ID_OFFSET 0x02
@@ -137,7 +139,7 @@ EnumerateDriverObjectDeviceObjects(_In_ PDRIVER_OBJECT    DriverObject,
     }
 
     buffer_size = object_count * sizeof(UINT64);
-    buffer = ExAllocatePool2(POOL_FLAG_NON_PAGED, buffer_size, POOL_TAG_HW);
+    buffer = ImpExAllocatePool2(POOL_FLAG_NON_PAGED, buffer_size, POOL_TAG_HW);
 
     if (!buffer)
         return STATUS_INSUFFICIENT_RESOURCES;
@@ -148,7 +150,7 @@ EnumerateDriverObjectDeviceObjects(_In_ PDRIVER_OBJECT    DriverObject,
     if (!NT_SUCCESS(status)) {
         DEBUG_ERROR("IoEnumerateDeviceObjectList failed with status %x",
                     status);
-        ExFreePoolWithTag(buffer, POOL_TAG_HW);
+        ImpExFreePoolWithTag(buffer, POOL_TAG_HW);
         return status;
     }
 
@@ -240,7 +242,7 @@ EnumeratePciDeviceObjects(_In_ PCI_DEVICE_CALLBACK CallbackRoutine,
 
 end:
     if (pci_device_objects)
-        ExFreePoolWithTag(pci_device_objects, POOL_TAG_HW);
+        ImpExFreePoolWithTag(pci_device_objects, POOL_TAG_HW);
 
     return status;
 }
@@ -272,17 +274,11 @@ PciDeviceQueryCallback(_In_ PDEVICE_OBJECT DeviceObject, _In_opt_ PVOID Context)
         return status;
     }
 
-    if (IsPciConfigurationSpaceFlagged(&header)) {
-        DEBUG_VERBOSE("Flagged DeviceID found. Device: %llx, DeviceId: %lx",
-                      (UINT64)DeviceObject,
-                      header.DeviceID);
-    }
-    else {
-        DEBUG_VERBOSE("Device: %llx, DeviceID: %lx, VendorID: %lx",
-                      DeviceObject,
-                      header.DeviceID,
-                      header.VendorID);
-    }
+    DEBUG_TRACE(TRACE_PCI_DEVICE,
+                DeviceObject,
+                header.DeviceID,
+                header.VendorID,
+                IsPciConfigurationSpaceFlagged(&header));
 
     return status;
 }
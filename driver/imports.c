@@ -5,8 +5,33 @@
 #include "crypt.h"
 #include <stdarg.h>
 
+/*
+ * Compares a loader entry name against a null terminated string without
+ * relying on the entry being terminated, BaseDllName is only bounded by its
+ * Length. No imports are used since this runs before any are resolved.
+ */
+STATIC
+BOOLEAN
+IsLoaderEntryName(_In_ PUNICODE_STRING EntryName, _In_ PWCH Name)
+{
+    USHORT length = EntryName->Length / sizeof(WCHAR);
+    USHORT index  = 0;
+
+    if (!EntryName->Buffer)
+        return FALSE;
+
+    for (index = 0; index < length; index++) {
+        if (!Name[index] || EntryName->Buffer[index] != Name[index])
+            return FALSE;
+    }
+
+    return Name[index] == L'\0';
+}
+
 PVOID
-FindDriverBaseNoApi(_In_ PDRIVER_OBJECT DriverObject, _In_ PWCH Name)
+FindDriverBaseNoApi(_In_ PDRIVER_OBJECT DriverObject,
+                    _In_ PWCH           Name,
+                    _Out_opt_ PULONG    ImageSize)
 {
     PKLDR_DATA_TABLE_ENTRY first =
         (PKLDR_DATA_TABLE_ENTRY)DriverObject->DriverSection;
@@ -16,11 +41,14 @@ FindDriverBaseNoApi(_In_ PDRIVER_OBJECT DriverObject, _In_ PWCH Name)
         ((PKLDR_DATA_TABLE_ENTRY)DriverObject->DriverSection)
             ->InLoadOrderLinks.Flink->Flink;
 
+    if (ImageSize)
+        *ImageSize = 0;
+
     while (entry->InLoadOrderLinks.Flink != first) {
-        /* todo: write our own unicode string comparison function, since
-         * the entire point of this is to find exports with no exports.
-         */
-        if (!wcscmp(entry->BaseDllName.Buffer, Name)) {
+        if (IsLoaderEntryName(&entry->BaseDllName, Name)) {
+            if (ImageSize)
+                *ImageSize = entry->SizeOfImage;
+
             return entry->DllBase;
         }
 
@@ -33,60 +61,18 @@ FindDriverBaseNoApi(_In_ PDRIVER_OBJECT DriverObject, _In_ PWCH Name)
 PVOID
 ImpResolveNtImport(PDRIVER_OBJECT DriverObject, PCZPSTR ExportName)
 {
-    PVOID                    image_base           = NULL;
-    PIMAGE_DOS_HEADER        dos_header           = NULL;
-    PLOCAL_NT_HEADER         nt_header            = NULL;
-    PIMAGE_OPTIONAL_HEADER64 optional_header      = NULL;
-    PIMAGE_DATA_DIRECTORY    data_dir             = NULL;
-    PIMAGE_EXPORT_DIRECTORY  export_dir           = NULL;
-    PUINT32                  export_name_table    = NULL;
-    PCHAR                    name                 = NULL;
-    PUINT16                  ordinals_table       = NULL;
-    PUINT32                  export_addr_table    = NULL;
-    UINT32                   ordinal              = 0;
-    PVOID                    target_function_addr = 0;
-    UINT32                   export_offset        = 0;
-
-    image_base = FindDriverBaseNoApi(DriverObject, L"ntoskrnl.exe");
+    PVOID image_base = NULL;
+    ULONG image_size = 0;
+
+    image_base =
+        FindDriverBaseNoApi(DriverObject, L"ntoskrnl.exe", &image_size);
 
     if (!image_base) {
         DEBUG_ERROR("FindDriverBaseNoApi failed with no status");
         return NULL;
     }
 
-    /*
-     * todo: add comment explaining this shit also this ugly af
-     */
-    dos_header      = (PIMAGE_DOS_HEADER)image_base;
-    nt_header       = (struct _IMAGE_NT_HEADERS64*)((UINT64)image_base +
-                                              dos_header->e_lfanew);
-    optional_header = (PIMAGE_OPTIONAL_HEADER64)&nt_header->OptionalHeader;
-
-    data_dir = (PIMAGE_DATA_DIRECTORY) &
-               (optional_header->DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]);
-    export_dir = (PIMAGE_EXPORT_DIRECTORY)((UINT64)image_base +
-                                           data_dir->VirtualAddress);
-
-    export_name_table =
-        (PUINT32)((UINT64)image_base + export_dir->AddressOfNames);
-    ordinals_table =
-        (PUINT16)((UINT64)image_base + export_dir->AddressOfNameOrdinals);
-    export_addr_table =
-        (PUINT32)((UINT64)image_base + export_dir->AddressOfFunctions);
-
-    for (INT index = 0; index < export_dir->NumberOfNames; index++) {
-        name = (PCHAR)((UINT64)image_base + export_name_table[index]);
-
-        if (strcmp(name, ExportName))
-            continue;
-
-        ordinal              = ordinals_table[index];
-        export_offset        = export_addr_table[ordinal];
-        target_function_addr = (PVOID)((UINT64)image_base + export_offset);
-        return target_function_addr;
-    }
-
-    return NULL;
+    return PeFindExportByName(image_base, image_size, ExportName);
 }
 
 /*
@@ -94,7 +80,10 @@ ImpResolveNtImport(PDRIVER_OBJECT DriverObject, PCZPSTR ExportName)
  * the same hash function to compare when we walk the export table.
  */
 #define NT_IMPORT_MAX_LENGTH 128
-#define NT_IMPORT_COUNT      79
+#define NT_IMPORT_COUNT      82
+
+C_ASSERT(NT_IMPORT_COUNT <= IMPORTS_LENGTH);
+C_ASSERT(IMPORTS_LENGTH % IMPORT_CIPHER_BLOCK_SIZE == 0);
 
 CHAR NT_IMPORTS[NT_IMPORT_COUNT][NT_IMPORT_MAX_LENGTH] = {
     "ObDereferenceObject",
@@ -175,7 +164,10 @@ CHAR NT_IMPORTS[NT_IMPORT_COUNT][NT_IMPORT_MAX_LENGTH] = {
     "DbgPrintEx",
     "RtlCompareUnicodeString",
     "RtlFreeUnicodeString",
-    "PsGetProcessImageFileName"};
+    "PsGetProcessImageFileName",
+    "ZwQueryVirtualMemory",
+    "PsIsThreadTerminating",
+    "PsGetThreadProcess"};
 
 DRIVER_IMPORTS driver_imports = {0};
 
@@ -1190,4 +1182,44 @@ ImpRtlFreeUnicodeString(_In_ PUNICODE_STRING UnicodeString)
             &driver_imports, IMPORTS_LENGTH, RTL_FREE_UNICODE_STRING_INDEX);
 
     impRtlFreeUnicodeString(UnicodeString);
+}
+
+NTSTATUS
+ImpZwQueryVirtualMemory(_In_ HANDLE                   ProcessHandle,
+                        _In_opt_ PVOID                BaseAddress,
+                        _In_ MEMORY_INFORMATION_CLASS MemoryInformationClass,
+                        _Out_ PVOID                   MemoryInformation,
+                        _In_ SIZE_T                   MemoryInformationLength,
+                        _Out_opt_ PSIZE_T             ReturnLength)
+{
+    pZwQueryVirtualMemory impZwQueryVirtualMemory =
+        (pZwQueryVirtualMemory)CryptDecryptImportsArrayEntry(
+            &driver_imports, IMPORTS_LENGTH, ZW_QUERY_VIRTUAL_MEMORY_INDEX);
+
+    return impZwQueryVirtualMemory(ProcessHandle,
+                                   BaseAddress,
+                                   MemoryInformationClass,
+                                   MemoryInformation,
+                                   MemoryInformationLength,
+                                   ReturnLength);
+}
+
+BOOLEAN
+ImpPsIsThreadTerminating(_In_ PETHREAD Thread)
+{
+    pPsIsThreadTerminating impPsIsThreadTerminating =
+        (pPsIsThreadTerminating)CryptDecryptImportsArrayEntry(
+            &driver_imports, IMPORTS_LENGTH, PS_IS_THREAD_TERMINATING_INDEX);
+
+    return impPsIsThreadTerminating(Thread);
+}
+
+PEPROCESS
+ImpPsGetThreadProcess(_In_ PETHREAD Thread)
+{
+    pPsGetThreadProcess impPsGetThreadProcess =
+        (pPsGetThreadProcess)CryptDecryptImportsArrayEntry(
+            &driver_imports, IMPORTS_LENGTH, PS_GET_THREAD_PROCESS_INDEX);
+
+    return impPsGetThreadProcess(Thread);
 }
\ No newline at end of file
@@ -540,6 +540,26 @@ void (*pRtlFreeUnicodeString)(
         PUNICODE_STRING UnicodeString
         );
 
+typedef 
+NTSTATUS (*pZwQueryVirtualMemory)(
+        HANDLE                   ProcessHandle,
+        PVOID                    BaseAddress,
+        MEMORY_INFORMATION_CLASS MemoryInformationClass,
+        PVOID                    MemoryInformation,
+        SIZE_T                   MemoryInformationLength,
+        PSIZE_T                  ReturnLength
+        );
+
+typedef 
+BOOLEAN (*pPsIsThreadTerminating)(
+        PETHREAD Thread
+        );
+
+typedef 
+PEPROCESS (*pPsGetThreadProcess)(
+        PETHREAD Thread
+        );
+
 // clang-format on
 
 #define OB_DEREFERENCE_OBJECT_INDEX                0
@@ -640,6 +660,10 @@ void (*pRtlFreeUnicodeString)(
 #define RTL_COMPARE_UNICODE_STRING_INDEX     76
 #define RTL_FREE_UNICODE_STRING_INDEX        77
 #define PS_GET_PROCESS_IMAGE_FILE_NAME_INDEX 78
+#define ZW_QUERY_VIRTUAL_MEMORY_INDEX        79
+
+#define PS_IS_THREAD_TERMINATING_INDEX 80
+#define PS_GET_THREAD_PROCESS_INDEX    81
 
 typedef struct _DRIVER_IMPORTS
 {
@@ -741,7 +765,13 @@ typedef struct _DRIVER_IMPORTS
         pRtlCompareUnicodeString   DrvImpRtlCompareUnicodeString;
         pRtlFreeUnicodeString      DrvImpRtlFreeUnicodeString;
         pPsGetProcessImageFileName DrvImpPsGetProcessImageFileName;
-        UINT64                     dummy;
+        pZwQueryVirtualMemory      DrvImpZwQueryVirtualMemory;
+
+        pPsIsThreadTerminating DrvImpPsIsThreadTerminating;
+        pPsGetThreadProcess    DrvImpPsGetThreadProcess;
+
+        /* only whole cipher blocks are encrypted, see core/cipher.c */
+        UINT64 dummy[2];
 
 } DRIVER_IMPORTS, *PDRIVER_IMPORTS;
 
@@ -1073,4 +1103,18 @@ ImpRtlCompareUnicodeString(_In_ PCUNICODE_STRING String1,
 VOID
 ImpRtlFreeUnicodeString(_In_ PUNICODE_STRING UnicodeString);
 
+NTSTATUS
+ImpZwQueryVirtualMemory(_In_ HANDLE                   ProcessHandle,
+                        _In_opt_ PVOID                BaseAddress,
+                        _In_ MEMORY_INFORMATION_CLASS MemoryInformationClass,
+                        _Out_ PVOID                   MemoryInformation,
+                        _In_ SIZE_T                   MemoryInformationLength,
+                        _Out_opt_ PSIZE_T             ReturnLength);
+
+BOOLEAN
+ImpPsIsThreadTerminating(_In_ PETHREAD Thread);
+
+PEPROCESS
+ImpPsGetThreadProcess(_In_ PETHREAD Thread);
+
 #endif
\ No newline at end of file
@@ -8,6 +8,10 @@
 #include "imports.h"
 #include "session.h"
 
+#include "../core/pe.h"
+#include "../core/smbios.h"
+#include "../core/signature.h"
+
 #include <bcrypt.h>
 #include <initguid.h>
 #include <devpkey.h>
@@ -65,17 +69,6 @@ ComputeHashOfBuffer(_In_ PVOID Buffer,
                         PVOID* HashResult,
                     _Out_ _Deref_out_range_(>, 0) PULONG HashResultSize);
 
-STATIC
-VOID
-GetNextSMBIOSStructureInTable(_Inout_ PSMBIOS_TABLE_HEADER* CurrentStructure);
-
-STATIC
-NTSTATUS
-GetStringAtIndexFromSMBIOSTable(_In_ PSMBIOS_TABLE_HEADER Table,
-                                _In_ INT                  Index,
-                                _In_ PVOID                Buffer,
-                                _In_ SIZE_T               BufferSize);
-
 STATIC
 NTSTATUS
 GetAverageReadTimeAtRoutine(_In_ PVOID    RoutineAddress,
@@ -89,14 +82,17 @@ GetAverageReadTimeAtRoutine(_In_ PVOID    RoutineAddress,
 #    pragma alloc_text(PAGE, ComputeHashOfBuffer)
 // #        pragma alloc_text(PAGE, VerifyInMemoryImageVsDiskImage)
 #    pragma alloc_text(PAGE, RetrieveInMemoryModuleExecutableSections)
-#    pragma alloc_text(PAGE, GetNextSMBIOSStructureInTable)
-#    pragma alloc_text(PAGE, GetStringAtIndexFromSMBIOSTable)
 #    pragma alloc_text(PAGE, ParseSMBIOSTable)
 #    pragma alloc_text(PAGE, ValidateProcessLoadedModule)
 #    pragma alloc_text(PAGE, GetHardDiskDriveSerialNumber)
-#    pragma alloc_text(PAGE, ScanForSignature)
 #    pragma alloc_text(PAGE, InitiateEptFunctionAddressArrays)
 #    pragma alloc_text(PAGE, DetectEptHooksInKeyFunctions)
+#    pragma alloc_text(PAGE, ValidateDataPointers)
+#    pragma alloc_text(PAGE, ScanProcessExecutableMemory)
+#    pragma alloc_text(PAGE, ResetProcessMemoryScan)
+#    pragma alloc_text(PAGE, RegisterModuleImage)
+#    pragma alloc_text(PAGE, ValidateModuleImage)
+#    pragma alloc_text(PAGE, ResetModuleImage)
 // #pragma alloc_text(PAGE, DetermineIfTestSigningIsEnabled)
 #endif
 
@@ -205,17 +201,12 @@ StoreModuleExecutableRegionsInBuffer(_Outptr_result_bytebuffer_(*BytesWritten)
 {
     PAGED_CODE();
 
-    NTSTATUS              status                  = STATUS_UNSUCCESSFUL;
-    PIMAGE_DOS_HEADER     dos_header              = NULL;
-    PLOCAL_NT_HEADER      nt_header               = NULL;
-    PIMAGE_SECTION_HEADER section                 = NULL;
-    ULONG                 total_packet_size       = 0;
-    ULONG                 num_sections            = 0;
-    ULONG                 num_executable_sections = 0;
-    UINT64                buffer_base             = 0;
-    ULONG                 bytes_returned          = 0;
-    MM_COPY_ADDRESS       address                 = {0};
-    ULONG                 buffer_size             = 0;
+    NTSTATUS               status                  = STATUS_UNSUCCESSFUL;
+    PIMAGE_DOS_HEADER      dos_header              = NULL;
+    SIZE_T                 total_packet_size       = 0;
+    UINT32                 num_executable_sections = 0;
+    ULONG                  buffer_size             = 0;
+    INTEGRITY_CHECK_HEADER header                  = {0};
 
     if (!ModuleBase || !ModuleSize)
         return STATUS_INVALID_PARAMETER;
@@ -251,65 +242,25 @@ StoreModuleExecutableRegionsInBuffer(_Outptr_result_bytebuffer_(*BytesWritten)
     }
 
     /*
-     * The IMAGE_DOS_HEADER.e_lfanew stores the offset of the
-     * IMAGE_NT_HEADER from the base of the image.
+     * The section walk lives in core so the same layout can be produced and
+     * checked outside the kernel. PlatformCopyMemory is backed by
+     * MmCopyMemory in the driver build.
      */
-    nt_header = (struct _IMAGE_NT_HEADERS64*)((UINT64)ModuleBase +
-                                              dos_header->e_lfanew);
-
-    num_sections = nt_header->FileHeader.NumberOfSections;
-
-    /*
-     * The IMAGE_FIRST_SECTION macro takes in an IMAGE_NT_HEADER and returns
-     * the address of the first section of the PE file.
-     */
-    section     = IMAGE_FIRST_SECTION(nt_header);
-    buffer_base = (UINT64)*Buffer + sizeof(INTEGRITY_CHECK_HEADER);
-
-    for (ULONG index = 0; index < num_sections - 1; index++) {
-        if (!(section->Characteristics & IMAGE_SCN_MEM_EXECUTE)) {
-            section++;
-            continue;
-        }
-
-        address.VirtualAddress = section;
+    status = PeCopyExecutableSections(
+        ModuleBase,
+        ModuleSize,
+        (PVOID)((UINT64)*Buffer + sizeof(INTEGRITY_CHECK_HEADER)),
+        ModuleSize,
+        &num_executable_sections,
+        &total_packet_size);
 
-        status = ImpMmCopyMemory((UINT64)buffer_base + total_packet_size,
-                                 address,
-                                 sizeof(IMAGE_SECTION_HEADER),
-                                 MM_COPY_MEMORY_VIRTUAL,
-                                 &bytes_returned);
-
-        if (!NT_SUCCESS(status)) {
-            DEBUG_ERROR("MmCopyMemory failed with status %x", status);
-            ImpExFreePoolWithTag(*Buffer, POOL_TAG_INTEGRITY);
-            *Buffer = NULL;
-            return status;
-        }
-
-        address.VirtualAddress = (UINT64)ModuleBase + section->PointerToRawData;
-
-        status = ImpMmCopyMemory((UINT64)buffer_base + total_packet_size +
-                                     sizeof(IMAGE_SECTION_HEADER),
-                                 address,
-                                 section->SizeOfRawData,
-                                 MM_COPY_MEMORY_VIRTUAL,
-                                 &bytes_returned);
-
-        if (!NT_SUCCESS(status)) {
-            DEBUG_ERROR("MmCopyMemory failed with status %x", status);
-            ImpExFreePoolWithTag(*Buffer, POOL_TAG_INTEGRITY);
-            *Buffer = NULL;
-            return status;
-        }
-
-        total_packet_size +=
-            section->SizeOfRawData + sizeof(IMAGE_SECTION_HEADER);
-        num_executable_sections += 1;
-        section++;
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("PeCopyExecutableSections failed with status %x", status);
+        ImpExFreePoolWithTag(*Buffer, POOL_TAG_INTEGRITY);
+        *Buffer = NULL;
+        return status;
     }
 
-    INTEGRITY_CHECK_HEADER header   = {0};
     header.executable_section_count = num_executable_sections;
     header.total_packet_size =
         total_packet_size + sizeof(INTEGRITY_CHECK_HEADER);
@@ -590,109 +541,7 @@ end:
 
     return status;
 }
-#define SMBIOS_TABLE    'RSMB'
-#define NULL_TERMINATOR '\0'
-/*
- * From line 727 in the SMBIOS Specification:
- *
- *    727  Each structure shall be terminated by a double-null (0000h), either
- * directly following the 728   formatted area (if no strings are present) or
- * directly following the last string. This includes 729   system- and
- * OEM-specific structures and allows upper-level software to easily traverse
- * the 730   structure table. (See structure-termination examples later in this
- * clause.)
- *
- * TLDR is that if the first two characters proceeding the structure are null
- * terminators, then there are no strings, otherwise to find the end of the
- * string section simply iterate until there is a double null terminator.
- *
- * source:
- * https://www.dmtf.org/sites/default/files/standards/documents/DSP0134_2.7.1.pdf
- */
-STATIC
-VOID
-GetNextSMBIOSStructureInTable(_Inout_ PSMBIOS_TABLE_HEADER* CurrentStructure)
-{
-    PAGED_CODE();
-
-    PCHAR string_section_start =
-        (PCHAR)((UINT64)*CurrentStructure + (*CurrentStructure)->Length);
-
-    PCHAR current_char_in_strings = string_section_start;
-    PCHAR next_char_in_strings    = string_section_start + 1;
-
-    for (;;) {
-        if (*current_char_in_strings == NULL_TERMINATOR &&
-            *next_char_in_strings == NULL_TERMINATOR) {
-            *CurrentStructure =
-                (PSMBIOS_TABLE_HEADER)(next_char_in_strings + 1);
-            return;
-        }
-
-        current_char_in_strings++;
-        next_char_in_strings++;
-    }
-}
-
-/*
- * Remember that the string index does not start from the beginning of the
- * struct. For example, lets take RAW_SMBIOS_TABLE_02: the first string is NOT
- * "Type" at index 0, the first string is Manufacturer. So if we want to find
- * the SerialNumber, the string index would be 4, as the previous 3 values
- * (after the header) are all strings. So remember, the index is into the number
- * of strings that exist for the given table, NOT the size of the structure or a
- * values index into the struct.
- *
- * Here we count the number of strings by incrementing the string_count each
- * time we pass a null terminator so we know when we're at the beginning of the
- * target string.
- */
-STATIC
-NTSTATUS
-GetStringAtIndexFromSMBIOSTable(_In_ PSMBIOS_TABLE_HEADER Table,
-                                _In_ INT                  Index,
-                                _In_ PVOID                Buffer,
-                                _In_ SIZE_T               BufferSize)
-{
-    PAGED_CODE();
-
-    INT   current_string_char_index = 0;
-    INT   string_count              = 0;
-    PCHAR current_string_char       = (PCHAR)((UINT64)Table + Table->Length);
-    PCHAR next_string_char          = current_string_char + 1;
-
-    for (;;) {
-        if (*current_string_char == NULL_TERMINATOR &&
-            *next_string_char == NULL_TERMINATOR)
-            return STATUS_NOT_FOUND;
-
-        if (current_string_char_index >= BufferSize)
-            return STATUS_BUFFER_TOO_SMALL;
-
-        if (string_count + 1 == Index) {
-            if (*current_string_char == NULL_TERMINATOR)
-                return STATUS_SUCCESS;
-
-            UINT64 dest = (UINT64)Buffer + current_string_char_index;
-
-            RtlCopyMemory(dest, current_string_char, sizeof(CHAR));
-            current_string_char_index++;
-            goto increment;
-        }
-
-        if (*current_string_char == NULL_TERMINATOR) {
-            current_string_char_index = 0;
-            string_count++;
-        }
-
-    increment:
-        current_string_char++;
-        next_string_char++;
-    }
-
-    return STATUS_NOT_FOUND;
-}
-
+#define SMBIOS_TABLE 'RSMB'
 /* for generic intel */
 // #define SMBIOS_SYSTEM_INFORMATION_TYPE_2_TABLE 2
 // #define MOTHERBOARD_SERIAL_CODE_TABLE_INDEX    4
@@ -709,13 +558,11 @@ ParseSMBIOSTable(_Out_ PVOID             Buffer,
 {
     PAGED_CODE();
 
-    NTSTATUS             status                       = STATUS_UNSUCCESSFUL;
-    PVOID                firmware_table_buffer        = NULL;
-    ULONG                firmware_table_buffer_size   = 0;
-    ULONG                bytes_returned               = 0;
-    PRAW_SMBIOS_DATA     smbios_data                  = NULL;
-    PSMBIOS_TABLE_HEADER smbios_table_header          = NULL;
-    PRAW_SMBIOS_TABLE_01 smbios_baseboard_information = NULL;
+    NTSTATUS         status                     = STATUS_UNSUCCESSFUL;
+    PVOID            firmware_table_buffer      = NULL;
+    ULONG            firmware_table_buffer_size = 0;
+    ULONG            bytes_returned             = 0;
+    PRAW_SMBIOS_DATA smbios_data                = NULL;
 
     status = ImpExGetSystemFirmwareTable(
         SMBIOS_TABLE, 0, NULL, 0, &firmware_table_buffer_size);
@@ -751,8 +598,6 @@ ParseSMBIOSTable(_Out_ PVOID             Buffer,
     }
 
     smbios_data = (PRAW_SMBIOS_DATA)firmware_table_buffer;
-    smbios_table_header =
-        (PSMBIOS_TABLE_HEADER)(&smbios_data->SMBIOSTableData[0]);
 
     /*
      * The System Information table is equal to Type == 2 and contains the
@@ -763,15 +608,11 @@ ParseSMBIOSTable(_Out_ PVOID             Buffer,
      * https://www.dmtf.org/sites/default/files/standards/documents/DSP0134_2.7.1.pdf
      * line 823
      */
-    while (smbios_table_header->Type != TableIndex)
-        GetNextSMBIOSStructureInTable(&smbios_table_header);
-
-    status = GetStringAtIndexFromSMBIOSTable(
-        smbios_table_header, TableSubIndex, Buffer, BufferSize);
+    status = FindSMBIOSStringInTable(
+        smbios_data, TableIndex, TableSubIndex, Buffer, BufferSize);
 
     if (!NT_SUCCESS(status)) {
-        DEBUG_ERROR("GetStringAtIndexFromSMBIOSTable failed with status %x",
-                    status);
+        DEBUG_ERROR("FindSMBIOSStringInTable failed with status %x", status);
         goto end;
     }
 
@@ -1107,33 +948,6 @@ end:
 
     return status;
 }
-PVOID
-ScanForSignature(_In_ PVOID  BaseAddress,
-                 _In_ SIZE_T MaxLength,
-                 _In_ LPCSTR Signature,
-                 _In_ SIZE_T SignatureLength)
-{
-    PAGED_CODE();
-
-    CHAR current_char     = 0;
-    CHAR current_sig_char = 0;
-
-    for (INT index = 0; index < MaxLength; index++) {
-        for (INT sig = 0; sig < SignatureLength + 1; sig++) {
-            current_char     = *(PCHAR)((UINT64)BaseAddress + index + sig);
-            current_sig_char = Signature[sig];
-
-            if (sig == SignatureLength)
-                return (PVOID)((UINT64)BaseAddress + index);
-
-            if (current_char != current_sig_char)
-                break;
-        }
-    }
-
-    return NULL;
-}
-
 /*
  * Lets ensure to the compiler doens't optimise out our useless instructions...
  */
@@ -1417,10 +1231,14 @@ DeferredModuleHashingCallback()
 
         DriverListEntryToExtendedModuleInfo(entry, &module);
 
-        DEBUG_VERBOSE("Hashing Deferred Module: %s", module.FullPathName);
-
         status = HashModule(&module, &entry->text_hash);
 
+        DEBUG_TRACE(TRACE_MODULE_HASHED,
+                    module.ImageBase,
+                    module.ImageSize,
+                    (UINT32)status,
+                    0);
+
         if (!NT_SUCCESS(status)) {
             DEBUG_ERROR("HashModule-x86 failed with status %x", status);
             entry->hashed = FALSE;
@@ -1538,7 +1356,7 @@ ValidateSystemModule(_In_ PRTL_MODULE_EXTENDED_INFO Module)
     PDRIVER_LIST_ENTRY entry  = NULL;
     PVOID              hash   = NULL;
 
-    hash = ExAllocatePool2(
+    hash = ImpExAllocatePool2(
         POOL_FLAG_NON_PAGED, SHA_256_HASH_LENGTH, POOL_TAG_INTEGRITY);
 
     if (!hash)
@@ -1559,15 +1377,18 @@ ValidateSystemModule(_In_ PRTL_MODULE_EXTENDED_INFO Module)
     }
 
     if (CompareHashes(hash, entry->text_hash, SHA_256_HASH_LENGTH))
-        DEBUG_VERBOSE("Module: %s text regions are valid.",
-                      Module->FullPathName);
+        DEBUG_TRACE(TRACE_MODULE_VALIDATED,
+                    Module->ImageBase,
+                    Module->ImageSize,
+                    TRUE,
+                    0);
     else
         DEBUG_WARNING("**!!** Module: %s text regions are NOT valid **!!**",
                       Module->FullPathName);
 
 end:
     if (hash)
-        ExFreePoolWithTag(hash, POOL_TAG_INTEGRITY);
+        ImpExFreePoolWithTag(hash, POOL_TAG_INTEGRITY);
 }
 
 NTSTATUS
@@ -1596,7 +1417,7 @@ ValidateOurDriverImage()
         goto end;
     }
 
-    memory_hash = ExAllocatePool2(
+    memory_hash = ImpExAllocatePool2(
         POOL_FLAG_NON_PAGED, SHA_256_HASH_LENGTH, POOL_TAG_INTEGRITY);
 
     if (!memory_hash)
@@ -1635,10 +1456,10 @@ ValidateOurDriverImage()
 end:
 
     if (memory_hash)
-        ExFreePoolWithTag(memory_hash, POOL_TAG_INTEGRITY);
+        ImpExFreePoolWithTag(memory_hash, POOL_TAG_INTEGRITY);
 
     if (modules.address)
-        ExFreePoolWithTag(modules.address, SYSTEM_MODULES_POOL);
+        ImpExFreePoolWithTag(modules.address, SYSTEM_MODULES_POOL);
 
     return status;
 }
@@ -1892,3 +1713,811 @@ ValidateOurDriversDispatchRoutines()
 
     return TRUE;
 }
+
+#define DATA_POINTER_MAX_REGIONS 0x800
+#define DATA_POINTER_MAX_PAGES   0x4000
+#define DATA_POINTER_MAX_SLOTS   0x10000
+
+/* tracked pages read per timer tick */
+#define DATA_POINTER_RESCAN_BUDGET 0x400
+
+STATIC
+PVOID
+TranslateDataPointerPage(_In_ UINT64 Address, _Inout_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (!ImpMmIsAddressValid((PVOID)Address))
+        return NULL;
+
+    return (PVOID)Address;
+}
+
+STATIC
+BOOLEAN
+InitialiseDataPointerView(_In_ PDRIVER_LIST_ENTRY Entry, _Out_ PPE_VIEW View)
+{
+    /* session space images can't be read from the timers worker thread */
+    if (Entry->x86 || !ImpMmIsAddressValid(Entry->ImageBase))
+        return FALSE;
+
+    return NT_SUCCESS(
+        PeViewInitialise(View, Entry->ImageBase, Entry->ImageSize));
+}
+
+/* only modules whose code was hashed when they loaded count as validated */
+STATIC
+VOID
+AddDataPointerCodeRegions(_In_ PDRIVER_LIST_ENTRY Entry,
+                          _In_opt_ PVOID          Context)
+{
+    NTSTATUS          status = STATUS_UNSUCCESSFUL;
+    PE_VIEW           view   = {0};
+    PDATA_POINTER_MAP map    = (PDATA_POINTER_MAP)Context;
+
+    if (!map || !Entry->hashed || !InitialiseDataPointerView(Entry, &view))
+        return;
+
+    status = DataPointerMapAddCodeSections(map, &view);
+
+    if (!NT_SUCCESS(status))
+        DEBUG_WARNING("DataPointerMapAddCodeSections failed with status %x",
+                      status);
+}
+
+STATIC
+VOID
+AddDataPointerSlots(_In_ PDRIVER_LIST_ENTRY Entry, _In_opt_ PVOID Context)
+{
+    NTSTATUS          status = STATUS_UNSUCCESSFUL;
+    PE_VIEW           view   = {0};
+    PDATA_POINTER_MAP map    = (PDATA_POINTER_MAP)Context;
+
+    if (!map || !InitialiseDataPointerView(Entry, &view))
+        return;
+
+    status = DataPointerMapAddImage(map, &view);
+
+    if (!NT_SUCCESS(status))
+        DEBUG_WARNING("DataPointerMapAddImage failed with status %x", status);
+}
+
+STATIC
+NTSTATUS
+AllocateDataPointerMap(_Inout_ PDATA_POINTER_MAP Map)
+{
+    SIZE_T size = DATA_POINTER_MAX_REGIONS * sizeof(DATA_POINTER_REGION) +
+                  DATA_POINTER_MAX_PAGES * sizeof(DATA_POINTER_PAGE) +
+                  DATA_POINTER_MAX_SLOTS * sizeof(DATA_POINTER_SLOT);
+
+    Map->regions =
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED, size, POOL_TAG_DATA_POINTER);
+
+    if (!Map->regions)
+        return STATUS_MEMORY_NOT_ALLOCATED;
+
+    Map->region_capacity = DATA_POINTER_MAX_REGIONS;
+    Map->page_capacity   = DATA_POINTER_MAX_PAGES;
+    Map->slot_capacity   = DATA_POINTER_MAX_SLOTS;
+    Map->pages = (PDATA_POINTER_PAGE)(Map->regions + DATA_POINTER_MAX_REGIONS);
+    Map->slots = (PDATA_POINTER_SLOT)(Map->pages + DATA_POINTER_MAX_PAGES);
+    Map->translate      = TranslateDataPointerPage;
+    Map->memory_context = NULL;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * The code regions of every validated module have to be known before any
+ * slots are added, so the driver list is walked twice.
+ */
+STATIC
+NTSTATUS
+BuildDataPointerMap(_Inout_ PDATA_POINTER_CONTEXT Context)
+{
+    NTSTATUS          status = STATUS_UNSUCCESSFUL;
+    PDATA_POINTER_MAP map    = &Context->map;
+
+    if (!map->regions) {
+        status = AllocateDataPointerMap(map);
+
+        if (!NT_SUCCESS(status)) {
+            DEBUG_ERROR("AllocateDataPointerMap failed with status %x",
+                        status);
+            return status;
+        }
+    }
+
+    DataPointerMapReset(map);
+    Context->driver_generation = GetDriverList()->generation;
+
+    EnumerateDriverListWithCallbackRoutine(AddDataPointerCodeRegions, map);
+    DataPointerMapSortRegions(map);
+    EnumerateDriverListWithCallbackRoutine(AddDataPointerSlots, map);
+
+    DEBUG_VERBOSE("Data pointer map built. Regions: %lx, Pages: %lx, Slots: "
+                  "%lx, Dropped: %lx",
+                  map->region_count,
+                  map->page_count,
+                  map->slot_count,
+                  map->dropped);
+
+    return STATUS_SUCCESS;
+}
+
+typedef struct _DATA_POINTER_OWNER {
+    UINT64             address;
+    PDRIVER_LIST_ENTRY entry;
+
+} DATA_POINTER_OWNER, *PDATA_POINTER_OWNER;
+
+STATIC
+VOID
+FindDataPointerOwner(_In_ PDRIVER_LIST_ENTRY Entry, _In_opt_ PVOID Context)
+{
+    PDATA_POINTER_OWNER owner = (PDATA_POINTER_OWNER)Context;
+    UINT64              base  = (UINT64)Entry->ImageBase;
+
+    if (owner && owner->address >= base &&
+        owner->address < base + Entry->ImageSize)
+        owner->entry = Entry;
+}
+
+STATIC
+VOID
+ReportDataPointerHook(_In_ UINT64       Address,
+                      _In_ UINT64       Baseline,
+                      _In_ UINT64       Current,
+                      _Inout_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    SIZE_T                    length = 0;
+    SIZE_T                    offset = 0;
+    DATA_POINTER_OWNER        owner  = {0};
+    PDATA_POINTER_HOOK_REPORT report =
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                           sizeof(DATA_POINTER_HOOK_REPORT),
+                           REPORT_POOL_TAG);
+
+    DEBUG_WARNING("Data pointer hook found. Slot: %llx, Baseline: %llx, "
+                  "Current: %llx",
+                  Address,
+                  Baseline,
+                  Current);
+
+    if (!report)
+        return;
+
+    report->report_code  = REPORT_DATA_POINTER_HOOK;
+    report->slot_address = Address;
+    report->baseline     = Baseline;
+    report->current      = Current;
+
+    owner.address = Address;
+    EnumerateDriverListWithCallbackRoutine(FindDataPointerOwner, &owner);
+
+    /* keep the end of the path, which is where the image name is */
+    if (owner.entry) {
+        report->module_base = (UINT64)owner.entry->ImageBase;
+        length = strnlen(owner.entry->path, DRIVER_PATH_LENGTH);
+
+        if (length >= sizeof(report->module))
+            offset = length - (sizeof(report->module) - 1);
+
+        RtlCopyMemory(
+            report->module, owner.entry->path + offset, length - offset);
+    }
+
+    if (!NT_SUCCESS(
+            IrpQueueCompleteIrp(report, sizeof(DATA_POINTER_HOOK_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+/*
+ * Run from the integrity check timer. The map is built on the first run and
+ * rebuilt whenever a driver has loaded or unloaded since, tracked by the
+ * driver list generation, every other run rescans the
+ * next DATA_POINTER_RESCAN_BUDGET tracked pages. Before rebuilding, every
+ * page is rescanned so changes made since the last run aren't folded into the
+ * new baseline.
+ */
+NTSTATUS
+ValidateDataPointers()
+{
+    PAGED_CODE();
+
+    PDATA_POINTER_CONTEXT context = GetDataPointerContext();
+    UINT32                pages   = 0;
+
+    DetectUnloadedDrivers();
+
+    if (context->map.regions &&
+        context->driver_generation == GetDriverList()->generation) {
+        pages = DataPointerMapRescan(&context->map,
+                                     DATA_POINTER_RESCAN_BUDGET,
+                                     ReportDataPointerHook,
+                                     NULL);
+
+        DEBUG_VERBOSE("Data pointer pages rescanned: %lx, Changed: %llx",
+                      pages,
+                      context->map.changed);
+
+        return STATUS_SUCCESS;
+    }
+
+    if (context->map.regions)
+        DataPointerMapRescan(&context->map, 0, ReportDataPointerHook, NULL);
+
+    return BuildDataPointerMap(context);
+}
+
+VOID
+CleanupDataPointerContextOnUnload(_In_ PDATA_POINTER_CONTEXT Context)
+{
+    if (!Context->map.regions)
+        return;
+
+    ImpExFreePoolWithTag(Context->map.regions, POOL_TAG_DATA_POINTER);
+    RtlZeroMemory(Context, sizeof(DATA_POINTER_CONTEXT));
+}
+
+STATIC
+REGION_TYPE
+GetRegionType(_In_ ULONG Type)
+{
+    switch (Type) {
+    case MEM_IMAGE: return RegionTypeImage;
+    case MEM_MAPPED: return RegionTypeMapped;
+    default: return RegionTypePrivate;
+    }
+}
+
+/* Context is the MEMORY_BASIC_INFORMATION the region was taken from */
+STATIC
+VOID
+ReportPrivateExecutableMemory(_In_ PMEMORY_REGION Region,
+                              _In_ REGION_STATE   State,
+                              _Inout_opt_ PVOID   Context)
+{
+    PMEMORY_BASIC_INFORMATION         info   = Context;
+    PPRIVATE_EXECUTABLE_MEMORY_REPORT report = NULL;
+
+    if (!RegionIsUnbackedExecutable(Region))
+        return;
+
+    DEBUG_WARNING("Unbacked executable memory found. Base: %llx, Size: %llx, "
+                  "Protection: %lx, Type: %lx",
+                  Region->base,
+                  Region->size,
+                  Region->protection,
+                  Region->type);
+
+    report = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                sizeof(PRIVATE_EXECUTABLE_MEMORY_REPORT),
+                                REPORT_POOL_TAG);
+
+    if (!report)
+        return;
+
+    report->report_code     = REPORT_PRIVATE_EXECUTABLE_MEMORY;
+    report->region_type     = Region->type;
+    report->base            = Region->base;
+    report->size            = Region->size;
+    report->allocation_base = info ? (UINT64)info->AllocationBase : 0;
+    report->protection      = Region->protection;
+    report->state           = State;
+
+    if (!NT_SUCCESS(IrpQueueCompleteIrp(
+            report, sizeof(PRIVATE_EXECUTABLE_MEMORY_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+/*
+ * Doubles the capacity of the region map, up to REGION_MAP_MAXIMUM_CAPACITY.
+ * The map starts out in the buffer inside the session, any buffer after that
+ * comes from the pool and is freed once the map moves again or is reset.
+ */
+STATIC
+NTSTATUS
+GrowRegionMap(_Inout_ PACTIVE_SESSION Session)
+{
+    PREGION_MAP    map      = &Session->region_map;
+    PMEMORY_REGION buffer   = NULL;
+    PMEMORY_REGION previous = NULL;
+    UINT32         capacity = map->capacity * 2;
+
+    if (capacity > REGION_MAP_MAXIMUM_CAPACITY)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    buffer = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                2 * capacity * sizeof(MEMORY_REGION),
+                                POOL_TAG_REGION_MAP);
+
+    if (!buffer)
+        return STATUS_MEMORY_NOT_ALLOCATED;
+
+    previous = RegionMapGrow(map, buffer, capacity);
+
+    if (previous != Session->region_buffer)
+        ImpExFreePoolWithTag(previous, POOL_TAG_REGION_MAP);
+
+    DEBUG_VERBOSE("Region map grown to %lx regions", capacity);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Walks the committed executable memory of the protected process. Regions
+ * that are the same as in the previous scan are skipped by the region map,
+ * new or changed ones not backed by an image are reported, which is where a
+ * manually mapped image ends up.
+ *
+ * ZwQueryVirtualMemory fails with STATUS_INVALID_PARAMETER once the address
+ * is past the highest user address, which is the end of the walk. If the walk
+ * stops early for any other reason the round is abandoned, the regions
+ * already inspected are kept and the rest of the previous round stays the
+ * baseline for them.
+ */
+NTSTATUS
+ScanProcessExecutableMemory()
+{
+    PAGED_CODE();
+
+    NTSTATUS                 status    = STATUS_UNSUCCESSFUL;
+    PACTIVE_SESSION          session   = GetActiveSession();
+    PEPROCESS                process   = NULL;
+    KAPC_STATE               apc_state = {0};
+    MEMORY_BASIC_INFORMATION info      = {0};
+    MEMORY_REGION            region    = {0};
+    UINT64                   address   = 0;
+    UINT64                   next      = 0;
+    SIZE_T                   length    = 0;
+    BOOLEAN                  complete  = FALSE;
+
+    SessionGetProcess(&process);
+
+    if (!process)
+        return STATUS_NOT_FOUND;
+
+    ImpKeAcquireGuardedMutex(&session->region_lock);
+    RegionMapBeginRound(&session->region_map);
+
+    ImpKeStackAttachProcess(process, &apc_state);
+
+    for (;;) {
+        status = ImpZwQueryVirtualMemory(ZwCurrentProcess(),
+                                         (PVOID)address,
+                                         MemoryBasicInformation,
+                                         &info,
+                                         sizeof(info),
+                                         &length);
+
+        if (status == STATUS_INVALID_PARAMETER && address) {
+            complete = TRUE;
+            break;
+        }
+
+        if (!NT_SUCCESS(status)) {
+            DEBUG_ERROR("ZwQueryVirtualMemory failed with status %x", status);
+            break;
+        }
+
+        next = (UINT64)info.BaseAddress + info.RegionSize;
+
+        if (next <= address) {
+            status = STATUS_UNSUCCESSFUL;
+            break;
+        }
+
+        address = next;
+
+        if (info.State != MEM_COMMIT ||
+            !(info.Protect & REGION_PROTECTION_EXECUTE))
+            continue;
+
+        region.base       = (UINT64)info.BaseAddress;
+        region.size       = info.RegionSize;
+        region.protection = info.Protect;
+        region.type       = GetRegionType(info.Type);
+
+        status = RegionMapRecord(&session->region_map,
+                                 &region,
+                                 ReportPrivateExecutableMemory,
+                                 &info);
+
+        if (status == STATUS_BUFFER_TOO_SMALL) {
+            status = GrowRegionMap(session);
+
+            if (!NT_SUCCESS(status)) {
+                DEBUG_ERROR("GrowRegionMap failed with status %x", status);
+                break;
+            }
+
+            status = RegionMapRecord(&session->region_map,
+                                     &region,
+                                     ReportPrivateExecutableMemory,
+                                     &info);
+        }
+
+        if (!NT_SUCCESS(status)) {
+            DEBUG_ERROR("RegionMapRecord failed with status %x", status);
+            break;
+        }
+    }
+
+    ImpKeUnstackDetachProcess(&apc_state);
+
+    if (complete) {
+        RegionMapEndRound(&session->region_map);
+        status = STATUS_SUCCESS;
+    }
+    else {
+        RegionMapAbandonRound(&session->region_map);
+    }
+
+    DEBUG_VERBOSE("Executable regions: %lx, Inspected: %llx, Dropped: %lx",
+                  session->region_map.count,
+                  session->region_map.inspected,
+                  session->region_map.dropped);
+
+    ImpKeReleaseGuardedMutex(&session->region_lock);
+
+    return status;
+}
+
+/*
+ * called when a session starts or ends and on unload, the first scan inspects
+ * every region. A grown map goes back to the buffer inside the session.
+ */
+VOID
+ResetProcessMemoryScan()
+{
+    PAGED_CODE();
+
+    PACTIVE_SESSION session = GetActiveSession();
+
+    ImpKeAcquireGuardedMutex(&session->region_lock);
+
+    if (session->region_map.buffer != session->region_buffer) {
+        ImpExFreePoolWithTag(session->region_map.buffer, POOL_TAG_REGION_MAP);
+        RegionMapInitialise(&session->region_map,
+                            session->region_buffer,
+                            REGION_MAP_DEFAULT_CAPACITY);
+    }
+
+    RegionMapReset(&session->region_map);
+    ImpKeReleaseGuardedMutex(&session->region_lock);
+}
+
+typedef struct _MODULE_IMAGE_REGISTRATION {
+    PVOID module_base;
+
+} MODULE_IMAGE_REGISTRATION, *PMODULE_IMAGE_REGISTRATION;
+
+/* MemoryMappedFilenameInformation, missing from older WDKs */
+#define MEMORY_MAPPED_FILENAME_INFORMATION 2
+#define MODULE_IMAGE_NAME_BUFFER_SIZE      0x800
+
+/*
+ * Pages verified per integrity timer tick. A page costs around 35us to copy
+ * and hash (see bench/pagehash.cpp), one page a frame at 60 frames a second
+ * keeps the cost under 50us a frame. The timer only fires every
+ * REPEAT_TIME_10_SEC so a tick gets the pages of every frame in its period,
+ * around 600 pages or 21ms on a background worker. That covers a 1MB module
+ * every tick, PageHashSetVerify never verifies a page twice in one call.
+ */
+#define MODULE_IMAGE_VERIFY_FRAMES_PER_SECOND 60
+#define MODULE_IMAGE_VERIFY_BUDGET \
+    (MODULE_IMAGE_VERIFY_FRAMES_PER_SECOND * REPEAT_TIME_10_SEC / 1000)
+
+/*
+ * Takes the path of the file the image at Base is mapped from, rather then
+ * trusting a path from the module. Base has to be the start of an image
+ * mapping.
+ */
+STATIC
+NTSTATUS
+QueryModuleImagePath(_In_ PEPROCESS        Process,
+                     _In_ UINT64           Base,
+                     _Out_ PUNICODE_STRING Path)
+{
+    PAGED_CODE();
+
+    NTSTATUS                 status    = STATUS_UNSUCCESSFUL;
+    KAPC_STATE               apc_state = {0};
+    MEMORY_BASIC_INFORMATION info      = {0};
+    PUNICODE_STRING          name      = NULL;
+    SIZE_T                   length    = 0;
+
+    name = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                              MODULE_IMAGE_NAME_BUFFER_SIZE,
+                              POOL_TAG_MODULE_IMAGE);
+
+    if (!name)
+        return STATUS_MEMORY_NOT_ALLOCATED;
+
+    ImpKeStackAttachProcess(Process, &apc_state);
+
+    status = ImpZwQueryVirtualMemory(ZwCurrentProcess(),
+                                     (PVOID)Base,
+                                     MemoryBasicInformation,
+                                     &info,
+                                     sizeof(info),
+                                     &length);
+
+    if (NT_SUCCESS(status) &&
+        (info.Type != MEM_IMAGE || (UINT64)info.AllocationBase != Base))
+        status = STATUS_INVALID_ADDRESS;
+
+    if (NT_SUCCESS(status))
+        status = ImpZwQueryVirtualMemory(
+            ZwCurrentProcess(),
+            (PVOID)Base,
+            (MEMORY_INFORMATION_CLASS)MEMORY_MAPPED_FILENAME_INFORMATION,
+            name,
+            MODULE_IMAGE_NAME_BUFFER_SIZE,
+            &length);
+
+    ImpKeUnstackDetachProcess(&apc_state);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("ZwQueryVirtualMemory failed with status %x", status);
+        goto end;
+    }
+
+    /* MapDiskImageIntoVirtualAddressSpace wants it null terminated */
+    Path->Length        = name->Length;
+    Path->MaximumLength = name->Length + sizeof(WCHAR);
+    Path->Buffer        = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                             Path->MaximumLength,
+                                             POOL_TAG_MODULE_IMAGE);
+
+    if (!Path->Buffer) {
+        status = STATUS_MEMORY_NOT_ALLOCATED;
+        goto end;
+    }
+
+    RtlCopyMemory(Path->Buffer, name->Buffer, name->Length);
+
+end:
+    ImpExFreePoolWithTag(name, POOL_TAG_MODULE_IMAGE);
+    return status;
+}
+
+/*
+ * Called by the module with its own image base once the session has started.
+ * Only the first registration of a session is accepted, otherwise a patched
+ * module could simply register a clean copy of itself.
+ */
+NTSTATUS
+RegisterModuleImage(_In_ PIRP Irp)
+{
+    PAGED_CODE();
+
+    NTSTATUS                   status       = STATUS_UNSUCCESSFUL;
+    PACTIVE_SESSION            session      = GetActiveSession();
+    PMODULE_IMAGE              image        = &session->module_image;
+    PMODULE_IMAGE_REGISTRATION registration = NULL;
+    PEPROCESS                  process      = NULL;
+
+    status = ValidateIrpInputBuffer(Irp, sizeof(MODULE_IMAGE_REGISTRATION));
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("ValidateIrpInputBuffer failed with status %x", status);
+        return status;
+    }
+
+    registration = (PMODULE_IMAGE_REGISTRATION)Irp->AssociatedIrp.SystemBuffer;
+
+    SessionGetProcess(&process);
+
+    if (!process)
+        return STATUS_NOT_FOUND;
+
+    ImpKeAcquireGuardedMutex(&session->module_lock);
+
+    if (image->base) {
+        status = STATUS_ALREADY_REGISTERED;
+        goto end;
+    }
+
+    status = QueryModuleImagePath(
+        process, (UINT64)registration->module_base, &image->path);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("QueryModuleImagePath failed with status %x", status);
+        goto end;
+    }
+
+    image->base = (UINT64)registration->module_base;
+
+    DEBUG_VERBOSE("Module image registered. Base: %llx", image->base);
+
+end:
+    ImpKeReleaseGuardedMutex(&session->module_lock);
+    return status;
+}
+
+/*
+ * Runs from the integrity timer, so the disk image is mapped into the system
+ * process where it lands at the same base as the loaded module. Mapped into
+ * the protected process it would land at a second address, relocated
+ * differently, and every page holding a fixup would mismatch.
+ */
+STATIC
+NTSTATUS
+BuildModuleImageHashes(_Inout_ PMODULE_IMAGE Image)
+{
+    NTSTATUS status         = STATUS_UNSUCCESSFUL;
+    HANDLE   section_handle = NULL;
+    PVOID    section        = NULL;
+    SIZE_T   section_size   = 0;
+    PE_VIEW  view           = {0};
+    UINT32   count          = 0;
+
+    status = MapDiskImageIntoVirtualAddressSpace(
+        &section_handle, &section, &Image->path, &section_size);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("MapDiskImageIntoVirtualAddressSpace failed with status %x",
+                    status);
+        return status;
+    }
+
+    status = PeViewInitialise(&view, section, section_size);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("PeViewInitialise failed with status %x", status);
+        goto end;
+    }
+
+    count = PageHashCountPages(&view);
+
+    if (!count) {
+        status = STATUS_INVALID_IMAGE_FORMAT;
+        goto end;
+    }
+
+    /* the scratch page comes first, then the page hashes */
+    Image->scratch =
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                           PAGE_HASH_PAGE_SIZE + count * sizeof(PAGE_HASH),
+                           POOL_TAG_MODULE_IMAGE);
+
+    if (!Image->scratch) {
+        status = STATUS_MEMORY_NOT_ALLOCATED;
+        goto end;
+    }
+
+    Image->size            = section_size;
+    Image->hashes.capacity = count;
+    Image->hashes.pages =
+        (PPAGE_HASH)((UINT64)Image->scratch + PAGE_HASH_PAGE_SIZE);
+
+    PageHashSetReset(&Image->hashes);
+    status = PageHashSetAddImage(&Image->hashes, &view);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("PageHashSetAddImage failed with status %x", status);
+        ImpExFreePoolWithTag(Image->scratch, POOL_TAG_MODULE_IMAGE);
+        Image->scratch = NULL;
+        RtlZeroMemory(&Image->hashes, sizeof(PAGE_HASH_SET));
+        goto end;
+    }
+
+    DEBUG_VERBOSE("Module image pages hashed: %lx", Image->hashes.count);
+
+end:
+    ImpZwUnmapViewOfSection(ZwCurrentProcess(), section);
+    ImpZwClose(section_handle);
+    return status;
+}
+
+STATIC
+VOID
+ReportModuleImageModified(_In_ PPAGE_HASH Page, _Inout_opt_ PVOID Context)
+{
+    PMODULE_IMAGE                 image  = Context;
+    PMODULE_IMAGE_MODIFIED_REPORT report = NULL;
+
+    DEBUG_WARNING("Module image page modified. Base: %llx, Rva: %lx",
+                  image->base,
+                  Page->rva);
+
+    report = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                sizeof(MODULE_IMAGE_MODIFIED_REPORT),
+                                REPORT_POOL_TAG);
+
+    if (!report)
+        return;
+
+    report->report_code = REPORT_MODULE_IMAGE_MODIFIED;
+    report->page_rva    = Page->rva;
+    report->page_length = Page->length;
+    report->image_size  = (UINT32)image->size;
+    report->image_base  = image->base;
+
+    if (!NT_SUCCESS(
+            IrpQueueCompleteIrp(report, sizeof(MODULE_IMAGE_MODIFIED_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+/*
+ * Run from the integrity check timer. Verifies the next
+ * MODULE_IMAGE_VERIFY_BUDGET pages of the registered module, so every page is
+ * verified once per pass over the image while the cost per frame stays the
+ * same as verifying a page every frame.
+ */
+NTSTATUS
+ValidateModuleImage()
+{
+    PAGED_CODE();
+
+    NTSTATUS        status    = STATUS_SUCCESS;
+    PACTIVE_SESSION session   = GetActiveSession();
+    PMODULE_IMAGE   image     = &session->module_image;
+    PEPROCESS       process   = NULL;
+    KAPC_STATE      apc_state = {0};
+    UINT32          pages     = 0;
+
+    SessionGetProcess(&process);
+
+    if (!process)
+        return STATUS_SUCCESS;
+
+    ImpKeAcquireGuardedMutex(&session->module_lock);
+
+    if (!image->base)
+        goto end;
+
+    if (!image->hashes.pages) {
+        status = BuildModuleImageHashes(image);
+
+        if (!NT_SUCCESS(status)) {
+            DEBUG_ERROR("BuildModuleImageHashes failed with status %x",
+                        status);
+            goto end;
+        }
+    }
+
+    ImpKeStackAttachProcess(process, &apc_state);
+
+    pages = PageHashSetVerify(&image->hashes,
+                              image->base,
+                              MODULE_IMAGE_VERIFY_BUDGET,
+                              image->scratch,
+                              ReportModuleImageModified,
+                              image);
+
+    ImpKeUnstackDetachProcess(&apc_state);
+
+    DEBUG_VERBOSE("Module image pages verified: %lx, Mismatches: %llx",
+                  pages,
+                  image->hashes.mismatches);
+
+end:
+    ImpKeReleaseGuardedMutex(&session->module_lock);
+    return status;
+}
+
+/* called when a session starts or ends, the next module has to register */
+VOID
+ResetModuleImage()
+{
+    PAGED_CODE();
+
+    PACTIVE_SESSION session = GetActiveSession();
+    PMODULE_IMAGE   image   = &session->module_image;
+
+    ImpKeAcquireGuardedMutex(&session->module_lock);
+
+    if (image->path.Buffer)
+        ImpExFreePoolWithTag(image->path.Buffer, POOL_TAG_MODULE_IMAGE);
+
+    if (image->scratch)
+        ImpExFreePoolWithTag(image->scratch, POOL_TAG_MODULE_IMAGE);
+
+    RtlZeroMemory(image, sizeof(MODULE_IMAGE));
+
+    ImpKeReleaseGuardedMutex(&session->module_lock);
+}
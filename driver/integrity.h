@@ -5,6 +5,9 @@
 
 #include "common.h"
 
+#include "../core/dataptr.h"
+#include "../core/signature.h"
+
 typedef struct _MODULE_DISPATCHER_HEADER {
     volatile UINT32 validated; // if this is > 0, a thread is already using it
     UINT8           result;
@@ -50,6 +53,14 @@ typedef struct _SYS_MODULE_VAL_CONTEXT {
 
 } SYS_MODULE_VAL_CONTEXT, *PSYS_MODULE_VAL_CONTEXT;
 
+typedef struct _DATA_POINTER_CONTEXT {
+    DATA_POINTER_MAP map;
+
+    /* driver list generation when the map was built */
+    LONG driver_generation;
+
+} DATA_POINTER_CONTEXT, *PDATA_POINTER_CONTEXT;
+
 typedef enum _SMBIOS_TABLE_INDEX {
     SmbiosInformation = 0,
     SystemInformation,
@@ -84,12 +95,6 @@ ParseSMBIOSTable(_Out_ PVOID Buffer,
 NTSTATUS
 DetectEptHooksInKeyFunctions();
 
-PVOID
-ScanForSignature(_In_ PVOID  BaseAddress,
-                 _In_ SIZE_T MaxLength,
-                 _In_ LPCSTR Signature,
-                 _In_ SIZE_T SignatureLength);
-
 NTSTATUS
 ValidateNtoskrnl();
 
@@ -120,4 +125,25 @@ ValidateOurDriversDispatchRoutines();
 VOID
 DeferredModuleHashingCallback();
 
+NTSTATUS
+ValidateDataPointers();
+
+VOID
+CleanupDataPointerContextOnUnload(_In_ PDATA_POINTER_CONTEXT Context);
+
+NTSTATUS
+ScanProcessExecutableMemory();
+
+NTSTATUS
+RegisterModuleImage(_In_ PIRP Irp);
+
+NTSTATUS
+ValidateModuleImage();
+
+VOID
+ResetModuleImage();
+
+VOID
+ResetProcessMemoryScan();
+
 #endif
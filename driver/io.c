@@ -68,6 +68,16 @@ DispatchApcOperation(_In_ PAPC_OPERATION_ID Operation);
     CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20023, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #define IOCTL_VALIDATE_PCI_DEVICES \
     CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20024, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_QUERY_TRACE_EVENTS \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20025, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_SCAN_PROCESS_EXECUTABLE_MEMORY \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20026, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_REGISTER_MODULE_IMAGE \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20027, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_SCAN_KERNEL_EXECUTABLE_MEMORY \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20028, METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define IOCTL_QUERY_HEARTBEAT \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20029, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
 #define APC_OPERATION_STACKWALK 0x1
 
@@ -259,6 +269,9 @@ IrpQueueCompleteIrp(_In_ PVOID Buffer, _In_ ULONG BufferSize)
     NTSTATUS        status = STATUS_UNSUCCESSFUL;
     PIRP_QUEUE_HEAD queue  = GetIrpQueueHead();
 
+    /* counted whether or not it gets delivered, see core/heartbeat.h */
+    SessionIncrementReportCount();
+
     PIRP irp = IoCsqRemoveNextIrp(&queue->csq, NULL);
 
     /*
@@ -504,7 +517,7 @@ SharedMappingTerminate()
     KeCancelTimer(&mapping->timer);
     IoFreeWorkItem(mapping->work_item);
     IoFreeMdl(mapping->mdl);
-    ExFreePoolWithTag(mapping->kernel_buffer, POOL_TAG_INTEGRITY);
+    ImpExFreePoolWithTag(mapping->kernel_buffer, POOL_TAG_INTEGRITY);
 
     RtlZeroMemory(mapping, sizeof(SHARED_MAPPING));
 }
@@ -561,7 +574,7 @@ SharedMappingInitialise(_In_ PIRP Irp)
      * zero
      */
     buffer =
-        ExAllocatePool2(POOL_FLAG_NON_PAGED, PAGE_SIZE, POOL_TAG_INTEGRITY);
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED, PAGE_SIZE, POOL_TAG_INTEGRITY);
 
     if (!buffer)
         return STATUS_INSUFFICIENT_RESOURCES;
@@ -570,7 +583,7 @@ SharedMappingInitialise(_In_ PIRP Irp)
 
     if (!mdl) {
         DEBUG_ERROR("IoAllocateMdl failed with no status");
-        ExFreePoolWithTag(buffer, POOL_TAG_INTEGRITY);
+        ImpExFreePoolWithTag(buffer, POOL_TAG_INTEGRITY);
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
@@ -590,7 +603,7 @@ SharedMappingInitialise(_In_ PIRP Irp)
         DEBUG_ERROR("MmMapLockedPagesSpecifyCache failed with status %x",
                     status);
         IoFreeMdl(mdl);
-        ExFreePoolWithTag(buffer, POOL_TAG_INTEGRITY);
+        ImpExFreePoolWithTag(buffer, POOL_TAG_INTEGRITY);
         return status;
     }
 
@@ -610,6 +623,38 @@ SharedMappingInitialise(_In_ PIRP Irp)
     return status;
 }
 
+/*
+ * Drains the trace rings into the output buffer, as many events as fit. The
+ * drain cursors are shared so the config lock serialises concurrent queries.
+ */
+STATIC
+NTSTATUS
+QueryTraceEvents(_In_ PIRP Irp)
+{
+    NTSTATUS           status = STATUS_UNSUCCESSFUL;
+    PIO_STACK_LOCATION io     = IoGetCurrentIrpStackLocation(Irp);
+    ULONG              length = 0;
+
+    length = io->Parameters.DeviceIoControl.OutputBufferLength;
+
+    if (length < sizeof(TRACE_DRAIN_HEADER))
+        return STATUS_BUFFER_TOO_SMALL;
+
+    status = ValidateIrpOutputBuffer(Irp, length);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("ValidateIrpOutputBuffer failed with status %x", status);
+        return status;
+    }
+
+    AcquireDriverConfigLock();
+    Irp->IoStatus.Information = TraceDrain(
+        GetTraceBuffer(), Irp->AssociatedIrp.SystemBuffer, length);
+    ReleaseDriverConfigLock();
+
+    return status;
+}
+
 STATIC
 NTSTATUS
 DispatchApcOperation(_In_ PAPC_OPERATION_ID Operation)
@@ -703,6 +748,39 @@ ValidateIrpInputBuffer(_In_ PIRP Irp, _In_ ULONG RequiredSize)
     return STATUS_SUCCESS;
 }
 
+/*
+ * Which check an IOCTL runs, used to record how long the check took. IOCTLs
+ * which only move data between us and the module aren't traced.
+ */
+STATIC
+TRACE_CHECK_ID
+GetTraceCheckId(_In_ ULONG IoControlCode)
+{
+    switch (IoControlCode) {
+    case IOCTL_RUN_NMI_CALLBACKS: return TRACE_CHECK_NMI_CALLBACKS;
+    case IOCTL_VALIDATE_DRIVER_OBJECTS: return TRACE_CHECK_DRIVER_OBJECTS;
+    case IOCTL_PERFORM_VIRTUALIZATION_CHECK: return TRACE_CHECK_VIRTUALISATION;
+    case IOCTL_ENUMERATE_HANDLE_TABLES: return TRACE_CHECK_HANDLE_TABLES;
+    case IOCTL_RETRIEVE_MODULE_EXECUTABLE_REGIONS:
+    case IOCTL_VALIDATE_PROCESS_LOADED_MODULE:
+        return TRACE_CHECK_PROCESS_MODULES;
+    case IOCTL_SCAN_FOR_UNLINKED_PROCESS:
+        return TRACE_CHECK_UNLINKED_PROCESSES;
+    case IOCTL_PERFORM_INTEGRITY_CHECK: return TRACE_CHECK_MODULE_INTEGRITY;
+    case IOCTL_DETECT_ATTACHED_THREADS: return TRACE_CHECK_ATTACHED_THREADS;
+    case IOCTL_INITIATE_APC_OPERATION: return TRACE_CHECK_APC_STACKWALK;
+    case IOCTL_CHECK_FOR_EPT_HOOK: return TRACE_CHECK_EPT_HOOKS;
+    case IOCTL_LAUNCH_DPC_STACKWALK: return TRACE_CHECK_DPC_STACKWALK;
+    case IOCTL_VALIDATE_SYSTEM_MODULES: return TRACE_CHECK_SYSTEM_MODULES;
+    case IOCTL_VALIDATE_PCI_DEVICES: return TRACE_CHECK_PCI_DEVICES;
+    case IOCTL_SCAN_PROCESS_EXECUTABLE_MEMORY:
+        return TRACE_CHECK_PROCESS_MEMORY;
+    case IOCTL_SCAN_KERNEL_EXECUTABLE_MEMORY:
+        return TRACE_CHECK_KERNEL_MEMORY;
+    default: return TRACE_CHECK_UNKNOWN;
+    }
+}
+
 NTSTATUS
 DeviceControl(_In_ PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp)
 {
@@ -713,6 +791,8 @@ DeviceControl(_In_ PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp)
     HANDLE             handle         = NULL;
     PKTHREAD           thread         = NULL;
     BOOLEAN            security_flag  = FALSE;
+    UINT64             start          = __rdtsc();
+    TRACE_CHECK_ID     check          = TRACE_CHECK_UNKNOWN;
 
     /*
      * LMAO
@@ -1051,6 +1131,59 @@ DeviceControl(_In_ PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp)
 
         break;
 
+    case IOCTL_SCAN_PROCESS_EXECUTABLE_MEMORY:
+
+        DEBUG_INFO("IOCTL_SCAN_PROCESS_EXECUTABLE_MEMORY Received");
+
+        status = ScanProcessExecutableMemory();
+
+        if (!NT_SUCCESS(status))
+            DEBUG_ERROR("ScanProcessExecutableMemory failed with status %x",
+                        status);
+
+        break;
+
+    case IOCTL_SCAN_KERNEL_EXECUTABLE_MEMORY:
+
+        DEBUG_INFO("IOCTL_SCAN_KERNEL_EXECUTABLE_MEMORY Received");
+
+        status = FindUnownedExecutableMemory();
+
+        if (!NT_SUCCESS(status))
+            DEBUG_ERROR("FindUnownedExecutableMemory failed with status %x",
+                        status);
+
+        break;
+
+    case IOCTL_REGISTER_MODULE_IMAGE:
+
+        DEBUG_INFO("IOCTL_REGISTER_MODULE_IMAGE Received");
+
+        status = RegisterModuleImage(Irp);
+
+        if (!NT_SUCCESS(status))
+            DEBUG_ERROR("RegisterModuleImage failed with status %x", status);
+
+        break;
+
+    case IOCTL_QUERY_TRACE_EVENTS:
+
+        status = QueryTraceEvents(Irp);
+
+        if (!NT_SUCCESS(status))
+            DEBUG_ERROR("QueryTraceEvents failed with status %x", status);
+
+        break;
+
+    case IOCTL_QUERY_HEARTBEAT:
+
+        status = SessionQueryHeartbeat(Irp);
+
+        if (!NT_SUCCESS(status))
+            DEBUG_ERROR("SessionQueryHeartbeat failed with status %x", status);
+
+        break;
+
     default:
         DEBUG_WARNING("Invalid IOCTL passed to driver: %lx",
                       stack_location->Parameters.DeviceIoControl.IoControlCode);
@@ -1060,6 +1193,12 @@ DeviceControl(_In_ PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp)
     }
 
 end:
+    check = GetTraceCheckId(
+        stack_location->Parameters.DeviceIoControl.IoControlCode);
+
+    if (check != TRACE_CHECK_UNKNOWN)
+        DEBUG_TRACE_SPAN(check, start, (UINT32)status);
+
     DEBUG_VERBOSE("Completing IRP with status %x", status);
     Irp->IoStatus.Status = status;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
@@ -3,6 +3,8 @@
 #include "imports.h"
 #include "driver.h"
 
+#include "../core/container.h"
+
 /*
  * Simple thread safe linked list implementation. All structures should begin
  * with a SINGLE_LIST_ENTRY structure provided by the windows API. for example:
@@ -40,10 +42,7 @@ ListInsert(_Inout_ PSINGLE_LIST_ENTRY Head,
 {
     ImpKeAcquireGuardedMutex(Lock);
 
-    PSINGLE_LIST_ENTRY old_entry = Head->Next;
-
-    Head->Next     = NewEntry;
-    NewEntry->Next = old_entry;
+    SingleListInsertHead(Head, NewEntry);
 
     ImpKeReleaseGuardedMutex(Lock);
 }
@@ -68,7 +67,7 @@ ListFreeFirstEntry(_Inout_ PSINGLE_LIST_ENTRY       Head,
         if (CallbackRoutine)
             CallbackRoutine(entry);
 
-        Head->Next = Head->Next->Next;
+        SingleListRemoveHead(Head);
         ImpExFreePoolWithTag(entry, POOL_TAG_THREAD_LIST);
         result = TRUE;
     }
@@ -88,28 +87,9 @@ ListRemoveEntry(_Inout_ PSINGLE_LIST_ENTRY Head,
 {
     ImpKeAcquireGuardedMutex(Lock);
 
-    PSINGLE_LIST_ENTRY entry = Head->Next;
-
-    if (!entry)
-        goto unlock;
-
-    if (entry == Entry) {
-        Head->Next = entry->Next;
+    if (SingleListUnlinkEntry(Head, Entry))
         ImpExFreePoolWithTag(Entry, POOL_TAG_THREAD_LIST);
-        goto unlock;
-    }
-
-    while (entry->Next) {
-        if (entry->Next == Entry) {
-            entry->Next = Entry->Next;
-            ImpExFreePoolWithTag(Entry, POOL_TAG_THREAD_LIST);
-            goto unlock;
-        }
 
-        entry = entry->Next;
-    }
-
-unlock:
     ImpKeReleaseGuardedMutex(Lock);
 }
 
@@ -120,29 +100,11 @@ LookasideListRemoveEntry(_Inout_ PSINGLE_LIST_ENTRY Head,
 {
     ImpKeAcquireGuardedMutex(Lock);
 
-    PTHREAD_LIST_HEAD  head  = GetThreadList();
-    PSINGLE_LIST_ENTRY entry = Head->Next;
-
-    if (!entry)
-        goto unlock;
+    PTHREAD_LIST_HEAD head = GetThreadList();
 
-    if (entry == Entry) {
-        Head->Next = entry->Next;
+    if (SingleListUnlinkEntry(Head, Entry))
         ExFreeToLookasideListEx(&head->lookaside_list, Entry);
-        goto unlock;
-    }
-
-    while (entry->Next) {
-        if (entry->Next == Entry) {
-            entry->Next = Entry->Next;
-            ExFreeToLookasideListEx(&head->lookaside_list, Entry);
-            goto unlock;
-        }
-
-        entry = entry->Next;
-    }
 
-unlock:
     ImpKeReleaseGuardedMutex(Lock);
 }
 
@@ -162,7 +124,7 @@ LookasideListFreeFirstEntry(_Inout_ PSINGLE_LIST_ENTRY       Head,
         if (CallbackRoutine)
             CallbackRoutine(entry);
 
-        Head->Next = Head->Next->Next;
+        SingleListRemoveHead(Head);
         ExFreeToLookasideListEx(&head->lookaside_list, entry);
         result = TRUE;
     }
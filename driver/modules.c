@@ -40,6 +40,45 @@ CHAR WHITELISTED_MODULES[WHITELISTED_MODULE_COUNT][MODULE_MAX_STRING_SIZE] = {
     "rdbss.sys",
     "LXCORE.SYS"};
 
+/*
+ * Modules that may own the dispatch routines of any driver. ntoskrnl fills
+ * unused slots with IopInvalidDeviceRequest and wdf routes every slot of a
+ * kmdf driver through itself.
+ */
+#define DRIVER_DISPATCH_FRAMEWORK_COUNT 2
+
+CHAR DRIVER_DISPATCH_FRAMEWORKS[DRIVER_DISPATCH_FRAMEWORK_COUNT]
+                               [MODULE_MAX_STRING_SIZE] = {"ntoskrnl.exe",
+                                                           "Wdf01000.sys"};
+
+/*
+ * Class and port drivers that fill in the dispatch routines of the drivers
+ * built on them. They may only own the routines of a driver that imports
+ * from them, see core/drvdispatch.h. The order is the bit each port has in
+ * a drivers snapshot, so only append to this.
+ */
+#define DRIVER_DISPATCH_PORT_COUNT 9
+
+CHAR DRIVER_DISPATCH_PORTS[DRIVER_DISPATCH_PORT_COUNT][MODULE_MAX_STRING_SIZE] = {
+    /* disk, cdrom and the other storage class drivers */
+    "CLASSPNP.SYS",
+    /* hid minidrivers such as hidusb and hidi2c */
+    "HIDCLASS.SYS",
+    /* storage miniports such as stornvme and storahci */
+    "storport.sys",
+    /* display miniports */
+    "dxgkrnl.sys",
+    /* network miniports, filters and protocols */
+    "ndis.sys",
+    /* avstream minidrivers */
+    "ks.sys",
+    /* audio miniports */
+    "portcls.sys",
+    /* network mini redirectors */
+    "rdbss.sys",
+    /* wsl pico providers */
+    "LXCORE.SYS"};
+
 #define MODULE_REPORT_DRIVER_NAME_BUFFER_SIZE 128
 
 #define REASON_NO_BACKING_MODULE      1
@@ -89,6 +128,15 @@ typedef struct _INVALID_DRIVERS_HEAD {
 
 } INVALID_DRIVERS_HEAD, *PINVALID_DRIVERS_HEAD;
 
+/* the module indexes a driver dispatch round classifies routines against */
+typedef struct _DRIVER_DISPATCH_ROUND {
+    PMODULE_RANGE      ranges;
+    MODULE_RANGE_INDEX modules;
+    MODULE_RANGE_INDEX allowed;
+    MODULE_RANGE       ports[DRIVER_DISPATCH_PORT_COUNT];
+
+} DRIVER_DISPATCH_ROUND, *PDRIVER_DISPATCH_ROUND;
+
 STATIC
 NTSTATUS
 PopulateWhitelistedModuleBuffer(_Inout_ PVOID        Buffer,
@@ -131,6 +179,15 @@ ValidateDriverObjectsWrapper(_In_ PSYSTEM_MODULES SystemModules,
                              _Inout_ PINVALID_DRIVERS_HEAD
                                  InvalidDriverListHead);
 
+STATIC
+NTSTATUS
+BeginDriverDispatchRound(_In_ PSYSTEM_MODULES         SystemModules,
+                         _Out_ PDRIVER_DISPATCH_ROUND Round);
+
+STATIC
+VOID
+EndDriverDispatchRound(_Inout_ PDRIVER_DISPATCH_ROUND Round);
+
 STATIC
 NTSTATUS
 AnalyseNmiData(_In_ PNMI_CONTEXT    NmiContext,
@@ -164,7 +221,6 @@ ValidateThreadViaKernelApcCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
                                    _Inout_opt_ PVOID       Context);
 
 #ifdef ALLOC_PRAGMA
-#    pragma alloc_text(PAGE, FindSystemModuleByName)
 #    pragma alloc_text(PAGE, PopulateWhitelistedModuleBuffer)
 #    pragma alloc_text(PAGE, ValidateDriverIOCTLDispatchRegion)
 #    pragma alloc_text(PAGE, InitDriverList)
@@ -174,8 +230,9 @@ ValidateThreadViaKernelApcCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
 #    pragma alloc_text(PAGE, ValidateDriverObjectHasBackingModule)
 #    pragma alloc_text(PAGE, GetSystemModuleInformation)
 #    pragma alloc_text(PAGE, ValidateDriverObjectsWrapper)
+#    pragma alloc_text(PAGE, BeginDriverDispatchRound)
+#    pragma alloc_text(PAGE, EndDriverDispatchRound)
 #    pragma alloc_text(PAGE, HandleValidateDriversIOCTL)
-#    pragma alloc_text(PAGE, IsInstructionPointerInInvalidRegion)
 #    pragma alloc_text(PAGE, AnalyseNmiData)
 #    pragma alloc_text(PAGE, LaunchNonMaskableInterrupt)
 #    pragma alloc_text(PAGE, HandleNmiIOCTL)
@@ -185,35 +242,10 @@ ValidateThreadViaKernelApcCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
 #    pragma alloc_text(PAGE, FlipKThreadMiscFlagsFlag)
 #    pragma alloc_text(PAGE, ValidateThreadsViaKernelApc)
 #    pragma alloc_text(PAGE, ValidateThreadViaKernelApcCallback)
+#    pragma alloc_text(PAGE, ValidateHalDispatchTables)
+#    pragma alloc_text(PAGE, ResetHalDispatchTableSnapshot)
 #endif
 
-/*
- * This returns a reference to an entry in the system modules array retrieved
- * via GetSystemModuleInformation. It's important to remember we don't free the
- * modules once we retrieve this reference, and instead only free them when we
- * are done using it.
- */
-PRTL_MODULE_EXTENDED_INFO
-FindSystemModuleByName(_In_ LPCSTR          ModuleName,
-                       _In_ PSYSTEM_MODULES SystemModules)
-{
-    PAGED_CODE();
-
-    if (!ModuleName || !SystemModules)
-        return NULL;
-
-    PRTL_MODULE_EXTENDED_INFO modules =
-        (PRTL_MODULE_EXTENDED_INFO)SystemModules->address;
-
-    for (INT index = 0; index < SystemModules->module_count; index++) {
-        if (strstr(modules[index].FullPathName, ModuleName)) {
-            return &modules[index];
-        }
-    }
-
-    return NULL;
-}
-
 STATIC
 NTSTATUS
 PopulateWhitelistedModuleBuffer(_Inout_ PVOID        Buffer,
@@ -456,6 +488,279 @@ GetSystemModuleInformation(_Out_ PSYSTEM_MODULES ModuleInformation)
     return status;
 }
 
+STATIC
+VOID
+ReportDriverDispatchHook(_In_ PDRIVER_DISPATCH_ENTRY  Entry,
+                         _In_ UINT32                  Slot,
+                         _In_ UINT64                  Previous,
+                         _In_ DRIVER_DISPATCH_VERDICT Verdict,
+                         _Inout_opt_ PVOID            Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    NTSTATUS                     status = STATUS_UNSUCCESSFUL;
+    PDRIVER_OBJECT               driver = (PDRIVER_OBJECT)Entry->driver;
+    ANSI_STRING                  string = {0};
+    PDRIVER_DISPATCH_HOOK_REPORT report = NULL;
+
+    DEBUG_WARNING("Driver %wZ dispatch slot %lx points to %llx, verdict: %lx",
+                  &driver->DriverName,
+                  Slot,
+                  Entry->slots[Slot],
+                  Verdict);
+
+    report = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                sizeof(DRIVER_DISPATCH_HOOK_REPORT),
+                                REPORT_POOL_TAG);
+
+    if (!report)
+        return;
+
+    report->report_code = REPORT_DRIVER_DISPATCH_HOOK;
+    report->slot        = Slot;
+    report->verdict     = Verdict;
+    report->driver_base = Entry->image_base;
+    report->driver_size = (UINT32)(Entry->image_end - Entry->image_base);
+    report->previous    = Previous;
+    report->current     = Entry->slots[Slot];
+
+    string.Length        = 0;
+    string.MaximumLength = DRIVER_DISPATCH_REPORT_NAME_LENGTH;
+    string.Buffer        = report->driver_name;
+
+    /* still send the report if we fail to get the driver name */
+    status = ImpRtlUnicodeStringToAnsiString(
+        &string, &driver->DriverName, FALSE);
+
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("RtlUnicodeStringToAnsiString failed with status %x",
+                    status);
+
+    if (!NT_SUCCESS(
+            IrpQueueCompleteIrp(report, sizeof(DRIVER_DISPATCH_HOOK_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+STATIC
+VOID
+CaptureDriverDispatchEntry(_In_ PDRIVER_OBJECT          Driver,
+                           _Out_ PDRIVER_DISPATCH_ENTRY Entry)
+{
+    PFAST_IO_DISPATCH fast_io = Driver->FastIoDispatch;
+    UINT32            count   = 0;
+
+    RtlZeroMemory(Entry, sizeof(DRIVER_DISPATCH_ENTRY));
+
+    Entry->driver     = (UINT64)Driver;
+    Entry->image_base = (UINT64)Driver->DriverStart;
+    Entry->image_end  = Entry->image_base + Driver->DriverSize;
+
+    RtlCopyMemory(Entry->slots,
+                  Driver->MajorFunction,
+                  DRIVER_DISPATCH_MAJOR_FUNCTIONS * sizeof(UINT64));
+
+    Entry->slots[DRIVER_DISPATCH_SLOT_UNLOAD] = (UINT64)Driver->DriverUnload;
+    Entry->slots[DRIVER_DISPATCH_SLOT_FAST_IO_TABLE] = (UINT64)fast_io;
+
+    if (!fast_io || !ImpMmIsAddressValid(fast_io))
+        return;
+
+    /* older drivers register a shorter table, the size says how many */
+    if (fast_io->SizeOfFastIoDispatch <=
+        FIELD_OFFSET(FAST_IO_DISPATCH, FastIoCheckIfPossible))
+        return;
+
+    count = (fast_io->SizeOfFastIoDispatch -
+             FIELD_OFFSET(FAST_IO_DISPATCH, FastIoCheckIfPossible)) /
+            sizeof(UINT64);
+
+    if (count > DRIVER_DISPATCH_FAST_IO_ROUTINES)
+        count = DRIVER_DISPATCH_FAST_IO_ROUTINES;
+
+    RtlCopyMemory(&Entry->slots[DRIVER_DISPATCH_SLOT_FAST_IO],
+                  &fast_io->FastIoCheckIfPossible,
+                  count * sizeof(UINT64));
+}
+
+/*
+ * The import address table outlives the INIT section, so it is still there
+ * to read long after the driver loaded. Drivers whose headers or table
+ * can't be read have no ports.
+ */
+STATIC
+VOID
+ResolveDriverDispatchPorts(_In_ PDRIVER_OBJECT            Driver,
+                           _In_ PDRIVER_DISPATCH_SNAPSHOT Snapshot,
+                           _Inout_ PDRIVER_DISPATCH_ENTRY Entry)
+{
+    PE_VIEW               view      = {0};
+    PIMAGE_DATA_DIRECTORY directory = NULL;
+    PUINT64               table     = NULL;
+
+    if (!Driver->DriverStart || !ImpMmIsAddressValid(Driver->DriverStart))
+        return;
+
+    if (!NT_SUCCESS(
+            PeViewInitialise(&view, Driver->DriverStart, Driver->DriverSize)))
+        return;
+
+    directory = PeViewGetDataDirectory(&view, IMAGE_DIRECTORY_ENTRY_IAT);
+
+    if (!directory || directory->Size < sizeof(UINT64))
+        return;
+
+    table = PeViewGetPointer(&view, directory->VirtualAddress, directory->Size);
+
+    if (!table || !ImpMmIsAddressValid(table) ||
+        !ImpMmIsAddressValid((PUCHAR)table + directory->Size - 1))
+        return;
+
+    DriverDispatchResolvePorts(
+        Snapshot, Entry, table, directory->Size / sizeof(UINT64));
+}
+
+/*
+ * Called for every driver object while the driver directory is locked, and
+ * with the dispatch context lock held by ValidateDriverObjectsWrapper.
+ */
+STATIC
+VOID
+ValidateDriverDispatchRoutines(_In_ PDRIVER_OBJECT Driver)
+{
+    PDRIVER_DISPATCH_CONTEXT context = GetDriverDispatchContext();
+    DRIVER_DISPATCH_ENTRY    live    = {0};
+
+    if (!context->snapshot.modules)
+        return;
+
+    CaptureDriverDispatchEntry(Driver, &live);
+    ResolveDriverDispatchPorts(Driver, &context->snapshot, &live);
+    DriverDispatchUpdate(
+        &context->snapshot, &live, ReportDriverDispatchHook, NULL);
+}
+
+/*
+ * The snapshot itself is allocated the first time it is needed and kept
+ * until unload, drivers outlive sessions.
+ */
+STATIC
+NTSTATUS
+BeginDriverDispatchRound(_In_ PSYSTEM_MODULES         SystemModules,
+                         _Out_ PDRIVER_DISPATCH_ROUND Round)
+{
+    PAGED_CODE();
+
+    PDRIVER_DISPATCH_CONTEXT  context  = GetDriverDispatchContext();
+    PDRIVER_DISPATCH_ENTRY    entries  = NULL;
+    PRTL_MODULE_EXTENDED_INFO module   = NULL;
+    UINT32                    capacity = 0;
+
+    RtlZeroMemory(Round, sizeof(DRIVER_DISPATCH_ROUND));
+
+    if (SystemModules->module_count <= 0)
+        return STATUS_INVALID_PARAMETER;
+
+    capacity      = (UINT32)SystemModules->module_count;
+    Round->ranges = ImpExAllocatePool2(
+        POOL_FLAG_NON_PAGED,
+        (capacity + DRIVER_DISPATCH_FRAMEWORK_COUNT) * sizeof(MODULE_RANGE),
+        POOL_TAG_DRIVER_DISPATCH);
+
+    if (!Round->ranges)
+        return STATUS_MEMORY_NOT_ALLOCATED;
+
+    ModuleRangeIndexInitialise(&Round->modules, Round->ranges, capacity);
+    ModuleRangeIndexBuild(&Round->modules, SystemModules);
+
+    ModuleRangeIndexInitialise(&Round->allowed,
+                               Round->ranges + capacity,
+                               DRIVER_DISPATCH_FRAMEWORK_COUNT);
+
+    for (INT index = 0; index < DRIVER_DISPATCH_FRAMEWORK_COUNT; index++) {
+        module = FindSystemModuleByName(DRIVER_DISPATCH_FRAMEWORKS[index],
+                                        SystemModules);
+
+        if (module)
+            ModuleRangeIndexAdd(
+                &Round->allowed, (UINT64)module->ImageBase, module->ImageSize);
+    }
+
+    ModuleRangeIndexSort(&Round->allowed);
+
+    /* ports that aren't loaded keep an empty range so the bits stay put */
+    for (INT index = 0; index < DRIVER_DISPATCH_PORT_COUNT; index++) {
+        module =
+            FindSystemModuleByName(DRIVER_DISPATCH_PORTS[index], SystemModules);
+
+        if (!module)
+            continue;
+
+        Round->ports[index].base = (UINT64)module->ImageBase;
+        Round->ports[index].end  = Round->ports[index].base + module->ImageSize;
+    }
+
+    ImpKeAcquireGuardedMutex(&context->lock);
+
+    if (!context->snapshot.entries) {
+        entries = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                     DRIVER_DISPATCH_DEFAULT_CAPACITY *
+                                         sizeof(DRIVER_DISPATCH_ENTRY),
+                                     POOL_TAG_DRIVER_DISPATCH);
+
+        if (!entries) {
+            ImpKeReleaseGuardedMutex(&context->lock);
+            ImpExFreePoolWithTag(Round->ranges, POOL_TAG_DRIVER_DISPATCH);
+            Round->ranges = NULL;
+            return STATUS_MEMORY_NOT_ALLOCATED;
+        }
+
+        DriverDispatchInitialise(
+            &context->snapshot, entries, DRIVER_DISPATCH_DEFAULT_CAPACITY);
+    }
+
+    DriverDispatchBeginRound(&context->snapshot,
+                             &Round->modules,
+                             &Round->allowed,
+                             Round->ports,
+                             DRIVER_DISPATCH_PORT_COUNT);
+
+    return STATUS_SUCCESS;
+}
+
+STATIC
+VOID
+EndDriverDispatchRound(_Inout_ PDRIVER_DISPATCH_ROUND Round)
+{
+    PAGED_CODE();
+
+    PDRIVER_DISPATCH_CONTEXT  context  = GetDriverDispatchContext();
+    PDRIVER_DISPATCH_SNAPSHOT snapshot = &context->snapshot;
+
+    DriverDispatchEndRound(snapshot);
+
+    DEBUG_VERBOSE("Driver dispatch routines validated. Drivers: %lx, new: %lx, "
+                  "slots changed: %lx, removed: %lx",
+                  snapshot->drivers,
+                  snapshot->drivers_added,
+                  snapshot->slots_changed,
+                  snapshot->drivers_removed);
+
+    ImpKeReleaseGuardedMutex(&context->lock);
+
+    ImpExFreePoolWithTag(Round->ranges, POOL_TAG_DRIVER_DISPATCH);
+    Round->ranges = NULL;
+}
+
+VOID
+CleanupDriverDispatchOnUnload(_Inout_ PDRIVER_DISPATCH_CONTEXT Context)
+{
+    if (Context->snapshot.entries)
+        ImpExFreePoolWithTag(Context->snapshot.entries,
+                             POOL_TAG_DRIVER_DISPATCH);
+
+    RtlZeroMemory(&Context->snapshot, sizeof(DRIVER_DISPATCH_SNAPSHOT));
+}
+
 STATIC
 VOID
 ValidateDriverObjects(_In_ PSYSTEM_MODULES          SystemModules,
@@ -509,6 +814,8 @@ ValidateDriverObjects(_In_ PSYSTEM_MODULES          SystemModules,
                 Head->count += 1;
         }
 
+        ValidateDriverDispatchRoutines(current_driver);
+
         sub_entry = sub_entry->ChainLink;
     }
 }
@@ -527,13 +834,14 @@ ValidateDriverObjectsWrapper(_In_ PSYSTEM_MODULES          SystemModules,
     if (!SystemModules || !Head)
         return STATUS_INVALID_PARAMETER;
 
-    HANDLE            handle                     = NULL;
-    OBJECT_ATTRIBUTES attributes                 = {0};
-    PVOID             directory                  = {0};
-    UNICODE_STRING    directory_name             = {0};
-    PVOID             whitelisted_regions_buffer = NULL;
-    NTSTATUS          status                     = STATUS_UNSUCCESSFUL;
-    POBJECT_DIRECTORY directory_object           = NULL;
+    HANDLE                handle                     = NULL;
+    OBJECT_ATTRIBUTES     attributes                 = {0};
+    PVOID                 directory                  = {0};
+    UNICODE_STRING        directory_name             = {0};
+    PVOID                 whitelisted_regions_buffer = NULL;
+    NTSTATUS              status                     = STATUS_UNSUCCESSFUL;
+    POBJECT_DIRECTORY     directory_object           = NULL;
+    DRIVER_DISPATCH_ROUND round                      = {0};
 
     ImpRtlInitUnicodeString(&directory_name, L"\\Driver");
 
@@ -591,12 +899,20 @@ ValidateDriverObjectsWrapper(_In_ PSYSTEM_MODULES          SystemModules,
         goto end;
     }
 
+    status = BeginDriverDispatchRound(SystemModules, &round);
+
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("BeginDriverDispatchRound failed with status %x", status);
+
     for (INT index = 0; index < NUMBER_HASH_BUCKETS; index++) {
         POBJECT_DIRECTORY_ENTRY entry = directory_object->HashBuckets[index];
         ValidateDriverObjects(
             SystemModules, entry, Head, whitelisted_regions_buffer);
     }
 
+    if (NT_SUCCESS(status))
+        EndDriverDispatchRound(&round);
+
 end:
     if (whitelisted_regions_buffer)
         ImpExFreePoolWithTag(whitelisted_regions_buffer,
@@ -716,55 +1032,6 @@ end:
     return status;
 }
 
-/*
- * TODO: this probably doesnt need to return an NTSTATUS, we can just return a
- * boolean and remove the out variable.
- */
-NTSTATUS
-IsInstructionPointerInInvalidRegion(_In_ UINT64          RIP,
-                                    _In_ PSYSTEM_MODULES SystemModules,
-                                    _Out_ PBOOLEAN       Result)
-{
-    PAGED_CODE();
-
-    if (!RIP || !SystemModules || !Result)
-        return STATUS_INVALID_PARAMETER;
-
-    PRTL_MODULE_EXTENDED_INFO modules =
-        (PRTL_MODULE_EXTENDED_INFO)SystemModules->address;
-
-    /* Note that this does not check for HAL or PatchGuard Execution */
-    for (INT index = 0; index < SystemModules->module_count; index++) {
-        UINT64 base = (UINT64)modules[index].ImageBase;
-        UINT64 end  = base + modules[index].ImageSize;
-
-        if (RIP >= base && RIP <= end) {
-            *Result = TRUE;
-            return STATUS_SUCCESS;
-        }
-    }
-
-    *Result = FALSE;
-    return STATUS_SUCCESS;
-}
-
-NTSTATUS
-IsInstructionPointerInsideModule(_In_ UINT64                    Rip,
-                                 _In_ PRTL_MODULE_EXTENDED_INFO Module,
-                                 _Out_ PBOOLEAN                 Result)
-{
-    UINT64 base = (UINT64)Module->ImageBase;
-    UINT64 end  = base + Module->ImageSize;
-
-    if (Rip >= base && Rip <= end) {
-        *Result = TRUE;
-        return STATUS_SUCCESS;
-    }
-
-    *Result = FALSE;
-    return STATUS_SUCCESS;
-}
-
 STATIC
 VOID
 ReportNmiBlocking()
@@ -825,6 +1092,84 @@ ReportInvalidRipFoundDuringNmi(_In_ PNMI_CONTEXT Context)
     IrpQueueCompleteIrp(report, sizeof(HIDDEN_SYSTEM_THREAD_REPORT));
 }
 
+/*
+ * The stack cache is shared by the NMI, APC and DPC stackwalks. APC kernel
+ * routines run on many threads at once, so it is only ever touched with the
+ * spin lock held, and none of these helpers may be paged.
+ */
+STATIC
+VOID
+BeginStackCacheRound(_In_ PSYSTEM_MODULES Modules)
+{
+    KIRQL                irql        = {0};
+    PSTACK_CACHE_CONTEXT context     = GetStackCacheContext();
+    PSTACK_CACHE_ENTRY   entries     = NULL;
+    STACK_CACHE_STATS    previous    = {0};
+    UINT64               fingerprint = StackCacheModuleFingerprint(Modules);
+
+    KeAcquireSpinLock(&context->lock, &irql);
+
+    if (!context->cache.entries) {
+        entries = ImpExAllocatePool2(
+            POOL_FLAG_NON_PAGED,
+            STACK_CACHE_DEFAULT_CAPACITY * sizeof(STACK_CACHE_ENTRY),
+            POOL_TAG_STACK_CACHE);
+
+        if (entries)
+            StackCacheInitialise(
+                &context->cache, entries, STACK_CACHE_DEFAULT_CAPACITY);
+    }
+
+    StackCacheBeginRound(&context->cache, fingerprint);
+    previous = context->cache.previous;
+
+    KeReleaseSpinLock(&context->lock, irql);
+
+    DEBUG_VERBOSE("Stack cache round finished. Lookups: %llx, hits: %llx, "
+                  "frames skipped: %llx, evictions: %llx",
+                  previous.lookups,
+                  previous.hits,
+                  previous.frames_skipped,
+                  previous.evictions);
+}
+
+/* a hit means the same thread had the exact same stack when last validated */
+STATIC
+BOOLEAN
+IsStackCachedAsValid(_In_ UINT64 Thread, _In_ UINT64 Hash, _In_ UINT32 Frames)
+{
+    KIRQL                irql    = {0};
+    BOOLEAN              hit     = FALSE;
+    PSTACK_CACHE_CONTEXT context = GetStackCacheContext();
+
+    KeAcquireSpinLock(&context->lock, &irql);
+    hit = StackCacheLookup(&context->cache, Thread, Hash, Frames);
+    KeReleaseSpinLock(&context->lock, irql);
+
+    return hit;
+}
+
+STATIC
+VOID
+CacheValidStack(_In_ UINT64 Thread, _In_ UINT64 Hash, _In_ UINT32 Frames)
+{
+    KIRQL                irql    = {0};
+    PSTACK_CACHE_CONTEXT context = GetStackCacheContext();
+
+    KeAcquireSpinLock(&context->lock, &irql);
+    StackCacheInsert(&context->cache, Thread, Hash, Frames);
+    KeReleaseSpinLock(&context->lock, irql);
+}
+
+VOID
+CleanupStackCacheOnUnload(_Inout_ PSTACK_CACHE_CONTEXT Context)
+{
+    if (Context->cache.entries)
+        ImpExFreePoolWithTag(Context->cache.entries, POOL_TAG_STACK_CACHE);
+
+    RtlZeroMemory(&Context->cache, sizeof(STACK_CACHE));
+}
+
 /*
  * todo: i think we should split this function up into each analysis i.e one for
  * the interrupted rip, one for the cid etc.
@@ -835,17 +1180,31 @@ AnalyseNmiData(_In_ PNMI_CONTEXT NmiContext, _In_ PSYSTEM_MODULES SystemModules)
 {
     PAGED_CODE();
 
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-    BOOLEAN  flag   = FALSE;
+    NTSTATUS       status   = STATUS_UNSUCCESSFUL;
+    BOOLEAN        flag     = FALSE;
+    UINT64         hash     = 0;
+    CID_TABLE_WALK snapshot = {0};
 
     if (!NmiContext || !SystemModules)
         return STATUS_INVALID_PARAMETER;
 
+    BeginStackCacheRound(SystemModules);
+
+    /*
+     * The PspCidTable is walked once for the whole analysis, every thread is
+     * then checked against the sorted snapshot rather then going through
+     * PsLookupThreadByThreadId for each one.
+     */
+    status = SnapshotPspCidTable(&snapshot);
+
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("SnapshotPspCidTable failed with status %x", status);
+
     for (INT core = 0; core < ImpKeQueryActiveProcessorCount(0); core++) {
         /* Make sure our NMIs were run  */
         if (!NmiContext[core].callback_count) {
             ReportNmiBlocking();
-            return STATUS_SUCCESS;
+            goto end;
         }
 
         DEBUG_VERBOSE(
@@ -876,13 +1235,21 @@ AnalyseNmiData(_In_ PNMI_CONTEXT NmiContext, _In_ PSYSTEM_MODULES SystemModules)
          * PsGetNextProcess ?
          */
 
-        if (!ValidateThreadsPspCidTableEntry(NmiContext[core].kthread)) {
+        if (snapshot.objects &&
+            !ValidateThreadsPspCidTableEntry(&snapshot,
+                                             NmiContext[core].kthread)) {
             ReportMissingCidTableEntry(&NmiContext[core]);
         }
 
         if (NmiContext[core].user_thread)
             continue;
 
+        /* the interrupted rip is the only frame an nmi gives us */
+        hash = StackCacheHashFrames(&NmiContext[core].interrupted_rip, 1);
+
+        if (IsStackCachedAsValid(NmiContext[core].kthread, hash, 1))
+            continue;
+
         status = IsInstructionPointerInInvalidRegion(
             NmiContext[core].interrupted_rip, SystemModules, &flag);
 
@@ -892,10 +1259,24 @@ AnalyseNmiData(_In_ PNMI_CONTEXT NmiContext, _In_ PSYSTEM_MODULES SystemModules)
 
         if (!flag) {
             ReportInvalidRipFoundDuringNmi(&NmiContext[core]);
-            return STATUS_SUCCESS;
+            goto end;
         }
+
+        CacheValidStack(NmiContext[core].kthread, hash, 1);
     }
 
+end:
+    /*
+     * With the snapshot already taken, diffing our whole thread list against
+     * it is a single merge so we may as well. Neither depends on the per core
+     * analysis, so they run however it ended.
+     */
+    if (snapshot.objects)
+        ValidateThreadListPspCidTableEntries(&snapshot);
+
+    AuditSystemThreadStartAddresses(SystemModules);
+
+    FreePspCidTableSnapshot(&snapshot);
     return STATUS_SUCCESS;
 }
 
@@ -935,11 +1316,9 @@ NmiCallback(_Inout_opt_ PVOID Context, _In_ BOOLEAN Handled)
     context[core].kthread         = PsGetCurrentThread();
     context[core].callback_count++;
 
-    DEBUG_VERBOSE(
-        "[NMI CALLBACK]: Core Number: %lx, Interrupted RIP: %llx, Interrupted RSP: %llx",
-        core,
-        machine_frame->rip,
-        machine_frame->rsp);
+    /* DbgPrintEx isnt safe at HIGH_LEVEL, so this can only ever be traced */
+    DEBUG_TRACE(
+        TRACE_NMI_CALLBACK, machine_frame->rip, machine_frame->rsp, 0, 0);
 
     return TRUE;
 }
@@ -1107,6 +1486,9 @@ ApcKernelRoutine(_In_ PRKAPC                                     Apc,
     INT                    frames_captured   = 0;
     PUINT64                frames            = 0;
     BOOLEAN                flag              = FALSE;
+    BOOLEAN                valid             = TRUE;
+    UINT64                 hash              = 0;
+    UINT64                 thread            = (UINT64)KeGetCurrentThread();
     PAPC_STACKWALK_CONTEXT context           = NULL;
     PTHREAD_LIST_ENTRY     thread_list_entry = NULL;
 
@@ -1130,9 +1512,13 @@ ApcKernelRoutine(_In_ PRKAPC                                     Apc,
     if (!frames_captured)
         goto free;
 
-    for (INT index = 0; index < frames_captured; index++) {
-        frames = (PUINT64)buffer;
+    frames = (PUINT64)buffer;
+    hash   = StackCacheHashFrames(frames, frames_captured);
+
+    if (IsStackCachedAsValid(thread, hash, frames_captured))
+        goto free;
 
+    for (INT index = 0; index < frames_captured; index++) {
         /*
          * Apc->NormalContext holds the address of our context data
          * structure that we passed into KeInitializeApc as the last
@@ -1145,10 +1531,15 @@ ApcKernelRoutine(_In_ PRKAPC                                     Apc,
             goto free;
         }
 
-        if (!flag)
+        if (!flag) {
             ReportApcStackwalkViolation(frames[index]);
+            valid = FALSE;
+        }
     }
 
+    if (valid)
+        CacheValidStack(thread, hash, frames_captured);
+
 free:
 
     if (buffer)
@@ -1189,12 +1580,8 @@ ValidateThreadViaKernelApcCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
     PCHAR                  previous_mode = NULL;
     PUCHAR                 state         = NULL;
     BOOLEAN                apc_queueable = FALSE;
-    LPCSTR                 process_name  = NULL;
     PAPC_STACKWALK_CONTEXT context       = (PAPC_STACKWALK_CONTEXT)Context;
 
-    process_name =
-        ImpPsGetProcessImageFileName(ThreadListEntry->owning_process);
-
     /*
      * Its possible to set the KThread->ApcQueueable flag to false ensuring
      * that no APCs can be queued to the thread, as KeInsertQueueApc will
@@ -1220,10 +1607,7 @@ ValidateThreadViaKernelApcCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
         !ThreadListEntry->thread)
         return;
 
-    DEBUG_VERBOSE(
-        "Validating thread: %llx, process name: %s via kernel APC stackwalk.",
-        ThreadListEntry->thread,
-        process_name);
+    DEBUG_TRACE(TRACE_APC_STACKWALK_QUEUED, ThreadListEntry->thread, 0, 0, 0);
 
     SetFlag(*flags, KTHREAD_MISC_FLAGS_ALERTABLE);
     SetFlag(*flags, KTHREAD_MISC_FLAGS_APC_QUEUEABLE);
@@ -1304,6 +1688,7 @@ ValidateThreadsViaKernelApc()
         return STATUS_MEMORY_NOT_ALLOCATED;
     }
 
+    BeginStackCacheRound(context->modules);
     InsertApcContext(context);
 
     context->header.allocation_in_progress = TRUE;
@@ -1332,6 +1717,7 @@ typedef struct _DPC_CONTEXT {
     UINT64           stack_frame[DPC_STACKWALK_STACKFRAME_COUNT];
     UINT16           frames_captured;
     volatile BOOLEAN executed;
+    UINT64           thread;
 
 } DPC_CONTEXT, *PDPC_CONTEXT;
 
@@ -1349,12 +1735,11 @@ DpcStackwalkCallbackRoutine(_In_ PKDPC     Dpc,
                                     DPC_STACKWALK_STACKFRAME_COUNT,
                                     &context->stack_frame,
                                     NULL);
+    context->thread = (UINT64)KeGetCurrentThread();
     InterlockedExchange(&context->executed, TRUE);
     ImpKeSignalCallDpcDone(SystemArgument1);
 
-    DEBUG_VERBOSE("Executed DPC on core: %lx, with %lx frames captured.",
-                  KeGetCurrentProcessorNumber(),
-                  context->frames_captured);
+    DEBUG_TRACE(TRACE_DPC_STACKWALK, context->frames_captured, 0, 0, 0);
 }
 
 STATIC
@@ -1398,6 +1783,16 @@ ValidateDpcStackFrame(_In_ PDPC_CONTEXT Context, _In_ PSYSTEM_MODULES Modules)
 {
     NTSTATUS status = STATUS_UNSUCCESSFUL;
     BOOLEAN  flag   = FALSE;
+    BOOLEAN  valid  = TRUE;
+    UINT64   hash   = 0;
+
+    if (!Context->frames_captured)
+        return;
+
+    hash = StackCacheHashFrames(Context->stack_frame, Context->frames_captured);
+
+    if (IsStackCachedAsValid(Context->thread, hash, Context->frames_captured))
+        return;
 
     for (UINT32 frame = 0; frame < Context->frames_captured; frame++) {
         UINT64 rip = Context->stack_frame[frame];
@@ -1406,9 +1801,14 @@ ValidateDpcStackFrame(_In_ PDPC_CONTEXT Context, _In_ PSYSTEM_MODULES Modules)
         if (!NT_SUCCESS(status))
             return;
 
-        if (!flag)
+        if (!flag) {
             ReportDpcStackwalkViolation(Context, rip);
+            valid = FALSE;
+        }
     }
+
+    if (valid)
+        CacheValidStack(Context->thread, hash, Context->frames_captured);
 }
 
 STATIC
@@ -1460,6 +1860,7 @@ DispatchStackwalkToEachCpuViaDpc()
     while (!CheckForDpcCompletion(context))
         YieldProcessor();
 
+    BeginStackCacheRound(&modules);
     ValidateDpcCapturedStack(&modules, context);
 
     DEBUG_VERBOSE("Finished validating cores via dpc");
@@ -1473,38 +1874,6 @@ end:
     return status;
 }
 
-/* todo: walk the chain of pointers to prevent jmp chaining */
-STATIC
-NTSTATUS
-ValidateTableDispatchRoutines(_In_ PVOID*          Base,
-                              _In_ UINT32          Entries,
-                              _In_ PSYSTEM_MODULES Modules,
-                              _Out_ PVOID*         Routine)
-{
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-    BOOLEAN  flag   = FALSE;
-
-    for (UINT32 index = 0; index < Entries; index++) {
-        if (!Base[index])
-            continue;
-
-        status =
-            IsInstructionPointerInInvalidRegion(Base[index], Modules, &flag);
-
-        if (!NT_SUCCESS(status)) {
-            DEBUG_ERROR(
-                "IsInstructionPointerInInvalidRegion failed with status %x",
-                status);
-            continue;
-        }
-
-        if (!flag)
-            *Routine = Base[index];
-    }
-
-    return status;
-}
-
 /*
  * windows version info: https://www.techthoughts.info/windows-version-numbers/
  *
@@ -1516,6 +1885,12 @@ ValidateTableDispatchRoutines(_In_ PVOID*          Base,
 
 #define WINDOWS_10_MAX_BUILD_NUMBER 19045
 
+/* both tables begin with a version field before the first routine */
+#define HAL_DISPATCH_ROUTINE_COUNT                                \
+    ((sizeof(HAL_DISPATCH) -                                      \
+      FIELD_OFFSET(HAL_DISPATCH, HalQuerySystemInformation)) /    \
+     sizeof(PVOID))
+
 STATIC
 UINT32
 GetHalPrivateDispatchTableRoutineCount(_In_ PRTL_OSVERSIONINFOW VersionInfo)
@@ -1527,278 +1902,210 @@ GetHalPrivateDispatchTableRoutineCount(_In_ PRTL_OSVERSIONINFOW VersionInfo)
 }
 
 STATIC
-NTSTATUS
-ValidateHalPrivateDispatchTable(_Out_ PVOID*         Routine,
-                                _In_ PSYSTEM_MODULES Modules)
+VOID
+ReportDataTableInvalidRoutine(_In_ TABLE_ID TableId, _In_ UINT64 Address)
 {
-    NTSTATUS           status = STATUS_UNSUCCESSFUL;
-    PVOID              table  = NULL;
-    UNICODE_STRING     string = RTL_CONSTANT_STRING(L"HalPrivateDispatchTable");
-    PVOID*             base   = NULL;
-    RTL_OSVERSIONINFOW os_info = {0};
-    UINT32             count   = 0;
-
-    DEBUG_VERBOSE("Validating HalPrivateDispatchTable.");
-
-    table = ImpMmGetSystemRoutineAddress(&string);
-
-    if (!table)
-        return status;
+    PDATA_TABLE_ROUTINE_REPORT report =
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                           sizeof(DATA_TABLE_ROUTINE_REPORT),
+                           REPORT_POOL_TAG);
 
-    status = GetOsVersionInformation(&os_info);
+    if (!report)
+        return;
 
-    if (!NT_SUCCESS(status)) {
-        DEBUG_ERROR("GetOsVersionInformation failed with status %x", status);
-        return status;
-    }
+    DEBUG_WARNING("Invalid data table routine found. Table: %lx, Address: %llx",
+                  TableId,
+                  Address);
 
-    base  = (UINT64)table + sizeof(UINT64);
-    count = GetHalPrivateDispatchTableRoutineCount(&os_info);
+    report->report_code = REPORT_DATA_TABLE_ROUTINE;
+    report->address     = Address;
+    report->id          = TableId;
+    RtlCopyMemory(report->routine, Address, DATA_TABLE_ROUTINE_BUF_SIZE);
 
-    status = ValidateTableDispatchRoutines(base, count, Modules, Routine);
+    if (!NT_SUCCESS(
+            IrpQueueCompleteIrp(report, sizeof(DATA_TABLE_ROUTINE_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
 
-    if (!NT_SUCCESS(status)) {
-        DEBUG_ERROR("ValidateTableDispatchRoutines failed with status %x",
-                    status);
-        return status;
-    }
+typedef struct _DISPATCH_VALIDATION_CONTEXT {
+    SYSTEM_MODULES modules;
+    NTSTATUS       status;
+    UINT32         resolved;
 
-    return status;
-}
+} DISPATCH_VALIDATION_CONTEXT, *PDISPATCH_VALIDATION_CONTEXT;
 
+/*
+ * Resolves a dispatch routine against the system modules. The module list is
+ * only queried once the first slot needs resolving, which on a run where
+ * nothing changed is never.
+ *
+ * todo: walk the chain of pointers to prevent jmp chaining
+ */
 STATIC
-NTSTATUS
-ValidateHalDispatchTable(_Out_ PVOID* Routine, _In_ PSYSTEM_MODULES Modules)
+VOID
+ValidateDispatchTableSlot(_In_ UINT32      TableId,
+                          _In_ UINT32      Index,
+                          _In_ UINT64      Previous,
+                          _In_ UINT64      Current,
+                          _Inout_opt_ PVOID Context)
 {
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-    BOOLEAN  flag   = FALSE;
-
-    *Routine = NULL;
-
-    DEBUG_VERBOSE("Validating HalDispatchTable.");
-
-    /*
-     * Since windows exports all the function pointers inside the
-     * HalDispatchTable, we may aswell make use of them and validate it this
-     * way. While it definitely is ugly, it is the safest way to do it.
-     *
-     * What if there are 2 invalid routines? hmm.. tink.
-     */
-    status = IsInstructionPointerInInvalidRegion(
-        HalQuerySystemInformation, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalQuerySystemInformation;
-    else
-        return status;
-
-    status = IsInstructionPointerInInvalidRegion(
-        HalSetSystemInformation, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalSetSystemInformation;
-    else
-        return status;
-
-    status =
-        IsInstructionPointerInInvalidRegion(HalQueryBusSlots, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalQueryBusSlots;
-    else
-        return status;
+    UNREFERENCED_PARAMETER(Index);
+    UNREFERENCED_PARAMETER(Previous);
 
-    status = IsInstructionPointerInInvalidRegion(
-        HalReferenceHandlerForBus, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalReferenceHandlerForBus;
-    else
-        return status;
-
-    status = IsInstructionPointerInInvalidRegion(
-        HalReferenceBusHandler, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalReferenceBusHandler;
-    else
-        return status;
-
-    status = IsInstructionPointerInInvalidRegion(
-        HalDereferenceBusHandler, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalDereferenceBusHandler;
-    else
-        return status;
+    NTSTATUS                     status  = STATUS_UNSUCCESSFUL;
+    BOOLEAN                      flag    = FALSE;
+    PDISPATCH_VALIDATION_CONTEXT context = Context;
 
-    status =
-        IsInstructionPointerInInvalidRegion(HalInitPnpDriver, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalInitPnpDriver;
-    else
-        return status;
+    if (!Current || !context || !NT_SUCCESS(context->status))
+        return;
 
-    status = IsInstructionPointerInInvalidRegion(
-        HalInitPowerManagement, Modules, &flag);
+    if (!context->modules.address) {
+        context->status = GetSystemModuleInformation(&context->modules);
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalInitPowerManagement;
-    else
-        return status;
-
-    status =
-        IsInstructionPointerInInvalidRegion(HalGetDmaAdapter, Modules, &flag);
+        if (!NT_SUCCESS(context->status)) {
+            DEBUG_ERROR("GetSystemModuleInformation failed with status %x",
+                        context->status);
+            return;
+        }
+    }
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalGetDmaAdapter;
-    else
-        return status;
+    context->resolved++;
 
     status = IsInstructionPointerInInvalidRegion(
-        HalGetInterruptTranslator, Modules, &flag);
+        Current, &context->modules, &flag);
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalGetInterruptTranslator;
-    else
-        return status;
-
-    status =
-        IsInstructionPointerInInvalidRegion(HalStartMirroring, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalStartMirroring;
-    else
-        return status;
-
-    status =
-        IsInstructionPointerInInvalidRegion(HalEndMirroring, Modules, &flag);
-
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalEndMirroring;
-    else
-        return status;
-
-    status = IsInstructionPointerInInvalidRegion(
-        HalMirrorPhysicalMemory, Modules, &flag);
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("IsInstructionPointerInInvalidRegion failed with status %x",
+                    status);
+        return;
+    }
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalMirrorPhysicalMemory;
-    else
-        return status;
+    if (!flag)
+        ReportDataTableInvalidRoutine((TABLE_ID)TableId, Current);
+}
 
-    status = IsInstructionPointerInInvalidRegion(HalEndOfBoot, Modules, &flag);
+STATIC
+NTSTATUS
+SnapshotHalDispatchTables(_Out_ PDISPATCH_SNAPSHOT Snapshot)
+{
+    NTSTATUS           status  = STATUS_UNSUCCESSFUL;
+    PVOID              table   = NULL;
+    RTL_OSVERSIONINFOW os_info = {0};
+    UNICODE_STRING     string  = RTL_CONSTANT_STRING(L"HalPrivateDispatchTable");
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalEndOfBoot;
-    else
-        return status;
+    DispatchSnapshotInitialise(Snapshot);
 
-    status =
-        IsInstructionPointerInInvalidRegion(HalMirrorVerify, Modules, &flag);
+    status = DispatchSnapshotAddTable(
+        Snapshot,
+        HalDispatch,
+        (PUINT64)&HalDispatchTable->HalQuerySystemInformation,
+        HAL_DISPATCH_ROUTINE_COUNT);
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalMirrorVerify;
-    else
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("DispatchSnapshotAddTable failed with status %x", status);
         return status;
+    }
 
-    status = IsInstructionPointerInInvalidRegion(
-        HalGetCachedAcpiTable, Modules, &flag);
+    table = ImpMmGetSystemRoutineAddress(&string);
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalGetCachedAcpiTable;
-    else
-        return status;
+    if (!table)
+        return STATUS_UNSUCCESSFUL;
 
-    status = IsInstructionPointerInInvalidRegion(
-        HalSetPciErrorHandlerCallback, Modules, &flag);
+    status = GetOsVersionInformation(&os_info);
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalSetPciErrorHandlerCallback;
-    else
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("GetOsVersionInformation failed with status %x", status);
         return status;
+    }
 
-    status =
-        IsInstructionPointerInInvalidRegion(HalGetPrmCache, Modules, &flag);
+    status = DispatchSnapshotAddTable(
+        Snapshot,
+        HalPrivateDispatch,
+        (PUINT64)((UINT64)table + sizeof(UINT64)),
+        GetHalPrivateDispatchTableRoutineCount(&os_info));
 
-    if (!flag && NT_SUCCESS(status))
-        *Routine = HalGetPrmCache;
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("DispatchSnapshotAddTable failed with status %x", status);
 
     return status;
 }
 
-STATIC
-VOID
-ReportDataTableInvalidRoutine(_In_ TABLE_ID TableId, _In_ UINT64 Address)
+/*
+ * Rather then resolving every routine in the HalDispatchTable and
+ * HalPrivateDispatchTable against the module list on every run, the tables
+ * are snapshotted and validated in full once per session. Later runs diff the
+ * live tables against the snapshot and only resolve slots that changed.
+ */
+NTSTATUS
+ValidateHalDispatchTables()
 {
-    PDATA_TABLE_ROUTINE_REPORT report =
-        ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
-                           sizeof(DATA_TABLE_ROUTINE_REPORT),
-                           REPORT_POOL_TAG);
-
-    if (!report)
-        return;
+    PAGED_CODE();
 
-    DEBUG_WARNING("Invalid data table routine found. Table: %lx, Address: %llx",
-                  TableId,
-                  Address);
+    NTSTATUS                    status   = STATUS_UNSUCCESSFUL;
+    PACTIVE_SESSION             session  = GetActiveSession();
+    PDISPATCH_SNAPSHOT          snapshot = &session->dispatch_snapshot;
+    DISPATCH_VALIDATION_CONTEXT context  = {0};
+    UINT32                      changed  = 0;
 
-    report->address = Address;
-    report->id      = TableId;
-    report->id      = REPORT_DATA_TABLE_ROUTINE;
-    RtlCopyMemory(report->routine, Address, DATA_TABLE_ROUTINE_BUF_SIZE);
+    context.status = STATUS_SUCCESS;
 
-    if (!NT_SUCCESS(
-            IrpQueueCompleteIrp(report, sizeof(DATA_TABLE_ROUTINE_REPORT))))
-        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
-}
+    ImpKeAcquireGuardedMutex(&session->dispatch_lock);
 
-NTSTATUS
-ValidateHalDispatchTables()
-{
-    NTSTATUS       status   = STATUS_UNSUCCESSFUL;
-    SYSTEM_MODULES modules  = {0};
-    PVOID          routine1 = NULL;
-    PVOID          routine2 = NULL;
+    if (snapshot->table_count) {
+        status = DispatchSnapshotDiff(
+            snapshot, ValidateDispatchTableSlot, &context, &changed);
 
-    status = GetSystemModuleInformation(&modules);
+        if (NT_SUCCESS(status)) {
+            DEBUG_VERBOSE("Dispatch tables diffed, %lx slots changed.",
+                          changed);
+            goto end;
+        }
 
-    if (!NT_SUCCESS(status)) {
-        DEBUG_ERROR("GetSystemModuleInformation failed with status %x", status);
-        return status;
+        DEBUG_WARNING("Dispatch table snapshot modified, taking a new one.");
     }
 
-    status = ValidateHalDispatchTable(&routine1, &modules);
+    status = SnapshotHalDispatchTables(snapshot);
 
     if (!NT_SUCCESS(status)) {
-        DEBUG_ERROR("ValidateHalDispatchTable failed with status %x", status);
+        DEBUG_ERROR("SnapshotHalDispatchTables failed with status %x", status);
+        DispatchSnapshotInitialise(snapshot);
         goto end;
     }
 
-    if (routine1)
-        ReportDataTableInvalidRoutine(HalDispatch, routine1);
-    else
-        DEBUG_VERBOSE("HalDispatch dispatch routines are valid.");
+    DispatchSnapshotEnumerate(snapshot, ValidateDispatchTableSlot, &context);
 
-    status = ValidateHalPrivateDispatchTable(&routine2, &modules);
+    DEBUG_VERBOSE("Dispatch tables snapshotted, %lx slots validated.",
+                  context.resolved);
 
-    if (!NT_SUCCESS(status)) {
-        DEBUG_ERROR("ValidateHalPrivateDispatchTable failed with status %x",
-                    status);
-        goto end;
-    }
+end:
+    ImpKeReleaseGuardedMutex(&session->dispatch_lock);
 
-    if (routine2)
-        ReportDataTableInvalidRoutine(HalPrivateDispatch, routine2);
-    else
-        DEBUG_VERBOSE("HalPrivateDispatch dispatch routines are valid.");
+    if (context.modules.address)
+        ImpExFreePoolWithTag(context.modules.address, SYSTEM_MODULES_POOL);
 
-end:
-    if (modules.address)
-        ImpExFreePoolWithTag(modules.address, SYSTEM_MODULES_POOL);
+    return NT_SUCCESS(status) ? context.status : status;
+}
 
-    return status;
+/*
+ * Called when a session starts so the full validation happens up front, and
+ * any change made since the previous session is resolved.
+ */
+VOID
+ResetHalDispatchTableSnapshot()
+{
+    PAGED_CODE();
+
+    NTSTATUS        status  = STATUS_UNSUCCESSFUL;
+    PACTIVE_SESSION session = GetActiveSession();
+
+    ImpKeAcquireGuardedMutex(&session->dispatch_lock);
+    DispatchSnapshotInitialise(&session->dispatch_snapshot);
+    ImpKeReleaseGuardedMutex(&session->dispatch_lock);
+
+    status = ValidateHalDispatchTables();
+
+    if (!NT_SUCCESS(status))
+        DEBUG_ERROR("ValidateHalDispatchTables failed with status %x", status);
 }
 
 NTSTATUS
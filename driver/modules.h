@@ -7,19 +7,13 @@
 #include "common.h"
 #include "queue.h"
 
+#include "../core/stackcache.h"
+
 typedef struct _APC_OPERATION_ID {
     int operation_id;
 
 } APC_OPERATION_ID, *PAPC_OPERATION_ID;
 
-/* system modules information */
-
-typedef struct _SYSTEM_MODULES {
-    PVOID address;
-    INT   module_count;
-
-} SYSTEM_MODULES, *PSYSTEM_MODULES;
-
 #define APC_CONTEXT_ID_STACKWALK 0x1
 
 typedef struct _APC_CONTEXT_HEADER {
@@ -35,16 +29,18 @@ typedef struct _APC_STACKWALK_CONTEXT {
 
 } APC_STACKWALK_CONTEXT, *PAPC_STACKWALK_CONTEXT;
 
+typedef struct _STACK_CACHE_CONTEXT {
+    STACK_CACHE cache;
+    KSPIN_LOCK  lock;
+
+} STACK_CACHE_CONTEXT, *PSTACK_CACHE_CONTEXT;
+
 NTSTATUS
 GetSystemModuleInformation(_Out_ PSYSTEM_MODULES ModuleInformation);
 
 NTSTATUS
 HandleValidateDriversIOCTL();
 
-PRTL_MODULE_EXTENDED_INFO
-FindSystemModuleByName(_In_ LPCSTR          ModuleName,
-                       _In_ PSYSTEM_MODULES SystemModules);
-
 NTSTATUS
 HandleNmiIOCTL();
 
@@ -57,11 +53,6 @@ ValidateThreadsViaKernelApc();
 VOID
 FreeApcStackwalkApcContextInformation(_Inout_ PAPC_STACKWALK_CONTEXT Context);
 
-NTSTATUS
-IsInstructionPointerInInvalidRegion(_In_ UINT64          RIP,
-                                    _In_ PSYSTEM_MODULES SystemModules,
-                                    _Out_ PBOOLEAN       Result);
-
 VOID
 FlipKThreadMiscFlagsFlag(_In_ PKTHREAD Thread,
                          _In_ ULONG    FlagIndex,
@@ -70,11 +61,22 @@ FlipKThreadMiscFlagsFlag(_In_ PKTHREAD Thread,
 NTSTATUS
 DispatchStackwalkToEachCpuViaDpc();
 
+VOID
+CleanupStackCacheOnUnload(_Inout_ PSTACK_CACHE_CONTEXT Context);
+
+VOID
+CleanupDriverDispatchOnUnload(_Inout_ PDRIVER_DISPATCH_CONTEXT Context);
+
 NTSTATUS
 ValidateHalDispatchTables();
 
+VOID
+ResetHalDispatchTableSnapshot();
+
 PVOID
-FindDriverBaseNoApi(_In_ PDRIVER_OBJECT DriverObject, _In_ PWCH Name);
+FindDriverBaseNoApi(_In_ PDRIVER_OBJECT DriverObject,
+                    _In_ PWCH           Name,
+                    _Out_opt_ PULONG    ImageSize);
 
 NTSTATUS
 GetDriverObjectByDriverName(_In_ PUNICODE_STRING  DriverName,
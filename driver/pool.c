@@ -6,62 +6,37 @@
 #include "queue.h"
 #include "ia32.h"
 #include "imports.h"
+#include "modules.h"
 
-#define PAGE_BASE_SIZE 0x1000
-#define POOL_TAG_SIZE  0x004
+#include "../core/pagewalk.h"
 
-#define PML4_ENTRY_COUNT 512
-#define PDPT_ENTRY_COUNT 512
-#define PD_ENTRY_COUNT   512
-#define PT_ENTRY_COUNT   512
+#define PROCESS_OBJECT_ALLOCATION_MARGIN 0x90
 
-#define LARGE_PAGE_2MB_ENTRIES 512
-#define LARGE_PAGE_1GB_ENTRIES 0x40000
+typedef struct _EXECUTABLE_SPAN_SCAN {
+    PPAGE_WALK       walk;
+    PAGE_SPAN_OWNERS owners;
 
-#define CHUNK_SIZE 16
+    /* the span currently being scanned has already been reported */
+    BOOLEAN reported;
+    UINT64  unowned;
+    UINT64  reports;
 
-#define PROCESS_OBJECT_ALLOCATION_MARGIN 0x90
+} EXECUTABLE_SPAN_SCAN, *PEXECUTABLE_SPAN_SCAN;
 
-#define POOL_TAG_LENGTH        4
-#define EXECUTIVE_OBJECT_COUNT 8
-
-#define INDEX_PROCESS_POOL_TAG         0
-#define INDEX_THREAD_POOL_TAG          1
-#define INDEX_DESKTOP_POOL_TAG         2
-#define INDEX_WINDOW_STATIONS_POOL_TAG 3
-#define INDEX_MUTANTS_POOL_TAG         4
-#define INDEX_FILE_OBJECTS_POOL_TAG    5
-#define INDEX_DRIVERS_POOL_TAG         6
-#define INDEX_SYMBOLIC_LINKS_POOL_TAG  7
-
-CHAR EXECUTIVE_OBJECT_POOL_TAGS[EXECUTIVE_OBJECT_COUNT][POOL_TAG_LENGTH] = {
-    "\x50\x72\x6f\x63", /* Process */
-    "\x54\x68\x72\x64", /* Thread */
-    "\x44\x65\x73\x6B", /* Desktop */
-    "\x57\x69\x6E\x64", /* Windows Station */
-    "\x4D\x75\x74\x65", /* Mutants i.e mutex etc. */
-    "\x46\x69\x6C\x65", /* File objects */
-    "\x44\x72\x69\x76", /* Drivers */
-    "\x4C\x69\x6E\x6B"  /* Symbolic links */
-};
-
-typedef struct _PROCESS_SCAN_CONTEXT {
-    ULONG process_count;
-    PVOID process_buffer;
-
-} PROCESS_SCAN_CONTEXT, *PPROCESS_SCAN_CONTEXT;
+STATIC
+PVOID
+GetVirtualForPhysicalInRange(_In_ UINT64        PhysicalAddress,
+                             _Inout_opt_ PVOID Context);
 
 STATIC
 BOOLEAN
-ValidateIfAddressIsProcessStructure(_In_ PVOID        Address,
-                                    _In_ PPOOL_HEADER PoolHeader);
+IsKernelAddressValid(_In_ PVOID VirtualAddress, _Inout_opt_ PVOID Context);
 
 STATIC
 VOID
-ScanPageForKernelObjectAllocation(_In_ UINT64                   PageBase,
-                                  _In_ ULONG                    PageSize,
-                                  _In_ ULONG                    ObjectIndex,
-                                  _Inout_ PPROCESS_SCAN_CONTEXT Context);
+ScanKernelPage(_In_ UINT64        PageBase,
+               _In_ ULONG         PageSize,
+               _Inout_opt_ PVOID Context);
 
 STATIC
 BOOLEAN
@@ -71,14 +46,17 @@ IsPhysicalAddressInPhysicalMemoryRange(_In_ UINT64 PhysicalAddress,
 
 STATIC
 VOID
-EnumerateKernelLargePages(_In_ UINT64                PageBase,
-                          _In_ ULONG                 PageSize,
-                          _In_ PPROCESS_SCAN_CONTEXT Context,
-                          _In_ ULONG                 ObjectIndex);
+WalkKernelPageTables(_In_ PPROCESS_SCAN_CONTEXT Context);
+
+STATIC
+BOOLEAN
+IsUnownedExecutableSpan(_In_ PPAGE_SPAN Span, _Inout_opt_ PVOID Context);
 
 STATIC
 VOID
-WalkKernelPageTables(_In_ PPROCESS_SCAN_CONTEXT Context);
+ScanUnownedExecutablePage(_In_ UINT64        PageBase,
+                          _In_ ULONG         PageSize,
+                          _Inout_opt_ PVOID Context);
 
 STATIC
 VOID
@@ -96,6 +74,7 @@ CheckIfProcessAllocationIsInProcessList(
 #    pragma alloc_text(PAGE, IncrementProcessCounter)
 #    pragma alloc_text(PAGE, CheckIfProcessAllocationIsInProcessList)
 #    pragma alloc_text(PAGE, FindUnlinkedProcesses)
+#    pragma alloc_text(PAGE, FindUnownedExecutableMemory)
 #endif
 
 PKDDEBUGGER_DATA64
@@ -155,215 +134,6 @@ GetPsActiveProcessHead(_Out_ PUINT64 Address)
     ImpExFreePoolWithTag(debugger_data, POOL_DEBUGGER_DATA_TAG);
 }
 
-/*
- * Here we define a signature that can be used to find EPROCESS structures
- *consistently across major windows versions. The fields we test have proven to
- *be consistent in the following study:
- *
- * https://www.cise.ufl.edu/~traynor/papers/ccs09b.pdf
- *
- * Aswell as some of my own additional research and testing. The following
- *signature is used:
- *
- * PeakVirtualSize must be greater then 0 for any valid process:
- *	-> EPROCESS->PeakVirtualSize > 0
- *
- * The DirectoryTableBase must be 0x20 aligned:
- *	-> EPROCESS->DirectoryTableBase % 20 == 0
- *
- * The pool allocation size must be greater then the size of an EPROCESS
- *allocation and less then the size of a page. Allocation size can be found with
- *the following formula:
- *	-> AllocationSize = POOL_HEADER->BlockSize * CHUNK_SIZE -
- *sizeof(POOL_HEADER)
- *	-> AllocationSize > sizeof(EPROCESS)
- *	-> AllocationSize < PAGE_SIZE (4096)
- *
- * Pool type must be non-null:
- *	-> POOL_HEADER->PoolType != NULL
- *
- * The process PEB must be a usermode address and 0x1000 aligned:
- *	-> EPROCESS->Peb & 0x7ffd0000 == 0x7ffd0000 && EPROCESS->Peb % 0x1000 == 0
- *
- * The object table must have the following properties and be 0x8 aligned:
- *	-> EPROCESS->ObjectTable & 0xe0000000 == 0xe0000000 && EPROCESS->ObjectTable
- *% 0x8 == 0
- *
- * The allocation size, when AND'd with 0xfff0 must not equal 0xfff0:
- *	-> AllocationSize & 0xfff0 != 0xfff0
- *
- * This signature will allow us to consistently and accurately determine if a
- *given pool allocation is indeed an executive process allocation across major
- *versions of Windows.
- */
-STATIC
-BOOLEAN
-ValidateIfAddressIsProcessStructure(_In_ PVOID        Address,
-                                    _In_ PPOOL_HEADER PoolHeader)
-{
-    UINT64  peak_virtual_size    = 0;
-    UINT64  dir_table_base       = 0;
-    UINT64  allocation_size      = 0;
-    UINT64  peb                  = 0;
-    UINT64  object_table         = 0;
-    BOOLEAN peb_test             = FALSE;
-    BOOLEAN object_table_test    = FALSE;
-    UINT64  allocation_size_test = 0;
-
-    if (ImpMmIsAddressValid((UINT64)Address +
-                            KPROCESS_DIRECTORY_TABLE_BASE_OFFSET))
-        dir_table_base =
-            *(UINT64*)((UINT64)Address + KPROCESS_DIRECTORY_TABLE_BASE_OFFSET);
-
-    if (ImpMmIsAddressValid((UINT64)Address +
-                            EPROCESS_PEAK_VIRTUAL_SIZE_OFFSET))
-        peak_virtual_size =
-            *(UINT64*)((UINT64)Address + EPROCESS_PEAK_VIRTUAL_SIZE_OFFSET);
-
-    if (ImpMmIsAddressValid((UINT64)PoolHeader + POOL_HEADER_BLOCK_SIZE_OFFSET))
-        allocation_size =
-            PoolHeader->BlockSize * CHUNK_SIZE - sizeof(POOL_HEADER);
-
-    if (ImpMmIsAddressValid((UINT64)Address + EPROCESS_PEB_OFFSET))
-        peb = *(UINT64*)((UINT64)Address + EPROCESS_PEB_OFFSET);
-
-    if (ImpMmIsAddressValid((UINT64)Address + EPROCESS_OBJECT_TABLE_OFFSET))
-        object_table =
-            *(UINT64*)((UINT64)Address + EPROCESS_OBJECT_TABLE_OFFSET);
-
-    peb_test =
-        peb == NULL || (peb & 0x7ffd0000 == 0x7ffd0000 && peb % 0x1000 == NULL);
-    object_table_test =
-        object_table == NULL ||
-        (object_table & 0xe0000000 == 0xe0000000 && object_table % 0x8 == 0);
-    allocation_size_test = allocation_size & 0xfff0;
-
-    if (peak_virtual_size > 0 && (dir_table_base & 0x20) == 0 &&
-        allocation_size >
-            (EPROCESS_SIZE + OBJECT_HEADER_SIZE + sizeof(POOL_HEADER)) &&
-        PoolHeader->PoolType != NULL && !(allocation_size_test == 0xfff0) &&
-        !peb_test && !object_table_test) {
-        return TRUE;
-    }
-
-    return FALSE;
-}
-
-/*
- * OBJECT_HEADER->InfoMask is a bit mask that tells us which optional
- * headers the object has. The bits are as follows:
- *
- * 0x1 = OBJECT_HEADER_CREATOR_INFO
- * 0x2 = OBJECT_HEADER_NAME_INFO
- * 0x4 = OBJECT_HEADER_HANDLE_INFO
- * 0x8 = OBJECT_HEADER_QUOTA_INFO
- * 0x10 = OBJECT_HEADER_PROCESS_INFO
- * 0x20 = OBJECT_HEADER_AUDIT_INFO
- * 0x40 = OBJECT_HEADER_HANDLE_REVOCATION_INFO
- */
-
-/*
- * Idea: since we don't know the number of headers or the exact memory layout of
- * the object header section for these proc allocations, we can form an estimate
- * address of base + 0x70 and then iterate the loaded process list and if theres
- * an address within say 0x50 of it we can assume that the process is legitmate.
- * Then to find an unlinked process, it wouldn't exist in the loaded module
- * list, check that it hasnt been deallocated and then focus on scanning it for
- * name etc. Maybe scan for .exe extension?
- *
- * Also use the full name so we get the file extension and path not the 15 char
- * long one
- */
-STATIC
-VOID
-ScanPageForKernelObjectAllocation(_In_ UINT64                   PageBase,
-                                  _In_ ULONG                    PageSize,
-                                  _In_ ULONG                    ObjectIndex,
-                                  _Inout_ PPROCESS_SCAN_CONTEXT Context)
-{
-    INT          length           = 0;
-    CHAR         current_char     = 0;
-    CHAR         current_sig_byte = 0;
-    PPOOL_HEADER pool_header      = NULL;
-    PEPROCESS    process          = NULL;
-    PEPROCESS    process_size_one = NULL;
-    PEPROCESS    process_size_two = NULL;
-    PEPROCESS    test_process     = NULL;
-    LPCSTR       process_name     = NULL;
-    PUINT64      address_list     = NULL;
-    ULONG        allocation_size  = 0;
-    ULONG        minimum_process_allocation_size =
-        EPROCESS_SIZE - sizeof(POOL_HEADER) - OBJECT_HEADER_SIZE;
-
-    if (!PageBase || !PageSize)
-        return;
-
-    for (INT offset = 0;
-         offset <= PageSize - POOL_TAG_LENGTH - minimum_process_allocation_size;
-         offset++) {
-        for (INT sig_index = 0; sig_index < POOL_TAG_LENGTH + 1; sig_index++) {
-            if (!ImpMmIsAddressValid(PageBase + offset + sig_index))
-                break;
-
-            current_char = *(PCHAR)(PageBase + offset + sig_index);
-            current_sig_byte =
-                EXECUTIVE_OBJECT_POOL_TAGS[ObjectIndex][sig_index];
-
-            if (sig_index == POOL_TAG_LENGTH) {
-                pool_header =
-                    (UINT64)PageBase + offset - POOL_HEADER_TAG_OFFSET;
-
-                if (!ImpMmIsAddressValid((PVOID)pool_header))
-                    break;
-
-                /*
-                 * Since every executive allocation is required
-                 * to have an _OBJECT_HEADER, we start iterating
-                 * from the size of this object header, then
-                 * jump up in blocks of 0x10 since every object
-                 * header is divisible by 0x10. We iterate up to
-                 * 0xb0 which is equal to the following:
-                 *
-                 * 0xb0 = sizeof(ALL_HEADER_OBJECTS) + 0x10
-                 * where the 0x10 is 16 bytes of padding.
-                 */
-                for (ULONG header_size = OBJECT_HEADER_SIZE; header_size < 0xb0;
-                     header_size += 0x10) {
-                    test_process =
-                        (PEPROCESS)((UINT64)pool_header + sizeof(POOL_HEADER) +
-                                    header_size);
-
-                    if (ValidateIfAddressIsProcessStructure(test_process,
-                                                            pool_header)) {
-                        process = test_process;
-                        break;
-                    }
-                }
-
-                if (!process)
-                    break;
-
-                DEBUG_VERBOSE("Found process via pt walk: %llx",
-                              (UINT64)process);
-
-                address_list = (PUINT64)Context->process_buffer;
-
-                for (INT i = 0; i < Context->process_count; i++) {
-                    if (address_list[i] == NULL) {
-                        address_list[i] = (UINT64)process;
-                        break;
-                    }
-                }
-
-                break;
-            }
-
-            if (current_char != current_sig_byte)
-                break;
-        }
-    }
-}
-
 /*
  * Using MmGetPhysicalMemoryRangesEx2(), we can get a block of structures that
  * describe the physical memory layout. With each physical page base we are
@@ -394,73 +164,57 @@ IsPhysicalAddressInPhysicalMemoryRange(_In_ UINT64 PhysicalAddress,
     return FALSE;
 }
 
+STATIC
+PVOID
+GetVirtualForPhysicalInRange(_In_ UINT64        PhysicalAddress,
+                             _Inout_opt_ PVOID Context)
+{
+    PHYSICAL_ADDRESS physical = {0};
+
+    /* if the page base isnt in a legit region, go next */
+    if (!IsPhysicalAddressInPhysicalMemoryRange(
+            PhysicalAddress, (PPHYSICAL_MEMORY_RANGE)Context))
+        return NULL;
+
+    physical.QuadPart = PhysicalAddress;
+    return ImpMmGetVirtualForPhysical(physical);
+}
+
+STATIC
+BOOLEAN
+IsKernelAddressValid(_In_ PVOID VirtualAddress, _Inout_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+    return ImpMmIsAddressValid(VirtualAddress);
+}
+
 STATIC
 VOID
-EnumerateKernelLargePages(_In_ UINT64                PageBase,
-                          _In_ ULONG                 PageSize,
-                          _In_ PPROCESS_SCAN_CONTEXT Context,
-                          _In_ ULONG                 ObjectIndex)
+ScanKernelPage(_In_ UINT64        PageBase,
+               _In_ ULONG         PageSize,
+               _Inout_opt_ PVOID Context)
 {
-    /*
-     * Split the large pages up into blocks of 0x1000 and scan each block
-     */
-    for (UINT64 page_index = 0; page_index < PageSize; page_index++) {
-        UINT64 page_base = PageBase + (page_index * PAGE_SIZE);
-        ScanPageForKernelObjectAllocation(
-            page_base, PAGE_SIZE, ObjectIndex, Context);
-    }
+    ScanPageForKernelObjectAllocation(PageBase,
+                                      PageSize,
+                                      INDEX_PROCESS_POOL_TAG,
+                                      (PPROCESS_SCAN_CONTEXT)Context);
 }
 
 /*
- * This is your basic page table walk function. On intel systems, paging has 4
- * levels, each table holds 512 entries with a total size of 0x1000 (512 *
- * sizeof(QWORD)). Each entry in each table contains a value with a subset
- * bitfield containing the physical address of the base of the next table in the
- * structure. So for example, a PML4 entry contains a physical address that
- * points to the base of the PDPT table, it is the same for a PDPT entry -> PD
- * base and so on.
- *
- * However, as with all good things Windows has implemented security features
- * meaning we cannot use functions such as MmCopyMemory or MmMapIoSpace on
- * paging structures, so we must find another way to walk the pages. Luckily for
- * us, there exists MmGetVirtualForPhysical. This function is self explanatory
- * and returns the corresponding virtual address given a physical address. What
- * this means is that we can extract a page entry physical address, pass it to
- * MmGetVirtualForPhysical which returns us the virtual address of the base of
- * the next page structure. This is because page tables are still mapped by the
- * kernel and exist in virtual memory just like everything else and hence
- * reading the value at all 512 entries from the virtual base will give us the
- * equivalent value as directly reading the physical address.
- *
- * Using this, we essentially walk the page tables as any regular translation
- * would except instead of simply reading the physical we translate it to a
- * virtual address and extract the physical address from the value at each
- * virtual address page entry.
- *
- * TODO: rewrite this its kinda ugly
+ * The walk itself lives in core/pagewalk.c so it can be run against synthetic
+ * page tables on the host. We can't use MmCopyMemory or MmMapIoSpace on
+ * paging structures, but they are still mapped by the kernel, so every
+ * physical address (tables included) is resolved with MmGetVirtualForPhysical
+ * after checking it lies within a range of physical memory.
  */
 STATIC
 VOID
 WalkKernelPageTables(_In_ PPROCESS_SCAN_CONTEXT Context)
 {
+    NTSTATUS               status                 = STATUS_UNSUCCESSFUL;
     CR3                    cr3                    = {0};
-    PML4E                  pml4_base              = {0};
-    PML4E                  pml4_entry             = {0};
-    UINT64                 pdpt_base              = 0;
-    UINT64                 pd_base                = 0;
-    UINT64                 pt_base                = 0;
-    PDPTE                  pdpt_entry             = {0};
-    PDPTE_LARGE            pdpt_large_entry       = {0};
-    PDE                    pd_entry               = {0};
-    PDE_LARGE              pd_large_entry         = {0};
-    PTE                    pt_entry               = {0};
-    UINT64                 base_physical_page     = 0;
-    UINT64                 base_virtual_page      = 0;
-    UINT64                 base_2mb_virtual_page  = 0;
-    UINT64                 base_1gb_virtual_page  = 0;
-    PHYSICAL_ADDRESS       physical               = {0};
+    PAGE_WALK              walk                   = {0};
     PPHYSICAL_MEMORY_RANGE physical_memory_ranges = NULL;
-    KIRQL                  irql                   = {0};
 
     physical_memory_ranges = ImpMmGetPhysicalMemoryRangesEx2(NULL, NULL);
 
@@ -471,159 +225,24 @@ WalkKernelPageTables(_In_ PPROCESS_SCAN_CONTEXT Context)
 
     cr3.AsUInt = __readcr3();
 
-    physical.QuadPart = cr3.AddressOfPageDirectory << PAGE_4KB_SHIFT;
+    walk.directory_table_base = cr3.AddressOfPageDirectory << PAGE_4KB_SHIFT;
+    walk.translate            = GetVirtualForPhysicalInRange;
+    walk.validate             = IsKernelAddressValid;
+    walk.memory_context       = physical_memory_ranges;
+    walk.callback             = ScanKernelPage;
+    walk.callback_context     = Context;
 
-    pml4_base.BitAddress = ImpMmGetVirtualForPhysical(physical);
+    status = WalkPageTables(&walk);
 
-    if (!ImpMmIsAddressValid(pml4_base.BitAddress) || !pml4_base.BitAddress)
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("WalkPageTables failed with status %x", status);
         return;
-
-    for (INT pml4_index = 0; pml4_index < PML4_ENTRY_COUNT; pml4_index++) {
-        if (!ImpMmIsAddressValid(pml4_base.BitAddress +
-                                 pml4_index * sizeof(UINT64)))
-            continue;
-
-        pml4_entry.BitAddress =
-            *(UINT64*)(pml4_base.BitAddress + pml4_index * sizeof(UINT64));
-
-        if (pml4_entry.Bits.Present == NULL)
-            continue;
-
-        physical.QuadPart = pml4_entry.Bits.PhysicalAddress << PAGE_4KB_SHIFT;
-
-        pdpt_base = ImpMmGetVirtualForPhysical(physical);
-
-        if (!pdpt_base || !ImpMmIsAddressValid(pdpt_base))
-            continue;
-
-        for (INT pdpt_index = 0; pdpt_index < PDPT_ENTRY_COUNT; pdpt_index++) {
-            if (!ImpMmIsAddressValid(pdpt_base + pdpt_index * sizeof(UINT64)))
-                continue;
-
-            pdpt_entry.BitAddress =
-                *(UINT64*)(pdpt_base + pdpt_index * sizeof(UINT64));
-
-            if (pdpt_entry.Bits.Present == NULL)
-                continue;
-
-            if (IS_LARGE_PAGE(pdpt_entry.BitAddress)) {
-                /* 1gb size page */
-                pdpt_large_entry.BitAddress = pdpt_entry.BitAddress;
-
-                physical.QuadPart = pdpt_large_entry.Bits.PhysicalAddress
-                                    << PAGE_1GB_SHIFT;
-
-                if (IsPhysicalAddressInPhysicalMemoryRange(
-                        physical.QuadPart, physical_memory_ranges) == FALSE)
-                    continue;
-
-                base_1gb_virtual_page = ImpMmGetVirtualForPhysical(physical);
-
-                if (!base_1gb_virtual_page ||
-                    !ImpMmIsAddressValid(base_1gb_virtual_page))
-                    continue;
-
-                EnumerateKernelLargePages(base_1gb_virtual_page,
-                                          LARGE_PAGE_1GB_ENTRIES,
-                                          Context,
-                                          INDEX_PROCESS_POOL_TAG);
-
-                continue;
-            }
-
-            physical.QuadPart = pdpt_entry.Bits.PhysicalAddress
-                                << PAGE_4KB_SHIFT;
-
-            pd_base = ImpMmGetVirtualForPhysical(physical);
-
-            if (!pd_base || !ImpMmIsAddressValid(pd_base))
-                continue;
-
-            for (INT pd_index = 0; pd_index < PD_ENTRY_COUNT; pd_index++) {
-                if (!ImpMmIsAddressValid(pd_base + pd_index * sizeof(UINT64)))
-                    continue;
-
-                pd_entry.BitAddress =
-                    *(UINT64*)(pd_base + pd_index * sizeof(UINT64));
-
-                if (pd_entry.Bits.Present == NULL)
-                    continue;
-
-                if (IS_LARGE_PAGE(pd_entry.BitAddress)) {
-                    /* 2MB size page */
-                    pd_large_entry.BitAddress = pd_entry.BitAddress;
-
-                    physical.QuadPart = pd_large_entry.Bits.PhysicalAddress
-                                        << PAGE_2MB_SHIFT;
-
-                    if (IsPhysicalAddressInPhysicalMemoryRange(
-                            physical.QuadPart, physical_memory_ranges) == FALSE)
-                        continue;
-
-                    base_2mb_virtual_page =
-                        ImpMmGetVirtualForPhysical(physical);
-
-                    if (!base_2mb_virtual_page ||
-                        !ImpMmIsAddressValid(base_2mb_virtual_page))
-                        continue;
-
-                    EnumerateKernelLargePages(base_2mb_virtual_page,
-                                              LARGE_PAGE_2MB_ENTRIES,
-                                              Context,
-                                              INDEX_PROCESS_POOL_TAG);
-
-                    continue;
-                }
-
-                physical.QuadPart = pd_entry.Bits.PhysicalAddress
-                                    << PAGE_4KB_SHIFT;
-
-                if (!ImpMmIsAddressValid(pd_base + pd_index * sizeof(UINT64)))
-                    continue;
-
-                pt_base = ImpMmGetVirtualForPhysical(physical);
-
-                if (!pt_base || !ImpMmIsAddressValid(pt_base))
-                    continue;
-
-                for (INT pt_index = 0; pt_index < PT_ENTRY_COUNT; pt_index++) {
-                    if (!ImpMmIsAddressValid(pt_base +
-                                             pt_index * sizeof(UINT64)))
-                        continue;
-
-                    pt_entry.BitAddress =
-                        *(UINT64*)(pt_base + pt_index * sizeof(UINT64));
-
-                    if (pt_entry.Bits.Present == NULL)
-                        continue;
-
-                    physical.QuadPart = pt_entry.Bits.PhysicalAddress
-                                        << PAGE_4KB_SHIFT;
-
-                    /* if the page base isnt in a legit
-                     * region, go next */
-                    if (IsPhysicalAddressInPhysicalMemoryRange(
-                            physical.QuadPart, physical_memory_ranges) == FALSE)
-                        continue;
-
-                    base_virtual_page = ImpMmGetVirtualForPhysical(physical);
-
-                    /* stupid fucking intellisense error GO
-                     * AWAY! */
-                    if (base_virtual_page == NULL ||
-                        !ImpMmIsAddressValid(base_virtual_page))
-                        continue;
-
-                    ScanPageForKernelObjectAllocation(base_virtual_page,
-                                                      PAGE_BASE_SIZE,
-                                                      INDEX_PROCESS_POOL_TAG,
-                                                      Context);
-                }
-            }
-        }
     }
 
-    DEBUG_VERBOSE("Finished scanning memory for unlinked processes.");
+    DEBUG_VERBOSE("Finished scanning memory for unlinked processes. Pages: "
+                  "%llx, tables: %llx",
+                  walk.pages_visited,
+                  walk.tables_visited);
 }
 
 STATIC
@@ -751,6 +370,193 @@ end:
     return STATUS_SUCCESS;
 }
 
+/*
+ * Spans are filtered before a single frame of them is translated. Anything
+ * not executable, user accessible or overlapping a loaded module is skipped
+ * with one check, which is what keeps the walk cheap on systems mapping most
+ * of the kernel with 2mb and 1gb pages.
+ */
+STATIC
+BOOLEAN
+IsUnownedExecutableSpan(_In_ PPAGE_SPAN Span, _Inout_opt_ PVOID Context)
+{
+    PEXECUTABLE_SPAN_SCAN scan = (PEXECUTABLE_SPAN_SCAN)Context;
+
+    if (!Span->executable || Span->user)
+        return FALSE;
+
+    if (PageSpanIsOwned(&scan->owners, Span))
+        return FALSE;
+
+    scan->unowned++;
+    scan->reported = FALSE;
+    return TRUE;
+}
+
+STATIC
+VOID
+ReportUnownedExecutableSpan(_In_ PPAGE_SPAN Span)
+{
+    PUNOWNED_EXECUTABLE_MEMORY_REPORT report = NULL;
+
+    DEBUG_WARNING("Unowned executable memory found. Base: %llx, Size: %llx",
+                  Span->virtual_base,
+                  Span->size);
+
+    report = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                sizeof(UNOWNED_EXECUTABLE_MEMORY_REPORT),
+                                REPORT_POOL_TAG);
+
+    if (!report)
+        return;
+
+    report->report_code   = REPORT_UNOWNED_EXECUTABLE_MEMORY;
+    report->span_size     = (UINT32)Span->size;
+    report->virtual_base  = Span->virtual_base;
+    report->physical_base = Span->physical_base;
+
+    if (!NT_SUCCESS(IrpQueueCompleteIrp(
+            report, sizeof(UNOWNED_EXECUTABLE_MEMORY_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+/*
+ * Executable pages that are entirely zero are left over from freed code and
+ * can't run anything meaningful, so a span is only reported once a page of it
+ * holds something.
+ */
+STATIC
+VOID
+ScanUnownedExecutablePage(_In_ UINT64        PageBase,
+                          _In_ ULONG         PageSize,
+                          _Inout_opt_ PVOID Context)
+{
+    PEXECUTABLE_SPAN_SCAN scan = (PEXECUTABLE_SPAN_SCAN)Context;
+    PUINT64               page = (PUINT64)PageBase;
+
+    if (scan->reported)
+        return;
+
+    for (UINT32 index = 0; index < PageSize / sizeof(UINT64); index++) {
+        if (!page[index])
+            continue;
+
+        scan->reported = TRUE;
+        scan->reports++;
+        ReportUnownedExecutableSpan(&scan->walk->span);
+        return;
+    }
+}
+
+STATIC
+NTSTATUS
+BuildSpanOwners(_Out_ PPAGE_SPAN_OWNERS Owners)
+{
+    PAGED_CODE();
+
+    NTSTATUS                  status  = STATUS_UNSUCCESSFUL;
+    SYSTEM_MODULES            modules = {0};
+    PRTL_MODULE_EXTENDED_INFO module  = NULL;
+    SIZE_T                    size    = 0;
+
+    status = GetSystemModuleInformation(&modules);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("GetSystemModuleInformation failed with status %x", status);
+        return status;
+    }
+
+    size             = modules.module_count * sizeof(PAGE_SPAN_OWNER);
+    Owners->count    = 0;
+    Owners->capacity = modules.module_count;
+    Owners->owners   = ImpExAllocatePool2(
+        POOL_FLAG_NON_PAGED, size, POOL_TAG_SPAN_OWNERS);
+
+    if (!Owners->owners) {
+        status = STATUS_MEMORY_NOT_ALLOCATED;
+        goto end;
+    }
+
+    module = (PRTL_MODULE_EXTENDED_INFO)modules.address;
+
+    for (INT index = 0; index < modules.module_count; index++, module++)
+        PageSpanOwnersAdd(Owners, (UINT64)module->ImageBase, module->ImageSize);
+
+    PageSpanOwnersSort(Owners);
+
+end:
+
+    ImpExFreePoolWithTag(modules.address, SYSTEM_MODULES_POOL);
+    return status;
+}
+
+/*
+ * Walks the kernel page tables looking for executable kernel memory that no
+ * loaded module accounts for. Ownership and executability are decided once
+ * per leaf mapping, so a 2mb or 1gb page costs the same as a 4kb one unless
+ * it turns out to be unowned, and only then are its pages translated and
+ * read.
+ */
+NTSTATUS
+FindUnownedExecutableMemory()
+{
+    PAGED_CODE();
+
+    NTSTATUS               status                 = STATUS_UNSUCCESSFUL;
+    CR3                    cr3                    = {0};
+    PAGE_WALK              walk                   = {0};
+    EXECUTABLE_SPAN_SCAN   scan                   = {0};
+    PPHYSICAL_MEMORY_RANGE physical_memory_ranges = NULL;
+
+    status = BuildSpanOwners(&scan.owners);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("BuildSpanOwners failed with status %x", status);
+        return status;
+    }
+
+    physical_memory_ranges = ImpMmGetPhysicalMemoryRangesEx2(NULL, NULL);
+
+    if (!physical_memory_ranges) {
+        DEBUG_ERROR("MmGetPhysicalMemoryRangesEx2 failed with no status.");
+        status = STATUS_UNSUCCESSFUL;
+        goto end;
+    }
+
+    cr3.AsUInt = __readcr3();
+    scan.walk  = &walk;
+
+    walk.directory_table_base = cr3.AddressOfPageDirectory << PAGE_4KB_SHIFT;
+    walk.translate            = GetVirtualForPhysicalInRange;
+    walk.validate             = IsKernelAddressValid;
+    walk.memory_context       = physical_memory_ranges;
+    walk.callback             = ScanUnownedExecutablePage;
+    walk.callback_context     = &scan;
+    walk.span_filter          = IsUnownedExecutableSpan;
+
+    status = WalkPageTables(&walk);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("WalkPageTables failed with status %x", status);
+        goto end;
+    }
+
+    DEBUG_VERBOSE("Finished scanning for unowned executable memory. Spans: "
+                  "%llx, unowned: %llx, pages: %llx, reports: %llx",
+                  walk.spans_visited,
+                  scan.unowned,
+                  walk.pages_visited,
+                  scan.reports);
+
+end:
+
+    if (physical_memory_ranges)
+        ExFreePool(physical_memory_ranges);
+
+    ImpExFreePoolWithTag(scan.owners.owners, POOL_TAG_SPAN_OWNERS);
+    return status;
+}
+
 /*
  * Allocations greater then a page in size are stored in a linked list and are
  * called big pool allocations.
@@ -16,4 +16,7 @@ GetGlobalDebuggerData();
 NTSTATUS
 EnumerateBigPoolAllocations();
 
+NTSTATUS
+FindUnownedExecutableMemory();
+
 #endif
\ No newline at end of file
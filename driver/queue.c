@@ -16,23 +16,13 @@ QueuePush(_Inout_ PQUEUE_HEAD Head, _In_ PVOID Data)
 {
     ImpKeAcquireGuardedMutex(&Head->lock);
 
-    PQUEUE_NODE temp = ExAllocatePool2(
+    PQUEUE_NODE temp = ImpExAllocatePool2(
         POOL_FLAG_NON_PAGED, sizeof(QUEUE_NODE), QUEUE_POOL_TAG);
 
     if (!temp)
         goto end;
 
-    Head->entries += 1;
-
-    temp->data = Data;
-
-    if (Head->end != NULL)
-        Head->end->next = temp;
-
-    Head->end = temp;
-
-    if (Head->start == NULL)
-        Head->start = temp;
+    QueueListInsertTail(&Head->queue, temp, Data);
 
 end:
     ImpKeReleaseGuardedMutex(&Head->lock);
@@ -44,19 +34,12 @@ QueuePop(_Inout_ PQUEUE_HEAD Head)
     ImpKeAcquireGuardedMutex(&Head->lock);
 
     PVOID       data = NULL;
-    PQUEUE_NODE temp = Head->start;
+    PQUEUE_NODE temp = QueueListRemoveHead(&Head->queue);
 
     if (temp == NULL)
         goto end;
 
-    Head->entries = Head->entries - 1;
-
-    data        = temp->data;
-    Head->start = temp->next;
-
-    if (Head->end == temp)
-        Head->end = NULL;
-
+    data = temp->data;
     ImpExFreePoolWithTag(temp, QUEUE_POOL_TAG);
 
 end:
@@ -4,13 +4,13 @@
 #include <ntifs.h>
 #include "common.h"
 
+#include "../core/container.h"
+
 #define MAX_REPORTS_PER_IRP 20
 
 typedef struct QUEUE_HEAD {
-    struct _QUEUE_NODE* start;
-    struct _QUEUE_NODE* end;
-    KGUARDED_MUTEX      lock;
-    INT                 entries;
+    QUEUE_LIST     queue;
+    KGUARDED_MUTEX lock;
 
 } QUEUE_HEAD, *PQUEUE_HEAD;
 
@@ -29,12 +29,6 @@ typedef struct _REPORT_QUEUE_HEAD {
 
 } REPORT_QUEUE_HEAD, *PREPORT_QUEUE_HEAD;
 
-typedef struct _QUEUE_NODE {
-    struct _QUEUE_NODE* next;
-    PVOID               data;
-
-} QUEUE_NODE, *PQUEUE_NODE;
-
 typedef struct _GLOBAL_REPORT_QUEUE_HEADER {
     INT count;
 
@@ -1,6 +1,11 @@
 #include "session.h"
 
 #include "imports.h"
+#include "integrity.h"
+#include "modules.h"
+#include "thread.h"
+
+#include "../core/heartbeat.h"
 
 /* for now, lets just xor the aes key with our cookie */
 
@@ -11,11 +16,38 @@ typedef struct _SESSION_INITIATION_PACKET {
 
 } SESSION_INITIATION_PACKET, *PSESSION_INITIATION_PACKET;
 
+/*
+ * Every session's heartbeat key is derived from this and the session cookie,
+ * see HeartbeatDeriveKey. The server holds the same key and nothing else
+ * does. It is passed in at build time as comma separated bytes, with
+ * msbuild /p:HeartbeatRootKey=..., only debug builds fall back to the public
+ * test key.
+ */
+#if defined(HEARTBEAT_ROOT_KEY_BYTES)
+STATIC CONST UCHAR HEARTBEAT_ROOT_KEY[HEARTBEAT_ROOT_KEY_LENGTH] = {
+    HEARTBEAT_ROOT_KEY_BYTES};
+#elif defined(HEARTBEAT_USE_TEST_ROOT_KEY)
+STATIC CONST UCHAR HEARTBEAT_ROOT_KEY[HEARTBEAT_ROOT_KEY_LENGTH] = {
+    HEARTBEAT_TEST_ROOT_KEY_BYTES};
+#else
+#error "HEARTBEAT_ROOT_KEY_BYTES must hold the heartbeat root key"
+#endif
+
+C_ASSERT(sizeof(HEARTBEAT_ROOT_KEY) == HEARTBEAT_ROOT_KEY_LENGTH);
+
 VOID
 SessionInitialiseStructure()
 {
     PAGED_CODE();
     ImpKeInitializeGuardedMutex(&GetActiveSession()->lock);
+    ImpKeInitializeGuardedMutex(&GetActiveSession()->attach_lock);
+    ImpKeInitializeGuardedMutex(&GetActiveSession()->dispatch_lock);
+    ImpKeInitializeGuardedMutex(&GetActiveSession()->region_lock);
+    ImpKeInitializeGuardedMutex(&GetActiveSession()->module_lock);
+
+    RegionMapInitialise(&GetActiveSession()->region_map,
+                        GetActiveSession()->region_buffer,
+                        REGION_MAP_DEFAULT_CAPACITY);
 }
 
 VOID
@@ -74,7 +106,11 @@ SessionTerminate()
     session->um_handle         = NULL;
     session->process           = NULL;
     session->is_session_active = FALSE;
+    RtlSecureZeroMemory(session->heartbeat_key, sizeof(session->heartbeat_key));
     ImpKeReleaseGuardedMutex(&session->lock);
+
+    ResetModuleImage();
+    ResetProcessMemoryScan();
 }
 
 NTSTATUS
@@ -114,13 +150,29 @@ SessionInitialise(_In_ PIRP Irp)
     session->process           = process;
     session->is_session_active = TRUE;
     session->session_cookie    = information->session_cookie;
+    session->heartbeat_count   = 0;
+    session->report_count      = 0;
 
     RtlCopyMemory(session->session_aes_key,
                   information->session_aes_key,
                   AES_128_KEY_SIZE);
 
+    HeartbeatDeriveKey((PVOID)HEARTBEAT_ROOT_KEY,
+                       sizeof(HEARTBEAT_ROOT_KEY),
+                       session->session_cookie,
+                       session->heartbeat_key);
+
 end:
     ImpKeReleaseGuardedMutex(&session->lock);
+
+    /* the session lock is never held with any of the per check locks */
+    if (NT_SUCCESS(status)) {
+        ResetAttachedThreadTracker();
+        ResetHalDispatchTableSnapshot();
+        ResetProcessMemoryScan();
+        ResetModuleImage();
+    }
+
     return status;
 }
 
@@ -164,12 +216,11 @@ SessionIncrementIrpsProcessedCount()
     ImpKeReleaseGuardedMutex(&GetActiveSession()->lock);
 }
 
+/* called as reports are completed, which can be above APC_LEVEL */
 VOID
 SessionIncrementReportCount()
 {
-    ImpKeAcquireGuardedMutex(&GetActiveSession()->lock);
-    GetActiveSession()->report_count++;
-    ImpKeReleaseGuardedMutex(&GetActiveSession()->lock);
+    InterlockedIncrement((volatile LONG*)&GetActiveSession()->report_count);
 }
 
 VOID
@@ -178,4 +229,48 @@ SessionIncrementHeartbeatCount()
     ImpKeAcquireGuardedMutex(&GetActiveSession()->lock);
     GetActiveSession()->heartbeat_count++;
     ImpKeReleaseGuardedMutex(&GetActiveSession()->lock);
-}
\ No newline at end of file
+}
+
+/*
+ * Signs the next heartbeat of the session with its heartbeat key. The
+ * sequence and time come from here rather than the module so it cant hold
+ * heartbeats back or make them up without the server noticing.
+ */
+NTSTATUS
+SessionQueryHeartbeat(_In_ PIRP Irp)
+{
+    PAGED_CODE();
+
+    NTSTATUS         status  = STATUS_UNSUCCESSFUL;
+    PACTIVE_SESSION  session = GetActiveSession();
+    HEARTBEAT_PACKET packet  = {0};
+
+    status = ValidateIrpOutputBuffer(Irp, sizeof(HEARTBEAT_PACKET));
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("ValidateIrpOutputBuffer failed with status %x", status);
+        return status;
+    }
+
+    ImpKeAcquireGuardedMutex(&session->lock);
+
+    if (!session->is_session_active) {
+        ImpKeReleaseGuardedMutex(&session->lock);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    session->heartbeat_count++;
+
+    packet.session_cookie = session->session_cookie;
+    packet.sequence       = session->heartbeat_count;
+    packet.time           = KeQueryInterruptTime() / 10000;
+    packet.report_count   = session->report_count;
+
+    HeartbeatSign(&packet, session->heartbeat_key, HEARTBEAT_KEY_LENGTH);
+
+    ImpKeReleaseGuardedMutex(&session->lock);
+
+    RtlCopyMemory(Irp->AssociatedIrp.SystemBuffer, &packet, sizeof(packet));
+    Irp->IoStatus.Information = sizeof(packet);
+    return status;
+}
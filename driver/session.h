@@ -42,4 +42,7 @@ SessionIncrementReportCount();
 VOID
 SessionIncrementHeartbeatCount();
 
+NTSTATUS
+SessionQueryHeartbeat(_In_ PIRP Irp);
+
 #endif
\ No newline at end of file
@@ -11,56 +11,451 @@
 
 #ifdef ALLOC_PRAGMA
 #    pragma alloc_text(PAGE, DetectThreadsAttachedToProtectedProcess)
+#    pragma alloc_text(PAGE, ResetAttachedThreadTracker)
+#    pragma alloc_text(PAGE, GetPspCidTable)
+#    pragma alloc_text(PAGE, SnapshotPspCidTable)
+#    pragma alloc_text(PAGE, SeedThreadListFromPspCidTable)
+#    pragma alloc_text(PAGE, FreePspCidTableSnapshot)
 #    pragma alloc_text(PAGE, ValidateThreadsPspCidTableEntry)
+#    pragma alloc_text(PAGE, ValidateThreadListPspCidTableEntries)
+#    pragma alloc_text(PAGE, AuditSystemThreadStartAddresses)
 #endif
 
-BOOLEAN
-ValidateThreadsPspCidTableEntry(_In_ PETHREAD Thread)
+STATIC
+PVOID
+TranslateCidTablePage(_In_ UINT64 Address, _Inout_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    if (!ImpMmIsAddressValid((PVOID)Address))
+        return NULL;
+
+    return (PVOID)Address;
+}
+
+STATIC
+PHANDLE_TABLE
+GetPspCidTable()
 {
     PAGED_CODE();
 
-    NTSTATUS status    = STATUS_UNSUCCESSFUL;
-    HANDLE   thread_id = NULL;
-    PETHREAD thread    = NULL;
+    PKDDEBUGGER_DATA64 debugger_data = NULL;
+    PHANDLE_TABLE      table         = NULL;
 
-    /*
-     * PsGetThreadId simply returns ETHREAD->Cid.UniqueThread
-     */
-    thread_id = ImpPsGetThreadId(Thread);
+    debugger_data = GetGlobalDebuggerData();
+
+    if (!debugger_data)
+        return NULL;
+
+    table = *(PHANDLE_TABLE*)debugger_data->PspCidTable;
+    ImpExFreePoolWithTag(debugger_data, POOL_DEBUGGER_DATA_TAG);
+
+    if (!table || !ImpMmIsAddressValid(table))
+        return NULL;
+
+    return table;
+}
+
+/*
+ * Takes a sorted snapshot of every object referenced by the PspCidTable. This
+ * replaces a PsLookupThreadByThreadId per thread, which went through the
+ * handle table for each lookup and took a reference on every thread it found
+ * that was never released.
+ */
+NTSTATUS
+SnapshotPspCidTable(_Out_ PCID_TABLE_WALK Walk)
+{
+    PAGED_CODE();
+
+    NTSTATUS      status   = STATUS_UNSUCCESSFUL;
+    PHANDLE_TABLE table    = NULL;
+    UINT32        capacity = 0;
+
+    RtlZeroMemory(Walk, sizeof(CID_TABLE_WALK));
+
+    table = GetPspCidTable();
+
+    if (!table)
+        return STATUS_INVALID_ADDRESS;
+
+    Walk->table_code               = table->TableCode;
+    Walk->next_handle_needing_pool = table->NextHandleNeedingPool;
+    Walk->translate                = TranslateCidTablePage;
+
+    capacity = CidTableGetMaximumEntryCount(Walk->next_handle_needing_pool);
+
+    if (!capacity)
+        return STATUS_INVALID_PARAMETER;
+
+    Walk->objects = ImpExAllocatePool2(
+        POOL_FLAG_NON_PAGED, capacity * sizeof(UINT64), POOL_TAG_CID_TABLE);
+
+    if (!Walk->objects)
+        return STATUS_MEMORY_NOT_ALLOCATED;
+
+    Walk->object_capacity = capacity;
+
+    status = WalkCidTable(Walk);
+
+    if (!NT_SUCCESS(status)) {
+        DEBUG_ERROR("WalkCidTable failed with status %x", status);
+        FreePspCidTableSnapshot(Walk);
+        return status;
+    }
+
+    DEBUG_VERBOSE("PspCidTable snapshot: %lx objects, %llx pages",
+                  Walk->object_count,
+                  Walk->pages_visited);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * The thread list is built by the thread notify routine, which never sees
+ * threads created before the driver loaded, most system threads among them.
+ * Every thread id below the PspCidTable's NextHandleNeedingPool is looked up
+ * once at load and inserted like a new thread. Lookups go through the table
+ * properly so a thread exiting under us is never touched.
+ */
+VOID
+SeedThreadListFromPspCidTable()
+{
+    PAGED_CODE();
+
+    PHANDLE_TABLE table    = GetPspCidTable();
+    PETHREAD      thread   = NULL;
+    UINT32        limit    = 0;
+    UINT32        inserted = 0;
+
+    if (!table) {
+        DEBUG_ERROR("PspCidTable not found, thread list not seeded.");
+        return;
+    }
+
+    limit = table->NextHandleNeedingPool;
+
+    ThreadListSetSeeding(TRUE);
+
+    for (UINT32 id = CID_TABLE_HANDLE_INCREMENT; id < limit;
+         id += CID_TABLE_HANDLE_INCREMENT) {
+        if (!NT_SUCCESS(ImpPsLookupThreadByThreadId((HANDLE)(UINT64)id,
+                                                    &thread)))
+            continue;
+
+        ThreadListInsertThread(thread, ImpPsGetThreadProcess(thread));
+        ImpObDereferenceObject(thread);
+        inserted++;
+    }
+
+    ThreadListSetSeeding(FALSE);
+
+    DEBUG_VERBOSE("Thread list seeded with %lx threads", inserted);
+}
+
+VOID
+FreePspCidTableSnapshot(_Inout_ PCID_TABLE_WALK Walk)
+{
+    if (Walk->objects)
+        ImpExFreePoolWithTag(Walk->objects, POOL_TAG_CID_TABLE);
+
+    Walk->objects         = NULL;
+    Walk->object_capacity = 0;
+    Walk->object_count    = 0;
+}
+
+/*
+ * For each core on the processor, the first x threads equal to x cores will be
+ * assigned a cid equal to its equivalent core. These are the idle threads,
+ * which are never inserted into the PspCidTable so would always be reported.
+ * The problem is this can be easily bypassed by simply modifying the
+ * ETHREAD->Cid.UniqueThread identifier.. So while it isnt a perfect
+ * detection method for now it's good enough.
+ */
+STATIC
+BOOLEAN
+IsIdleThreadId(_In_ HANDLE ThreadId)
+{
+    return (UINT64)ThreadId < (UINT64)ImpKeQueryActiveProcessorCount(NULL);
+}
+
+BOOLEAN
+ValidateThreadsPspCidTableEntry(_In_ PCID_TABLE_WALK Snapshot,
+                                _In_ PETHREAD        Thread)
+{
+    PAGED_CODE();
 
     /*
-     * For each core on the processor, the first x threads equal to x cores
-     * will be assigned a cid equal to its equivalent core. These threads
-     * are generally executing the HLT instruction or some other boring
-     * stuff while the processor is not busy. The reason this is important
-     * is because passing in a handle value of 0 which, even though is a
-     * valid cid, returns a non success status meaning we mark it an invalid
-     * cid entry even though it is. To combat this we simply add a little
-     * check here. The problem is this can be easily bypassed by simply
-     * modifying the ETHREAD->Cid.UniqueThread identifier.. So while it isnt
-     * a perfect detection method for now it's good enough.
+     * PsGetThreadId simply returns ETHREAD->Cid.UniqueThread
      */
-    if ((UINT64)thread_id < (UINT64)ImpKeQueryActiveProcessorCount(NULL))
+    if (IsIdleThreadId(ImpPsGetThreadId(Thread)))
         return TRUE;
 
     /*
-     * PsLookupThreadByThreadId will use a threads id to find its cid entry,
-     * and return the pointer contained in the HANDLE_TABLE entry pointing
-     * to the thread object. Meaning if we pass a valid thread id which we
-     * retrieved above and dont receive a STATUS_SUCCESS the cid entry could
-     * potentially be removed or disrupted..
+     * The cid entry of a thread points straight at the thread object, so if
+     * it isnt in the snapshot its entry has been removed or disrupted.
      */
-    status = ImpPsLookupThreadByThreadId(thread_id, &thread);
-
-    if (!NT_SUCCESS(status)) {
-        DEBUG_WARNING(
-            "Failed to lookup thread by id. PspCidTable entry potentially removed.");
+    if (!CidTableContainsObject(Snapshot, (UINT64)Thread)) {
+        DEBUG_WARNING("Thread: %llx not found in PspCidTable snapshot.",
+                      (UINT64)Thread);
         return FALSE;
     }
 
     return TRUE;
 }
 
+typedef struct _THREAD_ADDRESS_BUFFER {
+    PUINT64 addresses;
+    UINT32  capacity;
+    UINT32  count;
+
+} THREAD_ADDRESS_BUFFER, *PTHREAD_ADDRESS_BUFFER;
+
+STATIC
+VOID
+CountThreadListEntry(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
+                     _Inout_opt_ PVOID       Context)
+{
+    UNREFERENCED_PARAMETER(ThreadListEntry);
+
+    if (Context)
+        (*(PUINT32)Context)++;
+}
+
+STATIC
+VOID
+CollectThreadListEntry(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
+                       _Inout_opt_ PVOID       Context)
+{
+    PTHREAD_ADDRESS_BUFFER buffer = (PTHREAD_ADDRESS_BUFFER)Context;
+
+    if (!buffer || buffer->count >= buffer->capacity)
+        return;
+
+    if (IsIdleThreadId(ImpPsGetThreadId(ThreadListEntry->thread)))
+        return;
+
+    /* keeps the thread alive until we are done reporting it */
+    ImpObfReferenceObject(ThreadListEntry->thread);
+    buffer->addresses[buffer->count++] = (UINT64)ThreadListEntry->thread;
+}
+
+/*
+ * A thread created after the snapshot was taken is in our list but not the
+ * snapshot, so a miss is looked up in the live table before it is reported.
+ */
+STATIC
+BOOLEAN
+IsThreadInPspCidTable(_In_ PETHREAD Thread)
+{
+    NTSTATUS status = STATUS_UNSUCCESSFUL;
+    PETHREAD thread = NULL;
+
+    status = ImpPsLookupThreadByThreadId(ImpPsGetThreadId(Thread), &thread);
+
+    if (!NT_SUCCESS(status))
+        return FALSE;
+
+    ImpObDereferenceObject(thread);
+    return thread == Thread;
+}
+
+STATIC
+VOID
+ReportThreadMissingFromCidTable(_In_ UINT64 Thread, _Inout_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    PETHREAD thread = (PETHREAD)Thread;
+
+    if (IsThreadInPspCidTable(thread))
+        return;
+
+    DEBUG_WARNING("Thread: %llx was not found in the pspcid table.", Thread);
+
+    PHIDDEN_SYSTEM_THREAD_REPORT report =
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                           sizeof(HIDDEN_SYSTEM_THREAD_REPORT),
+                           REPORT_POOL_TAG);
+
+    if (!report)
+        return;
+
+    report->report_code          = REPORT_HIDDEN_SYSTEM_THREAD;
+    report->found_in_kthreadlist = TRUE;
+    report->found_in_pspcidtable = FALSE;
+    report->thread_id            = ImpPsGetThreadId(thread);
+    report->thread_address       = thread;
+
+    RtlCopyMemory(report->thread, thread, sizeof(report->thread));
+
+    if (!NT_SUCCESS(IrpQueueCompleteIrp(report,
+                                        sizeof(HIDDEN_SYSTEM_THREAD_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+/*
+ * Diffs our thread list against the snapshot in a single merge. Threads are
+ * removed from our list in the exit notify routine, which runs before their
+ * cid entry is destroyed, so every thread in the list should have an entry.
+ *
+ * The list is counted first so the buffer can be sized, threads created
+ * between the two passes are simply picked up by the next run. Threads
+ * created since the snapshot are missing from it and are looked up again
+ * before being reported.
+ */
+VOID
+ValidateThreadListPspCidTableEntries(_In_ PCID_TABLE_WALK Snapshot)
+{
+    PAGED_CODE();
+
+    UINT32                count   = 0;
+    UINT32                missing = 0;
+    THREAD_ADDRESS_BUFFER buffer  = {0};
+
+    EnumerateThreadListWithCallbackRoutine(CountThreadListEntry, &count);
+
+    if (!count)
+        return;
+
+    buffer.addresses = ImpExAllocatePool2(
+        POOL_FLAG_NON_PAGED, count * sizeof(UINT64), POOL_TAG_CID_TABLE);
+
+    if (!buffer.addresses)
+        return;
+
+    buffer.capacity = count;
+
+    EnumerateThreadListWithCallbackRoutine(CollectThreadListEntry, &buffer);
+
+    missing = CidTableFindMissingObjects(Snapshot,
+                                         buffer.addresses,
+                                         buffer.count,
+                                         ReportThreadMissingFromCidTable,
+                                         NULL);
+
+    DEBUG_VERBOSE("Validated %lx threads against the PspCidTable, %lx missing",
+                  buffer.count,
+                  missing);
+
+    for (UINT32 index = 0; index < buffer.count; index++)
+        ImpObDereferenceObject((PVOID)buffer.addresses[index]);
+
+    ImpExFreePoolWithTag(buffer.addresses, POOL_TAG_CID_TABLE);
+}
+
+STATIC
+VOID
+AuditSystemThreadStartCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
+                               _Inout_opt_ PVOID       Context)
+{
+    PTHREAD_START_AUDIT  audit   = (PTHREAD_START_AUDIT)Context;
+    PKTHREAD             thread  = ThreadListEntry->thread;
+    UINT64               start   = 0;
+    UINT64               win32   = 0;
+    THREAD_START_VERDICT verdict = THREAD_START_BACKED;
+
+    if (!audit || ThreadListEntry->owning_process != PsInitialSystemProcess)
+        return;
+
+    if (ThreadListEntry->start_audit_generation == audit->generation)
+        return;
+
+    /*
+     * StartAddress of a system thread is PspSystemThreadStartup, the routine
+     * handed to PsCreateSystemThread is kept in Win32StartAddress.
+     */
+    start = *(PUINT64)((UINT64)thread + KTHREAD_START_ADDRESS_OFFSET);
+    win32 = *(PUINT64)((UINT64)thread + ETHREAD_WIN32_START_ADDRESS_OFFSET);
+
+    verdict = ThreadStartAuditRecord(audit,
+                                     (UINT64)thread,
+                                     (UINT32)(UINT64)ImpPsGetThreadId(thread),
+                                     start,
+                                     win32);
+
+    if (verdict != THREAD_START_DEFERRED)
+        ThreadListEntry->start_audit_generation = audit->generation;
+}
+
+STATIC
+VOID
+ReportUnbackedSystemThread(_In_ PUNBACKED_THREAD_START Start,
+                           _Inout_opt_ PVOID           Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    DEBUG_WARNING("System thread %llx started at unbacked address %llx, "
+                  "threads: %lx",
+                  Start->thread,
+                  Start->address,
+                  Start->threads);
+
+    PUNBACKED_SYSTEM_THREAD_REPORT report =
+        ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                           sizeof(UNBACKED_SYSTEM_THREAD_REPORT),
+                           REPORT_POOL_TAG);
+
+    if (!report)
+        return;
+
+    report->report_code         = REPORT_UNBACKED_SYSTEM_THREAD;
+    report->thread_id           = Start->thread_id;
+    report->thread_address      = Start->thread;
+    report->start_address       = Start->start_address;
+    report->win32_start_address = Start->win32_start_address;
+    report->threads             = Start->threads;
+
+    if (!NT_SUCCESS(IrpQueueCompleteIrp(report,
+                                        sizeof(UNBACKED_SYSTEM_THREAD_REPORT))))
+        DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
+}
+
+/*
+ * Only threads created since the last round, or every thread if the module
+ * list changed, are resolved, see core/threadstart.h. Threads that existed
+ * before the driver loaded are in our thread list through
+ * SeedThreadListFromPspCidTable.
+ */
+VOID
+AuditSystemThreadStartAddresses(_In_ PSYSTEM_MODULES SystemModules)
+{
+    PAGED_CODE();
+
+    PTHREAD_START_CONTEXT context  = GetThreadStartContext();
+    PMODULE_RANGE         ranges   = NULL;
+    UINT32                capacity = 0;
+    UINT32                reported = 0;
+
+    if (SystemModules->module_count <= 0)
+        return;
+
+    capacity = (UINT32)SystemModules->module_count;
+    ranges   = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                capacity * sizeof(MODULE_RANGE),
+                                POOL_TAG_THREAD_START);
+
+    if (!ranges)
+        return;
+
+    ImpKeAcquireGuardedMutex(&context->lock);
+
+    ThreadStartAuditBeginRound(
+        &context->audit, ranges, capacity, SystemModules);
+    EnumerateThreadListWithCallbackRoutine(AuditSystemThreadStartCallback,
+                                           &context->audit);
+    reported = ThreadStartAuditEndRound(
+        &context->audit, ReportUnbackedSystemThread, NULL);
+
+    DEBUG_VERBOSE("Audited %lx system thread start addresses, %lx unbacked, "
+                  "%lx reported",
+                  context->audit.audited,
+                  context->audit.unbacked,
+                  reported);
+
+    ImpKeReleaseGuardedMutex(&context->lock);
+    ImpExFreePoolWithTag(ranges, POOL_TAG_THREAD_START);
+}
+
 /*
  * I did not reverse this myself and previously had no idea how you would go
  * about detecting KiAttachProcess so credits to KANKOSHEV for the find:
@@ -75,36 +470,74 @@ ValidateThreadsPspCidTableEntry(_In_ PETHREAD Thread)
  * during context switch scenarios as it's how the thread determines if it has
  * any APC's queued.
  */
-STATIC VOID
+STATIC
+VOID
 DetectAttachedThreadsProcessCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
                                      _Inout_opt_ PVOID       Context)
 {
-    UNREFERENCED_PARAMETER(Context);
-
-    PKAPC_STATE apc_state         = NULL;
-    PEPROCESS   protected_process = NULL;
-
-    SessionGetProcess(&protected_process);
-
-    if (!protected_process)
-        return;
+    PKAPC_STATE     apc_state         = NULL;
+    PEPROCESS       protected_process = (PEPROCESS)Context;
+    PEPROCESS       owner             = ThreadListEntry->owning_process;
+    PACTIVE_SESSION session           = GetActiveSession();
+    ATTACH_SAMPLE   sample            = {0};
+    LPCSTR          image_name        = NULL;
 
     apc_state = (PKAPC_STATE)((UINT64)ThreadListEntry->thread +
                               KTHREAD_APC_STATE_OFFSET);
 
     /*
      * We don't care if a thread owned by our protected process is attached
-     *
-     * todo: this is filterless and will just report anything, need to have
-     * a look into what processes actually attach to real games
      */
     if (!(apc_state->Process == protected_process &&
-          ThreadListEntry->owning_process != protected_process)) {
+          owner != protected_process)) {
         return;
     }
 
-    DEBUG_WARNING("Thread is attached to our protected process: %llx",
-                  (UINT64)ThreadListEntry->thread);
+    image_name = ImpPsGetProcessImageFileName(owner);
+
+    sample.process    = (UINT64)owner;
+    sample.process_id = (UINT32)(UINT64)ImpPsGetProcessId(owner);
+    sample.thread     = (UINT64)ThreadListEntry->thread;
+    sample.thread_id =
+        (UINT32)(UINT64)ImpPsGetThreadId(ThreadListEntry->thread);
+    sample.signature_level =
+        *(PUCHAR)((UINT64)owner + EPROCESS_SIGNATURE_LEVEL_OFFSET);
+
+    if (image_name)
+        RtlCopyMemory(
+            sample.image_name, image_name, ATTACH_IMAGE_NAME_LENGTH - 1);
+
+    if (AttachTrackerRecord(&session->attach_tracker, &sample) ==
+        ATTACH_RECORD_TRACKED) {
+        DEBUG_VERBOSE("Thread %llx of %s is attached to our protected process",
+                      sample.thread,
+                      sample.image_name);
+    }
+}
+
+/*
+ * Processes with a legitimate reason to attach to a game. Each one must also
+ * carry at least the given signature level, which the kernel assigns from the
+ * signing of the process image so it can't be matched by renaming a binary.
+ */
+STATIC CONST ATTACH_ALLOWLIST_ENTRY ATTACH_ALLOWLIST[] = {
+    {"System", ATTACH_SIGNING_LEVEL_WINDOWS_TCB},
+    {"csrss.exe", ATTACH_SIGNING_LEVEL_WINDOWS_TCB},
+    {"lsass.exe", ATTACH_SIGNING_LEVEL_WINDOWS},
+    {"MsMpEng.exe", ATTACH_SIGNING_LEVEL_ANTIMALWARE}};
+
+STATIC
+VOID
+ReportAttachedProcess(_In_ PATTACHER Attacher, _Inout_opt_ PVOID Context)
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    DEBUG_WARNING("Process %s (%lx) attached to our protected process, "
+                  "rounds: %lx threads: %lx",
+                  Attacher->image_name,
+                  Attacher->process_id,
+                  Attacher->rounds,
+                  Attacher->max_threads);
 
     PATTACH_PROCESS_REPORT report = ImpExAllocatePool2(
         POOL_FLAG_NON_PAGED, sizeof(ATTACH_PROCESS_REPORT), REPORT_POOL_TAG);
@@ -112,19 +545,72 @@ DetectAttachedThreadsProcessCallback(_In_ PTHREAD_LIST_ENTRY ThreadListEntry,
     if (!report)
         return;
 
-    report->report_code    = REPORT_ILLEGAL_ATTACH_PROCESS;
-    report->thread_id      = ImpPsGetThreadId(ThreadListEntry->thread);
-    report->thread_address = ThreadListEntry->thread;
+    report->report_code     = REPORT_ILLEGAL_ATTACH_PROCESS;
+    report->thread_id       = Attacher->thread_id;
+    report->thread_address  = Attacher->thread;
+    report->process_id      = Attacher->process_id;
+    report->signature_level = Attacher->signature_level;
+    report->dwell_time      = Attacher->last_seen - Attacher->first_seen;
+    report->rounds          = Attacher->rounds;
+    report->max_threads     = Attacher->max_threads;
+    report->samples         = Attacher->samples;
+    report->ended           = Attacher->ended;
+
+    RtlCopyMemory(report->image_name,
+                  Attacher->image_name,
+                  ATTACH_REPORT_IMAGE_NAME_LENGTH);
 
     if (!NT_SUCCESS(IrpQueueCompleteIrp(report, sizeof(ATTACH_PROCESS_REPORT))))
         DEBUG_ERROR("IrpQueueCompleteIrp failed with no status.");
 }
 
+/*
+ * Called when a new session starts, anything tracked belonged to the previous
+ * protected process.
+ */
+VOID
+ResetAttachedThreadTracker()
+{
+    PAGED_CODE();
+
+    PACTIVE_SESSION session = GetActiveSession();
+
+    ImpKeAcquireGuardedMutex(&session->attach_lock);
+    AttachTrackerInitialise(&session->attach_tracker,
+                            ATTACH_ALLOWLIST,
+                            ARRAYSIZE(ATTACH_ALLOWLIST),
+                            ReportAttachedProcess,
+                            NULL);
+    ImpKeReleaseGuardedMutex(&session->attach_lock);
+}
+
+/*
+ * Each call is one sampling round. Rather then a report per attached thread,
+ * threads are aggregated by their owning process and each attaching process
+ * is reported once per attach, see core/attach.h.
+ */
 VOID
 DetectThreadsAttachedToProtectedProcess()
 {
     PAGED_CODE();
+
+    PEPROCESS       protected_process = NULL;
+    PACTIVE_SESSION session           = GetActiveSession();
+
     DEBUG_VERBOSE("Detecting threads attached to our process...");
+
+    /* the session and attach locks are never held together */
+    SessionGetProcess(&protected_process);
+
+    if (!protected_process)
+        return;
+
+    ImpKeAcquireGuardedMutex(&session->attach_lock);
+
+    AttachTrackerBeginRound(&session->attach_tracker, KeQueryInterruptTime());
     EnumerateThreadListWithCallbackRoutine(DetectAttachedThreadsProcessCallback,
-                                           NULL);
+                                           protected_process);
+    AttachTrackerEndRound(&session->attach_tracker);
+
+    ImpKeReleaseGuardedMutex(&session->attach_lock);
 }
@@ -6,8 +6,29 @@
 #include "common.h"
 #include "callbacks.h"
 
+#include "../core/cidtable.h"
+
+NTSTATUS
+SnapshotPspCidTable(_Out_ PCID_TABLE_WALK Walk);
+
+VOID
+SeedThreadListFromPspCidTable();
+
+VOID
+FreePspCidTableSnapshot(_Inout_ PCID_TABLE_WALK Walk);
+
 BOOLEAN
-ValidateThreadsPspCidTableEntry(_In_ PETHREAD Thread);
+ValidateThreadsPspCidTableEntry(_In_ PCID_TABLE_WALK Snapshot,
+                                _In_ PETHREAD        Thread);
+
+VOID
+ValidateThreadListPspCidTableEntries(_In_ PCID_TABLE_WALK Snapshot);
+
+VOID
+AuditSystemThreadStartAddresses(_In_ PSYSTEM_MODULES SystemModules);
+
+VOID
+ResetAttachedThreadTracker();
 
 VOID
 DetectThreadsAttachedToProtectedProcess();
@@ -0,0 +1,28 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "pe_fixtures.h"
+
+/* writes the seed corpus for ac_pe_fuzzer into the given directory */
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: ac_pe_corpus <directory>\n");
+    return 1;
+  }
+
+  std::filesystem::path directory(argv[1]);
+  std::filesystem::create_directories(directory);
+
+  for (const fuzz::pe_fixture &fixture : fuzz::make_pe_fixtures()) {
+    std::ofstream file(directory / (fixture.name + ".bin"), std::ios::binary);
+    file.write(reinterpret_cast<const char *>(fixture.image.data()),
+               fixture.image.size());
+    if (!file) {
+      fprintf(stderr, "failed to write %s\n", fixture.name.c_str());
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,374 @@
+#include "pe_fixtures.h"
+
+#include <cstring>
+#include <functional>
+
+#include "../core/pe.h"
+
+static constexpr uint32_t SECTION_ALIGNMENT = 0x1000;
+static constexpr uint32_t NT_HEADER_OFFSET = 0xf8;
+
+static uint32_t align_section(uint32_t size) {
+  return (size + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+const char *const fuzz::fixture_exports[] = {
+    "ExAllocatePool2",
+    "ExFreePoolWithTag",
+    "IoCreateDevice",
+    "KeBugCheckEx",
+    "MmCopyMemory",
+    "MmIsAddressValid",
+    "ObDereferenceObject",
+    "PsLookupProcessByProcessId",
+    "RtlInitUnicodeString",
+    "ZwQuerySystemInformation"};
+const size_t fuzz::fixture_export_count =
+    sizeof(fuzz::fixture_exports) / sizeof(fuzz::fixture_exports[0]);
+
+namespace {
+
+struct section_layout {
+  const char *name;
+  uint32_t size;
+  uint32_t characteristics;
+};
+
+/* fills a section with something resembling code or data, never zero */
+void fill_section(uint8_t *data, uint32_t size, uint32_t seed) {
+  for (uint32_t index = 0; index < size; index++)
+    data[index] = static_cast<uint8_t>((index * 31 + seed * 7) | 1);
+}
+
+/*
+ * Writes an export directory and its tables at offset, which is the rva of
+ * the space left for it in .rdata. Functions point into the first section.
+ */
+void write_exports(std::vector<uint8_t> &image, uint32_t offset,
+                   uint32_t function_base) {
+  uint32_t count = static_cast<uint32_t>(fuzz::fixture_export_count);
+  uint32_t functions = offset + sizeof(IMAGE_EXPORT_DIRECTORY);
+  uint32_t names = functions + count * sizeof(UINT32);
+  uint32_t ordinals = names + count * sizeof(UINT32);
+  uint32_t strings = ordinals + count * sizeof(UINT16);
+
+  IMAGE_EXPORT_DIRECTORY directory = {};
+  directory.Base = 1;
+  directory.NumberOfFunctions = count;
+  directory.NumberOfNames = count;
+  directory.AddressOfFunctions = functions;
+  directory.AddressOfNames = names;
+  directory.AddressOfNameOrdinals = ordinals;
+  memcpy(&image[offset], &directory, sizeof(directory));
+
+  for (uint32_t index = 0; index < count; index++) {
+    const char *name = fuzz::fixture_exports[index];
+    UINT32 function = function_base + index * 0x10;
+    UINT16 ordinal = static_cast<UINT16>(index);
+
+    memcpy(&image[functions + index * sizeof(UINT32)], &function,
+           sizeof(function));
+    memcpy(&image[names + index * sizeof(UINT32)], &strings, sizeof(strings));
+    memcpy(&image[ordinals + index * sizeof(UINT16)], &ordinal,
+           sizeof(ordinal));
+    memcpy(&image[strings], name, strlen(name) + 1);
+    strings += static_cast<uint32_t>(strlen(name) + 1);
+  }
+}
+
+/*
+ * Builds an image with raw data laid out at the same offsets as the virtual
+ * addresses, so it is valid whether treated as a file or a mapped image. The
+ * export directory, if any, lives at the start of the section named .rdata.
+ */
+std::vector<uint8_t> build_image(bool is_64bit,
+                                 const std::vector<section_layout> &sections,
+                                 bool with_exports) {
+  uint32_t optional_size = is_64bit ? sizeof(IMAGE_OPTIONAL_HEADER64)
+                                    : sizeof(IMAGE_OPTIONAL_HEADER32);
+  uint32_t image_size = SECTION_ALIGNMENT;
+  for (const section_layout &section : sections)
+    image_size += align_section(section.size);
+
+  std::vector<uint8_t> image(image_size);
+
+  IMAGE_DOS_HEADER *dos = reinterpret_cast<IMAGE_DOS_HEADER *>(image.data());
+  dos->e_magic = PE_DOS_SIGNATURE;
+  dos->e_lfanew = NT_HEADER_OFFSET;
+
+  LOCAL_NT_HEADER *nt =
+      reinterpret_cast<LOCAL_NT_HEADER *>(&image[NT_HEADER_OFFSET]);
+  nt->Signature = PE_NT_SIGNATURE;
+  nt->FileHeader.Machine = is_64bit ? 0x8664 : 0x14c;
+  nt->FileHeader.NumberOfSections = static_cast<UINT16>(sections.size());
+  nt->FileHeader.SizeOfOptionalHeader = static_cast<UINT16>(optional_size);
+  nt->FileHeader.Characteristics = is_64bit ? 0x22 : 0x2102;
+
+  IMAGE_DATA_DIRECTORY *directories = nullptr;
+  if (is_64bit) {
+    IMAGE_OPTIONAL_HEADER64 *optional =
+        reinterpret_cast<IMAGE_OPTIONAL_HEADER64 *>(&nt->OptionalHeader);
+    optional->Magic = PE_OPTIONAL_HEADER64_MAGIC;
+    optional->ImageBase = 0x140000000;
+    optional->SectionAlignment = SECTION_ALIGNMENT;
+    optional->FileAlignment = SECTION_ALIGNMENT;
+    optional->SizeOfImage = image_size;
+    optional->SizeOfHeaders = SECTION_ALIGNMENT;
+    optional->Subsystem = 1;
+    optional->NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    directories = optional->DataDirectory;
+  } else {
+    IMAGE_OPTIONAL_HEADER32 *optional =
+        reinterpret_cast<IMAGE_OPTIONAL_HEADER32 *>(&nt->OptionalHeader);
+    optional->Magic = PE_OPTIONAL_HEADER32_MAGIC;
+    optional->ImageBase = 0x10000000;
+    optional->SectionAlignment = SECTION_ALIGNMENT;
+    optional->FileAlignment = SECTION_ALIGNMENT;
+    optional->SizeOfImage = image_size;
+    optional->SizeOfHeaders = SECTION_ALIGNMENT;
+    optional->Subsystem = 2;
+    optional->NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    directories = optional->DataDirectory;
+  }
+
+  IMAGE_SECTION_HEADER *header = PeGetFirstSection(nt);
+  uint32_t address = SECTION_ALIGNMENT;
+  uint32_t seed = 0;
+
+  for (const section_layout &section : sections) {
+    strncpy(reinterpret_cast<char *>(header->Name), section.name,
+            IMAGE_SIZEOF_SHORT_NAME);
+    header->VirtualAddress = address;
+    header->Misc.VirtualSize = section.size;
+    header->PointerToRawData = address;
+    header->SizeOfRawData = section.size;
+    header->Characteristics = section.characteristics;
+    fill_section(&image[address], section.size, seed++);
+
+    if (with_exports && !strcmp(section.name, ".rdata")) {
+      memset(&image[address], 0, section.size);
+      write_exports(image, address, SECTION_ALIGNMENT);
+      directories[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress = address;
+      directories[IMAGE_DIRECTORY_ENTRY_EXPORT].Size = section.size;
+    }
+
+    address += align_section(section.size);
+    header++;
+  }
+
+  return image;
+}
+
+constexpr uint32_t CODE = IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_EXECUTE | 0x20;
+constexpr uint32_t RDATA = IMAGE_SCN_MEM_READ | 0x40;
+constexpr uint32_t DATA = IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE | 0x40;
+/* IMAGE_SCN_MEM_DISCARDABLE */
+constexpr uint32_t DISCARDABLE = 0x02000000;
+
+std::vector<uint8_t> make_driver64() {
+  return build_image(true,
+                     {{".text", 0x2400, CODE},
+                      {".rdata", 0x800, RDATA},
+                      {".data", 0x200, DATA},
+                      {".pdata", 0x180, RDATA},
+                      {"PAGE", 0x1200, CODE},
+                      {"INIT", 0x600, CODE | DISCARDABLE},
+                      {".reloc", 0x40, RDATA | DISCARDABLE}},
+                     true);
+}
+
+std::vector<uint8_t> make_dll32() {
+  return build_image(false,
+                     {{".text", 0x1800, CODE},
+                      {".rdata", 0x600, RDATA},
+                      {".data", 0x100, DATA},
+                      {".reloc", 0x80, RDATA | DISCARDABLE}},
+                     true);
+}
+
+LOCAL_NT_HEADER *nt_header(std::vector<uint8_t> &image) {
+  return reinterpret_cast<LOCAL_NT_HEADER *>(&image[NT_HEADER_OFFSET]);
+}
+
+IMAGE_OPTIONAL_HEADER64 *optional_header(std::vector<uint8_t> &image) {
+  return reinterpret_cast<IMAGE_OPTIONAL_HEADER64 *>(
+      &nt_header(image)->OptionalHeader);
+}
+
+IMAGE_SECTION_HEADER *section_header(std::vector<uint8_t> &image,
+                                     uint32_t index) {
+  return PeGetFirstSection(nt_header(image)) + index;
+}
+
+IMAGE_EXPORT_DIRECTORY *export_directory(std::vector<uint8_t> &image) {
+  return reinterpret_cast<IMAGE_EXPORT_DIRECTORY *>(
+      &image[optional_header(image)
+                 ->DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]
+                 .VirtualAddress]);
+}
+
+struct mutation {
+  const char *name;
+  std::function<void(std::vector<uint8_t> &)> apply;
+};
+
+const std::vector<mutation> mutations = {
+    {"bad_dos_signature",
+     [](auto &image) { image[0] = 'X'; }},
+    {"bad_nt_signature",
+     [](auto &image) { nt_header(image)->Signature = 0x00004551; }},
+    {"negative_lfanew",
+     [](auto &image) {
+       reinterpret_cast<IMAGE_DOS_HEADER *>(image.data())->e_lfanew =
+           -0x1000;
+     }},
+    {"lfanew_past_end",
+     [](auto &image) {
+       reinterpret_cast<IMAGE_DOS_HEADER *>(image.data())->e_lfanew =
+           static_cast<LONG>(image.size() + 0x100);
+     }},
+    {"lfanew_at_end",
+     [](auto &image) {
+       reinterpret_cast<IMAGE_DOS_HEADER *>(image.data())->e_lfanew =
+           static_cast<LONG>(image.size() - 4);
+       memcpy(&image[image.size() - 4], "PE\0\0", 4);
+     }},
+    {"max_sections",
+     [](auto &image) {
+       nt_header(image)->FileHeader.NumberOfSections = 0xffff;
+     }},
+    {"no_sections",
+     [](auto &image) { nt_header(image)->FileHeader.NumberOfSections = 0; }},
+    {"max_optional_header",
+     [](auto &image) {
+       nt_header(image)->FileHeader.SizeOfOptionalHeader = 0xffff;
+     }},
+    {"empty_optional_header",
+     [](auto &image) {
+       nt_header(image)->FileHeader.SizeOfOptionalHeader = 0;
+     }},
+    {"short_optional_header",
+     [](auto &image) {
+       nt_header(image)->FileHeader.SizeOfOptionalHeader =
+           FIELD_OFFSET(IMAGE_OPTIONAL_HEADER64, DataDirectory) + 4;
+     }},
+    {"max_raw_size",
+     [](auto &image) { section_header(image, 0)->SizeOfRawData = 0xffffffff; }},
+    {"raw_data_wraps",
+     [](auto &image) {
+       section_header(image, 0)->PointerToRawData = 0xfffff000;
+       section_header(image, 0)->SizeOfRawData = 0x2000;
+     }},
+    {"raw_data_past_end",
+     [](auto &image) {
+       section_header(image, 4)->PointerToRawData =
+           static_cast<UINT32>(image.size() - 0x100);
+     }},
+    {"max_data_directories",
+     [](auto &image) {
+       optional_header(image)->NumberOfRvaAndSizes = 0xffffffff;
+     }},
+    {"no_data_directories",
+     [](auto &image) { optional_header(image)->NumberOfRvaAndSizes = 0; }},
+    {"export_directory_past_end",
+     [](auto &image) {
+       optional_header(image)
+           ->DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]
+           .VirtualAddress = static_cast<UINT32>(image.size() + 0x1000);
+     }},
+    {"export_directory_at_end",
+     [](auto &image) {
+       optional_header(image)
+           ->DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]
+           .VirtualAddress = static_cast<UINT32>(image.size() - 8);
+     }},
+    {"max_export_names",
+     [](auto &image) { export_directory(image)->NumberOfNames = 0x7fffffff; }},
+    {"export_names_past_end",
+     [](auto &image) {
+       export_directory(image)->AddressOfNames = 0xfffffff0;
+     }},
+    {"export_ordinal_out_of_range",
+     [](auto &image) {
+       IMAGE_EXPORT_DIRECTORY *directory = export_directory(image);
+       for (uint32_t index = 0; index < directory->NumberOfNames; index++) {
+         UINT16 ordinal = 0xffff;
+         memcpy(&image[directory->AddressOfNameOrdinals +
+                       index * sizeof(UINT16)],
+                &ordinal, sizeof(ordinal));
+       }
+     }},
+    {"export_function_past_end",
+     [](auto &image) {
+       IMAGE_EXPORT_DIRECTORY *directory = export_directory(image);
+       for (uint32_t index = 0; index < directory->NumberOfFunctions;
+            index++) {
+         UINT32 function = 0xfffffff0;
+         memcpy(&image[directory->AddressOfFunctions + index * sizeof(UINT32)],
+                &function, sizeof(function));
+       }
+     }},
+    {"export_name_past_end",
+     [](auto &image) {
+       IMAGE_EXPORT_DIRECTORY *directory = export_directory(image);
+       UINT32 name = static_cast<UINT32>(image.size() + 0x10);
+       memcpy(&image[directory->AddressOfNames], &name, sizeof(name));
+     }},
+    {"export_name_unterminated",
+     [](auto &image) {
+       /* the last bytes of the image become a name with no terminator */
+       IMAGE_EXPORT_DIRECTORY *directory = export_directory(image);
+       UINT32 name = static_cast<UINT32>(image.size() - 16);
+       memset(&image[name], 'A', 16);
+       memcpy(&image[directory->AddressOfNames], &name, sizeof(name));
+     }},
+    {"truncated_dos_header",
+     [](auto &image) { image.resize(0x20); }},
+    {"truncated_nt_header",
+     [](auto &image) { image.resize(NT_HEADER_OFFSET + 0x10); }},
+    {"truncated_section_table",
+     [](auto &image) {
+       image.resize(reinterpret_cast<uint8_t *>(section_header(image, 2)) -
+                    image.data());
+     }},
+    {"truncated_sections",
+     [](auto &image) { image.resize(image.size() / 2); }},
+    {"magic_only_optional_header",
+     [](auto &image) {
+       /*
+        * The nt header moves up against the dos header and the image ends
+        * right after the optional header's Magic, so NumberOfRvaAndSizes
+        * lies past the end of the buffer.
+        */
+       constexpr uint32_t offset = sizeof(IMAGE_DOS_HEADER);
+       constexpr uint32_t size =
+           FIELD_OFFSET(LOCAL_NT_HEADER, OptionalHeader) + sizeof(UINT16);
+       memmove(&image[offset], nt_header(image), size);
+       reinterpret_cast<IMAGE_DOS_HEADER *>(image.data())->e_lfanew = offset;
+       image.resize(offset + size);
+       LOCAL_NT_HEADER *nt =
+           reinterpret_cast<LOCAL_NT_HEADER *>(&image[offset]);
+       nt->FileHeader.NumberOfSections = 0;
+       nt->FileHeader.SizeOfOptionalHeader = sizeof(UINT16);
+     }},
+};
+
+} // namespace
+
+std::vector<fuzz::pe_fixture> fuzz::make_pe_fixtures() {
+  std::vector<pe_fixture> fixtures;
+  std::vector<uint8_t> driver64 = make_driver64();
+
+  fixtures.push_back({"driver64", driver64});
+  fixtures.push_back({"dll32", make_dll32()});
+  fixtures.push_back(
+      {"minimal64", build_image(true, {{".text", 0x100, CODE}}, false)});
+
+  for (const mutation &entry : mutations) {
+    std::vector<uint8_t> image = driver64;
+    entry.apply(image);
+    fixtures.push_back({std::string("driver64_") + entry.name, image});
+  }
+
+  return fixtures;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fuzz {
+
+struct pe_fixture {
+  std::string name;
+  std::vector<uint8_t> image;
+};
+
+/*
+ * Exports planted in the well formed fixtures. The harness looks these up so
+ * the export walk is exercised past the name comparison.
+ */
+extern const char *const fixture_exports[];
+extern const size_t fixture_export_count;
+
+/*
+ * Seed corpus for the PE parsing fuzzer. The base fixtures follow the layout
+ * the msvc linker produces for drivers and dlls (64 and 32 bit, with an export
+ * table in .rdata and PAGE / INIT sections). Every other fixture is one of
+ * those with a single header field corrupted in a way that previously sent
+ * the parser out of bounds: e_lfanew, NumberOfSections, SizeOfOptionalHeader,
+ * raw data ranges, data directory counts and export table offsets, plus
+ * images truncated part way through their headers.
+ */
+std::vector<pe_fixture> make_pe_fixtures();
+
+} // namespace fuzz
@@ -0,0 +1,44 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "pe_fixtures.h"
+
+#include "../core/pe.h"
+
+/*
+ * Treats the input as a mapped image and runs it through everything the
+ * driver does with untrusted images: the header walk, export lookups as done
+ * by ImpResolveNtImport and the section copy done by the integrity checks.
+ * The output buffer is sized the same way StoreModuleExecutableRegionsInBuffer
+ * sizes it, from the image size.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  PVOID image = const_cast<uint8_t *>(data);
+  PE_VIEW view = {};
+  UINT32 sink = 0;
+
+  if (NT_SUCCESS(PeViewInitialise(&view, image, size))) {
+    for (UINT32 index = 0; index < view.section_count; index++)
+      sink += view.sections[index].Characteristics;
+
+    for (UINT32 index = 0; index < IMAGE_NUMBEROF_DIRECTORY_ENTRIES; index++) {
+      PIMAGE_DATA_DIRECTORY directory = PeViewGetDataDirectory(&view, index);
+      if (directory)
+        sink += directory->Size;
+    }
+  }
+
+  *static_cast<volatile UINT32 *>(&sink) = sink;
+
+  for (size_t index = 0; index < fuzz::fixture_export_count; index++)
+    PeFindExportByName(image, size, fuzz::fixture_exports[index]);
+
+  std::vector<uint8_t> buffer(size);
+  UINT32 count = 0;
+  SIZE_T written = 0;
+  PeCopyExecutableSections(image, size, buffer.data(), buffer.size(), &count,
+                           &written);
+
+  return 0;
+}
@@ -0,0 +1,47 @@
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+/*
+ * Stand in for the libFuzzer driver when the compiler doesnt ship it. Runs
+ * the harness once over every file given, descending into directories, so the
+ * corpus can be replayed under the sanitizers on any toolchain.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void run_file(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+  /* an exactly sized heap copy, so the sanitizers catch reads past the end */
+  std::vector<uint8_t> input(data);
+  input.shrink_to_fit();
+  LLVMFuzzerTestOneInput(input.data(), input.size());
+}
+
+int main(int argc, char **argv) {
+  size_t count = 0;
+
+  for (int index = 1; index < argc; index++) {
+    std::filesystem::path path(argv[index]);
+
+    if (std::filesystem::is_directory(path)) {
+      for (const auto &entry :
+           std::filesystem::recursive_directory_iterator(path)) {
+        if (entry.is_regular_file()) {
+          run_file(entry.path());
+          count++;
+        }
+      }
+    } else {
+      run_file(path);
+      count++;
+    }
+  }
+
+  printf("ran %zu inputs\n", count);
+  return 0;
+}
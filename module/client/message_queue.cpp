@@ -2,28 +2,298 @@
 
 #include <Windows.h>
 
+#include "../../core/heartbeat.h"
+#include "../../core/report.h"
+
 #define TEST_STEAM_64_ID 123456789;
 
-client::message_queue::message_queue(LPTSTR PipeName) {
+client::message_queue::message_queue(LPTSTR PipeName)
+    : drain_pending(false), stopping(false), spool_connection(0) {
 #if NO_SERVER
   LOG_INFO("No_Server build used. Not opening named pipe.");
 #else
   this->pipe_interface = std::make_unique<client::pipe>(PipeName);
+  this->initiate_spool();
+  this->initiate_dictionary();
+
+  /* whatever was recovered from the spool goes out straight away */
+  if (this->report_spool) {
+    this->drain_pending = true;
+    this->drain_thread = std::thread(&message_queue::run_drain, this);
+  }
+
+  this->command_thread = std::thread(&message_queue::run_commands, this);
 #endif
 }
 
-void client::message_queue::dequeue_message(void *Buffer, size_t Size) {
+client::message_queue::~message_queue() {
+  {
+    std::lock_guard<std::mutex> lock(this->lock);
+    this->stopping = true;
+  }
+
+  this->drain_wake.notify_one();
+  this->command_wake.notify_one();
+
+  if (this->pipe_interface)
+    this->pipe_interface->cancel_reads();
+  if (this->command_thread.joinable())
+    this->command_thread.join();
+  if (this->drain_thread.joinable())
+    this->drain_thread.join();
+}
+
+void client::message_queue::initiate_spool() {
+  wchar_t path[MAX_PATH] = {0};
+  if (!GetEnvironmentVariableW(SPOOL_PATH_VARIABLE, path, MAX_PATH))
+    return;
+  this->report_spool = std::make_unique<client::spool>(path);
+  if (!this->report_spool->is_open()) {
+    this->report_spool.reset();
+    return;
+  }
+  LOG_INFO("Spooling reports to %ls", path);
+}
+
+void client::message_queue::initiate_dictionary() {
+  wchar_t path[MAX_PATH] = {0};
+  LARGE_INTEGER size = {0};
+  DWORD read = 0;
+
+  if (!GetEnvironmentVariableW(DICTIONARY_PATH_VARIABLE, path, MAX_PATH))
+    return;
+
+  HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    LOG_ERROR("CreateFileW failed with status %x", GetLastError());
+    return;
+  }
+
+  if (!GetFileSizeEx(file, &size) || size.HighPart) {
+    CloseHandle(file);
+    return;
+  }
+
+  this->dictionary_data.resize(size.LowPart);
+  BOOL result = ReadFile(file, this->dictionary_data.data(), size.LowPart,
+                         &read, NULL);
+  CloseHandle(file);
+
+  if (!result || read != size.LowPart)
+    return;
+
+  auto dictionary = std::make_unique<REPORT_DICTIONARY>();
+  if (!NT_SUCCESS(ReportDictionaryLoad(dictionary.get(),
+                                       this->dictionary_data.data(),
+                                       this->dictionary_data.size()))) {
+    LOG_ERROR("%ls is not a report dictionary", path);
+    this->dictionary_data.clear();
+    return;
+  }
+
+  this->report_dictionary = std::move(dictionary);
+  LOG_INFO("Packing reports against dictionary %x",
+           this->report_dictionary->id);
+}
+
+void client::message_queue::set_command_handler(
+    std::function<void(const SERVER_COMMAND &)> handler) {
+  std::lock_guard<std::mutex> lock(this->command_lock);
+  this->command_handler = std::move(handler);
+}
+
+/*
+ * Hands every command in Buffer to the handler and skips the responses in
+ * between, returning how much of the end of Buffer is a command or field
+ * that hasnt been read in full yet.
+ */
+size_t client::message_queue::handle_commands(byte *Buffer, size_t Size) {
+  SERVER_COMMAND command = {0};
+  size_t offset = 0;
+
+  while (Size - offset >= sizeof(unsigned int)) {
+    memcpy(&command.magic, Buffer + offset, sizeof(command.magic));
+
+    if (command.magic != SERVER_COMMAND_MAGIC) {
+      offset += sizeof(unsigned int);
+      continue;
+    }
+
+    if (Size - offset < sizeof(command))
+      break;
+
+    memcpy(&command, Buffer + offset, sizeof(command));
+    offset += sizeof(command);
+
+    std::lock_guard<std::mutex> lock(this->command_lock);
+    if (this->command_handler)
+      this->command_handler(command);
+  }
+
+  return Size - offset;
+}
+
+/*
+ * Reads what the server sends back for as long as the queue lives. Nothing
+ * else reads the pipe, so this also keeps the responses to reports from
+ * filling it up and blocking the service's writes.
+ */
+void client::message_queue::run_commands() {
+  byte buffer[SEND_BUFFER_SIZE];
+  size_t pending = 0;
+
+  while (true) {
+    size_t size =
+        this->pipe_interface->read_pipe(buffer + pending,
+                                        sizeof(buffer) - pending);
+
+    std::unique_lock<std::mutex> lock(this->lock);
+
+    /* not connected, or the connection went, a partial field went with it */
+    if (!size) {
+      pending = 0;
+      this->command_wake.wait_for(
+          lock, std::chrono::milliseconds(PIPE_READ_RETRY_INTERVAL_MS),
+          [this] { return this->stopping; });
+    }
+
+    if (this->stopping)
+      return;
+
+    lock.unlock();
+
+    size_t left = this->handle_commands(buffer, pending + size);
+    memmove(buffer, buffer + pending + size - left, left);
+    pending = left;
+  }
+}
+
+/*
+ * Sends what is in the spool over the current connection. A record the last
+ * drain got partly out is carried on from where it stopped if that was this
+ * connection, and sent again whole down a new one.
+ */
+bool client::message_queue::drain_spool() {
+  unsigned long connection = this->pipe_interface->connect();
+
+  if (!connection)
+    return false;
+
+  if (connection != this->spool_connection) {
+    this->report_spool->restart_record();
+    this->spool_connection = connection;
+  }
+
+  return this->report_spool->drain(
+      [this, connection](void *record, unsigned long size) {
+        return static_cast<unsigned long>(
+            this->pipe_interface->write_pipe(record, size, connection));
+      });
+}
+
+/*
+ * Drains whenever a report is appended. Once a drain fails the next waits out
+ * the retry interval however many reports arrive meanwhile, rather than
+ * trying to reopen the pipe for each of them.
+ */
+void client::message_queue::run_drain() {
+  bool delivered = true;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(this->lock);
+
+      if (delivered)
+        this->drain_wake.wait(lock, [this] {
+          return this->drain_pending || this->stopping;
+        });
+      else
+        this->drain_wake.wait_for(
+            lock, std::chrono::milliseconds(SPOOL_RETRY_INTERVAL_MS),
+            [this] { return this->stopping; });
+
+      if (this->stopping)
+        return;
+
+      this->drain_pending = false;
+    }
+
+    delivered = this->drain_spool();
+  }
+}
+
+/*
+ * Frames the report, packed against the dictionary if it can be. With a
+ * spool it is only appended there and the drain thread woken, the caller is
+ * a completion port thread and shouldnt wait on the pipe. Reports queued
+ * while the pipe was down go out in order ahead of the new one once it is
+ * back.
+ */
+void client::message_queue::enqueue_message(void *Buffer, size_t Size) {
 #if NO_SERVER
   return;
 #else
-  this->pipe_interface->read_pipe(Buffer, Size);
+  MESSAGE_PACKET_HEADER header = {0};
+
+  /* trace drains share the completion port but are not uplinked */
+  if (!ReportIsValid(Buffer, static_cast<UINT32>(Size)) ||
+      Size > sizeof(this->report_buffer) - sizeof(header))
+    return;
+
+  header.message_type = MESSAGE_TYPE_CLIENT_PACKED_REPORT;
+  header.steam64_id = TEST_STEAM_64_ID;
+
+  std::lock_guard<std::mutex> lock(this->lock);
+  size_t length = ReportPackMessage(
+      this->report_dictionary.get(), Buffer, static_cast<UINT32>(Size),
+      this->report_buffer + sizeof(header),
+      sizeof(this->report_buffer) - sizeof(header));
+
+  /* too large to pack, sent as it is */
+  if (!length) {
+    header.message_type = MESSAGE_TYPE_CLIENT_REPORT;
+    memcpy(this->report_buffer + sizeof(header), Buffer, Size);
+    length = Size;
+  }
+
+  memcpy(this->report_buffer, &header, sizeof(header));
+  length += sizeof(header);
+
+  if (!this->report_spool) {
+    this->pipe_interface->write_pipe(this->report_buffer, length);
+    return;
+  }
+
+  if (!this->report_spool->append(this->report_buffer,
+                                  static_cast<unsigned long>(length)))
+    return;
+
+  this->drain_pending = true;
+  this->drain_wake.notify_one();
 #endif
 }
 
-void client::message_queue::enqueue_message(void *Buffer, size_t Size) {
+/*
+ * Heartbeats go straight to the pipe and are never spooled, one delivered
+ * late proves nothing and the server would count it as late anyway.
+ */
+void client::message_queue::enqueue_heartbeat(void *Buffer, size_t Size) {
 #if NO_SERVER
   return;
 #else
-  return;
+  MESSAGE_PACKET_HEADER header = {0};
+  byte packet[sizeof(header) + sizeof(HEARTBEAT_PACKET)];
+
+  if (Size != sizeof(HEARTBEAT_PACKET))
+    return;
+
+  header.message_type = MESSAGE_TYPE_CLIENT_HEARTBEAT;
+  header.steam64_id = TEST_STEAM_64_ID;
+
+  memcpy(packet, &header, sizeof(header));
+  memcpy(packet + sizeof(header), Buffer, Size);
+
+  this->pipe_interface->write_pipe(packet, sizeof(packet));
 #endif
 }
@@ -1,25 +1,47 @@
-#ifndef REPORT_H
-#define REPORT_H
+#ifndef MESSAGE_QUEUE_H
+#define MESSAGE_QUEUE_H
 
 #include <Windows.h>
 
+#include <condition_variable>
+#include <thread>
+
 #include "../dispatcher/threadpool.h"
 
 #include "../common.h"
 
 #include "pipe.h"
+#include "spool.h"
+
+#include "../../core/message.h"
+#include "../../core/reportpack.h"
 
 #define REPORT_BUFFER_SIZE 8192
 #define SEND_BUFFER_SIZE 8192
 
 #define MAX_SIGNATURE_SIZE 256
 
-#define MESSAGE_TYPE_CLIENT_REPORT 1
-#define MESSAGE_TYPE_CLIENT_SEND 2
-#define MESSAGE_TYPE_CLIENT_REQUEST 3
-
 namespace client {
 
+/*
+ * Sent by the server down the pipe, interleaved with the responses to what
+ * the module sent, to have a check run straight away. check is the index of
+ * the kernel job the dispatcher issues. Everything the server writes is made
+ * of 32 bit fields, so the reader finds commands by their magic.
+ */
+#define SERVER_COMMAND_MAGIC 0x646d6341 /* Acmd */
+
+struct SERVER_COMMAND {
+  unsigned int magic;
+  unsigned int check;
+};
+
+/*
+ * When set, reports are packed against the dictionary in the file it names,
+ * see core/reportpack.h. Without one they are still packed, against zeroes.
+ */
+static constexpr wchar_t DICTIONARY_PATH_VARIABLE[] = L"DONNA_AC_DICTIONARY";
+
 class message_queue {
   struct MESSAGE_PACKET_HEADER {
     int message_type;
@@ -28,14 +50,43 @@ class message_queue {
   };
 
   std::unique_ptr<client::pipe> pipe_interface;
+  std::unique_ptr<client::spool> report_spool;
   std::mutex lock;
 
+  /* reports are appended to the spool and sent from a thread of its own */
+  std::thread drain_thread;
+  std::condition_variable drain_wake;
+  bool drain_pending;
+  bool stopping;
+  unsigned long spool_connection;
+
+  std::thread command_thread;
+  std::condition_variable command_wake;
+  std::mutex command_lock;
+  std::function<void(const SERVER_COMMAND &)> command_handler;
+
+  /* the dictionary points into dictionary_data */
+  std::vector<byte> dictionary_data;
+  std::unique_ptr<REPORT_DICTIONARY> report_dictionary;
+
   byte report_buffer[REPORT_BUFFER_SIZE];
 
+  void initiate_spool();
+  void initiate_dictionary();
+  void run_drain();
+  bool drain_spool();
+  void run_commands();
+  size_t handle_commands(byte *Buffer, size_t Size);
+
 public:
   message_queue(LPTSTR PipeName);
+  ~message_queue();
   void enqueue_message(void *Buffer, size_t Size);
-  void dequeue_message(void *Buffer, size_t Size);
+  void enqueue_heartbeat(void *Buffer, size_t Size);
+
+  /* called on the reader thread for each command, nullptr to stop */
+  void set_command_handler(
+      std::function<void(const SERVER_COMMAND &)> handler);
 };
 
 } // namespace client
@@ -4,37 +4,166 @@
 
 #include <intrin.h>
 
-client::pipe::pipe(LPTSTR PipeName) {
-  this->pipe_name = PipeName;
+client::pipe::pipe(LPTSTR PipeName)
+    : pipe_handle(INVALID_HANDLE_VALUE), pipe_name(PipeName), connection(0),
+      failed_opens(0), write_io{}, read_io{}, reads_cancelled(false) {
+  this->write_io.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  this->read_io.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  this->connect();
+}
+
+client::pipe::~pipe() {
+  this->close_pipe();
+  if (this->write_io.hEvent)
+    CloseHandle(this->write_io.hEvent);
+  if (this->read_io.hEvent)
+    CloseHandle(this->read_io.hEvent);
+}
+
+bool client::pipe::open_pipe() {
+  if (this->pipe_handle != INVALID_HANDLE_VALUE)
+    return true;
+
   this->pipe_handle =
       CreateFile(this->pipe_name, GENERIC_READ | GENERIC_WRITE, 0, NULL,
                  OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
 
   if (this->pipe_handle == INVALID_HANDLE_VALUE) {
-    LOG_ERROR("CreateFile failed with status 0x%x", GetLastError());
-    return;
+    /* only log the first of a run, the server may be down for a while */
+    if (!this->failed_opens++)
+      LOG_ERROR("CreateFile failed with status 0x%x", GetLastError());
+    return false;
   }
+
+  if (this->connection)
+    LOG_INFO("Reconnected to the pipe after %lu attempts", this->failed_opens);
+
+  this->failed_opens = 0;
+  this->connection++;
+  return true;
+}
+
+/* a read pending on the handle is cancelled and fails */
+void client::pipe::close_pipe() {
+  if (this->pipe_handle == INVALID_HANDLE_VALUE)
+    return;
+
+  CancelIoEx(this->pipe_handle, NULL);
+  CloseHandle(this->pipe_handle);
+  this->pipe_handle = INVALID_HANDLE_VALUE;
 }
 
-void client::pipe::write_pipe(PVOID Buffer, SIZE_T Size) {
+SIZE_T client::pipe::write_all(PVOID Buffer, SIZE_T Size) {
+  SIZE_T written = 0;
   DWORD bytes_written = 0;
 
-  WriteFile(this->pipe_handle, Buffer, Size, &bytes_written, NULL);
+  while (written < Size) {
+    bytes_written = 0;
 
-  if (bytes_written == 0) {
-    LOG_ERROR("WriteFile failed with status code 0x%x", GetLastError());
-    return;
+    BOOL status =
+        WriteFile(this->pipe_handle, static_cast<PUCHAR>(Buffer) + written,
+                  static_cast<DWORD>(Size - written), NULL, &this->write_io);
+
+    if (!status && GetLastError() == ERROR_IO_PENDING)
+      status = TRUE;
+
+    if (!status || !GetOverlappedResult(this->pipe_handle, &this->write_io,
+                                         &bytes_written, TRUE) ||
+        !bytes_written) {
+      LOG_ERROR("WriteFile failed with status code 0x%x", GetLastError());
+      this->close_pipe();
+      break;
+    }
+
+    written += bytes_written;
   }
+
+  return written;
+}
+
+unsigned long client::pipe::connect() {
+  std::lock_guard<std::mutex> lock(this->write_lock);
+
+  if (!this->open_pipe())
+    return 0;
+
+  return this->connection;
+}
+
+bool client::pipe::write_pipe(PVOID Buffer, SIZE_T Size) {
+  std::lock_guard<std::mutex> lock(this->write_lock);
+
+  if (!this->open_pipe())
+    return false;
+
+  SIZE_T written = this->write_all(Buffer, Size);
+
+  if (written && written != Size)
+    this->close_pipe();
+
+  return written == Size;
 }
 
-void client::pipe::read_pipe(PVOID Buffer, SIZE_T Size) {
-  BOOL status = FALSE;
+SIZE_T client::pipe::write_pipe(PVOID Buffer, SIZE_T Size,
+                                unsigned long Connection) {
+  std::lock_guard<std::mutex> lock(this->write_lock);
+
+  if (this->pipe_handle == INVALID_HANDLE_VALUE ||
+      this->connection != Connection)
+    return 0;
+
+  return this->write_all(Buffer, Size);
+}
+
+/*
+ * The read is issued under the lock so cancel_reads either sees it pending
+ * or stops it being issued at all, and waited on outside it so writes carry
+ * on meanwhile. The wait is on the event rather than the handle, which a
+ * writer may close under it.
+ */
+SIZE_T client::pipe::read_pipe(PVOID Buffer, SIZE_T Size) {
   DWORD bytes_read = 0;
+  HANDLE handle = INVALID_HANDLE_VALUE;
+
+  {
+    std::lock_guard<std::mutex> lock(this->write_lock);
+
+    if (this->reads_cancelled || this->pipe_handle == INVALID_HANDLE_VALUE)
+      return 0;
 
-  status = ReadFile(this->pipe_handle, Buffer, Size, &bytes_read, NULL);
+    handle = this->pipe_handle;
+
+    if (!ReadFile(handle, Buffer, static_cast<DWORD>(Size), NULL,
+                  &this->read_io) &&
+        GetLastError() != ERROR_IO_PENDING) {
+      LOG_ERROR("ReadFile failed with status code 0x%x", GetLastError());
+      this->close_pipe();
+      return 0;
+    }
+  }
+
+  WaitForSingleObject(this->read_io.hEvent, INFINITE);
+
+  if (!GetOverlappedResult(handle, &this->read_io, &bytes_read, FALSE)) {
+    if (GetLastError() == ERROR_OPERATION_ABORTED)
+      return 0;
 
-  if (status == NULL) {
     LOG_ERROR("ReadFile failed with status code 0x%x", GetLastError());
-    return;
+
+    std::lock_guard<std::mutex> lock(this->write_lock);
+    if (this->pipe_handle == handle)
+      this->close_pipe();
+    return 0;
   }
+
+  return bytes_read;
+}
+
+void client::pipe::cancel_reads() {
+  std::lock_guard<std::mutex> lock(this->write_lock);
+
+  this->reads_cancelled = true;
+
+  if (this->pipe_handle != INVALID_HANDLE_VALUE)
+    CancelIoEx(this->pipe_handle, &this->read_io);
 }
@@ -2,23 +2,62 @@
 
 #include <Windows.h>
 
-#define MESSAGE_TYPE_CLIENT_REPORT 1
-#define MESSAGE_TYPE_CLIENT_SEND 2
-#define MESSAGE_TYPE_CLIENT_REQUEST 3
+#include <mutex>
 
 #define MOTHERBOARD_SERIAL_CODE_LENGTH 64
 #define DEVICE_DRIVE_0_SERIAL_CODE_LENGTH 64
 
 namespace client {
+
+/* how long the reader waits for the pipe to be reopened by a writer */
+static constexpr unsigned long PIPE_READ_RETRY_INTERVAL_MS = 1000;
+
+/*
+ * The pipe is reopened on the next write after any write fails, the server
+ * end going away and coming back is expected. Every open is a new connection,
+ * numbered so a writer resuming a partial write can tell whether the bytes
+ * it already wrote went down the same one.
+ */
 class pipe {
   HANDLE pipe_handle;
   LPTSTR pipe_name;
+  std::mutex write_lock;
+  unsigned long connection;
+  unsigned long failed_opens;
+
+  /* reads and writes are overlapped so a pending read doesnt hold up writes */
+  OVERLAPPED write_io;
+  OVERLAPPED read_io;
+  bool reads_cancelled;
+
+  bool open_pipe();
+  void close_pipe();
+  SIZE_T write_all(PVOID Buffer, SIZE_T Size);
 
 public:
   pipe(LPTSTR PipeName);
+  ~pipe();
+
+  /* opens the pipe if it isnt and returns the connection, 0 if it failed */
+  unsigned long connect();
+
+  /* a message written in part is lost, the pipe is closed so it resyncs */
+  bool write_pipe(PVOID Buffer, SIZE_T Size);
+
+  /*
+   * Writes as much of Buffer as it can if Connection is still the one open,
+   * returning how much that was.
+   */
+  SIZE_T write_pipe(PVOID Buffer, SIZE_T Size, unsigned long Connection);
+
+  /*
+   * Reads whatever the server sent next, from one thread at a time. Returns 0
+   * if the pipe isnt open, the read failed or reads were cancelled.
+   */
+  SIZE_T read_pipe(PVOID Buffer, SIZE_T Size);
 
-  void write_pipe(PVOID Buffer, SIZE_T Size);
-  void read_pipe(PVOID Buffer, SIZE_T Size);
+  /* makes the pending read and every one after it return 0 */
+  void cancel_reads();
 };
 
 namespace headers {
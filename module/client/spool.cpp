@@ -0,0 +1,149 @@
+#include "spool.h"
+
+#include "../common.h"
+
+/*
+ * Called with the spool lock held, once every SPOOL_CHECKPOINT_INTERVAL
+ * appends rather than for each one.
+ */
+void client::spool::flush_records(PVOID base, SIZE_T length, PVOID context) {
+  client::spool *spool = static_cast<client::spool *>(context);
+
+  if (!FlushViewOfFile(base, length) || !FlushFileBuffers(spool->file))
+    LOG_ERROR("Failed to flush spool records with status %x", GetLastError());
+}
+
+client::spool::spool(LPCWSTR path)
+    : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), state{},
+      dropped(0), sent(0) {
+  if (!this->map(path))
+    return;
+
+  SpoolSetFlushRoutine(&this->state, flush_records, this);
+
+  if (NT_SUCCESS(SpoolOpen(&this->state, this->view, SPOOL_FILE_SIZE))) {
+    LOG_INFO("Recovered spool with %llu reports, %lu after the checkpoint",
+             this->state.tail_sequence - this->state.head_sequence,
+             this->state.recovered);
+    return;
+  }
+
+  /* a new file, or one no checkpoint survived in */
+  if (!NT_SUCCESS(SpoolFormat(&this->state, this->view, SPOOL_FILE_SIZE))) {
+    LOG_ERROR("Failed to format spool");
+    UnmapViewOfFile(this->view);
+    this->view = nullptr;
+  }
+}
+
+client::spool::~spool() {
+  if (this->view) {
+    FlushViewOfFile(this->view, 0);
+    UnmapViewOfFile(this->view);
+  }
+  if (this->mapping)
+    CloseHandle(this->mapping);
+  if (this->file != INVALID_HANDLE_VALUE)
+    CloseHandle(this->file);
+}
+
+bool client::spool::map(LPCWSTR path) {
+  this->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (this->file == INVALID_HANDLE_VALUE) {
+    LOG_ERROR("Failed to open spool file with status %x", GetLastError());
+    return false;
+  }
+
+  /* extends a new file to the full size, which reads back as zeroes */
+  this->mapping = CreateFileMappingW(this->file, nullptr, PAGE_READWRITE, 0,
+                                     SPOOL_FILE_SIZE, nullptr);
+  if (!this->mapping) {
+    LOG_ERROR("CreateFileMappingW failed with status %x", GetLastError());
+    return false;
+  }
+
+  this->view = MapViewOfFile(this->mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0,
+                             0, SPOOL_FILE_SIZE);
+  if (!this->view) {
+    LOG_ERROR("MapViewOfFile failed with status %x", GetLastError());
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Writes to the view survive the process dying as they are already in the
+ * page cache, only a crash of the system itself needs them flushed. The spool
+ * does that through flush_records before a checkpoint covers them, so most
+ * appends only copy into the view.
+ */
+bool client::spool::append(void *buffer, unsigned long size) {
+  if (!this->is_open())
+    return false;
+
+  std::lock_guard<std::mutex> lock(this->lock);
+  NTSTATUS status = SpoolAppend(&this->state, buffer, size);
+  if (status == STATUS_BUFFER_TOO_SMALL) {
+    /* only log the first of a run, the server may be down for a while */
+    if (!this->dropped++)
+      LOG_ERROR("Spool is full, dropping reports until it drains");
+    return false;
+  }
+
+  return NT_SUCCESS(status);
+}
+
+bool client::spool::drain(
+    std::function<unsigned long(void *, unsigned long)> send) {
+  PVOID record = nullptr;
+  UINT32 length = 0;
+  bool released = false;
+  bool empty = false;
+
+  if (!this->is_open())
+    return true;
+
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(this->lock);
+      if (!NT_SUCCESS(SpoolPeek(&this->state, &record, &length))) {
+        if (this->state.discarded) {
+          LOG_ERROR("Spool discarded %llu reports that didnt reach the disk",
+                    this->state.discarded);
+          this->state.discarded = 0;
+        }
+        empty = true;
+        break;
+      }
+    }
+
+    this->sent += send(static_cast<PUCHAR>(record) + this->sent,
+                       length - this->sent);
+    if (this->sent < length)
+      break;
+
+    std::lock_guard<std::mutex> lock(this->lock);
+    SpoolRelease(&this->state);
+    this->sent = 0;
+    released = true;
+  }
+
+  if (!released)
+    return empty;
+
+  /* the checkpoints only cover flushed records, the header can go any time */
+  if (!FlushViewOfFile(this->view, SPOOL_DATA_OFFSET) ||
+      !FlushFileBuffers(this->file))
+    LOG_ERROR("Failed to flush spool header with status %x", GetLastError());
+
+  std::lock_guard<std::mutex> lock(this->lock);
+  if (this->dropped) {
+    LOG_INFO("Spool draining, %llu reports were dropped while full",
+             this->dropped);
+    this->dropped = 0;
+  }
+
+  return empty;
+}
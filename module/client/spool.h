@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <functional>
+#include <mutex>
+
+#include "../../core/spool.h"
+
+namespace client {
+
+/*
+ * When set, reports are appended to a spool in the file it names before they
+ * are written to the pipe and only dropped once the write succeeds, so they
+ * survive the server being down and the module being restarted. See
+ * core/spool.h for the format.
+ */
+static constexpr wchar_t SPOOL_PATH_VARIABLE[] = L"DONNA_AC_SPOOL";
+static constexpr unsigned long SPOOL_FILE_SIZE = 0x400000;
+
+/* how long a drain that couldnt reach the server waits before trying again */
+static constexpr unsigned long SPOOL_RETRY_INTERVAL_MS = 1000;
+
+/*
+ * Appends and drains may run on different threads, a drain from one thread
+ * at a time. The lock is only held to update the spool, not while a record is
+ * sent, appends never write over a record that hasnt been released.
+ */
+class spool {
+  HANDLE file;
+  HANDLE mapping;
+  void *view;
+  SPOOL state;
+  unsigned __int64 dropped;
+  std::mutex lock;
+
+  /* how much of the oldest record a previous drain got out */
+  unsigned long sent;
+
+  bool map(LPCWSTR path);
+
+  static void flush_records(PVOID base, SIZE_T length, PVOID context);
+
+public:
+  spool(LPCWSTR path);
+  ~spool();
+
+  bool is_open() { return this->view != nullptr; }
+  bool append(void *buffer, unsigned long size);
+
+  /*
+   * Sends records oldest first until the spool is empty, returning true, or
+   * send writes less than it was given. send returns how much it wrote and the
+   * next drain carries on from there.
+   */
+  bool drain(std::function<unsigned long(void *, unsigned long)> send);
+
+  /* the oldest record is sent again from its start by the next drain */
+  void restart_record() { this->sent = 0; }
+};
+} // namespace client
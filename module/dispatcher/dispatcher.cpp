@@ -6,10 +6,48 @@
 #include <bcrypt.h>
 #include <chrono>
 
+static CPU_TOPOLOGY get_cpu_topology() {
+  CPU_TOPOLOGY topology = {0};
+  if (!dispatcher::load_cpu_topology(topology)) {
+    LOG_ERROR("Failed to read the processor topology, threads are unplaced");
+    return topology;
+  }
+  LOG_INFO("%lu cores, %lu logical processors, efficiency classes %u to %u",
+           topology.core_count, topology.processor_count,
+           topology.lowest_class, topology.highest_class);
+  return topology;
+}
+
 dispatcher::dispatcher::dispatcher(LPCWSTR driver_name,
                                    client::message_queue &message_queue)
-    : thread_pool(DISPATCHER_THREAD_COUNT),
-      k_interface(driver_name, message_queue) {}
+    : topology(get_cpu_topology()),
+      thread_pool(DISPATCHER_THREAD_COUNT,
+                  [this]() { this->place_thread(CpuPlacementBackground); }),
+      completion_pool(COMPLETION_PORT_THREAD_COUNT,
+                      [this]() { this->place_thread(CpuPlacementLatency); }),
+      k_interface(kernel_interface::open_device(driver_name), message_queue),
+      message_queue(message_queue) {
+  this->k_interface.set_report_observer([this](UINT32 report_code) {
+    this->post_job([this, report_code]() {
+      this->follow_up_report(report_code);
+    });
+  });
+  this->message_queue.set_command_handler(
+      [this](const client::SERVER_COMMAND &command) {
+        this->post_job(
+            [this, command]() { this->run_server_command(command); });
+      });
+}
+
+/*
+ * Runs on each pool thread as it starts, the topology is loaded by then as it
+ * is declared ahead of the pools.
+ */
+void dispatcher::dispatcher::place_thread(CPU_PLACEMENT_CLASS placement_class) {
+  CPU_PLACEMENT placement = {0};
+  CpuTopologyGetPlacement(&this->topology, placement_class, &placement);
+  apply_cpu_placement(placement);
+}
 
 void dispatcher::dispatcher::request_session_pk() {
 #ifdef NO_SERVER
@@ -29,39 +67,108 @@ void dispatcher::dispatcher::write_shared_mapping_operation() {
           &operation));
 }
 
-void dispatcher::dispatcher::init_timer_callbacks() {
-  /* we want to offset when our driver routines are called */
+/*
+ * Every periodic job shares the one scheduler wait, the shared mapping and
+ * trace drain deadlines used to have a waitable timer and a thread of their
+ * own.
+ */
+void dispatcher::dispatcher::init_scheduled_jobs() {
   this->k_interface.initiate_shared_mapping();
-  std::optional<HANDLE> result = this->timers.insert_callback(
-      std::bind(&dispatcher::dispatcher::write_shared_mapping_operation, this),
-      WRITE_SHARED_MAPPING_DUE_TIME, WRITE_SHARED_MAPPING_PERIOD);
-  helper::sleep_thread(TIMER_CALLBACK_DELAY);
+  this->scheduler.schedule(
+      [this]() { this->write_shared_mapping_operation(); },
+      std::chrono::seconds(WRITE_SHARED_MAPPING_DUE_TIME),
+      std::chrono::seconds(WRITE_SHARED_MAPPING_PERIOD));
+  this->scheduler.schedule([this]() { this->k_interface.drain_trace_events(); },
+                           std::chrono::seconds(DRAIN_TRACE_EVENTS_DUE_TIME),
+                           std::chrono::seconds(DRAIN_TRACE_EVENTS_PERIOD));
+  this->scheduler.schedule(
+      [this]() {
+        thread_pool.queue_job(
+            [this]() { this->k_interface.initiate_apc_stackwalk(); });
+      },
+      std::chrono::seconds(0), std::chrono::seconds(APC_STACKWALK_PERIOD));
+  /* sent from the scheduler itself, a heartbeat queued behind a scan is late */
+  this->scheduler.schedule([this]() { this->k_interface.send_heartbeat(); },
+                           std::chrono::milliseconds(0),
+                           std::chrono::milliseconds(HEARTBEAT_INTERVAL_MS));
+}
+
+void dispatcher::dispatcher::run_io_port_thread() {
+  completion_pool.queue_job([this]() { k_interface.run_completion_port(); });
 }
 
-void dispatcher::dispatcher::run_timer_thread() {
-  thread_pool.queue_job([this]() { this->timers.run_timer_thread(); });
+void dispatcher::dispatcher::post_job(std::function<void()> job) {
+  this->scheduler.post(std::move(job));
 }
 
-void dispatcher::dispatcher::run_io_port_thread() {
-  thread_pool.queue_job([this]() { k_interface.run_completion_port(); });
+/*
+ * A thread hiding from the system thread list or attached to the game is
+ * running now, a stackwalk straight away may catch it where the periodic one
+ * wouldnt. A burst of reports only gets the one follow up.
+ */
+void dispatcher::dispatcher::follow_up_report(UINT32 report_code) {
+  scheduler::clock::time_point now = scheduler::clock::now();
+
+  switch (report_code) {
+  case REPORT_HIDDEN_SYSTEM_THREAD:
+  case REPORT_UNBACKED_SYSTEM_THREAD:
+  case REPORT_ILLEGAL_ATTACH_PROCESS:
+    break;
+  default:
+    return;
+  }
+
+  if (now - this->last_follow_up <
+      std::chrono::seconds(REPORT_FOLLOW_UP_INTERVAL))
+    return;
+
+  this->last_follow_up = now;
+  LOG_INFO("Following up report %u with a stackwalk", report_code);
+  this->queue_kernel_job(KERNEL_JOB_APC_STACKWALK);
+  this->queue_kernel_job(KERNEL_JOB_DPC_STACKWALK);
+}
+
+void dispatcher::dispatcher::run_server_command(
+    const client::SERVER_COMMAND &command) {
+  if (command.check >= KERNEL_DISPATCH_FUNCTION_COUNT) {
+    LOG_ERROR("Server requested unknown check %u", command.check);
+    return;
+  }
+  LOG_INFO("Server requested check %u", command.check);
+  this->queue_kernel_job(command.check);
+}
+
+void dispatcher::dispatcher::shutdown() { this->scheduler.shutdown(); }
+
+/*
+ * Nothing may call back into the dispatcher once it is gone. The completion
+ * port consumers are woken and joined before the scan pool finishes the jobs
+ * it was running.
+ */
+void dispatcher::dispatcher::teardown() {
+  this->message_queue.set_command_handler(nullptr);
+  this->k_interface.stop_completion_port();
+  this->completion_pool.terminate();
+  this->thread_pool.terminate();
 }
 
 void dispatcher::dispatcher::run() {
   //helper::generate_rand_seed();
   std::srand(std::time(nullptr));
-  this->init_timer_callbacks();
-  this->run_timer_thread();
-  this->run_io_port_thread();
-  thread_pool.queue_job([this]() { k_interface.run_completion_port(); });
-  while (true) {
-    //this->issue_kernel_job();
-          this->k_interface.initiate_apc_stackwalk();
-    helper::sleep_thread(DISPATCH_LOOP_SLEEP_TIME);
-  }
+  this->init_scheduled_jobs();
+  for (int index = 0; index < COMPLETION_PORT_THREAD_COUNT; index++)
+    this->run_io_port_thread();
+  this->scheduler.run();
+  this->teardown();
 }
 
 void dispatcher::dispatcher::issue_kernel_job() {
-  switch (helper::generate_rand_int(KERNEL_DISPATCH_FUNCTION_COUNT)) {
+  this->queue_kernel_job(
+      helper::generate_rand_int(KERNEL_DISPATCH_FUNCTION_COUNT));
+}
+
+void dispatcher::dispatcher::queue_kernel_job(int job) {
+  switch (job) {
   case 0:
     thread_pool.queue_job([this]() { k_interface.enumerate_handle_tables(); });
     break;
@@ -102,5 +209,13 @@ void dispatcher::dispatcher::issue_kernel_job() {
   case 11:
     thread_pool.queue_job([this]() { k_interface.validate_pci_devices(); });
     break;
+  case 12:
+    thread_pool.queue_job(
+        [this]() { k_interface.scan_process_executable_memory(); });
+    break;
+  case 13:
+    thread_pool.queue_job(
+        [this]() { k_interface.scan_kernel_executable_memory(); });
+    break;
   }
 }
\ No newline at end of file
@@ -1,33 +1,62 @@
 #pragma once
 
+#include "scheduler.h"
 #include "threadpool.h"
+#include "topology.h"
 
-#include "timer.h"
 #include "../kernel_interface/kernel_interface.h"
 
 namespace dispatcher {
 
-constexpr int DISPATCH_LOOP_SLEEP_TIME = 30;
-constexpr int KERNEL_DISPATCH_FUNCTION_COUNT = 12;
+constexpr int APC_STACKWALK_PERIOD = 30;
+constexpr int KERNEL_DISPATCH_FUNCTION_COUNT = 14;
 constexpr int DISPATCHER_THREAD_COUNT = 4;
-constexpr int TIMER_CALLBACK_DELAY = 15;
+constexpr int COMPLETION_PORT_THREAD_COUNT = 2;
 constexpr int WRITE_SHARED_MAPPING_PERIOD = 30;
 constexpr int WRITE_SHARED_MAPPING_DUE_TIME = 30;
+constexpr int DRAIN_TRACE_EVENTS_PERIOD = 5;
+constexpr int DRAIN_TRACE_EVENTS_DUE_TIME = 5;
+constexpr int REPORT_FOLLOW_UP_INTERVAL = 5;
 
+/* indices into issue_kernel_job's jobs, as sent in a server command */
+constexpr int KERNEL_JOB_APC_STACKWALK = 7;
+constexpr int KERNEL_JOB_DPC_STACKWALK = 9;
+
+/*
+ * Scans and validation run on thread_pool, placed on the efficiency cores or
+ * a few cores of their own at low priority so they dont compete with the
+ * game. The completion port threads are kept off those, reports shouldnt
+ * wait behind a scan.
+ */
 class dispatcher {
-  timer timers;
+  CPU_TOPOLOGY topology;
+  scheduler scheduler;
   thread_pool thread_pool;
+  ::dispatcher::thread_pool completion_pool;
   kernel_interface::kernel_interface k_interface;
+  client::message_queue &message_queue;
+
+  /* only touched by posted jobs, which all run on the scheduler thread */
+  scheduler::clock::time_point last_follow_up;
+
+  void place_thread(CPU_PLACEMENT_CLASS placement_class);
 
   void issue_kernel_job();
+  void queue_kernel_job(int job);
+  void follow_up_report(UINT32 report_code);
+  void run_server_command(const client::SERVER_COMMAND &command);
+  void teardown();
   void write_shared_mapping_operation();
-  void init_timer_callbacks();
-  void run_timer_thread();
+  void init_scheduled_jobs();
   void run_io_port_thread();
   void request_session_pk();
 
 public:
   dispatcher(LPCWSTR driver_name, client::message_queue &queue);
   void run();
+
+  /* runs job on the dispatcher thread as soon as it is free */
+  void post_job(std::function<void()> job);
+  void shutdown();
 };
 } // namespace dispatcher
\ No newline at end of file
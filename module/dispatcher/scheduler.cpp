@@ -0,0 +1,78 @@
+#include "scheduler.h"
+
+dispatcher::scheduler::scheduler() : next_id(0), stopping(false), stats{} {}
+
+void dispatcher::scheduler::schedule(routine callback, clock::duration due,
+                                     clock::duration period) {
+  std::lock_guard<std::mutex> lock(this->lock);
+  this->deadlines.push(
+      {clock::now() + due, period, this->next_id++, std::move(callback)});
+  /* only matters if it is now the earliest, but waking early is harmless */
+  this->wake.notify_one();
+}
+
+void dispatcher::scheduler::post(routine callback) {
+  std::lock_guard<std::mutex> lock(this->lock);
+  this->posted.push_back(std::move(callback));
+  this->wake.notify_one();
+}
+
+void dispatcher::scheduler::shutdown() {
+  std::lock_guard<std::mutex> lock(this->lock);
+  this->stopping = true;
+  this->wake.notify_all();
+}
+
+dispatcher::scheduler_stats dispatcher::scheduler::get_stats() {
+  std::lock_guard<std::mutex> lock(this->lock);
+  return this->stats;
+}
+
+/*
+ * Posted jobs go first, they are the urgent ones. A periodic job that falls
+ * behind, say the machine was suspended, runs once and is rescheduled from
+ * now rather than running once for every period it missed.
+ */
+void dispatcher::scheduler::run() {
+  std::unique_lock<std::mutex> lock(this->lock);
+
+  while (!this->stopping) {
+    if (!this->posted.empty()) {
+      routine callback = std::move(this->posted.front());
+      this->posted.pop_front();
+      this->stats.posted++;
+      lock.unlock();
+      callback();
+      lock.lock();
+      continue;
+    }
+
+    clock::time_point now = clock::now();
+
+    if (!this->deadlines.empty() && this->deadlines.top().due <= now) {
+      deadline_job job = this->deadlines.top();
+      this->deadlines.pop();
+      this->stats.deadlines++;
+
+      if (job.period != clock::duration::zero()) {
+        deadline_job next = job;
+        next.due += next.period;
+        if (next.due <= now)
+          next.due = now + next.period;
+        this->deadlines.push(std::move(next));
+      }
+
+      lock.unlock();
+      job.callback();
+      lock.lock();
+      continue;
+    }
+
+    if (this->deadlines.empty())
+      this->wake.wait(lock);
+    else
+      this->wake.wait_until(lock, this->deadlines.top().due);
+
+    this->stats.wakeups++;
+  }
+}
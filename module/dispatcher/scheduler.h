@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace dispatcher {
+
+struct scheduler_stats {
+  /* times run came back from waiting, for whatever reason */
+  uint64_t wakeups;
+  uint64_t deadlines;
+  uint64_t posted;
+};
+
+/*
+ * The dispatcher's main loop. Everything it does is either a job due at a
+ * deadline, periodic or not, or a job posted to run as soon as possible by
+ * another thread, a completion port consumer or a server command for example.
+ *
+ * run blocks on a single condition variable until the earliest deadline, a
+ * post or shutdown, so an idle module doesnt wake at all between deadlines
+ * and a posted job runs straight away rather than on the next poll. Jobs run
+ * on the thread calling run, anything long should be handed to the thread
+ * pool from there.
+ */
+class scheduler {
+public:
+  using clock = std::chrono::steady_clock;
+  using routine = std::function<void()>;
+
+private:
+  struct deadline_job {
+    clock::time_point due;
+    clock::duration period;
+    uint64_t id;
+    routine callback;
+  };
+
+  /* orders the heap earliest first, ties in the order they were scheduled */
+  struct later {
+    bool operator()(const deadline_job &left, const deadline_job &right) {
+      return left.due > right.due ||
+             (left.due == right.due && left.id > right.id);
+    }
+  };
+
+  std::mutex lock;
+  std::condition_variable wake;
+  std::priority_queue<deadline_job, std::vector<deadline_job>, later>
+      deadlines;
+  std::deque<routine> posted;
+  uint64_t next_id;
+  bool stopping;
+  scheduler_stats stats;
+
+public:
+  scheduler();
+
+  /* runs callback after due and then every period, if period isnt zero */
+  void schedule(routine callback, clock::duration due,
+                clock::duration period = clock::duration::zero());
+  void post(routine callback);
+
+  /* run returns once the job it is running, if any, has finished */
+  void shutdown();
+  void run();
+
+  scheduler_stats get_stats();
+};
+} // namespace dispatcher
@@ -5,6 +5,9 @@
  * for execution
  */
 void dispatcher::thread_pool::wait_for_task() {
+  if (this->thread_init)
+    this->thread_init();
+
   while (true) {
     std::function<void()> job;
     {
@@ -44,8 +47,10 @@ void dispatcher::thread_pool::wait_for_task() {
   }
 }
 
-dispatcher::thread_pool::thread_pool(int thread_count) {
+dispatcher::thread_pool::thread_pool(int thread_count,
+                                     std::function<void()> thread_init) {
   this->thread_count = thread_count;
+  this->thread_init = std::move(thread_init);
   this->should_terminate = false;
 
   /* Initiate our threads and store them in our threads vector */
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <condition_variable>
 #include <functional>
 #include <mutex>
 #include <queue>
+#include <thread>
 #include <vector>
 
 namespace dispatcher {
@@ -18,11 +20,13 @@ class thread_pool {
   std::condition_variable mutex_condition;
   std::vector<std::thread> threads;
   std::queue<std::function<void()>> jobs;
+  std::function<void()> thread_init;
 
   void wait_for_task();
 
 public:
-  thread_pool(int thread_count);
+  /* thread_init, if given, runs on each thread before it takes any jobs */
+  thread_pool(int thread_count, std::function<void()> thread_init = nullptr);
   void queue_job(const std::function<void()> &job);
   void terminate();
   bool busy_wait();
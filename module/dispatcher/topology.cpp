@@ -0,0 +1,147 @@
+#include "topology.h"
+
+#if defined(_WIN32)
+#include <Windows.h>
+
+#include <vector>
+#else
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#endif
+
+#if defined(_WIN32)
+
+bool dispatcher::load_cpu_topology(CPU_TOPOLOGY &topology,
+                                   const char *sysfs_devices) {
+  DWORD length = 0;
+
+  UNREFERENCED_PARAMETER(sysfs_devices);
+  CpuTopologyInitialise(&topology);
+
+  GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+  if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+    return false;
+
+  std::vector<unsigned char> buffer(length);
+  if (!GetLogicalProcessorInformationEx(
+          RelationProcessorCore,
+          reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+              buffer.data()),
+          &length))
+    return false;
+
+  for (DWORD offset = 0; offset < length;) {
+    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX entry =
+        reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+            buffer.data() + offset);
+
+    /* cores outside the first group are never placed on, see cputopo.h */
+    if (entry->Processor.GroupMask[0].Group == 0)
+      CpuTopologyAddCore(&topology, entry->Processor.GroupMask[0].Mask,
+                         entry->Processor.EfficiencyClass);
+
+    offset += entry->Size;
+  }
+
+  return topology.core_count > 0;
+}
+
+void dispatcher::apply_cpu_placement(const CPU_PLACEMENT &placement) {
+  if (placement.mask)
+    SetThreadAffinityMask(GetCurrentThread(),
+                          static_cast<DWORD_PTR>(placement.mask));
+
+  if (!placement.low_priority)
+    return;
+
+  THREAD_POWER_THROTTLING_STATE throttling = {0};
+  throttling.Version = THREAD_POWER_THROTTLING_CURRENT_VERSION;
+  throttling.ControlMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+  throttling.StateMask = THREAD_POWER_THROTTLING_EXECUTION_SPEED;
+  SetThreadInformation(GetCurrentThread(), ThreadPowerThrottling, &throttling,
+                       sizeof(throttling));
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+#else
+
+namespace {
+
+bool read_file(const std::string &path, std::string &contents) {
+  std::ifstream file(path);
+  if (!file)
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool read_list(const std::string &path, UINT64 &mask) {
+  std::string list;
+  return read_file(path, list) &&
+         NT_SUCCESS(CpuTopologyParseList(list.data(), list.size(), &mask));
+}
+
+} // namespace
+
+/*
+ * Intel hybrid parts list their efficiency cores under cpu_atom, arm ones
+ * give each cpu a capacity relative to the fastest at 1024. Anything else is
+ * a single class.
+ */
+bool dispatcher::load_cpu_topology(CPU_TOPOLOGY &topology,
+                                   const char *sysfs_devices) {
+  std::string root = sysfs_devices;
+  std::string cpus = root + "/system/cpu/";
+  UINT64 atom = 0;
+
+  CpuTopologyInitialise(&topology);
+  read_list(root + "/cpu_atom/cpus", atom);
+
+  for (UINT32 processor = 0; processor < CPU_TOPOLOGY_MAX_PROCESSORS;
+       processor++) {
+    std::string cpu = cpus + "cpu" + std::to_string(processor);
+    std::string capacity;
+    UINT64 siblings = 0;
+    UINT8 efficiency_class = 0;
+
+    /* offline and absent cpus have no topology directory */
+    if (!read_list(cpu + "/topology/thread_siblings_list", siblings))
+      continue;
+
+    if (atom)
+      efficiency_class = atom & (1ull << processor) ? 0 : 1;
+    else if (read_file(cpu + "/cpu_capacity", capacity))
+      efficiency_class = static_cast<UINT8>(
+          std::strtoul(capacity.c_str(), nullptr, 10) / 8);
+
+    CpuTopologyAddCore(&topology, siblings, efficiency_class);
+  }
+
+  return topology.core_count > 0;
+}
+
+void dispatcher::apply_cpu_placement(const CPU_PLACEMENT &placement) {
+  if (placement.mask) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int processor = 0; processor < CPU_TOPOLOGY_MAX_PROCESSORS;
+         processor++) {
+      if (placement.mask & (1ull << processor))
+        CPU_SET(processor, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+
+  if (placement.low_priority) {
+    sched_param parameters = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameters);
+  }
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../../core/cputopo.h"
+
+namespace dispatcher {
+
+/* where the linux topology is read from, tests point this at a fake tree */
+static constexpr char SYSFS_DEVICES_PATH[] = "/sys/devices";
+
+/*
+ * Builds the topology of the processors the module runs on. Returns false if
+ * the platform wouldnt say, in which case the topology is left empty and
+ * every placement is unrestricted.
+ */
+bool load_cpu_topology(CPU_TOPOLOGY &topology,
+                       const char *sysfs_devices = SYSFS_DEVICES_PATH);
+
+/*
+ * Applies a placement to the calling thread. Low priority is EcoQoS and a
+ * below normal priority on windows, SCHED_IDLE on linux.
+ */
+void apply_cpu_placement(const CPU_PLACEMENT &placement);
+} // namespace dispatcher
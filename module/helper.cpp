@@ -45,6 +45,24 @@ kernel_interface::report_id helper::get_kernel_report_type(void *buffer) {
 
   case kernel_interface::report_id::report_data_table_routine:
     return kernel_interface::report_id::report_data_table_routine;
+
+  case kernel_interface::report_id::report_data_pointer_hook:
+    return kernel_interface::report_id::report_data_pointer_hook;
+
+  case kernel_interface::report_id::report_private_executable_memory:
+    return kernel_interface::report_id::report_private_executable_memory;
+
+  case kernel_interface::report_id::report_module_image_modified:
+    return kernel_interface::report_id::report_module_image_modified;
+
+  case kernel_interface::report_id::report_unowned_executable_memory:
+    return kernel_interface::report_id::report_unowned_executable_memory;
+
+  case kernel_interface::report_id::report_unbacked_system_thread:
+    return kernel_interface::report_id::report_unbacked_system_thread;
+
+  case kernel_interface::report_id::report_driver_dispatch_hook:
+    return kernel_interface::report_id::report_driver_dispatch_hook;
   }
 }
 
@@ -90,6 +108,12 @@ void helper::print_kernel_report(void *buffer) {
     LOG_INFO("report code: %lx", r4->report_code);
     LOG_INFO("thread_id: %lx", r4->thread_id);
     LOG_INFO("thread_address: %llx", r4->thread_address);
+    LOG_INFO("process_id: %lx", r4->process_id);
+    LOG_INFO("image_name: %s", r4->image_name);
+    LOG_INFO("signature_level: %lx", r4->signature_level);
+    LOG_INFO("dwell_time: %llu ms", r4->dwell_time / 10000);
+    LOG_INFO("rounds: %u max_threads: %u samples: %u ended: %u", r4->rounds,
+             r4->max_threads, r4->samples, r4->ended);
     LOG_INFO("********************************");
     break;
   }
@@ -162,6 +186,89 @@ void helper::print_kernel_report(void *buffer) {
     LOG_INFO("********************************");
     break;
   }
+  case kernel_interface::report_id::report_data_pointer_hook: {
+    kernel_interface::data_pointer_hook_report *r11 =
+        reinterpret_cast<kernel_interface::data_pointer_hook_report *>(buffer);
+    LOG_INFO("report type: data_pointer_hook_report");
+    LOG_INFO("report code: %d", r11->report_code);
+    LOG_INFO("slot_address: %llx", r11->slot_address);
+    LOG_INFO("module_base: %llx", r11->module_base);
+    LOG_INFO("baseline: %llx", r11->baseline);
+    LOG_INFO("current: %llx", r11->current);
+    LOG_INFO("module: %s", r11->module);
+    LOG_INFO("********************************");
+    break;
+  }
+  case kernel_interface::report_id::report_private_executable_memory: {
+    kernel_interface::private_executable_memory_report *r12 =
+        reinterpret_cast<kernel_interface::private_executable_memory_report *>(
+            buffer);
+    LOG_INFO("report type: private_executable_memory_report");
+    LOG_INFO("report code: %d", r12->report_code);
+    LOG_INFO("region_type: %lx", r12->region_type);
+    LOG_INFO("base: %llx", r12->base);
+    LOG_INFO("size: %llx", r12->size);
+    LOG_INFO("allocation_base: %llx", r12->allocation_base);
+    LOG_INFO("protection: %lx", r12->protection);
+    LOG_INFO("state: %lx", r12->state);
+    LOG_INFO("********************************");
+    break;
+  }
+  case kernel_interface::report_id::report_module_image_modified: {
+    kernel_interface::module_image_modified_report *r13 =
+        reinterpret_cast<kernel_interface::module_image_modified_report *>(
+            buffer);
+    LOG_INFO("report type: module_image_modified_report");
+    LOG_INFO("report code: %d", r13->report_code);
+    LOG_INFO("page_rva: %lx", r13->page_rva);
+    LOG_INFO("page_length: %lx", r13->page_length);
+    LOG_INFO("image_size: %lx", r13->image_size);
+    LOG_INFO("image_base: %llx", r13->image_base);
+    LOG_INFO("********************************");
+    break;
+  }
+  case kernel_interface::report_id::report_unowned_executable_memory: {
+    kernel_interface::unowned_executable_memory_report *r14 =
+        reinterpret_cast<kernel_interface::unowned_executable_memory_report *>(
+            buffer);
+    LOG_INFO("report type: unowned_executable_memory_report");
+    LOG_INFO("report code: %d", r14->report_code);
+    LOG_INFO("span_size: %lx", r14->span_size);
+    LOG_INFO("virtual_base: %llx", r14->virtual_base);
+    LOG_INFO("physical_base: %llx", r14->physical_base);
+    LOG_INFO("********************************");
+    break;
+  }
+  case kernel_interface::report_id::report_unbacked_system_thread: {
+    kernel_interface::unbacked_system_thread_report *r15 =
+        reinterpret_cast<kernel_interface::unbacked_system_thread_report *>(
+            buffer);
+    LOG_INFO("report type: unbacked_system_thread_report");
+    LOG_INFO("report code: %d", r15->report_code);
+    LOG_INFO("thread_id: %lx", r15->thread_id);
+    LOG_INFO("thread_address: %llx", r15->thread_address);
+    LOG_INFO("start_address: %llx", r15->start_address);
+    LOG_INFO("win32_start_address: %llx", r15->win32_start_address);
+    LOG_INFO("threads: %lx", r15->threads);
+    LOG_INFO("********************************");
+    break;
+  }
+  case kernel_interface::report_id::report_driver_dispatch_hook: {
+    kernel_interface::driver_dispatch_hook_report *r16 =
+        reinterpret_cast<kernel_interface::driver_dispatch_hook_report *>(
+            buffer);
+    LOG_INFO("report type: driver_dispatch_hook_report");
+    LOG_INFO("report code: %d", r16->report_code);
+    LOG_INFO("driver_name: %s", r16->driver_name);
+    LOG_INFO("driver_base: %llx", r16->driver_base);
+    LOG_INFO("driver_size: %lx", r16->driver_size);
+    LOG_INFO("slot: %lx", r16->slot);
+    LOG_INFO("verdict: %lx", r16->verdict);
+    LOG_INFO("previous: %llx", r16->previous);
+    LOG_INFO("current: %llx", r16->current);
+    LOG_INFO("********************************");
+    break;
+  }
   default:
     LOG_INFO("Invalid report type.");
     break;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+namespace kernel_interface {
+
+/*
+ * The transport between the module and the driver. ioctl_device talks to the
+ * real driver, simulated_device is an in process stand in so the module can
+ * be run and benchmarked without the driver loaded.
+ *
+ * Reports arrive through buffers handed to the driver ahead of time, the
+ * equivalent of the pending IRPs the driver completes. Each one is identified
+ * by a slot index chosen by the caller.
+ */
+class device {
+public:
+  virtual ~device() = default;
+
+  virtual bool is_open() = 0;
+
+  /* a synchronous ioctl, returns false on failure */
+  virtual bool call(unsigned long ioctl, void *input, unsigned long input_size,
+                    void *output, unsigned long output_size,
+                    unsigned long *bytes_returned) = 0;
+
+  /* hands the driver a buffer to complete with the next report */
+  virtual bool queue_report_buffer(int slot, void *buffer,
+                                   unsigned long buffer_size) = 0;
+
+  /*
+   * Blocks until the driver completes a queued buffer. Returns false once the
+   * device is shut down.
+   */
+  virtual bool wait_for_report(int *slot, unsigned long *bytes) = 0;
+
+  /* wakes every wait_for_report caller */
+  virtual void shutdown() = 0;
+};
+
+} // namespace kernel_interface
@@ -0,0 +1,94 @@
+#include "ioctl_device.h"
+
+#include "ioctl.h"
+
+#include "../common.h"
+
+kernel_interface::ioctl_device::ioctl_device(LPCWSTR driver_name,
+                                             int slot_count) {
+  this->port = nullptr;
+  this->overlapped.resize(slot_count);
+  this->driver_handle = CreateFileW(
+      driver_name, GENERIC_WRITE | GENERIC_READ | GENERIC_EXECUTE, 0, 0,
+      OPEN_EXISTING, FILE_ATTRIBUTE_SYSTEM | FILE_FLAG_OVERLAPPED, 0);
+  if (this->driver_handle == INVALID_HANDLE_VALUE) {
+    LOG_ERROR("Failed to open handle to driver with status 0x%x",
+              GetLastError());
+    return;
+  }
+  this->port = CreateIoCompletionPort(this->driver_handle, nullptr, 0, 0);
+  if (!this->port)
+    LOG_ERROR("CreateIoCompletePort failed with status %x", GetLastError());
+  for (OVERLAPPED &entry : this->overlapped) {
+    memset(&entry, 0, sizeof(entry));
+    entry.hEvent = CreateEvent(nullptr, false, false, nullptr);
+  }
+}
+
+kernel_interface::ioctl_device::~ioctl_device() {
+  for (OVERLAPPED &entry : this->overlapped) {
+    if (entry.hEvent)
+      CloseHandle(entry.hEvent);
+  }
+  if (this->port)
+    CloseHandle(this->port);
+  if (this->driver_handle != INVALID_HANDLE_VALUE)
+    CloseHandle(this->driver_handle);
+}
+
+bool kernel_interface::ioctl_device::call(unsigned long ioctl, void *input,
+                                          unsigned long input_size,
+                                          void *output,
+                                          unsigned long output_size,
+                                          unsigned long *bytes_returned) {
+  return DeviceIoControl(this->driver_handle, ioctl, input, input_size, output,
+                         output_size, bytes_returned, nullptr);
+}
+
+bool kernel_interface::ioctl_device::queue_report_buffer(
+    int slot, void *buffer, unsigned long buffer_size) {
+  DWORD status = 0;
+  OVERLAPPED *overlapped = &this->overlapped[slot];
+  ResetEvent(overlapped->hEvent);
+  status =
+      DeviceIoControl(this->driver_handle, ioctl_code::InsertIrpIntoIrpQueue,
+                      NULL, NULL, buffer, buffer_size, NULL, overlapped);
+  /*
+   * im not sure why this returns a status of ERROR_INVALID_FUNCTION when we use
+   * the inserted irp to complete a deferred irp - even though that procedure
+   * should return STATUS_SUCCESS? Weird.. Anyhow it works.
+   */
+  if (status == ERROR_IO_PENDING || status == ERROR_SUCCESS ||
+      status == ERROR_INVALID_FUNCTION)
+    return true;
+  LOG_ERROR("failed to insert irp into irp queue %x", status);
+  return false;
+}
+
+bool kernel_interface::ioctl_device::wait_for_report(int *slot,
+                                                     unsigned long *bytes) {
+  DWORD transferred = 0;
+  OVERLAPPED *io = nullptr;
+  ULONG_PTR key = 0;
+  while (true) {
+    GetQueuedCompletionStatus(this->port, &transferred, &key, &io, INFINITE);
+    /* either the port was closed or shutdown posted a wakeup */
+    if (io == nullptr)
+      return false;
+    for (size_t index = 0; index < this->overlapped.size(); index++) {
+      if (&this->overlapped[index] == io) {
+        *slot = static_cast<int>(index);
+        *bytes = transferred;
+        return true;
+      }
+    }
+  }
+}
+
+/* there are never more consumers than slots, so this wakes all of them */
+void kernel_interface::ioctl_device::shutdown() {
+  if (!this->port)
+    return;
+  for (size_t index = 0; index < this->overlapped.size(); index++)
+    PostQueuedCompletionStatus(this->port, 0, 0, nullptr);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <vector>
+
+#include "device.h"
+
+namespace kernel_interface {
+
+/*
+ * The real driver, reached through DeviceIoControl. Report buffers are
+ * overlapped InsertIrpIntoIrpQueue requests which complete on an io
+ * completion port.
+ */
+class ioctl_device : public device {
+  HANDLE driver_handle;
+  HANDLE port;
+  std::vector<OVERLAPPED> overlapped;
+
+public:
+  ioctl_device(LPCWSTR driver_name, int slot_count);
+  ~ioctl_device();
+
+  bool is_open() override {
+    return this->driver_handle != INVALID_HANDLE_VALUE;
+  }
+  bool call(unsigned long ioctl, void *input, unsigned long input_size,
+            void *output, unsigned long output_size,
+            unsigned long *bytes_returned) override;
+  bool queue_report_buffer(int slot, void *buffer,
+                           unsigned long buffer_size) override;
+  bool wait_for_report(int *slot, unsigned long *bytes) override;
+  void shutdown() override;
+};
+} // namespace kernel_interface
@@ -2,6 +2,11 @@
 
 #include <iostream>
 
+#include "ioctl_device.h"
+#ifdef AC_SIMULATED_DRIVER
+#include "simulated_device.h"
+#endif
+
 #include "../common.h"
 #include "../helper.h"
 
@@ -13,119 +18,159 @@ typedef BOOLEAN(NTAPI *RtlDosPathNameToNtPathName_U)(PCWSTR DosPathName,
                                                      PCWSTR *NtFileNamePart,
                                                      PVOID DirectoryInfo);
 
-kernel_interface::event_dispatcher *
-kernel_interface::kernel_interface::get_free_event_entry() {
-  std::lock_guard<std::mutex> lock(this->lock);
-  for (std::vector<event_dispatcher>::iterator it = events.begin();
-       it != events.end(); it++) {
-    if (it->in_use == false) {
-      it->in_use = true;
-      return &(*it);
-    }
+std::unique_ptr<kernel_interface::device>
+kernel_interface::open_device(LPCWSTR driver_name) {
+#ifdef AC_SIMULATED_DRIVER
+  if (GetEnvironmentVariableW(SIMULATED_DRIVER_VARIABLE, nullptr, 0)) {
+    LOG_INFO("Using the simulated driver");
+    return std::make_unique<simulated_device>(simulated_device_config());
   }
-  return nullptr;
+#endif
+  return std::make_unique<ioctl_device>(driver_name, EVENT_COUNT);
 }
 
-void kernel_interface::kernel_interface::terminate_completion_port() {
-  std::lock_guard<std::mutex> lock(this->lock);
-  for (std::vector<event_dispatcher>::iterator it = events.begin();
-       it != events.end(); it++) {
-    free(it->buffer);
-    CloseHandle(it->overlapped.hEvent);
-  }
+void kernel_interface::kernel_interface::set_report_observer(
+    std::function<void(UINT32)> observer) {
+  this->report_observer = std::move(observer);
 }
 
 void kernel_interface::kernel_interface::run_completion_port() {
-  DWORD bytes = 0;
-  OVERLAPPED *io = nullptr;
-  ULONG_PTR key = 0;
-  while (true) {
-    GetQueuedCompletionStatus(this->port, &bytes, &key, &io, INFINITE);
-    if (io == nullptr)
-      continue;
-    void *buffer = get_buffer_from_event_object(io);
+  this->reports.run([this](void *buffer, unsigned long bytes) {
+#ifdef AC_DIAGNOSTIC_SINKS
+    /* record before validating so malformed reports can be replayed too */
+    if (this->report_recorder)
+      this->report_recorder->record(buffer, bytes);
+#endif
+    if (!ReportIsValid(buffer, bytes)) {
+      LOG_ERROR("Received malformed report of size %lx", bytes);
+      return;
+    }
     helper::print_kernel_report(buffer);
-    release_event_object(io);
-    send_pending_irp();
-  }
+    if (this->report_observer)
+      this->report_observer(ReportGetCode(buffer));
+  });
 }
 
-void kernel_interface::kernel_interface::initiate_completion_port() {
-  for (int index = 0; index < EVENT_COUNT; index++) {
-    void *buffer = malloc(MAXIMUM_REPORT_BUFFER_SIZE);
-    this->events.push_back(
-        event_dispatcher(buffer, MAXIMUM_REPORT_BUFFER_SIZE));
-  }
-  this->port = CreateIoCompletionPort(this->driver_handle, nullptr, 0, 0);
-  if (!this->port) {
-    LOG_ERROR("CreateIoCompletePort failed with status %x", GetLastError());
-    return;
-  }
-  for (int index = 0; index < EVENT_COUNT; index++) {
-    send_pending_irp();
-  }
+void kernel_interface::kernel_interface::stop_completion_port() {
+  this->driver->shutdown();
 }
 
-void kernel_interface::kernel_interface::release_event_object(
-    OVERLAPPED *event) {
-  std::lock_guard<std::mutex> lock(this->lock);
-  for (std::vector<event_dispatcher>::iterator it = events.begin();
-       it != events.end(); it++) {
-    if (&it->overlapped == event) {
-      /* simply zero our the buffer, no need to free and realloc */
-      memset(it->buffer, 0, it->buffer_size);
-      it->in_use = false;
-      ResetEvent(it->overlapped.hEvent);
-    }
+#ifdef AC_DIAGNOSTIC_SINKS
+void kernel_interface::kernel_interface::initiate_recorder() {
+  wchar_t path[MAX_PATH] = {0};
+  if (!GetEnvironmentVariableW(recorder::RECORDING_PATH_VARIABLE, path,
+                               MAX_PATH))
+    return;
+  this->report_recorder = std::make_unique<recorder::recorder>(path);
+  if (!this->report_recorder->is_open()) {
+    this->report_recorder.reset();
+    return;
   }
+  LOG_INFO("Recording kernel reports to %ls", path);
 }
 
-void *kernel_interface::kernel_interface::get_buffer_from_event_object(
-    OVERLAPPED *event) {
-  std::lock_guard<std::mutex> lock(this->lock);
-  for (std::vector<event_dispatcher>::iterator it = events.begin();
-       it != events.end(); it++) {
-    if (&it->overlapped == event) {
-      return it->buffer;
-    }
+void kernel_interface::kernel_interface::initiate_trace_file() {
+  wchar_t path[MAX_PATH] = {0};
+  if (!GetEnvironmentVariableW(TRACE_PATH_VARIABLE, path, MAX_PATH))
+    return;
+  this->trace_file = CreateFileW(path, FILE_APPEND_DATA, FILE_SHARE_READ,
+                                 nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+                                 nullptr);
+  if (this->trace_file == INVALID_HANDLE_VALUE) {
+    LOG_ERROR("CreateFileW failed with status %x", GetLastError());
+    return;
   }
-  return nullptr;
+  LOG_INFO("Writing driver trace events to %ls", path);
 }
+#endif
 
 kernel_interface::kernel_interface::kernel_interface(
-    LPCWSTR driver_name, client::message_queue &queue)
-    : message_queue(queue) {
-  this->driver_name = driver_name;
-  this->port = INVALID_HANDLE_VALUE;
-  this->driver_handle = CreateFileW(
-      driver_name, GENERIC_WRITE | GENERIC_READ | GENERIC_EXECUTE, 0, 0,
-      OPEN_EXISTING, FILE_ATTRIBUTE_SYSTEM | FILE_FLAG_OVERLAPPED, 0);
-  if (this->driver_handle == INVALID_HANDLE_VALUE) {
-    LOG_ERROR("Failed to open handle to driver with status 0x%x",
-              GetLastError());
+    std::unique_ptr<device> driver, client::message_queue &queue)
+    : driver(std::move(driver)), message_queue(queue),
+      reports(*this->driver, EVENT_COUNT, MAXIMUM_REPORT_BUFFER_SIZE),
+      traces(TRACE_DEFAULT_CAPACITY) {
+  if (!this->driver->is_open())
     return;
-  }
   this->notify_driver_on_process_launch();
-  this->initiate_completion_port();
+  this->register_module_image();
+#ifdef AC_DIAGNOSTIC_SINKS
+  this->initiate_recorder();
+  this->initiate_trace_file();
+#endif
+  this->reports.queue_all();
 }
 
 kernel_interface::kernel_interface::~kernel_interface() {
-  this->terminate_completion_port();
+  this->driver->shutdown();
   this->notify_driver_on_process_termination();
+#ifdef AC_DIAGNOSTIC_SINKS
+  if (this->trace_file != INVALID_HANDLE_VALUE)
+    CloseHandle(this->trace_file);
+#endif
+}
+
+/* mirrors GetTraceCheckId in the driver */
+static TRACE_CHECK_ID get_trace_check_id(kernel_interface::ioctl_code ioctl) {
+  using kernel_interface::ioctl_code;
+  switch (ioctl) {
+  case ioctl_code::RunNmiCallbacks: return TRACE_CHECK_NMI_CALLBACKS;
+  case ioctl_code::ValidateDriverObjects: return TRACE_CHECK_DRIVER_OBJECTS;
+  case ioctl_code::PerformVirtualisationCheck:
+    return TRACE_CHECK_VIRTUALISATION;
+  case ioctl_code::EnumerateHandleTables: return TRACE_CHECK_HANDLE_TABLES;
+  case ioctl_code::ValidateProcessLoadedModule:
+    return TRACE_CHECK_PROCESS_MODULES;
+  case ioctl_code::ScanForUnlinkedProcesses:
+    return TRACE_CHECK_UNLINKED_PROCESSES;
+  case ioctl_code::PerformModuleIntegrityCheck:
+    return TRACE_CHECK_MODULE_INTEGRITY;
+  case ioctl_code::ScanFroAttachedThreads: return TRACE_CHECK_ATTACHED_THREADS;
+  case ioctl_code::InitiateApcStackwalkOperation:
+    return TRACE_CHECK_APC_STACKWALK;
+  case ioctl_code::ScanForEptHooks: return TRACE_CHECK_EPT_HOOKS;
+  case ioctl_code::InitiateDpcStackwalk: return TRACE_CHECK_DPC_STACKWALK;
+  case ioctl_code::ValidateSystemModules: return TRACE_CHECK_SYSTEM_MODULES;
+  case ioctl_code::ValidatePciDevices: return TRACE_CHECK_PCI_DEVICES;
+  case ioctl_code::ScanProcessExecutableMemory:
+    return TRACE_CHECK_PROCESS_MEMORY;
+  case ioctl_code::ScanKernelExecutableMemory:
+    return TRACE_CHECK_KERNEL_MEMORY;
+  default: return TRACE_CHECK_UNKNOWN;
+  }
+}
+
+/*
+ * Every driver call goes through here so checks are recorded as spans from
+ * the module's side too, the driver records its own for the time spent in the
+ * kernel.
+ */
+bool kernel_interface::kernel_interface::call_driver(
+    ioctl_code ioctl, void *input_buffer, unsigned long input_size,
+    void *output_buffer, unsigned long output_size,
+    unsigned long *bytes_returned) {
+  unsigned __int64 start = trace_ring::timestamp();
+  bool result = this->driver->call(ioctl, input_buffer, input_size,
+                                   output_buffer, output_size, bytes_returned);
+  TRACE_CHECK_ID check = get_trace_check_id(ioctl);
+  if (check != TRACE_CHECK_UNKNOWN)
+    this->traces.write_span(check, start, result ? 0 : GetLastError());
+  return result;
 }
 
 unsigned int kernel_interface::kernel_interface::generic_driver_call_output(
     ioctl_code ioctl, void *output_buffer, size_t buffer_size,
     unsigned long *bytes_returned) {
-  return DeviceIoControl(this->driver_handle, ioctl, nullptr, 0, output_buffer,
-                         buffer_size, bytes_returned, nullptr);
+  return this->call_driver(ioctl, nullptr, 0, output_buffer,
+                           static_cast<unsigned long>(buffer_size),
+                           bytes_returned);
 }
 
 void kernel_interface::kernel_interface::generic_driver_call_input(
     ioctl_code ioctl, void *input_buffer, size_t buffer_size,
     unsigned long *bytes_returned) {
-  if (!DeviceIoControl(this->driver_handle, ioctl, input_buffer, buffer_size,
-                       nullptr, 0, bytes_returned, nullptr))
+  if (!this->call_driver(ioctl, input_buffer,
+                         static_cast<unsigned long>(buffer_size), nullptr, 0,
+                         bytes_returned))
     LOG_ERROR("DeviceIoControl failed with status %x", GetLastError());
 }
 
@@ -145,6 +190,26 @@ void kernel_interface::kernel_interface::notify_driver_on_process_launch() {
                             sizeof(session_initiation_packet), &bytes_returned);
 }
 
+/*
+ * The driver verifies our own code against the image on disk from then on.
+ * Only the base is passed, the driver finds the file the image is mapped from
+ * itself.
+ */
+void kernel_interface::kernel_interface::register_module_image() {
+  HMODULE module = nullptr;
+  module_image_registration registration = {0};
+  if (!GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                              GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                          reinterpret_cast<LPCWSTR>(&get_trace_check_id),
+                          &module)) {
+    LOG_ERROR("GetModuleHandleExW failed with status %x", GetLastError());
+    return;
+  }
+  registration.module_base = module;
+  generic_driver_call_input(ioctl_code::RegisterModuleImage, &registration,
+                            sizeof(registration), nullptr);
+}
+
 void kernel_interface::kernel_interface::detect_system_virtualization() {
   unsigned int status = 0;
   unsigned long bytes_returned = 0;
@@ -161,8 +226,7 @@ void kernel_interface::kernel_interface::detect_system_virtualization() {
 }
 
 void kernel_interface::kernel_interface::generic_driver_call(ioctl_code ioctl) {
-  if (!DeviceIoControl(this->driver_handle, ioctl, nullptr, 0, nullptr, 0,
-                       nullptr, nullptr))
+  if (!this->call_driver(ioctl, nullptr, 0, nullptr, 0, nullptr))
     LOG_ERROR("DeviceIoControl failed with status %x", GetLastError());
 }
 
@@ -211,6 +275,27 @@ void kernel_interface::kernel_interface::validate_system_modules() {
   this->generic_driver_call(ioctl_code::ValidateSystemModules);
 }
 
+void kernel_interface::kernel_interface::scan_process_executable_memory() {
+  this->generic_driver_call(ioctl_code::ScanProcessExecutableMemory);
+}
+
+void kernel_interface::kernel_interface::scan_kernel_executable_memory() {
+  this->generic_driver_call(ioctl_code::ScanKernelExecutableMemory);
+}
+
+/* the driver signs it, all the module does is pass it on */
+void kernel_interface::kernel_interface::send_heartbeat() {
+  unsigned long bytes_returned = 0;
+  HEARTBEAT_PACKET packet = {0};
+  if (!generic_driver_call_output(ioctl_code::QueryHeartbeat, &packet,
+                                  sizeof(packet), &bytes_returned) ||
+      bytes_returned != sizeof(packet)) {
+    LOG_ERROR("Failed to query heartbeat with status %x", GetLastError());
+    return;
+  }
+  this->message_queue.enqueue_heartbeat(&packet, sizeof(packet));
+}
+
 void kernel_interface::kernel_interface::
     verify_process_module_executable_regions() {
 //  HANDLE handle = INVALID_HANDLE_VALUE;
@@ -257,24 +342,7 @@ void kernel_interface::kernel_interface::initiate_apc_stackwalk() {
 }
 
 void kernel_interface::kernel_interface::send_pending_irp() {
-  DWORD status = 0;
-  event_dispatcher *event = get_free_event_entry();
-  if (!event) {
-    LOG_ERROR("All event objects in use.");
-    return;
-  }
-  status = DeviceIoControl(
-      this->driver_handle, ioctl_code::InsertIrpIntoIrpQueue, NULL, NULL,
-      event->buffer, event->buffer_size, NULL, &event->overlapped);
-  /*
-   * im not sure why this returns a status of ERROR_INVALID_FUNCTION when we use
-   * the inserted irp to complete a deferred irp - even though that procedure
-   * should return STATUS_SUCCESS? Weird.. Anyhow it works.
-   */
-  if (status == ERROR_IO_PENDING || status == ERROR_SUCCESS ||
-      status == ERROR_INVALID_FUNCTION)
-    return;
-  LOG_ERROR("failed to insert irp into irp queue %x", status);
+  this->reports.queue_slot();
 }
 
 // void kernel_interface::kernel_interface::query_deferred_reports() {
@@ -311,4 +379,73 @@ void kernel_interface::kernel_interface::initiate_shared_mapping() {
     LOG_ERROR("DeviceIoControl failed with status %x", GetLastError());
     return;
   }
-}
\ No newline at end of file
+}
+
+void kernel_interface::kernel_interface::log_trace_events(
+    PTRACE_DRAIN_HEADER header, unsigned long size) {
+  char message[256] = {0};
+  PTRACE_EVENT events = reinterpret_cast<PTRACE_EVENT>(header + 1);
+  LPCSTR source =
+      header->source == TRACE_SOURCE_DRIVER ? "driver" : "module";
+  unsigned long count =
+      (size - sizeof(TRACE_DRAIN_HEADER)) / sizeof(TRACE_EVENT);
+  if (header->event_count < count)
+    count = header->event_count;
+  for (unsigned long index = 0; index < count; index++) {
+    TRACE_EVENT &event = events[index];
+    if (event.id == TRACE_CHECK_SPAN && header->frequency) {
+      LOG_INFO("[%s] core: %u %s took %lluus with result %llx", source,
+               event.core,
+               TraceGetCheckName(static_cast<UINT16>(event.arguments[0])),
+               (event.timestamp - event.arguments[1]) * 1000000 /
+                   header->frequency,
+               event.arguments[2]);
+      continue;
+    }
+    snprintf(message, sizeof(message), TraceGetEventFormat(event.id),
+             event.arguments[0], event.arguments[1], event.arguments[2],
+             event.arguments[3]);
+    LOG_INFO("[%s] core: %u %s %s", source, event.core,
+             TraceGetEventName(event.id), message);
+  }
+}
+
+void kernel_interface::kernel_interface::handle_trace_drain(
+    void *buffer, unsigned long size) {
+  if (size < sizeof(TRACE_DRAIN_HEADER))
+    return;
+  PTRACE_DRAIN_HEADER header = reinterpret_cast<PTRACE_DRAIN_HEADER>(buffer);
+  if (header->magic != TRACE_MAGIC || !header->event_count)
+    return;
+  if (header->lost)
+    LOG_INFO("Trace rings overflowed, %llu events lost", header->lost);
+  this->message_queue.enqueue_message(buffer, size);
+#ifdef AC_DIAGNOSTIC_SINKS
+  if (this->trace_file != INVALID_HANDLE_VALUE) {
+    unsigned long bytes_written = 0;
+    if (!WriteFile(this->trace_file, buffer, size, &bytes_written, nullptr))
+      LOG_ERROR("WriteFile failed with status %x", GetLastError());
+    return;
+  }
+#endif
+  this->log_trace_events(header, size);
+}
+
+/*
+ * The driver only stores raw events on its hot paths, this is where they get
+ * turned into something readable along with the spans the module recorded
+ * around its own driver calls. Called periodically from a dispatcher timer.
+ */
+void kernel_interface::kernel_interface::drain_trace_events() {
+  unsigned long bytes_returned = 0;
+  std::vector<unsigned char> buffer(TRACE_DRAIN_BUFFER_SIZE);
+  if (this->generic_driver_call_output(ioctl_code::QueryTraceEvents,
+                                       buffer.data(), buffer.size(),
+                                       &bytes_returned))
+    this->handle_trace_drain(buffer.data(), bytes_returned);
+  else
+    LOG_ERROR("DeviceIoControl failed with status %x", GetLastError());
+  bytes_returned = this->traces.drain(
+      buffer.data(), static_cast<unsigned long>(buffer.size()));
+  this->handle_trace_drain(buffer.data(), bytes_returned);
+}
@@ -2,7 +2,21 @@
 
 #include <Windows.h>
 
+#include <memory>
+
+#include "device.h"
+#include "ioctl.h"
+#include "report_port.h"
+#include "trace_ring.h"
+
 #include "../client/message_queue.h"
+#ifdef AC_DIAGNOSTIC_SINKS
+#include "../recorder/recorder.h"
+#endif
+
+#include "../../core/heartbeat.h"
+#include "../../core/report.h"
+#include "../../core/trace.h"
 
 namespace kernel_interface {
 
@@ -11,30 +25,41 @@ static constexpr int MAX_MODULE_PATH = 256;
 static constexpr int MAXIMUM_REPORT_BUFFER_SIZE = 1000;
 static constexpr int QUERY_DEFERRED_REPORT_COUNT = 10;
 static constexpr int AES_128_KEY_SIZE = 16;
+static constexpr int TRACE_DRAIN_BUFFER_SIZE = 0x10000;
+
+#ifdef AC_DIAGNOSTIC_SINKS
+/*
+ * When set, drained driver trace events are appended raw to the file it names
+ * for tools/trace to decode, rather than being formatted and logged here.
+ * Like the report recorder this writes what the driver hands the module to
+ * disk, so it only exists in builds defining AC_DIAGNOSTIC_SINKS.
+ */
+static constexpr wchar_t TRACE_PATH_VARIABLE[] = L"DONNA_AC_TRACE";
+#endif
 
 enum report_id {
-  report_nmi_callback_failure = 50,
-  report_module_validation_failure = 60,
-  report_illegal_handle_operation = 70,
-  report_invalid_process_allocation = 80,
-  report_hidden_system_thread = 90,
-  report_illegal_attach_process = 100,
-  report_apc_stackwalk = 110,
-  report_dpc_stackwalk = 120,
-  report_data_table_routine = 130,
-  report_invalid_process_module = 140
+  report_nmi_callback_failure = REPORT_NMI_CALLBACK_FAILURE,
+  report_module_validation_failure = REPORT_MODULE_VALIDATION_FAILURE,
+  report_illegal_handle_operation = REPORT_ILLEGAL_HANDLE_OPERATION,
+  report_invalid_process_allocation = REPORT_INVALID_PROCESS_ALLOCATION,
+  report_hidden_system_thread = REPORT_HIDDEN_SYSTEM_THREAD,
+  report_illegal_attach_process = REPORT_ILLEGAL_ATTACH_PROCESS,
+  report_apc_stackwalk = REPORT_APC_STACKWALK,
+  report_dpc_stackwalk = REPORT_DPC_STACKWALK,
+  report_data_table_routine = REPORT_DATA_TABLE_ROUTINE,
+  report_invalid_process_module = REPORT_INVALID_PROCESS_MODULE,
+  report_data_pointer_hook = REPORT_DATA_POINTER_HOOK,
+  report_private_executable_memory = REPORT_PRIVATE_EXECUTABLE_MEMORY,
+  report_module_image_modified = REPORT_MODULE_IMAGE_MODIFIED,
+  report_unowned_executable_memory = REPORT_UNOWNED_EXECUTABLE_MEMORY,
+  report_unbacked_system_thread = REPORT_UNBACKED_SYSTEM_THREAD,
+  report_driver_dispatch_hook = REPORT_DRIVER_DISPATCH_HOOK
 };
 
 struct report_header {
   int report_id;
 };
 
-constexpr int APC_STACKWALK_BUFFER_SIZE = 500;
-constexpr int DATA_TABLE_ROUTINE_BUF_SIZE = 256;
-constexpr int REPORT_INVALID_PROCESS_BUFFER_SIZE = 500;
-constexpr int HANDLE_REPORT_PROCESS_NAME_MAX_LENGTH = 64;
-constexpr int MODULE_PATH_LEN = 256;
-
 struct apc_stackwalk_report {
   int report_code;
   uint64_t kthread_address;
@@ -91,6 +116,14 @@ struct attach_process_report {
   int report_code;
   uint32_t thread_id;
   uint64_t thread_address;
+  uint32_t process_id;
+  uint32_t signature_level;
+  char image_name[ATTACH_REPORT_IMAGE_NAME_LENGTH];
+  uint64_t dwell_time;
+  uint32_t rounds;
+  uint32_t max_threads;
+  uint32_t samples;
+  uint32_t ended;
 };
 
 struct kprcb_thread_validation_ctx {
@@ -115,33 +148,103 @@ struct process_module_validation_report {
   wchar_t module_path[MODULE_PATH_LEN];
 };
 
-enum apc_operation { operation_stackwalk = 0x1 };
+struct data_pointer_hook_report {
+  uint32_t report_code;
+  uint32_t reserved;
+  uint64_t slot_address;
+  uint64_t module_base;
+  uint64_t baseline;
+  uint64_t current;
+  char module[DATA_POINTER_REPORT_MODULE_LENGTH];
+};
 
-// clang-format off
-enum ioctl_code
-{
-        RunNmiCallbacks =                       CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20001, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ValidateDriverObjects =                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20002, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        NotifyDriverOnProcessLaunch =           CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20004, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        QueryForApcCompletion =                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20005, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        PerformVirtualisationCheck =            CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20006, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        EnumerateHandleTables =                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20007, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        NotifyDriverOnProcessTermination =      CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20010, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ScanForUnlinkedProcesses =              CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20011, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        PerformModuleIntegrityCheck =           CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20013, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ScanFroAttachedThreads =                CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20014, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ValidateProcessLoadedModule =           CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20015, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        RequestHardwareInformation =            CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20016, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        InitiateApcStackwalkOperation =         CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20017, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ScanForEptHooks =                       CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20018, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        InitiateDpcStackwalk =                  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20019, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ValidateSystemModules =                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20020, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        InsertIrpIntoIrpQueue =                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20021, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        QueryDeferredReports =                  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20022, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        InitiateSharedMapping =                 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20023, METHOD_BUFFERED, FILE_ANY_ACCESS),
-        ValidatePciDevices =                    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20024, METHOD_BUFFERED, FILE_ANY_ACCESS)
+struct private_executable_memory_report {
+  uint32_t report_code;
+  uint32_t region_type;
+  uint64_t base;
+  uint64_t size;
+  uint64_t allocation_base;
+  uint32_t protection;
+  uint32_t state;
+};
+
+struct module_image_modified_report {
+  uint32_t report_code;
+  uint32_t page_rva;
+  uint32_t page_length;
+  uint32_t image_size;
+  uint64_t image_base;
+};
+
+struct unowned_executable_memory_report {
+  uint32_t report_code;
+  uint32_t span_size;
+  uint64_t virtual_base;
+  uint64_t physical_base;
 };
 
+struct unbacked_system_thread_report {
+  uint32_t report_code;
+  uint32_t thread_id;
+  uint64_t thread_address;
+  uint64_t start_address;
+  uint64_t win32_start_address;
+  uint32_t threads;
+};
+
+struct driver_dispatch_hook_report {
+  uint32_t report_code;
+  uint32_t slot;
+  uint32_t verdict;
+  uint32_t driver_size;
+  uint64_t driver_base;
+  uint64_t previous;
+  uint64_t current;
+  char driver_name[DRIVER_DISPATCH_REPORT_NAME_LENGTH];
+};
+
+/*
+ * The structures above mirror the ones the driver writes, which are defined in
+ * core/report.h. Make sure the two never drift apart.
+ */
+static_assert(sizeof(apc_stackwalk_report) == sizeof(APC_STACKWALK_REPORT));
+static_assert(sizeof(dpc_stackwalk_report) == sizeof(DPC_STACKWALK_REPORT));
+static_assert(sizeof(module_validation_failure) ==
+              sizeof(MODULE_VALIDATION_FAILURE));
+static_assert(sizeof(data_table_routine_report) ==
+              sizeof(DATA_TABLE_ROUTINE_REPORT));
+static_assert(sizeof(nmi_callback_failure) == sizeof(NMI_CALLBACK_FAILURE));
+static_assert(sizeof(invalid_process_allocation_report) ==
+              sizeof(INVALID_PROCESS_ALLOCATION_REPORT));
+static_assert(sizeof(hidden_system_thread_report) ==
+              sizeof(HIDDEN_SYSTEM_THREAD_REPORT));
+static_assert(sizeof(attach_process_report) == sizeof(ATTACH_PROCESS_REPORT));
+static_assert(sizeof(open_handle_failure_report) ==
+              sizeof(OPEN_HANDLE_FAILURE_REPORT));
+static_assert(sizeof(process_module_validation_report) ==
+              sizeof(PROCESS_MODULE_VALIDATION_REPORT));
+static_assert(sizeof(data_pointer_hook_report) ==
+              sizeof(DATA_POINTER_HOOK_REPORT));
+static_assert(sizeof(private_executable_memory_report) ==
+              sizeof(PRIVATE_EXECUTABLE_MEMORY_REPORT));
+static_assert(sizeof(module_image_modified_report) ==
+              sizeof(MODULE_IMAGE_MODIFIED_REPORT));
+static_assert(sizeof(unowned_executable_memory_report) ==
+              sizeof(UNOWNED_EXECUTABLE_MEMORY_REPORT));
+static_assert(sizeof(unbacked_system_thread_report) ==
+              sizeof(UNBACKED_SYSTEM_THREAD_REPORT));
+static_assert(sizeof(driver_dispatch_hook_report) ==
+              sizeof(DRIVER_DISPATCH_HOOK_REPORT));
+
+/*
+ * Opens the driver, or the simulated driver when SIMULATED_DRIVER_VARIABLE is
+ * set in the environment and the module is built with AC_SIMULATED_DRIVER.
+ */
+std::unique_ptr<device> open_device(LPCWSTR driver_name);
+
+enum apc_operation { operation_stackwalk = 0x1 };
+
+// clang-format off
 constexpr int SHARED_STATE_OPERATION_COUNT = 9;
 
 enum shared_state_operation_id
@@ -159,20 +262,6 @@ enum shared_state_operation_id
 
 // clang-format on
 
-struct event_dispatcher {
-  bool in_use;
-  OVERLAPPED overlapped;
-  void *buffer;
-  unsigned long buffer_size;
-
-  event_dispatcher(void *buffer, unsigned long buffer_size) {
-    this->in_use = false;
-    this->overlapped.hEvent = CreateEvent(nullptr, false, false, nullptr);
-    this->buffer = buffer;
-    this->buffer_size = buffer_size;
-  }
-};
-
 class kernel_interface {
   struct session_initiation_packet {
     unsigned __int32 session_cookie;
@@ -191,16 +280,23 @@ class kernel_interface {
     wchar_t module_path[MAX_MODULE_PATH];
   };
 
+  struct module_image_registration {
+    void *module_base;
+  };
+
   struct apc_operation_init {
     int operation_id;
   };
 
-  HANDLE driver_handle;
-  LPCWSTR driver_name;
+  std::unique_ptr<device> driver;
   client::message_queue &message_queue;
-  HANDLE port;
-  std::mutex lock;
-  std::vector<event_dispatcher> events;
+  report_port reports;
+  trace_ring traces;
+#ifdef AC_DIAGNOSTIC_SINKS
+  std::unique_ptr<recorder::recorder> report_recorder;
+  HANDLE trace_file = INVALID_HANDLE_VALUE;
+#endif
+  std::function<void(UINT32)> report_observer;
 
   struct shared_data {
     unsigned __int32 status;
@@ -214,14 +310,19 @@ class kernel_interface {
 
   shared_mapping mapping;
 
-  void initiate_completion_port();
-  void terminate_completion_port();
-  event_dispatcher *get_free_event_entry();
-  void release_event_object(OVERLAPPED *event);
-  void *get_buffer_from_event_object(OVERLAPPED *event);
+#ifdef AC_DIAGNOSTIC_SINKS
+  void initiate_recorder();
+  void initiate_trace_file();
+#endif
+  void log_trace_events(PTRACE_DRAIN_HEADER header, unsigned long size);
+  void handle_trace_drain(void *buffer, unsigned long size);
 
   void notify_driver_on_process_launch();
+  void register_module_image();
   void notify_driver_on_process_termination();
+  bool call_driver(ioctl_code ioctl, void *input_buffer,
+                   unsigned long input_size, void *output_buffer,
+                   unsigned long output_size, unsigned long *bytes_returned);
   void generic_driver_call(ioctl_code ioctl);
   unsigned int generic_driver_call_output(ioctl_code ioctl, void *output_buffer,
                                           size_t buffer_size,
@@ -232,10 +333,19 @@ class kernel_interface {
   void generic_driver_call_apc(apc_operation operation);
 
 public:
-  kernel_interface(LPCWSTR driver_name, client::message_queue &queue);
+  kernel_interface(std::unique_ptr<device> driver,
+                   client::message_queue &queue);
   ~kernel_interface();
 
+  /*
+   * observer is called on the completion port thread with the code of every
+   * valid report, it must be set before run_completion_port is.
+   */
+  void set_report_observer(std::function<void(UINT32)> observer);
   void run_completion_port();
+
+  /* wakes every run_completion_port caller and has it return */
+  void stop_completion_port();
   void run_nmi_callbacks();
   void validate_pci_devices();
   void validate_system_driver_objects();
@@ -247,10 +357,14 @@ public:
   void scan_for_ept_hooks();
   void perform_dpc_stackwalk();
   void validate_system_modules();
+  void scan_process_executable_memory();
+  void scan_kernel_executable_memory();
   void verify_process_module_executable_regions();
   void initiate_apc_stackwalk();
   void send_pending_irp();
   void write_shared_mapping_operation(shared_state_operation_id operation_id);
   void initiate_shared_mapping();
+  void drain_trace_events();
+  void send_heartbeat();
 };
 } // namespace kernel_interface
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "report_port.h"
+
+#include <cstring>
+
+#include "../common.h"
+
+kernel_interface::report_port::report_port(device &driver, int slot_count,
+                                           unsigned long buffer_size)
+    : driver(driver) {
+  this->slots.resize(slot_count);
+  for (report_slot &slot : this->slots) {
+    slot.in_use = false;
+    slot.buffer.resize(buffer_size);
+  }
+}
+
+int kernel_interface::report_port::get_free_slot() {
+  std::lock_guard<std::mutex> lock(this->lock);
+  for (int index = 0; index < static_cast<int>(this->slots.size()); index++) {
+    if (this->slots[index].in_use == false) {
+      this->slots[index].in_use = true;
+      return index;
+    }
+  }
+  return -1;
+}
+
+void kernel_interface::report_port::release_slot(int slot) {
+  std::lock_guard<std::mutex> lock(this->lock);
+  /* simply zero our the buffer, no need to free and realloc */
+  memset(this->slots[slot].buffer.data(), 0, this->slots[slot].buffer.size());
+  this->slots[slot].in_use = false;
+}
+
+void kernel_interface::report_port::queue_all() {
+  for (size_t index = 0; index < this->slots.size(); index++)
+    this->queue_slot();
+}
+
+void kernel_interface::report_port::queue_slot() {
+  int slot = this->get_free_slot();
+  if (slot < 0) {
+    LOG_ERROR("All event objects in use.");
+    return;
+  }
+  report_slot &entry = this->slots[slot];
+  if (!this->driver.queue_report_buffer(
+          slot, entry.buffer.data(),
+          static_cast<unsigned long>(entry.buffer.size()))) {
+    LOG_ERROR("failed to insert irp into irp queue");
+    this->release_slot(slot);
+  }
+}
+
+void kernel_interface::report_port::run(const report_handler &handler) {
+  int slot = 0;
+  unsigned long bytes = 0;
+  while (this->driver.wait_for_report(&slot, &bytes)) {
+    if (slot < 0 || slot >= static_cast<int>(this->slots.size()))
+      continue;
+    handler(this->slots[slot].buffer.data(), bytes);
+    this->release_slot(slot);
+    this->queue_slot();
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "device.h"
+
+namespace kernel_interface {
+
+/*
+ * Keeps a fixed set of report buffers queued with the driver and runs the
+ * completion loop. Any number of threads can call run, each completed buffer
+ * is handed to the handler then immediately requeued.
+ */
+class report_port {
+  struct report_slot {
+    bool in_use;
+    std::vector<unsigned char> buffer;
+  };
+
+  device &driver;
+  std::mutex lock;
+  std::vector<report_slot> slots;
+
+  int get_free_slot();
+  void release_slot(int slot);
+
+public:
+  using report_handler = std::function<void(void *buffer, unsigned long size)>;
+
+  report_port(device &driver, int slot_count, unsigned long buffer_size);
+
+  void queue_all();
+  void queue_slot();
+  void run(const report_handler &handler);
+};
+
+} // namespace kernel_interface
@@ -0,0 +1,265 @@
+#include "simulated_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+#include "ioctl.h"
+
+#include "../../core/heartbeat.h"
+#include "../../core/report.h"
+
+/* back to back reports within a burst, e.g. a scan flagging many objects */
+static constexpr std::chrono::microseconds BURST_SPACING(10);
+static constexpr size_t SHARED_PAGE_SIZE = 0x1000;
+
+static constexpr uint32_t report_codes[] = {
+    REPORT_NMI_CALLBACK_FAILURE,     REPORT_MODULE_VALIDATION_FAILURE,
+    REPORT_ILLEGAL_HANDLE_OPERATION, REPORT_INVALID_PROCESS_ALLOCATION,
+    REPORT_HIDDEN_SYSTEM_THREAD,     REPORT_ILLEGAL_ATTACH_PROCESS,
+    REPORT_APC_STACKWALK,            REPORT_DPC_STACKWALK,
+    REPORT_DATA_TABLE_ROUTINE,       REPORT_INVALID_PROCESS_MODULE,
+    REPORT_DATA_POINTER_HOOK,        REPORT_PRIVATE_EXECUTABLE_MEMORY,
+    REPORT_MODULE_IMAGE_MODIFIED,    REPORT_UNOWNED_EXECUTABLE_MEMORY,
+    REPORT_UNBACKED_SYSTEM_THREAD,   REPORT_DRIVER_DISPATCH_HOOK};
+
+kernel_interface::simulated_device::simulated_device(
+    const simulated_device_config &config)
+    : config(config), rng(config.seed), shared_page(SHARED_PAGE_SIZE),
+      stats(), heartbeat_sequence(0),
+      started(std::chrono::steady_clock::now()), terminate(false) {
+  if (this->config.report_rate > 0)
+    this->generator = std::thread(&simulated_device::run_generator, this);
+}
+
+kernel_interface::simulated_device::~simulated_device() { this->shutdown(); }
+
+/*
+ * Same shape as the reports the driver writes, the code, a few address sized
+ * fields and a short string with the rest of the structure zeroed.
+ */
+void kernel_interface::simulated_device::make_report() {
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  uint32_t code = report_codes[this->rng() % std::size(report_codes)];
+  uint32_t size = ReportGetExpectedSize(code);
+  uint32_t used = std::min<uint32_t>(size, 24 + this->rng() % 64);
+
+  this->report.assign(size, 0);
+  for (uint32_t index = sizeof(code); index < used; index++)
+    this->report[index] = static_cast<unsigned char>(this->rng() % 255 + 1);
+
+  if (chance(this->rng) < this->config.malformed_ratio) {
+    if (this->rng() % 2)
+      code += 1;
+    else
+      this->report.resize(size / 2);
+  }
+
+  memcpy(this->report.data(), &code, sizeof(code));
+}
+
+void kernel_interface::simulated_device::complete(const queued_buffer &entry,
+                                                  const unsigned char *report,
+                                                  unsigned long size) {
+  unsigned long bytes = std::min(size, entry.size);
+  memcpy(entry.buffer, report, bytes);
+  this->completed.push_back({entry.slot, bytes});
+  this->stats.completed++;
+  this->completed_condition.notify_one();
+}
+
+/* called with the lock held */
+void kernel_interface::simulated_device::submit_report() {
+  this->make_report();
+  this->stats.generated++;
+
+  if (!this->pending.empty()) {
+    queued_buffer entry = this->pending.front();
+    this->pending.pop_front();
+    this->complete(entry, this->report.data(),
+                   static_cast<unsigned long>(this->report.size()));
+    return;
+  }
+
+  if (this->deferred.size() >= this->config.deferred_max) {
+    this->stats.dropped++;
+    return;
+  }
+
+  this->deferred.push_back(this->report);
+  this->stats.deferred++;
+}
+
+void kernel_interface::simulated_device::run_generator() {
+  std::exponential_distribution<double> interval(this->config.report_rate);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  std::unique_lock<std::mutex> lock(this->lock);
+  uint32_t burst = 0;
+
+  while (!this->terminate) {
+    std::chrono::duration<double> wait(0);
+    if (burst) {
+      wait = BURST_SPACING;
+      burst--;
+    } else {
+      wait = std::chrono::duration<double>(interval(this->rng));
+      if (chance(this->rng) < this->config.burst_ratio)
+        burst = this->config.burst_size;
+    }
+
+    /* woken early by shutdown */
+    if (this->generator_condition.wait_for(
+            lock, wait, [this] { return this->terminate; }))
+      break;
+
+    this->submit_report();
+  }
+}
+
+void kernel_interface::simulated_device::inject(uint32_t count) {
+  std::lock_guard<std::mutex> lock(this->lock);
+  for (uint32_t index = 0; index < count; index++)
+    this->submit_report();
+}
+
+bool kernel_interface::simulated_device::call(unsigned long ioctl, void *input,
+                                              unsigned long input_size,
+                                              void *output,
+                                              unsigned long output_size,
+                                              unsigned long *bytes_returned) {
+  uint32_t latency = this->config.call_latency_us;
+  bool failed = false;
+  {
+    std::lock_guard<std::mutex> lock(this->lock);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    if (this->config.call_jitter_us)
+      latency += this->rng() % this->config.call_jitter_us;
+    failed = chance(this->rng) < this->config.call_failure_ratio;
+    this->stats.calls++;
+    this->stats.failed_calls += failed;
+  }
+
+  if (latency)
+    std::this_thread::sleep_for(std::chrono::microseconds(latency));
+
+  if (bytes_returned)
+    *bytes_returned = 0;
+
+  if (failed)
+    return false;
+
+  switch (ioctl) {
+  case ioctl_code::InitiateSharedMapping: {
+    if (!output || output_size < sizeof(shared_mapping))
+      return false;
+    shared_mapping mapping = {this->shared_page.data(),
+                              this->shared_page.size()};
+    memcpy(output, &mapping, sizeof(mapping));
+    if (bytes_returned)
+      *bytes_returned = sizeof(mapping);
+    return true;
+  }
+  case ioctl_code::QueryDeferredReports: {
+    std::lock_guard<std::mutex> lock(this->lock);
+    if (this->deferred.empty() || !output)
+      return true;
+    std::vector<unsigned char> &report = this->deferred.front();
+    unsigned long bytes =
+        std::min(output_size, static_cast<unsigned long>(report.size()));
+    memcpy(output, report.data(), bytes);
+    this->deferred.pop_front();
+    if (bytes_returned)
+      *bytes_returned = bytes;
+    return true;
+  }
+  case ioctl_code::QueryHeartbeat: {
+    static const unsigned char root[HEARTBEAT_ROOT_KEY_LENGTH] = {
+        HEARTBEAT_TEST_ROOT_KEY_BYTES};
+    unsigned char key[HEARTBEAT_KEY_LENGTH] = {0};
+    HEARTBEAT_PACKET packet = {0};
+    if (!output || output_size < sizeof(packet))
+      return false;
+    {
+      std::lock_guard<std::mutex> lock(this->lock);
+      packet.sequence = ++this->heartbeat_sequence;
+      packet.report_count = static_cast<UINT32>(this->stats.generated);
+    }
+    packet.session_cookie = this->config.session_cookie;
+    packet.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - this->started)
+                      .count();
+    HeartbeatDeriveKey((PVOID)root, sizeof(root), packet.session_cookie, key);
+    HeartbeatSign(&packet, key, sizeof(key));
+    memcpy(output, &packet, sizeof(packet));
+    if (bytes_returned)
+      *bytes_returned = sizeof(packet);
+    return true;
+  }
+  case ioctl_code::PerformVirtualisationCheck:
+    if (output)
+      memset(output, 0, output_size);
+    if (bytes_returned)
+      *bytes_returned = output_size;
+    return true;
+  default: return true;
+  }
+}
+
+/*
+ * Like the driver, a deferred report is completed straight into the new
+ * buffer rather than the buffer being queued.
+ */
+bool kernel_interface::simulated_device::queue_report_buffer(
+    int slot, void *buffer, unsigned long buffer_size) {
+  std::lock_guard<std::mutex> lock(this->lock);
+  queued_buffer entry = {slot, buffer, buffer_size};
+
+  if (this->terminate)
+    return false;
+
+  if (!this->deferred.empty()) {
+    std::vector<unsigned char> report = std::move(this->deferred.front());
+    this->deferred.pop_front();
+    this->complete(entry, report.data(),
+                   static_cast<unsigned long>(report.size()));
+    return true;
+  }
+
+  this->pending.push_back(entry);
+  return true;
+}
+
+bool kernel_interface::simulated_device::wait_for_report(int *slot,
+                                                         unsigned long *bytes) {
+  std::unique_lock<std::mutex> lock(this->lock);
+  this->completed_condition.wait(lock, [this] {
+    return !this->completed.empty() || this->terminate;
+  });
+
+  if (this->terminate)
+    return false;
+
+  *slot = this->completed.front().slot;
+  *bytes = this->completed.front().bytes;
+  this->completed.pop_front();
+  return true;
+}
+
+void kernel_interface::simulated_device::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(this->lock);
+    this->terminate = true;
+    this->pending.clear();
+  }
+  this->completed_condition.notify_all();
+  this->generator_condition.notify_all();
+  if (this->generator.joinable())
+    this->generator.join();
+}
+
+kernel_interface::simulated_device_stats
+kernel_interface::simulated_device::get_stats() {
+  std::lock_guard<std::mutex> lock(this->lock);
+  return this->stats;
+}
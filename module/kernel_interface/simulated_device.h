@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "device.h"
+
+/*
+ * The simulation answers every check with whatever it is configured to, so it
+ * is only built into the test configuration and the benchmarks.
+ */
+#ifndef AC_SIMULATED_DRIVER
+#error "simulated_device is only part of AC_SIMULATED_DRIVER builds"
+#endif
+
+namespace kernel_interface {
+
+/*
+ * When set, the module talks to simulated_device instead of the driver. This
+ * lets the dispatcher and completion port run on a machine without the
+ * driver loaded, and on the host for benchmarking.
+ */
+static constexpr wchar_t SIMULATED_DRIVER_VARIABLE[] =
+    L"DONNA_AC_SIMULATED_DRIVER";
+
+/* same as MAX_DEFERRED_REPORTS_COUNT in driver/io.c */
+static constexpr size_t SIMULATED_DEFERRED_REPORT_MAX = 100;
+
+struct simulated_device_config {
+  /* reports per second generated in the background, 0 to only use inject */
+  double report_rate = 50.0;
+  /* chance a report starts a burst, and the reports in one */
+  double burst_ratio = 0.01;
+  uint32_t burst_size = 32;
+  /* time each synchronous ioctl takes */
+  uint32_t call_latency_us = 0;
+  uint32_t call_jitter_us = 0;
+  /* fraction of synchronous ioctls that fail */
+  double call_failure_ratio = 0.0;
+  /* fraction of reports with a wrong code or size */
+  double malformed_ratio = 0.0;
+  size_t deferred_max = SIMULATED_DEFERRED_REPORT_MAX;
+  uint64_t seed = 1;
+  /* heartbeats are signed under the all zero development root key */
+  uint32_t session_cookie = 0;
+};
+
+struct simulated_device_stats {
+  uint64_t calls;
+  uint64_t failed_calls;
+  uint64_t generated;
+  uint64_t completed;
+  uint64_t deferred;
+  uint64_t dropped;
+};
+
+/*
+ * Mirrors the driver's irp queue: a report completes a queued buffer if one
+ * is available, otherwise it is deferred until the next buffer is queued and
+ * dropped once too many are waiting.
+ */
+class simulated_device : public device {
+  struct queued_buffer {
+    int slot;
+    void *buffer;
+    unsigned long size;
+  };
+
+  struct completion {
+    int slot;
+    unsigned long bytes;
+  };
+
+  struct shared_mapping {
+    void *buffer;
+    size_t size;
+  };
+
+  simulated_device_config config;
+  std::mutex lock;
+  std::condition_variable completed_condition;
+  std::condition_variable generator_condition;
+  std::deque<queued_buffer> pending;
+  std::deque<std::vector<unsigned char>> deferred;
+  std::deque<completion> completed;
+  std::mt19937_64 rng;
+  std::vector<unsigned char> report;
+  std::vector<unsigned char> shared_page;
+  simulated_device_stats stats;
+  uint64_t heartbeat_sequence;
+  std::chrono::steady_clock::time_point started;
+  bool terminate;
+  std::thread generator;
+
+  void run_generator();
+  void make_report();
+  void submit_report();
+  void complete(const queued_buffer &entry, const unsigned char *report,
+                unsigned long size);
+
+public:
+  simulated_device(const simulated_device_config &config);
+  ~simulated_device();
+
+  bool is_open() override { return true; }
+  bool call(unsigned long ioctl, void *input, unsigned long input_size,
+            void *output, unsigned long output_size,
+            unsigned long *bytes_returned) override;
+  bool queue_report_buffer(int slot, void *buffer,
+                           unsigned long buffer_size) override;
+  bool wait_for_report(int *slot, unsigned long *bytes) override;
+  void shutdown() override;
+
+  /* generates count reports immediately, regardless of report_rate */
+  void inject(uint32_t count);
+  simulated_device_stats get_stats();
+};
+} // namespace kernel_interface
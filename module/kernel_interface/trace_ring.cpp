@@ -0,0 +1,55 @@
+#include "trace_ring.h"
+
+#include <intrin.h>
+
+#include "../common.h"
+
+/* how long to spin for when measuring the tsc frequency, in milliseconds */
+static constexpr unsigned __int64 TSC_CALIBRATION_PERIOD = 10;
+
+static unsigned __int64 calibrate_tsc_frequency() {
+  LARGE_INTEGER frequency = {0};
+  LARGE_INTEGER start = {0};
+  LARGE_INTEGER now = {0};
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&start);
+  unsigned __int64 tsc_start = __rdtsc();
+  unsigned __int64 period = frequency.QuadPart * TSC_CALIBRATION_PERIOD / 1000;
+  do {
+    QueryPerformanceCounter(&now);
+  } while (static_cast<unsigned __int64>(now.QuadPart - start.QuadPart) <
+           period);
+  unsigned __int64 tsc_end = __rdtsc();
+  return (tsc_end - tsc_start) * frequency.QuadPart /
+         (now.QuadPart - start.QuadPart);
+}
+
+kernel_interface::trace_ring::trace_ring(unsigned int capacity) {
+  DWORD cpu_count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+  this->storage.resize(TraceGetBufferSize(cpu_count, capacity));
+  NTSTATUS status =
+      TraceInitialise(this->storage.data(), this->storage.size(), cpu_count,
+                      capacity, calibrate_tsc_frequency(), TRACE_SOURCE_MODULE);
+  if (!NT_SUCCESS(status)) {
+    LOG_ERROR("TraceInitialise failed with status %x", status);
+    this->storage.clear();
+  }
+}
+
+unsigned __int64 kernel_interface::trace_ring::timestamp() { return __rdtsc(); }
+
+void kernel_interface::trace_ring::write_span(TRACE_CHECK_ID check,
+                                              unsigned __int64 start,
+                                              unsigned __int64 result) {
+  if (this->storage.empty())
+    return;
+  TraceWriteSpan(this->buffer(), GetCurrentProcessorNumber(), start,
+                 __rdtsc(), static_cast<UINT16>(check), result);
+}
+
+unsigned long kernel_interface::trace_ring::drain(void *output,
+                                                  unsigned long size) {
+  if (this->storage.empty())
+    return 0;
+  return static_cast<unsigned long>(TraceDrain(this->buffer(), output, size));
+}
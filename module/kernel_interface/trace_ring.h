@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <vector>
+
+#include "../../core/trace.h"
+
+namespace kernel_interface {
+
+/*
+ * The module's own trace rings, one per logical processor like the driver's.
+ * Events are stamped with the same tsc the driver uses so spans recorded here
+ * line up with the driver's once both are drained, see core/trace.h.
+ */
+class trace_ring {
+  std::vector<unsigned char> storage;
+
+  PTRACE_BUFFER buffer() {
+    return reinterpret_cast<PTRACE_BUFFER>(this->storage.data());
+  }
+
+public:
+  trace_ring(unsigned int capacity);
+
+  static unsigned __int64 timestamp();
+
+  void write_span(TRACE_CHECK_ID check, unsigned __int64 start,
+                  unsigned __int64 result);
+  unsigned long drain(void *output, unsigned long size);
+};
+
+} // namespace kernel_interface
@@ -5,6 +5,12 @@
 #include "client/message_queue.h"
 #include "dispatcher/dispatcher.h"
 
+#include <mutex>
+
+/* the dispatcher run is in, for terminate to stop */
+static std::mutex              running_lock;
+static dispatcher::dispatcher* running_dispatcher = nullptr;
+
 void
 module::run(HINSTANCE hinstDLL)
 {
@@ -18,9 +24,20 @@ module::run(HINSTANCE hinstDLL)
         LPTSTR  pipe_name   = (LPTSTR)L"\\\\.\\pipe\\DonnaACPipe";
         LPCWSTR driver_name = L"\\\\.\\DonnaAC";
 
-        client::message_queue  queue(pipe_name);
-        dispatcher::dispatcher dispatch(driver_name, queue);
-        dispatch.run();
+        {
+                client::message_queue  queue(pipe_name);
+                dispatcher::dispatcher dispatch(driver_name, queue);
+
+                {
+                        std::lock_guard<std::mutex> lock(running_lock);
+                        running_dispatcher = &dispatch;
+                }
+
+                dispatch.run();
+
+                std::lock_guard<std::mutex> lock(running_lock);
+                running_dispatcher = nullptr;
+        }
 
 #if DEBUG
         fclose(stdout);
@@ -31,7 +48,15 @@ module::run(HINSTANCE hinstDLL)
         FreeLibraryAndExitThread(hinstDLL, 0);
 }
 
+/*
+ * Stops the dispatcher, run then tears it and the queue down and unloads the
+ * module from its own thread.
+ */
 void
 module::terminate()
 {
+        std::lock_guard<std::mutex> lock(running_lock);
+
+        if (running_dispatcher)
+                running_dispatcher->shutdown();
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "recorder.h"
+
+#include "../common.h"
+
+#include "../../core/recording.h"
+
+recorder::recorder::recorder(LPCWSTR path) {
+  FILETIME wall_clock = {0};
+  ULARGE_INTEGER time = {0};
+  QueryPerformanceFrequency(&this->frequency);
+  QueryPerformanceCounter(&this->start);
+  this->file = CreateFileW(path, FILE_APPEND_DATA, FILE_SHARE_READ, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (this->file == INVALID_HANDLE_VALUE) {
+    LOG_ERROR("Failed to open recording file with status %x", GetLastError());
+    return;
+  }
+  GetSystemTimeAsFileTime(&wall_clock);
+  time.LowPart = wall_clock.dwLowDateTime;
+  time.HighPart = wall_clock.dwHighDateTime;
+  std::lock_guard<std::mutex> lock(this->lock);
+  this->write(this->buffer,
+              RecordingEncodeSession(this->buffer, sizeof(this->buffer),
+                                     time.QuadPart));
+}
+
+recorder::recorder::~recorder() {
+  if (this->file != INVALID_HANDLE_VALUE)
+    CloseHandle(this->file);
+}
+
+unsigned __int64 recorder::recorder::get_session_time() {
+  LARGE_INTEGER now = {0};
+  QueryPerformanceCounter(&now);
+  unsigned __int64 ticks = now.QuadPart - this->start.QuadPart;
+  /* split to avoid overflowing the multiplication on long sessions */
+  return (ticks / this->frequency.QuadPart) * 1000000000ull +
+         (ticks % this->frequency.QuadPart) * 1000000000ull /
+             this->frequency.QuadPart;
+}
+
+/* assumes lock is held */
+void recorder::recorder::write(void *data, unsigned long size) {
+  unsigned long bytes_written = 0;
+  if (!size)
+    return;
+  if (!WriteFile(this->file, data, size, &bytes_written, nullptr))
+    LOG_ERROR("Failed to write recording block with status %x",
+              GetLastError());
+}
+
+/*
+ * Called by every completion port thread, the lock keeps blocks from
+ * interleaving.
+ */
+void recorder::recorder::record(void *report, unsigned long size) {
+  if (!this->is_open() || !report)
+    return;
+  std::lock_guard<std::mutex> lock(this->lock);
+  SIZE_T length = RecordingEncodeReport(this->buffer, sizeof(this->buffer),
+                                        this->get_session_time(), report, size);
+  if (!length) {
+    LOG_ERROR("Report of size %lx too large to record", size);
+    return;
+  }
+  this->write(this->buffer, static_cast<unsigned long>(length));
+}
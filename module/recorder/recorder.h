@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <mutex>
+
+/*
+ * Recordings hold every report exactly as the driver sent it, so the
+ * recorder is only built into the test configuration.
+ */
+#ifndef AC_DIAGNOSTIC_SINKS
+#error "the recorder is only part of AC_DIAGNOSTIC_SINKS builds"
+#endif
+
+namespace recorder {
+
+/*
+ * When set, every raw report buffer received from the driver is appended to
+ * the file it names. See core/recording.h for the format, the recordings can
+ * be replayed on the host with tools/replay.
+ */
+static constexpr wchar_t RECORDING_PATH_VARIABLE[] = L"DONNA_AC_RECORDING";
+static constexpr int RECORDING_BUFFER_SIZE = 0x1000;
+
+class recorder {
+  HANDLE file;
+  std::mutex lock;
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER start;
+  unsigned char buffer[RECORDING_BUFFER_SIZE];
+
+  unsigned __int64 get_session_time();
+  void write(void *data, unsigned long size);
+
+public:
+  recorder(LPCWSTR path);
+  ~recorder();
+
+  bool is_open() { return this->file != INVALID_HANDLE_VALUE; }
+  void record(void *report, unsigned long size);
+};
+} // namespace recorder
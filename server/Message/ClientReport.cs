@@ -540,6 +540,14 @@ namespace server.Message
                 report.ThreadId,
                 report.ThreadAddress);
 
+            _logger.Information("attacher: {0} ({1:x}), signature level: {2:x}, rounds: {3}, threads: {4}, dwell: {5} ms",
+                report.ImageName,
+                report.ProcessId,
+                report.SignatureLevel,
+                report.Rounds,
+                report.MaxThreads,
+                report.DwellTime / 10000);
+
             using (var context = new ModelContext())
             {
                 UserEntity user = new UserEntity(context);
@@ -0,0 +1,199 @@
+﻿using Serilog;
+using System;
+using System.Buffers.Binary;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
+using System.Security.Cryptography;
+
+namespace server.Message
+{
+    /*
+     * Tracks each client's heartbeats the way HeartbeatTrack in
+     * core/heartbeat.c does. Every heartbeat is checked against a key derived
+     * from the session cookie and the root key the driver was built with, so
+     * only the driver could have signed it. A heartbeat that verifies under a
+     * new cookie starts a new stream, the client started another session, and
+     * one under a cookie an earlier session used is a replay.
+     */
+    public class HeartbeatTracker
+    {
+        private const string ROOT_KEY_VARIABLE = "DONNA_AC_HEARTBEAT_KEY";
+        private const uint HEARTBEAT_MAGIC = 0x74626841;
+        private const uint HEARTBEAT_KEY_MAGIC = 0x6b626841;
+        private const int HEARTBEAT_ROOT_KEY_LENGTH = 32;
+        private const int HEARTBEAT_KEY_LENGTH = 16;
+        private const int HEARTBEAT_MAC_LENGTH = 16;
+        private const long HEARTBEAT_INTERVAL_MS = 10000;
+        private const long HEARTBEAT_LATE_FACTOR = 2;
+        private const long HEARTBEAT_SKEW_DIVISOR = 2;
+
+        /* the mac covers everything ahead of it */
+        private const int MAC_OFFSET = 32;
+        public const int PACKET_SIZE = MAC_OFFSET + HEARTBEAT_MAC_LENGTH;
+
+        [Flags]
+        public enum Verdict
+        {
+            None = 0,
+            Forged = 0x1,
+            Replayed = 0x2,
+            Gap = 0x4,
+            Late = 0x8,
+            Skewed = 0x10,
+            Unverified = 0x20
+        }
+
+        private static readonly byte[]? RootKey = LoadRootKey();
+        private static readonly ConcurrentDictionary<ulong, HeartbeatTracker> Trackers =
+            new ConcurrentDictionary<ulong, HeartbeatTracker>();
+
+        private bool _started;
+        private uint _sessionCookie;
+        private byte[] _key = Array.Empty<byte>();
+        private readonly HashSet<uint> _endedSessions = new HashSet<uint>();
+        private ulong _nextSequence;
+        private ulong _lastTime;
+        private long _lastReceived;
+
+        public ulong Accepted { get; private set; }
+        public ulong Missed { get; private set; }
+
+        public static HeartbeatTracker ForClient(ulong steam64Id)
+        {
+            return Trackers.GetOrAdd(steam64Id, _ => new HeartbeatTracker());
+        }
+
+        /*
+         * There is no default key, without one every heartbeat is reported as
+         * unverified rather than checked against a key anyone could know.
+         */
+        private static byte[]? LoadRootKey()
+        {
+            string? hex = Environment.GetEnvironmentVariable(ROOT_KEY_VARIABLE);
+
+            if (string.IsNullOrEmpty(hex))
+            {
+                Log.Error("{0} is not set, heartbeats cant be verified", ROOT_KEY_VARIABLE);
+                return null;
+            }
+
+            try
+            {
+                byte[] key = Convert.FromHexString(hex);
+
+                if (key.Length == HEARTBEAT_ROOT_KEY_LENGTH)
+                    return key;
+            }
+            catch (FormatException)
+            {
+            }
+
+            Log.Error("{0} is not a {1} byte hex key, heartbeats cant be verified",
+                ROOT_KEY_VARIABLE, HEARTBEAT_ROOT_KEY_LENGTH);
+            return null;
+        }
+
+        private static byte[] DeriveKey(byte[] rootKey, uint sessionCookie)
+        {
+            byte[] input = new byte[2 * sizeof(uint)];
+
+            BinaryPrimitives.WriteUInt32LittleEndian(input, HEARTBEAT_KEY_MAGIC);
+            BinaryPrimitives.WriteUInt32LittleEndian(input.AsSpan(sizeof(uint)), sessionCookie);
+
+            using (HMACSHA256 hmac = new HMACSHA256(rootKey))
+                return hmac.ComputeHash(input).AsSpan(0, HEARTBEAT_KEY_LENGTH).ToArray();
+        }
+
+        private static bool Verify(ReadOnlySpan<byte> packet, byte[] key)
+        {
+            if (BinaryPrimitives.ReadUInt32LittleEndian(packet) != HEARTBEAT_MAGIC)
+                return false;
+
+            using (HMACSHA256 hmac = new HMACSHA256(key))
+            {
+                byte[] mac = hmac.ComputeHash(packet.Slice(0, MAC_OFFSET).ToArray());
+
+                return CryptographicOperations.FixedTimeEquals(
+                    mac.AsSpan(0, HEARTBEAT_MAC_LENGTH),
+                    packet.Slice(MAC_OFFSET, HEARTBEAT_MAC_LENGTH));
+            }
+        }
+
+        private static ulong Distance(ulong left, ulong right)
+        {
+            return left > right ? left - right : right - left;
+        }
+
+        /*
+         * Checks the heartbeat in packet, received at received milliseconds
+         * on the server's clock. Forged and replayed heartbeats leave the
+         * stream where it was, as does every heartbeat when there is no root
+         * key to check them against.
+         */
+        public Verdict Track(ReadOnlySpan<byte> packet, long received)
+        {
+            Verdict verdict = Verdict.None;
+            byte[]? rootKey = RootKey;
+
+            if (rootKey == null)
+                return Verdict.Unverified;
+
+            if (packet.Length < PACKET_SIZE)
+                return Verdict.Forged;
+
+            uint cookie = BinaryPrimitives.ReadUInt32LittleEndian(packet.Slice(4));
+            ulong sequence = BinaryPrimitives.ReadUInt64LittleEndian(packet.Slice(8));
+            ulong time = BinaryPrimitives.ReadUInt64LittleEndian(packet.Slice(16));
+
+            lock (this)
+            {
+                if (_endedSessions.Contains(cookie))
+                    return Verdict.Replayed;
+
+                bool newSession = !_started || cookie != _sessionCookie;
+                byte[] key = newSession ? DeriveKey(rootKey, cookie) : _key;
+
+                if (!Verify(packet, key))
+                    return Verdict.Forged;
+
+                if (newSession)
+                {
+                    if (_started)
+                        _endedSessions.Add(_sessionCookie);
+
+                    _started = false;
+                    _sessionCookie = cookie;
+                    _key = key;
+                }
+
+                if (_started)
+                {
+                    if (sequence < _nextSequence || time < _lastTime)
+                        return Verdict.Replayed;
+
+                    if (sequence > _nextSequence)
+                    {
+                        Missed += sequence - _nextSequence;
+                        verdict |= Verdict.Gap;
+                    }
+
+                    ulong elapsed = (ulong)(received - _lastReceived);
+
+                    if (elapsed > HEARTBEAT_INTERVAL_MS * HEARTBEAT_LATE_FACTOR)
+                        verdict |= Verdict.Late;
+
+                    if (Distance(time - _lastTime, elapsed) >
+                        HEARTBEAT_INTERVAL_MS / HEARTBEAT_SKEW_DIVISOR)
+                        verdict |= Verdict.Skewed;
+                }
+
+                _started = true;
+                _nextSequence = sequence + 1;
+                _lastTime = time;
+                _lastReceived = received;
+                Accepted++;
+                return verdict;
+            }
+        }
+    }
+}
@@ -31,7 +31,9 @@ namespace server.Message
         {
             MESSAGE_TYPE_CLIENT_REPORT = 1,
             MESSAGE_TYPE_CLIENT_SEND = 2,
-            MESSAGE_TYPE_CLIENT_REQUEST = 3
+            MESSAGE_TYPE_CLIENT_REQUEST = 3,
+            MESSAGE_TYPE_CLIENT_PACKED_REPORT = 4,
+            MESSAGE_TYPE_CLIENT_HEARTBEAT = 5
         }
 
         public struct PACKET_HEADER
@@ -59,6 +61,12 @@ namespace server.Message
                 case (int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_REPORT:
                     HandleClientSendReport();
                     break;
+                case (int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_PACKED_REPORT:
+                    HandleClientSendPackedReport();
+                    break;
+                case (int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_HEARTBEAT:
+                    HandleClientHeartbeat();
+                    break;
                 case (int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_SEND:
                     HandleClientSendMessage();
                     break;
@@ -82,6 +90,61 @@ namespace server.Message
             _logger.Warning("Failed to handle client sent report");
         }
 
+        /*
+         * Packed reports are unpacked back into the layout ClientReport walks,
+         * a packet header in front of every report, and handled as usual.
+         */
+        private void HandleClientSendPackedReport()
+        {
+            int headerSize = Marshal.SizeOf(typeof(PACKET_HEADER));
+            List<byte> unpacked = new List<byte>();
+            int offset = 0;
+
+            while (offset + headerSize < _bufferSize)
+            {
+                PACKET_HEADER header = Helper.BytesToStructure<PACKET_HEADER>(_buffer, offset);
+
+                if (header.message_type != (int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_PACKED_REPORT ||
+                    !ReportUnpacker.Shared.Unpack(_buffer, offset + headerSize,
+                        _bufferSize - offset - headerSize, out byte[] report, out int consumed))
+                {
+                    _logger.Warning("Failed to unpack client sent report");
+                    return;
+                }
+
+                unpacked.AddRange(BitConverter.GetBytes((int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_REPORT));
+                unpacked.AddRange(_buffer.Skip(offset + sizeof(int)).Take(headerSize - sizeof(int)));
+                unpacked.AddRange(report);
+                offset += headerSize + consumed;
+            }
+
+            _header.message_type = (int)MESSAGE_TYPE.MESSAGE_TYPE_CLIENT_REPORT;
+            _buffer = unpacked.ToArray();
+            _bufferSize = _buffer.Length;
+
+            HandleClientSendReport();
+        }
+
+        /* heartbeats are never acked, the module doesnt wait on them */
+        private void HandleClientHeartbeat()
+        {
+            int offset = Marshal.SizeOf(typeof(PACKET_HEADER));
+
+            if (_bufferSize - offset < HeartbeatTracker.PACKET_SIZE)
+            {
+                _logger.Warning("Received truncated heartbeat of size {0}", _bufferSize);
+                return;
+            }
+
+            HeartbeatTracker tracker = HeartbeatTracker.ForClient(_header.steam64_id);
+            HeartbeatTracker.Verdict verdict = tracker.Track(
+                _buffer.AsSpan(offset, HeartbeatTracker.PACKET_SIZE), Environment.TickCount64);
+
+            if (verdict != HeartbeatTracker.Verdict.None)
+                _logger.Warning("Heartbeat from {0} flagged {1}, {2} missed so far",
+                    _header.steam64_id, verdict, tracker.Missed);
+        }
+
         private void HandleClientSendMessage()
         {
             ClientSend send = new ClientSend(_logger, ref _buffer, _bufferSize, _header);
@@ -0,0 +1,189 @@
+﻿using Serilog;
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace server.Message
+{
+    /*
+     * Unpacks the reports the module sends as MESSAGE_TYPE_CLIENT_PACKED_REPORT,
+     * the same format as ReportUnpackMessage in core/reportpack.c. Each one is
+     * the id of the dictionary it was packed against, a pack header and a run
+     * of match and literal tokens against the reference for its report code.
+     */
+    public class ReportUnpacker
+    {
+        private const string DICTIONARY_PATH_VARIABLE = "DONNA_AC_DICTIONARY";
+        private const uint DICTIONARY_MAGIC = 0x63696441;
+        private const ushort DICTIONARY_VERSION = 1;
+        private const int DICTIONARY_HEADER_SIZE = 16;
+        private const int DICTIONARY_RECORD_SIZE = 8;
+        private const int DICTIONARY_MAX_ENTRIES = 64;
+        private const int DICTIONARY_MAX_SIZE = 0x1000;
+        private const uint HASH_SEED = 0x811c9dc5;
+        private const uint HASH_MULTIPLIER = 0x01000193;
+
+        /* dictionary id, then report code, size and packed size */
+        private const int PACK_HEADER_SIZE = 12;
+
+        private static readonly byte[] ZeroReference = new byte[DICTIONARY_MAX_SIZE];
+
+        private readonly Dictionary<uint, byte[]> _references = new Dictionary<uint, byte[]>();
+
+        public uint Id { get; private set; }
+
+        public static readonly ReportUnpacker Shared = FromEnvironment();
+
+        /* without a dictionary reports packed against zeroes are still unpacked */
+        private static ReportUnpacker FromEnvironment()
+        {
+            ReportUnpacker unpacker = new ReportUnpacker();
+            string? path = Environment.GetEnvironmentVariable(DICTIONARY_PATH_VARIABLE);
+
+            if (string.IsNullOrEmpty(path))
+                return unpacker;
+
+            try
+            {
+                if (!unpacker.Load(File.ReadAllBytes(path)))
+                {
+                    Log.Error("{0} is not a report dictionary", path);
+                    return new ReportUnpacker();
+                }
+            }
+            catch (IOException ex)
+            {
+                Log.Error("Failed to read the report dictionary: {0}", ex.Message);
+                return new ReportUnpacker();
+            }
+
+            Log.Information("Unpacking reports against dictionary {0:x}", unpacker.Id);
+            return unpacker;
+        }
+
+        private static uint Hash(byte[] buffer, int offset)
+        {
+            uint hash = HASH_SEED;
+
+            for (int index = offset; index < buffer.Length; index++)
+                hash = unchecked((hash ^ buffer[index]) * HASH_MULTIPLIER);
+
+            return hash;
+        }
+
+        private bool Load(byte[] data)
+        {
+            int offset = DICTIONARY_HEADER_SIZE;
+
+            if (data.Length < DICTIONARY_HEADER_SIZE)
+                return false;
+
+            uint magic = BitConverter.ToUInt32(data, 0);
+            ushort version = BitConverter.ToUInt16(data, 4);
+            ushort count = BitConverter.ToUInt16(data, 6);
+            uint id = BitConverter.ToUInt32(data, 8);
+
+            if (magic != DICTIONARY_MAGIC || version != DICTIONARY_VERSION ||
+                count > DICTIONARY_MAX_ENTRIES || id != Hash(data, offset))
+                return false;
+
+            for (int index = 0; index < count; index++)
+            {
+                if (data.Length - offset < DICTIONARY_RECORD_SIZE)
+                    return false;
+
+                uint code = BitConverter.ToUInt32(data, offset);
+                uint size = BitConverter.ToUInt32(data, offset + 4);
+                offset += DICTIONARY_RECORD_SIZE;
+
+                if (size == 0 || size > DICTIONARY_MAX_SIZE || data.Length - offset < size)
+                    return false;
+
+                _references[code] = data.AsSpan(offset, (int)size).ToArray();
+                offset += (int)size;
+            }
+
+            if (offset != data.Length)
+                return false;
+
+            Id = id;
+            return true;
+        }
+
+        private static int ReadVarint(byte[] buffer, int offset, int end, out int value)
+        {
+            value = 0;
+
+            for (int length = 0; length < 3 && offset + length < end; length++)
+            {
+                value |= (buffer[offset + length] & 0x7f) << (7 * length);
+
+                if ((buffer[offset + length] & 0x80) == 0)
+                    return length + 1;
+            }
+
+            return 0;
+        }
+
+        /*
+         * Unpacks the report at offset. Consumed is the length of the packed
+         * report, false is returned for a report packed against another
+         * dictionary or one that doesn't parse.
+         */
+        public bool Unpack(byte[] buffer, int offset, int length, out byte[] report, out int consumed)
+        {
+            report = Array.Empty<byte>();
+            consumed = 0;
+
+            if (length < PACK_HEADER_SIZE || BitConverter.ToUInt32(buffer, offset) != Id)
+                return false;
+
+            uint code = BitConverter.ToUInt32(buffer, offset + 4);
+            int size = BitConverter.ToUInt16(buffer, offset + 8);
+            int packedSize = BitConverter.ToUInt16(buffer, offset + 10);
+            int position = offset + PACK_HEADER_SIZE;
+            int end = position + packedSize;
+
+            if (size < sizeof(uint) || size > DICTIONARY_MAX_SIZE || length - PACK_HEADER_SIZE < packedSize)
+                return false;
+
+            byte[]? reference;
+            if (!_references.TryGetValue(code, out reference) || reference.Length != size)
+                reference = ZeroReference;
+
+            byte[] unpacked = new byte[size];
+            int written = 0;
+
+            while (written < size)
+            {
+                int read = ReadVarint(buffer, position, end, out int match);
+
+                if (read == 0 || match > size - written)
+                    return false;
+
+                position += read;
+                Array.Copy(reference, written, unpacked, written, match);
+                written += match;
+
+                read = ReadVarint(buffer, position, end, out int literal);
+
+                /* an empty token would never make progress */
+                if (read == 0 || (match == 0 && literal == 0) ||
+                    literal > size - written || literal > end - position - read)
+                    return false;
+
+                position += read;
+                Array.Copy(buffer, position, unpacked, written, literal);
+                written += literal;
+                position += literal;
+            }
+
+            if (position != end || BitConverter.ToUInt32(unpacked, 0) != code)
+                return false;
+
+            report = unpacked;
+            consumed = end - offset;
+            return true;
+        }
+    }
+}
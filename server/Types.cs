@@ -128,6 +128,15 @@ namespace server
                 public int ReportCode;
                 public int ThreadId;
                 public long ThreadAddress;
+                public int ProcessId;
+                public int SignatureLevel;
+                [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 16)]
+                public string ImageName;
+                public long DwellTime;
+                public int Rounds;
+                public int MaxThreads;
+                public int Samples;
+                public int Ended;
             }
         }
     }
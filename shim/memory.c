@@ -0,0 +1,335 @@
+#include "stats.h"
+
+#include <stdlib.h>
+
+/*
+ * The simulated address space is a sorted array of non overlapping regions.
+ * Each region maps a range of host memory, and optionally assigns it a
+ * physical address so physical copies and translations can be resolved.
+ */
+typedef struct _SHIM_REGION {
+    UINT64 base;
+    UINT64 size;
+    UINT64 physical;
+
+} SHIM_REGION, *PSHIM_REGION;
+
+STATIC PSHIM_REGION     regions        = NULL;
+STATIC SIZE_T           region_count   = 0;
+STATIC SIZE_T           region_maximum = 0;
+STATIC pthread_rwlock_t region_lock    = PTHREAD_RWLOCK_INITIALIZER;
+
+/* returns the index of the first region whose base is greater than Address */
+STATIC
+SIZE_T
+ShimRegionUpperBound(_In_ UINT64 Address)
+{
+    SIZE_T low  = 0;
+    SIZE_T high = region_count;
+
+    while (low < high) {
+        SIZE_T middle = low + (high - low) / 2;
+
+        if (regions[middle].base <= Address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+STATIC
+PSHIM_REGION
+ShimFindRegion(_In_ UINT64 Address)
+{
+    SIZE_T index = ShimRegionUpperBound(Address);
+
+    if (!index)
+        return NULL;
+
+    PSHIM_REGION region = &regions[index - 1];
+
+    if (Address - region->base >= region->size)
+        return NULL;
+
+    return region;
+}
+
+STATIC
+PSHIM_REGION
+ShimFindPhysicalRegion(_In_ UINT64 PhysicalAddress)
+{
+    for (SIZE_T index = 0; index < region_count; index++) {
+        PSHIM_REGION region = &regions[index];
+
+        if (region->physical == SHIM_NO_PHYSICAL_ADDRESS)
+            continue;
+
+        if (PhysicalAddress >= region->physical &&
+            PhysicalAddress - region->physical < region->size)
+            return region;
+    }
+
+    return NULL;
+}
+
+/*
+ * A copy may span several regions as long as they are virtually contiguous,
+ * just like a copy spanning several present pages.
+ */
+STATIC
+BOOLEAN
+ShimIsRangeMapped(_In_ UINT64 Address, _In_ SIZE_T Length)
+{
+    UINT64 end = Address + Length;
+
+    while (Address < end) {
+        PSHIM_REGION region = ShimFindRegion(Address);
+
+        if (!region)
+            return FALSE;
+
+        Address = region->base + region->size;
+    }
+
+    return TRUE;
+}
+
+NTSTATUS
+ShimMapRegion(_In_ PVOID Base, _In_ SIZE_T Size, _In_ UINT64 PhysicalBase)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    UINT64   base   = (UINT64)Base;
+    SIZE_T   index  = 0;
+
+    if (!Base || !Size)
+        return STATUS_INVALID_PARAMETER;
+
+    pthread_rwlock_wrlock(&region_lock);
+
+    index = ShimRegionUpperBound(base);
+
+    if (index && base - regions[index - 1].base < regions[index - 1].size) {
+        status = STATUS_INVALID_PARAMETER;
+        goto end;
+    }
+
+    if (index < region_count && base + Size > regions[index].base) {
+        status = STATUS_INVALID_PARAMETER;
+        goto end;
+    }
+
+    if (region_count == region_maximum) {
+        SIZE_T       maximum = region_maximum ? region_maximum * 2 : 64;
+        PSHIM_REGION entries = realloc(regions, maximum * sizeof(SHIM_REGION));
+
+        if (!entries) {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            goto end;
+        }
+
+        regions        = entries;
+        region_maximum = maximum;
+    }
+
+    memmove(&regions[index + 1],
+            &regions[index],
+            (region_count - index) * sizeof(SHIM_REGION));
+
+    regions[index].base     = base;
+    regions[index].size     = Size;
+    regions[index].physical = PhysicalBase;
+    region_count++;
+
+end:
+    pthread_rwlock_unlock(&region_lock);
+    return status;
+}
+
+VOID
+ShimUnmapRegion(_In_ PVOID Base)
+{
+    UINT64 base  = (UINT64)Base;
+    SIZE_T index = 0;
+
+    pthread_rwlock_wrlock(&region_lock);
+
+    index = ShimRegionUpperBound(base);
+
+    if (index && regions[index - 1].base == base) {
+        memmove(&regions[index - 1],
+                &regions[index],
+                (region_count - index) * sizeof(SHIM_REGION));
+        region_count--;
+    }
+
+    pthread_rwlock_unlock(&region_lock);
+}
+
+VOID
+ShimResetAddressSpace()
+{
+    pthread_rwlock_wrlock(&region_lock);
+
+    free(regions);
+    regions        = NULL;
+    region_count   = 0;
+    region_maximum = 0;
+
+    pthread_rwlock_unlock(&region_lock);
+}
+
+BOOLEAN
+ImpMmIsAddressValid(_In_ PVOID VirtualAddress)
+{
+    UINT64  start  = ShimTraceBegin();
+    BOOLEAN result = FALSE;
+
+    pthread_rwlock_rdlock(&region_lock);
+    result = ShimFindRegion((UINT64)VirtualAddress) ? TRUE : FALSE;
+    pthread_rwlock_unlock(&region_lock);
+
+    ShimTraceEnd(ShimImportMmIsAddressValid, start);
+    return result;
+}
+
+NTSTATUS
+ImpMmCopyMemory(PVOID           TargetAddress,
+                MM_COPY_ADDRESS SourceAddress,
+                SIZE_T          NumberOfBytes,
+                ULONG           Flags,
+                PSIZE_T         NumberOfBytesTransferred)
+{
+    UINT64       start  = ShimTraceBegin();
+    NTSTATUS     status = STATUS_SUCCESS;
+    PSHIM_REGION region = NULL;
+    UINT64       source = 0;
+
+    *NumberOfBytesTransferred = 0;
+
+    pthread_rwlock_rdlock(&region_lock);
+
+    if (Flags == MM_COPY_MEMORY_VIRTUAL) {
+        source = (UINT64)SourceAddress.VirtualAddress;
+
+        if (!ShimIsRangeMapped(source, NumberOfBytes)) {
+            status = STATUS_ACCESS_VIOLATION;
+            goto end;
+        }
+    }
+    else if (Flags == MM_COPY_MEMORY_PHYSICAL) {
+        region = ShimFindPhysicalRegion(SourceAddress.PhysicalAddress.QuadPart);
+
+        if (!region || SourceAddress.PhysicalAddress.QuadPart +
+                               NumberOfBytes - region->physical >
+                           region->size) {
+            status = STATUS_ACCESS_VIOLATION;
+            goto end;
+        }
+
+        source = region->base +
+                 (SourceAddress.PhysicalAddress.QuadPart - region->physical);
+    }
+    else {
+        status = STATUS_INVALID_PARAMETER;
+        goto end;
+    }
+
+    RtlCopyMemory(TargetAddress, (PVOID)source, NumberOfBytes);
+    *NumberOfBytesTransferred = NumberOfBytes;
+
+end:
+    pthread_rwlock_unlock(&region_lock);
+    ShimTraceEnd(ShimImportMmCopyMemory, start);
+    return status;
+}
+
+void*
+ImpMmGetVirtualForPhysical(_In_ PHYSICAL_ADDRESS PhysicalAddress)
+{
+    UINT64       start   = ShimTraceBegin();
+    PSHIM_REGION region  = NULL;
+    PVOID        address = NULL;
+
+    pthread_rwlock_rdlock(&region_lock);
+
+    region = ShimFindPhysicalRegion(PhysicalAddress.QuadPart);
+
+    if (region)
+        address = (PVOID)(region->base +
+                          (PhysicalAddress.QuadPart - region->physical));
+
+    pthread_rwlock_unlock(&region_lock);
+
+    ShimTraceEnd(ShimImportMmGetVirtualForPhysical, start);
+    return address;
+}
+
+STATIC
+INT
+ShimComparePhysicalRanges(_In_ const void* First, _In_ const void* Second)
+{
+    const PHYSICAL_MEMORY_RANGE* first  = First;
+    const PHYSICAL_MEMORY_RANGE* second = Second;
+
+    if (first->BaseAddress.QuadPart < second->BaseAddress.QuadPart)
+        return -1;
+
+    return first->BaseAddress.QuadPart > second->BaseAddress.QuadPart;
+}
+
+/*
+ * Like the real routine the result is terminated by an empty entry and must be
+ * freed by the caller.
+ */
+PPHYSICAL_MEMORY_RANGE
+ImpMmGetPhysicalMemoryRangesEx2(_In_ PVOID PartitionObject, _In_ ULONG Flags)
+{
+    UINT64                 start  = ShimTraceBegin();
+    PPHYSICAL_MEMORY_RANGE ranges  = NULL;
+    SIZE_T                 count   = 0;
+    SIZE_T                 maximum = 0;
+
+    pthread_rwlock_rdlock(&region_lock);
+
+    for (SIZE_T index = 0; index < region_count; index++) {
+        if (regions[index].physical != SHIM_NO_PHYSICAL_ADDRESS)
+            count++;
+    }
+
+    /* dont hold the region lock across the pool allocation, it maps the
+     * allocation into the address space */
+    pthread_rwlock_unlock(&region_lock);
+
+    maximum = count;
+    ranges  = ImpExAllocatePool2(POOL_FLAG_NON_PAGED,
+                                (maximum + 1) * sizeof(PHYSICAL_MEMORY_RANGE),
+                                SHIM_POOL_TAG);
+
+    if (!ranges)
+        goto end;
+
+    pthread_rwlock_rdlock(&region_lock);
+
+    count = 0;
+    for (SIZE_T index = 0; index < region_count && count < maximum; index++) {
+        if (regions[index].physical == SHIM_NO_PHYSICAL_ADDRESS)
+            continue;
+
+        ranges[count].BaseAddress.QuadPart   = regions[index].physical;
+        ranges[count].NumberOfBytes.QuadPart = regions[index].size;
+        count++;
+    }
+
+    pthread_rwlock_unlock(&region_lock);
+
+    qsort(ranges,
+          count,
+          sizeof(PHYSICAL_MEMORY_RANGE),
+          ShimComparePhysicalRanges);
+
+end:
+    ShimTraceEnd(ShimImportMmGetPhysicalMemoryRangesEx2, start);
+    return ranges;
+}
@@ -0,0 +1,34 @@
+#include "shim.h"
+
+/*
+ * Shim implementation of the core platform routines. These go through the
+ * Imp* wrappers exactly like driver/platform.c does, so core code linked
+ * against the shim is subject to the simulated address space and pool
+ * tracking.
+ */
+
+PVOID
+PlatformAllocatePool(_In_ SIZE_T Size, _In_ ULONG Tag)
+{
+    return ImpExAllocatePool2(POOL_FLAG_NON_PAGED, Size, Tag);
+}
+
+VOID
+PlatformFreePool(_In_ PVOID Buffer, _In_ ULONG Tag)
+{
+    ImpExFreePoolWithTag(Buffer, Tag);
+}
+
+NTSTATUS
+PlatformCopyMemory(_Out_ PVOID Destination,
+                   _In_ PVOID  Source,
+                   _In_ SIZE_T Length)
+{
+    MM_COPY_ADDRESS address        = {0};
+    SIZE_T          bytes_returned = 0;
+
+    address.VirtualAddress = Source;
+
+    return ImpMmCopyMemory(
+        Destination, address, Length, MM_COPY_MEMORY_VIRTUAL, &bytes_returned);
+}
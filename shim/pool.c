@@ -0,0 +1,156 @@
+#include "stats.h"
+
+#include "../core/container.h"
+
+#include <stdlib.h>
+
+/*
+ * Every allocation is prefixed with a header recording its tag and size, and
+ * linked into a list of outstanding allocations so that anything not freed by
+ * the time the test finishes can be reported along with its tag.
+ */
+#define SHIM_POOL_HEADER_MAGIC 0x6c6f6f706d696873ull
+
+typedef struct _SHIM_POOL_HEADER {
+    LIST_ENTRY list_entry;
+    UINT64     magic;
+    SIZE_T     size;
+    ULONG      tag;
+    UINT32     padding[3];
+
+} SHIM_POOL_HEADER, *PSHIM_POOL_HEADER;
+
+/* keep the returned allocation 16 byte aligned like the real pool */
+_Static_assert(sizeof(SHIM_POOL_HEADER) % 16 == 0,
+               "pool header must preserve 16 byte alignment");
+
+STATIC LIST_ENTRY           pool_allocations = {&pool_allocations,
+                                                &pool_allocations};
+STATIC SHIM_POOL_STATISTICS pool_statistics  = {0};
+STATIC pthread_mutex_t      pool_lock        = PTHREAD_MUTEX_INITIALIZER;
+
+void*
+ImpExAllocatePool2(_In_ POOL_FLAGS Flags,
+                   _In_ SIZE_T     NumberOfBytes,
+                   _In_ ULONG      Tag)
+{
+    UINT64            start  = ShimTraceBegin();
+    PSHIM_POOL_HEADER header = NULL;
+    PVOID             buffer = NULL;
+
+    if (!NumberOfBytes)
+        goto end;
+
+    if (posix_memalign(
+            (void**)&header, 16, sizeof(SHIM_POOL_HEADER) + NumberOfBytes))
+        goto end;
+
+    /* ExAllocatePool2 always zeroes the allocation */
+    RtlZeroMemory(header, sizeof(SHIM_POOL_HEADER) + NumberOfBytes);
+
+    header->magic = SHIM_POOL_HEADER_MAGIC;
+    header->size  = NumberOfBytes;
+    header->tag   = Tag;
+    buffer        = (PVOID)(header + 1);
+
+    if (!NT_SUCCESS(
+            ShimMapRegion(buffer, NumberOfBytes, SHIM_NO_PHYSICAL_ADDRESS))) {
+        free(header);
+        buffer = NULL;
+        goto end;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+
+    InsertTailList(&pool_allocations, &header->list_entry);
+
+    pool_statistics.allocations++;
+    pool_statistics.outstanding++;
+    pool_statistics.outstanding_bytes += NumberOfBytes;
+
+    if (pool_statistics.outstanding_bytes > pool_statistics.peak_bytes)
+        pool_statistics.peak_bytes = pool_statistics.outstanding_bytes;
+
+    pthread_mutex_unlock(&pool_lock);
+
+end:
+    ShimTraceEnd(ShimImportExAllocatePool2, start);
+    return buffer;
+}
+
+VOID
+ImpExFreePoolWithTag(_In_ PVOID P, _In_ ULONG Tag)
+{
+    UINT64            start  = ShimTraceBegin();
+    PSHIM_POOL_HEADER header = NULL;
+
+    if (!P)
+        goto end;
+
+    header = (PSHIM_POOL_HEADER)P - 1;
+
+    /* a bugcheck in the real kernel, abort so the test fails loudly */
+    if (header->magic != SHIM_POOL_HEADER_MAGIC) {
+        fprintf(stderr, "shim: freeing invalid pool allocation %p\n", P);
+        abort();
+    }
+
+    ShimUnmapRegion(P);
+
+    pthread_mutex_lock(&pool_lock);
+
+    if (header->tag != Tag)
+        pool_statistics.tag_mismatches++;
+
+    RemoveEntryList(&header->list_entry);
+
+    pool_statistics.frees++;
+    pool_statistics.outstanding--;
+    pool_statistics.outstanding_bytes -= header->size;
+
+    pthread_mutex_unlock(&pool_lock);
+
+    header->magic = 0;
+    free(header);
+
+end:
+    ShimTraceEnd(ShimImportExFreePoolWithTag, start);
+}
+
+VOID
+ShimPoolGetStatistics(_Out_ PSHIM_POOL_STATISTICS Statistics)
+{
+    pthread_mutex_lock(&pool_lock);
+    *Statistics = pool_statistics;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * Prints every outstanding allocation and returns how many there were. Tags
+ * are stored little endian, so 'list' is printed as "tsil" - the same way
+ * they appear in poolmon.
+ */
+UINT64
+ShimPoolReportLeaks(_In_ FILE* Stream)
+{
+    UINT64      count = 0;
+    PLIST_ENTRY entry = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+
+    for (entry = pool_allocations.Flink; entry != &pool_allocations;
+         entry = entry->Flink) {
+        PSHIM_POOL_HEADER header =
+            CONTAINING_RECORD(entry, SHIM_POOL_HEADER, list_entry);
+
+        fprintf(Stream,
+                "shim: leaked %zu bytes at %p with tag '%.4s'\n",
+                header->size,
+                (PVOID)(header + 1),
+                (const char*)&header->tag);
+        count++;
+    }
+
+    pthread_mutex_unlock(&pool_lock);
+    return count;
+}
@@ -0,0 +1,157 @@
+#include "stats.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+SIZE_T
+ImpRtlCompareMemory(_In_ PVOID Source1, _In_ PVOID Source2, _In_ SIZE_T Length)
+{
+    UINT64 start  = ShimTraceBegin();
+    PUCHAR first  = (PUCHAR)Source1;
+    PUCHAR second = (PUCHAR)Source2;
+    SIZE_T index  = 0;
+
+    while (index < Length && first[index] == second[index])
+        index++;
+
+    ShimTraceEnd(ShimImportRtlCompareMemory, start);
+    return index;
+}
+
+INT
+ImpStrStr(_In_ CHAR* haystack, _In_ CHAR* needle)
+{
+    return strstr(haystack, needle) ? TRUE : FALSE;
+}
+
+SIZE_T
+ImpStrnlen(_In_ CHAR* str, _In_ SIZE_T maxCount)
+{
+    return strnlen(str, maxCount);
+}
+
+void
+ImpRtlInitUnicodeString(PUNICODE_STRING DestinationString, PCWSTR SourceString)
+{
+    SIZE_T length = 0;
+
+    DestinationString->Buffer = (PWCH)SourceString;
+
+    if (!SourceString) {
+        DestinationString->Length        = 0;
+        DestinationString->MaximumLength = 0;
+        return;
+    }
+
+    while (SourceString[length])
+        length++;
+
+    DestinationString->Length        = (USHORT)(length * sizeof(WCHAR));
+    DestinationString->MaximumLength = (USHORT)((length + 1) * sizeof(WCHAR));
+}
+
+void
+ImpRtlInitAnsiString(PANSI_STRING DestinationString, PCSZ SourceString)
+{
+    SIZE_T length = SourceString ? strlen(SourceString) : 0;
+
+    DestinationString->Buffer        = (PCHAR)SourceString;
+    DestinationString->Length        = (USHORT)length;
+    DestinationString->MaximumLength = SourceString ? (USHORT)(length + 1) : 0;
+}
+
+STATIC
+WCHAR
+ShimUpcase(_In_ WCHAR Character)
+{
+    if (Character >= 'a' && Character <= 'z')
+        return Character - ('a' - 'A');
+
+    return Character;
+}
+
+LONG
+ImpRtlCompareUnicodeString(_In_ PCUNICODE_STRING String1,
+                           _In_ PCUNICODE_STRING String2,
+                           _In_ BOOLEAN          CaseInSensitive)
+{
+    USHORT first_length  = String1->Length / sizeof(WCHAR);
+    USHORT second_length = String2->Length / sizeof(WCHAR);
+    USHORT length = first_length < second_length ? first_length : second_length;
+
+    for (USHORT index = 0; index < length; index++) {
+        WCHAR first  = String1->Buffer[index];
+        WCHAR second = String2->Buffer[index];
+
+        if (CaseInSensitive) {
+            first  = ShimUpcase(first);
+            second = ShimUpcase(second);
+        }
+
+        if (first != second)
+            return (LONG)first - (LONG)second;
+    }
+
+    return (LONG)first_length - (LONG)second_length;
+}
+
+ULONG
+ImpKeQueryActiveProcessorCount(PKAFFINITY ActiveProcessors)
+{
+    UINT64 start = ShimTraceBegin();
+    LONG   count = (LONG)sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (count < 1)
+        count = 1;
+
+    if (ActiveProcessors)
+        *ActiveProcessors = count >= 32 ? MAXUINT32 : (1u << count) - 1;
+
+    ShimTraceEnd(ShimImportKeQueryActiveProcessorCount, start);
+    return (ULONG)count;
+}
+
+/*
+ * Negative intervals are relative, in units of 100ns. Absolute timeouts are
+ * not used by the driver so theyre treated as an immediate return.
+ */
+NTSTATUS
+ImpKeDelayExecutionThread(KPROCESSOR_MODE WaitMode,
+                          BOOLEAN         Alertable,
+                          PLARGE_INTEGER  Interval)
+{
+    UINT64          start    = ShimTraceBegin();
+    struct timespec duration = {0};
+    LONGLONG        interval = 0;
+
+    if (Interval && Interval->QuadPart < 0) {
+        interval          = -Interval->QuadPart * 100;
+        duration.tv_sec   = interval / 1000000000ll;
+        duration.tv_nsec  = interval % 1000000000ll;
+        nanosleep(&duration, NULL);
+    }
+
+    ShimTraceEnd(ShimImportKeDelayExecutionThread, start);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Debug output is dropped unless AC_SHIM_VERBOSE is set in the environment,
+ * the tests produce a lot of it.
+ */
+ULONG
+ImpDbgPrintEx(_In_ ULONG ComponentId, _In_ ULONG Level, _In_ PCSTR Format, ...)
+{
+    va_list args;
+
+    if (!getenv("AC_SHIM_VERBOSE"))
+        return STATUS_SUCCESS;
+
+    va_start(args, Format);
+    vfprintf(stderr, Format, args);
+    va_end(args);
+
+    return STATUS_SUCCESS;
+}
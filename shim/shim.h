@@ -0,0 +1,243 @@
+#ifndef SHIM_H
+#define SHIM_H
+
+/*
+ * User mode implementation of the Imp* kernel import wrappers so that driver
+ * logic can be compiled and run inside an ordinary host process.
+ *
+ * The shim provides:
+ *
+ *  - a simulated address space. Only memory that has been mapped with
+ *    ShimMapRegion (or allocated from the shim pool) is considered valid by
+ *    ImpMmIsAddressValid and ImpMmCopyMemory, and regions can optionally be
+ *    given a physical address so physical copies and translations work.
+ *
+ *  - a tracking pool allocator. Every allocation records its tag and size so
+ *    leaks and tag mismatches can be reported.
+ *
+ *  - guarded mutexes built on pthreads.
+ *
+ *  - per import call counts and timings.
+ *
+ * Only the routines needed by the platform neutral parts of the driver are
+ * implemented, anything touching real kernel objects stays in the driver.
+ */
+
+#include "../core/platform.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef PVOID  HANDLE;
+typedef ULONG* PKAFFINITY;
+typedef ULONG  KAFFINITY;
+typedef CHAR   KPROCESSOR_MODE;
+typedef UINT64 POOL_FLAGS;
+typedef const CHAR* PCSZ;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        ULONG LowPart;
+        LONG  HighPart;
+    };
+    LONGLONG QuadPart;
+
+} LARGE_INTEGER, *PLARGE_INTEGER, PHYSICAL_ADDRESS, *PPHYSICAL_ADDRESS;
+
+typedef struct _PHYSICAL_MEMORY_RANGE {
+    PHYSICAL_ADDRESS BaseAddress;
+    LARGE_INTEGER    NumberOfBytes;
+
+} PHYSICAL_MEMORY_RANGE, *PPHYSICAL_MEMORY_RANGE;
+
+typedef struct _MM_COPY_ADDRESS {
+    union {
+        PVOID            VirtualAddress;
+        PHYSICAL_ADDRESS PhysicalAddress;
+    };
+
+} MM_COPY_ADDRESS, *PMMCOPY_ADDRESS;
+
+typedef struct _UNICODE_STRING {
+    USHORT Length;
+    USHORT MaximumLength;
+    PWCH   Buffer;
+
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef const UNICODE_STRING* PCUNICODE_STRING;
+
+typedef struct _ANSI_STRING {
+    USHORT Length;
+    USHORT MaximumLength;
+    PCHAR  Buffer;
+
+} ANSI_STRING, *PANSI_STRING;
+
+typedef struct _KGUARDED_MUTEX {
+    pthread_mutex_t mutex;
+    volatile LONG   contention;
+    BOOLEAN         initialised;
+
+} KGUARDED_MUTEX, *PKGUARDED_MUTEX;
+
+#define POOL_FLAG_NON_PAGED 0x0000000000000040ULL
+#define POOL_FLAG_PAGED     0x0000000000000100ULL
+
+#define MM_COPY_MEMORY_PHYSICAL 0x1
+#define MM_COPY_MEMORY_VIRTUAL  0x2
+
+#define KernelMode 0
+#define UserMode   1
+
+#ifndef STATUS_ACCESS_VIOLATION
+#    define STATUS_ACCESS_VIOLATION ((NTSTATUS)0xC0000005L)
+#endif
+#ifndef STATUS_INSUFFICIENT_RESOURCES
+#    define STATUS_INSUFFICIENT_RESOURCES ((NTSTATUS)0xC000009AL)
+#endif
+
+#define SHIM_POOL_TAG 'mihs'
+
+/* simulated address space */
+
+#define SHIM_NO_PHYSICAL_ADDRESS MAXUINT64
+
+NTSTATUS
+ShimMapRegion(_In_ PVOID Base, _In_ SIZE_T Size, _In_ UINT64 PhysicalBase);
+
+VOID
+ShimUnmapRegion(_In_ PVOID Base);
+
+VOID
+ShimResetAddressSpace();
+
+/* pool */
+
+typedef struct _SHIM_POOL_STATISTICS {
+    UINT64 allocations;
+    UINT64 frees;
+    UINT64 outstanding;
+    UINT64 outstanding_bytes;
+    UINT64 peak_bytes;
+    UINT64 tag_mismatches;
+
+} SHIM_POOL_STATISTICS, *PSHIM_POOL_STATISTICS;
+
+VOID
+ShimPoolGetStatistics(_Out_ PSHIM_POOL_STATISTICS Statistics);
+
+UINT64
+ShimPoolReportLeaks(_In_ FILE* Stream);
+
+/* instrumentation */
+
+typedef enum _SHIM_IMPORT {
+    ShimImportMmIsAddressValid = 0,
+    ShimImportMmCopyMemory,
+    ShimImportMmGetVirtualForPhysical,
+    ShimImportMmGetPhysicalMemoryRangesEx2,
+    ShimImportExAllocatePool2,
+    ShimImportExFreePoolWithTag,
+    ShimImportKeInitializeGuardedMutex,
+    ShimImportKeAcquireGuardedMutex,
+    ShimImportKeReleaseGuardedMutex,
+    ShimImportRtlCompareMemory,
+    ShimImportKeQueryActiveProcessorCount,
+    ShimImportKeDelayExecutionThread,
+    ShimImportCount
+
+} SHIM_IMPORT;
+
+typedef struct _SHIM_IMPORT_STATISTICS {
+    UINT64 calls;
+    UINT64 total_ns;
+    UINT64 max_ns;
+
+} SHIM_IMPORT_STATISTICS, *PSHIM_IMPORT_STATISTICS;
+
+VOID
+ShimGetImportStatistics(_In_ SHIM_IMPORT               Import,
+                        _Out_ PSHIM_IMPORT_STATISTICS Statistics);
+
+VOID
+ShimResetStatistics();
+
+VOID
+ShimDumpStatistics(_In_ FILE* Stream);
+
+/* the Imp* wrappers, signatures match driver/imports.h */
+
+BOOLEAN
+ImpMmIsAddressValid(_In_ PVOID VirtualAddress);
+
+NTSTATUS
+ImpMmCopyMemory(PVOID           TargetAddress,
+                MM_COPY_ADDRESS SourceAddress,
+                SIZE_T          NumberOfBytes,
+                ULONG           Flags,
+                PSIZE_T         NumberOfBytesTransferred);
+
+void*
+ImpMmGetVirtualForPhysical(_In_ PHYSICAL_ADDRESS PhysicalAddress);
+
+PPHYSICAL_MEMORY_RANGE
+ImpMmGetPhysicalMemoryRangesEx2(_In_ PVOID PartitionObject, _In_ ULONG Flags);
+
+void*
+ImpExAllocatePool2(_In_ POOL_FLAGS Flags,
+                   _In_ SIZE_T     NumberOfBytes,
+                   _In_ ULONG      Tag);
+
+VOID
+ImpExFreePoolWithTag(_In_ PVOID P, _In_ ULONG Tag);
+
+void
+ImpKeInitializeGuardedMutex(PKGUARDED_MUTEX GuardedMutex);
+
+VOID
+ImpKeAcquireGuardedMutex(_In_ PKGUARDED_MUTEX GuardedMutex);
+
+VOID
+ImpKeReleaseGuardedMutex(_In_ PKGUARDED_MUTEX GuardedMutex);
+
+SIZE_T
+ImpRtlCompareMemory(_In_ PVOID Source1, _In_ PVOID Source2, _In_ SIZE_T Length);
+
+INT
+ImpStrStr(_In_ CHAR* haystack, _In_ CHAR* needle);
+
+SIZE_T
+ImpStrnlen(_In_ CHAR* str, _In_ SIZE_T maxCount);
+
+void
+ImpRtlInitUnicodeString(PUNICODE_STRING DestinationString, PCWSTR SourceString);
+
+void
+ImpRtlInitAnsiString(PANSI_STRING DestinationString, PCSZ SourceString);
+
+LONG
+ImpRtlCompareUnicodeString(_In_ PCUNICODE_STRING String1,
+                           _In_ PCUNICODE_STRING String2,
+                           _In_ BOOLEAN          CaseInSensitive);
+
+ULONG
+ImpKeQueryActiveProcessorCount(PKAFFINITY ActiveProcessors);
+
+NTSTATUS
+ImpKeDelayExecutionThread(KPROCESSOR_MODE WaitMode,
+                          BOOLEAN         Alertable,
+                          PLARGE_INTEGER  Interval);
+
+ULONG
+ImpDbgPrintEx(_In_ ULONG ComponentId, _In_ ULONG Level, _In_ PCSTR Format, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
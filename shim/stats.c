@@ -0,0 +1,98 @@
+#include "stats.h"
+
+#include <stdatomic.h>
+#include <time.h>
+
+typedef struct _SHIM_IMPORT_COUNTERS {
+    _Atomic UINT64 calls;
+    _Atomic UINT64 total_ns;
+    _Atomic UINT64 max_ns;
+
+} SHIM_IMPORT_COUNTERS, *PSHIM_IMPORT_COUNTERS;
+
+STATIC SHIM_IMPORT_COUNTERS import_counters[ShimImportCount];
+
+STATIC const CHAR* import_names[ShimImportCount] = {
+    "MmIsAddressValid",
+    "MmCopyMemory",
+    "MmGetVirtualForPhysical",
+    "MmGetPhysicalMemoryRangesEx2",
+    "ExAllocatePool2",
+    "ExFreePoolWithTag",
+    "KeInitializeGuardedMutex",
+    "KeAcquireGuardedMutex",
+    "KeReleaseGuardedMutex",
+    "RtlCompareMemory",
+    "KeQueryActiveProcessorCount",
+    "KeDelayExecutionThread"};
+
+UINT64
+ShimTraceBegin()
+{
+    struct timespec now = {0};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (UINT64)now.tv_sec * 1000000000ull + (UINT64)now.tv_nsec;
+}
+
+VOID
+ShimTraceEnd(_In_ SHIM_IMPORT Import, _In_ UINT64 Start)
+{
+    PSHIM_IMPORT_COUNTERS counters = &import_counters[Import];
+    UINT64                elapsed  = ShimTraceBegin() - Start;
+    UINT64                max      = atomic_load(&counters->max_ns);
+
+    atomic_fetch_add(&counters->calls, 1);
+    atomic_fetch_add(&counters->total_ns, elapsed);
+
+    while (elapsed > max &&
+           !atomic_compare_exchange_weak(&counters->max_ns, &max, elapsed))
+        ;
+}
+
+VOID
+ShimGetImportStatistics(_In_ SHIM_IMPORT               Import,
+                        _Out_ PSHIM_IMPORT_STATISTICS Statistics)
+{
+    Statistics->calls    = atomic_load(&import_counters[Import].calls);
+    Statistics->total_ns = atomic_load(&import_counters[Import].total_ns);
+    Statistics->max_ns   = atomic_load(&import_counters[Import].max_ns);
+}
+
+VOID
+ShimResetStatistics()
+{
+    for (INT index = 0; index < ShimImportCount; index++) {
+        atomic_store(&import_counters[index].calls, 0);
+        atomic_store(&import_counters[index].total_ns, 0);
+        atomic_store(&import_counters[index].max_ns, 0);
+    }
+}
+
+VOID
+ShimDumpStatistics(_In_ FILE* Stream)
+{
+    SHIM_IMPORT_STATISTICS stats = {0};
+
+    fprintf(Stream,
+            "%-30s %12s %14s %12s %12s\n",
+            "import",
+            "calls",
+            "total (ns)",
+            "avg (ns)",
+            "max (ns)");
+
+    for (INT index = 0; index < ShimImportCount; index++) {
+        ShimGetImportStatistics(index, &stats);
+
+        if (!stats.calls)
+            continue;
+
+        fprintf(Stream,
+                "%-30s %12llu %14llu %12llu %12llu\n",
+                import_names[index],
+                (unsigned long long)stats.calls,
+                (unsigned long long)stats.total_ns,
+                (unsigned long long)(stats.total_ns / stats.calls),
+                (unsigned long long)stats.max_ns);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef SHIM_STATS_H
+#define SHIM_STATS_H
+
+#include "shim.h"
+
+UINT64
+ShimTraceBegin();
+
+VOID
+ShimTraceEnd(_In_ SHIM_IMPORT Import, _In_ UINT64 Start);
+
+#endif
@@ -0,0 +1,49 @@
+#include "stats.h"
+
+#include <stdlib.h>
+
+void
+ImpKeInitializeGuardedMutex(PKGUARDED_MUTEX GuardedMutex)
+{
+    UINT64 start = ShimTraceBegin();
+
+    pthread_mutex_init(&GuardedMutex->mutex, NULL);
+    GuardedMutex->contention  = 0;
+    GuardedMutex->initialised = TRUE;
+
+    ShimTraceEnd(ShimImportKeInitializeGuardedMutex, start);
+}
+
+/*
+ * The contention count mirrors KGUARDED_MUTEX.Contention, its incremented
+ * each time an acquire has to wait for the current owner.
+ */
+VOID
+ImpKeAcquireGuardedMutex(_In_ PKGUARDED_MUTEX GuardedMutex)
+{
+    UINT64 start = ShimTraceBegin();
+
+    if (!GuardedMutex->initialised) {
+        fprintf(stderr,
+                "shim: acquiring uninitialised guarded mutex %p\n",
+                (PVOID)GuardedMutex);
+        abort();
+    }
+
+    if (pthread_mutex_trylock(&GuardedMutex->mutex)) {
+        __atomic_add_fetch(&GuardedMutex->contention, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&GuardedMutex->mutex);
+    }
+
+    ShimTraceEnd(ShimImportKeAcquireGuardedMutex, start);
+}
+
+VOID
+ImpKeReleaseGuardedMutex(_In_ PKGUARDED_MUTEX GuardedMutex)
+{
+    UINT64 start = ShimTraceBegin();
+
+    pthread_mutex_unlock(&GuardedMutex->mutex);
+
+    ShimTraceEnd(ShimImportKeReleaseGuardedMutex, start);
+}
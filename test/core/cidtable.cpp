@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../../core/cidtable.h"
+
+/*
+ * Checks WalkCidTable against synthetic handle tables built in host memory.
+ * Table pages are ordinary heap allocations so the walk translates addresses
+ * one to one, the objects are made up kernel addresses that are only ever
+ * encoded and compared, never read.
+ */
+
+static constexpr uint32_t ENTRY_COUNT = 100000;
+static constexpr UINT64 OBJECT_BASE = 0xffff9a0000000000ull;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+class synthetic_table {
+public:
+  /* a table with room for Entries entries, using as few levels as it can */
+  explicit synthetic_table(uint32_t entries) {
+    uint32_t leaves =
+        (entries + CID_TABLE_LEAF_ENTRY_COUNT - 1) / CID_TABLE_LEAF_ENTRY_COUNT;
+
+    this->next_handle = leaves * CID_TABLE_LEAF_ENTRY_COUNT *
+                        CID_TABLE_HANDLE_INCREMENT;
+
+    if (leaves == 1)
+      this->level = 0;
+    else if (leaves <= CID_TABLE_INDEX_ENTRY_COUNT)
+      this->level = 1;
+    else
+      this->level = 2;
+
+    for (uint32_t leaf = 0; leaf < leaves; leaf++)
+      this->leaves.push_back(
+          std::make_unique<CID_TABLE_ENTRY[]>(CID_TABLE_LEAF_ENTRY_COUNT));
+
+    if (this->level == 0) {
+      this->top = reinterpret_cast<UINT64>(this->leaves[0].get());
+      return;
+    }
+
+    uint32_t mids = this->level == 1
+                        ? 1
+                        : (leaves + CID_TABLE_INDEX_ENTRY_COUNT - 1) /
+                              CID_TABLE_INDEX_ENTRY_COUNT;
+
+    for (uint32_t mid = 0; mid < mids; mid++)
+      this->indices.push_back(
+          std::make_unique<UINT64[]>(CID_TABLE_INDEX_ENTRY_COUNT));
+
+    for (uint32_t leaf = 0; leaf < leaves; leaf++)
+      this->indices[leaf / CID_TABLE_INDEX_ENTRY_COUNT]
+                   [leaf % CID_TABLE_INDEX_ENTRY_COUNT] =
+          reinterpret_cast<UINT64>(this->leaves[leaf].get());
+
+    if (this->level == 1) {
+      this->top = reinterpret_cast<UINT64>(this->indices[0].get());
+      return;
+    }
+
+    this->indices.push_back(
+        std::make_unique<UINT64[]>(CID_TABLE_INDEX_ENTRY_COUNT));
+
+    for (uint32_t mid = 0; mid < mids; mid++)
+      this->indices.back()[mid] =
+          reinterpret_cast<UINT64>(this->indices[mid].get());
+
+    this->top = reinterpret_cast<UINT64>(this->indices.back().get());
+  }
+
+  /* entry 0 of every leaf page is reserved */
+  static bool is_usable(uint32_t index) {
+    return index % CID_TABLE_LEAF_ENTRY_COUNT != 0;
+  }
+
+  uint32_t capacity() const {
+    return this->next_handle / CID_TABLE_HANDLE_INCREMENT;
+  }
+
+  void set(uint32_t index, UINT64 object) {
+    CID_TABLE_ENTRY &entry = this->leaves[index / CID_TABLE_LEAF_ENTRY_COUNT]
+                                         [index % CID_TABLE_LEAF_ENTRY_COUNT];
+
+    /* unlocked bit plus the object pointer bits, access in the high value */
+    entry.low_value = ((object & ~CID_TABLE_OBJECT_HIGH) >> 4)
+                          << CID_TABLE_OBJECT_SHIFT |
+                      1;
+    entry.high_value = 0x1fffff;
+  }
+
+  /* free entries only carry a free list link in their high value */
+  void free(uint32_t index) {
+    CID_TABLE_ENTRY &entry = this->leaves[index / CID_TABLE_LEAF_ENTRY_COUNT]
+                                         [index % CID_TABLE_LEAF_ENTRY_COUNT];
+    entry.low_value = 0;
+    entry.high_value = reinterpret_cast<UINT64>(&entry + 1);
+  }
+
+  /* drops a whole leaf page, as if it had never been allocated */
+  void unlink_leaf(uint32_t leaf) {
+    this->indices[leaf / CID_TABLE_INDEX_ENTRY_COUNT]
+                 [leaf % CID_TABLE_INDEX_ENTRY_COUNT] = 0;
+  }
+
+  void prepare_walk(CID_TABLE_WALK &walk, std::vector<UINT64> &objects) const {
+    objects.assign(this->capacity(), 0);
+
+    walk = {};
+    walk.table_code = this->top | this->level;
+    walk.next_handle_needing_pool = this->next_handle;
+    walk.translate = translate;
+    walk.objects = objects.data();
+    walk.object_capacity = static_cast<UINT32>(objects.size());
+  }
+
+  uint32_t level = 0;
+  uint32_t next_handle = 0;
+
+private:
+  static PVOID translate(UINT64 Address, PVOID Context) {
+    return reinterpret_cast<PVOID>(Address);
+  }
+
+  UINT64 top = 0;
+  std::vector<std::unique_ptr<CID_TABLE_ENTRY[]>> leaves;
+  std::vector<std::unique_ptr<UINT64[]>> indices;
+};
+
+/*
+ * Fills Count usable entries with unique objects, leaving every free_every'th
+ * one free. Returns the objects placed, in table order.
+ */
+std::vector<UINT64> populate(synthetic_table &table, uint32_t count,
+                             uint32_t free_every) {
+  std::vector<UINT64> objects;
+  uint32_t placed = 0;
+
+  for (uint32_t index = 0; index < table.capacity() && placed < count;
+       index++) {
+    if (!synthetic_table::is_usable(index))
+      continue;
+
+    placed++;
+
+    if (free_every && placed % free_every == 0) {
+      table.free(index);
+      continue;
+    }
+
+    /*
+     * Multiplying by an odd constant is a bijection mod 2^32, so objects are
+     * unique but land in the table in no particular order.
+     */
+    UINT64 object = OBJECT_BASE +
+                    (static_cast<UINT64>(index * 2654435761u) << 4);
+    table.set(index, object);
+    objects.push_back(object);
+  }
+
+  return objects;
+}
+
+void missing_callback(UINT64 Object, PVOID Context) {
+  static_cast<std::vector<UINT64> *>(Context)->push_back(Object);
+}
+
+void test_decode() {
+  synthetic_table table(CID_TABLE_LEAF_ENTRY_COUNT);
+  UINT64 object = 0xffffc30b1a2c4080ull;
+
+  table.set(1, object);
+  table.free(2);
+
+  CID_TABLE_WALK walk = {};
+  std::vector<UINT64> objects;
+  table.prepare_walk(walk, objects);
+
+  CHECK(table.level == 0);
+  CHECK(NT_SUCCESS(WalkCidTable(&walk)));
+  CHECK(walk.object_count == 1);
+  CHECK(walk.object_count == 1 && walk.objects[0] == object);
+  CHECK(walk.pages_visited == 1);
+}
+
+void test_sort() {
+  std::mt19937_64 random(1);
+  std::vector<UINT64> values(ENTRY_COUNT);
+
+  for (UINT64 &value : values)
+    value = random() % (ENTRY_COUNT / 4);
+
+  std::vector<UINT64> expected = values;
+  std::sort(expected.begin(), expected.end());
+
+  CidTableSortObjects(values.data(), static_cast<UINT32>(values.size()));
+  CHECK(values == expected);
+
+  /* already sorted and reversed input */
+  CidTableSortObjects(values.data(), static_cast<UINT32>(values.size()));
+  CHECK(values == expected);
+
+  std::reverse(values.begin(), values.end());
+  CidTableSortObjects(values.data(), static_cast<UINT32>(values.size()));
+  CHECK(values == expected);
+}
+
+/* Entries sizes the table, at most ENTRY_COUNT of them are populated */
+void test_walk(uint32_t entries, uint32_t expected_level) {
+  synthetic_table table(entries);
+  std::vector<UINT64> placed =
+      populate(table, std::min(entries, ENTRY_COUNT), 7);
+
+  CID_TABLE_WALK walk = {};
+  std::vector<UINT64> objects;
+  table.prepare_walk(walk, objects);
+
+  CHECK(table.level == expected_level);
+  CHECK(NT_SUCCESS(WalkCidTable(&walk)));
+  CHECK(walk.dropped == 0);
+  CHECK(walk.pages_skipped == 0);
+
+  std::vector<UINT64> found(walk.objects, walk.objects + walk.object_count);
+  std::sort(placed.begin(), placed.end());
+  CHECK(found == placed);
+  CHECK(std::is_sorted(found.begin(), found.end()));
+
+  for (size_t index = 0; index < placed.size(); index += 97)
+    CHECK(CidTableContainsObject(&walk, placed[index]));
+
+  CHECK(!CidTableContainsObject(&walk, OBJECT_BASE - 0x10));
+  CHECK(!CidTableContainsObject(&walk, placed.back() + 0x10));
+  CHECK(!CidTableContainsObject(&walk, placed.front() + 0x8));
+}
+
+/* handles at or past NextHandleNeedingPool are never looked at */
+void test_limit() {
+  synthetic_table table(ENTRY_COUNT);
+  std::vector<UINT64> placed = populate(table, ENTRY_COUNT, 0);
+  uint32_t limit = 1000;
+
+  CID_TABLE_WALK walk = {};
+  std::vector<UINT64> objects;
+  table.prepare_walk(walk, objects);
+  walk.next_handle_needing_pool = limit * CID_TABLE_HANDLE_INCREMENT;
+
+  uint32_t expected = 0;
+  for (uint32_t index = 0; index < limit; index++)
+    expected += synthetic_table::is_usable(index);
+
+  CHECK(NT_SUCCESS(WalkCidTable(&walk)));
+  CHECK(walk.object_count == expected);
+}
+
+/* missing leaf pages are skipped, a full buffer drops rather then overflows */
+void test_sparse() {
+  synthetic_table table(ENTRY_COUNT);
+  std::vector<UINT64> placed = populate(table, ENTRY_COUNT, 0);
+  uint32_t per_leaf = CID_TABLE_LEAF_ENTRY_COUNT - 1;
+
+  table.unlink_leaf(5);
+  table.unlink_leaf(100);
+
+  CID_TABLE_WALK walk = {};
+  std::vector<UINT64> objects;
+  table.prepare_walk(walk, objects);
+
+  CHECK(NT_SUCCESS(WalkCidTable(&walk)));
+  CHECK(walk.pages_skipped == 2);
+  CHECK(walk.object_count == placed.size() - 2 * per_leaf);
+
+  walk.object_capacity = 1000;
+  CHECK(NT_SUCCESS(WalkCidTable(&walk)));
+  CHECK(walk.object_count == 1000);
+  CHECK(walk.dropped == placed.size() - 2 * per_leaf - 1000);
+}
+
+/*
+ * The thread list is every object in the table plus a handful of hidden ones,
+ * only the hidden ones should come back from the merge.
+ */
+void test_missing() {
+  std::mt19937_64 random(4);
+  synthetic_table table(ENTRY_COUNT);
+  std::vector<UINT64> placed = populate(table, ENTRY_COUNT, 3);
+
+  CID_TABLE_WALK walk = {};
+  std::vector<UINT64> objects;
+  table.prepare_walk(walk, objects);
+  CHECK(NT_SUCCESS(WalkCidTable(&walk)));
+
+  std::vector<UINT64> hidden;
+  for (uint32_t index = 0; index < 64; index++)
+    hidden.push_back(OBJECT_BASE - 0x1000 * (index + 1));
+
+  std::vector<UINT64> sorted = placed;
+  std::sort(sorted.begin(), sorted.end());
+  hidden.push_back(sorted.back() + 0x10);
+  hidden.push_back(sorted.front() + 0x8);
+
+  std::vector<UINT64> threads = placed;
+  threads.insert(threads.end(), hidden.begin(), hidden.end());
+  std::shuffle(threads.begin(), threads.end(), random);
+
+  std::vector<UINT64> missing;
+  UINT32 count = CidTableFindMissingObjects(
+      &walk, threads.data(), static_cast<UINT32>(threads.size()),
+      missing_callback, &missing);
+
+  std::sort(hidden.begin(), hidden.end());
+  CHECK(count == hidden.size());
+  CHECK(missing == hidden);
+
+  missing.clear();
+  CHECK(CidTableFindMissingObjects(&walk, placed.data(),
+                                   static_cast<UINT32>(placed.size()),
+                                   missing_callback, &missing) == 0);
+  CHECK(missing.empty());
+}
+
+void test_invalid() {
+  CID_TABLE_WALK walk = {};
+  std::vector<UINT64> objects(16);
+
+  CHECK(WalkCidTable(nullptr) == STATUS_INVALID_PARAMETER);
+  CHECK(WalkCidTable(&walk) == STATUS_INVALID_PARAMETER);
+
+  synthetic_table table(CID_TABLE_LEAF_ENTRY_COUNT);
+  table.prepare_walk(walk, objects);
+  walk.table_code |= 3;
+  CHECK(WalkCidTable(&walk) == STATUS_INVALID_PARAMETER);
+
+  table.prepare_walk(walk, objects);
+  walk.translate = [](UINT64 Address, PVOID Context) -> PVOID {
+    return nullptr;
+  };
+  CHECK(WalkCidTable(&walk) == STATUS_INVALID_ADDRESS);
+}
+
+} // namespace
+
+int main() {
+  test_decode();
+  test_sort();
+  test_walk(200, 0);
+  test_walk(ENTRY_COUNT, 1);
+  test_walk(2 * CID_TABLE_LEAF_ENTRY_COUNT * CID_TABLE_INDEX_ENTRY_COUNT, 2);
+  test_limit();
+  test_sparse();
+  test_missing();
+  test_invalid();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "../../core/dataptr.h"
+
+/*
+ * Builds a data pointer map over a few fake kernel pages held in host memory
+ * and checks which slots it tracks, and which changes to them are reported
+ * and which are only taken as the new baseline.
+ */
+
+static constexpr UINT64 CODE_BASE = 0xfffff80001000000ull;
+static constexpr UINT64 CODE_SIZE = 0x2000;
+static constexpr UINT64 DATA_BASE = 0xfffff80002000000ull;
+static constexpr UINT64 UNMAPPED = 0xfffff80009000000ull;
+static constexpr UINT64 SLOTS_PER_PAGE =
+    DATA_POINTER_PAGE_SIZE / DATA_POINTER_SLOT_SIZE;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+struct report {
+  UINT64 address;
+  UINT64 baseline;
+  UINT64 current;
+};
+
+/* kernel pages by address, a page that isnt in here isnt resident */
+class memory {
+public:
+  UINT64 *page(UINT64 address) {
+    std::vector<UINT64> &page = this->pages[address];
+    page.resize(SLOTS_PER_PAGE);
+    return page.data();
+  }
+
+  static PVOID translate(UINT64 Address, PVOID Context) {
+    memory *self = static_cast<memory *>(Context);
+    auto entry = self->pages.find(Address);
+    return entry == self->pages.end() ? nullptr : entry->second.data();
+  }
+
+private:
+  std::map<UINT64, std::vector<UINT64>> pages;
+};
+
+class pointer_map {
+public:
+  pointer_map(memory &memory, UINT32 slots)
+      : regions(4), pages(4), slots(slots) {
+    this->map.translate = memory::translate;
+    this->map.memory_context = &memory;
+    this->map.region_capacity = static_cast<UINT32>(this->regions.size());
+    this->map.regions = this->regions.data();
+    this->map.page_capacity = static_cast<UINT32>(this->pages.size());
+    this->map.pages = this->pages.data();
+    this->map.slot_capacity = slots;
+    this->map.slots = this->slots.data();
+  }
+
+  UINT32 rescan(UINT32 budget) {
+    return DataPointerMapRescan(&this->map, budget, on_report, this);
+  }
+
+  DATA_POINTER_MAP map = {};
+  std::vector<report> reports;
+
+private:
+  static VOID on_report(UINT64 Address, UINT64 Baseline, UINT64 Current,
+                        PVOID Context) {
+    static_cast<pointer_map *>(Context)->reports.push_back(
+        {Address, Baseline, Current});
+  }
+
+  std::vector<DATA_POINTER_REGION> regions;
+  std::vector<DATA_POINTER_PAGE> pages;
+  std::vector<DATA_POINTER_SLOT> slots;
+};
+
+/* two overlapping regions and an adjacent one come out as a single region */
+void test_regions() {
+  memory memory;
+  pointer_map pointers(memory, 1);
+  DATA_POINTER_MAP &map = pointers.map;
+
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, CODE_BASE + 0x1000, 0x1000)));
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, CODE_BASE, 0x1800)));
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, CODE_BASE + 0x2000, 0x10)));
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, UNMAPPED, 0x1000)));
+  CHECK(DataPointerMapAddRegion(&map, CODE_BASE, 0x1000) ==
+        STATUS_BUFFER_TOO_SMALL);
+
+  DataPointerMapSortRegions(&map);
+  CHECK(map.region_count == 2);
+  CHECK(map.regions[0].base == CODE_BASE);
+  CHECK(map.regions[0].end == CODE_BASE + 0x2010);
+
+  CHECK(DataPointerIsValidCode(&map, CODE_BASE));
+  CHECK(DataPointerIsValidCode(&map, CODE_BASE + 0x200f));
+  CHECK(!DataPointerIsValidCode(&map, CODE_BASE + 0x2010));
+  CHECK(!DataPointerIsValidCode(&map, CODE_BASE - 1));
+  CHECK(DataPointerIsValidCode(&map, UNMAPPED + 0x800));
+
+  CHECK(DataPointerMapAddRegion(&map, ~0ull, 2) == STATUS_INVALID_PARAMETER);
+}
+
+/*
+ * Three pages of data, the second holds no code pointers and the third isnt
+ * resident. Only the slots pointing into code are tracked, and a range that
+ * starts part way into a slot skips it.
+ */
+void test_slots() {
+  memory memory;
+  pointer_map pointers(memory, 8);
+  DATA_POINTER_MAP &map = pointers.map;
+
+  UINT64 *first = memory.page(DATA_BASE);
+  first[1] = CODE_BASE + 0x10;
+  first[3] = CODE_BASE + 0x20;
+  first[10] = CODE_BASE + 0x30;
+  first[11] = UNMAPPED;
+  first[12] = 0x7ff600001000ull;
+  memory.page(DATA_BASE + DATA_POINTER_PAGE_SIZE)[5] = UNMAPPED;
+
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, CODE_BASE, CODE_SIZE)));
+  DataPointerMapSortRegions(&map);
+
+  CHECK(NT_SUCCESS(DataPointerMapAddRange(
+      &map, DATA_BASE + 0x0c, 3 * DATA_POINTER_PAGE_SIZE - 0x0c)));
+  CHECK(map.page_count == 1);
+  CHECK(map.slot_count == 2);
+  CHECK(map.pages_skipped == 1);
+  CHECK(map.pages[0].address == DATA_BASE);
+  CHECK(map.pages[0].slot_count == 2);
+  CHECK(map.slots[0].offset == 3 * DATA_POINTER_SLOT_SIZE);
+  CHECK(map.slots[0].baseline == CODE_BASE + 0x20);
+  CHECK(map.slots[1].offset == 10 * DATA_POINTER_SLOT_SIZE);
+  CHECK(map.dropped == 0);
+
+  /* without a translate routine there is nothing to read the pages with */
+  map.translate = nullptr;
+  CHECK(DataPointerMapAddRange(&map, DATA_BASE, DATA_POINTER_PAGE_SIZE) ==
+        STATUS_INVALID_PARAMETER);
+}
+
+/* slots that dont fit are counted, not silently lost */
+void test_dropped() {
+  memory memory;
+  pointer_map pointers(memory, 2);
+  DATA_POINTER_MAP &map = pointers.map;
+
+  UINT64 *data = memory.page(DATA_BASE);
+  for (UINT32 index = 0; index < 5; index++)
+    data[index] = CODE_BASE + index;
+
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, CODE_BASE, CODE_SIZE)));
+  CHECK(NT_SUCCESS(
+      DataPointerMapAddRange(&map, DATA_BASE, DATA_POINTER_PAGE_SIZE)));
+  CHECK(map.slot_count == 2);
+  CHECK(map.dropped == 3);
+
+  DataPointerMapReset(&map);
+  CHECK(map.region_count == 0 && map.slot_count == 0 && map.dropped == 0);
+}
+
+/*
+ * Retargets to other code and to user addresses become the baseline, a kernel
+ * address outside code is reported once with the value it replaced.
+ */
+void test_rescan() {
+  memory memory;
+  pointer_map pointers(memory, 8);
+  DATA_POINTER_MAP &map = pointers.map;
+
+  UINT64 *first = memory.page(DATA_BASE);
+  UINT64 *second = memory.page(DATA_BASE + DATA_POINTER_PAGE_SIZE);
+  first[2] = CODE_BASE + 0x100;
+  first[7] = CODE_BASE + 0x200;
+  second[4] = CODE_BASE + 0x300;
+
+  CHECK(NT_SUCCESS(DataPointerMapAddRegion(&map, CODE_BASE, CODE_SIZE)));
+  CHECK(NT_SUCCESS(
+      DataPointerMapAddRange(&map, DATA_BASE, 2 * DATA_POINTER_PAGE_SIZE)));
+  CHECK(map.page_count == 2);
+  CHECK(map.slot_count == 3);
+
+  CHECK(pointers.rescan(0) == 2);
+  CHECK(map.pages_scanned == 2);
+  CHECK(map.changed == 0);
+  CHECK(pointers.reports.empty());
+
+  first[2] = CODE_BASE + 0x180;
+  first[7] = 0x7ff600001000ull;
+  CHECK(pointers.rescan(0) == 2);
+  CHECK(map.changed == 2);
+  CHECK(map.retargeted == 2);
+  CHECK(pointers.reports.empty());
+
+  second[4] = UNMAPPED + 0x40;
+  CHECK(pointers.rescan(0) == 2);
+  CHECK(pointers.reports.size() == 1);
+  CHECK(map.reports == 1);
+  if (pointers.reports.size() == 1) {
+    CHECK(pointers.reports[0].address ==
+          DATA_BASE + DATA_POINTER_PAGE_SIZE + 4 * DATA_POINTER_SLOT_SIZE);
+    CHECK(pointers.reports[0].baseline == CODE_BASE + 0x300);
+    CHECK(pointers.reports[0].current == UNMAPPED + 0x40);
+  }
+
+  /* the hook is the baseline now, it isnt reported again */
+  CHECK(pointers.rescan(0) == 2);
+  CHECK(pointers.reports.size() == 1);
+
+  /* a budget of one visits a page per run, carrying on from the last */
+  map.cursor = 0;
+  first[2] = UNMAPPED;
+  second[4] = UNMAPPED + 0x80;
+  CHECK(pointers.rescan(1) == 1);
+  CHECK(pointers.reports.size() == 2);
+  CHECK(pointers.rescan(1) == 1);
+  CHECK(pointers.reports.size() == 3);
+  CHECK(pointers.reports.back().current == UNMAPPED + 0x80);
+
+  /* a page that stopped being resident is skipped, not reported */
+  UINT64 skipped = map.pages_skipped;
+  map.translate = [](UINT64, PVOID) -> PVOID { return nullptr; };
+  CHECK(pointers.rescan(0) == 2);
+  CHECK(map.pages_skipped == skipped + 2);
+  CHECK(pointers.reports.size() == 3);
+}
+
+} // namespace
+
+int main() {
+  test_regions();
+  test_slots();
+  test_dropped();
+  test_rescan();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
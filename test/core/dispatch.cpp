@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../core/dispatch.h"
+
+/*
+ * Snapshots two tables sized like HAL_DISPATCH and HAL_PRIVATE_DISPATCH,
+ * neither a whole number of blocks, and checks every slot written afterwards
+ * is reported exactly once whichever byte of it changed and wherever it falls
+ * in a block. Also checks a patched snapshot is refused rather than diffed.
+ */
+
+static constexpr UINT32 HAL_DISPATCH_SLOTS = 21;
+static constexpr UINT32 HAL_PRIVATE_DISPATCH_SLOTS = 157;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+struct slot_change {
+  UINT32 table;
+  UINT32 index;
+  UINT64 previous;
+  UINT64 current;
+};
+
+VOID record_slot(UINT32 TableId, UINT32 Index, UINT64 Previous, UINT64 Current,
+                 PVOID Context) {
+  static_cast<std::vector<slot_change> *>(Context)->push_back(
+      {TableId, Index, Previous, Current});
+}
+
+struct dispatch_tables {
+  std::vector<UINT64> hal;
+  std::vector<UINT64> hal_private;
+  DISPATCH_SNAPSHOT snapshot;
+
+  dispatch_tables()
+      : hal(HAL_DISPATCH_SLOTS), hal_private(HAL_PRIVATE_DISPATCH_SLOTS) {
+    for (UINT32 index = 0; index < hal.size(); index++)
+      hal[index] = 0xfffff80001000000ull + index * 0x40;
+    for (UINT32 index = 0; index < hal_private.size(); index++)
+      hal_private[index] = 0xfffff80002000000ull + index * 0x40;
+
+    DispatchSnapshotInitialise(&snapshot);
+    DispatchSnapshotAddTable(&snapshot, 0, hal.data(), HAL_DISPATCH_SLOTS);
+    DispatchSnapshotAddTable(&snapshot, 1, hal_private.data(),
+                             HAL_PRIVATE_DISPATCH_SLOTS);
+  }
+
+  std::vector<slot_change> diff(NTSTATUS expected = STATUS_SUCCESS) {
+    std::vector<slot_change> changes;
+    UINT32 changed = ~0u;
+
+    CHECK(DispatchSnapshotDiff(&snapshot, record_slot, &changes, &changed) ==
+          expected);
+    CHECK(changed == changes.size());
+    return changes;
+  }
+};
+
+void test_snapshot() {
+  dispatch_tables tables;
+  std::vector<slot_change> slots;
+
+  CHECK(tables.snapshot.table_count == 2);
+  CHECK(tables.snapshot.slot_count ==
+        HAL_DISPATCH_SLOTS + HAL_PRIVATE_DISPATCH_SLOTS);
+  CHECK(tables.snapshot.tables[1].first_slot == HAL_DISPATCH_SLOTS);
+  CHECK(tables.snapshot.hash == DispatchSnapshotHash(&tables.snapshot));
+
+  DispatchSnapshotEnumerate(&tables.snapshot, record_slot, &slots);
+  CHECK(slots.size() == tables.snapshot.slot_count);
+  CHECK(slots[20].table == 0 && slots[20].index == 20);
+  CHECK(slots[21].table == 1 && slots[21].index == 0);
+  CHECK(slots[21].current == tables.hal_private[0]);
+
+  CHECK(tables.diff().empty());
+
+  std::vector<UINT64> large(DISPATCH_SNAPSHOT_MAX_SLOTS);
+  CHECK(DispatchSnapshotAddTable(&tables.snapshot, 2, large.data(),
+                                 static_cast<UINT32>(large.size())) ==
+        STATUS_BUFFER_TOO_SMALL);
+  CHECK(DispatchSnapshotAddTable(&tables.snapshot, 2, nullptr, 1) ==
+        STATUS_INVALID_PARAMETER);
+  CHECK(DispatchSnapshotAddTable(&tables.snapshot, 2, large.data(), 0) ==
+        STATUS_INVALID_PARAMETER);
+}
+
+/*
+ * Each slot of the private table written on its own, flipping a different
+ * byte every time, so every lane of the block compare and the slots past the
+ * last whole block are covered.
+ */
+void test_every_slot() {
+  dispatch_tables tables;
+
+  for (UINT32 index = 0; index < HAL_PRIVATE_DISPATCH_SLOTS; index++) {
+    UINT64 previous = tables.hal_private[index];
+    UINT64 current = previous ^ (0x80ull << (8 * (index % 8)));
+
+    tables.hal_private[index] = current;
+    std::vector<slot_change> changes = tables.diff();
+
+    CHECK(changes.size() == 1);
+    if (changes.size() != 1)
+      continue;
+
+    CHECK(changes[0].table == 1);
+    CHECK(changes[0].index == index);
+    CHECK(changes[0].previous == previous);
+    CHECK(changes[0].current == current);
+  }
+
+  /* the changes were taken into the snapshot */
+  CHECK(tables.diff().empty());
+}
+
+/* several slots of one block, and slots in both tables, in a single run */
+void test_many_slots() {
+  dispatch_tables tables;
+
+  tables.hal[4] = 0xfffff80009000000ull;
+  tables.hal[7] = 0xfffff80009000040ull;
+  tables.hal[20] = 0xfffff80009000080ull;
+  tables.hal_private[156] = 0;
+
+  std::vector<slot_change> changes = tables.diff();
+  CHECK(changes.size() == 4);
+  if (changes.size() == 4) {
+    CHECK(changes[0].table == 0 && changes[0].index == 4);
+    CHECK(changes[1].table == 0 && changes[1].index == 7);
+    CHECK(changes[2].table == 0 && changes[2].index == 20);
+    CHECK(changes[3].table == 1 && changes[3].index == 156);
+    CHECK(changes[3].current == 0);
+  }
+
+  CHECK(tables.diff().empty());
+}
+
+/* patching our copy to match a hook, or where it points, is refused */
+void test_hash_mismatch() {
+  dispatch_tables tables;
+
+  tables.hal[3] = 0xfffff80009000000ull;
+  tables.snapshot.slots[3] = tables.hal[3];
+  CHECK(tables.diff(STATUS_DATA_ERROR).empty());
+
+  dispatch_tables moved;
+  std::vector<UINT64> decoy(moved.hal);
+
+  decoy[5] = 0xfffff80009000000ull;
+  moved.snapshot.tables[0].live = decoy.data();
+  CHECK(moved.diff(STATUS_DATA_ERROR).empty());
+
+  /* a new snapshot of the hooked table diffs clean */
+  dispatch_tables fresh;
+  fresh.hal[3] = 0xfffff80009000000ull;
+  DispatchSnapshotInitialise(&fresh.snapshot);
+  DispatchSnapshotAddTable(&fresh.snapshot, 0, fresh.hal.data(),
+                           HAL_DISPATCH_SLOTS);
+  CHECK(fresh.diff().empty());
+}
+
+} // namespace
+
+int main() {
+  test_snapshot();
+  test_every_slot();
+  test_many_slots();
+  test_hash_mismatch();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../core/drvdispatch.h"
+
+/*
+ * Runs driver dispatch snapshots over a fake module list holding ntoskrnl,
+ * two port drivers, a disk class driver, a network miniport and an unrelated
+ * driver, and checks the verdict of every slot reported on first sight and
+ * after the slots change.
+ */
+
+static constexpr UINT64 NTOSKRNL = 0xfffff80001000000ull;
+static constexpr UINT64 CLASSPNP = 0xfffff80002000000ull;
+static constexpr UINT64 NDIS = 0xfffff80003000000ull;
+static constexpr UINT64 DISK = 0xfffff80004000000ull;
+static constexpr UINT64 MINIPORT = 0xfffff80005000000ull;
+static constexpr UINT64 FOREIGN = 0xfffff80006000000ull;
+static constexpr UINT64 MODULE_SIZE = 0x100000;
+static constexpr UINT64 UNBACKED = 0xffffa10000020000ull;
+
+static constexpr UINT64 DISK_DRIVER = 0xffffc00100001000ull;
+static constexpr UINT64 MINIPORT_DRIVER = 0xffffc00100000800ull;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+struct reported_slot {
+  UINT64 driver;
+  UINT32 slot;
+  UINT64 previous;
+  UINT64 current;
+  DRIVER_DISPATCH_VERDICT verdict;
+};
+
+class dispatch_snapshot {
+public:
+  explicit dispatch_snapshot(UINT32 capacity)
+      : entries(capacity), module_ranges(8), allowed_ranges(2), ports(2) {
+    DriverDispatchInitialise(&this->snapshot, this->entries.data(), capacity);
+
+    ModuleRangeIndexInitialise(&this->modules, this->module_ranges.data(),
+                               static_cast<UINT32>(this->module_ranges.size()));
+    for (UINT64 base : {FOREIGN, NTOSKRNL, CLASSPNP, NDIS, DISK, MINIPORT})
+      ModuleRangeIndexAdd(&this->modules, base, MODULE_SIZE);
+    ModuleRangeIndexSort(&this->modules);
+
+    ModuleRangeIndexInitialise(&this->allowed, this->allowed_ranges.data(),
+                               static_cast<UINT32>(this->allowed_ranges.size()));
+    ModuleRangeIndexAdd(&this->allowed, NTOSKRNL, MODULE_SIZE);
+    ModuleRangeIndexSort(&this->allowed);
+
+    this->ports[0] = {CLASSPNP, CLASSPNP + MODULE_SIZE};
+    this->ports[1] = {NDIS, NDIS + MODULE_SIZE};
+  }
+
+  void begin() {
+    DriverDispatchBeginRound(&this->snapshot, &this->modules, &this->allowed,
+                             this->ports.data(),
+                             static_cast<UINT32>(this->ports.size()));
+  }
+
+  UINT32 update(DRIVER_DISPATCH_ENTRY &live) {
+    return DriverDispatchUpdate(&this->snapshot, &live, on_report, this);
+  }
+
+  void end() { DriverDispatchEndRound(&this->snapshot); }
+
+  DRIVER_DISPATCH_SNAPSHOT snapshot = {};
+  std::vector<reported_slot> reports;
+
+private:
+  static VOID on_report(PDRIVER_DISPATCH_ENTRY Entry, UINT32 Slot,
+                        UINT64 Previous, DRIVER_DISPATCH_VERDICT Verdict,
+                        PVOID Context) {
+    static_cast<dispatch_snapshot *>(Context)->reports.push_back(
+        {Entry->driver, Slot, Previous, Entry->slots[Slot], Verdict});
+  }
+
+  std::vector<DRIVER_DISPATCH_ENTRY> entries;
+  std::vector<MODULE_RANGE> module_ranges;
+  std::vector<MODULE_RANGE> allowed_ranges;
+  std::vector<MODULE_RANGE> ports;
+  MODULE_RANGE_INDEX modules = {};
+  MODULE_RANGE_INDEX allowed = {};
+};
+
+/* every major function in the drivers own image, unload too */
+DRIVER_DISPATCH_ENTRY make_driver(UINT64 driver, UINT64 image) {
+  DRIVER_DISPATCH_ENTRY entry = {};
+
+  entry.driver = driver;
+  entry.image_base = image;
+  entry.image_end = image + MODULE_SIZE;
+
+  for (UINT32 slot = 0; slot < DRIVER_DISPATCH_MAJOR_FUNCTIONS; slot++)
+    entry.slots[slot] = image + 0x1000 + slot * 0x10;
+  entry.slots[DRIVER_DISPATCH_SLOT_UNLOAD] = image + 0x2000;
+
+  return entry;
+}
+
+/* imports from a port make its code allowed for that driver only */
+void test_classify() {
+  dispatch_snapshot dispatch(4);
+  DRIVER_DISPATCH_ENTRY disk = make_driver(DISK_DRIVER, DISK);
+  UINT64 imports[] = {NTOSKRNL + 0x500, CLASSPNP + 0x40, UNBACKED, 0};
+
+  dispatch.begin();
+  DriverDispatchResolvePorts(&dispatch.snapshot, &disk, imports, 4);
+  CHECK(disk.ports == 0x1);
+
+  DRIVER_DISPATCH_SNAPSHOT *snapshot = &dispatch.snapshot;
+  CHECK(DriverDispatchClassify(snapshot, &disk, DISK + 0x10) ==
+        DRIVER_DISPATCH_OWN_IMAGE);
+  CHECK(DriverDispatchClassify(snapshot, &disk, NTOSKRNL + 0x10) ==
+        DRIVER_DISPATCH_ALLOWED_MODULE);
+  CHECK(DriverDispatchClassify(snapshot, &disk, CLASSPNP + 0x10) ==
+        DRIVER_DISPATCH_ALLOWED_MODULE);
+  CHECK(DriverDispatchClassify(snapshot, &disk, NDIS + 0x10) ==
+        DRIVER_DISPATCH_FOREIGN_MODULE);
+  CHECK(DriverDispatchClassify(snapshot, &disk, FOREIGN + 0x10) ==
+        DRIVER_DISPATCH_FOREIGN_MODULE);
+  CHECK(DriverDispatchClassify(snapshot, &disk, DISK + MODULE_SIZE) ==
+        DRIVER_DISPATCH_UNBACKED);
+  CHECK(DriverDispatchClassify(snapshot, &disk, UNBACKED) ==
+        DRIVER_DISPATCH_UNBACKED);
+
+  DriverDispatchResolvePorts(&dispatch.snapshot, &disk, nullptr, 0);
+  CHECK(disk.ports == 0);
+  CHECK(DriverDispatchClassify(snapshot, &disk, CLASSPNP + 0x10) ==
+        DRIVER_DISPATCH_FOREIGN_MODULE);
+  dispatch.end();
+}
+
+/*
+ * The first time a driver is seen every slot is checked, slots in its own
+ * image, ntoskrnl and its ports pass and the rest are reported with no
+ * previous value.
+ */
+void test_first_sight() {
+  dispatch_snapshot dispatch(4);
+  DRIVER_DISPATCH_ENTRY disk = make_driver(DISK_DRIVER, DISK);
+  DRIVER_DISPATCH_ENTRY miniport = make_driver(MINIPORT_DRIVER, MINIPORT);
+  UINT64 disk_imports[] = {CLASSPNP + 0x40};
+  UINT64 miniport_imports[] = {NDIS + 0x80};
+
+  disk.slots[1] = NTOSKRNL + 0x100;
+  disk.slots[2] = CLASSPNP + 0x200;
+  disk.slots[3] = NDIS + 0x200;
+  disk.slots[4] = UNBACKED;
+  disk.slots[5] = 0;
+
+  miniport.slots[0] = NDIS + 0x300;
+  miniport.slots[DRIVER_DISPATCH_SLOT_FAST_IO_TABLE] = FOREIGN + 0x40;
+  miniport.slots[DRIVER_DISPATCH_SLOT_FAST_IO + 2] = CLASSPNP + 0x80;
+
+  dispatch.begin();
+  DriverDispatchResolvePorts(&dispatch.snapshot, &disk, disk_imports, 1);
+  DriverDispatchResolvePorts(&dispatch.snapshot, &miniport, miniport_imports,
+                             1);
+
+  CHECK(dispatch.update(disk) == 2);
+  CHECK(dispatch.update(miniport) == 2);
+  dispatch.end();
+
+  CHECK(dispatch.reports.size() == 4);
+  if (dispatch.reports.size() == 4) {
+    CHECK(dispatch.reports[0].driver == DISK_DRIVER);
+    CHECK(dispatch.reports[0].slot == 3);
+    CHECK(dispatch.reports[0].verdict == DRIVER_DISPATCH_FOREIGN_MODULE);
+    CHECK(dispatch.reports[0].previous == 0);
+
+    CHECK(dispatch.reports[1].slot == 4);
+    CHECK(dispatch.reports[1].verdict == DRIVER_DISPATCH_UNBACKED);
+    CHECK(dispatch.reports[1].current == UNBACKED);
+
+    CHECK(dispatch.reports[2].driver == MINIPORT_DRIVER);
+    CHECK(dispatch.reports[2].slot == DRIVER_DISPATCH_SLOT_FAST_IO_TABLE);
+    CHECK(dispatch.reports[2].verdict == DRIVER_DISPATCH_FOREIGN_MODULE);
+
+    /* classpnp is the disk drivers port, not the miniports */
+    CHECK(dispatch.reports[3].slot == DRIVER_DISPATCH_SLOT_FAST_IO + 2);
+    CHECK(dispatch.reports[3].verdict == DRIVER_DISPATCH_FOREIGN_MODULE);
+  }
+
+  /* kept sorted by driver object whatever order they were seen in */
+  CHECK(dispatch.snapshot.count == 2);
+  CHECK(dispatch.snapshot.entries[0].driver == MINIPORT_DRIVER);
+  CHECK(dispatch.snapshot.entries[1].driver == DISK_DRIVER);
+  CHECK(dispatch.snapshot.drivers_added == 2);
+}
+
+/*
+ * Later rounds only check slots that changed, report a hook once with the
+ * value it replaced, and take it as the baseline.
+ */
+void test_changes() {
+  dispatch_snapshot dispatch(4);
+  DRIVER_DISPATCH_ENTRY disk = make_driver(DISK_DRIVER, DISK);
+
+  dispatch.begin();
+  CHECK(dispatch.update(disk) == 0);
+  dispatch.end();
+
+  dispatch.begin();
+  CHECK(dispatch.update(disk) == 0);
+  CHECK(dispatch.snapshot.slots_changed == 0);
+  CHECK(dispatch.snapshot.drivers_added == 0);
+  dispatch.end();
+
+  UINT64 original = disk.slots[3];
+  disk.slots[3] = UNBACKED + 0x40;
+  disk.slots[7] = DISK + 0x8000;
+  disk.slots[9] = NTOSKRNL + 0x40;
+  disk.slots[DRIVER_DISPATCH_SLOT_UNLOAD] = 0;
+
+  dispatch.begin();
+  CHECK(dispatch.update(disk) == 1);
+  CHECK(dispatch.snapshot.slots_changed == 4);
+  dispatch.end();
+
+  CHECK(dispatch.reports.size() == 1);
+  if (dispatch.reports.size() == 1) {
+    CHECK(dispatch.reports[0].slot == 3);
+    CHECK(dispatch.reports[0].previous == original);
+    CHECK(dispatch.reports[0].current == UNBACKED + 0x40);
+    CHECK(dispatch.reports[0].verdict == DRIVER_DISPATCH_UNBACKED);
+  }
+
+  dispatch.begin();
+  CHECK(dispatch.update(disk) == 0);
+  dispatch.end();
+
+  /* a driver object freed and reused by another driver is seen anew */
+  DRIVER_DISPATCH_ENTRY reused = make_driver(DISK_DRIVER, FOREIGN);
+  reused.slots[0] = UNBACKED;
+
+  dispatch.begin();
+  CHECK(dispatch.update(reused) == 1);
+  CHECK(dispatch.snapshot.drivers_added == 1);
+  CHECK(dispatch.reports.back().previous == 0);
+  dispatch.end();
+  CHECK(dispatch.snapshot.entries[0].image_base == FOREIGN);
+}
+
+/* drivers not seen in a round are dropped at its end */
+void test_removed() {
+  dispatch_snapshot dispatch(4);
+  DRIVER_DISPATCH_ENTRY disk = make_driver(DISK_DRIVER, DISK);
+  DRIVER_DISPATCH_ENTRY miniport = make_driver(MINIPORT_DRIVER, MINIPORT);
+
+  dispatch.begin();
+  dispatch.update(disk);
+  dispatch.update(miniport);
+  dispatch.end();
+
+  dispatch.begin();
+  dispatch.update(disk);
+  dispatch.end();
+
+  CHECK(dispatch.snapshot.drivers == 1);
+  CHECK(dispatch.snapshot.drivers_removed == 1);
+  CHECK(dispatch.snapshot.count == 1);
+  CHECK(dispatch.snapshot.entries[0].driver == DISK_DRIVER);
+  CHECK(dispatch.snapshot.modules == nullptr);
+}
+
+/* past the capacity a driver is validated in full every round */
+void test_capacity() {
+  dispatch_snapshot dispatch(1);
+  DRIVER_DISPATCH_ENTRY disk = make_driver(DISK_DRIVER, DISK);
+  DRIVER_DISPATCH_ENTRY miniport = make_driver(MINIPORT_DRIVER, MINIPORT);
+
+  miniport.slots[0] = UNBACKED;
+
+  for (UINT32 round = 0; round < 3; round++) {
+    dispatch.begin();
+    CHECK(dispatch.update(disk) == 0);
+    CHECK(dispatch.update(miniport) == 1);
+    dispatch.end();
+  }
+
+  CHECK(dispatch.snapshot.count == 1);
+  CHECK(dispatch.reports.size() == 3);
+}
+
+} // namespace
+
+int main() {
+  test_classify();
+  test_first_sight();
+  test_changes();
+  test_removed();
+  test_capacity();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,242 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../../core/heartbeat.h"
+
+/*
+ * Plays a driver signing heartbeats and a server tracking them, with the
+ * module in between dropping, forging, replaying and holding them back.
+ * Times are in milliseconds, the driver's clock starts well away from the
+ * server's since the two are only ever compared by deltas.
+ */
+
+static constexpr UINT32 INTERVAL = HEARTBEAT_INTERVAL_MS;
+static constexpr UINT32 COOKIE = 0x5eed;
+static constexpr UINT64 DRIVER_EPOCH = 123456789;
+
+static const UCHAR key[16] = {0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe,
+                              0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+HEARTBEAT_PACKET make_heartbeat(UINT64 sequence, UINT64 time) {
+  HEARTBEAT_PACKET packet = {};
+  packet.session_cookie = COOKIE;
+  packet.sequence = sequence;
+  packet.time = DRIVER_EPOCH + time;
+  packet.report_count = static_cast<UINT32>(sequence * 3);
+  HeartbeatSign(&packet, (PVOID)key, sizeof(key));
+  return packet;
+}
+
+UINT32 track(HEARTBEAT_TRACKER &tracker, const HEARTBEAT_PACKET &packet,
+             UINT64 received) {
+  return HeartbeatTrack(&tracker, (PHEARTBEAT_PACKET)&packet, (PVOID)key,
+                        sizeof(key), COOKIE, received);
+}
+
+void test_sign() {
+  HEARTBEAT_PACKET packet = make_heartbeat(1, 0);
+  HEARTBEAT_PACKET changed = packet;
+  UCHAR other[sizeof(key)] = {};
+  UCHAR long_key[100] = {};
+
+  CHECK(packet.magic == HEARTBEAT_MAGIC);
+  CHECK(HeartbeatVerify(&packet, (PVOID)key, sizeof(key)));
+  CHECK(!HeartbeatVerify(&packet, other, sizeof(other)));
+
+  /* every field is covered by the mac */
+  changed.report_count++;
+  CHECK(!HeartbeatVerify(&changed, (PVOID)key, sizeof(key)));
+  changed = packet;
+  changed.time--;
+  CHECK(!HeartbeatVerify(&changed, (PVOID)key, sizeof(key)));
+  changed = packet;
+  changed.mac[HEARTBEAT_MAC_LENGTH - 1] ^= 1;
+  CHECK(!HeartbeatVerify(&changed, (PVOID)key, sizeof(key)));
+  changed = packet;
+  changed.magic = 0;
+  CHECK(!HeartbeatVerify(&changed, (PVOID)key, sizeof(key)));
+
+  /* keys longer than a block are hashed first */
+  HeartbeatSign(&changed, long_key, sizeof(long_key));
+  CHECK(HeartbeatVerify(&changed, long_key, sizeof(long_key)));
+  CHECK(!HeartbeatVerify(&changed, long_key, sizeof(long_key) - 1));
+}
+
+void test_derive_key() {
+  /* HMAC-SHA256 of "Ahbk" and the cookie, little endian, keyed by zeroes */
+  static const UCHAR expected[HEARTBEAT_KEY_LENGTH] = {
+      0x73, 0x1d, 0xd6, 0xc4, 0x71, 0x57, 0xe2, 0xda,
+      0xb6, 0x5f, 0xc4, 0xe6, 0x2a, 0x52, 0x0a, 0x58};
+  UCHAR root[HEARTBEAT_ROOT_KEY_LENGTH] = {};
+  UCHAR derived[HEARTBEAT_KEY_LENGTH] = {};
+  UCHAR other[HEARTBEAT_KEY_LENGTH] = {};
+
+  HeartbeatDeriveKey(root, sizeof(root), COOKIE, derived);
+  CHECK(memcmp(derived, expected, sizeof(expected)) == 0);
+
+  /* another session, or the same one under another root, gets another key */
+  HeartbeatDeriveKey(root, sizeof(root), COOKIE + 1, other);
+  CHECK(memcmp(derived, other, sizeof(other)) != 0);
+
+  root[0] = 1;
+  HeartbeatDeriveKey(root, sizeof(root), COOKIE, other);
+  CHECK(memcmp(derived, other, sizeof(other)) != 0);
+
+  /* signed with the session key the module knows, it doesnt verify */
+  HEARTBEAT_PACKET packet = make_heartbeat(1, 0);
+  CHECK(!HeartbeatVerify(&packet, derived, sizeof(derived)));
+}
+
+void test_stream() {
+  HEARTBEAT_TRACKER tracker = {};
+  UINT64 received = 5000;
+
+  HeartbeatTrackerInitialise(&tracker, INTERVAL);
+
+  /* a little jitter either side of the interval is fine */
+  for (UINT64 sequence = 1; sequence <= 100; sequence++) {
+    UINT64 jitter = sequence % 3 * 40;
+    CHECK(track(tracker, make_heartbeat(sequence, sequence * INTERVAL),
+                received + sequence * INTERVAL + jitter) == 0);
+  }
+
+  CHECK(tracker.accepted == 100);
+  CHECK(tracker.missed == 0);
+  CHECK(tracker.late == 0);
+  CHECK(tracker.skewed == 0);
+  CHECK(tracker.next_sequence == 101);
+}
+
+void test_forged() {
+  HEARTBEAT_TRACKER tracker = {};
+  HEARTBEAT_PACKET packet = make_heartbeat(1, 0);
+  HEARTBEAT_PACKET forged = make_heartbeat(2, INTERVAL);
+
+  HeartbeatTrackerInitialise(&tracker, INTERVAL);
+  CHECK(track(tracker, packet, 0) == 0);
+
+  /* the module bumping the sequence to hide a gap */
+  forged.sequence = 3;
+  CHECK(track(tracker, forged, INTERVAL) == HEARTBEAT_VERDICT_FORGED);
+
+  /* a heartbeat from another session */
+  CHECK(HeartbeatTrack(&tracker, &packet, (PVOID)key, sizeof(key), COOKIE + 1,
+                       INTERVAL) == HEARTBEAT_VERDICT_FORGED);
+
+  /* neither moved the stream */
+  CHECK(tracker.forged == 2);
+  CHECK(tracker.next_sequence == 2);
+  CHECK(track(tracker, make_heartbeat(2, INTERVAL), INTERVAL) == 0);
+}
+
+void test_replayed() {
+  HEARTBEAT_TRACKER tracker = {};
+  HEARTBEAT_PACKET first = make_heartbeat(1, 0);
+  HEARTBEAT_PACKET second = make_heartbeat(2, INTERVAL);
+
+  HeartbeatTrackerInitialise(&tracker, INTERVAL);
+  CHECK(track(tracker, first, 0) == 0);
+  CHECK(track(tracker, second, INTERVAL) == 0);
+
+  /* a recorded heartbeat sent again in place of a fresh one */
+  CHECK(track(tracker, second, 2 * INTERVAL) == HEARTBEAT_VERDICT_REPLAYED);
+  CHECK(track(tracker, first, 2 * INTERVAL) == HEARTBEAT_VERDICT_REPLAYED);
+  CHECK(tracker.replayed == 2);
+  CHECK(tracker.accepted == 2);
+
+  CHECK(track(tracker, make_heartbeat(3, 2 * INTERVAL), 2 * INTERVAL) == 0);
+}
+
+void test_gap() {
+  HEARTBEAT_TRACKER tracker = {};
+
+  HeartbeatTrackerInitialise(&tracker, INTERVAL);
+  CHECK(track(tracker, make_heartbeat(1, 0), 0) == 0);
+  CHECK(track(tracker, make_heartbeat(2, INTERVAL), INTERVAL) == 0);
+
+  /* the module swallowed two, the one after arrives on time */
+  CHECK(track(tracker, make_heartbeat(5, 4 * INTERVAL), 2 * INTERVAL) ==
+        (HEARTBEAT_VERDICT_GAP | HEARTBEAT_VERDICT_SKEWED));
+  CHECK(tracker.missed == 2);
+
+  /* the usual case, dropped on the way so the next one is late as well */
+  CHECK(track(tracker, make_heartbeat(8, 7 * INTERVAL), 5 * INTERVAL) ==
+        (HEARTBEAT_VERDICT_GAP | HEARTBEAT_VERDICT_LATE));
+  CHECK(tracker.missed == 4);
+  CHECK(tracker.late == 1);
+}
+
+void test_late() {
+  HEARTBEAT_TRACKER tracker = {};
+
+  HeartbeatTrackerInitialise(&tracker, INTERVAL);
+  CHECK(track(tracker, make_heartbeat(1, 0), 0) == 0);
+
+  /* the whole machine slept, both clocks moved together */
+  CHECK(track(tracker, make_heartbeat(2, 10 * INTERVAL), 10 * INTERVAL) ==
+        HEARTBEAT_VERDICT_LATE);
+
+  /* exactly at the limit is still on time */
+  CHECK(track(tracker,
+              make_heartbeat(3, 10 * INTERVAL +
+                                    HEARTBEAT_LATE_FACTOR * INTERVAL),
+              10 * INTERVAL + HEARTBEAT_LATE_FACTOR * INTERVAL) == 0);
+  CHECK(tracker.late == 1);
+  CHECK(tracker.skewed == 0);
+}
+
+void test_skewed() {
+  HEARTBEAT_TRACKER tracker = {};
+
+  HeartbeatTrackerInitialise(&tracker, INTERVAL);
+  CHECK(track(tracker, make_heartbeat(1, 0), 0) == 0);
+
+  /* signed on time but held back by the module and sent in a burst */
+  CHECK(track(tracker, make_heartbeat(2, INTERVAL), 3 * INTERVAL) ==
+        (HEARTBEAT_VERDICT_LATE | HEARTBEAT_VERDICT_SKEWED));
+  CHECK(track(tracker, make_heartbeat(3, 2 * INTERVAL), 3 * INTERVAL) ==
+        HEARTBEAT_VERDICT_SKEWED);
+  CHECK(track(tracker, make_heartbeat(4, 3 * INTERVAL), 3 * INTERVAL) ==
+        HEARTBEAT_VERDICT_SKEWED);
+  CHECK(track(tracker, make_heartbeat(5, 4 * INTERVAL), 4 * INTERVAL) == 0);
+  CHECK(tracker.skewed == 3);
+
+  /* a clock going backwards is a replay however it is signed */
+  CHECK(track(tracker, make_heartbeat(6, 3 * INTERVAL), 5 * INTERVAL) ==
+        HEARTBEAT_VERDICT_REPLAYED);
+}
+
+} // namespace
+
+int main() {
+  test_sign();
+  test_derive_key();
+  test_stream();
+  test_forged();
+  test_replayed();
+  test_gap();
+  test_late();
+  test_skewed();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
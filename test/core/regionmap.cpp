@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../core/regionmap.h"
+
+/*
+ * Drives the region map the way the driver's scan does, growing it when it
+ * fills up and abandoning rounds that stop part way through, and checks each
+ * region is inspected once for as long as it doesn't change.
+ */
+
+static constexpr UINT32 CAPACITY = 4;
+static constexpr UINT64 REGION_SIZE = 0x1000;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+class region_map {
+public:
+  region_map() : buffer(2 * CAPACITY) {
+    RegionMapInitialise(&this->map, this->buffer.data(), CAPACITY);
+  }
+
+  /* records regions [First, Last), growing the map the way the driver does */
+  NTSTATUS record(UINT32 first, UINT32 last) {
+    for (UINT32 index = first; index < last; index++) {
+      MEMORY_REGION region = {};
+      region.base = (index + 1) * 2 * REGION_SIZE;
+      region.size = REGION_SIZE;
+      region.protection = 0x20;
+      region.type = RegionTypePrivate;
+
+      NTSTATUS status = RegionMapRecord(&this->map, &region, inspect, this);
+
+      if (status == STATUS_BUFFER_TOO_SMALL) {
+        this->grow();
+        status = RegionMapRecord(&this->map, &region, inspect, this);
+      }
+
+      if (!NT_SUCCESS(status))
+        return status;
+    }
+
+    return STATUS_SUCCESS;
+  }
+
+  REGION_MAP map = {};
+  UINT32 inspected = 0;
+
+private:
+  static VOID inspect(PMEMORY_REGION Region, REGION_STATE State,
+                      PVOID Context) {
+    static_cast<region_map *>(Context)->inspected++;
+  }
+
+  void grow() {
+    UINT32 capacity = this->map.capacity * 2;
+    std::vector<MEMORY_REGION> buffer(2 * capacity);
+
+    RegionMapGrow(&this->map, buffer.data(), capacity);
+    this->buffer.swap(buffer);
+  }
+
+  std::vector<MEMORY_REGION> buffer;
+};
+
+void test_grow() {
+  region_map map;
+
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 100)));
+  RegionMapEndRound(&map.map);
+
+  CHECK(map.inspected == 100);
+  CHECK(map.map.count == 100);
+  CHECK(map.map.capacity == 128);
+
+  /* nothing changed, nothing past the first capacity is inspected again */
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 100)));
+  RegionMapEndRound(&map.map);
+
+  CHECK(map.inspected == 100);
+  CHECK(map.map.dropped == 0);
+}
+
+void test_full() {
+  REGION_MAP map = {};
+  MEMORY_REGION buffer[2 * CAPACITY] = {};
+  MEMORY_REGION region = {};
+
+  RegionMapInitialise(&map, buffer, CAPACITY);
+  RegionMapBeginRound(&map);
+
+  for (UINT32 index = 0; index < CAPACITY; index++) {
+    region.base = (index + 1) * 2 * REGION_SIZE;
+    region.size = REGION_SIZE;
+    CHECK(NT_SUCCESS(RegionMapRecord(&map, &region, NULL, NULL)));
+  }
+
+  /* a full map refuses the region without recording anything */
+  region.base += 2 * REGION_SIZE;
+  CHECK(RegionMapRecord(&map, &region, NULL, NULL) == STATUS_BUFFER_TOO_SMALL);
+  CHECK(map.recorded == CAPACITY);
+  CHECK(map.next_count == CAPACITY);
+}
+
+void test_abandon() {
+  region_map map;
+
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 20)));
+  RegionMapEndRound(&map.map);
+  CHECK(map.inspected == 20);
+
+  /* the walk stops half way, the rest of the last round is kept */
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 10)));
+  RegionMapAbandonRound(&map.map);
+
+  CHECK(map.map.count == 20);
+  CHECK(map.map.dropped == 0);
+
+  /* stopping earlier still inspects nothing, new regions only once */
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 5)));
+  RegionMapAbandonRound(&map.map);
+  CHECK(map.inspected == 20);
+
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 25)));
+  RegionMapEndRound(&map.map);
+  CHECK(map.inspected == 25);
+
+  RegionMapBeginRound(&map.map);
+  CHECK(NT_SUCCESS(map.record(0, 25)));
+  RegionMapEndRound(&map.map);
+  CHECK(map.inspected == 25);
+}
+
+void test_abandon_full() {
+  REGION_MAP map = {};
+  MEMORY_REGION buffer[2 * CAPACITY] = {};
+  MEMORY_REGION region = {};
+
+  RegionMapInitialise(&map, buffer, CAPACITY);
+  RegionMapBeginRound(&map);
+
+  for (UINT32 index = 0; index < CAPACITY; index++) {
+    region.base = (index + 1) * 2 * REGION_SIZE;
+    region.size = REGION_SIZE;
+    CHECK(NT_SUCCESS(RegionMapRecord(&map, &region, NULL, NULL)));
+  }
+
+  RegionMapEndRound(&map);
+
+  /* new regions fill the round, the ones it can't keep are counted */
+  RegionMapBeginRound(&map);
+
+  for (UINT32 index = 0; index < CAPACITY; index++) {
+    region.base = (index + 1) * REGION_SIZE / 2;
+    region.size = REGION_SIZE / 4;
+    CHECK(NT_SUCCESS(RegionMapRecord(&map, &region, NULL, NULL)));
+  }
+
+  RegionMapAbandonRound(&map);
+  CHECK(map.count == CAPACITY);
+  CHECK(map.dropped == CAPACITY - 1);
+}
+
+} // namespace
+
+int main() {
+  test_grow();
+  test_full();
+  test_abandon();
+  test_abandon_full();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,349 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../../core/reportpack.h"
+
+/*
+ * Packs reports against a small dictionary and against zeroes and checks
+ * they unpack to the same bytes, one after another from a single stream as
+ * the server reads them. Then feeds the loader and unpacker malformed input,
+ * all of which has to be refused rather than read out of bounds.
+ */
+
+static constexpr UINT32 CODE_SMALL = 10;
+static constexpr UINT32 CODE_LARGE = 20;
+static constexpr UINT32 CODE_UNKNOWN = 30;
+static constexpr UINT32 SIZE_SMALL = 64;
+static constexpr UINT32 SIZE_LARGE = 0x800;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+/* a report of Size bytes starting with its code, the rest from Seed */
+std::vector<UCHAR> make_report(UINT32 code, UINT32 size, UINT32 seed) {
+  std::vector<UCHAR> report(size);
+
+  memcpy(report.data(), &code, sizeof(code));
+  for (UINT32 index = sizeof(code); index < size; index++)
+    report[index] = static_cast<UCHAR>((index * 7 + seed) % 251);
+
+  return report;
+}
+
+void append(std::vector<UCHAR> &buffer, const void *data, size_t length) {
+  const UCHAR *bytes = static_cast<const UCHAR *>(data);
+  buffer.insert(buffer.end(), bytes, bytes + length);
+}
+
+struct reference {
+  UINT32 code;
+  std::vector<UCHAR> bytes;
+};
+
+/* a dictionary file holding References in the order given */
+std::vector<UCHAR> make_dictionary(const std::vector<reference> &references) {
+  std::vector<UCHAR> buffer(sizeof(REPORT_DICTIONARY_HEADER));
+  REPORT_DICTIONARY_HEADER header = {};
+
+  for (const reference &entry : references) {
+    REPORT_DICTIONARY_RECORD record = {
+        entry.code, static_cast<UINT32>(entry.bytes.size())};
+    append(buffer, &record, sizeof(record));
+    append(buffer, entry.bytes.data(), entry.bytes.size());
+  }
+
+  header.magic = REPORT_DICTIONARY_MAGIC;
+  header.version = REPORT_DICTIONARY_VERSION;
+  header.count = static_cast<UINT16>(references.size());
+  header.id = ReportDictionaryHash(buffer.data() + sizeof(header),
+                                   buffer.size() - sizeof(header));
+  memcpy(buffer.data(), &header, sizeof(header));
+
+  return buffer;
+}
+
+std::vector<reference> default_references() {
+  return {{CODE_SMALL, make_report(CODE_SMALL, SIZE_SMALL, 1)},
+          {CODE_LARGE, make_report(CODE_LARGE, SIZE_LARGE, 2)}};
+}
+
+std::vector<UCHAR> pack(PREPORT_DICTIONARY dictionary,
+                        std::vector<UCHAR> &report) {
+  std::vector<UCHAR> packed(REPORT_PACK_MESSAGE_BOUND(report.size()));
+  SIZE_T length = ReportPackMessage(dictionary, report.data(),
+                                    static_cast<UINT32>(report.size()),
+                                    packed.data(), packed.size());
+
+  CHECK(length > 0);
+  packed.resize(length);
+  return packed;
+}
+
+void test_dictionary() {
+  std::vector<UCHAR> file = make_dictionary(default_references());
+  REPORT_DICTIONARY dictionary;
+
+  CHECK(NT_SUCCESS(
+      ReportDictionaryLoad(&dictionary, file.data(), file.size())));
+  CHECK(dictionary.count == 2);
+  CHECK(dictionary.id != 0);
+
+  CHECK(ReportDictionaryLookup(&dictionary, CODE_SMALL, SIZE_SMALL) ==
+        dictionary.entries[0].reference);
+  CHECK(ReportDictionaryLookup(&dictionary, CODE_LARGE, SIZE_LARGE) ==
+        dictionary.entries[1].reference);
+  /* another version of the structure, or a code with no reference */
+  CHECK(!ReportDictionaryLookup(&dictionary, CODE_SMALL, SIZE_SMALL + 8));
+  CHECK(!ReportDictionaryLookup(&dictionary, CODE_UNKNOWN, SIZE_SMALL));
+  CHECK(!ReportDictionaryLookup(nullptr, CODE_SMALL, SIZE_SMALL));
+
+  /* a flipped byte in a reference changes the id */
+  std::vector<UCHAR> corrupt(file);
+  corrupt.back() ^= 1;
+  CHECK(ReportDictionaryLoad(&dictionary, corrupt.data(), corrupt.size()) ==
+        STATUS_DATA_ERROR);
+
+  std::vector<UCHAR> magic(file);
+  magic[0] ^= 1;
+  CHECK(ReportDictionaryLoad(&dictionary, magic.data(), magic.size()) ==
+        STATUS_INVALID_PARAMETER);
+
+  std::vector<reference> unsorted = default_references();
+  std::swap(unsorted[0], unsorted[1]);
+  std::vector<UCHAR> unsorted_file = make_dictionary(unsorted);
+  CHECK(ReportDictionaryLoad(&dictionary, unsorted_file.data(),
+                             unsorted_file.size()) ==
+        STATUS_INVALID_PARAMETER);
+
+  std::vector<reference> empty = {{CODE_SMALL, {}}};
+  std::vector<UCHAR> empty_file = make_dictionary(empty);
+  CHECK(ReportDictionaryLoad(&dictionary, empty_file.data(),
+                             empty_file.size()) == STATUS_INVALID_PARAMETER);
+
+  /* a count past the records that are there */
+  std::vector<UCHAR> short_file(file);
+  REPORT_DICTIONARY_HEADER header;
+  memcpy(&header, short_file.data(), sizeof(header));
+  header.count = 3;
+  memcpy(short_file.data(), &header, sizeof(header));
+  CHECK(ReportDictionaryLoad(&dictionary, short_file.data(),
+                             short_file.size()) == STATUS_INVALID_PARAMETER);
+
+  CHECK(ReportDictionaryLoad(&dictionary, file.data(), 4) ==
+        STATUS_INVALID_PARAMETER);
+}
+
+/* every byte of the reference ends up the value most samples agree on */
+void test_train() {
+  std::vector<UCHAR> reference(4);
+  std::vector<UINT16> counts(4);
+  UCHAR samples[][4] = {
+      {1, 2, 3, 4}, {1, 2, 9, 4}, {1, 7, 9, 4}, {1, 7, 9, 5}, {1, 7, 3, 5}};
+
+  for (UCHAR *sample : samples)
+    ReportDictionaryTrain(reference.data(), counts.data(), sample, 4);
+
+  CHECK(reference[0] == 1 && counts[0] == 5);
+  CHECK(reference[1] == 7);
+  CHECK(reference[2] == 9);
+  CHECK(reference[3] == 4);
+}
+
+/*
+ * Reports with and without a reference, packed into one stream and unpacked
+ * from it in order.
+ */
+void test_round_trip() {
+  std::vector<UCHAR> file = make_dictionary(default_references());
+  REPORT_DICTIONARY dictionary;
+  CHECK(NT_SUCCESS(
+      ReportDictionaryLoad(&dictionary, file.data(), file.size())));
+
+  std::vector<std::vector<UCHAR>> reports;
+  reports.push_back(make_report(CODE_SMALL, SIZE_SMALL, 1));
+  reports.push_back(make_report(CODE_LARGE, SIZE_LARGE, 2));
+  reports.push_back(make_report(CODE_LARGE, SIZE_LARGE, 2));
+  reports.back()[100] ^= 0xff;
+  reports.back()[SIZE_LARGE - 1] ^= 0xff;
+  reports.push_back(make_report(CODE_UNKNOWN, 300, 3));
+  reports.push_back(std::vector<UCHAR>(SIZE_LARGE));
+  memcpy(reports.back().data(), &CODE_UNKNOWN, sizeof(CODE_UNKNOWN));
+  reports.push_back(make_report(CODE_SMALL, 4, 4));
+  reports.push_back(make_report(CODE_SMALL, REPORT_DICTIONARY_MAX_SIZE, 5));
+
+  std::vector<UCHAR> stream;
+  std::vector<SIZE_T> lengths;
+  for (std::vector<UCHAR> &report : reports) {
+    std::vector<UCHAR> packed = pack(&dictionary, report);
+    CHECK(packed.size() <= REPORT_PACK_MESSAGE_BOUND(report.size()));
+    lengths.push_back(packed.size());
+    append(stream, packed.data(), packed.size());
+  }
+
+  /* a report matching its reference is a single token */
+  CHECK(lengths[1] ==
+        sizeof(UINT32) + sizeof(REPORT_PACK_HEADER) + 2 + 1);
+  /* one of zeroes without a reference is the code and a single match */
+  CHECK(lengths[4] ==
+        sizeof(UINT32) + sizeof(REPORT_PACK_HEADER) + 1 + 1 + 1 + 2 + 1);
+
+  SIZE_T offset = 0;
+  for (size_t index = 0; index < reports.size(); index++) {
+    std::vector<UCHAR> report(REPORT_DICTIONARY_MAX_SIZE);
+    UINT32 size = 0;
+    SIZE_T consumed = 0;
+
+    CHECK(NT_SUCCESS(ReportUnpackMessage(
+        &dictionary, stream.data() + offset, stream.size() - offset,
+        report.data(), report.size(), &size, &consumed)));
+    CHECK(consumed == lengths[index]);
+    CHECK(size == reports[index].size());
+    CHECK(!memcmp(report.data(), reports[index].data(),
+                  reports[index].size()));
+
+    offset += consumed;
+  }
+  CHECK(offset == stream.size());
+
+  /* no dictionary on either end works too */
+  std::vector<UCHAR> packed = pack(nullptr, reports[2]);
+  std::vector<UCHAR> report(SIZE_LARGE);
+  UINT32 size = 0;
+  SIZE_T consumed = 0;
+  CHECK(NT_SUCCESS(ReportUnpackMessage(nullptr, packed.data(), packed.size(),
+                                       report.data(), report.size(), &size,
+                                       &consumed)));
+  CHECK(report == reports[2]);
+}
+
+/* the unpacked report, or the status it was refused with */
+NTSTATUS unpack(PREPORT_DICTIONARY dictionary, std::vector<UCHAR> &packed,
+                SIZE_T report_size = REPORT_DICTIONARY_MAX_SIZE) {
+  std::vector<UCHAR> report(report_size);
+  UINT32 size = 0;
+  SIZE_T consumed = 0;
+
+  return ReportUnpack(dictionary, packed.data(), packed.size(), report.data(),
+                      report.size(), &size, &consumed);
+}
+
+/* a packed report from a header and a raw token stream */
+std::vector<UCHAR> make_packed(UINT32 code, UINT16 size,
+                               std::vector<UCHAR> tokens) {
+  REPORT_PACK_HEADER header = {code, size,
+                               static_cast<UINT16>(tokens.size())};
+  std::vector<UCHAR> packed;
+
+  append(packed, &header, sizeof(header));
+  append(packed, tokens.data(), tokens.size());
+  return packed;
+}
+
+void test_malformed() {
+  std::vector<UCHAR> file = make_dictionary(default_references());
+  REPORT_DICTIONARY dictionary;
+  CHECK(NT_SUCCESS(
+      ReportDictionaryLoad(&dictionary, file.data(), file.size())));
+
+  /* a well formed 8 byte report, the code as literal and 4 zeroes */
+  std::vector<UCHAR> valid =
+      make_packed(CODE_UNKNOWN, 8, {0, 4, 30, 0, 0, 0, 4, 0});
+  CHECK(NT_SUCCESS(unpack(nullptr, valid)));
+
+  /* every prefix is incomplete rather than malformed */
+  for (size_t length = 1; length < valid.size(); length++) {
+    std::vector<UCHAR> prefix(valid.begin(), valid.begin() + length);
+    CHECK(unpack(nullptr, prefix) == STATUS_BUFFER_TOO_SMALL);
+  }
+
+  /* a report larger than the buffer it is unpacked into */
+  CHECK(unpack(nullptr, valid, 7) == STATUS_INVALID_PARAMETER);
+
+  std::vector<UCHAR> tiny = make_packed(CODE_UNKNOWN, 3, {0, 3, 30, 0, 0});
+  CHECK(unpack(nullptr, tiny) == STATUS_INVALID_PARAMETER);
+
+  std::vector<UCHAR> huge =
+      make_packed(CODE_UNKNOWN, REPORT_DICTIONARY_MAX_SIZE + 1, {});
+  CHECK(unpack(nullptr, huge) == STATUS_INVALID_PARAMETER);
+
+  /* the code in the header disagreeing with the report */
+  std::vector<UCHAR> code =
+      make_packed(CODE_UNKNOWN + 1, 8, {0, 4, 30, 0, 0, 0, 4, 0});
+  CHECK(unpack(nullptr, code) == STATUS_DATA_ERROR);
+
+  /* a match running past the end of the report */
+  std::vector<UCHAR> long_match = make_packed(CODE_UNKNOWN, 8, {9, 0});
+  CHECK(unpack(nullptr, long_match) == STATUS_DATA_ERROR);
+
+  /* a literal running past the end of the report, or of the token stream */
+  std::vector<UCHAR> long_literal =
+      make_packed(CODE_UNKNOWN, 4, {0, 5, 30, 0, 0, 0, 0});
+  CHECK(unpack(nullptr, long_literal) == STATUS_DATA_ERROR);
+  std::vector<UCHAR> short_literal = make_packed(CODE_UNKNOWN, 8, {0, 8, 30});
+  CHECK(unpack(nullptr, short_literal) == STATUS_DATA_ERROR);
+
+  /* an empty token, which would never make progress */
+  std::vector<UCHAR> empty = make_packed(CODE_UNKNOWN, 8, {0, 0, 0, 0});
+  CHECK(unpack(nullptr, empty) == STATUS_DATA_ERROR);
+
+  /* a varint longer than any valid length, or cut off */
+  std::vector<UCHAR> varint =
+      make_packed(CODE_UNKNOWN, 8, {0x80, 0x80, 0x80, 0x00, 0});
+  CHECK(unpack(nullptr, varint) == STATUS_DATA_ERROR);
+  std::vector<UCHAR> cut = make_packed(CODE_UNKNOWN, 8, {0x84});
+  CHECK(unpack(nullptr, cut) == STATUS_DATA_ERROR);
+
+  /* bytes left over once the report is complete */
+  std::vector<UCHAR> trailing =
+      make_packed(CODE_UNKNOWN, 8, {0, 4, 30, 0, 0, 0, 4, 0, 1});
+  CHECK(unpack(nullptr, trailing) == STATUS_DATA_ERROR);
+
+  /* packed against a dictionary the reader doesnt have */
+  std::vector<UCHAR> report = make_report(CODE_SMALL, SIZE_SMALL, 1);
+  std::vector<UCHAR> packed = pack(&dictionary, report);
+  std::vector<UCHAR> output(SIZE_SMALL);
+  UINT32 size = 0;
+  SIZE_T consumed = 0;
+  CHECK(ReportUnpackMessage(nullptr, packed.data(), packed.size(),
+                            output.data(), output.size(), &size,
+                            &consumed) == STATUS_NOT_FOUND);
+  CHECK(consumed == 0);
+
+  /* reports that cant be packed */
+  std::vector<UCHAR> buffer(REPORT_PACK_BOUND(REPORT_DICTIONARY_MAX_SIZE + 1));
+  CHECK(ReportPack(nullptr, report.data(), 3, buffer.data(), buffer.size()) ==
+        0);
+  CHECK(ReportPack(nullptr, buffer.data(), REPORT_DICTIONARY_MAX_SIZE + 1,
+                   buffer.data(), buffer.size()) == 0);
+  CHECK(ReportPack(nullptr, report.data(), SIZE_SMALL, buffer.data(),
+                   REPORT_PACK_BOUND(SIZE_SMALL) - 1) == 0);
+}
+
+} // namespace
+
+int main() {
+  test_dictionary();
+  test_train();
+  test_round_trip();
+  test_malformed();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
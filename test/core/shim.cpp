@@ -0,0 +1,178 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../../core/pagehash.h"
+#include "../../fuzz/pe_fixtures.h"
+#include "../../shim/shim.h"
+
+/*
+ * Runs the core PE and page hash code against ac_shim instead of the plain
+ * platform routines, so every copy goes through ImpMmCopyMemory and the
+ * simulated address space, and every buffer comes from the tracking pool the
+ * way the driver allocates them. Nothing may be left allocated at the end.
+ */
+
+static constexpr ULONG POOL_TAG_TEST = 'tsim';
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+/* a copy of a fixture image in shim pool, so it is mapped like kernel memory */
+struct pool_image {
+  PVOID base = nullptr;
+  SIZE_T size = 0;
+
+  explicit pool_image(const std::vector<uint8_t> &image) : size(image.size()) {
+    this->base = ImpExAllocatePool2(POOL_FLAG_NON_PAGED, size, POOL_TAG_TEST);
+    if (this->base)
+      memcpy(this->base, image.data(), size);
+  }
+
+  ~pool_image() { ImpExFreePoolWithTag(this->base, POOL_TAG_TEST); }
+};
+
+std::vector<uint8_t> driver_image() {
+  for (const fuzz::pe_fixture &fixture : fuzz::make_pe_fixtures())
+    if (fixture.name == "driver64")
+      return fixture.image;
+  return {};
+}
+
+UINT64 copy_calls() {
+  SHIM_IMPORT_STATISTICS statistics = {};
+  ShimGetImportStatistics(ShimImportMmCopyMemory, &statistics);
+  return statistics.calls;
+}
+
+void count_mismatch(PPAGE_HASH Page, PVOID Context) {
+  (*static_cast<UINT32 *>(Context))++;
+}
+
+/* the executable sections are copied out of the mapped image via the shim */
+void test_copy_sections(const std::vector<uint8_t> &image) {
+  pool_image mapped(image);
+  CHECK(mapped.base != nullptr);
+
+  SIZE_T buffer_size = image.size();
+  PVOID buffer =
+      ImpExAllocatePool2(POOL_FLAG_NON_PAGED, buffer_size, POOL_TAG_TEST);
+  CHECK(buffer != nullptr);
+
+  UINT32 sections = 0;
+  SIZE_T written = 0;
+  UINT64 calls = copy_calls();
+
+  CHECK(NT_SUCCESS(PeCopyExecutableSections(mapped.base, mapped.size, buffer,
+                                            buffer_size, &sections,
+                                            &written)));
+  /* .text, PAGE and INIT */
+  CHECK(sections == 3);
+  CHECK(written > 0);
+  CHECK(copy_calls() - calls == 2 * sections);
+
+  /* the first section header and its data land at the start of the buffer */
+  PIMAGE_SECTION_HEADER header = static_cast<PIMAGE_SECTION_HEADER>(buffer);
+  CHECK(!memcmp(header->Name, ".text", 5));
+  CHECK(!memcmp(header + 1,
+                static_cast<uint8_t *>(mapped.base) + header->PointerToRawData,
+                header->SizeOfRawData));
+
+  ImpExFreePoolWithTag(buffer, POOL_TAG_TEST);
+}
+
+/*
+ * Hashes the image, then verifies the pool copy with and without a patched
+ * page, and once more after the image has been unmapped.
+ */
+void test_page_hashes(const std::vector<uint8_t> &image) {
+  PE_VIEW view = {};
+  PAGE_HASH_SET set = {};
+  UINT32 mismatches = 0;
+
+  pool_image mapped(image);
+  CHECK(NT_SUCCESS(PeViewInitialise(&view, mapped.base, mapped.size)));
+
+  set.capacity = PageHashCountPages(&view);
+  set.pages = static_cast<PPAGE_HASH>(ImpExAllocatePool2(
+      POOL_FLAG_NON_PAGED, set.capacity * sizeof(PAGE_HASH), POOL_TAG_TEST));
+  PVOID scratch = ImpExAllocatePool2(POOL_FLAG_NON_PAGED, PAGE_HASH_PAGE_SIZE,
+                                     POOL_TAG_TEST);
+  CHECK(set.pages != nullptr && scratch != nullptr);
+
+  PageHashSetReset(&set);
+  CHECK(NT_SUCCESS(PageHashSetAddImage(&set, &view)));
+  CHECK(set.count == set.capacity);
+
+  UINT64 base = reinterpret_cast<UINT64>(mapped.base);
+  UINT64 calls = copy_calls();
+
+  CHECK(PageHashSetVerify(&set, base, 0, scratch, count_mismatch,
+                          &mismatches) == set.count);
+  CHECK(copy_calls() - calls == set.count);
+  CHECK(set.verified == set.count);
+  CHECK(set.unreadable == 0);
+  CHECK(mismatches == 0);
+
+  /* a patched byte in the second page of .text is reported once */
+  static_cast<uint8_t *>(mapped.base)[set.pages[1].rva + 0x10] ^= 0xff;
+  PageHashSetVerify(&set, base, 0, scratch, count_mismatch, &mismatches);
+  PageHashSetVerify(&set, base, 0, scratch, count_mismatch, &mismatches);
+  CHECK(mismatches == 1);
+  CHECK(set.mismatches == 1);
+
+  /* copies out of memory the shim doesnt have mapped fail */
+  std::vector<uint8_t> unmapped(image);
+  CHECK(PageHashSetVerify(&set, reinterpret_cast<UINT64>(unmapped.data()), 0,
+                          scratch, count_mismatch,
+                          &mismatches) == set.count);
+  CHECK(set.unreadable == set.count);
+  CHECK(mismatches == 1);
+
+  /* and start working once it is */
+  CHECK(NT_SUCCESS(ShimMapRegion(unmapped.data(), unmapped.size(),
+                                 SHIM_NO_PHYSICAL_ADDRESS)));
+  PageHashSetVerify(&set, reinterpret_cast<UINT64>(unmapped.data()), 0,
+                    scratch, count_mismatch, &mismatches);
+  CHECK(set.unreadable == set.count);
+  CHECK(mismatches == 1);
+  ShimUnmapRegion(unmapped.data());
+
+  ImpExFreePoolWithTag(scratch, POOL_TAG_TEST);
+  ImpExFreePoolWithTag(set.pages, POOL_TAG_TEST);
+}
+
+} // namespace
+
+int main() {
+  std::vector<uint8_t> image = driver_image();
+  CHECK(!image.empty());
+
+  test_copy_sections(image);
+  test_page_hashes(image);
+
+  SHIM_POOL_STATISTICS statistics = {};
+  ShimPoolGetStatistics(&statistics);
+  CHECK(statistics.allocations == statistics.frees);
+  CHECK(statistics.tag_mismatches == 0);
+  CHECK(ShimPoolReportLeaks(stderr) == 0);
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,408 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../../core/spool.h"
+
+/*
+ * Checks the spool against buffers in host memory, and on unix against a file
+ * mapping written by a child process that is killed at a random point, which
+ * is as close to the module crashing mid append as the host gets.
+ */
+
+static constexpr SIZE_T SPOOL_SIZE = 0x10000;
+static constexpr uint32_t CRASH_ROUNDS = 25;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+/* a record numbered Number, its length and contents follow from the number */
+std::vector<uint8_t> make_record(uint64_t number) {
+  std::vector<uint8_t> record(sizeof(number) + number * 37 % 700);
+
+  memcpy(record.data(), &number, sizeof(number));
+  for (size_t index = sizeof(number); index < record.size(); index++)
+    record[index] = static_cast<uint8_t>(number + index);
+
+  return record;
+}
+
+bool append_record(SPOOL &spool, uint64_t number) {
+  std::vector<uint8_t> record = make_record(number);
+  return NT_SUCCESS(SpoolAppend(&spool, record.data(),
+                                static_cast<UINT32>(record.size())));
+}
+
+/* the number of the record at the head, or ~0 if it isnt a valid record */
+uint64_t peek_record(SPOOL &spool) {
+  PVOID record = nullptr;
+  UINT32 length = 0;
+  uint64_t number = 0;
+
+  if (!NT_SUCCESS(SpoolPeek(&spool, &record, &length)) ||
+      length < sizeof(number))
+    return ~0ull;
+
+  memcpy(&number, record, sizeof(number));
+
+  std::vector<uint8_t> expected = make_record(number);
+  if (length != expected.size() || memcmp(record, expected.data(), length))
+    return ~0ull;
+
+  return number;
+}
+
+/* drains the spool, checking the records are numbered First onwards */
+uint64_t drain_records(SPOOL &spool, uint64_t first) {
+  PVOID record = nullptr;
+  UINT32 length = 0;
+  uint64_t next = first;
+
+  while (NT_SUCCESS(SpoolPeek(&spool, &record, &length))) {
+    CHECK(peek_record(spool) == next);
+    SpoolRelease(&spool);
+    next++;
+  }
+
+  return next - first;
+}
+
+void test_order() {
+  std::vector<uint8_t> buffer(SPOOL_SIZE);
+  SPOOL spool = {};
+  uint64_t appended = 0;
+  uint64_t drained = 0;
+  std::mt19937_64 random(1);
+
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, buffer.data(), buffer.size())));
+  CHECK(drain_records(spool, 0) == 0);
+
+  /* many laps around the ring with the fill level moving up and down */
+  for (uint32_t round = 0; round < 2000; round++) {
+    uint32_t appends = random() % 24;
+    uint32_t releases = random() % 24;
+
+    for (uint32_t index = 0; index < appends; index++) {
+      if (!append_record(spool, appended))
+        break;
+      appended++;
+    }
+
+    for (uint32_t index = 0; index < releases && drained < appended;
+         index++) {
+      CHECK(peek_record(spool) == drained);
+      SpoolRelease(&spool);
+      drained++;
+    }
+  }
+
+  CHECK(spool.tail > 4 * spool.capacity);
+  CHECK(spool.full > 0);
+  CHECK(drain_records(spool, drained) == appended - drained);
+}
+
+void test_reopen() {
+  std::vector<uint8_t> buffer(SPOOL_SIZE);
+  SPOOL spool = {};
+  SPOOL reopened = {};
+
+  CHECK(SpoolOpen(&spool, buffer.data(), buffer.size()) ==
+        STATUS_INVALID_PARAMETER);
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, buffer.data(), buffer.size())));
+
+  /* a few more than a checkpoint interval, so some come from the scan */
+  for (uint64_t number = 0; number < SPOOL_CHECKPOINT_INTERVAL + 10; number++)
+    CHECK(append_record(spool, number));
+
+  for (uint64_t number = 0; number < 5; number++)
+    SpoolRelease(&spool);
+
+  for (uint64_t number = SPOOL_CHECKPOINT_INTERVAL + 10;
+       number < SPOOL_CHECKPOINT_INTERVAL + 20; number++)
+    CHECK(append_record(spool, number));
+
+  CHECK(NT_SUCCESS(SpoolOpen(&reopened, buffer.data(), buffer.size())));
+  CHECK(reopened.recovered == 10);
+  CHECK(reopened.head == spool.head);
+  CHECK(reopened.tail == spool.tail);
+  CHECK(drain_records(reopened, 5) == SPOOL_CHECKPOINT_INTERVAL + 15);
+
+  /* a different size is a different spool */
+  CHECK(SpoolOpen(&reopened, buffer.data(), buffer.size() - 0x100) ==
+        STATUS_INVALID_PARAMETER);
+}
+
+void test_torn() {
+  std::vector<uint8_t> buffer(SPOOL_SIZE);
+  SPOOL spool = {};
+  SPOOL reopened = {};
+  PVOID record = nullptr;
+  UINT32 length = 0;
+
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, buffer.data(), buffer.size())));
+
+  for (uint64_t number = 0; number < 20; number++)
+    CHECK(append_record(spool, number));
+
+  /* tear the last record, as if the crash came half way through copying it */
+  SPOOL_RECORD *last = reinterpret_cast<SPOOL_RECORD *>(
+      spool.data + spool.tail - ((sizeof(SPOOL_RECORD) +
+                                  make_record(19).size() + 7) & ~7ull));
+  CHECK(last->sequence == 19);
+  reinterpret_cast<uint8_t *>(last + 1)[9] ^= 0xff;
+
+  CHECK(NT_SUCCESS(SpoolOpen(&reopened, buffer.data(), buffer.size())));
+  CHECK(reopened.tail_sequence == 19);
+  CHECK(drain_records(reopened, 0) == 19);
+
+  /* tear the newest checkpoint, the older one and the scan cover for it */
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, buffer.data(), buffer.size())));
+  for (uint64_t number = 0; number < 2 * SPOOL_CHECKPOINT_INTERVAL + 8;
+       number++)
+    CHECK(append_record(spool, number));
+  SpoolRelease(&spool);
+
+  SPOOL_HEADER *header = spool.header;
+  header->checkpoints[spool.generation % SPOOL_CHECKPOINT_COUNT].tail ^= 0x40;
+
+  CHECK(NT_SUCCESS(SpoolOpen(&reopened, buffer.data(), buffer.size())));
+  CHECK(reopened.head_sequence == 0);
+  CHECK(drain_records(reopened, 0) == 2 * SPOOL_CHECKPOINT_INTERVAL + 8);
+
+  /* both torn means there is nothing left to trust */
+  for (SPOOL_CHECKPOINT &checkpoint : header->checkpoints)
+    checkpoint.checksum ^= 1;
+  CHECK(SpoolOpen(&reopened, buffer.data(), buffer.size()) ==
+        STATUS_DATA_ERROR);
+
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, buffer.data(), buffer.size())));
+  CHECK(!NT_SUCCESS(SpoolPeek(&spool, &record, &length)));
+  CHECK(SpoolAppend(&spool, buffer.data(),
+                    SpoolGetMaximumRecordLength(spool.capacity) + 1) ==
+        STATUS_INVALID_PARAMETER);
+}
+
+struct flushed_range {
+  uint64_t offset;
+  size_t length;
+};
+
+/* the ranges handed to the flush routine, as offsets into the data area */
+struct flush_log {
+  SPOOL *spool;
+  std::vector<flushed_range> ranges;
+};
+
+void record_flush(PVOID base, SIZE_T length, PVOID context) {
+  flush_log *log = static_cast<flush_log *>(context);
+
+  log->ranges.push_back(
+      {static_cast<uint64_t>(static_cast<uint8_t *>(base) - log->spool->data),
+       length});
+}
+
+/* the newest checkpoint in the header, as SpoolOpen would pick it */
+SPOOL_CHECKPOINT &newest_checkpoint(SPOOL &spool) {
+  return spool.header->checkpoints[spool.generation % SPOOL_CHECKPOINT_COUNT];
+}
+
+/*
+ * Checkpoints only cover records that went through the flush routine first,
+ * and a head record that fails its checksum ends the spool instead of being
+ * handed out.
+ */
+void test_flush() {
+  std::vector<uint8_t> buffer(SPOOL_SIZE);
+  SPOOL spool = {};
+  flush_log log = {&spool, {}};
+  std::vector<flushed_range> &ranges = log.ranges;
+  PVOID record = nullptr;
+  UINT32 length = 0;
+
+  SpoolSetFlushRoutine(&spool, record_flush, &log);
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, buffer.data(), buffer.size())));
+
+  for (uint64_t number = 0; number < SPOOL_CHECKPOINT_INTERVAL - 1; number++)
+    CHECK(append_record(spool, number));
+  CHECK(ranges.empty());
+  CHECK(newest_checkpoint(spool).tail == 0);
+
+  CHECK(append_record(spool, SPOOL_CHECKPOINT_INTERVAL - 1));
+  CHECK(ranges.size() == 1);
+  CHECK(ranges[0].offset == 0 && ranges[0].length == spool.tail);
+  CHECK(newest_checkpoint(spool).tail == spool.tail);
+
+  /* releasing moves the head without flushing or covering newer records */
+  uint64_t flushed = spool.tail;
+  CHECK(append_record(spool, SPOOL_CHECKPOINT_INTERVAL));
+  SpoolRelease(&spool);
+  CHECK(ranges.size() == 1);
+  CHECK(newest_checkpoint(spool).head == spool.head);
+  CHECK(newest_checkpoint(spool).tail == flushed);
+
+  SpoolCheckpoint(&spool);
+  CHECK(ranges.size() == 2);
+  CHECK(ranges[1].offset == flushed &&
+        ranges[1].length == spool.tail - flushed);
+  CHECK(newest_checkpoint(spool).tail == spool.tail);
+
+  /* a range that wraps around the end of the data area is flushed in two */
+  while (spool.tail < spool.capacity) {
+    while (spool.tail - spool.head > spool.capacity / 2)
+      SpoolRelease(&spool);
+    CHECK(append_record(spool, spool.tail_sequence));
+  }
+  ranges.clear();
+  SpoolCheckpoint(&spool);
+  CHECK(ranges.size() == 2);
+  CHECK(ranges[1].offset == 0);
+  CHECK(ranges[0].offset + ranges[0].length == spool.capacity);
+
+  /* a head record the disk never saw discards it and everything after it */
+  uint64_t remaining = spool.tail_sequence - spool.head_sequence;
+  CHECK(NT_SUCCESS(SpoolPeek(&spool, &record, &length)));
+  static_cast<uint8_t *>(record)[0] ^= 0xff;
+
+  CHECK(SpoolPeek(&spool, &record, &length) == STATUS_NOT_FOUND);
+  CHECK(spool.discarded == remaining);
+  CHECK(spool.head == spool.tail);
+  CHECK(newest_checkpoint(spool).tail == spool.head);
+
+  /* and the spool carries on from there */
+  uint64_t next = spool.tail_sequence;
+  CHECK(append_record(spool, next));
+  CHECK(peek_record(spool) == next);
+  SpoolRelease(&spool);
+  CHECK(spool.head == spool.tail);
+}
+
+#if defined(__unix__)
+
+/* appends and releases records as fast as it can until it is killed */
+[[noreturn]] void run_writer(void *mapping, uint64_t next, uint64_t seed) {
+  std::mt19937_64 random(seed);
+  SPOOL spool = {};
+
+  if (!NT_SUCCESS(SpoolOpen(&spool, mapping, SPOOL_SIZE)))
+    _exit(1);
+
+  while (true) {
+    if (append_record(spool, next))
+      next++;
+
+    if (random() % 3 == 0)
+      SpoolRelease(&spool);
+  }
+}
+
+void test_crash() {
+  char path[] = "/tmp/ac_spool_test_XXXXXX";
+  int fd = mkstemp(path);
+  std::mt19937_64 random(2);
+  SPOOL spool = {};
+  uint64_t next = 0;
+  uint64_t recovered = 0;
+
+  CHECK(fd >= 0);
+  if (fd < 0)
+    return;
+
+  unlink(path);
+  CHECK(!ftruncate(fd, SPOOL_SIZE));
+
+  void *mapping =
+      mmap(nullptr, SPOOL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  CHECK(mapping != MAP_FAILED);
+  if (mapping == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+
+  CHECK(NT_SUCCESS(SpoolFormat(&spool, mapping, SPOOL_SIZE)));
+
+  for (uint32_t round = 0; round < CRASH_ROUNDS; round++) {
+    pid_t child = fork();
+    if (!child)
+      run_writer(mapping, next, round);
+
+    usleep(1000 + random() % 20000);
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+
+    /* the parent's own view of the file, as a restarted module would map it */
+    CHECK(NT_SUCCESS(SpoolOpen(&spool, mapping, SPOOL_SIZE)));
+
+    uint64_t head = peek_record(spool);
+    uint64_t count = spool.tail_sequence - spool.head_sequence;
+    if (!count)
+      continue;
+
+    CHECK(head != ~0ull);
+
+    /* every record left must be intact and in order, with no gaps */
+    PVOID record = nullptr;
+    UINT32 length = 0;
+    uint64_t expected = head;
+    while (NT_SUCCESS(SpoolPeek(&spool, &record, &length)) &&
+           expected < head + count / 2) {
+      CHECK(peek_record(spool) == expected);
+      SpoolRelease(&spool);
+      expected++;
+    }
+
+    /* leave the rest for the next writer to append behind */
+    next = head + count;
+    recovered += spool.recovered;
+    CHECK(NT_SUCCESS(SpoolOpen(&spool, mapping, SPOOL_SIZE)));
+    CHECK(peek_record(spool) == expected);
+  }
+
+  uint64_t left = spool.tail_sequence - spool.head_sequence;
+  CHECK(drain_records(spool, peek_record(spool)) == left);
+  CHECK(recovered > 0);
+
+  munmap(mapping, SPOOL_SIZE);
+  close(fd);
+}
+
+#endif
+
+} // namespace
+
+int main() {
+  test_order();
+  test_reopen();
+  test_torn();
+  test_flush();
+#if defined(__unix__)
+  test_crash();
+#endif
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../core/stackcache.h"
+
+/*
+ * Runs the stack cache through rounds the way the stackwalks do and checks
+ * which stacks hit, when an entry ages out, which entry a full probe window
+ * evicts and that a changed module list drops everything.
+ */
+
+static constexpr UINT32 CAPACITY = 64;
+static constexpr UINT64 THREAD = 0xffffc0012345a080ull;
+static constexpr UINT64 FINGERPRINT = 0x1234;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+class stack_cache {
+public:
+  stack_cache() : entries(CAPACITY) {
+    StackCacheInitialise(&this->cache, this->entries.data(), CAPACITY);
+    StackCacheBeginRound(&this->cache, FINGERPRINT);
+  }
+
+  /* moves the cache on Count rounds against the same module list */
+  void advance(UINT32 count) {
+    for (UINT32 round = 0; round < count; round++)
+      StackCacheBeginRound(&this->cache, FINGERPRINT);
+  }
+
+  BOOLEAN lookup(UINT64 thread, UINT64 hash) {
+    return StackCacheLookup(&this->cache, thread, hash, 12);
+  }
+
+  void insert(UINT64 thread, UINT64 hash) {
+    StackCacheInsert(&this->cache, thread, hash, 12);
+  }
+
+  STACK_CACHE cache = {};
+
+private:
+  std::vector<STACK_CACHE_ENTRY> entries;
+};
+
+void test_hashes() {
+  UINT64 frames[] = {0xfffff80001001000ull, 0xfffff80001002000ull,
+                     0xfffff80001003000ull};
+  UINT64 hash = StackCacheHashFrames(frames, 3);
+
+  CHECK(hash != StackCacheHashFrames(frames, 2));
+  frames[2]++;
+  CHECK(hash != StackCacheHashFrames(frames, 3));
+
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules(2);
+  modules[0].ImageBase = reinterpret_cast<PVOID>(0xfffff80001000000ull);
+  modules[0].ImageSize = 0x100000;
+  modules[1].ImageBase = reinterpret_cast<PVOID>(0xfffff80003000000ull);
+  modules[1].ImageSize = 0x20000;
+
+  SYSTEM_MODULES list = {modules.data(), 2};
+  UINT64 fingerprint = StackCacheModuleFingerprint(&list);
+
+  modules[1].ImageSize += 0x1000;
+  CHECK(StackCacheModuleFingerprint(&list) != fingerprint);
+  modules[1].ImageSize -= 0x1000;
+
+  list.module_count = 1;
+  CHECK(StackCacheModuleFingerprint(&list) != fingerprint);
+}
+
+/* only the same thread, hash and frame count hit, and the stats say so */
+void test_lookup() {
+  stack_cache stacks;
+  STACK_CACHE &cache = stacks.cache;
+
+  CHECK(!stacks.lookup(THREAD, 1));
+  stacks.insert(THREAD, 1);
+  CHECK(cache.count == 1);
+
+  CHECK(stacks.lookup(THREAD, 1));
+  CHECK(!stacks.lookup(THREAD, 2));
+  CHECK(!stacks.lookup(THREAD + 0x80, 1));
+  CHECK(!StackCacheLookup(&cache, THREAD, 1, 11));
+
+  CHECK(cache.current.lookups == 5);
+  CHECK(cache.current.hits == 1);
+  CHECK(cache.current.frames_skipped == 12);
+
+  /* the round's numbers move to previous when the next one starts */
+  stacks.advance(1);
+  CHECK(cache.previous.hits == 1);
+  CHECK(cache.current.lookups == 0);
+  CHECK(cache.hits == 1 && cache.lookups == 5);
+
+  /* inserting the same stack again doesnt take another slot */
+  stacks.insert(THREAD, 1);
+  CHECK(cache.count == 1);
+
+  /* a null thread is never stored */
+  stacks.insert(0, 1);
+  CHECK(cache.count == 1);
+}
+
+/*
+ * An entry lives STACK_CACHE_MAX_AGE rounds past the last one it was seen in,
+ * and every hit starts that again.
+ */
+void test_aging() {
+  stack_cache stacks;
+  STACK_CACHE &cache = stacks.cache;
+
+  stacks.insert(THREAD, 1);
+  stacks.insert(THREAD, 2);
+
+  stacks.advance(STACK_CACHE_MAX_AGE);
+  CHECK(stacks.lookup(THREAD, 1));
+
+  stacks.advance(1);
+  CHECK(!stacks.lookup(THREAD, 2));
+  CHECK(stacks.lookup(THREAD, 1));
+
+  stacks.advance(STACK_CACHE_MAX_AGE + 1);
+  CHECK(!stacks.lookup(THREAD, 1));
+
+  /* stale entries are reused before anything is evicted */
+  for (UINT64 hash = 10; hash < 10 + STACK_CACHE_PROBE_LIMIT; hash++)
+    stacks.insert(THREAD, hash);
+  CHECK(cache.current.evictions == 0);
+  CHECK(cache.count == STACK_CACHE_PROBE_LIMIT);
+}
+
+/*
+ * A thread with more stacks than the probe window evicts the one seen least
+ * recently, the rest keep hitting.
+ */
+void test_eviction() {
+  stack_cache stacks;
+  STACK_CACHE &cache = stacks.cache;
+
+  for (UINT64 hash = 0; hash < STACK_CACHE_PROBE_LIMIT; hash++) {
+    stacks.insert(THREAD, hash);
+    stacks.advance(1);
+  }
+  CHECK(cache.count == STACK_CACHE_PROBE_LIMIT);
+
+  /* seeing the oldest again makes the second oldest the one to go */
+  CHECK(stacks.lookup(THREAD, 0));
+
+  stacks.insert(THREAD, 100);
+  CHECK(cache.current.evictions == 1);
+  CHECK(cache.count == STACK_CACHE_PROBE_LIMIT);
+  CHECK(!stacks.lookup(THREAD, 1));
+  CHECK(stacks.lookup(THREAD, 0));
+  CHECK(stacks.lookup(THREAD, 100));
+
+  for (UINT64 hash = 2; hash < STACK_CACHE_PROBE_LIMIT; hash++)
+    CHECK(stacks.lookup(THREAD, hash));
+}
+
+/* a new module list drops every entry, the same one keeps them */
+void test_invalidation() {
+  stack_cache stacks;
+  STACK_CACHE &cache = stacks.cache;
+
+  stacks.insert(THREAD, 1);
+  stacks.insert(THREAD + 0x80, 1);
+  StackCacheBeginRound(&cache, FINGERPRINT);
+  CHECK(cache.count == 2);
+  CHECK(cache.invalidations == 0);
+
+  StackCacheBeginRound(&cache, FINGERPRINT + 1);
+  CHECK(cache.count == 0);
+  CHECK(cache.invalidations == 1);
+  CHECK(!stacks.lookup(THREAD, 1));
+  CHECK(!StackCacheLookup(&cache, THREAD + 0x80, 1, 12));
+
+  /* an empty cache isnt counted as invalidated */
+  StackCacheBeginRound(&cache, FINGERPRINT + 2);
+  CHECK(cache.invalidations == 1);
+}
+
+} // namespace
+
+int main() {
+  test_hashes();
+  test_lookup();
+  test_aging();
+  test_eviction();
+  test_invalidation();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
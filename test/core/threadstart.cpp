@@ -0,0 +1,218 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../../core/threadstart.h"
+
+/*
+ * Audits system threads against a fake module list over several rounds and
+ * checks each thread's verdict, how unbacked threads are aggregated by start
+ * address, that an address is only reported once, and when the generation
+ * moves on to have every thread audited again.
+ */
+
+static constexpr UINT64 NTOSKRNL = 0xfffff80001000000ull;
+static constexpr UINT64 DRIVER = 0xfffff80003000000ull;
+static constexpr UINT64 MAPPED = 0xffffa10000020000ull;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+class thread_audit {
+public:
+  thread_audit() : modules(2), ranges(4) {
+    this->modules[0].ImageBase = reinterpret_cast<PVOID>(NTOSKRNL);
+    this->modules[0].ImageSize = 0x1000000;
+    this->modules[1].ImageBase = reinterpret_cast<PVOID>(DRIVER);
+    this->modules[1].ImageSize = 0x40000;
+
+    ThreadStartAuditInitialise(&this->audit);
+  }
+
+  UINT32 begin() {
+    SYSTEM_MODULES list = {this->modules.data(),
+                           static_cast<INT>(this->modules.size())};
+
+    return ThreadStartAuditBeginRound(
+        &this->audit, this->ranges.data(),
+        static_cast<UINT32>(this->ranges.size()), &list);
+  }
+
+  THREAD_START_VERDICT record(UINT32 id, UINT64 start, UINT64 win32_start) {
+    return ThreadStartAuditRecord(&this->audit, 0xffffc00100000000ull + id,
+                                  id, start, win32_start);
+  }
+
+  UINT32 end() {
+    return ThreadStartAuditEndRound(&this->audit, on_report, this);
+  }
+
+  THREAD_START_AUDIT audit = {};
+  std::vector<RTL_MODULE_EXTENDED_INFO> modules;
+  std::vector<UNBACKED_THREAD_START> reports;
+
+private:
+  static VOID on_report(PUNBACKED_THREAD_START Start, PVOID Context) {
+    static_cast<thread_audit *>(Context)->reports.push_back(*Start);
+  }
+
+  std::vector<MODULE_RANGE> ranges;
+};
+
+void test_verdicts() {
+  thread_audit threads;
+  THREAD_START_AUDIT &audit = threads.audit;
+
+  CHECK(threads.begin() == 1);
+
+  CHECK(threads.record(4, NTOSKRNL + 0x100, NTOSKRNL + 0x100) ==
+        THREAD_START_BACKED);
+  /* Win32StartAddress isnt always set */
+  CHECK(threads.record(8, DRIVER + 0x200, 0) == THREAD_START_BACKED);
+  CHECK(threads.record(12, MAPPED, 0) == THREAD_START_UNBACKED);
+  /* the unbacked one of the two is the key, whichever it is */
+  CHECK(threads.record(16, NTOSKRNL + 0x300, MAPPED) ==
+        THREAD_START_UNBACKED);
+  CHECK(threads.record(20, MAPPED + 0x80, NTOSKRNL + 0x300) ==
+        THREAD_START_UNBACKED);
+  /* the end of a module is outside it */
+  CHECK(threads.record(24, DRIVER + 0x40000, 0) == THREAD_START_UNBACKED);
+
+  CHECK(audit.audited == 6);
+  CHECK(audit.unbacked == 4);
+  CHECK(audit.pending_count == 3);
+
+  CHECK(threads.end() == 3);
+  CHECK(threads.reports.size() == 3);
+  if (threads.reports.size() == 3) {
+    /* the first thread seen starting at an address is the one reported */
+    CHECK(threads.reports[0].address == MAPPED);
+    CHECK(threads.reports[0].thread_id == 12);
+    CHECK(threads.reports[0].threads == 2);
+    CHECK(threads.reports[0].win32_start_address == 0);
+
+    CHECK(threads.reports[1].address == MAPPED + 0x80);
+    CHECK(threads.reports[1].start_address == MAPPED + 0x80);
+    CHECK(threads.reports[1].win32_start_address == NTOSKRNL + 0x300);
+    CHECK(threads.reports[1].threads == 1);
+
+    CHECK(threads.reports[2].address == DRIVER + 0x40000);
+  }
+}
+
+/* the same start address in a later round is suppressed, a new one isnt */
+void test_reported_once() {
+  thread_audit threads;
+  THREAD_START_AUDIT &audit = threads.audit;
+
+  threads.begin();
+  threads.record(4, MAPPED, 0);
+  CHECK(threads.end() == 1);
+
+  CHECK(threads.begin() == 1);
+  CHECK(threads.record(8, MAPPED, 0) == THREAD_START_UNBACKED);
+  CHECK(threads.record(12, MAPPED + 0x1000, 0) == THREAD_START_UNBACKED);
+  CHECK(threads.end() == 1);
+  CHECK(audit.suppressed == 1);
+  CHECK(threads.reports.size() == 2);
+  CHECK(threads.reports.back().address == MAPPED + 0x1000);
+  CHECK(audit.rounds == 2);
+  CHECK(audit.threads_audited == 3);
+}
+
+/*
+ * The generation only moves on when the module list changes, and skips 0 when
+ * it wraps so new threads are always audited.
+ */
+void test_generation() {
+  thread_audit threads;
+
+  CHECK(threads.begin() == 1);
+  threads.end();
+  CHECK(threads.begin() == 1);
+  threads.end();
+
+  /* a module unloading leaves its threads unbacked */
+  threads.modules.pop_back();
+  CHECK(threads.begin() == 2);
+  CHECK(threads.record(8, DRIVER + 0x200, 0) == THREAD_START_UNBACKED);
+  threads.end();
+
+  threads.audit.generation = ~0u;
+  threads.modules[0].ImageSize += 0x1000;
+  CHECK(threads.begin() == 1);
+  threads.end();
+}
+
+/*
+ * Once there is no room to aggregate another start address the thread is
+ * deferred, threads starting at an address already pending still count. Once
+ * the reported set is full new addresses are reported every round.
+ */
+void test_capacity() {
+  thread_audit threads;
+  THREAD_START_AUDIT &audit = threads.audit;
+
+  threads.begin();
+  for (UINT32 index = 0; index < THREAD_START_PENDING_CAPACITY; index++)
+    CHECK(threads.record(index, MAPPED + index * 0x1000, 0) ==
+          THREAD_START_UNBACKED);
+
+  CHECK(threads.record(0x1000, MAPPED + 0x100000, 0) ==
+        THREAD_START_DEFERRED);
+  CHECK(threads.record(0x1004, MAPPED, 0) == THREAD_START_UNBACKED);
+  CHECK(audit.audited == THREAD_START_PENDING_CAPACITY + 1);
+  CHECK(threads.end() == THREAD_START_PENDING_CAPACITY);
+
+  for (UINT32 round = 1; round < 4; round++) {
+    threads.begin();
+    for (UINT32 index = 0; index < THREAD_START_PENDING_CAPACITY; index++)
+      threads.record(index,
+                     MAPPED + (round * THREAD_START_PENDING_CAPACITY + index) *
+                                  0x1000,
+                     0);
+    CHECK(threads.end() == THREAD_START_PENDING_CAPACITY);
+  }
+  CHECK(audit.reported_count == THREAD_START_REPORTED_CAPACITY);
+
+  /* the reported set stays sorted, and full */
+  bool sorted = true;
+  for (UINT32 index = 1; index < audit.reported_count; index++)
+    sorted &= audit.reported[index - 1] < audit.reported[index];
+  CHECK(sorted);
+
+  threads.begin();
+  threads.record(0, MAPPED + 0x10000000, 0);
+  CHECK(threads.end() == 1);
+  threads.begin();
+  threads.record(0, MAPPED + 0x10000000, 0);
+  CHECK(threads.end() == 1);
+  CHECK(audit.reported_count == THREAD_START_REPORTED_CAPACITY);
+}
+
+} // namespace
+
+int main() {
+  test_verdicts();
+  test_reported_once();
+  test_generation();
+  test_capacity();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "../../module/dispatcher/scheduler.h"
+
+/*
+ * Checks the dispatcher's scheduler on the host. The idle check compares the
+ * wakeups of the scheduler against the sleep polling loop it replaced, run
+ * with a much shorter period so the test stays quick.
+ */
+
+using namespace std::chrono_literals;
+
+static constexpr auto IDLE_WINDOW = 500ms;
+static constexpr auto POLL_PERIOD = 10ms;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+using dispatcher::scheduler;
+using dispatcher::scheduler_stats;
+
+void test_order() {
+  scheduler jobs;
+  std::vector<int> order;
+
+  jobs.schedule([&]() { order.push_back(3); }, 30ms);
+  jobs.schedule([&]() { order.push_back(1); }, 10ms);
+  jobs.schedule([&]() { order.push_back(2); }, 20ms);
+  jobs.schedule([&]() { jobs.shutdown(); }, 40ms);
+  /* posted jobs run before anything due */
+  jobs.post([&]() { order.push_back(0); });
+
+  jobs.run();
+
+  CHECK((order == std::vector<int>{0, 1, 2, 3}));
+  CHECK(jobs.get_stats().deadlines == 4);
+  CHECK(jobs.get_stats().posted == 1);
+}
+
+void test_periodic() {
+  scheduler jobs;
+  int runs = 0;
+
+  jobs.schedule([&]() { runs++; }, 0ms, 20ms);
+  jobs.schedule([&]() { jobs.shutdown(); }, 210ms);
+
+  jobs.run();
+
+  /* at 0, 20, ... 200ms, with some room for a slow machine */
+  CHECK(runs >= 8 && runs <= 11);
+}
+
+/* a post from another thread runs long before the next deadline */
+void test_post() {
+  scheduler jobs;
+  std::atomic<bool> ran(false);
+
+  jobs.schedule([]() {}, 1h);
+  std::thread runner([&]() { jobs.run(); });
+
+  std::this_thread::sleep_for(50ms);
+  scheduler::clock::time_point posted = scheduler::clock::now();
+  jobs.post([&]() { ran = true; });
+
+  while (!ran && scheduler::clock::now() - posted < 1s)
+    std::this_thread::yield();
+
+  CHECK(ran);
+  CHECK(scheduler::clock::now() - posted < 100ms);
+
+  jobs.shutdown();
+  runner.join();
+}
+
+void test_idle() {
+  scheduler jobs;
+  uint64_t polls = 0;
+
+  /* nothing due for an hour, the scheduler should sleep through the window */
+  jobs.schedule([]() {}, 1h, 1h);
+  std::thread runner([&]() { jobs.run(); });
+
+  scheduler::clock::time_point end = scheduler::clock::now() + IDLE_WINDOW;
+  while (scheduler::clock::now() < end) {
+    std::this_thread::sleep_for(POLL_PERIOD);
+    polls++;
+  }
+
+  jobs.shutdown();
+  runner.join();
+
+  /* the only wakeup is the shutdown */
+  scheduler_stats stats = jobs.get_stats();
+  printf("idle wakeups in %lldms: scheduler %llu, polling every %lldms %llu\n",
+         static_cast<long long>(IDLE_WINDOW.count()),
+         static_cast<unsigned long long>(stats.wakeups),
+         static_cast<long long>(POLL_PERIOD.count()),
+         static_cast<unsigned long long>(polls));
+
+  CHECK(stats.wakeups <= 1);
+  CHECK(stats.deadlines == 0);
+  CHECK(polls > 10);
+}
+
+/* shutdown from another thread ends a run blocked with nothing scheduled */
+void test_shutdown() {
+  scheduler jobs;
+  std::thread runner([&]() { jobs.run(); });
+
+  std::this_thread::sleep_for(20ms);
+  jobs.shutdown();
+  runner.join();
+
+  CHECK(jobs.get_stats().wakeups <= 1);
+}
+
+} // namespace
+
+int main() {
+  test_order();
+  test_periodic();
+  test_post();
+  test_idle();
+  test_shutdown();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "../../module/dispatcher/topology.h"
+
+/*
+ * Checks the processor topology and thread placement against fake sysfs
+ * trees laid out like the machines the module runs on: a hybrid intel part,
+ * a desktop with SMT on every core, an arm big.LITTLE part and a single core
+ * virtual machine.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+namespace {
+
+namespace fs = std::filesystem;
+
+class fake_sysfs {
+  fs::path root;
+
+  void write(const fs::path &path, const std::string &contents) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << contents << "\n";
+  }
+
+public:
+  fake_sysfs(const char *name) {
+    this->root = fs::temp_directory_path() /
+                 ("ac_topology_test_" + std::to_string(getpid()) + name);
+    fs::remove_all(this->root);
+  }
+
+  ~fake_sysfs() { fs::remove_all(this->root); }
+
+  void add_cpu(int cpu, const std::string &siblings,
+               const char *capacity = nullptr) {
+    fs::path directory =
+        this->root / "system/cpu" / ("cpu" + std::to_string(cpu));
+    this->write(directory / "topology/thread_siblings_list", siblings);
+    if (capacity)
+      this->write(directory / "cpu_capacity", capacity);
+  }
+
+  void set_atom(const std::string &cpus) {
+    this->write(this->root / "cpu_atom/cpus", cpus);
+  }
+
+  std::string path() { return this->root.string(); }
+};
+
+UINT64 parse(const char *list) {
+  UINT64 mask = 0;
+  if (!NT_SUCCESS(CpuTopologyParseList(list, strlen(list), &mask)))
+    return ~0ull;
+  return mask;
+}
+
+CPU_PLACEMENT get_placement(CPU_TOPOLOGY &topology, CPU_PLACEMENT_CLASS type) {
+  CPU_PLACEMENT placement = {};
+  CpuTopologyGetPlacement(&topology, type, &placement);
+  return placement;
+}
+
+void test_parse() {
+  CHECK(parse("0") == 0x1);
+  CHECK(parse("0-3,8,10-11\n") == 0xd0f);
+  CHECK(parse("") == 0);
+  CHECK(parse("60-70") == 0xf000000000000000ull);
+  CHECK(parse("3-1") == ~0ull);
+  CHECK(parse("1,,2") == ~0ull);
+  CHECK(parse("a") == ~0ull);
+  CHECK(parse("1-") == ~0ull);
+}
+
+/* 2 performance cores with SMT then 4 efficiency cores without */
+void test_hybrid() {
+  fake_sysfs sysfs("hybrid");
+  CPU_TOPOLOGY topology = {};
+
+  for (int cpu = 0; cpu < 4; cpu++)
+    sysfs.add_cpu(cpu, cpu < 2 ? "0-1" : "2-3");
+  for (int cpu = 4; cpu < 8; cpu++)
+    sysfs.add_cpu(cpu, std::to_string(cpu));
+  sysfs.set_atom("4-7");
+
+  CHECK(dispatcher::load_cpu_topology(topology, sysfs.path().c_str()));
+  CHECK(topology.core_count == 6);
+  CHECK(topology.processor_count == 8);
+  CHECK(topology.smt);
+  CHECK(topology.lowest_class == 0 && topology.highest_class == 1);
+
+  CPU_PLACEMENT background = get_placement(topology, CpuPlacementBackground);
+  CPU_PLACEMENT latency = get_placement(topology, CpuPlacementLatency);
+  CHECK(background.mask == 0xf0 && background.low_priority);
+  CHECK(latency.mask == 0x0f && !latency.low_priority);
+}
+
+/* 8 cores with SMT, siblings numbered n and n + 8 as on most desktops */
+void test_smt() {
+  fake_sysfs sysfs("smt");
+  CPU_TOPOLOGY topology = {};
+
+  for (int cpu = 0; cpu < 16; cpu++)
+    sysfs.add_cpu(cpu, std::to_string(cpu % 8) + "," +
+                           std::to_string(cpu % 8 + 8));
+
+  CHECK(dispatcher::load_cpu_topology(topology, sysfs.path().c_str()));
+  CHECK(topology.core_count == 8);
+  CHECK(topology.processor_count == 16);
+
+  /* the last quarter of the cores, both siblings of each */
+  CPU_PLACEMENT background = get_placement(topology, CpuPlacementBackground);
+  CPU_PLACEMENT latency = get_placement(topology, CpuPlacementLatency);
+  CHECK(background.mask == 0xc0c0);
+  CHECK(latency.mask == 0x3f3f);
+}
+
+/* 4 little cores at capacity 446 and 2 big ones at 1024 */
+void test_capacity() {
+  fake_sysfs sysfs("capacity");
+  CPU_TOPOLOGY topology = {};
+
+  for (int cpu = 0; cpu < 6; cpu++)
+    sysfs.add_cpu(cpu, std::to_string(cpu), cpu < 4 ? "446" : "1024");
+
+  CHECK(dispatcher::load_cpu_topology(topology, sysfs.path().c_str()));
+  CHECK(!topology.smt);
+  CHECK(get_placement(topology, CpuPlacementBackground).mask == 0x0f);
+  CHECK(get_placement(topology, CpuPlacementLatency).mask == 0x30);
+}
+
+/* one core and a missing tree leave placement to the scheduler */
+void test_unrestricted() {
+  fake_sysfs sysfs("single");
+  CPU_TOPOLOGY topology = {};
+
+  sysfs.add_cpu(0, "0");
+  CHECK(dispatcher::load_cpu_topology(topology, sysfs.path().c_str()));
+  CHECK(get_placement(topology, CpuPlacementBackground).mask == 0);
+  CHECK(get_placement(topology, CpuPlacementBackground).low_priority);
+  CHECK(get_placement(topology, CpuPlacementLatency).mask == 0);
+
+  fake_sysfs missing("missing");
+  CHECK(!dispatcher::load_cpu_topology(topology, missing.path().c_str()));
+  CHECK(get_placement(topology, CpuPlacementLatency).mask == 0);
+}
+
+void test_overlap() {
+  CPU_TOPOLOGY topology = {};
+
+  CpuTopologyInitialise(&topology);
+  CHECK(NT_SUCCESS(CpuTopologyAddCore(&topology, 0x3, 1)));
+  CHECK(NT_SUCCESS(CpuTopologyAddCore(&topology, 0x3, 1)));
+  CHECK(CpuTopologyAddCore(&topology, 0x6, 1) == STATUS_INVALID_PARAMETER);
+  CHECK(CpuTopologyAddCore(&topology, 0, 1) == STATUS_INVALID_PARAMETER);
+  CHECK(topology.core_count == 1);
+}
+
+/* low priority is SCHED_IDLE, which needs no privileges to enter */
+void test_apply() {
+  int policy = -1;
+
+  std::thread thread([&]() {
+    CPU_PLACEMENT placement = {};
+    sched_param parameters = {};
+    placement.low_priority = TRUE;
+    dispatcher::apply_cpu_placement(placement);
+    pthread_getschedparam(pthread_self(), &policy, &parameters);
+  });
+  thread.join();
+
+  CHECK(policy == SCHED_IDLE);
+}
+
+} // namespace
+
+int main() {
+  test_parse();
+  test_hybrid();
+  test_smt();
+  test_capacity();
+  test_unrestricted();
+  test_overlap();
+  test_apply();
+
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("all checks passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,350 @@
+#include "load.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <random>
+
+#include "../../core/heartbeat.h"
+#include "../../core/report.h"
+
+static constexpr int MAXIMUM_EVENTS = 256;
+static constexpr int POLL_TIMEOUT_MS = 100;
+static constexpr uint32_t TIMER_ID = ~0u;
+
+static constexpr uint32_t report_codes[] = {
+    REPORT_NMI_CALLBACK_FAILURE,     REPORT_MODULE_VALIDATION_FAILURE,
+    REPORT_ILLEGAL_HANDLE_OPERATION, REPORT_INVALID_PROCESS_ALLOCATION,
+    REPORT_HIDDEN_SYSTEM_THREAD,     REPORT_ILLEGAL_ATTACH_PROCESS,
+    REPORT_APC_STACKWALK,            REPORT_DPC_STACKWALK,
+    REPORT_DATA_TABLE_ROUTINE,       REPORT_INVALID_PROCESS_MODULE};
+
+ingest::load::load(const load_config &config)
+    : config(config), started(clock::now()), rng(config.seed) {
+  this->build_reports();
+}
+
+ingest::load::~load() {
+  for (client &entry : this->clients)
+    if (entry.fd >= 0)
+      close(entry.fd);
+  if (this->timer >= 0)
+    close(this->timer);
+  if (this->poll >= 0)
+    close(this->poll);
+}
+
+/* one of each report, shaped like the driver leaves them */
+void ingest::load::build_reports() {
+  std::mt19937_64 rng(this->config.seed);
+
+  for (uint32_t code : report_codes) {
+    uint32_t size = ReportGetExpectedSize(code);
+    uint32_t used = std::min<uint32_t>(size, 24 + rng() % 64);
+    std::vector<uint8_t> report(size, 0);
+
+    for (uint32_t index = sizeof(code); index < used; index++)
+      report[index] = static_cast<uint8_t>(rng() % 255 + 1);
+
+    memcpy(report.data(), &code, sizeof(code));
+
+    /* packed once up front, the clients only ever send copies */
+    if (this->config.pack) {
+      std::vector<uint8_t> packed(REPORT_PACK_MESSAGE_BOUND(size));
+      packed.resize(ReportPackMessage(this->config.dictionary, report.data(),
+                                      size, packed.data(), packed.size()));
+      report = std::move(packed);
+      this->message_type = MESSAGE_TYPE_CLIENT_PACKED_REPORT;
+    }
+
+    this->reports.push_back(std::move(report));
+  }
+}
+
+bool ingest::load::connect(const address &where) {
+  std::mt19937_64 rng(this->config.seed);
+  clock::time_point now = clock::now();
+
+  this->poll = epoll_create1(EPOLL_CLOEXEC);
+  if (this->poll < 0) {
+    fprintf(stderr, "epoll_create1 failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  this->timer = create_timer();
+  if (this->timer < 0)
+    return false;
+
+  epoll_event timer_event = {};
+  timer_event.events = EPOLLIN;
+  timer_event.data.u32 = TIMER_ID;
+  if (epoll_ctl(this->poll, EPOLL_CTL_ADD, this->timer, &timer_event))
+    return false;
+
+  this->clients.resize(this->config.clients);
+
+  for (uint32_t index = 0; index < this->config.clients; index++) {
+    client &entry = this->clients[index];
+    epoll_event event = {};
+
+    entry.fd = connect_socket(where);
+    if (entry.fd < 0)
+      return false;
+
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u32 = index;
+    if (epoll_ctl(this->poll, EPOLL_CTL_ADD, entry.fd, &event)) {
+      fprintf(stderr, "epoll_ctl failed: %s\n", strerror(errno));
+      return false;
+    }
+
+    /* spread the first report over one interval so clients dont march */
+    entry.next_send = now;
+    if (this->config.rate > 0)
+      entry.next_send += std::chrono::duration_cast<clock::duration>(
+          std::chrono::duration<double>(
+              std::uniform_real_distribution<double>(0.0, 1.0)(rng) /
+              this->config.rate));
+
+    /* heartbeats are spread the same way */
+    if (this->config.heartbeat_interval)
+      this->heartbeat_schedule.push(
+          {now + std::chrono::microseconds(
+                     rng() % (this->config.heartbeat_interval * 1000ull)),
+           index});
+
+    this->stats.connected++;
+  }
+
+  return true;
+}
+
+void ingest::load::finish(uint32_t index) {
+  client &entry = this->clients[index];
+  if (entry.fd < 0)
+    return;
+  close(entry.fd);
+  entry.fd = -1;
+  this->finished++;
+}
+
+void ingest::load::flush(uint32_t index) {
+  client &entry = this->clients[index];
+  epoll_event event = {};
+
+  while (entry.output_offset < entry.output.size()) {
+    ssize_t length = write(entry.fd, entry.output.data() + entry.output_offset,
+                           entry.output.size() - entry.output_offset);
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (length <= 0) {
+      this->stats.disconnected++;
+      this->finish(index);
+      return;
+    }
+    entry.output_offset += length;
+  }
+
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.u32 = index;
+
+  if (entry.output_offset == entry.output.size()) {
+    entry.output.clear();
+    entry.output_offset = 0;
+  } else {
+    event.events |= EPOLLOUT;
+  }
+
+  epoll_ctl(this->poll, EPOLL_CTL_MOD, entry.fd, &event);
+}
+
+void ingest::load::send_reports(uint32_t index, clock::time_point now) {
+  client &entry = this->clients[index];
+  bool queued = false;
+
+  while (entry.fd >= 0 && entry.sent < this->config.messages &&
+         entry.in_flight.size() < this->config.window &&
+         entry.next_send <= now) {
+    message_packet_header header = {};
+    header.message_type = this->message_type;
+    header.request_id = static_cast<int>(entry.sent);
+    header.steam64_id = this->config.first_steam64_id + index;
+
+    const std::vector<uint8_t> &report =
+        this->reports[(index + entry.sent) % this->reports.size()];
+    encode_frame(entry.output, header, report.data(),
+                 static_cast<uint32_t>(report.size()));
+
+    entry.in_flight.push_back(now);
+    entry.sent++;
+    this->stats.sent++;
+    queued = true;
+
+    if (this->config.rate > 0)
+      entry.next_send += std::chrono::duration_cast<clock::duration>(
+          std::chrono::duration<double>(1.0 / this->config.rate));
+  }
+
+  if (queued)
+    this->flush(index);
+
+  /* a full window is picked up again when the next ack arrives */
+  if (entry.fd >= 0 && entry.sent < this->config.messages &&
+      entry.in_flight.size() < this->config.window && !entry.scheduled) {
+    entry.scheduled = true;
+    this->schedule.push({entry.next_send, index});
+  }
+}
+
+/*
+ * Signs the heartbeat the way the driver would, with the steam id as the
+ * session cookie. A dropped heartbeat still takes its sequence number.
+ */
+void ingest::load::send_heartbeat(uint32_t index, clock::time_point now) {
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  client &entry = this->clients[index];
+  message_packet_header header = {};
+  HEARTBEAT_PACKET packet = {};
+
+  header.message_type = MESSAGE_TYPE_CLIENT_HEARTBEAT;
+  header.steam64_id = this->config.first_steam64_id + index;
+
+  packet.session_cookie = static_cast<UINT32>(header.steam64_id);
+  packet.sequence = ++entry.heartbeat_sequence;
+  packet.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - this->started)
+                    .count();
+  packet.report_count = entry.sent;
+
+  if (chance(this->rng) < this->config.heartbeat_drop) {
+    this->stats.heartbeats_dropped++;
+    return;
+  }
+
+  UCHAR key[HEARTBEAT_KEY_LENGTH] = {};
+  HeartbeatDeriveKey((PVOID)HEARTBEAT_TEST_ROOT_KEY,
+                     sizeof(HEARTBEAT_TEST_ROOT_KEY), packet.session_cookie,
+                     key);
+  HeartbeatSign(&packet, key, sizeof(key));
+  encode_frame(entry.output, header, &packet, sizeof(packet));
+  this->stats.heartbeats++;
+  this->flush(index);
+}
+
+void ingest::load::read_responses(uint32_t index) {
+  client &entry = this->clients[index];
+  uint8_t buffer[0x1000];
+
+  while (entry.fd >= 0) {
+    ssize_t length = read(entry.fd, buffer, sizeof(buffer));
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (length <= 0) {
+      this->stats.disconnected++;
+      this->finish(index);
+      return;
+    }
+
+    clock::time_point now = clock::now();
+    for (ssize_t offset = 0; offset < length; offset++) {
+      entry.response[entry.response_length++] = buffer[offset];
+      if (entry.response_length < sizeof(entry.response))
+        continue;
+
+      client_report_packet_response response = {};
+      memcpy(&response, entry.response, sizeof(response));
+      entry.response_length = 0;
+
+      /* a server sending acks we never asked for is a protocol error */
+      if (entry.in_flight.empty()) {
+        this->stats.disconnected++;
+        this->finish(index);
+        return;
+      }
+
+      this->stats.latencies.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              now - entry.in_flight.front())
+              .count());
+      entry.in_flight.pop_front();
+      entry.answered++;
+      this->stats.acked++;
+      this->stats.failed += !response.success;
+    }
+
+    if (entry.answered == this->config.messages) {
+      this->finish(index);
+      return;
+    }
+
+    this->send_reports(index, now);
+  }
+}
+
+ingest::load_stats ingest::load::run() {
+  epoll_event events[MAXIMUM_EVENTS];
+  clock::time_point start = clock::now();
+
+  for (uint32_t index = 0; index < this->clients.size(); index++)
+    this->send_reports(index, start);
+
+  while (this->finished < this->clients.size()) {
+    clock::time_point now = clock::now();
+    while (!this->schedule.empty() && this->schedule.top().first <= now) {
+      uint32_t index = this->schedule.top().second;
+      this->schedule.pop();
+      this->clients[index].scheduled = false;
+      this->send_reports(index, now);
+    }
+
+    while (!this->heartbeat_schedule.empty() &&
+           this->heartbeat_schedule.top().first <= now) {
+      send_time due = this->heartbeat_schedule.top();
+      this->heartbeat_schedule.pop();
+      if (this->clients[due.second].fd < 0)
+        continue;
+      this->send_heartbeat(due.second, now);
+      due.first +=
+          std::chrono::milliseconds(this->config.heartbeat_interval);
+      this->heartbeat_schedule.push(due);
+    }
+
+    clock::time_point wake = clock::time_point::max();
+    if (!this->schedule.empty())
+      wake = this->schedule.top().first;
+    if (!this->heartbeat_schedule.empty())
+      wake = std::min(wake, this->heartbeat_schedule.top().first);
+    if (wake != clock::time_point::max())
+      arm_timer(this->timer,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(wake -
+                                                                     now));
+
+    int count =
+        epoll_wait(this->poll, events, MAXIMUM_EVENTS, POLL_TIMEOUT_MS);
+    if (count < 0 && errno != EINTR) {
+      fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+      break;
+    }
+
+    for (int index = 0; index < count; index++) {
+      uint32_t id = events[index].data.u32;
+      if (id == TIMER_ID) {
+        clear_timer(this->timer);
+        continue;
+      }
+      if (events[index].events & EPOLLOUT)
+        this->flush(id);
+      if (events[index].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        this->read_responses(id);
+    }
+  }
+
+  this->stats.elapsed =
+      std::chrono::duration<double>(clock::now() - start).count();
+  return this->stats;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "protocol.h"
+#include "socket.h"
+
+namespace ingest {
+
+struct load_config {
+  uint32_t clients = 100;
+  uint32_t messages = 1000;
+  /* reports per second per client, 0 sends the next as soon as one is acked */
+  double rate = 0.0;
+  /* reports a client may have unacknowledged at once */
+  uint32_t window = 1;
+  uint64_t first_steam64_id = 76561197960265728ull;
+  uint64_t seed = 0x6c6f6164;
+  /* sends every report packed against the dictionary */
+  bool pack = false;
+  REPORT_DICTIONARY *dictionary = nullptr;
+  /* milliseconds between each client's heartbeats, 0 for none */
+  uint32_t heartbeat_interval = 0;
+  /* fraction of heartbeats skipped, the server should see the gaps */
+  double heartbeat_drop = 0.0;
+};
+
+struct load_stats {
+  uint64_t connected = 0;
+  uint64_t sent = 0;
+  uint64_t acked = 0;
+  uint64_t failed = 0;
+  uint64_t disconnected = 0;
+  uint64_t heartbeats = 0;
+  uint64_t heartbeats_dropped = 0;
+  double elapsed = 0.0;
+  /* report written to ack read, in nanoseconds */
+  std::vector<uint64_t> latencies;
+};
+
+/*
+ * Plays any number of modules uplinking reports, all from one epoll loop so
+ * thousands of clients can be driven from a single process.
+ */
+class load {
+  using clock = std::chrono::steady_clock;
+
+  struct client {
+    int fd = -1;
+    uint32_t sent = 0;
+    uint32_t answered = 0;
+    clock::time_point next_send;
+    std::deque<clock::time_point> in_flight;
+    std::vector<uint8_t> output;
+    size_t output_offset = 0;
+    uint8_t response[sizeof(client_report_packet_response)];
+    size_t response_length = 0;
+    bool scheduled = false;
+    uint64_t heartbeat_sequence = 0;
+  };
+
+  using send_time = std::pair<clock::time_point, uint32_t>;
+
+  load_config config;
+  int poll = -1;
+  int timer = -1;
+  std::vector<client> clients;
+  std::vector<std::vector<uint8_t>> reports;
+  int message_type = MESSAGE_TYPE_CLIENT_REPORT;
+  std::priority_queue<send_time, std::vector<send_time>,
+                      std::greater<send_time>>
+      schedule;
+  std::priority_queue<send_time, std::vector<send_time>,
+                      std::greater<send_time>>
+      heartbeat_schedule;
+  clock::time_point started;
+  std::mt19937_64 rng;
+  uint32_t finished = 0;
+  load_stats stats;
+
+  void build_reports();
+  void finish(uint32_t index);
+  void send_reports(uint32_t index, clock::time_point now);
+  void send_heartbeat(uint32_t index, clock::time_point now);
+  void flush(uint32_t index);
+  void read_responses(uint32_t index);
+
+public:
+  load(const load_config &config);
+  ~load();
+
+  bool connect(const address &where);
+  load_stats run();
+};
+
+} // namespace ingest
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <vector>
+
+#include "load.h"
+#include "server.h"
+
+static std::atomic<bool> stop_requested(false);
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: ac_ingest serve <address> [options]\n"
+          "       ac_ingest load <address> [options]\n"
+          "\n"
+          "  address is unix:/path or tcp:host:port\n"
+          "\n"
+          "serve:\n"
+          "  --latency us      delay before each ack\n"
+          "  --jitter us       random extra delay, 0 to n\n"
+          "  --failure r       fraction of reports acked as failed\n"
+          "  --disconnect r    fraction of reports answered by disconnecting\n"
+          "  --duration s      stop after s seconds (default until SIGINT)\n"
+          "  --dictionary path unpack packed reports against the dictionary\n"
+          "  --heartbeat ms    interval heartbeats are expected at (default\n"
+          "                    10000)\n"
+          "\n"
+          "load:\n"
+          "  --clients n       simulated modules (default 100)\n"
+          "  --messages n      reports per client (default 1000)\n"
+          "  --rate n          reports per second per client (default as\n"
+          "                    fast as they are acked)\n"
+          "  --window n        unacked reports per client (default 1)\n"
+          "  --dictionary path send reports packed against the dictionary\n"
+          "  --heartbeat ms    send heartbeats every ms (default none)\n"
+          "  --heartbeat-drop r fraction of heartbeats skipped\n");
+}
+
+static void handle_signal(int signal) { stop_requested = true; }
+
+/* the dictionary points into data, which has to be kept alive with it */
+static bool load_dictionary(const std::string &path,
+                            std::vector<uint8_t> &data,
+                            REPORT_DICTIONARY &dictionary) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  size_t read = fread(data.data(), 1, data.size(), file);
+  fclose(file);
+
+  if (read != data.size() ||
+      !NT_SUCCESS(
+          ReportDictionaryLoad(&dictionary, data.data(), data.size()))) {
+    fprintf(stderr, "%s is not a report dictionary\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+static double percentile(const std::vector<uint64_t> &sorted, double rank) {
+  if (sorted.empty())
+    return 0.0;
+  size_t index = static_cast<size_t>(rank * (sorted.size() - 1));
+  return static_cast<double>(sorted[index]) / 1000.0;
+}
+
+static void print_latency(std::vector<uint64_t> &latencies) {
+  std::sort(latencies.begin(), latencies.end());
+  printf("latency us    p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+         percentile(latencies, 0.50), percentile(latencies, 0.99),
+         percentile(latencies, 0.999), percentile(latencies, 1.0));
+}
+
+static void print_stats(ingest::server_stats &stats) {
+  printf("elapsed       %.3f s\n", stats.elapsed);
+  printf("connections   %llu (peak %llu, %zu distinct steam ids)\n",
+         (unsigned long long)stats.connections,
+         (unsigned long long)stats.peak_connections, stats.clients.size());
+  printf("messages      %llu (%.0f/s, %.2f MB/s)\n",
+         (unsigned long long)stats.messages,
+         stats.elapsed ? stats.messages / stats.elapsed : 0.0,
+         stats.elapsed ? stats.bytes / stats.elapsed / (1 << 20) : 0.0);
+  if (stats.packed)
+    printf("packed        %llu (%llu of %llu bytes, ratio %.2f)\n",
+           (unsigned long long)stats.packed, (unsigned long long)stats.bytes,
+           (unsigned long long)stats.report_bytes,
+           (double)stats.report_bytes / stats.bytes);
+  printf("acked         %llu (%llu failed)\n", (unsigned long long)stats.acked,
+         (unsigned long long)stats.failed);
+  printf("disconnected  %llu\n", (unsigned long long)stats.disconnected);
+  printf("invalid       %llu\n", (unsigned long long)stats.invalid);
+  if (stats.heartbeats)
+    printf("heartbeats    %llu (%llu missed, %llu forged, %llu replayed, "
+           "%llu late, %llu skewed)\n",
+           (unsigned long long)stats.heartbeats,
+           (unsigned long long)stats.heartbeats_missed,
+           (unsigned long long)stats.heartbeats_forged,
+           (unsigned long long)stats.heartbeats_replayed,
+           (unsigned long long)stats.heartbeats_late,
+           (unsigned long long)stats.heartbeats_skewed);
+  print_latency(stats.latencies);
+
+  for (auto &[code, count] : stats.codes)
+    printf("  code %-4u   %llu\n", code, (unsigned long long)count);
+}
+
+static void print_stats(ingest::load_stats &stats) {
+  printf("elapsed       %.3f s\n", stats.elapsed);
+  printf("clients       %llu\n", (unsigned long long)stats.connected);
+  printf("sent          %llu (%.0f/s)\n", (unsigned long long)stats.sent,
+         stats.elapsed ? stats.sent / stats.elapsed : 0.0);
+  printf("acked         %llu (%llu failed)\n", (unsigned long long)stats.acked,
+         (unsigned long long)stats.failed);
+  printf("disconnected  %llu\n", (unsigned long long)stats.disconnected);
+  if (stats.heartbeats || stats.heartbeats_dropped)
+    printf("heartbeats    %llu (%llu dropped)\n",
+           (unsigned long long)stats.heartbeats,
+           (unsigned long long)stats.heartbeats_dropped);
+  print_latency(stats.latencies);
+}
+
+/*
+ * A local stand in for the report ingestion server and a load generator to
+ * drive it, for testing the uplink at scale without the real server.
+ */
+int main(int argc, char **argv) {
+  ingest::server_config server_config;
+  ingest::load_config load_config;
+  ingest::address where = {};
+  std::string dictionary_path;
+  std::vector<uint8_t> dictionary_data;
+  REPORT_DICTIONARY dictionary = {};
+
+  if (argc < 3 || !ingest::parse_address(argv[2], where)) {
+    print_usage();
+    return 1;
+  }
+
+  std::string mode = argv[1];
+
+  for (int index = 3; index < argc; index += 2) {
+    const char *arg = argv[index];
+    const char *value = index + 1 < argc ? argv[index + 1] : nullptr;
+
+    if (!value) {
+      print_usage();
+      return 1;
+    }
+
+    if (!strcmp(arg, "--latency"))
+      server_config.latency_us = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--jitter"))
+      server_config.jitter_us = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--failure"))
+      server_config.failure_ratio = strtod(value, nullptr);
+    else if (!strcmp(arg, "--disconnect"))
+      server_config.disconnect_ratio = strtod(value, nullptr);
+    else if (!strcmp(arg, "--duration"))
+      server_config.duration = strtod(value, nullptr);
+    else if (!strcmp(arg, "--clients"))
+      load_config.clients = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--messages"))
+      load_config.messages = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--rate"))
+      load_config.rate = strtod(value, nullptr);
+    else if (!strcmp(arg, "--window"))
+      load_config.window = std::max<uint32_t>(1, strtoul(value, nullptr, 10));
+    else if (!strcmp(arg, "--dictionary"))
+      dictionary_path = value;
+    else if (!strcmp(arg, "--heartbeat")) {
+      server_config.heartbeat_interval = strtoul(value, nullptr, 10);
+      load_config.heartbeat_interval = server_config.heartbeat_interval;
+    } else if (!strcmp(arg, "--heartbeat-drop"))
+      load_config.heartbeat_drop = strtod(value, nullptr);
+    else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if (!dictionary_path.empty()) {
+    if (!load_dictionary(dictionary_path, dictionary_data, dictionary))
+      return 1;
+    server_config.dictionary = &dictionary;
+    load_config.pack = true;
+    load_config.dictionary = &dictionary;
+  }
+
+  ingest::raise_file_limit();
+  signal(SIGPIPE, SIG_IGN);
+
+  if (mode == "serve") {
+    ingest::server server(server_config);
+    if (!server.open(where))
+      return 1;
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    ingest::server_stats stats = server.run(stop_requested);
+    print_stats(stats);
+    return 0;
+  }
+
+  if (mode == "load") {
+    ingest::load load(load_config);
+    if (!load.connect(where))
+      return 1;
+    ingest::load_stats stats = load.run();
+    print_stats(stats);
+    return stats.acked == stats.sent && !stats.disconnected ? 0 : 2;
+  }
+
+  print_usage();
+  return 1;
+}
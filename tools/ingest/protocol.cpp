@@ -0,0 +1,84 @@
+#include "protocol.h"
+
+#include <cstring>
+
+#include "../../core/report.h"
+
+void ingest::frame_reader::append(const uint8_t *bytes, size_t length) {
+  /* compact once everything before offset has been consumed */
+  if (this->offset && this->offset == this->data.size()) {
+    this->data.clear();
+    this->offset = 0;
+  } else if (this->offset > this->data.size() / 2) {
+    this->data.erase(this->data.begin(), this->data.begin() + this->offset);
+    this->offset = 0;
+  }
+  this->data.insert(this->data.end(), bytes, bytes + length);
+}
+
+ingest::frame_reader::result ingest::frame_reader::next(frame &out) {
+  size_t available = this->data.size() - this->offset;
+  const uint8_t *start = this->data.data() + this->offset;
+  uint32_t code = 0;
+
+  if (available < sizeof(message_packet_header) + sizeof(code))
+    return result::incomplete;
+
+  memcpy(&out.header, start, sizeof(out.header));
+  memcpy(&code, start + sizeof(out.header), sizeof(code));
+
+  if (out.header.message_type == MESSAGE_TYPE_CLIENT_PACKED_REPORT)
+    return this->next_packed(out, start, available);
+
+  if (out.header.message_type == MESSAGE_TYPE_CLIENT_HEARTBEAT)
+    out.size = sizeof(HEARTBEAT_PACKET);
+  else if (out.header.message_type == MESSAGE_TYPE_CLIENT_REPORT)
+    out.size = ReportGetExpectedSize(code);
+  else
+    return result::invalid;
+
+  if (!out.size || out.size > MAXIMUM_REPORT_SIZE)
+    return result::invalid;
+
+  if (available < sizeof(out.header) + out.size)
+    return result::incomplete;
+
+  out.report = start + sizeof(out.header);
+  out.wire_size = sizeof(out.header) + out.size;
+  this->offset += out.wire_size;
+  return result::complete;
+}
+
+ingest::frame_reader::result
+ingest::frame_reader::next_packed(frame &out, const uint8_t *start,
+                                  size_t available) {
+  SIZE_T consumed = 0;
+  UINT32 size = 0;
+  NTSTATUS status = ReportUnpackMessage(
+      this->dictionary, (PVOID)(start + sizeof(out.header)),
+      available - sizeof(out.header), this->unpacked, sizeof(this->unpacked),
+      &size, &consumed);
+
+  if (status == STATUS_BUFFER_TOO_SMALL)
+    return result::incomplete;
+
+  /* same rule as unpacked reports, the size follows from the code */
+  if (!NT_SUCCESS(status) ||
+      size != ReportGetExpectedSize(ReportGetCode(this->unpacked)))
+    return result::invalid;
+
+  out.report = this->unpacked;
+  out.size = size;
+  out.wire_size = static_cast<uint32_t>(sizeof(out.header) + consumed);
+  this->offset += out.wire_size;
+  return result::complete;
+}
+
+void ingest::encode_frame(std::vector<uint8_t> &out,
+                          const message_packet_header &header,
+                          const void *report, uint32_t size) {
+  const uint8_t *raw = reinterpret_cast<const uint8_t *>(&header);
+  out.insert(out.end(), raw, raw + sizeof(header));
+  raw = static_cast<const uint8_t *>(report);
+  out.insert(out.end(), raw, raw + size);
+}
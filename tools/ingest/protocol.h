@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../../core/heartbeat.h"
+#include "../../core/message.h"
+#include "../../core/reportpack.h"
+
+namespace ingest {
+
+/* larger than any report in core/report.h */
+static constexpr uint32_t MAXIMUM_REPORT_SIZE = 0x1000;
+
+/* same layout as client::message_queue and the server's PACKET_HEADER */
+struct message_packet_header {
+  int message_type;
+  int request_id;
+  uint64_t steam64_id;
+};
+
+/* the server's CLIENT_REPORT_PACKET_RESPONSE */
+struct client_report_packet_response {
+  int success;
+};
+
+/*
+ * The root key heartbeat keys are derived from, the same test key the
+ * simulated device and debug drivers use. The steam id stands in for the
+ * session cookie.
+ */
+static constexpr uint8_t HEARTBEAT_TEST_ROOT_KEY[HEARTBEAT_ROOT_KEY_LENGTH] = {
+    HEARTBEAT_TEST_ROOT_KEY_BYTES};
+
+static_assert(sizeof(message_packet_header) == 16);
+static_assert(sizeof(client_report_packet_response) == 4);
+
+struct frame {
+  message_packet_header header;
+  const uint8_t *report;
+  uint32_t size;
+  /* bytes the message took on the wire, header included */
+  uint32_t wire_size;
+};
+
+/*
+ * Splits a byte stream into messages. The wire format has no length field,
+ * a message is a packet header followed by a single report whose size is
+ * implied by its report code, exactly what the module batches into its send
+ * buffer. Packed reports carry their length in the pack header and are
+ * unpacked against the dictionary the reader was given, if any. A heartbeat
+ * is a fixed size HEARTBEAT_PACKET in place of the report. Anything that
+ * doesnt parse leaves the stream unrecoverable.
+ */
+class frame_reader {
+public:
+  enum class result { complete, incomplete, invalid };
+
+private:
+  std::vector<uint8_t> data;
+  size_t offset = 0;
+  REPORT_DICTIONARY *dictionary = nullptr;
+  uint8_t unpacked[MAXIMUM_REPORT_SIZE];
+
+  result next_packed(frame &out, const uint8_t *start, size_t available);
+
+public:
+  frame_reader(REPORT_DICTIONARY *dictionary = nullptr)
+      : dictionary(dictionary) {}
+
+  void append(const uint8_t *bytes, size_t length);
+  /* the frame points into the reader and is valid until the next call */
+  result next(frame &out);
+};
+
+/* header followed by the report, ready to be written to a socket */
+void encode_frame(std::vector<uint8_t> &out,
+                  const message_packet_header &header, const void *report,
+                  uint32_t size);
+
+} // namespace ingest
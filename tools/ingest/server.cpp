@@ -0,0 +1,315 @@
+#include "server.h"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "../../core/report.h"
+
+static constexpr int MAXIMUM_EVENTS = 256;
+/* upper bound on how long stop can go unnoticed */
+static constexpr int POLL_TIMEOUT_MS = 100;
+static constexpr size_t READ_SIZE = 0x4000;
+/* epoll ids, connections count up from 1 */
+static constexpr uint64_t LISTENER_ID = 0;
+static constexpr uint64_t TIMER_ID = ~0ull;
+
+ingest::server::server(const server_config &config)
+    : config(config), started(clock::now()), rng(config.seed) {}
+
+ingest::server::~server() {
+  for (auto &[id, entry] : this->connections)
+    close(entry.fd);
+  if (this->listener >= 0)
+    close(this->listener);
+  if (this->timer >= 0)
+    close(this->timer);
+  if (this->poll >= 0)
+    close(this->poll);
+}
+
+bool ingest::server::open(const address &where) {
+  epoll_event event = {};
+
+  this->listener = listen_socket(where);
+  if (this->listener < 0)
+    return false;
+
+  this->poll = epoll_create1(EPOLL_CLOEXEC);
+  if (this->poll < 0) {
+    fprintf(stderr, "epoll_create1 failed: %s\n", strerror(errno));
+    return false;
+  }
+
+  this->timer = create_timer();
+  if (this->timer < 0)
+    return false;
+
+  event.events = EPOLLIN;
+  event.data.u64 = LISTENER_ID;
+  if (epoll_ctl(this->poll, EPOLL_CTL_ADD, this->listener, &event))
+    return false;
+
+  event.data.u64 = TIMER_ID;
+  return epoll_ctl(this->poll, EPOLL_CTL_ADD, this->timer, &event) == 0;
+}
+
+void ingest::server::accept_clients() {
+  while (true) {
+    int fd = accept4(this->listener, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        fprintf(stderr, "accept failed: %s\n", strerror(errno));
+      return;
+    }
+
+    uint64_t id = this->next_id++;
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u64 = id;
+
+    if (epoll_ctl(this->poll, EPOLL_CTL_ADD, fd, &event)) {
+      fprintf(stderr, "epoll_ctl failed: %s\n", strerror(errno));
+      close(fd);
+      continue;
+    }
+
+    connection &client = this->connections[id];
+    client.fd = fd;
+    client.reader = frame_reader(this->config.dictionary);
+    this->stats.connections++;
+    this->stats.peak_connections =
+        std::max<uint64_t>(this->stats.peak_connections,
+                           this->connections.size());
+  }
+}
+
+/* acks still pending for a closed connection are dropped when they come due */
+void ingest::server::close_connection(uint64_t id) {
+  auto entry = this->connections.find(id);
+  if (entry == this->connections.end())
+    return;
+  close(entry->second.fd);
+  this->connections.erase(entry);
+}
+
+/* the driver's clock is only ever compared against the server's by deltas */
+void ingest::server::handle_heartbeat(const frame &message,
+                                      clock::time_point now) {
+  HEARTBEAT_PACKET packet = {};
+  uint64_t id = message.header.steam64_id;
+  uint64_t received = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          now - this->started)
+                          .count();
+
+  auto [entry, inserted] = this->heartbeats.try_emplace(id);
+  HEARTBEAT_TRACKER &tracker = entry->second;
+  if (inserted)
+    HeartbeatTrackerInitialise(&tracker, this->config.heartbeat_interval);
+  uint64_t missed = tracker.missed;
+
+  UCHAR key[HEARTBEAT_KEY_LENGTH] = {};
+  HeartbeatDeriveKey((PVOID)HEARTBEAT_TEST_ROOT_KEY,
+                     sizeof(HEARTBEAT_TEST_ROOT_KEY), static_cast<UINT32>(id),
+                     key);
+
+  memcpy(&packet, message.report, sizeof(packet));
+  UINT32 verdict = HeartbeatTrack(&tracker, &packet, key, sizeof(key),
+                                  static_cast<UINT32>(id), received);
+
+  this->stats.heartbeats++;
+  this->stats.heartbeats_forged += !!(verdict & HEARTBEAT_VERDICT_FORGED);
+  this->stats.heartbeats_replayed += !!(verdict & HEARTBEAT_VERDICT_REPLAYED);
+  this->stats.heartbeats_late += !!(verdict & HEARTBEAT_VERDICT_LATE);
+  this->stats.heartbeats_skewed += !!(verdict & HEARTBEAT_VERDICT_SKEWED);
+  this->stats.heartbeats_missed += tracker.missed - missed;
+}
+
+void ingest::server::handle_frame(uint64_t id, const frame &message) {
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  clock::time_point now = clock::now();
+  uint32_t delay = this->config.latency_us;
+  pending_ack ack = {};
+
+  if (message.header.message_type == MESSAGE_TYPE_CLIENT_HEARTBEAT) {
+    this->stats.bytes += message.wire_size;
+    this->handle_heartbeat(message, now);
+    return;
+  }
+
+  if (this->config.jitter_us)
+    delay += this->rng() % this->config.jitter_us;
+
+  this->stats.messages++;
+  this->stats.bytes += message.wire_size;
+  this->stats.report_bytes += sizeof(message.header) + message.size;
+  if (message.header.message_type == MESSAGE_TYPE_CLIENT_PACKED_REPORT)
+    this->stats.packed++;
+  this->stats.codes[ReportGetCode((PVOID)message.report)]++;
+  this->stats.clients[message.header.steam64_id]++;
+
+  ack.received = now;
+  ack.due = now + std::chrono::microseconds(delay);
+  ack.connection_id = id;
+  ack.success = chance(this->rng) >= this->config.failure_ratio;
+
+  /* a negative success marks the connection to be dropped instead */
+  if (chance(this->rng) < this->config.disconnect_ratio)
+    ack.success = -1;
+
+  this->acks.push(ack);
+}
+
+void ingest::server::read_connection(uint64_t id) {
+  uint8_t buffer[READ_SIZE];
+
+  while (true) {
+    auto entry = this->connections.find(id);
+    if (entry == this->connections.end())
+      return;
+
+    ssize_t length = read(entry->second.fd, buffer, sizeof(buffer));
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (length <= 0) {
+      this->close_connection(id);
+      return;
+    }
+
+    entry->second.reader.append(buffer, length);
+
+    frame message = {};
+    frame_reader::result result;
+    while ((result = entry->second.reader.next(message)) ==
+           frame_reader::result::complete)
+      this->handle_frame(id, message);
+
+    if (result == frame_reader::result::invalid) {
+      this->stats.invalid++;
+      this->close_connection(id);
+      return;
+    }
+  }
+}
+
+void ingest::server::write_connection(uint64_t id) {
+  auto entry = this->connections.find(id);
+  if (entry == this->connections.end())
+    return;
+
+  connection &client = entry->second;
+  while (client.output_offset < client.output.size()) {
+    ssize_t length =
+        write(client.fd, client.output.data() + client.output_offset,
+              client.output.size() - client.output_offset);
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (length <= 0) {
+      this->close_connection(id);
+      return;
+    }
+    client.output_offset += length;
+  }
+
+  epoll_event event = {};
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.u64 = id;
+
+  if (client.output_offset == client.output.size()) {
+    client.output.clear();
+    client.output_offset = 0;
+  } else {
+    /* the client isnt reading its acks, wait for room */
+    event.events |= EPOLLOUT;
+  }
+
+  epoll_ctl(this->poll, EPOLL_CTL_MOD, client.fd, &event);
+}
+
+void ingest::server::send_due_acks(clock::time_point now) {
+  std::vector<uint64_t> touched;
+
+  while (!this->acks.empty() && this->acks.top().due <= now) {
+    pending_ack ack = this->acks.top();
+    this->acks.pop();
+
+    auto entry = this->connections.find(ack.connection_id);
+    if (entry == this->connections.end())
+      continue;
+
+    if (ack.success < 0) {
+      this->stats.disconnected++;
+      this->close_connection(ack.connection_id);
+      continue;
+    }
+
+    client_report_packet_response response = {ack.success};
+    const uint8_t *raw = reinterpret_cast<const uint8_t *>(&response);
+    std::vector<uint8_t> &output = entry->second.output;
+    if (output.empty())
+      touched.push_back(ack.connection_id);
+    output.insert(output.end(), raw, raw + sizeof(response));
+
+    this->stats.acked++;
+    this->stats.failed += !ack.success;
+    this->stats.latencies.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - ack.received)
+            .count());
+  }
+
+  for (uint64_t id : touched)
+    this->write_connection(id);
+}
+
+ingest::server_stats ingest::server::run(const std::atomic<bool> &stop) {
+  epoll_event events[MAXIMUM_EVENTS];
+  clock::time_point start = clock::now();
+  clock::time_point end =
+      start + std::chrono::duration_cast<clock::duration>(
+                  std::chrono::duration<double>(this->config.duration));
+
+  while (!stop) {
+    clock::time_point now = clock::now();
+
+    if (this->config.duration > 0 && now >= end)
+      break;
+
+    if (!this->acks.empty())
+      arm_timer(this->timer,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    this->acks.top().due - now));
+
+    int count =
+        epoll_wait(this->poll, events, MAXIMUM_EVENTS, POLL_TIMEOUT_MS);
+    if (count < 0 && errno != EINTR) {
+      fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+      break;
+    }
+
+    for (int index = 0; index < count; index++) {
+      uint64_t id = events[index].data.u64;
+      if (id == LISTENER_ID) {
+        this->accept_clients();
+        continue;
+      }
+      if (id == TIMER_ID) {
+        clear_timer(this->timer);
+        continue;
+      }
+      if (events[index].events & EPOLLOUT)
+        this->write_connection(id);
+      if (events[index].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        this->read_connection(id);
+    }
+
+    this->send_due_acks(clock::now());
+  }
+
+  this->stats.elapsed =
+      std::chrono::duration<double>(clock::now() - start).count();
+  return this->stats;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "protocol.h"
+#include "socket.h"
+
+namespace ingest {
+
+using clock = std::chrono::steady_clock;
+
+struct server_config {
+  /* delay before each ack, on top of the time to read the message */
+  uint32_t latency_us = 0;
+  uint32_t jitter_us = 0;
+  /* fraction of reports acked with success = 0 */
+  double failure_ratio = 0.0;
+  /* fraction of reports answered by closing the connection */
+  double disconnect_ratio = 0.0;
+  /* seconds to run for, 0 until stopped */
+  double duration = 0.0;
+  uint64_t seed = 0x696e67657374;
+  /* what packed reports are unpacked against, nullptr for zeroes */
+  REPORT_DICTIONARY *dictionary = nullptr;
+  /* milliseconds clients are expected to send heartbeats every */
+  uint32_t heartbeat_interval = HEARTBEAT_INTERVAL_MS;
+};
+
+struct server_stats {
+  uint64_t connections = 0;
+  uint64_t peak_connections = 0;
+  uint64_t messages = 0;
+  uint64_t bytes = 0;
+  uint64_t packed = 0;
+  /* bytes the messages would have taken unpacked */
+  uint64_t report_bytes = 0;
+  uint64_t acked = 0;
+  uint64_t failed = 0;
+  uint64_t disconnected = 0;
+  uint64_t invalid = 0;
+  /* totals over every client's HEARTBEAT_TRACKER */
+  uint64_t heartbeats = 0;
+  uint64_t heartbeats_missed = 0;
+  uint64_t heartbeats_forged = 0;
+  uint64_t heartbeats_replayed = 0;
+  uint64_t heartbeats_late = 0;
+  uint64_t heartbeats_skewed = 0;
+  double elapsed = 0.0;
+  /* message fully read to ack written, in nanoseconds */
+  std::vector<uint64_t> latencies;
+  std::map<uint32_t, uint64_t> codes;
+  std::map<uint64_t, uint64_t> clients;
+};
+
+/*
+ * Stand in for the report ingestion server. Accepts any number of clients on
+ * one epoll loop, parses their reports and answers each one with a
+ * client_report_packet_response once the configured latency has passed.
+ * Heartbeats are checked against a tracker per steam id, which outlives the
+ * connection so a client reconnecting keeps its stream.
+ */
+class server {
+  struct connection {
+    int fd;
+    frame_reader reader;
+    std::vector<uint8_t> output;
+    size_t output_offset = 0;
+  };
+
+  struct pending_ack {
+    clock::time_point due;
+    clock::time_point received;
+    uint64_t connection_id;
+    int success;
+
+    bool operator>(const pending_ack &other) const {
+      return this->due > other.due;
+    }
+  };
+
+  server_config config;
+  int listener = -1;
+  int poll = -1;
+  int timer = -1;
+  uint64_t next_id = 1;
+  std::unordered_map<uint64_t, connection> connections;
+  std::priority_queue<pending_ack, std::vector<pending_ack>,
+                      std::greater<pending_ack>>
+      acks;
+  std::unordered_map<uint64_t, HEARTBEAT_TRACKER> heartbeats;
+  clock::time_point started;
+  std::mt19937_64 rng;
+  server_stats stats;
+
+  void accept_clients();
+  void close_connection(uint64_t id);
+  void read_connection(uint64_t id);
+  void write_connection(uint64_t id);
+  void handle_frame(uint64_t id, const frame &message);
+  void handle_heartbeat(const frame &message, clock::time_point now);
+  void send_due_acks(clock::time_point now);
+
+public:
+  server(const server_config &config);
+  ~server();
+
+  bool open(const address &where);
+  /* runs until stop is set or the configured duration has passed */
+  server_stats run(const std::atomic<bool> &stop);
+};
+
+} // namespace ingest
@@ -0,0 +1,148 @@
+#include "socket.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+static bool set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int open_socket(const ingest::address &where) {
+  int fd = socket(where.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "socket failed: %s\n", strerror(errno));
+    return -1;
+  }
+  if (!where.is_unix) {
+    /* acks are tiny, dont let nagle hold them back */
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  }
+  return fd;
+}
+
+bool ingest::parse_address(const std::string &text, address &out) {
+  memset(&out.storage, 0, sizeof(out.storage));
+
+  if (text.rfind("unix:", 0) == 0) {
+    sockaddr_un *local = reinterpret_cast<sockaddr_un *>(&out.storage);
+    out.is_unix = true;
+    out.path = text.substr(5);
+    if (out.path.empty() || out.path.size() >= sizeof(local->sun_path))
+      return false;
+    local->sun_family = AF_UNIX;
+    memcpy(local->sun_path, out.path.c_str(), out.path.size() + 1);
+    out.length = sizeof(sockaddr_un);
+    return true;
+  }
+
+  std::string host = text.rfind("tcp:", 0) == 0 ? text.substr(4) : text;
+  size_t separator = host.rfind(':');
+  if (separator == std::string::npos)
+    return false;
+
+  std::string port = host.substr(separator + 1);
+  host = host.substr(0, separator);
+
+  addrinfo hints = {};
+  addrinfo *result = nullptr;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints,
+                  &result) ||
+      !result)
+    return false;
+
+  memcpy(&out.storage, result->ai_addr, result->ai_addrlen);
+  out.length = result->ai_addrlen;
+  out.is_unix = false;
+  freeaddrinfo(result);
+  return true;
+}
+
+int ingest::listen_socket(const address &where) {
+  int fd = open_socket(where);
+  int enable = 1;
+
+  if (fd < 0)
+    return -1;
+
+  if (where.is_unix)
+    unlink(where.path.c_str());
+  else
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  if (bind(fd, reinterpret_cast<const sockaddr *>(&where.storage),
+           where.length) ||
+      listen(fd, SOMAXCONN) || !set_nonblocking(fd)) {
+    fprintf(stderr, "failed to listen: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int ingest::connect_socket(const address &where) {
+  int fd = open_socket(where);
+
+  if (fd < 0)
+    return -1;
+
+  /*
+   * Connect while still blocking, a non blocking unix socket connect fails
+   * outright rather than waiting when the listen backlog is full.
+   */
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&where.storage),
+              where.length) ||
+      !set_nonblocking(fd)) {
+    fprintf(stderr, "failed to connect: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int ingest::create_timer() {
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timer < 0)
+    fprintf(stderr, "timerfd_create failed: %s\n", strerror(errno));
+  return timer;
+}
+
+void ingest::arm_timer(int timer, std::chrono::nanoseconds delay) {
+  itimerspec spec = {};
+  /* a zero value disarms the timer, so fire as soon as possible instead */
+  int64_t nanoseconds = std::max<int64_t>(1, delay.count());
+  spec.it_value.tv_sec = nanoseconds / 1000000000;
+  spec.it_value.tv_nsec = nanoseconds % 1000000000;
+  timerfd_settime(timer, 0, &spec, nullptr);
+}
+
+void ingest::clear_timer(int timer) {
+  uint64_t expirations = 0;
+  while (read(timer, &expirations, sizeof(expirations)) > 0)
+    ;
+}
+
+void ingest::raise_file_limit() {
+  rlimit limit = {};
+  if (getrlimit(RLIMIT_NOFILE, &limit))
+    return;
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <string>
+
+namespace ingest {
+
+/*
+ * "unix:/path/to/socket" or "tcp:host:port", a bare "host:port" is tcp.
+ */
+struct address {
+  sockaddr_storage storage;
+  socklen_t length;
+  bool is_unix;
+  std::string path;
+};
+
+bool parse_address(const std::string &text, address &out);
+
+/* both return a non blocking socket, or -1 with the error printed */
+int listen_socket(const address &where);
+int connect_socket(const address &where);
+
+/*
+ * epoll_wait only takes milliseconds, a timerfd in the same epoll set wakes
+ * the loop for sub millisecond deadlines such as injected ack latency.
+ */
+int create_timer();
+void arm_timer(int timer, std::chrono::nanoseconds delay);
+void clear_timer(int timer);
+
+/* lets a single process hold thousands of connections */
+void raise_file_limit();
+
+} // namespace ingest
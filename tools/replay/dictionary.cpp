@@ -0,0 +1,109 @@
+#include "dictionary.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "../../core/report.h"
+
+namespace {
+
+struct reference_trainer {
+  std::vector<uint8_t> reference;
+  std::vector<uint16_t> counts;
+  uint64_t samples = 0;
+};
+
+} // namespace
+
+int replay::train_dictionary(const stream &input, const std::string &path) {
+  std::map<uint32_t, reference_trainer> trainers;
+  std::vector<uint8_t> report(RECORDING_MAX_REPORT_SIZE);
+
+  for (const recorded_report &recorded : input.reports()) {
+    if (!NT_SUCCESS(RecordingExpandReport((PRECORDING_BLOCK)&recorded.block,
+                                          (PVOID)recorded.payload,
+                                          report.data(), report.size())) ||
+        !ReportIsValid(report.data(), recorded.block.size))
+      continue;
+
+    uint32_t code = ReportGetCode(report.data());
+    uint32_t size = ReportGetExpectedSize(code);
+    if (size > REPORT_DICTIONARY_MAX_SIZE ||
+        (trainers.size() >= REPORT_DICTIONARY_MAX_ENTRIES &&
+         !trainers.count(code)))
+      continue;
+
+    reference_trainer &trainer = trainers[code];
+    trainer.reference.resize(size);
+    trainer.counts.resize(size);
+    ReportDictionaryTrain(trainer.reference.data(), trainer.counts.data(),
+                          report.data(), size);
+    trainer.samples++;
+  }
+
+  /* the map is ordered by report code, which is the order the format needs */
+  std::vector<uint8_t> data(sizeof(REPORT_DICTIONARY_HEADER));
+  for (auto &[code, trainer] : trainers) {
+    REPORT_DICTIONARY_RECORD record = {};
+    record.report_code = code;
+    record.size = static_cast<UINT32>(trainer.reference.size());
+
+    const uint8_t *raw = reinterpret_cast<const uint8_t *>(&record);
+    data.insert(data.end(), raw, raw + sizeof(record));
+    data.insert(data.end(), trainer.reference.begin(),
+                trainer.reference.end());
+
+    printf("  code %-4u   %llu samples\n", code,
+           (unsigned long long)trainer.samples);
+  }
+
+  REPORT_DICTIONARY_HEADER header = {};
+  header.magic = REPORT_DICTIONARY_MAGIC;
+  header.version = REPORT_DICTIONARY_VERSION;
+  header.count = static_cast<UINT16>(trainers.size());
+  header.id = ReportDictionaryHash(data.data() + sizeof(header),
+                                   data.size() - sizeof(header));
+  memcpy(data.data(), &header, sizeof(header));
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "failed to create %s\n", path.c_str());
+    return -1;
+  }
+
+  bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  if (fclose(file) || !written) {
+    fprintf(stderr, "failed to write %s\n", path.c_str());
+    return -1;
+  }
+
+  printf("dictionary %08x, %zu bytes\n", header.id, data.size());
+  return static_cast<int>(trainers.size());
+}
+
+bool replay::load_dictionary(const std::string &path,
+                             std::vector<uint8_t> &data,
+                             REPORT_DICTIONARY &dictionary) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  size_t read = fread(data.data(), 1, data.size(), file);
+  fclose(file);
+
+  if (read != data.size() ||
+      !NT_SUCCESS(
+          ReportDictionaryLoad(&dictionary, data.data(), data.size()))) {
+    fprintf(stderr, "%s is not a report dictionary\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stream.h"
+
+#include "../../core/reportpack.h"
+
+namespace replay {
+
+/*
+ * Trains a report dictionary for core/reportpack.h from every well formed
+ * report in the stream, one reference per report code. Returns the number of
+ * entries written, or -1 on io errors.
+ */
+int train_dictionary(const stream &input, const std::string &path);
+
+/* the dictionary points into data, which has to be kept alive with it */
+bool load_dictionary(const std::string &path, std::vector<uint8_t> &data,
+                     REPORT_DICTIONARY &dictionary);
+
+} // namespace replay
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "dictionary.h"
+#include "pipeline.h"
+#include "stream.h"
+
+#include "../../core/report.h"
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: ac_replay <recording> [options]\n"
+          "       ac_replay --generate <recording> [--reports n] [--rate n]\n"
+          "       ac_replay <recording> --train <dictionary>\n"
+          "\n"
+          "  --speed n         replay speed, 1 to 1000 (default 1)\n"
+          "  --loop n          number of passes over the recording\n"
+          "  --irp-slots n     pending irps (default %u)\n"
+          "  --deferred-max n  deferred reports before dropping (default %u)\n"
+          "  --consumers n     completion port threads (default 2)\n"
+          "  --uplink path     write uplinked batches to path\n"
+          "  --dictionary path pack uplinked reports against the dictionary\n",
+          replay::EVENT_COUNT, replay::MAX_DEFERRED_REPORTS_COUNT);
+}
+
+static double percentile(const std::vector<uint64_t> &sorted, double rank) {
+  if (sorted.empty())
+    return 0.0;
+  size_t index = static_cast<size_t>(rank * (sorted.size() - 1));
+  return static_cast<double>(sorted[index]) / 1000.0;
+}
+
+static void print_stats(replay::pipeline_stats &stats) {
+  std::sort(stats.latencies.begin(), stats.latencies.end());
+
+  printf("elapsed       %.3f s\n", stats.elapsed);
+  printf("offered       %llu\n", (unsigned long long)stats.offered);
+  printf("delivered     %llu (%.0f reports/s, %.2f MB/s)\n",
+         (unsigned long long)stats.delivered,
+         stats.delivered / stats.elapsed,
+         stats.uplink_bytes / stats.elapsed / (1 << 20));
+  printf("batches       %llu (%.1f reports per batch)\n",
+         (unsigned long long)stats.batches,
+         stats.batches ? (double)stats.delivered / stats.batches : 0.0);
+  printf("deferred      %llu (peak %u)\n", (unsigned long long)stats.deferred,
+         stats.peak_deferred);
+  printf("dropped       %llu\n", (unsigned long long)stats.dropped);
+  printf("malformed     %llu\n", (unsigned long long)stats.malformed);
+  printf("latency us    p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+         percentile(stats.latencies, 0.50), percentile(stats.latencies, 0.99),
+         percentile(stats.latencies, 0.999), percentile(stats.latencies, 1.0));
+
+  if (stats.report_bytes != stats.uplink_bytes)
+    printf("packed        %llu of %llu bytes (ratio %.2f)\n",
+           (unsigned long long)stats.uplink_bytes,
+           (unsigned long long)stats.report_bytes,
+           stats.uplink_bytes
+               ? (double)stats.report_bytes / stats.uplink_bytes
+               : 0.0);
+
+  for (auto &[code, count] : stats.codes)
+    printf("  code %-4u   %llu\n", code, (unsigned long long)count);
+}
+
+/*
+ * Host side load testing for the report pipeline, see pipeline.h. Recordings
+ * come from the module (set DONNA_AC_RECORDING) or from --generate.
+ */
+int main(int argc, char **argv) {
+  std::string input;
+  std::string output;
+  std::string uplink;
+  std::string train;
+  std::string dictionary_path;
+  std::vector<uint8_t> dictionary_data;
+  REPORT_DICTIONARY dictionary = {};
+  replay::pipeline_config config;
+  replay::generate_config generate;
+
+  for (int index = 1; index < argc; index++) {
+    const char *arg = argv[index];
+    const char *value = index + 1 < argc ? argv[index + 1] : nullptr;
+
+    if (arg[0] != '-') {
+      input = arg;
+      continue;
+    }
+
+    if (!value) {
+      print_usage();
+      return 1;
+    }
+
+    if (!strcmp(arg, "--generate"))
+      output = value;
+    else if (!strcmp(arg, "--reports"))
+      generate.report_count = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--rate"))
+      generate.rate = std::max<uint32_t>(1, strtoul(value, nullptr, 10));
+    else if (!strcmp(arg, "--speed"))
+      config.speed = strtod(value, nullptr);
+    else if (!strcmp(arg, "--loop"))
+      config.passes = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--irp-slots"))
+      config.irp_slots = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--deferred-max"))
+      config.deferred_max = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--consumers"))
+      config.consumers = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--uplink"))
+      uplink = value;
+    else if (!strcmp(arg, "--train"))
+      train = value;
+    else if (!strcmp(arg, "--dictionary"))
+      dictionary_path = value;
+    else {
+      print_usage();
+      return 1;
+    }
+
+    index++;
+  }
+
+  if (!output.empty())
+    return replay::generate(output, generate) ? 0 : 1;
+
+  if (input.empty() || config.speed < 1.0 || config.speed > 1000.0 ||
+      !config.irp_slots || !config.consumers) {
+    print_usage();
+    return 1;
+  }
+
+  replay::stream stream;
+  if (!stream.load(input))
+    return 1;
+
+  printf("loaded %zu reports from %u sessions spanning %.3f s%s\n",
+         stream.reports().size(), stream.sessions(),
+         stream.duration() / 1e9,
+         stream.is_truncated() ? ", last block truncated" : "");
+
+  if (!train.empty())
+    return replay::train_dictionary(stream, train) > 0 ? 0 : 1;
+
+  if (!dictionary_path.empty()) {
+    if (!replay::load_dictionary(dictionary_path, dictionary_data,
+                                 dictionary))
+      return 1;
+    config.pack = true;
+    config.dictionary = &dictionary;
+  }
+
+  if (!uplink.empty()) {
+    config.uplink = fopen(uplink.c_str(), "wb");
+    if (!config.uplink) {
+      fprintf(stderr, "failed to create %s\n", uplink.c_str());
+      return 1;
+    }
+  }
+
+  replay::pipeline pipeline(stream, config);
+  replay::pipeline_stats stats = pipeline.run();
+
+  if (config.uplink)
+    fclose(config.uplink);
+
+  print_stats(stats);
+  return 0;
+}
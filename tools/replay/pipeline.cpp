@@ -0,0 +1,216 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "../../core/report.h"
+
+replay::pipeline::pipeline(const stream &input, const pipeline_config &config)
+    : config(config), input(input) {
+  this->slots.resize(config.irp_slots);
+  for (uint32_t index = 0; index < config.irp_slots; index++)
+    this->free_slots.push_back(index);
+  this->batch.reserve(SEND_BUFFER_SIZE);
+}
+
+/* assumes lock is held */
+void replay::pipeline::complete_report(uint32_t index,
+                                       const pending_report &pending) {
+  slot &entry = this->slots[index];
+  const RECORDING_BLOCK &block = pending.report->block;
+
+  /* the driver only ever copies as much as fits in the irp buffer */
+  if (block.size > sizeof(entry.buffer)) {
+    RECORDING_BLOCK clamped = block;
+    clamped.size = sizeof(entry.buffer);
+    clamped.stored_size =
+        std::min<UINT16>(clamped.stored_size, sizeof(entry.buffer));
+    RecordingExpandReport(&clamped, (PVOID)pending.report->payload,
+                          entry.buffer, sizeof(entry.buffer));
+    entry.bytes = sizeof(entry.buffer);
+  } else {
+    RecordingExpandReport((PRECORDING_BLOCK)&block,
+                          (PVOID)pending.report->payload, entry.buffer,
+                          sizeof(entry.buffer));
+    entry.bytes = block.size;
+  }
+
+  entry.arrival = pending.arrival;
+  this->completed.push_back(index);
+  this->completed_event.notify_one();
+}
+
+void replay::pipeline::offer_report(const recorded_report &report,
+                                    clock::time_point arrival) {
+  std::lock_guard<std::mutex> lock(this->lock);
+  this->stats.offered++;
+
+  if (!this->free_slots.empty() && this->deferred.empty()) {
+    uint32_t index = this->free_slots.back();
+    this->free_slots.pop_back();
+    this->complete_report(index, {&report, arrival});
+    return;
+  }
+
+  if (this->deferred.size() >= this->config.deferred_max) {
+    this->stats.dropped++;
+    return;
+  }
+
+  this->deferred.push_back({&report, arrival});
+  this->stats.deferred++;
+  this->stats.peak_deferred = std::max<uint32_t>(
+      this->stats.peak_deferred, static_cast<uint32_t>(this->deferred.size()));
+}
+
+void replay::pipeline::release_slot(uint32_t index) {
+  std::lock_guard<std::mutex> lock(this->lock);
+
+  if (this->deferred.empty()) {
+    this->free_slots.push_back(index);
+  } else {
+    pending_report pending = this->deferred.front();
+    this->deferred.pop_front();
+    this->complete_report(index, pending);
+  }
+
+  /* wake everyone once the producer is done so idle consumers can exit */
+  if (this->finished)
+    this->completed_event.notify_all();
+}
+
+/* assumes batch_lock is held */
+void replay::pipeline::flush_batch() {
+  if (this->batch.empty())
+    return;
+
+  if (this->config.uplink)
+    fwrite(this->batch.data(), 1, this->batch.size(), this->config.uplink);
+
+  clock::time_point now = clock::now();
+  for (clock::time_point arrival : this->batch_arrivals)
+    this->stats.latencies.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - arrival)
+            .count());
+
+  this->stats.batches++;
+  this->stats.uplink_bytes += this->batch.size();
+  this->batch.clear();
+  this->batch_arrivals.clear();
+}
+
+void replay::pipeline::batch_report(const slot &entry) {
+  message_packet_header header = {};
+  uint8_t packed[REPORT_PACK_MESSAGE_BOUND(MAXIMUM_REPORT_BUFFER_SIZE)];
+  const uint8_t *report = entry.buffer;
+  size_t size = entry.bytes;
+
+  header.message_type = MESSAGE_TYPE_CLIENT_REPORT;
+  header.steam64_id = TEST_STEAM_64_ID;
+
+  if (this->config.pack) {
+    SIZE_T length =
+        ReportPackMessage(this->config.dictionary, (PVOID)entry.buffer,
+                          entry.bytes, packed, sizeof(packed));
+    if (length) {
+      header.message_type = MESSAGE_TYPE_CLIENT_PACKED_REPORT;
+      report = packed;
+      size = length;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(this->batch_lock);
+  if (this->batch.size() + sizeof(header) + size > SEND_BUFFER_SIZE)
+    this->flush_batch();
+
+  header.request_id = static_cast<int>(this->stats.delivered++);
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&header);
+  this->batch.insert(this->batch.end(), bytes, bytes + sizeof(header));
+  this->batch.insert(this->batch.end(), report, report + size);
+  this->stats.report_bytes += sizeof(header) + entry.bytes;
+  this->batch_arrivals.push_back(entry.arrival);
+  this->stats.codes[ReportGetCode((PVOID)entry.buffer)]++;
+}
+
+void replay::pipeline::run_producer(clock::time_point start) {
+  uint64_t pass_offset = 0;
+  /* keep passes apart by the average gap so loops dont start with a burst */
+  const std::vector<recorded_report> &reports = this->input.reports();
+  uint64_t pass_gap =
+      reports.empty() ? 0 : this->input.duration() / reports.size();
+
+  for (uint32_t pass = 0; pass < this->config.passes; pass++) {
+    for (const recorded_report &report : reports) {
+      clock::time_point arrival =
+          start + std::chrono::nanoseconds(static_cast<int64_t>(
+                      (pass_offset + report.time) / this->config.speed));
+      std::this_thread::sleep_until(arrival);
+      this->offer_report(report, arrival);
+    }
+    pass_offset += this->input.duration() + pass_gap;
+  }
+
+  std::lock_guard<std::mutex> lock(this->lock);
+  this->finished = true;
+  this->completed_event.notify_all();
+}
+
+void replay::pipeline::run_consumer() {
+  while (true) {
+    uint32_t index = 0;
+    {
+      std::unique_lock<std::mutex> lock(this->lock);
+      this->completed_event.wait(lock, [this] {
+        return !this->completed.empty() ||
+               (this->finished && this->deferred.empty());
+      });
+      if (this->completed.empty())
+        return;
+      index = this->completed.front();
+      this->completed.pop_front();
+    }
+
+    slot &entry = this->slots[index];
+    if (ReportIsValid(entry.buffer, entry.bytes))
+      this->batch_report(entry);
+    else {
+      std::lock_guard<std::mutex> lock(this->batch_lock);
+      this->stats.malformed++;
+    }
+
+    this->release_slot(index);
+
+    bool idle = false;
+    {
+      std::lock_guard<std::mutex> lock(this->lock);
+      idle = this->completed.empty();
+    }
+    if (idle) {
+      std::lock_guard<std::mutex> lock(this->batch_lock);
+      this->flush_batch();
+    }
+  }
+}
+
+replay::pipeline_stats replay::pipeline::run() {
+  std::vector<std::thread> consumers;
+  clock::time_point start = clock::now();
+
+  for (uint32_t index = 0; index < this->config.consumers; index++)
+    consumers.emplace_back(&pipeline::run_consumer, this);
+
+  this->run_producer(start);
+
+  for (std::thread &consumer : consumers)
+    consumer.join();
+
+  {
+    std::lock_guard<std::mutex> lock(this->batch_lock);
+    this->flush_batch();
+  }
+
+  this->stats.elapsed =
+      std::chrono::duration<double>(clock::now() - start).count();
+  return this->stats;
+}
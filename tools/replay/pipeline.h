@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "stream.h"
+
+#include "../../core/message.h"
+#include "../../core/reportpack.h"
+
+namespace replay {
+
+using clock = std::chrono::steady_clock;
+
+/* mirrors of the module and driver limits the pipeline is modelled on */
+static constexpr uint32_t EVENT_COUNT = 5;
+static constexpr uint32_t MAXIMUM_REPORT_BUFFER_SIZE = 1000;
+static constexpr uint32_t MAX_DEFERRED_REPORTS_COUNT = 100;
+static constexpr uint32_t SEND_BUFFER_SIZE = 8192;
+static constexpr uint64_t TEST_STEAM_64_ID = 123456789;
+
+struct message_packet_header {
+  int message_type;
+  int request_id;
+  uint64_t steam64_id;
+};
+
+struct pipeline_config {
+  /* 1 replays in real time, 1000 compresses a second into a millisecond */
+  double speed = 1.0;
+  uint32_t passes = 1;
+  uint32_t irp_slots = EVENT_COUNT;
+  uint32_t deferred_max = MAX_DEFERRED_REPORTS_COUNT;
+  uint32_t consumers = 2;
+  /* where batches are uplinked to, nullptr discards them */
+  FILE *uplink = nullptr;
+  /* packs every report against the dictionary before batching it */
+  bool pack = false;
+  REPORT_DICTIONARY *dictionary = nullptr;
+};
+
+struct pipeline_stats {
+  uint64_t offered = 0;
+  uint64_t delivered = 0;
+  uint64_t deferred = 0;
+  uint64_t dropped = 0;
+  uint64_t malformed = 0;
+  uint64_t batches = 0;
+  uint64_t uplink_bytes = 0;
+  /* what uplink_bytes would have been without packing */
+  uint64_t report_bytes = 0;
+  uint32_t peak_deferred = 0;
+  double elapsed = 0.0;
+  /* scheduled arrival to uplink, in nanoseconds */
+  std::vector<uint64_t> latencies;
+  std::map<uint32_t, uint64_t> codes;
+};
+
+/*
+ * Feeds a recorded stream through the same stages a report takes in
+ * production:
+ *
+ * - The producer plays the driver. Each report is completed into a free
+ *   pending IRP, deferred when none are free, or dropped once the deferred
+ *   queue is full.
+ *
+ * - Consumers play the module's completion port threads. They validate the
+ *   report, append it to the shared send buffer behind a message header and
+ *   release the IRP slot, which immediately completes the oldest deferred
+ *   report just like inserting a new IRP does in the driver.
+ *
+ * - The send buffer is uplinked once the next report wouldnt fit or the
+ *   consumers run out of work. With packing enabled each consumer packs its
+ *   report before taking the batch lock.
+ */
+class pipeline {
+  struct slot {
+    uint8_t buffer[MAXIMUM_REPORT_BUFFER_SIZE];
+    uint32_t bytes;
+    clock::time_point arrival;
+  };
+
+  struct pending_report {
+    const recorded_report *report;
+    clock::time_point arrival;
+  };
+
+  pipeline_config config;
+  const stream &input;
+
+  std::mutex lock;
+  std::condition_variable completed_event;
+  std::vector<slot> slots;
+  std::vector<uint32_t> free_slots;
+  std::deque<uint32_t> completed;
+  std::deque<pending_report> deferred;
+  bool finished = false;
+
+  std::mutex batch_lock;
+  std::vector<uint8_t> batch;
+  std::vector<clock::time_point> batch_arrivals;
+
+  pipeline_stats stats;
+
+  void complete_report(uint32_t index, const pending_report &pending);
+  void offer_report(const recorded_report &report, clock::time_point arrival);
+  void release_slot(uint32_t index);
+  void batch_report(const slot &entry);
+  void flush_batch();
+  void run_producer(clock::time_point start);
+  void run_consumer();
+
+public:
+  pipeline(const stream &input, const pipeline_config &config);
+
+  pipeline_stats run();
+};
+
+} // namespace replay
@@ -0,0 +1,152 @@
+#include "stream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <random>
+
+#include "../../core/report.h"
+
+static constexpr uint64_t NANOSECONDS_PER_SECOND = 1000000000ull;
+/* back to back reports within a burst, e.g. a scan flagging many objects */
+static constexpr uint64_t BURST_SPACING_NS = 10000;
+/* filetime of 2024-01-01, generated streams dont need a real wall clock */
+static constexpr uint64_t GENERATED_WALL_CLOCK = 0x01da3c47c5a48000;
+
+static constexpr uint32_t report_codes[] = {
+    REPORT_NMI_CALLBACK_FAILURE,     REPORT_MODULE_VALIDATION_FAILURE,
+    REPORT_ILLEGAL_HANDLE_OPERATION, REPORT_INVALID_PROCESS_ALLOCATION,
+    REPORT_HIDDEN_SYSTEM_THREAD,     REPORT_ILLEGAL_ATTACH_PROCESS,
+    REPORT_APC_STACKWALK,            REPORT_DPC_STACKWALK,
+    REPORT_DATA_TABLE_ROUTINE,       REPORT_INVALID_PROCESS_MODULE};
+
+bool replay::stream::load(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  this->data.resize(size > 0 ? size : 0);
+  size_t read = fread(this->data.data(), 1, this->data.size(), file);
+  fclose(file);
+
+  if (read != this->data.size()) {
+    fprintf(stderr, "failed to read %s\n", path.c_str());
+    return false;
+  }
+
+  uint64_t session_base = 0;
+  size_t offset = 0;
+
+  while (offset < this->data.size()) {
+    RECORDING_BLOCK block = {};
+    PVOID payload = nullptr;
+    SIZE_T consumed = 0;
+    NTSTATUS status =
+        RecordingReadBlock(this->data.data() + offset,
+                           this->data.size() - offset, &block, &payload,
+                           &consumed);
+
+    if (status == STATUS_BUFFER_TOO_SMALL) {
+      this->truncated = true;
+      break;
+    }
+
+    if (!NT_SUCCESS(status)) {
+      fprintf(stderr, "corrupt block at offset %zx\n", offset);
+      return false;
+    }
+
+    if (block.type == RECORDING_BLOCK_SESSION) {
+      session_base = this->duration();
+      this->session_count++;
+    } else if (this->session_count) {
+      this->recorded.push_back({session_base + block.timestamp, block,
+                                static_cast<const uint8_t *>(payload)});
+    }
+
+    offset += consumed;
+  }
+
+  if (!this->session_count) {
+    fprintf(stderr, "%s is not a recording\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+/*
+ * Reports are as the driver leaves them: the code, a few address sized
+ * fields and a short string, with the rest of the structure zeroed.
+ */
+static uint32_t make_report(std::mt19937_64 &rng, double malformed_ratio,
+                            std::vector<uint8_t> &report) {
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  uint32_t code = report_codes[rng() % std::size(report_codes)];
+  uint32_t size = ReportGetExpectedSize(code);
+  uint32_t used = std::min<uint32_t>(size, 24 + rng() % 64);
+
+  report.assign(size, 0);
+  for (uint32_t index = sizeof(code); index < used; index++)
+    report[index] = static_cast<uint8_t>(rng() % 255 + 1);
+
+  if (chance(rng) < malformed_ratio) {
+    if (rng() % 2)
+      code += 1;
+    else
+      size /= 2;
+  }
+
+  memcpy(report.data(), &code, sizeof(code));
+  return size;
+}
+
+bool replay::generate(const std::string &path, const generate_config &config) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "failed to create %s\n", path.c_str());
+    return false;
+  }
+
+  std::mt19937_64 rng(config.seed);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+  std::exponential_distribution<double> interval(config.rate);
+  std::vector<uint8_t> report;
+  uint8_t block[sizeof(RECORDING_BLOCK) + RECORDING_MAX_REPORT_SIZE];
+  uint64_t time = 0;
+  uint32_t burst = 0;
+  bool status = true;
+
+  SIZE_T length =
+      RecordingEncodeSession(block, sizeof(block), GENERATED_WALL_CLOCK);
+  status &= fwrite(block, 1, length, file) == length;
+
+  for (uint32_t index = 0; index < config.report_count && status; index++) {
+    if (burst) {
+      time += BURST_SPACING_NS;
+      burst--;
+    } else {
+      time += static_cast<uint64_t>(interval(rng) * NANOSECONDS_PER_SECOND);
+      if (chance(rng) < config.burst_ratio)
+        burst = config.burst_size;
+    }
+
+    uint32_t size = make_report(rng, config.malformed_ratio, report);
+    length = RecordingEncodeReport(block, sizeof(block), time, report.data(),
+                                   size);
+    status &= fwrite(block, 1, length, file) == length;
+  }
+
+  if (fclose(file) || !status) {
+    fprintf(stderr, "failed to write %s\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
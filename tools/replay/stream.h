@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../core/recording.h"
+
+namespace replay {
+
+struct recorded_report {
+  /* nanoseconds since the start of the first session in the stream */
+  uint64_t time;
+  RECORDING_BLOCK block;
+  const uint8_t *payload;
+};
+
+/*
+ * A recording loaded into memory. Sessions are laid end to end, each one
+ * starting where the previous one's last report was, so a file built from
+ * several module runs replays as one continuous stream.
+ */
+class stream {
+  std::vector<uint8_t> data;
+  std::vector<recorded_report> recorded;
+  uint32_t session_count = 0;
+  bool truncated = false;
+
+public:
+  bool load(const std::string &path);
+
+  const std::vector<recorded_report> &reports() const {
+    return this->recorded;
+  }
+  uint32_t sessions() const { return this->session_count; }
+  bool is_truncated() const { return this->truncated; }
+  uint64_t duration() const {
+    return this->recorded.empty() ? 0 : this->recorded.back().time;
+  }
+};
+
+struct generate_config {
+  uint32_t report_count = 100000;
+  /* average reports per second outside of bursts */
+  uint32_t rate = 2000;
+  /* chance of any report starting a burst, and the reports in one */
+  double burst_ratio = 0.002;
+  uint32_t burst_size = 64;
+  /* fraction of reports with a bad code or a short buffer */
+  double malformed_ratio = 0.005;
+  uint64_t seed = 0x7265706c6179;
+};
+
+/* writes a synthetic single session recording, returns false on io errors */
+bool generate(const std::string &path, const generate_config &config);
+
+} // namespace replay
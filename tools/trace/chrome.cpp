@@ -0,0 +1,82 @@
+#include "chrome.h"
+
+#include <cstdio>
+
+static const char *get_source_name(uint32_t source) {
+  return source == TRACE_SOURCE_DRIVER ? "driver" : "module";
+}
+
+/* microseconds, the unit chrome expects timestamps in */
+static double get_time(const trace::log &log, uint64_t timestamp) {
+  return log.elapsed(timestamp) / 1000.0;
+}
+
+static void write_span(FILE *file, const trace::log &log,
+                       const trace::loaded_event &loaded) {
+  const TRACE_EVENT &event = loaded.event;
+  double start = get_time(log, loaded.start());
+  double end = get_time(log, event.timestamp);
+
+  fprintf(file,
+          "{\"name\":\"%s\",\"cat\":\"check\",\"ph\":\"X\",\"ts\":%.3f,"
+          "\"dur\":%.3f,\"pid\":%u,\"tid\":%u,"
+          "\"args\":{\"result\":\"0x%llx\"}}",
+          TraceGetCheckName(static_cast<UINT16>(event.arguments[0])), start,
+          end - start, loaded.source, event.core,
+          (unsigned long long)event.arguments[2]);
+}
+
+static void write_instant(FILE *file, const trace::log &log,
+                          const trace::loaded_event &loaded) {
+  const TRACE_EVENT &event = loaded.event;
+  char message[256] = {0};
+
+  /* none of the formats produce characters that need escaping */
+  snprintf(message, sizeof(message), TraceGetEventFormat(event.id),
+           (unsigned long long)event.arguments[0],
+           (unsigned long long)event.arguments[1],
+           (unsigned long long)event.arguments[2],
+           (unsigned long long)event.arguments[3]);
+
+  fprintf(file,
+          "{\"name\":\"%s\",\"cat\":\"event\",\"ph\":\"i\",\"s\":\"t\","
+          "\"ts\":%.3f,\"pid\":%u,\"tid\":%u,"
+          "\"args\":{\"message\":\"%s\"}}",
+          TraceGetEventName(event.id), get_time(log, event.timestamp),
+          loaded.source, event.core, message);
+}
+
+bool trace::export_chrome(const log &log, const std::string &path) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+  const char *separator = "";
+  for (uint32_t source : {TRACE_SOURCE_DRIVER, TRACE_SOURCE_MODULE}) {
+    fprintf(file,
+            "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+            "\"args\":{\"name\":\"%s\"}}",
+            separator, source, get_source_name(source));
+    separator = ",\n";
+  }
+
+  for (const loaded_event &loaded : log.events()) {
+    fputs(separator, file);
+    if (loaded.is_span())
+      write_span(file, log, loaded);
+    else
+      write_instant(file, log, loaded);
+  }
+
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "failed to write %s\n", path.c_str());
+    return false;
+  }
+  return true;
+}
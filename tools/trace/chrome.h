@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "log.h"
+
+namespace trace {
+
+/*
+ * Writes the trace in the Chrome trace event JSON format, which both
+ * chrome://tracing and ui.perfetto.dev open. The driver and module are shown
+ * as separate processes with a track per cpu. Checks become complete events
+ * spanning their start and end, everything else an instant event.
+ */
+bool export_chrome(const log &log, const std::string &path);
+
+} // namespace trace
@@ -0,0 +1,187 @@
+#include "log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+static constexpr uint64_t NANOSECONDS_PER_SECOND = 1000000000ull;
+
+bool trace::log::load(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  TRACE_DRAIN_HEADER header = {};
+  std::vector<TRACE_EVENT> events;
+
+  while (fread(&header, sizeof(header), 1, file) == 1) {
+    if (header.magic != TRACE_MAGIC) {
+      fprintf(stderr, "corrupt drain at offset %lx\n",
+              ftell(file) - static_cast<long>(sizeof(header)));
+      fclose(file);
+      return false;
+    }
+
+    events.resize(header.event_count);
+    size_t read = fread(events.data(), sizeof(TRACE_EVENT),
+                        header.event_count, file);
+
+    for (size_t index = 0; index < read; index++)
+      this->loaded.push_back({events[index], header.source});
+
+    /* both sides stamp events with the same tsc */
+    if (header.frequency)
+      this->ticks_per_second = header.frequency;
+
+    this->lost_count += header.lost;
+    this->drain_count++;
+
+    if (read != header.event_count) {
+      this->truncated = true;
+      break;
+    }
+  }
+
+  if (!this->truncated && !feof(file))
+    this->truncated = true;
+
+  fclose(file);
+
+  if (!this->drain_count) {
+    fprintf(stderr, "%s is not a trace\n", path.c_str());
+    return false;
+  }
+
+  std::stable_sort(this->loaded.begin(), this->loaded.end(),
+                   [](const loaded_event &left, const loaded_event &right) {
+                     return left.event.timestamp < right.event.timestamp;
+                   });
+
+  this->first_timestamp = UINT64_MAX;
+  for (const loaded_event &event : this->loaded)
+    this->first_timestamp = std::min(this->first_timestamp, event.start());
+
+  return true;
+}
+
+uint64_t trace::log::elapsed(uint64_t timestamp) const {
+  if (!this->ticks_per_second || timestamp < this->first_timestamp)
+    return 0;
+  uint64_t ticks = timestamp - this->first_timestamp;
+  return static_cast<uint64_t>(static_cast<double>(ticks) *
+                               NANOSECONDS_PER_SECOND /
+                               this->ticks_per_second);
+}
+
+static uint64_t get_timestamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/* returns the number of events drained, or -1 if the write failed */
+static int64_t write_drain(FILE *file, PTRACE_BUFFER buffer,
+                           std::vector<uint8_t> &output) {
+  SIZE_T size = TraceDrain(buffer, output.data(), output.size());
+  if (fwrite(output.data(), 1, size, file) != size)
+    return -1;
+  return reinterpret_cast<PTRACE_DRAIN_HEADER>(output.data())->event_count;
+}
+
+/* stands in for a check doing some work */
+static void spin(uint64_t nanoseconds) {
+  uint64_t start = get_timestamp();
+  while (get_timestamp() - start < nanoseconds)
+    ;
+}
+
+bool trace::generate(const std::string &path,
+                     const generate_config &config) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  SIZE_T size = TraceGetBufferSize(config.cpu_count, config.capacity);
+  std::vector<uint8_t> driver_storage(size);
+  std::vector<uint8_t> module_storage(size);
+  PTRACE_BUFFER driver =
+      reinterpret_cast<PTRACE_BUFFER>(driver_storage.data());
+  PTRACE_BUFFER module =
+      reinterpret_cast<PTRACE_BUFFER>(module_storage.data());
+  std::vector<uint8_t> output(DRAIN_BUFFER_SIZE);
+
+  if (!NT_SUCCESS(TraceInitialise(driver, size, config.cpu_count,
+                                  config.capacity, NANOSECONDS_PER_SECOND,
+                                  TRACE_SOURCE_DRIVER)) ||
+      !NT_SUCCESS(TraceInitialise(module, size, config.cpu_count,
+                                  config.capacity, NANOSECONDS_PER_SECOND,
+                                  TRACE_SOURCE_MODULE))) {
+    fprintf(stderr, "invalid ring configuration\n");
+    fclose(file);
+    return false;
+  }
+
+  std::atomic<uint32_t> running = config.cpu_count;
+  std::vector<std::thread> writers;
+
+  for (uint32_t core = 0; core < config.cpu_count; core++) {
+    writers.emplace_back([&, core]() {
+      uint64_t module_start = 0;
+      uint64_t driver_start = 0;
+      for (uint32_t index = 0; index < config.events_per_cpu; index++) {
+        uint32_t step = index % config.check_period;
+        UINT16 check =
+            static_cast<UINT16>(1 + index / config.check_period %
+                                        (TRACE_CHECK_ID_MAX - 1));
+        if (step == 0) {
+          module_start = get_timestamp();
+          spin(2000);
+          driver_start = get_timestamp();
+        }
+        UINT16 id = static_cast<UINT16>(1 + index % (TRACE_CHECK_SPAN - 1));
+        TraceWrite(driver, core, get_timestamp(), id, index, core,
+                   0xfffff80000000000ull + index * 0x10, 0);
+        spin(500);
+        if (step == config.check_period - 1) {
+          TraceWriteSpan(driver, core, driver_start, get_timestamp(), check,
+                         0);
+          spin(2000);
+          TraceWriteSpan(module, core, module_start, get_timestamp(), check,
+                         0);
+        }
+      }
+      running--;
+    });
+  }
+
+  int64_t drained = 0;
+  while (running && drained >= 0) {
+    drained = write_drain(file, driver, output);
+    if (drained >= 0)
+      drained = write_drain(file, module, output);
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(config.drain_period_us));
+  }
+
+  for (std::thread &writer : writers)
+    writer.join();
+
+  /* whatever is left may take more than one drain */
+  for (PTRACE_BUFFER buffer : {driver, module}) {
+    do {
+      drained = drained >= 0 ? write_drain(file, buffer, output) : drained;
+    } while (drained > 0);
+  }
+
+  bool success = fclose(file) == 0 && drained == 0;
+
+  if (!success)
+    fprintf(stderr, "failed to write %s\n", path.c_str());
+  return success;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../core/trace.h"
+
+namespace trace {
+
+/* same size the module drains with */
+static constexpr uint32_t DRAIN_BUFFER_SIZE = 0x10000;
+
+struct loaded_event {
+  TRACE_EVENT event;
+  /* TRACE_SOURCE_DRIVER or TRACE_SOURCE_MODULE */
+  uint32_t source;
+
+  bool is_span() const { return this->event.id == TRACE_CHECK_SPAN; }
+  uint64_t start() const {
+    return this->is_span() ? this->event.arguments[1] : this->event.timestamp;
+  }
+};
+
+/*
+ * A trace file written by the module when DONNA_AC_TRACE is set. The file is
+ * every drain the module made, of both the driver's rings and its own, laid
+ * end to end, a TRACE_DRAIN_HEADER followed by its events. Events are only
+ * ordered within a single ring, so they are sorted by timestamp once loaded.
+ */
+class log {
+  std::vector<loaded_event> loaded;
+  uint64_t ticks_per_second = 0;
+  uint64_t first_timestamp = 0;
+  uint64_t lost_count = 0;
+  uint32_t drain_count = 0;
+  bool truncated = false;
+
+public:
+  bool load(const std::string &path);
+
+  const std::vector<loaded_event> &events() const { return this->loaded; }
+  uint64_t frequency() const { return this->ticks_per_second; }
+  uint64_t lost() const { return this->lost_count; }
+  uint32_t drains() const { return this->drain_count; }
+  bool is_truncated() const { return this->truncated; }
+
+  /* nanoseconds between the earliest timestamp in the trace and Timestamp */
+  uint64_t elapsed(uint64_t timestamp) const;
+};
+
+struct generate_config {
+  uint32_t cpu_count = 4;
+  uint32_t events_per_cpu = 100000;
+  /* instant events between checks */
+  uint32_t check_period = 16;
+  uint32_t capacity = TRACE_DEFAULT_CAPACITY;
+  /* how often the drain thread empties the rings, like the module's timer */
+  uint32_t drain_period_us = 1000;
+};
+
+/*
+ * Writes a synthetic trace using the same ring code the driver and module
+ * do, one writer thread per cpu racing a drain thread. Writers record checks
+ * as a driver span nested inside a module span, with instant events in
+ * between. Returns false on io errors.
+ */
+bool generate(const std::string &path, const generate_config &config);
+
+} // namespace trace
@@ -0,0 +1,145 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "chrome.h"
+#include "log.h"
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: ac_trace <trace> [--summary] [--chrome path]\n"
+          "       ac_trace --generate <trace> [--cpus n] [--events n]\n"
+          "\n"
+          "  --summary     only print per event counts\n"
+          "  --chrome path write chrome trace json, opens in ui.perfetto.dev\n"
+          "  --cpus n      writer threads, one ring each (default 4)\n"
+          "  --events n    events written per cpu (default 100000)\n"
+          "  --capacity n  events per ring, a power of two (default %u)\n"
+          "  --drain n     drain period in us (default 1000)\n",
+          TRACE_DEFAULT_CAPACITY);
+}
+
+static void print_event(const trace::log &log,
+                        const trace::loaded_event &loaded) {
+  const TRACE_EVENT &event = loaded.event;
+  const char *source =
+      loaded.source == TRACE_SOURCE_DRIVER ? "driver" : "module";
+  char message[256] = {0};
+
+  if (loaded.is_span())
+    snprintf(message, sizeof(message), "%s took %.3f us, result %llx",
+             TraceGetCheckName(static_cast<UINT16>(event.arguments[0])),
+             (log.elapsed(event.timestamp) - log.elapsed(loaded.start())) /
+                 1000.0,
+             (unsigned long long)event.arguments[2]);
+  else
+    snprintf(message, sizeof(message), TraceGetEventFormat(event.id),
+             (unsigned long long)event.arguments[0],
+             (unsigned long long)event.arguments[1],
+             (unsigned long long)event.arguments[2],
+             (unsigned long long)event.arguments[3]);
+
+  printf("%14.3f  %-6s %3u  %-24s %s\n",
+         log.elapsed(event.timestamp) / 1000.0, source, event.core,
+         TraceGetEventName(event.id), message);
+}
+
+static void print_summary(const trace::log &log) {
+  uint64_t counts[TRACE_EVENT_ID_MAX + 1] = {0};
+  for (const trace::loaded_event &loaded : log.events()) {
+    UINT16 id = loaded.event.id;
+    counts[id < TRACE_EVENT_ID_MAX ? id : TRACE_EVENT_ID_MAX]++;
+  }
+
+  printf("drains        %u\n", log.drains());
+  printf("events        %zu\n", log.events().size());
+  printf("lost          %llu\n", (unsigned long long)log.lost());
+  printf("duration      %.3f ms\n",
+         log.events().empty()
+             ? 0.0
+             : log.elapsed(log.events().back().event.timestamp) / 1000000.0);
+
+  for (uint32_t id = 0; id <= TRACE_EVENT_ID_MAX; id++) {
+    if (counts[id])
+      printf("  %-24s %llu\n", TraceGetEventName(static_cast<UINT16>(id)),
+             (unsigned long long)counts[id]);
+  }
+}
+
+/*
+ * Decodes the binary trace events drained from the driver, see core/trace.h.
+ * Traces come from the module (set DONNA_AC_TRACE) or from --generate.
+ */
+int main(int argc, char **argv) {
+  std::string input;
+  std::string output;
+  std::string chrome;
+  bool summary = false;
+  trace::generate_config generate;
+
+  for (int index = 1; index < argc; index++) {
+    const char *arg = argv[index];
+    const char *value = index + 1 < argc ? argv[index + 1] : nullptr;
+
+    if (arg[0] != '-') {
+      input = arg;
+      continue;
+    }
+
+    if (!strcmp(arg, "--summary")) {
+      summary = true;
+      continue;
+    }
+
+    if (!value) {
+      print_usage();
+      return 1;
+    }
+
+    if (!strcmp(arg, "--generate"))
+      output = value;
+    else if (!strcmp(arg, "--chrome"))
+      chrome = value;
+    else if (!strcmp(arg, "--cpus"))
+      generate.cpu_count = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--events"))
+      generate.events_per_cpu = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--capacity"))
+      generate.capacity = strtoul(value, nullptr, 10);
+    else if (!strcmp(arg, "--drain"))
+      generate.drain_period_us = strtoul(value, nullptr, 10);
+    else {
+      print_usage();
+      return 1;
+    }
+
+    index++;
+  }
+
+  if (!output.empty())
+    return trace::generate(output, generate) ? 0 : 1;
+
+  if (input.empty()) {
+    print_usage();
+    return 1;
+  }
+
+  trace::log log;
+  if (!log.load(input))
+    return 1;
+
+  if (log.is_truncated())
+    fprintf(stderr, "warning: trace is truncated\n");
+
+  if (!chrome.empty() && !trace::export_chrome(log, chrome))
+    return 1;
+
+  if (!summary && chrome.empty()) {
+    for (const trace::loaded_event &loaded : log.events())
+      print_event(log, loaded);
+  }
+
+  print_summary(log);
+  return 0;
+}